@@ -352,6 +352,9 @@ init_splite_internal_cache (struct splite_internal_cache *cache)
     gaiaOutBufferPtr out;
     int i;
     const char *tinyPoint;
+    const char *geosCacheSize;
+    const char *unionThreads;
+    const char *routingHeap;
     struct splite_geos_cache_item *p;
     struct splite_xmlSchema_cache_item *p_xmlSchema;
     if (cache == NULL)
@@ -413,19 +416,75 @@ init_splite_internal_cache (struct splite_internal_cache *cache)
     out = malloc (sizeof (gaiaOutBuffer));
     gaiaOutBufferInitialize (out);
     cache->xmlXPathErrors = out;
+/* initializing the ST_Union worker threads (0 = automatic) */
+    cache->unionThreads = 0;
+    unionThreads = getenv ("SPATIALITE_UNION_THREADS");
+    if (unionThreads != NULL)
+      {
+	  cache->unionThreads = atoi (unionThreads);
+	  if (cache->unionThreads < 0)
+	      cache->unionThreads = 0;
+	  if (cache->unionThreads > UNION_MAX_THREADS)
+	      cache->unionThreads = UNION_MAX_THREADS;
+      }
+    cache->unionPool = NULL;
+/* initializing the VirtualRouting priority queue (D-ary heap) */
+    cache->routingHeap = ROUTING_HEAP_DARY;
+    routingHeap = getenv ("SPATIALITE_ROUTING_HEAP");
+    if (routingHeap != NULL)
+      {
+	  if (strcasecmp (routingHeap, "RADIX") == 0)
+	      cache->routingHeap = ROUTING_HEAP_RADIX;
+      }
+/* the KNN R*Tree mirror is disabled by default */
+    cache->knnMirror = 0;
+    cache->knnMirrors = NULL;
 /* initializing the GEOS cache */
-    p = &(cache->cacheItem1);
-    memset (p->gaiaBlob, '\0', 64);
-    p->gaiaBlobSize = 0;
-    p->crc32 = 0;
-    p->geosGeom = NULL;
-    p->preparedGeosGeom = NULL;
-    p = &(cache->cacheItem2);
-    memset (p->gaiaBlob, '\0', 64);
-    p->gaiaBlobSize = 0;
-    p->crc32 = 0;
-    p->geosGeom = NULL;
-    p->preparedGeosGeom = NULL;
+    cache->geosCacheSize = GEOS_CACHE_DEFAULT_SIZE;
+    geosCacheSize = getenv ("SPATIALITE_GEOS_CACHE_SIZE");
+    if (geosCacheSize != NULL)
+      {
+	  cache->geosCacheSize = atoi (geosCacheSize);
+	  if (cache->geosCacheSize < 2)
+	      cache->geosCacheSize = 2;
+	  if (cache->geosCacheSize > GEOS_CACHE_MAX_SIZE)
+	      cache->geosCacheSize = GEOS_CACHE_MAX_SIZE;
+      }
+    cache->geosCache =
+	malloc (sizeof (struct splite_geos_cache_item) * cache->geosCacheSize);
+    if (cache->geosCache == NULL)
+	cache->geosCacheSize = 0;	/* insufficient memory: no caching at all */
+    for (i = 0; i < cache->geosCacheSize; i++)
+      {
+	  p = cache->geosCache + i;
+	  memset (p->gaiaBlob, '\0', 64);
+	  p->gaiaBlobSize = 0;
+	  p->crc32 = 0;
+	  p->adler32 = 0;
+	  p->lastUsed = 0;
+	  p->geosGeom = NULL;
+	  p->preparedGeosGeom = NULL;
+      }
+    cache->geosCacheTick = 0;
+    cache->geosCacheHits = 0;
+    cache->geosCacheMisses = 0;
+/* initializing the PROJ.4 caches */
+    for (i = 0; i < MAX_PROJ_CACHE; i++)
+      {
+	  struct splite_proj_cache_item *p_proj = &(cache->projCache[i]);
+	  p_proj->proj_from = NULL;
+	  p_proj->proj_to = NULL;
+	  p_proj->from_cs = NULL;
+	  p_proj->to_cs = NULL;
+	  p_proj->lastUsed = 0;
+      }
+    cache->projCacheTick = 0;
+    for (i = 0; i < MAX_SRID_CACHE; i++)
+      {
+	  cache->sridCache[i].srid = 0;
+	  cache->sridCache[i].proj_params = NULL;
+      }
+    cache->sridCacheNext = 0;
     for (i = 0; i < MAX_XMLSCHEMA_CACHE; i++)
       {
 	  /* initializing the XmlSchema cache */
@@ -703,8 +762,8 @@ free_internal_cache (struct splite_internal_cache *cache)
     GEOSContextHandle_t handle = NULL;
 #endif
 
-#ifdef ENABLE_LIBXML2
     int i;
+#ifdef ENABLE_LIBXML2
     struct splite_xmlSchema_cache_item *p_xmlSchema;
 #endif
 
@@ -714,7 +773,20 @@ free_internal_cache (struct splite_internal_cache *cache)
 	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
 	return;
 
+/* freeing the GEOS cache */
+    for (i = 0; i < cache->geosCacheSize; i++)
+      {
+	  p = cache->geosCache + i;
+	  splite_free_geos_cache_item_r (cache, p);
+      }
+    free (cache->geosCache);
+    cache->geosCache = NULL;
+
 #ifndef OMIT_GEOS
+/* stopping the ST_Union worker threads */
+    splite_union_pool_free (cache->unionPool);
+    cache->unionPool = NULL;
+
     handle = cache->GEOS_handle;
     if (handle != NULL)
 #ifdef GEOS_REENTRANT		/* reentrant (thread-safe) initialization */
@@ -726,6 +798,27 @@ free_internal_cache (struct splite_internal_cache *cache)
     gaiaResetGeosMsg_r (cache);
 #endif
 
+/* freeing the PROJ.4 caches */
+    for (i = 0; i < MAX_PROJ_CACHE; i++)
+      {
+	  struct splite_proj_cache_item *p_proj = &(cache->projCache[i]);
+#ifndef OMIT_PROJ
+	  if (p_proj->from_cs != NULL)
+	      pj_free (p_proj->from_cs);
+	  if (p_proj->to_cs != NULL)
+	      pj_free (p_proj->to_cs);
+#endif
+	  if (p_proj->proj_from != NULL)
+	      free (p_proj->proj_from);
+	  if (p_proj->proj_to != NULL)
+	      free (p_proj->proj_to);
+	  p_proj->proj_from = NULL;
+	  p_proj->proj_to = NULL;
+	  p_proj->from_cs = NULL;
+	  p_proj->to_cs = NULL;
+      }
+    splite_reset_srid_cache (cache);
+
 #ifndef OMIT_PROJ
     if (cache->PROJ_handle != NULL)
 	pj_ctx_free (cache->PROJ_handle);
@@ -754,11 +847,6 @@ free_internal_cache (struct splite_internal_cache *cache)
     free (cache->xmlSchemaValidationErrors);
     free (cache->xmlXPathErrors);
 
-/* freeing the GEOS cache */
-    p = &(cache->cacheItem1);
-    splite_free_geos_cache_item_r (cache, p);
-    p = &(cache->cacheItem2);
-    splite_free_geos_cache_item_r (cache, p);
 #ifdef ENABLE_LIBXML2
     for (i = 0; i < MAX_XMLSCHEMA_CACHE; i++)
       {
@@ -785,6 +873,10 @@ free_internal_cache (struct splite_internal_cache *cache)
     cache->SqlProcLog = NULL;
     free_sequences (cache);
     free_shp_extents (cache);
+#ifndef OMIT_KNN		/* only if KNN is enabled */
+    free_knn_mirrors (cache->knnMirrors);
+    cache->knnMirrors = NULL;
+#endif /* end KNN conditional */
 
     spatialite_finalize_topologies (cache);
 
@@ -1138,6 +1230,9 @@ spatialite_shutdown (void)
     if (!gaia_already_initialized)
 	return;
 
+/* freeing any idle NETWORK still cached by VirtualRouting */
+    splite_routing_cache_cleanup ();
+
 #if defined(_WIN32) && !defined(__MINGW32__)
     DeleteCriticalSection (&gaia_cache_semaphore);
 #endif
@@ -1227,3 +1322,97 @@ is_tiny_point_enabled (const void *p_cache)
 	return 0;
     return cache->tinyPointEnabled;
 }
+
+SPATIALITE_DECLARE void
+set_geos_cache_size (const void *p_cache, int size)
+{
+/* resizing the internal GEOS cache (LRU) */
+    int i;
+    struct splite_geos_cache_item *items;
+    struct splite_geos_cache_item *p;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return;
+    if (size < 2)
+	size = 2;
+    if (size > GEOS_CACHE_MAX_SIZE)
+	size = GEOS_CACHE_MAX_SIZE;
+    items = malloc (sizeof (struct splite_geos_cache_item) * size);
+    if (items == NULL)
+	return;
+
+/* discarding all currently cached items */
+    for (i = 0; i < cache->geosCacheSize; i++)
+      {
+	  p = cache->geosCache + i;
+	  splite_free_geos_cache_item_r (cache, p);
+      }
+    free (cache->geosCache);
+
+    for (i = 0; i < size; i++)
+      {
+	  p = items + i;
+	  memset (p->gaiaBlob, '\0', 64);
+	  p->gaiaBlobSize = 0;
+	  p->crc32 = 0;
+	  p->adler32 = 0;
+	  p->lastUsed = 0;
+	  p->geosGeom = NULL;
+	  p->preparedGeosGeom = NULL;
+      }
+    cache->geosCache = items;
+    cache->geosCacheSize = size;
+    cache->geosCacheTick = 0;
+}
+
+SPATIALITE_DECLARE int
+get_geos_cache_size (const void *p_cache)
+{
+/* returning the current size of the internal GEOS cache */
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return -1;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return -1;
+    return cache->geosCacheSize;
+}
+
+SPATIALITE_DECLARE int
+get_geos_cache_stats (const void *p_cache, unsigned long *hits,
+		      unsigned long *misses)
+{
+/* returning the hit/miss counters of the internal GEOS cache */
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    *hits = 0;
+    *misses = 0;
+    if (cache == NULL)
+	return 0;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return 0;
+    *hits = cache->geosCacheHits;
+    *misses = cache->geosCacheMisses;
+    return 1;
+}
+
+SPATIALITE_DECLARE void
+reset_geos_cache_stats (const void *p_cache)
+{
+/* resetting the hit/miss counters of the internal GEOS cache */
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return;
+    cache->geosCacheHits = 0;
+    cache->geosCacheMisses = 0;
+}
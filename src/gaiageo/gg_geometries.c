@@ -2919,116 +2919,16 @@ gaiaDimension (gaiaGeomCollPtr geom)
     return 2;
 }
 
-GAIAGEO_DECLARE int
-gaiaGeometryType (gaiaGeomCollPtr geom)
+static int
+doGeometryClass (int n_points, int n_linestrings, int n_polygons, int dm,
+		 int declared_type)
 {
-/* determines the Class for this geometry */
-    gaiaPointPtr point;
-    gaiaLinestringPtr line;
-    gaiaPolygonPtr polyg;
-    gaiaRingPtr ring;
-    int ib;
-    int n_points = 0;
-    int n_linestrings = 0;
-    int n_polygons = 0;
-    int dm = GAIA_XY;
-    if (!geom)
-	return GAIA_UNKNOWN;
-    point = geom->FirstPoint;
-    while (point)
-      {
-	  /* counts how many points are there */
-	  n_points++;
-	  if (point->DimensionModel == GAIA_XY_Z)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_Z;
-		else if (dm == GAIA_XY_M)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (point->DimensionModel == GAIA_XY_M)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_M;
-		else if (dm == GAIA_XY_Z)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (point->DimensionModel == GAIA_XY_Z_M)
-	      dm = GAIA_XY_Z_M;
-	  point = point->Next;
-      }
-    line = geom->FirstLinestring;
-    while (line)
-      {
-	  /* counts how many linestrings are there */
-	  n_linestrings++;
-	  if (line->DimensionModel == GAIA_XY_Z)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_Z;
-		else if (dm == GAIA_XY_M)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (line->DimensionModel == GAIA_XY_M)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_M;
-		else if (dm == GAIA_XY_Z)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (line->DimensionModel == GAIA_XY_Z_M)
-	      dm = GAIA_XY_Z_M;
-	  line = line->Next;
-      }
-    polyg = geom->FirstPolygon;
-    while (polyg)
-      {
-	  /* counts how many polygons are there */
-	  n_polygons++;
-	  ring = polyg->Exterior;
-	  if (ring->DimensionModel == GAIA_XY_Z)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_Z;
-		else if (dm == GAIA_XY_M)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (ring->DimensionModel == GAIA_XY_M)
-	    {
-		if (dm == GAIA_XY)
-		    dm = GAIA_XY_M;
-		else if (dm == GAIA_XY_Z)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  else if (ring->DimensionModel == GAIA_XY_Z_M)
-	      dm = GAIA_XY_Z_M;
-	  for (ib = 0; ib < polyg->NumInteriors; ib++)
-	    {
-		ring = polyg->Interiors + ib;
-		if (ring->DimensionModel == GAIA_XY_Z)
-		  {
-		      if (dm == GAIA_XY)
-			  dm = GAIA_XY_Z;
-		      else if (dm == GAIA_XY_M)
-			  dm = GAIA_XY_Z_M;
-		  }
-		else if (ring->DimensionModel == GAIA_XY_M)
-		  {
-		      if (dm == GAIA_XY)
-			  dm = GAIA_XY_M;
-		      else if (dm == GAIA_XY_Z)
-			  dm = GAIA_XY_Z_M;
-		  }
-		else if (ring->DimensionModel == GAIA_XY_Z_M)
-		    dm = GAIA_XY_Z_M;
-	    }
-	  polyg = polyg->Next;
-      }
+/* determines the Class from the elementary items and the declared type */
     if (n_points == 0 && n_linestrings == 0 && n_polygons == 0)
 	return GAIA_UNKNOWN;
     if (n_points == 1 && n_linestrings == 0 && n_polygons == 0)
       {
-	  if (geom->DeclaredType == GAIA_MULTIPOINT)
+	  if (declared_type == GAIA_MULTIPOINT)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_MULTIPOINTZ;
@@ -3039,7 +2939,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
 		else
 		    return GAIA_MULTIPOINT;
 	    }
-	  else if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  else if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3064,7 +2964,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
       }
     if (n_points > 0 && n_linestrings == 0 && n_polygons == 0)
       {
-	  if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3089,7 +2989,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
       }
     if (n_points == 0 && n_linestrings == 1 && n_polygons == 0)
       {
-	  if (geom->DeclaredType == GAIA_MULTILINESTRING)
+	  if (declared_type == GAIA_MULTILINESTRING)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_MULTILINESTRINGZ;
@@ -3100,7 +3000,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
 		else
 		    return GAIA_MULTILINESTRING;
 	    }
-	  else if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  else if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3125,7 +3025,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
       }
     if (n_points == 0 && n_linestrings > 0 && n_polygons == 0)
       {
-	  if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3150,7 +3050,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
       }
     if (n_points == 0 && n_linestrings == 0 && n_polygons == 1)
       {
-	  if (geom->DeclaredType == GAIA_MULTIPOLYGON)
+	  if (declared_type == GAIA_MULTIPOLYGON)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_MULTIPOLYGONZ;
@@ -3161,7 +3061,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
 		else
 		    return GAIA_MULTIPOLYGON;
 	    }
-	  else if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  else if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3186,7 +3086,7 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
       }
     if (n_points == 0 && n_linestrings == 0 && n_polygons > 0)
       {
-	  if (geom->DeclaredType == GAIA_GEOMETRYCOLLECTION)
+	  if (declared_type == GAIA_GEOMETRYCOLLECTION)
 	    {
 		if (dm == GAIA_XY_Z)
 		    return GAIA_GEOMETRYCOLLECTIONZ;
@@ -3219,6 +3119,143 @@ gaiaGeometryType (gaiaGeomCollPtr geom)
 	return GAIA_GEOMETRYCOLLECTION;
 }
 
+GAIAGEO_DECLARE int
+gaiaGeometryType (gaiaGeomCollPtr geom)
+{
+/* determines the Class for this geometry */
+    gaiaPointPtr point;
+    gaiaLinestringPtr line;
+    gaiaPolygonPtr polyg;
+    gaiaRingPtr ring;
+    int ib;
+    int n_points = 0;
+    int n_linestrings = 0;
+    int n_polygons = 0;
+    int dm = GAIA_XY;
+    if (!geom)
+	return GAIA_UNKNOWN;
+    point = geom->FirstPoint;
+    while (point)
+      {
+	  /* counts how many points are there */
+	  n_points++;
+	  if (point->DimensionModel == GAIA_XY_Z)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_Z;
+		else if (dm == GAIA_XY_M)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (point->DimensionModel == GAIA_XY_M)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_M;
+		else if (dm == GAIA_XY_Z)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (point->DimensionModel == GAIA_XY_Z_M)
+	      dm = GAIA_XY_Z_M;
+	  point = point->Next;
+      }
+    line = geom->FirstLinestring;
+    while (line)
+      {
+	  /* counts how many linestrings are there */
+	  n_linestrings++;
+	  if (line->DimensionModel == GAIA_XY_Z)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_Z;
+		else if (dm == GAIA_XY_M)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (line->DimensionModel == GAIA_XY_M)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_M;
+		else if (dm == GAIA_XY_Z)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (line->DimensionModel == GAIA_XY_Z_M)
+	      dm = GAIA_XY_Z_M;
+	  line = line->Next;
+      }
+    polyg = geom->FirstPolygon;
+    while (polyg)
+      {
+	  /* counts how many polygons are there */
+	  n_polygons++;
+	  ring = polyg->Exterior;
+	  if (ring->DimensionModel == GAIA_XY_Z)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_Z;
+		else if (dm == GAIA_XY_M)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (ring->DimensionModel == GAIA_XY_M)
+	    {
+		if (dm == GAIA_XY)
+		    dm = GAIA_XY_M;
+		else if (dm == GAIA_XY_Z)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  else if (ring->DimensionModel == GAIA_XY_Z_M)
+	      dm = GAIA_XY_Z_M;
+	  for (ib = 0; ib < polyg->NumInteriors; ib++)
+	    {
+		ring = polyg->Interiors + ib;
+		if (ring->DimensionModel == GAIA_XY_Z)
+		  {
+		      if (dm == GAIA_XY)
+			  dm = GAIA_XY_Z;
+		      else if (dm == GAIA_XY_M)
+			  dm = GAIA_XY_Z_M;
+		  }
+		else if (ring->DimensionModel == GAIA_XY_M)
+		  {
+		      if (dm == GAIA_XY)
+			  dm = GAIA_XY_M;
+		      else if (dm == GAIA_XY_Z)
+			  dm = GAIA_XY_Z_M;
+		  }
+		else if (ring->DimensionModel == GAIA_XY_Z_M)
+		    dm = GAIA_XY_Z_M;
+	    }
+	  polyg = polyg->Next;
+      }
+    return doGeometryClass (n_points, n_linestrings, n_polygons, dm,
+			    geom->DeclaredType);
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewGeometryType (gaiaGeomViewPtr view)
+{
+/* determines the Class for this geometry view */
+    if (!view)
+	return GAIA_UNKNOWN;
+    return doGeometryClass (view->NumPoints, view->NumLinestrings,
+			    view->NumPolygons, view->ItemsDimensionModel,
+			    view->DeclaredType);
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewDimension (gaiaGeomViewPtr view)
+{
+/* determines the Dimension for this geometry view */
+    if (!view)
+	return -1;
+    if (view->NumPoints == 0 && view->NumLinestrings == 0
+	&& view->NumPolygons == 0)
+	return -1;
+    if (view->NumPoints > 0 && view->NumLinestrings == 0
+	&& view->NumPolygons == 0)
+	return 0;
+    if (view->NumLinestrings > 0 && view->NumPolygons == 0)
+	return 1;
+    return 2;
+}
+
 GAIAGEO_DECLARE int
 gaiaGeometryAliasType (gaiaGeomCollPtr geom)
 {
@@ -357,7 +357,7 @@ splite_mbr_equals (gaiaGeomCollPtr g1, gaiaGeomCollPtr g2)
 
 static int
 evalGeosCacheItem (unsigned char *blob, int blob_size, uLong crc,
-		   struct splite_geos_cache_item *p)
+		   uLong adler, struct splite_geos_cache_item *p)
 {
 /* evaluting if this one could be a valid cache hit */
     if (blob_size != p->gaiaBlobSize)
@@ -365,9 +365,9 @@ evalGeosCacheItem (unsigned char *blob, int blob_size, uLong crc,
 	  /* surely not a match; different size */
 	  return 0;
       }
-    if (crc != p->crc32)
+    if (crc != p->crc32 || adler != p->adler32)
       {
-	  /* surely not a match: different CRC32 */
+	  /* surely not a match: different CRC32 / Adler32 */
 	  return 0;
       }
 
@@ -379,6 +379,99 @@ evalGeosCacheItem (unsigned char *blob, int blob_size, uLong crc,
     return 0;
 }
 
+static void
+touchGeosCacheItem (struct splite_internal_cache *cache,
+		    struct splite_geos_cache_item *p)
+{
+/* marking a cache item as the most recently used one */
+    int i;
+    cache->geosCacheTick += 1;
+    if (cache->geosCacheTick == 0)
+      {
+	  /* the tick counter wrapped around: restarting from scratch */
+	  for (i = 0; i < cache->geosCacheSize; i++)
+	      cache->geosCache[i].lastUsed = 0;
+	  cache->geosCacheTick = 1;
+      }
+    p->lastUsed = cache->geosCacheTick;
+}
+
+static struct splite_geos_cache_item *
+findGeosCacheItem (struct splite_internal_cache *cache, unsigned char *blob,
+		   int blob_size, uLong crc, uLong adler)
+{
+/* searching a matching item within the GEOS cache */
+    int i;
+    for (i = 0; i < cache->geosCacheSize; i++)
+      {
+	  struct splite_geos_cache_item *p = cache->geosCache + i;
+	  if (p->gaiaBlobSize == 0)
+	      continue;
+	  if (evalGeosCacheItem (blob, blob_size, crc, adler, p))
+	      return p;
+      }
+    return NULL;
+}
+
+static void
+storeGeosCacheItem (struct splite_internal_cache *cache,
+		    GEOSContextHandle_t handle, unsigned char *blob,
+		    int blob_size, uLong crc, uLong adler)
+{
+/* replacing the Least Recently Used item of the GEOS cache */
+    int i;
+    struct splite_geos_cache_item *lru = NULL;
+    for (i = 0; i < cache->geosCacheSize; i++)
+      {
+	  struct splite_geos_cache_item *p = cache->geosCache + i;
+	  if (lru == NULL || p->lastUsed < lru->lastUsed)
+	      lru = p;
+	  if (p->gaiaBlobSize == 0)
+	      break;
+      }
+    if (lru == NULL)
+	return;
+    memcpy (lru->gaiaBlob, blob, 46);
+    lru->gaiaBlobSize = blob_size;
+    lru->crc32 = crc;
+    lru->adler32 = adler;
+    if (lru->preparedGeosGeom)
+	GEOSPreparedGeom_destroy_r (handle, lru->preparedGeosGeom);
+    if (lru->geosGeom)
+	GEOSGeom_destroy_r (handle, lru->geosGeom);
+    lru->geosGeom = NULL;
+    lru->preparedGeosGeom = NULL;
+    touchGeosCacheItem (cache, lru);
+}
+
+static int
+prepareGeosCacheItem (struct splite_internal_cache *cache,
+		      GEOSContextHandle_t handle, gaiaGeomCollPtr geom,
+		      struct splite_geos_cache_item *p)
+{
+/* lazily preparing the GeosGeometry of a cache item */
+    touchGeosCacheItem (cache, p);
+    if (p->preparedGeosGeom == NULL)
+      {
+	  /* preparing the GeosGeometries */
+	  p->geosGeom = gaiaToGeos_r (cache, geom);
+	  if (p->geosGeom)
+	    {
+		p->preparedGeosGeom =
+		    (void *) GEOSPrepare_r (handle, p->geosGeom);
+		if (p->preparedGeosGeom == NULL)
+		  {
+		      /* unexpected failure */
+		      GEOSGeom_destroy_r (handle, p->geosGeom);
+		      p->geosGeom = NULL;
+		  }
+	    }
+      }
+    if (p->preparedGeosGeom)
+	return 1;
+    return 0;
+}
+
 static int
 sniffTinyPointBlob (const unsigned char *blob, const int size)
 {
@@ -530,11 +623,12 @@ evalGeosCache (struct splite_internal_cache *cache, gaiaGeomCollPtr geom1,
 	       const int size2, GEOSPreparedGeometry ** gPrep,
 	       gaiaGeomCollPtr * geom)
 {
-/* handling the internal GEOS cache */
-    struct splite_geos_cache_item *p1 = &(cache->cacheItem1);
-    struct splite_geos_cache_item *p2 = &(cache->cacheItem2);
+/* handling the internal GEOS cache (LRU) */
+    struct splite_geos_cache_item *p;
     uLong crc1;
     uLong crc2;
+    uLong adler1;
+    uLong adler2;
     unsigned char *tiny1 = NULL;
     unsigned char *tiny2 = NULL;
     unsigned char *p_blob1;
@@ -552,6 +646,8 @@ evalGeosCache (struct splite_internal_cache *cache, gaiaGeomCollPtr geom1,
     handle = cache->GEOS_handle;
     if (handle == NULL)
 	return 0;
+    if (cache->geosCache == NULL)
+	return 0;
 
     if (sniffTinyPointBlob (blob1, size1))
       {
@@ -576,93 +672,55 @@ evalGeosCache (struct splite_internal_cache *cache, gaiaGeomCollPtr geom1,
 	  sz2 = size2;
       }
     crc1 = crc32 (0L, p_blob1, sz1);
+    adler1 = adler32 (1L, p_blob1, sz1);
     crc2 = crc32 (0L, p_blob2, sz2);
+    adler2 = adler32 (1L, p_blob2, sz2);
 
-/* checking the first cache item */
-    if (evalGeosCacheItem (p_blob1, sz1, crc1, p1))
+/* checking the first geometry */
+    p = findGeosCacheItem (cache, p_blob1, sz1, crc1, adler1);
+    if (p != NULL)
       {
 	  /* found a matching item */
-	  if (p1->preparedGeosGeom == NULL)
-	    {
-		/* preparing the GeosGeometries */
-		p1->geosGeom = gaiaToGeos_r (cache, geom1);
-		if (p1->geosGeom)
-		  {
-		      p1->preparedGeosGeom =
-			  (void *) GEOSPrepare_r (handle, p1->geosGeom);
-		      if (p1->preparedGeosGeom == NULL)
-			{
-			    /* unexpected failure */
-			    GEOSGeom_destroy_r (handle, p1->geosGeom);
-			    p1->geosGeom = NULL;
-			}
-		  }
-	    }
-	  if (p1->preparedGeosGeom)
+	  if (prepareGeosCacheItem (cache, handle, geom1, p))
 	    {
 		/* returning the corresponding GeosPreparedGeometry */
-		*gPrep = p1->preparedGeosGeom;
+		*gPrep = p->preparedGeosGeom;
 		*geom = geom2;
+		cache->geosCacheHits += 1;
 		retcode = 1;
 		goto end;
 	    }
+	  cache->geosCacheMisses += 1;
 	  retcode = 0;
 	  goto end;
       }
 
-/* checking the second cache item */
-    if (evalGeosCacheItem (p_blob2, sz2, crc2, p2))
+/* checking the second geometry */
+    p = findGeosCacheItem (cache, p_blob2, sz2, crc2, adler2);
+    if (p != NULL)
       {
 	  /* found a matching item */
-	  if (p2->preparedGeosGeom == NULL)
-	    {
-		/* preparing the GeosGeometries */
-		p2->geosGeom = gaiaToGeos_r (cache, geom2);
-		if (p2->geosGeom)
-		  {
-		      p2->preparedGeosGeom =
-			  (void *) GEOSPrepare_r (handle, p2->geosGeom);
-		      if (p2->preparedGeosGeom == NULL)
-			{
-			    /* unexpected failure */
-			    GEOSGeom_destroy_r (handle, p2->geosGeom);
-			    p2->geosGeom = NULL;
-			}
-		  }
-	    }
-	  if (p2->preparedGeosGeom)
+	  if (prepareGeosCacheItem (cache, handle, geom2, p))
 	    {
 		/* returning the corresponding GeosPreparedGeometry */
-		*gPrep = p2->preparedGeosGeom;
+		*gPrep = p->preparedGeosGeom;
 		*geom = geom1;
+		cache->geosCacheHits += 1;
 		retcode = 1;
 		goto end;
 	    }
+	  cache->geosCacheMisses += 1;
 	  retcode = 0;
 	  goto end;
       }
 
-/* updating the GEOS cache item#1 */
-    memcpy (p1->gaiaBlob, p_blob1, 46);
-    p1->gaiaBlobSize = sz1;
-    p1->crc32 = crc1;
-    if (p1->preparedGeosGeom)
-	GEOSPreparedGeom_destroy_r (handle, p1->preparedGeosGeom);
-    if (p1->geosGeom)
-	GEOSGeom_destroy_r (handle, p1->geosGeom);
-    p1->geosGeom = NULL;
-    p1->preparedGeosGeom = NULL;
-
-/* updating the GEOS cache item#2 */
-    memcpy (p2->gaiaBlob, p_blob2, 46);
-    p2->gaiaBlobSize = sz2;
-    p2->crc32 = crc2;
-    if (p2->preparedGeosGeom)
-	GEOSPreparedGeom_destroy_r (handle, p2->preparedGeosGeom);
-    if (p2->geosGeom)
-	GEOSGeom_destroy_r (handle, p2->geosGeom);
-    p2->geosGeom = NULL;
-    p2->preparedGeosGeom = NULL;
+/* 
+/ not yet cached: both geometries will be remembered
+/ and will be eventually prepared when seen again
+*/
+    storeGeosCacheItem (cache, handle, p_blob1, sz1, crc1, adler1);
+    storeGeosCacheItem (cache, handle, p_blob2, sz2, crc2, adler2);
+    cache->geosCacheMisses += 1;
     retcode = 0;
 
   end:
@@ -44,6 +44,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 */
 
 #include <sys/types.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -1626,26 +1627,226 @@ gaiaDegsToRads (double degs)
     return degs * DEG_TO_RAD;
 }
 
-static gaiaGeomCollPtr
-gaiaTransformCommon (projCtx handle, gaiaGeomCollPtr org, char *proj_from,
-		     char *proj_to, int ignore_zm)
+static int
+getCachedProjPair (struct splite_internal_cache *cache, projCtx handle,
+		   const char *proj_from, const char *proj_to,
+		   projPJ * from_cs, projPJ * to_cs)
 {
-/* creates a new GEOMETRY reprojecting coordinates from the original one */
-    int ib;
-    int cnt;
+/* 
+/ attempting to reuse a cached pair of PROJ.4 objects
+/ (or to initialize and cache a new pair)
+/
+/ returns 1 if the returned objects belong to the cache, 0 otherwise
+*/
     int i;
+    int len;
+    struct splite_proj_cache_item *p;
+    struct splite_proj_cache_item *lru = NULL;
+    *from_cs = NULL;
+    *to_cs = NULL;
+    for (i = 0; i < MAX_PROJ_CACHE; i++)
+      {
+	  p = &(cache->projCache[i]);
+	  if (p->proj_from == NULL || p->proj_to == NULL)
+	      continue;
+	  if (strcmp (p->proj_from, proj_from) == 0
+	      && strcmp (p->proj_to, proj_to) == 0)
+	    {
+		/* cache hit */
+		*from_cs = p->from_cs;
+		*to_cs = p->to_cs;
+		cache->projCacheTick += 1;
+		p->lastUsed = cache->projCacheTick;
+		return 1;
+	    }
+      }
+
+/* initializing a new pair of PROJ.4 objects */
+    *from_cs = pj_init_plus_ctx (handle, proj_from);
+    *to_cs = pj_init_plus_ctx (handle, proj_to);
+    if (*from_cs == NULL || *to_cs == NULL)
+	return 0;
+
+/* replacing the Least Recently Used cache item */
+    for (i = 0; i < MAX_PROJ_CACHE; i++)
+      {
+	  p = &(cache->projCache[i]);
+	  if (lru == NULL || p->lastUsed < lru->lastUsed)
+	      lru = p;
+      }
+    if (lru->from_cs != NULL)
+	pj_free (lru->from_cs);
+    if (lru->to_cs != NULL)
+	pj_free (lru->to_cs);
+    if (lru->proj_from != NULL)
+	free (lru->proj_from);
+    if (lru->proj_to != NULL)
+	free (lru->proj_to);
+    len = strlen (proj_from);
+    lru->proj_from = malloc (len + 1);
+    strcpy (lru->proj_from, proj_from);
+    len = strlen (proj_to);
+    lru->proj_to = malloc (len + 1);
+    strcpy (lru->proj_to, proj_to);
+    lru->from_cs = *from_cs;
+    lru->to_cs = *to_cs;
+    cache->projCacheTick += 1;
+    if (cache->projCacheTick == 0)
+      {
+	  /* the tick counter wrapped around: restarting from scratch */
+	  for (i = 0; i < MAX_PROJ_CACHE; i++)
+	      cache->projCache[i].lastUsed = 0;
+	  cache->projCacheTick = 1;
+      }
+    lru->lastUsed = cache->projCacheTick;
+    return 1;
+}
+
+struct transform_buffers
+{
+/* contiguous coordinate arrays for a batched reprojection */
     double *xx;
     double *yy;
     double *zz;
-    double *old_zz = NULL;
-    double *mm = NULL;
+    double *old_zz;
+    double *mm;
+    int from_angle;
+    int to_angle;
+    int ignore_zm;
+};
+
+static void
+transformGather (struct transform_buffers *buf, int base, double *coords,
+		 int points, int dimension_model)
+{
+/* copying a coordinate array into the transform buffers */
+    int i;
     double x;
     double y;
     double z = 0.0;
     double m = 0.0;
-    int error = 0;
-    int from_angle;
-    int to_angle;
+    int has_z = (dimension_model == GAIA_XY_Z
+		 || dimension_model == GAIA_XY_Z_M);
+    int has_m = (dimension_model == GAIA_XY_M
+		 || dimension_model == GAIA_XY_Z_M);
+    for (i = 0; i < points; i++)
+      {
+	  int k = base + i;
+	  if (dimension_model == GAIA_XY_Z)
+	    {
+		gaiaGetPointXYZ (coords, i, &x, &y, &z);
+	    }
+	  else if (dimension_model == GAIA_XY_M)
+	    {
+		gaiaGetPointXYM (coords, i, &x, &y, &m);
+	    }
+	  else if (dimension_model == GAIA_XY_Z_M)
+	    {
+		gaiaGetPointXYZM (coords, i, &x, &y, &z, &m);
+	    }
+	  else
+	    {
+		gaiaGetPoint (coords, i, &x, &y);
+	    }
+	  if (buf->from_angle)
+	    {
+		buf->xx[k] = gaiaDegsToRads (x);
+		buf->yy[k] = gaiaDegsToRads (y);
+	    }
+	  else
+	    {
+		buf->xx[k] = x;
+		buf->yy[k] = y;
+	    }
+	  buf->zz[k] = has_z ? z : 0.0;
+	  if (buf->ignore_zm && has_z && buf->old_zz != NULL)
+	    {
+		buf->zz[k] = 0.0;
+		buf->old_zz[k] = z;
+	    }
+	  if (has_m && buf->mm != NULL)
+	      buf->mm[k] = m;
+      }
+}
+
+static void
+transformGetXYZM (struct transform_buffers *buf, int k, int dimension_model,
+		  double *x, double *y, double *z, double *m)
+{
+/* fetching a reprojected vertex from the transform buffers */
+    int has_z = (dimension_model == GAIA_XY_Z
+		 || dimension_model == GAIA_XY_Z_M);
+    int has_m = (dimension_model == GAIA_XY_M
+		 || dimension_model == GAIA_XY_Z_M);
+    if (buf->to_angle)
+      {
+	  *x = gaiaRadsToDegs (buf->xx[k]);
+	  *y = gaiaRadsToDegs (buf->yy[k]);
+      }
+    else
+      {
+	  *x = buf->xx[k];
+	  *y = buf->yy[k];
+      }
+    *z = has_z ? buf->zz[k] : 0.0;
+    if (buf->ignore_zm && has_z && buf->old_zz != NULL)
+	*z = buf->old_zz[k];
+    *m = (has_m && buf->mm != NULL) ? buf->mm[k] : 0.0;
+}
+
+static void
+transformScatter (struct transform_buffers *buf, int base, double *coords,
+		  int points, int src_dimension_model, int dst_dimension_model)
+{
+/* copying the reprojected vertices into a coordinate array */
+    int i;
+    double x;
+    double y;
+    double z;
+    double m;
+    for (i = 0; i < points; i++)
+      {
+	  transformGetXYZM (buf, base + i, src_dimension_model, &x, &y, &z,
+			    &m);
+	  if (dst_dimension_model == GAIA_XY_Z)
+	    {
+		gaiaSetPointXYZ (coords, i, x, y, z);
+	    }
+	  else if (dst_dimension_model == GAIA_XY_M)
+	    {
+		gaiaSetPointXYM (coords, i, x, y, m);
+	    }
+	  else if (dst_dimension_model == GAIA_XY_Z_M)
+	    {
+		gaiaSetPointXYZM (coords, i, x, y, z, m);
+	    }
+	  else
+	    {
+		gaiaSetPoint (coords, i, x, y);
+	    }
+      }
+}
+
+static gaiaGeomCollPtr
+gaiaTransformCommon (struct splite_internal_cache *cache, projCtx handle,
+		     gaiaGeomCollPtr org, char *proj_from, char *proj_to,
+		     int ignore_zm)
+{
+/* 
+/ creates a new GEOMETRY reprojecting coordinates from the original one
+/
+/ all vertices (Points, Linestrings and Rings) are gathered into
+/ contiguous arrays, so to be reprojected by a single call to
+/ pj_transform(), and are then scattered back into the new GEOMETRY
+*/
+    int ib;
+    int cnt;
+    int k;
+    double x;
+    double y;
+    double z;
+    double m;
+    struct transform_buffers buf;
     gaiaPointPtr pt;
     gaiaLinestringPtr ln;
     gaiaLinestringPtr dst_ln;
@@ -1655,8 +1856,13 @@ gaiaTransformCommon (projCtx handle, gaiaGeomCollPtr org, char *proj_from,
     gaiaRingPtr dst_rng;
     projPJ from_cs;
     projPJ to_cs;
+    int cached = 0;
     gaiaGeomCollPtr dst;
-    if (handle != NULL)
+    if (cache != NULL && handle != NULL)
+	cached =
+	    getCachedProjPair (cache, handle, proj_from, proj_to, &from_cs,
+			       &to_cs);
+    else if (handle != NULL)
       {
 	  from_cs = pj_init_plus_ctx (handle, proj_from);
 	  to_cs = pj_init_plus_ctx (handle, proj_to);
@@ -1686,529 +1892,165 @@ gaiaTransformCommon (projCtx handle, gaiaGeomCollPtr org, char *proj_from,
     else
 	dst = gaiaAllocGeomColl ();
 /* setting up projection parameters */
-    from_angle = gaiaIsLongLat (proj_from);
-    to_angle = gaiaIsLongLat (proj_to);
+    memset (&buf, 0, sizeof (struct transform_buffers));
+    buf.from_angle = gaiaIsLongLat (proj_from);
+    buf.to_angle = gaiaIsLongLat (proj_to);
+    buf.ignore_zm = ignore_zm;
+
+/* counting all vertices */
     cnt = 0;
     pt = org->FirstPoint;
     while (pt)
       {
-	  /* counting POINTs */
 	  cnt++;
 	  pt = pt->Next;
       }
-    if (cnt)
-      {
-	  /* reprojecting POINTs */
-	  xx = malloc (sizeof (double) * cnt);
-	  yy = malloc (sizeof (double) * cnt);
-	  zz = malloc (sizeof (double) * cnt);
-	  if (ignore_zm
-	      && (org->DimensionModel == GAIA_XY_Z
-		  || org->DimensionModel == GAIA_XY_Z_M))
-	      old_zz = malloc (sizeof (double) * cnt);
-	  if (org->DimensionModel == GAIA_XY_M
-	      || org->DimensionModel == GAIA_XY_Z_M)
-	      mm = malloc (sizeof (double) * cnt);
-	  i = 0;
-	  pt = org->FirstPoint;
-	  while (pt)
-	    {
-		/* inserting points to be converted in temporary arrays */
-		if (from_angle)
-		  {
-		      xx[i] = gaiaDegsToRads (pt->X);
-		      yy[i] = gaiaDegsToRads (pt->Y);
-		  }
-		else
-		  {
-		      xx[i] = pt->X;
-		      yy[i] = pt->Y;
-		  }
-		if (org->DimensionModel == GAIA_XY_Z
-		    || org->DimensionModel == GAIA_XY_Z_M)
-		    zz[i] = pt->Z;
-		else
-		    zz[i] = 0.0;
-		if (ignore_zm
-		    && (org->DimensionModel == GAIA_XY_Z
-			|| org->DimensionModel == GAIA_XY_Z_M))
-		  {
-		      zz[i] = 0.0;
-		      old_zz[i] = pt->Z;
-		  }
-		if (org->DimensionModel == GAIA_XY_M
-		    || org->DimensionModel == GAIA_XY_Z_M)
-		    mm[i] = pt->M;
-		i++;
-		pt = pt->Next;
-	    }
-	  /* applying reprojection        */
-	  if (pj_transform (from_cs, to_cs, cnt, 0, xx, yy, zz) == 0)
-	    {
-		/* inserting the reprojected POINTs in the new GEOMETRY */
-		for (i = 0; i < cnt; i++)
-		  {
-		      if (to_angle)
-			{
-			    x = gaiaRadsToDegs (xx[i]);
-			    y = gaiaRadsToDegs (yy[i]);
-			}
-		      else
-			{
-			    x = xx[i];
-			    y = yy[i];
-			}
-		      if (org->DimensionModel == GAIA_XY_Z
-			  || org->DimensionModel == GAIA_XY_Z_M)
-			  z = zz[i];
-		      else
-			  z = 0.0;
-		      if (ignore_zm
-			  && (org->DimensionModel == GAIA_XY_Z
-			      || org->DimensionModel == GAIA_XY_Z_M))
-			  z = old_zz[i];
-		      if (org->DimensionModel == GAIA_XY_M
-			  || org->DimensionModel == GAIA_XY_Z_M)
-			  m = mm[i];
-		      else
-			  m = 0.0;
-		      if (dst->DimensionModel == GAIA_XY_Z)
-			  gaiaAddPointToGeomCollXYZ (dst, x, y, z);
-		      else if (dst->DimensionModel == GAIA_XY_M)
-			  gaiaAddPointToGeomCollXYM (dst, x, y, m);
-		      else if (dst->DimensionModel == GAIA_XY_Z_M)
-			  gaiaAddPointToGeomCollXYZM (dst, x, y, z, m);
-		      else
-			  gaiaAddPointToGeomColl (dst, x, y);
-		  }
-	    }
-	  else
-	      error = 1;
-	  free (xx);
-	  free (yy);
-	  free (zz);
-	  if (old_zz != NULL)
-	      free (old_zz);
-	  if (org->DimensionModel == GAIA_XY_M
-	      || org->DimensionModel == GAIA_XY_Z_M)
-	      free (mm);
-      }
-    if (error)
-	goto stop;
     ln = org->FirstLinestring;
     while (ln)
       {
-	  /* reprojecting LINESTRINGs */
-	  cnt = ln->Points;
-	  xx = malloc (sizeof (double) * cnt);
-	  yy = malloc (sizeof (double) * cnt);
-	  zz = malloc (sizeof (double) * cnt);
-	  if (ignore_zm
-	      && (ln->DimensionModel == GAIA_XY_Z
-		  || ln->DimensionModel == GAIA_XY_Z_M))
-	      old_zz = malloc (sizeof (double) * cnt);
-	  if (ln->DimensionModel == GAIA_XY_M
-	      || ln->DimensionModel == GAIA_XY_Z_M)
-	      mm = malloc (sizeof (double) * cnt);
-	  for (i = 0; i < cnt; i++)
-	    {
-		/* inserting points to be converted in temporary arrays */
-		if (ln->DimensionModel == GAIA_XY_Z)
-		  {
-		      gaiaGetPointXYZ (ln->Coords, i, &x, &y, &z);
-		  }
-		else if (ln->DimensionModel == GAIA_XY_M)
-		  {
-		      gaiaGetPointXYM (ln->Coords, i, &x, &y, &m);
-		  }
-		else if (ln->DimensionModel == GAIA_XY_Z_M)
-		  {
-		      gaiaGetPointXYZM (ln->Coords, i, &x, &y, &z, &m);
-		  }
-		else
-		  {
-		      gaiaGetPoint (ln->Coords, i, &x, &y);
-		  }
-		if (from_angle)
-		  {
-		      xx[i] = gaiaDegsToRads (x);
-		      yy[i] = gaiaDegsToRads (y);
-		  }
-		else
-		  {
-		      xx[i] = x;
-		      yy[i] = y;
-		  }
-		if (ln->DimensionModel == GAIA_XY_Z
-		    || ln->DimensionModel == GAIA_XY_Z_M)
-		    zz[i] = z;
-		else
-		    zz[i] = 0.0;
-		if (ignore_zm
-		    && (ln->DimensionModel == GAIA_XY_Z
-			|| ln->DimensionModel == GAIA_XY_Z_M))
-		  {
-		      zz[i] = 0.0;
-		      old_zz[i] = z;
-		  }
-		if (ln->DimensionModel == GAIA_XY_M
-		    || ln->DimensionModel == GAIA_XY_Z_M)
-		    mm[i] = m;
-	    }
-	  /* applying reprojection        */
-	  if (pj_transform (from_cs, to_cs, cnt, 0, xx, yy, zz) == 0)
+	  cnt += ln->Points;
+	  ln = ln->Next;
+      }
+    pg = org->FirstPolygon;
+    while (pg)
+      {
+	  cnt += pg->Exterior->Points;
+	  for (ib = 0; ib < pg->NumInteriors; ib++)
+	      cnt += (pg->Interiors + ib)->Points;
+	  pg = pg->Next;
+      }
+    if (cnt == 0)
+	goto stop;
+
+/* gathering all vertices into the transform buffers */
+    buf.xx = malloc (sizeof (double) * cnt);
+    buf.yy = malloc (sizeof (double) * cnt);
+    buf.zz = malloc (sizeof (double) * cnt);
+    if (ignore_zm
+	&& (org->DimensionModel == GAIA_XY_Z
+	    || org->DimensionModel == GAIA_XY_Z_M))
+	buf.old_zz = malloc (sizeof (double) * cnt);
+    if (org->DimensionModel == GAIA_XY_M
+	|| org->DimensionModel == GAIA_XY_Z_M)
+	buf.mm = malloc (sizeof (double) * cnt);
+    k = 0;
+    pt = org->FirstPoint;
+    while (pt)
+      {
+	  double coords[4];
+	  coords[0] = pt->X;
+	  coords[1] = pt->Y;
+	  if (org->DimensionModel == GAIA_XY_Z)
+	      coords[2] = pt->Z;
+	  else if (org->DimensionModel == GAIA_XY_M)
+	      coords[2] = pt->M;
+	  else if (org->DimensionModel == GAIA_XY_Z_M)
 	    {
-		/* inserting the reprojected LINESTRING in the new GEOMETRY */
-		dst_ln = gaiaAddLinestringToGeomColl (dst, cnt);
-		for (i = 0; i < cnt; i++)
-		  {
-		      /* setting LINESTRING points */
-		      if (to_angle)
-			{
-			    x = gaiaRadsToDegs (xx[i]);
-			    y = gaiaRadsToDegs (yy[i]);
-			}
-		      else
-			{
-			    x = xx[i];
-			    y = yy[i];
-			}
-		      if (ln->DimensionModel == GAIA_XY_Z
-			  || ln->DimensionModel == GAIA_XY_Z_M)
-			  z = zz[i];
-		      else
-			  z = 0.0;
-		      if (ignore_zm
-			  && (ln->DimensionModel == GAIA_XY_Z
-			      || ln->DimensionModel == GAIA_XY_Z_M))
-			  z = old_zz[i];
-		      if (ln->DimensionModel == GAIA_XY_M
-			  || ln->DimensionModel == GAIA_XY_Z_M)
-			  m = mm[i];
-		      else
-			  m = 0.0;
-		      if (dst_ln->DimensionModel == GAIA_XY_Z)
-			{
-			    gaiaSetPointXYZ (dst_ln->Coords, i, x, y, z);
-			}
-		      else if (dst_ln->DimensionModel == GAIA_XY_M)
-			{
-			    gaiaSetPointXYM (dst_ln->Coords, i, x, y, m);
-			}
-		      else if (dst_ln->DimensionModel == GAIA_XY_Z_M)
-			{
-			    gaiaSetPointXYZM (dst_ln->Coords, i, x, y, z, m);
-			}
-		      else
-			{
-			    gaiaSetPoint (dst_ln->Coords, i, x, y);
-			}
-		  }
+		coords[2] = pt->Z;
+		coords[3] = pt->M;
 	    }
-	  else
-	      error = 1;
-	  free (xx);
-	  free (yy);
-	  free (zz);
-	  if (old_zz != NULL)
-	      free (old_zz);
-	  if (ln->DimensionModel == GAIA_XY_M
-	      || ln->DimensionModel == GAIA_XY_Z_M)
-	      free (mm);
-	  if (error)
-	      goto stop;
+	  transformGather (&buf, k, coords, 1, org->DimensionModel);
+	  k++;
+	  pt = pt->Next;
+      }
+    ln = org->FirstLinestring;
+    while (ln)
+      {
+	  transformGather (&buf, k, ln->Coords, ln->Points,
+			   ln->DimensionModel);
+	  k += ln->Points;
 	  ln = ln->Next;
       }
     pg = org->FirstPolygon;
     while (pg)
       {
-	  /* reprojecting POLYGONs */
 	  rng = pg->Exterior;
-	  cnt = rng->Points;
-	  dst_pg = gaiaAddPolygonToGeomColl (dst, cnt, pg->NumInteriors);
-	  xx = malloc (sizeof (double) * cnt);
-	  yy = malloc (sizeof (double) * cnt);
-	  zz = malloc (sizeof (double) * cnt);
-	  if (ignore_zm
-	      && (org->DimensionModel == GAIA_XY_Z
-		  || org->DimensionModel == GAIA_XY_Z_M))
-	      old_zz = malloc (sizeof (double) * cnt);
-	  if (rng->DimensionModel == GAIA_XY_M
-	      || rng->DimensionModel == GAIA_XY_Z_M)
-	      mm = malloc (sizeof (double) * cnt);
-	  for (i = 0; i < cnt; i++)
-	    {
-		/* inserting points to be converted in temporary arrays [EXTERIOR RING] */
-		if (rng->DimensionModel == GAIA_XY_Z)
-		  {
-		      gaiaGetPointXYZ (rng->Coords, i, &x, &y, &z);
-		  }
-		else if (rng->DimensionModel == GAIA_XY_M)
-		  {
-		      gaiaGetPointXYM (rng->Coords, i, &x, &y, &m);
-		  }
-		else if (rng->DimensionModel == GAIA_XY_Z_M)
-		  {
-		      gaiaGetPointXYZM (rng->Coords, i, &x, &y, &z, &m);
-		  }
-		else
-		  {
-		      gaiaGetPoint (rng->Coords, i, &x, &y);
-		  }
-		if (from_angle)
-		  {
-		      xx[i] = gaiaDegsToRads (x);
-		      yy[i] = gaiaDegsToRads (y);
-		  }
-		else
-		  {
-		      xx[i] = x;
-		      yy[i] = y;
-		  }
-		if (rng->DimensionModel == GAIA_XY_Z
-		    || rng->DimensionModel == GAIA_XY_Z_M)
-		    zz[i] = z;
-		else
-		    zz[i] = 0.0;
-		if (ignore_zm
-		    && (rng->DimensionModel == GAIA_XY_Z
-			|| rng->DimensionModel == GAIA_XY_Z_M))
-		  {
-		      zz[i] = 0.0;
-		      old_zz[i] = z;
-		  }
-		if (rng->DimensionModel == GAIA_XY_M
-		    || rng->DimensionModel == GAIA_XY_Z_M)
-		    mm[i] = m;
-	    }
-	  /* applying reprojection        */
-	  if (pj_transform (from_cs, to_cs, cnt, 0, xx, yy, zz) == 0)
+	  transformGather (&buf, k, rng->Coords, rng->Points,
+			   rng->DimensionModel);
+	  k += rng->Points;
+	  for (ib = 0; ib < pg->NumInteriors; ib++)
 	    {
-		/* inserting the reprojected POLYGON in the new GEOMETRY */
-		dst_rng = dst_pg->Exterior;
-		for (i = 0; i < cnt; i++)
-		  {
-		      /* setting EXTERIOR RING points */
-		      if (to_angle)
-			{
-			    x = gaiaRadsToDegs (xx[i]);
-			    y = gaiaRadsToDegs (yy[i]);
-			}
-		      else
-			{
-			    x = xx[i];
-			    y = yy[i];
-			}
-		      if (rng->DimensionModel == GAIA_XY_Z
-			  || rng->DimensionModel == GAIA_XY_Z_M)
-			  z = zz[i];
-		      else
-			  z = 0.0;
-		      if (ignore_zm
-			  && (rng->DimensionModel == GAIA_XY_Z
-			      || rng->DimensionModel == GAIA_XY_Z_M))
-			  z = old_zz[i];
-		      if (rng->DimensionModel == GAIA_XY_M
-			  || rng->DimensionModel == GAIA_XY_Z_M)
-			  m = mm[i];
-		      else
-			  m = 0.0;
-		      if (dst_rng->DimensionModel == GAIA_XY_Z)
-			{
-			    gaiaSetPointXYZ (dst_rng->Coords, i, x, y, z);
-			}
-		      else if (dst_rng->DimensionModel == GAIA_XY_M)
-			{
-			    gaiaSetPointXYM (dst_rng->Coords, i, x, y, m);
-			}
-		      else if (dst_rng->DimensionModel == GAIA_XY_Z_M)
-			{
-			    gaiaSetPointXYZM (dst_rng->Coords, i, x, y, z, m);
-			}
-		      else
-			{
-			    gaiaSetPoint (dst_rng->Coords, i, x, y);
-			}
-		  }
+		rng = pg->Interiors + ib;
+		transformGather (&buf, k, rng->Coords, rng->Points,
+				 rng->DimensionModel);
+		k += rng->Points;
 	    }
+	  pg = pg->Next;
+      }
+
+/* applying reprojection        */
+    if (pj_transform (from_cs, to_cs, cnt, 0, buf.xx, buf.yy, buf.zz) != 0)
+      {
+	  /* some error occurred: returning an empty GEOMETRY */
+	  goto stop;
+      }
+
+/* scattering the reprojected vertices into the new GEOMETRY */
+    k = 0;
+    pt = org->FirstPoint;
+    while (pt)
+      {
+	  /* inserting the reprojected POINTs in the new GEOMETRY */
+	  transformGetXYZM (&buf, k, org->DimensionModel, &x, &y, &z, &m);
+	  if (dst->DimensionModel == GAIA_XY_Z)
+	      gaiaAddPointToGeomCollXYZ (dst, x, y, z);
+	  else if (dst->DimensionModel == GAIA_XY_M)
+	      gaiaAddPointToGeomCollXYM (dst, x, y, m);
+	  else if (dst->DimensionModel == GAIA_XY_Z_M)
+	      gaiaAddPointToGeomCollXYZM (dst, x, y, z, m);
 	  else
-	      error = 1;
-	  free (xx);
-	  free (yy);
-	  free (zz);
-	  if (old_zz != NULL)
-	      free (old_zz);
-	  if (rng->DimensionModel == GAIA_XY_M
-	      || rng->DimensionModel == GAIA_XY_Z_M)
-	      free (mm);
-	  if (error)
-	      goto stop;
+	      gaiaAddPointToGeomColl (dst, x, y);
+	  k++;
+	  pt = pt->Next;
+      }
+    ln = org->FirstLinestring;
+    while (ln)
+      {
+	  /* inserting the reprojected LINESTRINGs in the new GEOMETRY */
+	  dst_ln = gaiaAddLinestringToGeomColl (dst, ln->Points);
+	  transformScatter (&buf, k, dst_ln->Coords, ln->Points,
+			    ln->DimensionModel, dst_ln->DimensionModel);
+	  k += ln->Points;
+	  ln = ln->Next;
+      }
+    pg = org->FirstPolygon;
+    while (pg)
+      {
+	  /* inserting the reprojected POLYGONs in the new GEOMETRY */
+	  rng = pg->Exterior;
+	  dst_pg =
+	      gaiaAddPolygonToGeomColl (dst, rng->Points, pg->NumInteriors);
+	  dst_rng = dst_pg->Exterior;
+	  transformScatter (&buf, k, dst_rng->Coords, rng->Points,
+			    rng->DimensionModel, dst_rng->DimensionModel);
+	  k += rng->Points;
 	  for (ib = 0; ib < pg->NumInteriors; ib++)
 	    {
-		/* processing INTERIOR RINGS */
 		rng = pg->Interiors + ib;
-		cnt = rng->Points;
-		xx = malloc (sizeof (double) * cnt);
-		yy = malloc (sizeof (double) * cnt);
-		zz = malloc (sizeof (double) * cnt);
-		if (ignore_zm
-		    && (org->DimensionModel == GAIA_XY_Z
-			|| org->DimensionModel == GAIA_XY_Z_M))
-		    old_zz = malloc (sizeof (double) * cnt);
-		if (rng->DimensionModel == GAIA_XY_M
-		    || rng->DimensionModel == GAIA_XY_Z_M)
-		    mm = malloc (sizeof (double) * cnt);
-		for (i = 0; i < cnt; i++)
-		  {
-		      /* inserting points to be converted in temporary arrays [INTERIOR RING] */
-		      if (rng->DimensionModel == GAIA_XY_Z)
-			{
-			    gaiaGetPointXYZ (rng->Coords, i, &x, &y, &z);
-			}
-		      else if (rng->DimensionModel == GAIA_XY_M)
-			{
-			    gaiaGetPointXYM (rng->Coords, i, &x, &y, &m);
-			}
-		      else if (rng->DimensionModel == GAIA_XY_Z_M)
-			{
-			    gaiaGetPointXYZM (rng->Coords, i, &x, &y, &z, &m);
-			}
-		      else
-			{
-			    gaiaGetPoint (rng->Coords, i, &x, &y);
-			}
-		      if (from_angle)
-			{
-			    xx[i] = gaiaDegsToRads (x);
-			    yy[i] = gaiaDegsToRads (y);
-			}
-		      else
-			{
-			    xx[i] = x;
-			    yy[i] = y;
-			}
-		      if (rng->DimensionModel == GAIA_XY_Z
-			  || rng->DimensionModel == GAIA_XY_Z_M)
-			  zz[i] = z;
-		      else
-			  zz[i] = 0.0;
-		      if (ignore_zm
-			  && (rng->DimensionModel == GAIA_XY_Z
-			      || rng->DimensionModel == GAIA_XY_Z_M))
-			{
-			    zz[i] = 0.0;
-			    old_zz[i] = z;
-			}
-		      if (rng->DimensionModel == GAIA_XY_M
-			  || rng->DimensionModel == GAIA_XY_Z_M)
-			  mm[i] = m;
-		  }
-		/* applying reprojection        */
-		if (pj_transform (from_cs, to_cs, cnt, 0, xx, yy, zz) == 0)
-		  {
-		      /* inserting the reprojected POLYGON in the new GEOMETRY */
-		      dst_rng = gaiaAddInteriorRing (dst_pg, ib, cnt);
-		      for (i = 0; i < cnt; i++)
-			{
-			    /* setting INTERIOR RING points */
-			    if (to_angle)
-			      {
-				  x = gaiaRadsToDegs (xx[i]);
-				  y = gaiaRadsToDegs (yy[i]);
-			      }
-			    else
-			      {
-				  x = xx[i];
-				  y = yy[i];
-			      }
-			    if (rng->DimensionModel == GAIA_XY_Z
-				|| rng->DimensionModel == GAIA_XY_Z_M)
-				z = zz[i];
-			    else
-				z = 0.0;
-			    if (ignore_zm
-				&& (rng->DimensionModel == GAIA_XY_Z
-				    || rng->DimensionModel == GAIA_XY_Z_M))
-				z = old_zz[i];
-			    if (rng->DimensionModel == GAIA_XY_M
-				|| rng->DimensionModel == GAIA_XY_Z_M)
-				m = mm[i];
-			    else
-				m = 0.0;
-			    if (dst_rng->DimensionModel == GAIA_XY_Z)
-			      {
-				  gaiaSetPointXYZ (dst_rng->Coords, i, x, y, z);
-			      }
-			    else if (dst_rng->DimensionModel == GAIA_XY_M)
-			      {
-				  gaiaSetPointXYM (dst_rng->Coords, i, x, y, m);
-			      }
-			    else if (dst_rng->DimensionModel == GAIA_XY_Z_M)
-			      {
-				  gaiaSetPointXYZM (dst_rng->Coords, i, x, y, z,
-						    m);
-			      }
-			    else
-			      {
-				  gaiaSetPoint (dst_rng->Coords, i, x, y);
-			      }
-			}
-		  }
-		else
-		    error = 1;
-		free (xx);
-		free (yy);
-		free (zz);
-		if (old_zz != NULL)
-		    free (old_zz);
-		if (rng->DimensionModel == GAIA_XY_M
-		    || rng->DimensionModel == GAIA_XY_Z_M)
-		    free (mm);
-		if (error)
-		    goto stop;
+		dst_rng = gaiaAddInteriorRing (dst_pg, ib, rng->Points);
+		transformScatter (&buf, k, dst_rng->Coords, rng->Points,
+				  rng->DimensionModel, dst_rng->DimensionModel);
+		k += rng->Points;
 	    }
 	  pg = pg->Next;
       }
+
 /* destroying the PROJ4 params */
   stop:
-    pj_free (from_cs);
-    pj_free (to_cs);
-    if (error)
-      {
-	  /* some error occurred */
-	  gaiaPointPtr pP;
-	  gaiaPointPtr pPn;
-	  gaiaLinestringPtr pL;
-	  gaiaLinestringPtr pLn;
-	  gaiaPolygonPtr pA;
-	  gaiaPolygonPtr pAn;
-	  pP = dst->FirstPoint;
-	  while (pP != NULL)
-	    {
-		pPn = pP->Next;
-		gaiaFreePoint (pP);
-		pP = pPn;
-	    }
-	  pL = dst->FirstLinestring;
-	  while (pL != NULL)
-	    {
-		pLn = pL->Next;
-		gaiaFreeLinestring (pL);
-		pL = pLn;
-	    }
-	  pA = dst->FirstPolygon;
-	  while (pA != NULL)
-	    {
-		pAn = pA->Next;
-		gaiaFreePolygon (pA);
-		pA = pAn;
-	    }
-	  dst->FirstPoint = NULL;
-	  dst->LastPoint = NULL;
-	  dst->FirstLinestring = NULL;
-	  dst->LastLinestring = NULL;
-	  dst->FirstPolygon = NULL;
-	  dst->LastPolygon = NULL;
+    if (buf.xx != NULL)
+	free (buf.xx);
+    if (buf.yy != NULL)
+	free (buf.yy);
+    if (buf.zz != NULL)
+	free (buf.zz);
+    if (buf.old_zz != NULL)
+	free (buf.old_zz);
+    if (buf.mm != NULL)
+	free (buf.mm);
+    if (!cached)
+      {
+	  pj_free (from_cs);
+	  pj_free (to_cs);
       }
     if (dst)
       {
@@ -2221,7 +2063,7 @@ gaiaTransformCommon (projCtx handle, gaiaGeomCollPtr org, char *proj_from,
 GAIAGEO_DECLARE gaiaGeomCollPtr
 gaiaTransform (gaiaGeomCollPtr org, char *proj_from, char *proj_to)
 {
-    return gaiaTransformCommon (NULL, org, proj_from, proj_to, 0);
+    return gaiaTransformCommon (NULL, NULL, org, proj_from, proj_to, 0);
 }
 
 GAIAGEO_DECLARE gaiaGeomCollPtr
@@ -2239,13 +2081,13 @@ gaiaTransform_r (const void *p_cache, gaiaGeomCollPtr org, char *proj_from,
     handle = cache->PROJ_handle;
     if (handle == NULL)
 	return NULL;
-    return gaiaTransformCommon (handle, org, proj_from, proj_to, 0);
+    return gaiaTransformCommon (cache, handle, org, proj_from, proj_to, 0);
 }
 
 GAIAGEO_DECLARE gaiaGeomCollPtr
 gaiaTransformXY (gaiaGeomCollPtr org, char *proj_from, char *proj_to)
 {
-    return gaiaTransformCommon (NULL, org, proj_from, proj_to, 1);
+    return gaiaTransformCommon (NULL, NULL, org, proj_from, proj_to, 1);
 }
 
 GAIAGEO_DECLARE gaiaGeomCollPtr
@@ -2263,7 +2105,7 @@ gaiaTransformXY_r (const void *p_cache, gaiaGeomCollPtr org, char *proj_from,
     handle = cache->PROJ_handle;
     if (handle == NULL)
 	return NULL;
-    return gaiaTransformCommon (handle, org, proj_from, proj_to, 1);
+    return gaiaTransformCommon (cache, handle, org, proj_from, proj_to, 1);
 }
 
 #endif /* end including PROJ.4 */
@@ -1404,6 +1404,604 @@ gaiaFromSpatiaLiteBlobWkb (const unsigned char *blob, unsigned int size)
     return gaiaFromSpatiaLiteBlobWkbEx (blob, size, 0, 0);
 }
 
+static int
+viewElementaryType (int type, int *klass, int *dims, int *compressed)
+{
+/* classifying an elementary item [Geometry View] */
+    *compressed = 0;
+    switch (type)
+      {
+      case GAIA_POINT:
+	  *klass = GAIA_POINT;
+	  *dims = GAIA_XY;
+	  return 1;
+      case GAIA_POINTZ:
+      case GAIA_GEOSWKB_POINTZ:
+	  *klass = GAIA_POINT;
+	  *dims = GAIA_XY_Z;
+	  return 1;
+      case GAIA_POINTM:
+	  *klass = GAIA_POINT;
+	  *dims = GAIA_XY_M;
+	  return 1;
+      case GAIA_POINTZM:
+	  *klass = GAIA_POINT;
+	  *dims = GAIA_XY_Z_M;
+	  return 1;
+      case GAIA_LINESTRING:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY;
+	  return 1;
+      case GAIA_LINESTRINGZ:
+      case GAIA_GEOSWKB_LINESTRINGZ:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_Z;
+	  return 1;
+      case GAIA_LINESTRINGM:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_M;
+	  return 1;
+      case GAIA_LINESTRINGZM:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_Z_M;
+	  return 1;
+      case GAIA_POLYGON:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY;
+	  return 1;
+      case GAIA_POLYGONZ:
+      case GAIA_GEOSWKB_POLYGONZ:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_Z;
+	  return 1;
+      case GAIA_POLYGONM:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_M;
+	  return 1;
+      case GAIA_POLYGONZM:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_Z_M;
+	  return 1;
+      case GAIA_COMPRESSED_LINESTRING:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_LINESTRINGZ:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_Z;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_LINESTRINGM:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_M;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_LINESTRINGZM:
+	  *klass = GAIA_LINESTRING;
+	  *dims = GAIA_XY_Z_M;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_POLYGON:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_POLYGONZ:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_Z;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_POLYGONM:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_M;
+	  *compressed = 1;
+	  return 1;
+      case GAIA_COMPRESSED_POLYGONZM:
+	  *klass = GAIA_POLYGON;
+	  *dims = GAIA_XY_Z_M;
+	  *compressed = 1;
+	  return 1;
+      };
+    return 0;
+}
+
+static unsigned int
+viewVertexSize (int dims, int compressed)
+{
+/* size (in bytes) of a single vertex [Geometry View] */
+    switch (dims)
+      {
+      case GAIA_XY_Z:
+	  return compressed ? 12 : 24;
+      case GAIA_XY_M:
+	  return compressed ? 16 : 24;
+      case GAIA_XY_Z_M:
+	  return compressed ? 20 : 32;
+      };
+    return compressed ? 8 : 16;
+}
+
+static int
+viewSkipVertices (gaiaGeomViewPtr view, unsigned int *offset, int points,
+		  int dims, int compressed)
+{
+/*
+/ checking and skipping a vertex array [Geometry View]
+/ exactly mirroring the bounds checks of the BLOB parsers
+*/
+    unsigned int full = viewVertexSize (dims, 0);
+    unsigned int compr = viewVertexSize (dims, 1);
+    unsigned int remaining;
+    if (points < 0)
+	return 0;
+    if (*offset > view->size)
+	return 0;
+    remaining = view->size - *offset;
+    if (!compressed)
+      {
+	  if ((unsigned int) points > remaining / full)
+	      return 0;
+	  *offset += full * points;
+	  return 1;
+      }
+    if (remaining < 2 * (full - compr))
+	return 0;
+    if ((unsigned int) points > (remaining - (2 * (full - compr))) / compr)
+	return 0;
+    if (points == 1)
+	*offset += full;
+    else if (points > 1)
+	*offset += (2 * full) + (compr * (points - 2));
+    return 1;
+}
+
+static int
+viewParseItem (gaiaGeomViewPtr view, unsigned int offset, int type,
+	       gaiaGeomViewItemPtr item)
+{
+/* checking and describing an elementary item [Geometry View] */
+    int klass;
+    int dims;
+    int compressed;
+    int points;
+    int rings;
+    int ib;
+    if (!viewElementaryType (type, &klass, &dims, &compressed))
+	return 0;
+    item->Type = klass;
+    item->DimensionModel = dims;
+    item->Compressed = compressed;
+    item->Rings = 0;
+    item->FirstRing = 0;
+    if (klass == GAIA_POINT)
+      {
+	  item->Points = 1;
+	  item->Coords = offset;
+	  if (!viewSkipVertices (view, &offset, 1, dims, 0))
+	      return 0;
+	  item->Next = offset;
+	  return 1;
+      }
+    if (klass == GAIA_LINESTRING)
+      {
+	  if (view->size < offset + 4)
+	      return 0;
+	  points = gaiaImport32 (view->blob + offset, view->endian,
+				 view->endian_arch);
+	  offset += 4;
+	  item->Points = points;
+	  item->Coords = offset;
+	  if (!viewSkipVertices (view, &offset, points, dims, compressed))
+	      return 0;
+	  item->Next = offset;
+	  return 1;
+      }
+/* POLYGON */
+    if (view->size < offset + 4)
+	return 0;
+    rings = gaiaImport32 (view->blob + offset, view->endian, view->endian_arch);
+    offset += 4;
+    if (rings <= 0)
+	return 0;
+    item->Rings = rings;
+    item->FirstRing = offset;
+    for (ib = 0; ib < rings; ib++)
+      {
+	  if (view->size < offset + 4)
+	      return 0;
+	  points = gaiaImport32 (view->blob + offset, view->endian,
+				 view->endian_arch);
+	  offset += 4;
+	  if (ib == 0)
+	    {
+		item->Points = points;
+		item->Coords = offset;
+	    }
+	  if (!viewSkipVertices (view, &offset, points, dims, compressed))
+	      return 0;
+      }
+    item->Next = offset;
+    return 1;
+}
+
+static int
+viewItemAt (gaiaGeomViewPtr view, unsigned int offset, int index,
+	    gaiaGeomViewItemPtr item)
+{
+/* describing the item starting at the given offset [Geometry View] */
+    int type;
+    item->Index = index;
+    if (!view->IsCollection)
+	return viewParseItem (view, offset, view->BlobType, item);
+    if (view->size < offset + 5)
+	return 0;
+    type = gaiaImport32 (view->blob + offset + 1, view->endian,
+			 view->endian_arch);
+    return viewParseItem (view, offset + 5, type, item);
+}
+
+static int
+viewMergeDims (int dm, int item_dm)
+{
+/* merging dimension models [Geometry View] */
+    if (item_dm == GAIA_XY_Z)
+      {
+	  if (dm == GAIA_XY)
+	      return GAIA_XY_Z;
+	  if (dm == GAIA_XY_M)
+	      return GAIA_XY_Z_M;
+      }
+    else if (item_dm == GAIA_XY_M)
+      {
+	  if (dm == GAIA_XY)
+	      return GAIA_XY_M;
+	  if (dm == GAIA_XY_Z)
+	      return GAIA_XY_Z_M;
+      }
+    else if (item_dm == GAIA_XY_Z_M)
+	return GAIA_XY_Z_M;
+    return dm;
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewFromBlob (gaiaGeomViewPtr view, const unsigned char *blob,
+		      unsigned int size)
+{
+/* initializing a zero-copy Geometry View over a SpatiaLite BLOB */
+    int type;
+    int klass;
+    int dims;
+    int compressed;
+    int ir;
+    gaiaGeomViewItem item;
+    gaiaGeomViewItem ring;
+    if (view == NULL || blob == NULL)
+	return 0;
+    memset (view, 0, sizeof (gaiaGeomView));
+    view->blob = blob;
+    view->size = size;
+    view->endian_arch = gaiaEndianArch ();
+
+    if (size == 24 || size == 32 || size == 40)
+      {
+	  /* testing for a possible TinyPoint BLOB */
+	  if (*(blob + 0) == GAIA_MARK_START &&
+	      (*(blob + 1) == GAIA_TINYPOINT_LITTLE_ENDIAN
+	       || *(blob + 1) == GAIA_TINYPOINT_BIG_ENDIAN)
+	      && *(blob + (size - 1)) == GAIA_MARK_END)
+	    {
+		if (*(blob + 1) == GAIA_TINYPOINT_LITTLE_ENDIAN)
+		    view->endian = 1;
+		else
+		    view->endian = 0;
+		view->TinyPoint = 1;
+		view->Srid =
+		    gaiaImport32 (blob + 2, view->endian, view->endian_arch);
+		switch (*(blob + 6))
+		  {
+		  case GAIA_TINYPOINT_XYZ:
+		      view->BlobType = GAIA_POINTZ;
+		      break;
+		  case GAIA_TINYPOINT_XYM:
+		      view->BlobType = GAIA_POINTM;
+		      break;
+		  case GAIA_TINYPOINT_XYZM:
+		      view->BlobType = GAIA_POINTZM;
+		      break;
+		  default:
+		      view->BlobType = GAIA_POINT;
+		      break;
+		  };
+		view->FirstItem = 7;
+		if (!viewItemAt (view, view->FirstItem, 0, &item))
+		    return 0;
+		view->DeclaredType = GAIA_POINT;
+		view->DimensionModel = item.DimensionModel;
+		view->ItemsDimensionModel = item.DimensionModel;
+		view->NumItems = 1;
+		view->NumPoints = 1;
+		view->NumVertices = 1;
+		view->MinX = gaiaImport64 (blob + 7, view->endian,
+					   view->endian_arch);
+		view->MinY = gaiaImport64 (blob + 15, view->endian,
+					   view->endian_arch);
+		view->MaxX = view->MinX;
+		view->MaxY = view->MinY;
+		return 1;
+	    }
+      }
+
+    if (size < 45)
+	return 0;		/* cannot be an internal BLOB WKB geometry */
+    if (*(blob + 0) != GAIA_MARK_START)
+	return 0;		/* failed to recognize START signature */
+    if (*(blob + (size - 1)) != GAIA_MARK_END)
+	return 0;		/* failed to recognize END signature */
+    if (*(blob + 38) != GAIA_MARK_MBR)
+	return 0;		/* failed to recognize MBR signature */
+    if (*(blob + 1) == GAIA_LITTLE_ENDIAN)
+	view->endian = 1;
+    else if (*(blob + 1) == GAIA_BIG_ENDIAN)
+	view->endian = 0;
+    else
+	return 0;		/* unknown encoding; nor little-endian neither big-endian */
+    type = gaiaImport32 (blob + 39, view->endian, view->endian_arch);
+    view->BlobType = type;
+    view->Srid = gaiaImport32 (blob + 2, view->endian, view->endian_arch);
+    view->MinX = gaiaImport64 (blob + 6, view->endian, view->endian_arch);
+    view->MinY = gaiaImport64 (blob + 14, view->endian, view->endian_arch);
+    view->MaxX = gaiaImport64 (blob + 22, view->endian, view->endian_arch);
+    view->MaxY = gaiaImport64 (blob + 30, view->endian, view->endian_arch);
+    if (viewElementaryType (type, &klass, &dims, &compressed))
+      {
+	  /* a single elementary item */
+	  view->IsCollection = 0;
+	  view->DeclaredType = klass;
+	  view->DimensionModel = dims;
+	  view->FirstItem = 43;
+	  view->NumItems = 1;
+      }
+    else
+      {
+	  switch (type)
+	    {
+	    case GAIA_MULTIPOINT:
+	    case GAIA_MULTIPOINTZ:
+	    case GAIA_MULTIPOINTM:
+	    case GAIA_MULTIPOINTZM:
+		view->DeclaredType = GAIA_MULTIPOINT;
+		break;
+	    case GAIA_MULTILINESTRING:
+	    case GAIA_MULTILINESTRINGZ:
+	    case GAIA_MULTILINESTRINGM:
+	    case GAIA_MULTILINESTRINGZM:
+		view->DeclaredType = GAIA_MULTILINESTRING;
+		break;
+	    case GAIA_MULTIPOLYGON:
+	    case GAIA_MULTIPOLYGONZ:
+	    case GAIA_MULTIPOLYGONM:
+	    case GAIA_MULTIPOLYGONZM:
+		view->DeclaredType = GAIA_MULTIPOLYGON;
+		break;
+	    case GAIA_GEOMETRYCOLLECTION:
+	    case GAIA_GEOMETRYCOLLECTIONZ:
+	    case GAIA_GEOMETRYCOLLECTIONM:
+	    case GAIA_GEOMETRYCOLLECTIONZM:
+		view->DeclaredType = GAIA_GEOMETRYCOLLECTION;
+		break;
+	    default:
+		return 0;	/* unsupported Geometry Type */
+	    };
+	  switch (type)
+	    {
+	    case GAIA_MULTIPOINTZ:
+	    case GAIA_MULTILINESTRINGZ:
+	    case GAIA_MULTIPOLYGONZ:
+	    case GAIA_GEOMETRYCOLLECTIONZ:
+		view->DimensionModel = GAIA_XY_Z;
+		break;
+	    case GAIA_MULTIPOINTM:
+	    case GAIA_MULTILINESTRINGM:
+	    case GAIA_MULTIPOLYGONM:
+	    case GAIA_GEOMETRYCOLLECTIONM:
+		view->DimensionModel = GAIA_XY_M;
+		break;
+	    case GAIA_MULTIPOINTZM:
+	    case GAIA_MULTILINESTRINGZM:
+	    case GAIA_MULTIPOLYGONZM:
+	    case GAIA_GEOMETRYCOLLECTIONZM:
+		view->DimensionModel = GAIA_XY_Z_M;
+		break;
+	    default:
+		view->DimensionModel = GAIA_XY;
+		break;
+	    };
+	  view->IsCollection = 1;
+	  view->NumItems = gaiaImport32 (blob + 43, view->endian,
+					 view->endian_arch);
+	  if (view->NumItems < 0)
+	      return 0;
+	  view->FirstItem = 47;
+      }
+
+/* validating all items and collecting statistics */
+    view->ItemsDimensionModel = GAIA_XY;
+    if (view->NumItems == 0)
+	return 1;
+    if (!gaiaGeomViewGetItem (view, 0, &item))
+	return 0;
+    while (1)
+      {
+	  view->ItemsDimensionModel =
+	      viewMergeDims (view->ItemsDimensionModel, item.DimensionModel);
+	  if (item.Type == GAIA_POINT)
+	    {
+		view->NumPoints += 1;
+		view->NumVertices += 1;
+	    }
+	  else if (item.Type == GAIA_LINESTRING)
+	    {
+		view->NumLinestrings += 1;
+		view->NumVertices += item.Points;
+	    }
+	  else
+	    {
+		view->NumPolygons += 1;
+		view->NumRings += item.Rings;
+		for (ir = 0; ir < item.Rings; ir++)
+		  {
+		      if (!gaiaGeomViewGetRing (view, &item, ir, &ring))
+			  return 0;
+		      view->NumVertices += ring.Points;
+		  }
+	    }
+	  if (item.Index + 1 >= view->NumItems)
+	      break;
+	  if (!gaiaGeomViewNextItem (view, &item))
+	      return 0;
+      }
+    return 1;
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewGetItem (gaiaGeomViewPtr view, int index, gaiaGeomViewItemPtr item)
+{
+/* retrieving an elementary item from a Geometry View */
+    int ie;
+    unsigned int offset;
+    if (view == NULL || item == NULL)
+	return 0;
+    if (index < 0 || index >= view->NumItems)
+	return 0;
+    offset = view->FirstItem;
+    for (ie = 0; ie <= index; ie++)
+      {
+	  if (!viewItemAt (view, offset, ie, item))
+	      return 0;
+	  offset = item->Next;
+      }
+    return 1;
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewNextItem (gaiaGeomViewPtr view, gaiaGeomViewItemPtr item)
+{
+/* advancing to the next elementary item of a Geometry View */
+    if (view == NULL || item == NULL)
+	return 0;
+    if (item->Index + 1 >= view->NumItems)
+	return 0;
+    return viewItemAt (view, item->Next, item->Index + 1, item);
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewGetRing (gaiaGeomViewPtr view, gaiaGeomViewItemPtr polyg,
+		     int index, gaiaGeomViewItemPtr ring)
+{
+/* retrieving a Ring from a Polygon item of a Geometry View */
+    int ib;
+    int points;
+    unsigned int offset;
+    if (view == NULL || polyg == NULL || ring == NULL)
+	return 0;
+    if (polyg->Type != GAIA_POLYGON)
+	return 0;
+    if (index < 0 || index >= polyg->Rings)
+	return 0;
+    offset = polyg->FirstRing;
+    for (ib = 0; ib <= index; ib++)
+      {
+	  if (view->size < offset + 4)
+	      return 0;
+	  points = gaiaImport32 (view->blob + offset, view->endian,
+				 view->endian_arch);
+	  offset += 4;
+	  if (ib == index)
+	    {
+		ring->Index = index;
+		ring->Type = GAIA_POLYGON;
+		ring->DimensionModel = polyg->DimensionModel;
+		ring->Compressed = polyg->Compressed;
+		ring->Points = points;
+		ring->Rings = 0;
+		ring->Coords = offset;
+		ring->FirstRing = 0;
+	    }
+	  if (!viewSkipVertices (view, &offset, points,
+				 polyg->DimensionModel, polyg->Compressed))
+	      return 0;
+      }
+    ring->Next = offset;
+    return 1;
+}
+
+GAIAGEO_DECLARE int
+gaiaGeomViewGetVertex (gaiaGeomViewPtr view, gaiaGeomViewItemPtr item,
+		       int index, double *x, double *y, double *z, double *m)
+{
+/* retrieving a Vertex from an item of a Geometry View */
+    const unsigned char *p;
+    unsigned int full;
+    unsigned int compr;
+    int has_z;
+    int has_m;
+    int iv;
+    if (view == NULL || item == NULL)
+	return 0;
+    if (index < 0 || index >= item->Points)
+	return 0;
+    has_z = (item->DimensionModel == GAIA_XY_Z
+	     || item->DimensionModel == GAIA_XY_Z_M);
+    has_m = (item->DimensionModel == GAIA_XY_M
+	     || item->DimensionModel == GAIA_XY_Z_M);
+    full = viewVertexSize (item->DimensionModel, 0);
+    *z = 0.0;
+    *m = 0.0;
+    if (!item->Compressed || index == 0 || index == item->Points - 1)
+      {
+	  /* uncompressed vertex: direct access */
+	  if (!item->Compressed)
+	      p = view->blob + item->Coords + (full * index);
+	  else if (index == 0)
+	      p = view->blob + item->Coords;
+	  else
+	    {
+		compr = viewVertexSize (item->DimensionModel, 1);
+		p = view->blob + item->Coords + full + (compr * (index - 1));
+	    }
+	  *x = gaiaImport64 (p, view->endian, view->endian_arch);
+	  *y = gaiaImport64 (p + 8, view->endian, view->endian_arch);
+	  if (has_z)
+	      *z = gaiaImport64 (p + 16, view->endian, view->endian_arch);
+	  if (has_m)
+	      *m = gaiaImport64 (p + (has_z ? 24 : 16), view->endian,
+				 view->endian_arch);
+	  return 1;
+      }
+
+/* compressed intermediate vertex: accumulating deltas */
+    compr = viewVertexSize (item->DimensionModel, 1);
+    p = view->blob + item->Coords;
+    *x = gaiaImport64 (p, view->endian, view->endian_arch);
+    *y = gaiaImport64 (p + 8, view->endian, view->endian_arch);
+    if (has_z)
+	*z = gaiaImport64 (p + 16, view->endian, view->endian_arch);
+    p += full;
+    for (iv = 1; iv <= index; iv++)
+      {
+	  *x += gaiaImportF32 (p, view->endian, view->endian_arch);
+	  *y += gaiaImportF32 (p + 4, view->endian, view->endian_arch);
+	  if (has_z)
+	      *z += gaiaImportF32 (p + 8, view->endian, view->endian_arch);
+	  if (iv == index && has_m)
+	      *m = gaiaImport64 (p + (has_z ? 12 : 8), view->endian,
+				 view->endian_arch);
+	  p += compr;
+      }
+    return 1;
+}
+
 static gaiaGeomCollPtr
 doParseTinyPointBlobMbr (const unsigned char *blob, unsigned int size)
 {
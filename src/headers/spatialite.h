@@ -253,6 +253,61 @@ extern "C"
 */
     SPATIALITE_DECLARE int is_tiny_point_enabled (const void *ptr);
 
+/**
+ Sets the number of Prepared Geometries held by the internal GEOS cache
+ 
+ \param ptr the same memory pointer passed to the corresponding call to
+ spatialite_init_ex() and returned by spatialite_alloc_connection()
+ \param size the max number of cached items (LRU); any value less than 2
+ will be silently adjusted to 2, and any value greater than 1024 will be
+ silently adjusted to 1024.
+ 
+ \note any currently cached item will be discarded; the current size
+ will be left untouched if the new cache can't be allocated.
+ 
+ \sa get_geos_cache_size, get_geos_cache_stats
+*/
+    SPATIALITE_DECLARE void set_geos_cache_size (const void *ptr, int size);
+
+/**
+ Returns the number of Prepared Geometries held by the internal GEOS cache
+ 
+ \param ptr the same memory pointer passed to the corresponding call to
+ spatialite_init_ex() and returned by spatialite_alloc_connection()
+ 
+ \return the max number of cached items (0 if the cache couldn't be
+ allocated, thus disabling any caching), or -1 on invalid arguments
+ 
+ \sa set_geos_cache_size
+*/
+    SPATIALITE_DECLARE int get_geos_cache_size (const void *ptr);
+
+/**
+ Returns the hit/miss counters of the internal GEOS cache
+ 
+ \param ptr the same memory pointer passed to the corresponding call to
+ spatialite_init_ex() and returned by spatialite_alloc_connection()
+ \param hits on completion will contain the number of cache hits
+ \param misses on completion will contain the number of cache misses
+ 
+ \return 0 on invalid arguments, any other value on success
+ 
+ \sa set_geos_cache_size, reset_geos_cache_stats
+*/
+    SPATIALITE_DECLARE int get_geos_cache_stats (const void *ptr,
+						 unsigned long *hits,
+						 unsigned long *misses);
+
+/**
+ Resets the hit/miss counters of the internal GEOS cache
+ 
+ \param ptr the same memory pointer passed to the corresponding call to
+ spatialite_init_ex() and returned by spatialite_alloc_connection()
+ 
+ \sa get_geos_cache_stats
+*/
+    SPATIALITE_DECLARE void reset_geos_cache_stats (const void *ptr);
+
 /**
  Dumps a full geometry-table into an external Shapefile
 
@@ -1783,6 +1838,168 @@ extern "C"
 						const char *oneway_to,
 						int overwrite);
 
+/**
+  Will attempt to create a VirtualRouting from an input table, optionally
+  supporting Contraction Hierarchies
+  
+ \param db_handle handle to the current SQLite connection
+ \param cache a memory pointer returned by spatialite_alloc_connection()
+ \param routing_data_table name of the Routing Data Table to be created.
+ \param virtual_routing_table name of the VirtualRouting Table to be created.
+ \param input_table name of the input table to be processed.
+ \param from_column name of the input table column containing NodeFrom.
+ \param to_column name of the input table column containing NodeTo.
+ \param geom_column name of the input table column containing Linestring Geometries
+ (could be eventually NULL).
+ \param cost_column name of the input table column containing Cost values
+ (could be eventually NULL).
+ \param name_column name of the input table column containing RoadName
+ (could be eventually NULL).
+ \param a_star_enabled if set to TRUE the Routing Data Table will support
+ both Djiskra's Shortest Path and A* algorithms; if set to FALSE only
+ the Djiskra's algorithm will be supported.
+ \param bidirectional if set to TRUE all input arcs/links will be assumed
+ to be bidirectional (from-to and to-from); if set to FALSE all input
+ arcs/links will be assumed to be unidirectional (from-to only).
+ \param oneway_from name of the input table column containing OneWayFrom
+ (could be eventually NULL).
+ \param oneway_to name of the input table column containing OneWayTo
+ (could be eventually NULL).
+ \param overwrite if set to TRUE both the Routing Data Table and the
+ VirtualRouting Table will be dropped if already existing; if set to
+ FALSE an already existing Routing Data Table or VirtualRouting Table
+ will cause a fatal error.
+ \param contraction_hierarchies if set to TRUE the Routing Data Table
+ will also store the Node order and the Shortcuts required by the
+ Contraction Hierarchies algorithm.
+ 
+ \return 0 on failure, any other value on success
+ 
+ \sa gaia_create_routing, gaia_create_routing_ex2
+
+ \note the Contraction Hierarchies preprocessing could require a
+ noticeable time on large networks, but will then allow VirtualRouting
+ to resolve Shortest Path queries by visiting just a tiny fraction
+ of the whole graph.
+ */
+    SPATIALITE_DECLARE int gaia_create_routing_ex (sqlite3 * db_handle,
+						   const void *cache,
+						   const char
+						   *routing_data_table,
+						   const char
+						   *virtual_routing_table,
+						   const char *input_table,
+						   const char *from_column,
+						   const char *to_column,
+						   const char *geom_column,
+						   const char *cost_column,
+						   const char *name_column,
+						   int a_star_enabled,
+						   int bidirectional,
+						   const char *oneway_from,
+						   const char *oneway_to,
+						   int overwrite,
+						   int contraction_hierarchies);
+
+/**
+  Will attempt to create a VirtualRouting from an input table, optionally
+  supporting Contraction Hierarchies, Time Profiles and Turn Restrictions
+  
+ \param db_handle handle to the current SQLite connection
+ \param cache a memory pointer returned by spatialite_alloc_connection()
+ \param routing_data_table name of the Routing Data Table to be created.
+ \param virtual_routing_table name of the VirtualRouting Table to be created.
+ \param input_table name of the input table to be processed.
+ \param from_column name of the input table column containing NodeFrom.
+ \param to_column name of the input table column containing NodeTo.
+ \param geom_column name of the input table column containing Linestring Geometries
+ (could be eventually NULL).
+ \param cost_column name of the input table column containing Cost values
+ (could be eventually NULL).
+ \param name_column name of the input table column containing RoadName
+ (could be eventually NULL).
+ \param a_star_enabled if set to TRUE the Routing Data Table will support
+ both Djiskra's Shortest Path and A* algorithms; if set to FALSE only
+ the Djiskra's algorithm will be supported.
+ \param bidirectional if set to TRUE all input arcs/links will be assumed
+ to be bidirectional (from-to and to-from); if set to FALSE all input
+ arcs/links will be assumed to be unidirectional (from-to only).
+ \param oneway_from name of the input table column containing OneWayFrom
+ (could be eventually NULL).
+ \param oneway_to name of the input table column containing OneWayTo
+ (could be eventually NULL).
+ \param overwrite if set to TRUE both the Routing Data Table and the
+ VirtualRouting Table will be dropped if already existing; if set to
+ FALSE an already existing Routing Data Table or VirtualRouting Table
+ will cause a fatal error.
+ \param contraction_hierarchies if set to TRUE the Routing Data Table
+ will also store the Node order and the Shortcuts required by the
+ Contraction Hierarchies algorithm.
+ \param time_profiles_table name of a table containing the time-dependent
+ Costs of the Links (could be eventually NULL); it must contain the columns
+ link_id (ROWID of the input table), start_time (seconds since midnight)
+ and cost.
+ \param turn_restrictions_table name of a table containing the Turn
+ Restrictions (could be eventually NULL); it must contain the columns
+ from_link and to_link (ROWIDs of the input table) and cost (the turn
+ penalty, NULL for a banned turn).
+ 
+ \return 0 on failure, any other value on success
+ 
+ \sa gaia_create_routing, gaia_create_routing_ex
+
+ \note Contraction Hierarchies cannot be combined with Time Profiles
+ or Turn Restrictions.
+ */
+    SPATIALITE_DECLARE int gaia_create_routing_ex2 (sqlite3 * db_handle,
+						    const void *cache,
+						    const char
+						    *routing_data_table,
+						    const char
+						    *virtual_routing_table,
+						    const char *input_table,
+						    const char *from_column,
+						    const char *to_column,
+						    const char *geom_column,
+						    const char *cost_column,
+						    const char *name_column,
+						    int a_star_enabled,
+						    int bidirectional,
+						    const char *oneway_from,
+						    const char *oneway_to,
+						    int overwrite,
+						    int
+						    contraction_hierarchies,
+						    const char
+						    *time_profiles_table,
+						    const char
+						    *turn_restrictions_table);
+
+/**
+  Will attempt to incrementally update an existing Routing Data Table
+
+ \param db_handle handle to the current SQLite connection
+ \param cache a memory pointer returned by spatialite_alloc_connection()
+ \param routing_data_table name of the Routing Data Table to be updated.
+ \param changes_table name of a table containing the changed arcs; it must 
+ contain the columns link_id (ROWID of the input table), node_from and 
+ node_to (both of them existing Nodes) and cost (the new Cost, NULL for
+ a deleted arc).
+ 
+ \return 0 on failure, any other value on success
+ 
+ \sa gaia_create_routing_ex2
+
+ \note only the blocks containing the NodeFrom of some changed arc will
+ be rewritten. Arcs not yet existing will be inserted, but new Nodes
+ always require a full gaia_create_routing(). Any Contraction Hierarchies
+ data will be discarded.
+ */
+    SPATIALITE_DECLARE int gaia_update_routing (sqlite3 * db_handle,
+						const void *cache,
+						const char *routing_data_table,
+						const char *changes_table);
+
     SPATIALITE_DECLARE const char *gaia_create_routing_get_last_error (const
 								       void
 								       *cache);
@@ -330,6 +330,24 @@ extern "C"
 #define GAIA_NET_A_STAR_COEFF	0xa5
 /** VirtualNetwork internal markers: BLOCK */
 #define GAIA_NET_BLOCK		0xed
+/** VirtualNetwork internal markers: Contraction Hierarchies HEADER */
+#define GAIA_NET_CH_HEADER	0xc1
+/** VirtualNetwork internal markers: Contraction Hierarchies BLOCK */
+#define GAIA_NET_CH_BLOCK	0xee
+/** VirtualNetwork internal markers: Contraction Hierarchies NODE */
+#define GAIA_NET_CH_NODE	0xdf
+/** VirtualNetwork internal markers: Contraction Hierarchies SHORTCUT */
+#define GAIA_NET_CH_SHORTCUT	0x55
+/** VirtualNetwork internal markers: Time-Dependent HEADER */
+#define GAIA_NET_TD_HEADER	0xc2
+/** VirtualNetwork internal markers: Time-Dependent BLOCK */
+#define GAIA_NET_TD_BLOCK	0xef
+/** VirtualNetwork internal markers: Time-Dependent PROFILE */
+#define GAIA_NET_TD_PROFILE	0x56
+/** VirtualNetwork internal markers: Time-Dependent TURN */
+#define GAIA_NET_TD_TURN	0x57
+/** VirtualNetwork internal markers: REVISION */
+#define GAIA_NET_REVISION	0xc3
 
 /* constants used for Coordinate Dimensions */
 /** Coordinate Dimensions: XY */
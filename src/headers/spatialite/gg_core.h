@@ -1243,6 +1243,31 @@ extern "C"
  */
     GAIAGEO_DECLARE int gaiaGeometryAliasType (gaiaGeomCollPtr geom);
 
+/**
+ Determines OGC dimensions for a Geometry View
+
+ \param view pointer to Geometry View
+
+ \return OGC dimensions
+
+ \sa gaiaDimension, gaiaGeomViewFromBlob
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewDimension (gaiaGeomViewPtr view);
+
+/**
+ Determines the corresponding Type for a Geometry View
+
+ \param view pointer to Geometry View
+
+ \return the corresponding Geometry Type
+
+ \sa gaiaGeometryType, gaiaGeomViewFromBlob
+
+ \note the returned value is exactly the same gaiaGeometryType() would
+ return for the corresponding Geometry object.
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewGeometryType (gaiaGeomViewPtr view);
+
 /**
  Checks for empty Geometry object
 
@@ -580,6 +580,100 @@ extern "C"
 								 int
 								 gpkg_amphibious);
 
+/**
+ Initializes a read-only Geometry View over a BLOB-Geometry
+
+ \param view pointer to the Geometry View to be initialized
+ \param blob pointer to BLOB-Geometry
+ \param size the BLOB's size
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaGeomViewGetItem, gaiaGeomViewNextItem, gaiaGeomViewGetRing,
+ gaiaGeomViewGetVertex, gaiaFromSpatiaLiteBlobWkb
+
+ \note the whole BLOB will be validated, but no memory will be allocated
+ and no coordinate will be copied; the BLOB must stay valid while the View
+ is in use.
+ \n only SpatiaLite BLOB-Geometries (including TinyPoints and compressed
+ geometries) are supported: GPKG Geometry-BLOBs will always fail.
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewFromBlob (gaiaGeomViewPtr view,
+					      const unsigned char *blob,
+					      unsigned int size);
+
+/**
+ Retrieves an elementary item from a Geometry View
+
+ \param view pointer to the Geometry View
+ \param index relative index of the item (first item has index 0)
+ \param item pointer to the item descriptor to be filled
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaGeomViewFromBlob, gaiaGeomViewNextItem
+
+ \note items are returned in the same order they have into the BLOB.
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewGetItem (gaiaGeomViewPtr view, int index,
+					     gaiaGeomViewItemPtr item);
+
+/**
+ Advances an item descriptor to the next elementary item
+
+ \param view pointer to the Geometry View
+ \param item pointer to an item descriptor returned by gaiaGeomViewGetItem
+ or by a previous call to gaiaGeomViewNextItem
+
+ \return 0 if there are no more items: any other value on success.
+
+ \sa gaiaGeomViewGetItem
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewNextItem (gaiaGeomViewPtr view,
+					      gaiaGeomViewItemPtr item);
+
+/**
+ Retrieves a Ring from a Polygon item of a Geometry View
+
+ \param view pointer to the Geometry View
+ \param polyg pointer to a POLYGON item descriptor
+ \param index relative index of the Ring (0 is the exterior ring)
+ \param ring pointer to the descriptor to be filled
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaGeomViewGetItem, gaiaGeomViewGetVertex
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewGetRing (gaiaGeomViewPtr view,
+					     gaiaGeomViewItemPtr polyg,
+					     int index,
+					     gaiaGeomViewItemPtr ring);
+
+/**
+ Retrieves a Vertex from an item (or Ring) of a Geometry View
+
+ \param view pointer to the Geometry View
+ \param item pointer to an item or Ring descriptor
+ \param index relative index of the Vertex (first vertex has index 0)
+ \param x on completion this variable will contain the X coordinate
+ \param y on completion this variable will contain the Y coordinate
+ \param z on completion this variable will contain the Z coordinate
+ (0.0 if the item has no Z dimension)
+ \param m on completion this variable will contain the M measure
+ (0.0 if the item has no M dimension)
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaGeomViewGetItem, gaiaGeomViewGetRing
+
+ \note for POLYGON items the exterior ring will be accessed.
+ */
+    GAIAGEO_DECLARE int gaiaGeomViewGetVertex (gaiaGeomViewPtr view,
+					       gaiaGeomViewItemPtr item,
+					       int index, double *x,
+					       double *y, double *z,
+					       double *m);
+
 /**
  Creates a BLOB-Geometry corresponding to a Geometry object
 
@@ -271,6 +271,99 @@ extern "C"
  */
     typedef gaiaGeomColl *gaiaGeomCollPtr;
 
+/**
+ Read-only view over a SpatiaLite BLOB-Geometry
+
+ \note a Geometry View never allocates any memory: all values are
+ directly read from the BLOB, that must stay valid while the View is in use.
+ */
+    typedef struct gaiaGeomViewStruct
+    {
+/* a zero-copy view over a BLOB-Geometry */
+/** BLOB-Geometry buffer [not owned] */
+	const unsigned char *blob;	/* BLOB-Geometry buffer */
+/** BLOB-Geometry buffer size (in bytes) */
+	unsigned int size;	/* buffer size */
+/** BLOB Geometry endian arch */
+	int endian;		/* littleEndian - bigEndian */
+/** CPU endian arch */
+	int endian_arch;	/* littleEndian - bigEndian arch for target CPU */
+/** TRUE if the BLOB is a TinyPoint */
+	int TinyPoint;		/* TinyPoint BLOB */
+/** the SRID */
+	int Srid;		/* the SRID value */
+/** the Geometry Type code as declared by the BLOB */
+	int BlobType;		/* e.g. GAIA_POLYGONZ or GAIA_COMPRESSED_LINESTRING */
+/** any valid Geometry Class type */
+	int DeclaredType;	/* the declared TYPE for this Geometry */
+/** one of GAIA_XY, GAIA_XY_Z, GAIA_XY_M, GAIA_XY_ZM */
+	int DimensionModel;	/* (x,y), (x,y,z), (x,y,m) or (x,y,z,m) */
+/** MBR: min X */
+	double MinX;		/* MBR - BBOX */
+/** MBR: min Y */
+	double MinY;		/* MBR - BBOX */
+/** MBR: max X */
+	double MaxX;		/* MBR - BBOX */
+/** MBR: max Y */
+	double MaxY;		/* MBR - BBOX */
+/** total number of elementary items */
+	int NumItems;		/* Points + Linestrings + Polygons */
+/** number of elementary POINTs */
+	int NumPoints;
+/** number of elementary LINESTRINGs */
+	int NumLinestrings;
+/** number of elementary POLYGONs */
+	int NumPolygons;
+/** total number of RINGs (both exterior and interior) */
+	int NumRings;
+/** total number of vertices */
+	int NumVertices;
+/** the "widest" dimension model found in any elementary item */
+	int ItemsDimensionModel;
+/** TRUE if the BLOB contains a MULTIxx or GEOMETRYCOLLECTION */
+	int IsCollection;
+/** offset of the first elementary item */
+	unsigned int FirstItem;
+    } gaiaGeomView;
+/**
+ Typedef for Geometry View structure
+
+ \sa gaiaGeomView
+ */
+    typedef gaiaGeomView *gaiaGeomViewPtr;
+
+/**
+ Elementary item (or Ring) within a Geometry View
+ */
+    typedef struct gaiaGeomViewItemStruct
+    {
+/* an elementary item within a BLOB-Geometry */
+/** relative index of this item (or Ring) */
+	int Index;
+/** one of GAIA_POINT, GAIA_LINESTRING, GAIA_POLYGON */
+	int Type;
+/** one of GAIA_XY, GAIA_XY_Z, GAIA_XY_M, GAIA_XY_ZM */
+	int DimensionModel;
+/** TRUE if the vertices are compressed */
+	int Compressed;
+/** number of vertices: for POLYGONs, vertices of the exterior ring */
+	int Points;
+/** number of rings (POLYGONs only: exterior + interiors) */
+	int Rings;
+/** offset of the first vertex */
+	unsigned int Coords;
+/** offset of the first ring (POLYGONs only) */
+	unsigned int FirstRing;
+/** offset immediately following this item */
+	unsigned int Next;
+    } gaiaGeomViewItem;
+/**
+ Typedef for Geometry View item structure
+
+ \sa gaiaGeomViewItem
+ */
+    typedef gaiaGeomViewItem *gaiaGeomViewItemPtr;
+
 /**
  Container similar to LINESTRING [internally used]
  */
@@ -114,10 +114,29 @@ extern "C"
 	unsigned char gaiaBlob[64];
 	int gaiaBlobSize;
 	uLong crc32;
+	uLong adler32;
+	unsigned int lastUsed;
 	void *geosGeom;
 	void *preparedGeosGeom;
     };
 
+    struct splite_proj_cache_item
+    {
+	/* a cached pair of PROJ.4 initialized objects */
+	char *proj_from;
+	char *proj_to;
+	void *from_cs;
+	void *to_cs;
+	unsigned int lastUsed;
+    };
+
+    struct splite_srid_cache_item
+    {
+	/* a cached SRID -> PROJ.4 params lookup */
+	int srid;
+	char *proj_params;
+    };
+
     struct splite_xmlSchema_cache_item
     {
 	time_t timestamp;
@@ -148,6 +167,17 @@ extern "C"
 
 #define MAX_XMLSCHEMA_CACHE	16
 
+#define MAX_PROJ_CACHE	4
+#define MAX_SRID_CACHE	8
+
+#define GEOS_CACHE_DEFAULT_SIZE	16
+#define GEOS_CACHE_MAX_SIZE	1024
+
+#define UNION_MAX_THREADS	64
+
+#define ROUTING_HEAP_DARY	0
+#define ROUTING_HEAP_RADIX	1
+
     struct splite_internal_cache
     {
 	unsigned char magic1;
@@ -163,8 +193,20 @@ extern "C"
 	char *cutterMessage;
 	char *storedProcError;
 	char *createRoutingError;
-	struct splite_geos_cache_item cacheItem1;
-	struct splite_geos_cache_item cacheItem2;
+	struct splite_geos_cache_item *geosCache;
+	int geosCacheSize;
+	unsigned int geosCacheTick;
+	unsigned long geosCacheHits;
+	unsigned long geosCacheMisses;
+	struct splite_proj_cache_item projCache[MAX_PROJ_CACHE];
+	unsigned int projCacheTick;
+	struct splite_srid_cache_item sridCache[MAX_SRID_CACHE];
+	int sridCacheNext;
+	int unionThreads;
+	void *unionPool;
+	int routingHeap;
+	int knnMirror;
+	void *knnMirrors;
 	struct splite_xmlSchema_cache_item xmlSchemaCache[MAX_XMLSCHEMA_CACHE];
 	int pool_index;
 	void (*geos_warning) (const char *fmt, ...);
@@ -260,6 +302,8 @@ extern "C"
 
     SPATIALITE_PRIVATE void free_internal_cache_networks (void *first);
 
+    SPATIALITE_PRIVATE void free_knn_mirrors (void *first);
+
     SPATIALITE_PRIVATE struct epsg_defs *add_epsg_def (int filter_srid,
 						       struct epsg_defs
 						       **first,
@@ -334,6 +378,20 @@ extern "C"
 
     SPATIALITE_PRIVATE void voronoj_free (void *voronoj);
 
+    SPATIALITE_PRIVATE int splite_count_processors (void);
+
+    SPATIALITE_PRIVATE int splite_get_union_threads (const void *p_cache);
+
+    SPATIALITE_PRIVATE void *splite_union_engine_alloc (const void *p_cache);
+
+    SPATIALITE_PRIVATE int splite_union_engine_add (void *engine, void *geom);
+
+    SPATIALITE_PRIVATE void *splite_union_engine_final (void *engine);
+
+    SPATIALITE_PRIVATE void splite_union_engine_free (void *engine);
+
+    SPATIALITE_PRIVATE void splite_union_pool_free (void *pool);
+
     SPATIALITE_PRIVATE void *concave_hull_build (void *first,
 						 int dimension_model,
 						 double factor,
@@ -382,6 +440,30 @@ extern "C"
 
     SPATIALITE_PRIVATE int validateRowid (void *p_sqlite, const char *table);
 
+    SPATIALITE_PRIVATE int setDeferredSpatialIndex (void *p_sqlite,
+						    const char *table,
+						    const char *column,
+						    int deferred);
+
+    SPATIALITE_PRIVATE int flushDeferredSpatialIndex (void *p_sqlite,
+						      const char *table,
+						      const char *column);
+
+    SPATIALITE_PRIVATE int splite_spatial_index_estimate (void *p_sqlite,
+							  const char
+							  *db_prefix,
+							  const char *table,
+							  const char *column,
+							  int has_frame,
+							  double min_x,
+							  double min_y,
+							  double max_x,
+							  double max_y,
+							  double
+							  *estimated_rows,
+							  double
+							  *estimated_cost);
+
     SPATIALITE_PRIVATE int doComputeFieldInfos (void *p_sqlite,
 						const char *table,
 						const char *column,
@@ -390,6 +472,12 @@ extern "C"
     SPATIALITE_PRIVATE void getProjParams (void *p_sqlite, int srid,
 					   char **params);
 
+    SPATIALITE_PRIVATE void getProjParamsEx (void *p_sqlite,
+					     const void *p_cache, int srid,
+					     char **proj_params);
+
+    SPATIALITE_PRIVATE void splite_reset_srid_cache (const void *p_cache);
+
     SPATIALITE_PRIVATE int getEllipsoidParams (void *p_sqlite, int srid,
 					       double *a, double *b,
 					       double *rf);
@@ -933,6 +1021,11 @@ extern "C"
 
     SPATIALITE_PRIVATE void splite_cache_semaphore_unlock (void);
 
+    SPATIALITE_PRIVATE void splite_routing_cache_cleanup (void);
+
+    SPATIALITE_PRIVATE void splite_routing_cache_outdate (const void *sqlite,
+							  const char *table);
+
     SPATIALITE_PRIVATE const void *gaiaAuxClonerCreate (const void *sqlite,
 							const char *db_prefix,
 							const char *in_table,
@@ -956,6 +1049,14 @@ extern "C"
 
     SPATIALITE_PRIVATE int gaiaAuxClonerExecute (const void *cloner);
 
+    SPATIALITE_PRIVATE int gaiaAuxClusterTable (const void *sqlite,
+						const char *table,
+						const char *geometry,
+						int resequence);
+
+    SPATIALITE_PRIVATE unsigned int splite_hilbert_index (unsigned int x,
+							  unsigned int y);
+
     SPATIALITE_PRIVATE const void *gaiaElemGeomOptionsCreate ();
 
     SPATIALITE_PRIVATE void gaiaElemGeomOptionsAdd (const void *options,
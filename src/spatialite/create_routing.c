@@ -47,6 +47,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <stdio.h>
 #include <string.h>
 #include <float.h>
+#include <math.h>
 
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
@@ -1294,8 +1295,7 @@ do_check_input_table (sqlite3 * db_handle, const void *cache,
 			    sqlite3_bind_text (stmt_ins_links, 5, to,
 					       strlen (to), SQLITE_STATIC);
 			}
-		      sqlite3_bind_double (stmt_ins_links, 6, length);
-		      sqlite3_bind_double (stmt_ins_links, 7, cost);
+		      sqlite3_bind_double (stmt_ins_links, 6, cost);
 		      ret = sqlite3_step (stmt_ins_links);
 		      if (ret == SQLITE_DONE || ret == SQLITE_ROW)
 			  ;
@@ -1973,12 +1973,52 @@ do_prepare_header (unsigned char *buf, int endian_arch, int n_nodes,
     return out - buf;
 }
 
+typedef struct routing_arc_struct
+{
+/* an arc (Link) exactly as it has been stored into NETWORK-DATA */
+    int From;
+    int To;
+    double Cost;
+} RoutingArc;
+typedef RoutingArc *RoutingArcPtr;
+
+typedef struct routing_arcs_struct
+{
+/* all arcs (Links) in the same order they have into NETWORK-DATA */
+    RoutingArcPtr Arcs;
+    int Count;
+    int Max;
+} RoutingArcs;
+typedef RoutingArcs *RoutingArcsPtr;
+
+static int
+routing_arcs_add (RoutingArcsPtr list, int from, int to, double cost)
+{
+/* appending an arc to the list */
+    RoutingArcPtr arc;
+    if (list->Count >= list->Max)
+      {
+	  int max = (list->Max == 0) ? 1024 : list->Max * 2;
+	  RoutingArcPtr arcs = realloc (list->Arcs, sizeof (RoutingArc) * max);
+	  if (arcs == NULL)
+	      return 0;
+	  list->Arcs = arcs;
+	  list->Max = max;
+      }
+    arc = list->Arcs + list->Count;
+    arc->From = from;
+    arc->To = to;
+    arc->Cost = cost;
+    list->Count += 1;
+    return 1;
+}
+
 static int
 output_node (unsigned char *auxbuf, int *size, int index, int has_ids,
 	     int max_code_length, int endian_arch, int a_star_enabled,
 	     sqlite3_int64 id, const char *code, double x, double y,
 	     short count_outcomings, sqlite3 * db_handle, const void *cache,
-	     sqlite3_stmt * stmt_to)
+	     sqlite3_stmt * stmt_to, RoutingArcsPtr arcs)
 {
 /* exporting a Node into NETWORK-DATA */
     int ret;
@@ -2033,6 +2073,16 @@ output_node (unsigned char *auxbuf, int *size, int index, int has_ids,
 		gaiaExport64 (out, cost, 1, endian_arch);	/* the Arc Cost */
 		out += 8;
 		*out++ = GAIA_NET_END;
+		if (arcs != NULL)
+		  {
+		      /* remembering the arc for Contraction Hierarchies */
+		      if (!routing_arcs_add (arcs, index, index_to, cost))
+			{
+			    gaia_create_routing_set_error (cache,
+							   "insufficient memory");
+			    return 0;
+			}
+		  }
 	    }
 	  else
 	    {
@@ -2056,9 +2106,13 @@ do_create_data (sqlite3 * db_handle, const void *cache,
 		const char *from_column, const char *to_column,
 		const char *geom_column, const char *name_column,
 		int a_star_enabled, double a_star_coeff, int has_ids,
-		int n_nodes, int max_code_length)
+		int n_nodes, int max_code_length, RoutingArcsPtr arcs)
 {
-/* creating and populating the Routing Data table */
+/* 
+/ creating and populating the Routing Data table
+/ if a list is passed, all arcs will be collected into it
+/ in the same order they are stored into NETWORK-DATA
+*/
     char *sql;
     int ret;
     char *xtable;
@@ -2127,13 +2181,15 @@ do_create_data (sqlite3 * db_handle, const void *cache,
 	    "SELECT n.internal_index, n.node_id, n.node_x, n.node_y, Count(l.rowid) "
 	    "FROM create_routing_nodes AS n "
 	    "LEFT JOIN create_routing_links as l ON (l.index_from = n.internal_index) "
-	    "WHERE n.internal_index IS NOT NULL " "GROUP BY n.internal_index";
+	    "WHERE n.internal_index IS NOT NULL " "GROUP BY n.internal_index "
+	    "ORDER BY n.internal_index";
     else
 	sql =
 	    "SELECT n.internal_index, n.node_code, n.node_x, n.node_y, Count(l.rowid) "
 	    "FROM create_routing_nodes AS n "
 	    "LEFT JOIN create_routing_links as l ON (l.index_from = n.internal_index) "
-	    "WHERE n.internal_index IS NOT NULL " "GROUP BY n.internal_index";
+	    "WHERE n.internal_index IS NOT NULL " "GROUP BY n.internal_index "
+	    "ORDER BY n.internal_index";
     ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_from, NULL);
     if (ret != SQLITE_OK)
       {
@@ -2218,7 +2274,7 @@ do_create_data (sqlite3 * db_handle, const void *cache,
 		if (!output_node
 		    (auxbuf, &size, index, has_ids, max_code_length,
 		     endian_arch, a_star_enabled, id, code, x, y,
-		     count_outcomings, db_handle, cache, stmt_to))
+		     count_outcomings, db_handle, cache, stmt_to, arcs))
 		  {
 		      error = 1;
 		      goto error;
@@ -2333,423 +2389,516 @@ do_create_data (sqlite3 * db_handle, const void *cache,
     return 1;
 }
 
-static int
-do_create_virtual_routing (sqlite3 * db_handle, const void *cache,
-			   const char *routing_data_table,
-			   const char *virtual_routing_table)
+/*
+/ Contraction Hierarchies preprocessing
+/
+/ all Nodes are contracted one at time following an "edge difference"
+/ priority; whenever removing a Node would break some shortest path
+/ a Shortcut arc is added in its place.
+/ both the Node order (rank) and the Shortcuts are then stored into
+/ the Routing Data table, so that VirtualRouting could later answer
+/ Shortest Path queries by performing a bidirectional upward search.
+*/
+
+#define CH_WITNESS_MAX_SETTLED	512
+#define CH_SIMULATE_MAX_SETTLED	16
+#define CH_MAX_BLOCK_ITEMS	30000
+
+typedef struct ch_arc_struct
 {
-/* creating the VirtualRouting table - dropping the Temp-Tables */
-    char *xtable1;
-    char *xtable2;
-    char *sql;
-    int ret;
+/* a CH arc: an original Link or a Shortcut */
+    int From;
+    int To;
+    double Cost;
+    int Child1;			/* first half of a Shortcut; -1 for original Links */
+    int Child2;			/* second half of a Shortcut; -1 for original Links */
+} ChArc;
+typedef ChArc *ChArcPtr;
+
+typedef struct ch_adjacency_struct
+{
+/* the list of arcs incident on some Node */
+    int *Arcs;
+    int Count;
+    int Max;
+} ChAdjacency;
+typedef ChAdjacency *ChAdjacencyPtr;
+
+typedef struct ch_heap_item_struct
+{
+/* a Heap item */
+    int Node;
+    double Key;
+} ChHeapItem;
+typedef ChHeapItem *ChHeapItemPtr;
 
-    xtable1 = gaiaDoubleQuotedSql (virtual_routing_table);
-    xtable2 = gaiaDoubleQuotedSql (routing_data_table);
-    sql =
-	sqlite3_mprintf
-	("CREATE VIRTUAL TABLE \"%s\" USING  VirtualRouting(\"%s\")", xtable1,
-	 xtable2);
-    free (xtable1);
-    free (xtable2);
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
+typedef struct ch_heap_struct
+{
+/* a binary min-Heap (supporting lazy deletion) */
+    ChHeapItemPtr Items;
+    int Count;
+    int Max;
+} ChHeap;
+typedef ChHeap *ChHeapPtr;
+
+typedef struct ch_builder_struct
+{
+/* the Contraction Hierarchies builder */
+    int NumNodes;
+    int NumLinks;		/* how many original Links */
+    int NumArcs;		/* original Links + Shortcuts */
+    int MaxArcs;
+    ChArcPtr Arcs;
+    ChAdjacencyPtr Out;
+    ChAdjacencyPtr In;
+    int *Rank;			/* -1 for not yet contracted Nodes */
+    int *Deleted;		/* how many neighbours have already been contracted */
+    double *Dist;		/* witness search distances */
+    int *Touched;		/* Nodes touched by the current witness search */
+    int NumTouched;
+    ChHeap Heap;
+} ChBuilder;
+typedef ChBuilder *ChBuilderPtr;
+
+static void
+ch_heap_push (ChHeapPtr heap, int node, double key)
+{
+/* inserting an item into the Heap */
+    int i;
+    int parent;
+    ChHeapItem tmp;
+    if (heap->Count == heap->Max)
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  goto rollback;
+	  heap->Max = (heap->Max == 0) ? 1024 : heap->Max * 2;
+	  heap->Items = realloc (heap->Items, sizeof (ChHeapItem) * heap->Max);
       }
-    do_drop_temp_tables (db_handle);
+    i = heap->Count++;
+    heap->Items[i].Node = node;
+    heap->Items[i].Key = key;
+    while (i > 0)
+      {
+	  parent = (i - 1) / 2;
+	  if (heap->Items[parent].Key <= heap->Items[i].Key)
+	      break;
+	  tmp = heap->Items[parent];
+	  heap->Items[parent] = heap->Items[i];
+	  heap->Items[i] = tmp;
+	  i = parent;
+      }
+}
 
-/* releasing the Savepoint */
-    sql = "RELEASE SAVEPOINT create_routing_zero";
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    if (ret != SQLITE_OK)
+static ChHeapItem
+ch_heap_pop (ChHeapPtr heap)
+{
+/* removing the topmost item from the Heap */
+    int i = 0;
+    int child;
+    ChHeapItem tmp;
+    ChHeapItem top = heap->Items[0];
+    heap->Items[0] = heap->Items[--heap->Count];
+    while (1)
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  return 0;
+	  child = (2 * i) + 1;
+	  if (child >= heap->Count)
+	      break;
+	  if (child + 1 < heap->Count
+	      && heap->Items[child + 1].Key < heap->Items[child].Key)
+	      child++;
+	  if (heap->Items[i].Key <= heap->Items[child].Key)
+	      break;
+	  tmp = heap->Items[child];
+	  heap->Items[child] = heap->Items[i];
+	  heap->Items[i] = tmp;
+	  i = child;
       }
-    return 1;
+    return top;
+}
 
-  rollback:
-    sql = "ROLLBACK TO create_routing_zero";
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    if (ret != SQLITE_OK)
+static void
+ch_adjacency_add (ChAdjacencyPtr adj, int arc)
+{
+/* adding an arc to some adjacency list */
+    if (adj->Count == adj->Max)
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  return 0;
+	  adj->Max = (adj->Max == 0) ? 4 : adj->Max * 2;
+	  adj->Arcs = realloc (adj->Arcs, sizeof (int) * adj->Max);
       }
-    return 0;
+    adj->Arcs[adj->Count++] = arc;
 }
 
 static int
-do_check_registered_spatial_table (sqlite3 * db_handle, const char *db_prefix,
-				   const char *table, const char *geom_column,
-				   char **geom_name)
+ch_add_arc (ChBuilderPtr ch, int from, int to, double cost, int child1,
+	    int child2)
 {
-/* checking for a valid Spatial Table */
-    char *xprefix;
-    char *sql;
-    char *name = NULL;
-    int ret;
-    sqlite3_stmt *stmt = NULL;
-    int type;
-    int count = 0;
-    int is_linestring = 0;
-
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
+/* adding an arc (original Link or Shortcut) */
+    ChArcPtr arc;
+    if (ch->NumArcs == ch->MaxArcs)
+      {
+	  ch->MaxArcs = (ch->MaxArcs == 0) ? 1024 : ch->MaxArcs * 2;
+	  ch->Arcs = realloc (ch->Arcs, sizeof (ChArc) * ch->MaxArcs);
+      }
+    arc = ch->Arcs + ch->NumArcs;
+    arc->From = from;
+    arc->To = to;
+    arc->Cost = cost;
+    arc->Child1 = child1;
+    arc->Child2 = child2;
+    ch_adjacency_add (ch->Out + from, ch->NumArcs);
+    ch_adjacency_add (ch->In + to, ch->NumArcs);
+    return ch->NumArcs++;
+}
 
-    if (geom_column == NULL)
+static ChBuilderPtr
+ch_builder_alloc (int n_nodes)
+{
+/* allocating an empty CH builder */
+    int i;
+    ChBuilderPtr ch = malloc (sizeof (ChBuilder));
+    ch->NumNodes = n_nodes;
+    ch->NumLinks = 0;
+    ch->NumArcs = 0;
+    ch->MaxArcs = 0;
+    ch->Arcs = NULL;
+    ch->Out = calloc (n_nodes, sizeof (ChAdjacency));
+    ch->In = calloc (n_nodes, sizeof (ChAdjacency));
+    ch->Rank = malloc (sizeof (int) * n_nodes);
+    ch->Deleted = calloc (n_nodes, sizeof (int));
+    ch->Dist = malloc (sizeof (double) * n_nodes);
+    ch->Touched = malloc (sizeof (int) * n_nodes);
+    ch->NumTouched = 0;
+    for (i = 0; i < n_nodes; i++)
       {
-	  sql =
-	      sqlite3_mprintf
-	      ("SELECT f_geometry_column, geometry_type FROM \"%s\".geometry_columns WHERE "
-	       "Lower(f_table_name) = Lower(%Q)", xprefix, table);
+	  ch->Rank[i] = -1;
+	  ch->Dist[i] = DBL_MAX;
       }
-    else
+    ch->Heap.Items = NULL;
+    ch->Heap.Count = 0;
+    ch->Heap.Max = 0;
+    return ch;
+}
+
+static void
+ch_builder_free (ChBuilderPtr ch)
+{
+/* memory cleanup - destroying a CH builder */
+    int i;
+    if (ch == NULL)
+	return;
+    for (i = 0; i < ch->NumNodes; i++)
       {
-	  sql =
-	      sqlite3_mprintf
-	      ("SELECT f_geometry_column, geometry_type FROM \"%s\".geometry_columns WHERE "
-	       "Lower(f_table_name) = Lower(%Q) AND Lower(f_geometry_column) = Lower(%Q)",
-	       xprefix, table, geom_column);
+	  if (ch->Out[i].Arcs != NULL)
+	      free (ch->Out[i].Arcs);
+	  if (ch->In[i].Arcs != NULL)
+	      free (ch->In[i].Arcs);
       }
-    free (xprefix);
-    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+    free (ch->Out);
+    free (ch->In);
+    if (ch->Arcs != NULL)
+	free (ch->Arcs);
+    free (ch->Rank);
+    free (ch->Deleted);
+    free (ch->Dist);
+    free (ch->Touched);
+    if (ch->Heap.Items != NULL)
+	free (ch->Heap.Items);
+    free (ch);
+}
+
+static void
+ch_witness_search (ChBuilderPtr ch, int source, int excluded, double max_cost,
+		   int max_settled)
+{
+/* 
+/ local Dijkstra search starting from Source and ignoring both the
+/ Excluded node and all the already contracted nodes
+/ the search stops as soon as MaxCost is exceeded or too many
+/ Nodes have been settled
+*/
+    int i;
+    int settled = 0;
+    ChHeapItem item;
+    ChAdjacencyPtr adj;
+    ch->Dist[source] = 0.0;
+    ch->Touched[ch->NumTouched++] = source;
+    ch->Heap.Count = 0;
+    ch_heap_push (&(ch->Heap), source, 0.0);
+    while (ch->Heap.Count > 0)
       {
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
+	  item = ch_heap_pop (&(ch->Heap));
+	  if (item.Key > ch->Dist[item.Node])
+	      continue;		/* stale item */
+	  if (item.Key > max_cost)
 	      break;
-	  if (ret == SQLITE_ROW)
+	  if (++settled > max_settled)
+	      break;
+	  adj = ch->Out + item.Node;
+	  for (i = 0; i < adj->Count; i++)
 	    {
-		const char *geom = (const char *) sqlite3_column_text (stmt, 0);
-		int len = strlen (geom);
-		if (name != NULL)
-		    free (name);
-		name = malloc (len + 1);
-		strcpy (name, geom);
-		type = sqlite3_column_int (stmt, 1);
-		count++;
+		ChArcPtr arc = ch->Arcs + adj->Arcs[i];
+		int to = arc->To;
+		double dist = item.Key + arc->Cost;
+		if (to == excluded || ch->Rank[to] >= 0)
+		    continue;
+		if (dist < ch->Dist[to])
+		  {
+		      if (ch->Dist[to] == DBL_MAX)
+			  ch->Touched[ch->NumTouched++] = to;
+		      ch->Dist[to] = dist;
+		      ch_heap_push (&(ch->Heap), to, dist);
+		  }
 	    }
       }
-    sqlite3_finalize (stmt);
-    if (count == 1)
+}
+
+static void
+ch_witness_reset (ChBuilderPtr ch)
+{
+/* resetting all distances touched by the last witness search */
+    int i;
+    for (i = 0; i < ch->NumTouched; i++)
+	ch->Dist[ch->Touched[i]] = DBL_MAX;
+    ch->NumTouched = 0;
+}
+
+static int
+ch_contract_node (ChBuilderPtr ch, int node, int simulate)
+{
+/* 
+/ contracting a Node (or just simulating its contraction)
+/ returns the number of required Shortcuts
+*/
+    int i;
+    int j;
+    int shortcuts = 0;
+    ChAdjacencyPtr in = ch->In + node;
+    ChAdjacencyPtr out = ch->Out + node;
+    int count_in = in->Count;
+    int count_out = out->Count;
+    for (i = 0; i < count_in; i++)
       {
-	  switch (type)
+	  int arc_in = in->Arcs[i];
+	  int from = ch->Arcs[arc_in].From;
+	  double cost_in = ch->Arcs[arc_in].Cost;
+	  double max_out = -1.0;
+	  if (from == node || ch->Rank[from] >= 0)
+	      continue;
+	  for (j = 0; j < count_out; j++)
 	    {
-	    case GAIA_LINESTRING:
-	    case GAIA_LINESTRINGZ:
-	    case GAIA_LINESTRINGM:
-	    case GAIA_LINESTRINGZM:
-		is_linestring = 1;
-		break;
-	    default:
-		is_linestring = 0;
-		break;
-	    };
+		ChArcPtr arc = ch->Arcs + out->Arcs[j];
+		if (arc->To == node || arc->To == from || ch->Rank[arc->To] >= 0)
+		    continue;
+		if (arc->Cost > max_out)
+		    max_out = arc->Cost;
+	    }
+	  if (max_out < 0.0)
+	      continue;		/* no outcoming arcs */
+	  ch_witness_search (ch, from, node, cost_in + max_out,
+			     simulate ? CH_SIMULATE_MAX_SETTLED :
+			     CH_WITNESS_MAX_SETTLED);
+	  for (j = 0; j < count_out; j++)
+	    {
+		int arc_out = out->Arcs[j];
+		int to = ch->Arcs[arc_out].To;
+		double via = cost_in + ch->Arcs[arc_out].Cost;
+		if (to == node || to == from || ch->Rank[to] >= 0)
+		    continue;
+		if (ch->Dist[to] <= via)
+		    continue;	/* a witness path exists */
+		shortcuts++;
+		if (!simulate)
+		  {
+		      /* the new Shortcut will act as a witness from now on */
+		      ch_add_arc (ch, from, to, via, arc_in, arc_out);
+		      if (via < ch->Dist[to])
+			{
+			    if (ch->Dist[to] == DBL_MAX)
+				ch->Touched[ch->NumTouched++] = to;
+			    ch->Dist[to] = via;
+			}
+		  }
+	    }
+	  ch_witness_reset (ch);
       }
-    if (is_linestring)
+    return shortcuts;
+}
+
+static void
+ch_compact (ChBuilderPtr ch, int node)
+{
+/* removing from the adjacency lists all arcs leading to contracted Nodes */
+    int i;
+    int j;
+    ChAdjacencyPtr adj = ch->Out + node;
+    for (i = 0, j = 0; i < adj->Count; i++)
       {
-	  *geom_name = name;
-	  return 1;
+	  if (ch->Rank[ch->Arcs[adj->Arcs[i]].To] < 0)
+	      adj->Arcs[j++] = adj->Arcs[i];
       }
-    if (name != NULL)
-	free (name);
-    return 0;
+    adj->Count = j;
+    adj = ch->In + node;
+    for (i = 0, j = 0; i < adj->Count; i++)
+      {
+	  if (ch->Rank[ch->Arcs[adj->Arcs[i]].From] < 0)
+	      adj->Arcs[j++] = adj->Arcs[i];
+      }
+    adj->Count = j;
 }
 
-static int
-do_check_spatial_table (sqlite3 * db_handle, const void *cache,
-			const char *db_prefix, const char *table,
-			const char *geom_column, const char *from_column,
-			const char *to_column, char **geom_name)
+static double
+ch_priority (ChBuilderPtr ch, int node)
 {
-/* testing if the Spatial Table exists and it's correctly defined */
-    char *xprefix;
-    char *xtable;
-    char *sql;
-    int ret;
+/* computing the "edge difference" priority of some Node */
     int i;
-    char **results;
-    int rows;
-    int columns;
-    int ok_from = 0;
-    int ok_to = 0;
-    int ok_geom = 0;
-
-/* checking for a valid Spatial Table */
-    *geom_name = NULL;
-    if (!do_check_registered_spatial_table
-	(db_handle, db_prefix, table, geom_column, geom_name))
+    int degree = 0;
+    int shortcuts = ch_contract_node (ch, node, 1);
+    for (i = 0; i < ch->In[node].Count; i++)
       {
-	  char *msg;
-	  if (geom_column == NULL)
-	      msg =
-		  sqlite3_mprintf
-		  ("%Q is not a valid Spatial Table (LINESTRING)", table);
-	  else
-	      msg =
-		  sqlite3_mprintf
-		  ("%Q.%Q is not a valid Spatial Table (LINESTRING)", table,
-		   geom_column);
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free(msg);
-	  return 0;
+	  if (ch->Rank[ch->Arcs[ch->In[node].Arcs[i]].From] < 0)
+	      degree++;
       }
-
-/* checking the table's columns */
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
-    xtable = gaiaDoubleQuotedSql (table);
-    sql = sqlite3_mprintf ("PRAGMA \"%s\".table_info(\"%s\")", xprefix, xtable);
-    free (xprefix);
-    free (xtable);
-    ret = sqlite3_get_table (db_handle, sql, &results, &rows, &columns, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-	return 0;
-    for (i = 1; i <= rows; i++)
+    for (i = 0; i < ch->Out[node].Count; i++)
       {
-	  const char *col = results[(i * columns) + 1];
-	  if (strcasecmp (col, from_column) == 0)
-	      ok_from = 1;
-	  if (strcasecmp (col, to_column) == 0)
-	      ok_to = 1;
-	  if (strcasecmp (col, *geom_name) == 0)
-	      ok_geom = 1;
+	  if (ch->Rank[ch->Arcs[ch->Out[node].Arcs[i]].To] < 0)
+	      degree++;
       }
-    sqlite3_free_table (results);
+    return (double) (shortcuts - degree) + (double) ch->Deleted[node];
+}
 
-/* final validity check */
-    if (ok_from)
+static void
+ch_build (ChBuilderPtr ch)
+{
+/* computing the Node order and all the Shortcuts */
+    int i;
+    int rank = 0;
+    ChHeap queue;
+    ChHeapItem item;
+    queue.Items = NULL;
+    queue.Count = 0;
+    queue.Max = 0;
+    for (i = 0; i < ch->NumNodes; i++)
+	ch_heap_push (&queue, i, ch_priority (ch, i));
+    while (queue.Count > 0)
       {
-	  char *msg =
-	      sqlite3_mprintf
-	      ("FromNode Column \"%s\" is already defined in the Spatial Table",
-	       from_column);
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  return 0;
-      }
-    if (ok_to)
-      {
-	  char *msg =
-	      sqlite3_mprintf
-	      ("ToNode Column \"%s\" is already defined in the Spatial Table",
-	       to_column);
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  return 0;
-      }
-    if (!ok_geom)
-      {
-	  char *msg =
-	      sqlite3_mprintf
-	      ("Geometry Column \"%s\" is not defined in the Spatial Table",
-	       geom_name);
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  return 0;
+	  double priority;
+	  item = ch_heap_pop (&queue);
+	  if (ch->Rank[item.Node] >= 0)
+	      continue;
+	  /* lazy update: priorities could be changed since the last time */
+	  priority = ch_priority (ch, item.Node);
+	  if (queue.Count > 0 && priority > queue.Items[0].Key)
+	    {
+		ch_heap_push (&queue, item.Node, priority);
+		continue;
+	    }
+	  ch_contract_node (ch, item.Node, 0);
+	  ch->Rank[item.Node] = rank++;
+	  for (i = 0; i < ch->In[item.Node].Count; i++)
+	    {
+		int from = ch->Arcs[ch->In[item.Node].Arcs[i]].From;
+		if (ch->Rank[from] >= 0)
+		    continue;
+		ch->Deleted[from] += 1;
+		ch_compact (ch, from);
+	    }
+	  for (i = 0; i < ch->Out[item.Node].Count; i++)
+	    {
+		int to = ch->Arcs[ch->Out[item.Node].Arcs[i]].To;
+		if (ch->Rank[to] >= 0)
+		    continue;
+		ch->Deleted[to] += 1;
+		ch_compact (ch, to);
+	    }
       }
-
-    return 1;
+    if (queue.Items != NULL)
+	free (queue.Items);
 }
 
 static int
-do_insert_temp_aux_node (sqlite3 * db_handle, sqlite3_stmt * stmt, double x,
-			 double y, double z, char **msg)
+do_insert_ch_block (sqlite3 * db_handle, const void *cache,
+		    sqlite3_stmt * stmt, const unsigned char *buf, int size)
 {
-/* inserting an Aux Node */
+/* inserting a CH block into the Routing Data table */
     int ret;
-
     sqlite3_reset (stmt);
     sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, x);
-    sqlite3_bind_double (stmt, 2, y);
-    sqlite3_bind_double (stmt, 3, z);
+    sqlite3_bind_null (stmt, 1);
+    sqlite3_bind_blob (stmt, 2, buf, size, SQLITE_STATIC);
     ret = sqlite3_step (stmt);
     if (ret == SQLITE_DONE || ret == SQLITE_ROW)
 	return 1;
-
-/* some error occurred */
-    *msg = sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-    fprintf (stderr, "%s\n", *msg);
-    return 0;
-}
-
-static int
-do_update_link (sqlite3 * db_handle, sqlite3_stmt * stmt,
-		sqlite3_stmt * stmt_upd, int rowid, double from_x,
-		double from_y, double from_z, double to_x, double to_y,
-		double to_z, char **msg)
-{
-/* updating the Spatial Table - step #1 */
-    int ret;
-
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, from_x);
-    sqlite3_bind_double (stmt, 2, from_y);
-    sqlite3_bind_double (stmt, 3, from_z);
-    sqlite3_bind_double (stmt, 4, to_x);
-    sqlite3_bind_double (stmt, 5, to_y);
-    sqlite3_bind_double (stmt, 6, to_z);
-    while (1)
+    else
       {
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;
-	  if (ret == SQLITE_ROW)
-	    {
-		int node_from = sqlite3_column_int (stmt, 0);
-		int node_to = sqlite3_column_int (stmt, 1);
-
-		sqlite3_reset (stmt_upd);
-		sqlite3_clear_bindings (stmt_upd);
-		sqlite3_bind_int (stmt_upd, 1, node_from);
-		sqlite3_bind_int (stmt_upd, 2, node_to);
-		sqlite3_bind_int (stmt_upd, 3, rowid);
-		ret = sqlite3_step (stmt_upd);
-		if (ret == SQLITE_DONE || ret == SQLITE_ROW)
-		    return 1;
-		else
-		  {
-		      *msg =
-			  sqlite3_mprintf ("SQL error: %s",
-					   sqlite3_errmsg (db_handle));
-		      return 0;
-		  }
-
-/* some error occurred */
-		*msg =
-		    sqlite3_mprintf ("SQL error: %s",
-				     sqlite3_errmsg (db_handle));
-		return 0;
-	    }
-	  else
-	    {
-		*msg =
-		    sqlite3_mprintf ("SQL error: %s",
-				     sqlite3_errmsg (db_handle));
-		return 0;
-	    }
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
       }
-    return 1;
 }
 
 static int
-do_create_routing_nodes (sqlite3 * db_handle, const void *cache,
-			 const char *db_prefix, const char *table,
-			 const char *geom_column, const char *from_column,
-			 const char *to_column)
+do_create_ch_data (sqlite3 * db_handle, const void *cache,
+		   const char *output_table, int n_nodes, RoutingArcsPtr arcs)
 {
-/* creating and populating the Routing Nodes columns */
-    char *xprefix;
-    char *xtable;
-    char *xcolumn;
-    char *xfrom;
-    char *xto;
+/* adding the Contraction Hierarchies blocks to the Routing Data table */
     char *sql;
+    const char *sql2;
     int ret;
-    sqlite3_stmt *stmt_q1 = NULL;
-    sqlite3_stmt *stmt_ins = NULL;
-    sqlite3_stmt *stmt_q2 = NULL;
-    sqlite3_stmt *stmt_upd = NULL;
+    char *xtable;
+    sqlite3_stmt *stmt_out = NULL;
+    int error = 0;
+    unsigned char *buf = NULL;
+    unsigned char *out;
+    int items;
+    int i;
+    int prev_from = 0;
+    int endian_arch = gaiaEndianArch ();
+    ChBuilderPtr ch = NULL;
 
-/* adding the FromNode column */
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
-    xtable = gaiaDoubleQuotedSql (table);
-    xcolumn = gaiaDoubleQuotedSql (from_column);
-    sql =
-	sqlite3_mprintf ("ALTER TABLE \"%s\".\"%s\" ADD COLUMN \"%s\" INTEGER",
-			 xprefix, xtable, xcolumn);
-    free (xprefix);
-    free (xtable);
-    free (xcolumn);
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    sqlite3_free (sql);
+/* setting a Savepoint */
+    sql2 = "SAVEPOINT create_routing_ch";
+    ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
     if (ret != SQLITE_OK)
       {
 	  char *msg =
 	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
 	  gaia_create_routing_set_error (cache, msg);
 	  sqlite3_free (msg);
-	  goto error;
+	  return 0;
       }
 
-/* adding the ToNode column */
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
-    xtable = gaiaDoubleQuotedSql (table);
-    xcolumn = gaiaDoubleQuotedSql (to_column);
-    sql =
-	sqlite3_mprintf ("ALTER TABLE \"%s\".\"%s\" ADD COLUMN \"%s\" INTEGER",
-			 xprefix, xtable, xcolumn);
-    free (xprefix);
-    free (xtable);
-    free (xcolumn);
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
+/* 
+/ the original Links are exactly the same arcs (in the same order)
+/ just stored into the NETWORK-DATA blocks, i.e. grouped by FromNode
+/ in ascending order; VirtualRouting will number them this way
+*/
+    ch = ch_builder_alloc (n_nodes);
+    for (i = 0; i < arcs->Count; i++)
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  goto error;
+	  RoutingArcPtr arc = arcs->Arcs + i;
+	  if (arc->From < prev_from || arc->From >= n_nodes || arc->To < 0
+	      || arc->To >= n_nodes)
+	    {
+		gaia_create_routing_set_error (cache,
+					       "Contraction Hierarchies: invalid Node index");
+		error = 1;
+		goto error;
+	    }
+	  prev_from = arc->From;
+	  ch_add_arc (ch, arc->From, arc->To, arc->Cost, -1, -1);
       }
+    ch->NumLinks = ch->NumArcs;
 
-/* dropping the Temporary Aux Table (just in case) */
-    sql = "DROP TABLE temp_create_routing_aux_nodes";
-    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-
-/* creating the Temporary Aux Table for Nodes */
-    sql = "CREATE TEMPORARY TABLE temp_create_routing_aux_nodes ("
-	"x DOUBLE, y DOUBLE, z DOUBLE, "
-	"CONSTRAINT pk_create_routing_aux_nodes PRIMARY KEY (x, y, z))";
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    if (ret != SQLITE_OK)
-      {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  goto error;
-      }
+/* contracting all Nodes */
+    ch_build (ch);
 
-/* preparing the query statement for identifying all Nodes */
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
-    xtable = gaiaDoubleQuotedSql (table);
-    xcolumn = gaiaDoubleQuotedSql (geom_column);
+/* preparing the Insert SQL statement */
+    xtable = gaiaDoubleQuotedSql (output_table);
     sql =
 	sqlite3_mprintf
-	("SELECT ROWID, ST_StartPoint(\"%s\"), ST_EndPoint(\"%s\") "
-	 "FROM \"%s\".\"%s\"", xcolumn, xcolumn, xprefix, xtable);
-    free (xprefix);
+	("INSERT INTO \"%s\" (Id, NetworkData) VALUES (?, ?)", xtable);
     free (xtable);
-    free (xcolumn);
-    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_q1, NULL);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_out, NULL);
     sqlite3_free (sql);
     if (ret != SQLITE_OK)
       {
@@ -2757,52 +2906,283 @@ do_create_routing_nodes (sqlite3 * db_handle, const void *cache,
 	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
 	  gaia_create_routing_set_error (cache, msg);
 	  sqlite3_free (msg);
+	  error = 1;
 	  goto error;
       }
 
-/* preparing the INSERT statement for Aux Nodes */
-    sql = "INSERT OR IGNORE INTO temp_create_routing_aux_nodes "
-	"VALUES (?, ?, ?)";
-    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_ins, NULL);
-    if (ret != SQLITE_OK)
+/* inserting the CH Header block */
+    buf = malloc (MAX_BLOCK);
+    out = buf;
+    *out++ = GAIA_NET_CH_HEADER;
+    gaiaExport32 (out, n_nodes, 1, endian_arch);	/* how many Nodes */
+    out += 4;
+    gaiaExport32 (out, ch->NumLinks, 1, endian_arch);	/* how many original Links */
+    out += 4;
+    gaiaExport32 (out, ch->NumArcs - ch->NumLinks, 1, endian_arch);	/* how many Shortcuts */
+    out += 4;
+    *out++ = GAIA_NET_END;
+    if (!do_insert_ch_block (db_handle, cache, stmt_out, buf, out - buf))
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
+	  error = 1;
 	  goto error;
       }
 
-/* preparing the query statement for identifying all Node-IDs */
-    sql = "SELECT a.ROWID, b.ROWID "
-	"FROM temp_create_routing_aux_nodes AS a, "
-	"temp_create_routing_aux_nodes AS b "
-	"WHERE a.x = ? AND a.y = ? AND a.z = ? "
-	"AND b.x = ? AND b.y = ? AND b.z = ?";
-    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_q2, NULL);
-    if (ret != SQLITE_OK)
+/* inserting the Node ranks, then all Shortcuts */
+    out = buf;
+    *out++ = GAIA_NET_CH_BLOCK;
+    out += 2;
+    items = 0;
+    for (i = 0; i < n_nodes + (ch->NumArcs - ch->NumLinks); i++)
       {
-	  char *msg =
-	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
-	  goto error;
+	  if (items == CH_MAX_BLOCK_ITEMS)
+	    {
+		/* inserting the current block */
+		gaiaExport16 (buf + 1, items, 1, endian_arch);	/* how many items are into this block */
+		if (!do_insert_ch_block
+		    (db_handle, cache, stmt_out, buf, out - buf))
+		  {
+		      error = 1;
+		      goto error;
+		  }
+		out = buf;
+		*out++ = GAIA_NET_CH_BLOCK;
+		out += 2;
+		items = 0;
+	    }
+	  if (i < n_nodes)
+	    {
+		/* the rank of some Node */
+		*out++ = GAIA_NET_CH_NODE;
+		gaiaExport32 (out, i, 1, endian_arch);	/* the Node internal index */
+		out += 4;
+		gaiaExport32 (out, ch->Rank[i], 1, endian_arch);	/* the Node rank */
+		out += 4;
+	    }
+	  else
+	    {
+		/* a Shortcut */
+		ChArcPtr arc = ch->Arcs + ch->NumLinks + (i - n_nodes);
+		*out++ = GAIA_NET_CH_SHORTCUT;
+		gaiaExport32 (out, arc->From, 1, endian_arch);	/* the FromNode internal index */
+		out += 4;
+		gaiaExport32 (out, arc->To, 1, endian_arch);	/* the ToNode internal index */
+		out += 4;
+		gaiaExport64 (out, arc->Cost, 1, endian_arch);	/* the Shortcut Cost */
+		out += 8;
+		gaiaExport32 (out, arc->Child1, 1, endian_arch);	/* the first replaced arc */
+		out += 4;
+		gaiaExport32 (out, arc->Child2, 1, endian_arch);	/* the second replaced arc */
+		out += 4;
+		*out++ = GAIA_NET_END;
+	    }
+	  items++;
+      }
+    if (items)
+      {
+	  /* inserting the last CH block */
+	  gaiaExport16 (buf + 1, items, 1, endian_arch);	/* how many items are into this block */
+	  if (!do_insert_ch_block (db_handle, cache, stmt_out, buf, out - buf))
+	    {
+		error = 1;
+		goto error;
+	    }
       }
 
-/* preparing the UPDATE statement */
-    if (db_prefix == NULL)
-	db_prefix = "MAIN";
-    xprefix = gaiaDoubleQuotedSql (db_prefix);
-    xtable = gaiaDoubleQuotedSql (table);
-    xfrom = gaiaDoubleQuotedSql (from_column);
-    xto = gaiaDoubleQuotedSql (to_column);
-    sql = sqlite3_mprintf ("UPDATE \"%s\".\"%s\" SET \"%s\" = ?, \"%s\" = ? "
-			   "WHERE ROWID = ?", xprefix, xtable, xfrom, xto);
-    free (xprefix);
+  error:
+    if (buf != NULL)
+	free (buf);
+    if (stmt_out != NULL)
+	sqlite3_finalize (stmt_out);
+    ch_builder_free (ch);
+    if (error)
+      {
+	  /* rolling back the Savepoint */
+	  sql2 = "ROLLBACK TO create_routing_ch";
+	  ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+	  if (ret != SQLITE_OK)
+	    {
+		char *msg = sqlite3_mprintf ("SQL error: %s",
+					     sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		return 0;
+	    }
+	  return 0;
+      }
+
+/* releasing the Savepoint */
+    sql2 = "RELEASE SAVEPOINT create_routing_ch";
+    ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+
+    return 1;
+}
+
+/*
+/
+/ Time-dependent Costs and Turn Restrictions
+/
+/ an optional Time Profiles table assigns to some Links a Cost
+/ varying along the day; the expected layout is:
+/    link_id INTEGER     - the ROWID of the Link into the input table
+/    start_time INTEGER  - seconds since midnight [0 - 86399]; a DOUBLE
+/                          value is accepted if it has no fractional part
+/    cost DOUBLE         - the Cost from start_time up to the next step
+/ the last step of each Link wraps around up to its first step.
+/
+/ an optional Turn Restrictions table assigns a penalty to the
+/ transition between two Links; the expected layout is:
+/    from_link INTEGER   - the ROWID of the incoming Link
+/    to_link INTEGER     - the ROWID of the outgoing Link
+/    cost DOUBLE         - the penalty; NULL means a banned turn
+/
+/ both are stored into the Routing Data table as additional blocks:
+/ a TD header, then all profiles (one item for each Link) and finally
+/ all turns.
+*/
+
+#define TD_DAY_SECONDS		86400
+#define TD_MAX_STEPS		4096
+#define TD_MAX_BLOCK_ITEMS	30000
+
+static int
+do_flush_td_block (sqlite3 * db_handle, const void *cache,
+		   sqlite3_stmt * stmt, unsigned char *buf,
+		   unsigned char **out, int *items, int endian_arch)
+{
+/* inserting the current TD block, then starting a new one */
+    if (*items > 0)
+      {
+	  gaiaExport16 (buf + 1, *items, 1, endian_arch);	/* how many items are into this block */
+	  if (!do_insert_ch_block (db_handle, cache, stmt, buf, *out - buf))
+	      return 0;
+      }
+    *out = buf;
+    *(*out)++ = GAIA_NET_TD_BLOCK;
+    *out += 2;
+    *items = 0;
+    return 1;
+}
+
+static int
+do_count_td_items (sqlite3 * db_handle, const void *cache, const char *sql,
+		   int *count)
+{
+/* counting the Time Profile steps or the Turn Restrictions */
+    char **results;
+    int rows;
+    int columns;
+    char *errMsg = NULL;
+    int ret = sqlite3_get_table (db_handle, sql, &results, &rows, &columns,
+				 &errMsg);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg = sqlite3_mprintf ("SQL error: %s", errMsg);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  sqlite3_free (errMsg);
+	  return 0;
+      }
+    *count = 0;
+    if (rows >= 1 && results[columns] != NULL)
+	*count = atoi (results[columns]);
+    sqlite3_free_table (results);
+    return 1;
+}
+
+static int
+do_create_td_data (sqlite3 * db_handle, const void *cache,
+		   const char *output_table, const char *profiles_table,
+		   const char *turns_table)
+{
+/* adding the Time Profiles and Turn Restrictions blocks to the Routing Data table */
+    char *sql;
+    const char *sql2;
+    int ret;
+    char *xtable;
+    sqlite3_stmt *stmt_in = NULL;
+    sqlite3_stmt *stmt_out = NULL;
+    int error = 0;
+    unsigned char *buf = NULL;
+    unsigned char *out;
+    int items;
+    int n_steps = 0;
+    int n_turns = 0;
+    int endian_arch = gaiaEndianArch ();
+    sqlite3_int64 link_id = 0;
+    int steps = 0;
+    int *times = NULL;
+    double *costs = NULL;
+    int i;
+
+/* setting a Savepoint */
+    sql2 = "SAVEPOINT create_routing_td";
+    ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+
+/* Links are looked up by their ROWID */
+    sql2 = "CREATE INDEX idx_create_routing_rowid "
+	"ON create_routing_links (rowid)";
+    ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  error = 1;
+	  goto error;
+      }
+
+/* counting the items to be stored */
+    if (profiles_table != NULL)
+      {
+	  xtable = gaiaDoubleQuotedSql (profiles_table);
+	  sql = sqlite3_mprintf ("SELECT Count(*) FROM \"%s\"", xtable);
+	  free (xtable);
+	  ret = do_count_td_items (db_handle, cache, sql, &n_steps);
+	  sqlite3_free (sql);
+	  if (!ret)
+	    {
+		error = 1;
+		goto error;
+	    }
+      }
+    if (turns_table != NULL)
+      {
+	  xtable = gaiaDoubleQuotedSql (turns_table);
+	  sql = sqlite3_mprintf ("SELECT Count(*) FROM \"%s\"", xtable);
+	  free (xtable);
+	  ret = do_count_td_items (db_handle, cache, sql, &n_turns);
+	  sqlite3_free (sql);
+	  if (!ret)
+	    {
+		error = 1;
+		goto error;
+	    }
+      }
+
+/* preparing the Insert SQL statement */
+    xtable = gaiaDoubleQuotedSql (output_table);
+    sql =
+	sqlite3_mprintf
+	("INSERT INTO \"%s\" (Id, NetworkData) VALUES (?, ?)", xtable);
     free (xtable);
-    free (xfrom);
-    free (xto);
-    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_upd, NULL);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_out, NULL);
     sqlite3_free (sql);
     if (ret != SQLITE_OK)
       {
@@ -2810,248 +3190,2122 @@ do_create_routing_nodes (sqlite3 * db_handle, const void *cache,
 	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
 	  gaia_create_routing_set_error (cache, msg);
 	  sqlite3_free (msg);
+	  error = 1;
 	  goto error;
       }
 
-/* populating the Temp Aux Nodes */
-    while (1)
+/* inserting the TD Header block */
+    buf = malloc (MAX_BLOCK);
+    out = buf;
+    *out++ = GAIA_NET_TD_HEADER;
+    gaiaExport32 (out, n_steps, 1, endian_arch);	/* how many Profile steps */
+    out += 4;
+    gaiaExport32 (out, n_turns, 1, endian_arch);	/* how many Turn Restrictions */
+    out += 4;
+    *out++ = GAIA_NET_END;
+    if (!do_insert_ch_block (db_handle, cache, stmt_out, buf, out - buf))
       {
-	  ret = sqlite3_step (stmt_q1);
-	  if (ret == SQLITE_DONE)
-	      break;
-	  if (ret == SQLITE_ROW)
+	  error = 1;
+	  goto error;
+      }
+    out = buf;
+    items = 0;
+    if (!do_flush_td_block
+	(db_handle, cache, stmt_out, buf, &out, &items, endian_arch))
+      {
+	  error = 1;
+	  goto error;
+      }
+
+    if (profiles_table != NULL)
+      {
+	  /* inserting all Time Profiles, grouped by Link */
+	  times = malloc (sizeof (int) * TD_MAX_STEPS);
+	  costs = malloc (sizeof (double) * TD_MAX_STEPS);
+	  xtable = gaiaDoubleQuotedSql (profiles_table);
+	  sql =
+	      sqlite3_mprintf
+	      ("SELECT p.link_id, p.start_time, p.cost, "
+	       "EXISTS (SELECT rowid FROM create_routing_links AS l "
+	       "WHERE l.rowid = p.link_id) FROM \"%s\" AS p "
+	       "ORDER BY p.link_id, p.start_time", xtable);
+	  free (xtable);
+	  ret =
+	      sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_in,
+				  NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
 	    {
-		const unsigned char *blob;
-		int size;
-		gaiaGeomCollPtr geom;
-		gaiaPointPtr pt;
-		double x;
-		double y;
-		double z;
-		char *msg;
-		if (sqlite3_column_type (stmt_q1, 1) == SQLITE_BLOB)
+		char *msg =
+		    sqlite3_mprintf ("Time Profiles table \"%s\": %s",
+				     profiles_table,
+				     sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		error = 1;
+		goto error;
+	    }
+	  while (1)
+	    {
+		/* scrolling the result set rows */
+		sqlite3_int64 id = 0;
+		int start_time = 0;
+		double start = 0.0;
+		double cost = 0.0;
+		ret = sqlite3_step (stmt_in);
+		if (ret != SQLITE_DONE && ret != SQLITE_ROW)
 		  {
-		      blob =
-			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
-								       1);
-		      size = sqlite3_column_bytes (stmt_q1, 1);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom)
+		      char *msg =
+			  sqlite3_mprintf
+			  ("SQL error: %s", sqlite3_errmsg (db_handle));
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      error = 1;
+		      goto error;
+		  }
+		if (ret == SQLITE_ROW)
+		  {
+		      if (sqlite3_column_type (stmt_in, 0) != SQLITE_INTEGER
+			  || (sqlite3_column_type (stmt_in, 1) != SQLITE_FLOAT
+			      && sqlite3_column_type (stmt_in,
+						      1) != SQLITE_INTEGER)
+			  || (sqlite3_column_type (stmt_in, 2) != SQLITE_FLOAT
+			      && sqlite3_column_type (stmt_in,
+						      2) != SQLITE_INTEGER))
 			{
-			    pt = geom->FirstPoint;
-			    x = pt->X;
-			    y = pt->Y;
-			    if (geom->DimensionModel == GAIA_XY_Z
-				|| geom->DimensionModel == GAIA_XY_Z_M)
-				z = pt->Z;
-			    else
-				z = 0.0;
-			    gaiaFreeGeomColl (geom);
-			    if (!do_insert_temp_aux_node
-				(db_handle, stmt_ins, x, y, z, &msg))
-			      {
-				  gaia_create_routing_set_error (cache, msg);
-				  sqlite3_free (msg);
-				  goto error;
-			      }
+			    gaia_create_routing_set_error (cache,
+							   "Time Profiles: found a row containing invalid values");
+			    error = 1;
+			    goto error;
+			}
+		      id = sqlite3_column_int64 (stmt_in, 0);
+		      start = sqlite3_column_double (stmt_in, 1);
+		      cost = sqlite3_column_double (stmt_in, 2);
+		      if (sqlite3_column_int (stmt_in, 3) == 0)
+			{
+			    char *msg =
+				sqlite3_mprintf
+				("Time Profiles: Link " FRMT64
+				 " does not exist", id);
+			    gaia_create_routing_set_error (cache, msg);
+			    sqlite3_free (msg);
+			    error = 1;
+			    goto error;
+			}
+		      /* start_time must be a whole number of seconds */
+		      if (start < 0.0 || start >= TD_DAY_SECONDS
+			  || start != floor (start) || cost < 0.0)
+			{
+			    char *msg =
+				sqlite3_mprintf
+				("Time Profiles: Link " FRMT64
+				 " has an invalid start_time or cost", id);
+			    gaia_create_routing_set_error (cache, msg);
+			    sqlite3_free (msg);
+			    error = 1;
+			    goto error;
 			}
+		      start_time = (int) start;
 		  }
-		if (sqlite3_column_type (stmt_q1, 2) == SQLITE_BLOB)
+		if (steps > 0 && (ret == SQLITE_DONE || id != link_id))
 		  {
-		      blob =
-			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
-								       2);
-		      size = sqlite3_column_bytes (stmt_q1, 2);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom)
+		      /* storing the completed profile of the previous Link */
+		      if ((out - buf) + 12 + (12 * steps) > MAX_BLOCK
+			  || items == TD_MAX_BLOCK_ITEMS)
 			{
-			    pt = geom->FirstPoint;
-			    x = pt->X;
-			    y = pt->Y;
-			    if (geom->DimensionModel == GAIA_XY_Z
-				|| geom->DimensionModel == GAIA_XY_Z_M)
-				z = pt->Z;
-			    else
-				z = 0.0;
-			    gaiaFreeGeomColl (geom);
-			    if (!do_insert_temp_aux_node
-				(db_handle, stmt_ins, x, y, z, &msg))
+			    if (!do_flush_td_block
+				(db_handle, cache, stmt_out, buf, &out, &items,
+				 endian_arch))
 			      {
-				  gaia_create_routing_set_error (cache, msg);
-				  sqlite3_free (msg);
+				  error = 1;
 				  goto error;
 			      }
 			}
+		      *out++ = GAIA_NET_TD_PROFILE;
+		      gaiaExportI64 (out, link_id, 1, endian_arch);	/* the Link ROWID */
+		      out += 8;
+		      gaiaExport16 (out, steps, 1, endian_arch);	/* how many steps */
+		      out += 2;
+		      for (i = 0; i < steps; i++)
+			{
+			    gaiaExport32 (out, times[i], 1, endian_arch);	/* the step start time */
+			    out += 4;
+			    gaiaExport64 (out, costs[i], 1, endian_arch);	/* the step Cost */
+			    out += 8;
+			}
+		      *out++ = GAIA_NET_END;
+		      items++;
+		      steps = 0;
 		  }
-	    }
-	  else
-	    {
-		char *msg = sqlite3_mprintf ("SQL error: %s",
-					     sqlite3_errmsg (db_handle));
-		gaia_create_routing_set_error (cache, msg);
-		sqlite3_free (msg);
-		goto error;
-	    }
-      }
+		if (ret == SQLITE_DONE)
+		    break;	/* end of result set */
+		if (steps > 0 && times[steps - 1] == start_time)
+		  {
+		      char *msg = sqlite3_mprintf ("Time Profiles: Link "
+						   FRMT64
+						   " has duplicate start_time values",
+						   id);
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      error = 1;
+		      goto error;
+		  }
+		if (steps == TD_MAX_STEPS)
+		  {
+		      char *msg = sqlite3_mprintf ("Time Profiles: Link "
+						   FRMT64
+						   " has too many steps", id);
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      error = 1;
+		      goto error;
+		  }
+		link_id = id;
+		times[steps] = start_time;
+		costs[steps] = cost;
+		steps++;
+	    }
+	  sqlite3_finalize (stmt_in);
+	  stmt_in = NULL;
+      }
 
-/* updating the Spatial Table */
-    sqlite3_reset (stmt_q1);
-    while (1)
+    if (turns_table != NULL)
       {
-	  ret = sqlite3_step (stmt_q1);
-	  if (ret == SQLITE_DONE)
-	      break;
-	  if (ret == SQLITE_ROW)
+	  /* inserting all Turn Restrictions */
+	  xtable = gaiaDoubleQuotedSql (turns_table);
+	  sql =
+	      sqlite3_mprintf
+	      ("SELECT t.from_link, t.to_link, t.cost, "
+	       "EXISTS (SELECT rowid FROM create_routing_links AS l "
+	       "WHERE l.rowid = t.from_link), "
+	       "EXISTS (SELECT rowid FROM create_routing_links AS l "
+	       "WHERE l.rowid = t.to_link) FROM \"%s\" AS t "
+	       "ORDER BY t.from_link, t.to_link", xtable);
+	  free (xtable);
+	  ret =
+	      sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_in,
+				  NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
 	    {
-		const unsigned char *blob;
-		int size;
-		gaiaGeomCollPtr geom;
-		gaiaPointPtr pt;
-		double from_x = DBL_MIN;
-		double from_y = DBL_MIN;
-		double from_z = DBL_MIN;
-		double to_x = DBL_MIN;
-		double to_y = DBL_MIN;
-		double to_z = DBL_MIN;
-		char *msg;
-		int rowid = sqlite3_column_int (stmt_q1, 0);
-		if (sqlite3_column_type (stmt_q1, 1) == SQLITE_BLOB)
+		char *msg =
+		    sqlite3_mprintf ("Turn Restrictions table \"%s\": %s",
+				     turns_table, sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		error = 1;
+		goto error;
+	    }
+	  while (1)
+	    {
+		/* scrolling the result set rows */
+		sqlite3_int64 from_link;
+		sqlite3_int64 to_link;
+		int banned = 0;
+		double cost = 0.0;
+		ret = sqlite3_step (stmt_in);
+		if (ret == SQLITE_DONE)
+		    break;	/* end of result set */
+		if (ret != SQLITE_ROW)
 		  {
-		      blob =
-			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
-								       1);
-		      size = sqlite3_column_bytes (stmt_q1, 1);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom)
-			{
-			    pt = geom->FirstPoint;
-			    from_x = pt->X;
-			    from_y = pt->Y;
-			    if (geom->DimensionModel == GAIA_XY_Z
-				|| geom->DimensionModel == GAIA_XY_Z_M)
-				from_z = pt->Z;
-			    else
-				from_z = 0.0;
-			    gaiaFreeGeomColl (geom);
-			}
+		      char *msg =
+			  sqlite3_mprintf
+			  ("SQL error: %s", sqlite3_errmsg (db_handle));
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      error = 1;
+		      goto error;
 		  }
-		if (sqlite3_column_type (stmt_q1, 2) == SQLITE_BLOB)
+		if (sqlite3_column_type (stmt_in, 0) != SQLITE_INTEGER
+		    || sqlite3_column_type (stmt_in, 1) != SQLITE_INTEGER)
 		  {
-		      blob =
-			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
-								       2);
-		      size = sqlite3_column_bytes (stmt_q1, 2);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom)
-			{
-			    pt = geom->FirstPoint;
-			    to_x = pt->X;
-			    to_y = pt->Y;
-			    if (geom->DimensionModel == GAIA_XY_Z
-				|| geom->DimensionModel == GAIA_XY_Z_M)
-				to_z = pt->Z;
-			    else
-				to_z = 0.0;
-			    gaiaFreeGeomColl (geom);
-			}
+		      gaia_create_routing_set_error (cache,
+						     "Turn Restrictions: found a row containing invalid Link ids");
+		      error = 1;
+		      goto error;
 		  }
-		if (!do_update_link
-		    (db_handle, stmt_q2, stmt_upd, rowid, from_x, from_y,
-		     from_z, to_x, to_y, to_z, &msg))
+		from_link = sqlite3_column_int64 (stmt_in, 0);
+		to_link = sqlite3_column_int64 (stmt_in, 1);
+		if (sqlite3_column_type (stmt_in, 2) == SQLITE_NULL)
+		    banned = 1;
+		else if (sqlite3_column_type (stmt_in, 2) == SQLITE_FLOAT
+			 || sqlite3_column_type (stmt_in, 2) == SQLITE_INTEGER)
+		    cost = sqlite3_column_double (stmt_in, 2);
+		else
+		    cost = -1.0;
+		if (cost < 0.0)
+		  {
+		      char *msg = sqlite3_mprintf ("Turn Restrictions: turn "
+						   FRMT64 " -> " FRMT64
+						   " has an invalid cost",
+						   from_link, to_link);
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      error = 1;
+		      goto error;
+		  }
+		if (sqlite3_column_int (stmt_in, 3) == 0
+		    || sqlite3_column_int (stmt_in, 4) == 0)
 		  {
+		      char *msg = sqlite3_mprintf ("Turn Restrictions: turn "
+						   FRMT64 " -> " FRMT64
+						   " references a Link that does not exist",
+						   from_link, to_link);
 		      gaia_create_routing_set_error (cache, msg);
 		      sqlite3_free (msg);
+		      error = 1;
 		      goto error;
 		  }
+		if ((out - buf) + 27 > MAX_BLOCK
+		    || items == TD_MAX_BLOCK_ITEMS)
+		  {
+		      if (!do_flush_td_block
+			  (db_handle, cache, stmt_out, buf, &out, &items,
+			   endian_arch))
+			{
+			    error = 1;
+			    goto error;
+			}
+		  }
+		*out++ = GAIA_NET_TD_TURN;
+		gaiaExportI64 (out, from_link, 1, endian_arch);	/* the incoming Link ROWID */
+		out += 8;
+		gaiaExportI64 (out, to_link, 1, endian_arch);	/* the outgoing Link ROWID */
+		out += 8;
+		*out++ = banned ? 1 : 0;	/* banned turn */
+		gaiaExport64 (out, cost, 1, endian_arch);	/* the turn penalty */
+		out += 8;
+		*out++ = GAIA_NET_END;
+		items++;
 	    }
-	  else
+	  sqlite3_finalize (stmt_in);
+	  stmt_in = NULL;
+      }
+
+/* inserting the last TD block */
+    if (!do_flush_td_block
+	(db_handle, cache, stmt_out, buf, &out, &items, endian_arch))
+	error = 1;
+
+  error:
+    if (buf != NULL)
+	free (buf);
+    if (times != NULL)
+	free (times);
+    if (costs != NULL)
+	free (costs);
+    if (stmt_in != NULL)
+	sqlite3_finalize (stmt_in);
+    if (stmt_out != NULL)
+	sqlite3_finalize (stmt_out);
+    if (error)
+      {
+	  /* rolling back the Savepoint */
+	  sql2 = "ROLLBACK TO create_routing_td";
+	  ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+	  if (ret != SQLITE_OK)
 	    {
 		char *msg = sqlite3_mprintf ("SQL error: %s",
 					     sqlite3_errmsg (db_handle));
 		gaia_create_routing_set_error (cache, msg);
 		sqlite3_free (msg);
-		goto error;
+		return 0;
 	    }
+	  return 0;
       }
 
-    sqlite3_finalize (stmt_q1);
-    sqlite3_finalize (stmt_q2);
-    sqlite3_finalize (stmt_ins);
-    sqlite3_finalize (stmt_upd);
+/* releasing the Savepoint */
+    sql2 = "RELEASE SAVEPOINT create_routing_td";
+    ret = sqlite3_exec (db_handle, sql2, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
 
-/* dropping the Temporary Aux Table */
-    sql = "DROP TABLE temp_create_routing_aux_nodes";
-    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    return 1;
+}
+
+static int
+do_create_virtual_routing (sqlite3 * db_handle, const void *cache,
+			   const char *routing_data_table,
+			   const char *virtual_routing_table)
+{
+/* creating the VirtualRouting table - dropping the Temp-Tables */
+    char *xtable1;
+    char *xtable2;
+    char *sql;
+    int ret;
+
+    xtable1 = gaiaDoubleQuotedSql (virtual_routing_table);
+    xtable2 = gaiaDoubleQuotedSql (routing_data_table);
+    sql =
+	sqlite3_mprintf
+	("CREATE VIRTUAL TABLE \"%s\" USING  VirtualRouting(\"%s\")", xtable1,
+	 xtable2);
+    free (xtable1);
+    free (xtable2);
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto rollback;
+      }
+    do_drop_temp_tables (db_handle);
+
+/* releasing the Savepoint */
+    sql = "RELEASE SAVEPOINT create_routing_zero";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    return 1;
+
+  rollback:
+    sql = "ROLLBACK TO create_routing_zero";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    return 0;
+}
+
+static int
+do_check_registered_spatial_table (sqlite3 * db_handle, const char *db_prefix,
+				   const char *table, const char *geom_column,
+				   char **geom_name)
+{
+/* checking for a valid Spatial Table */
+    char *xprefix;
+    char *sql;
+    char *name = NULL;
+    int ret;
+    sqlite3_stmt *stmt = NULL;
+    int type;
+    int count = 0;
+    int is_linestring = 0;
+
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+
+    if (geom_column == NULL)
+      {
+	  sql =
+	      sqlite3_mprintf
+	      ("SELECT f_geometry_column, geometry_type FROM \"%s\".geometry_columns WHERE "
+	       "Lower(f_table_name) = Lower(%Q)", xprefix, table);
+      }
+    else
+      {
+	  sql =
+	      sqlite3_mprintf
+	      ("SELECT f_geometry_column, geometry_type FROM \"%s\".geometry_columns WHERE "
+	       "Lower(f_table_name) = Lower(%Q) AND Lower(f_geometry_column) = Lower(%Q)",
+	       xprefix, table, geom_column);
+      }
+    free (xprefix);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		const char *geom = (const char *) sqlite3_column_text (stmt, 0);
+		int len = strlen (geom);
+		if (name != NULL)
+		    free (name);
+		name = malloc (len + 1);
+		strcpy (name, geom);
+		type = sqlite3_column_int (stmt, 1);
+		count++;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (count == 1)
+      {
+	  switch (type)
+	    {
+	    case GAIA_LINESTRING:
+	    case GAIA_LINESTRINGZ:
+	    case GAIA_LINESTRINGM:
+	    case GAIA_LINESTRINGZM:
+		is_linestring = 1;
+		break;
+	    default:
+		is_linestring = 0;
+		break;
+	    };
+      }
+    if (is_linestring)
+      {
+	  *geom_name = name;
+	  return 1;
+      }
+    if (name != NULL)
+	free (name);
+    return 0;
+}
+
+static int
+do_check_spatial_table (sqlite3 * db_handle, const void *cache,
+			const char *db_prefix, const char *table,
+			const char *geom_column, const char *from_column,
+			const char *to_column, char **geom_name)
+{
+/* testing if the Spatial Table exists and it's correctly defined */
+    char *xprefix;
+    char *xtable;
+    char *sql;
+    int ret;
+    int i;
+    char **results;
+    int rows;
+    int columns;
+    int ok_from = 0;
+    int ok_to = 0;
+    int ok_geom = 0;
+
+/* checking for a valid Spatial Table */
+    *geom_name = NULL;
+    if (!do_check_registered_spatial_table
+	(db_handle, db_prefix, table, geom_column, geom_name))
+      {
+	  char *msg;
+	  if (geom_column == NULL)
+	      msg =
+		  sqlite3_mprintf
+		  ("%Q is not a valid Spatial Table (LINESTRING)", table);
+	  else
+	      msg =
+		  sqlite3_mprintf
+		  ("%Q.%Q is not a valid Spatial Table (LINESTRING)", table,
+		   geom_column);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free(msg);
+	  return 0;
+      }
+
+/* checking the table's columns */
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    sql = sqlite3_mprintf ("PRAGMA \"%s\".table_info(\"%s\")", xprefix, xtable);
+    free (xprefix);
+    free (xtable);
+    ret = sqlite3_get_table (db_handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 1; i <= rows; i++)
+      {
+	  const char *col = results[(i * columns) + 1];
+	  if (strcasecmp (col, from_column) == 0)
+	      ok_from = 1;
+	  if (strcasecmp (col, to_column) == 0)
+	      ok_to = 1;
+	  if (strcasecmp (col, *geom_name) == 0)
+	      ok_geom = 1;
+      }
+    sqlite3_free_table (results);
+
+/* final validity check */
+    if (ok_from)
+      {
+	  char *msg =
+	      sqlite3_mprintf
+	      ("FromNode Column \"%s\" is already defined in the Spatial Table",
+	       from_column);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    if (ok_to)
+      {
+	  char *msg =
+	      sqlite3_mprintf
+	      ("ToNode Column \"%s\" is already defined in the Spatial Table",
+	       to_column);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    if (!ok_geom)
+      {
+	  char *msg =
+	      sqlite3_mprintf
+	      ("Geometry Column \"%s\" is not defined in the Spatial Table",
+	       geom_name);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+
+    return 1;
+}
+
+static int
+do_insert_temp_aux_node (sqlite3 * db_handle, sqlite3_stmt * stmt, double x,
+			 double y, double z, char **msg)
+{
+/* inserting an Aux Node */
+    int ret;
+
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, x);
+    sqlite3_bind_double (stmt, 2, y);
+    sqlite3_bind_double (stmt, 3, z);
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+
+/* some error occurred */
+    *msg = sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+    fprintf (stderr, "%s\n", *msg);
+    return 0;
+}
+
+static int
+do_update_link (sqlite3 * db_handle, sqlite3_stmt * stmt,
+		sqlite3_stmt * stmt_upd, int rowid, double from_x,
+		double from_y, double from_z, double to_x, double to_y,
+		double to_z, char **msg)
+{
+/* updating the Spatial Table - step #1 */
+    int ret;
+
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, from_x);
+    sqlite3_bind_double (stmt, 2, from_y);
+    sqlite3_bind_double (stmt, 3, from_z);
+    sqlite3_bind_double (stmt, 4, to_x);
+    sqlite3_bind_double (stmt, 5, to_y);
+    sqlite3_bind_double (stmt, 6, to_z);
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		int node_from = sqlite3_column_int (stmt, 0);
+		int node_to = sqlite3_column_int (stmt, 1);
+
+		sqlite3_reset (stmt_upd);
+		sqlite3_clear_bindings (stmt_upd);
+		sqlite3_bind_int (stmt_upd, 1, node_from);
+		sqlite3_bind_int (stmt_upd, 2, node_to);
+		sqlite3_bind_int (stmt_upd, 3, rowid);
+		ret = sqlite3_step (stmt_upd);
+		if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+		    return 1;
+		else
+		  {
+		      *msg =
+			  sqlite3_mprintf ("SQL error: %s",
+					   sqlite3_errmsg (db_handle));
+		      return 0;
+		  }
+
+/* some error occurred */
+		*msg =
+		    sqlite3_mprintf ("SQL error: %s",
+				     sqlite3_errmsg (db_handle));
+		return 0;
+	    }
+	  else
+	    {
+		*msg =
+		    sqlite3_mprintf ("SQL error: %s",
+				     sqlite3_errmsg (db_handle));
+		return 0;
+	    }
+      }
+    return 1;
+}
+
+static int
+do_create_routing_nodes (sqlite3 * db_handle, const void *cache,
+			 const char *db_prefix, const char *table,
+			 const char *geom_column, const char *from_column,
+			 const char *to_column)
+{
+/* creating and populating the Routing Nodes columns */
+    char *xprefix;
+    char *xtable;
+    char *xcolumn;
+    char *xfrom;
+    char *xto;
+    char *sql;
+    int ret;
+    sqlite3_stmt *stmt_q1 = NULL;
+    sqlite3_stmt *stmt_ins = NULL;
+    sqlite3_stmt *stmt_q2 = NULL;
+    sqlite3_stmt *stmt_upd = NULL;
+
+/* adding the FromNode column */
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    xcolumn = gaiaDoubleQuotedSql (from_column);
+    sql =
+	sqlite3_mprintf ("ALTER TABLE \"%s\".\"%s\" ADD COLUMN \"%s\" INTEGER",
+			 xprefix, xtable, xcolumn);
+    free (xprefix);
+    free (xtable);
+    free (xcolumn);
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* adding the ToNode column */
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    xcolumn = gaiaDoubleQuotedSql (to_column);
+    sql =
+	sqlite3_mprintf ("ALTER TABLE \"%s\".\"%s\" ADD COLUMN \"%s\" INTEGER",
+			 xprefix, xtable, xcolumn);
+    free (xprefix);
+    free (xtable);
+    free (xcolumn);
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* dropping the Temporary Aux Table (just in case) */
+    sql = "DROP TABLE temp_create_routing_aux_nodes";
+    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+
+/* creating the Temporary Aux Table for Nodes */
+    sql = "CREATE TEMPORARY TABLE temp_create_routing_aux_nodes ("
+	"x DOUBLE, y DOUBLE, z DOUBLE, "
+	"CONSTRAINT pk_create_routing_aux_nodes PRIMARY KEY (x, y, z))";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* preparing the query statement for identifying all Nodes */
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    xcolumn = gaiaDoubleQuotedSql (geom_column);
+    sql =
+	sqlite3_mprintf
+	("SELECT ROWID, ST_StartPoint(\"%s\"), ST_EndPoint(\"%s\") "
+	 "FROM \"%s\".\"%s\"", xcolumn, xcolumn, xprefix, xtable);
+    free (xprefix);
+    free (xtable);
+    free (xcolumn);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_q1, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* preparing the INSERT statement for Aux Nodes */
+    sql = "INSERT OR IGNORE INTO temp_create_routing_aux_nodes "
+	"VALUES (?, ?, ?)";
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_ins, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* preparing the query statement for identifying all Node-IDs */
+    sql = "SELECT a.ROWID, b.ROWID "
+	"FROM temp_create_routing_aux_nodes AS a, "
+	"temp_create_routing_aux_nodes AS b "
+	"WHERE a.x = ? AND a.y = ? AND a.z = ? "
+	"AND b.x = ? AND b.y = ? AND b.z = ?";
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_q2, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* preparing the UPDATE statement */
+    if (db_prefix == NULL)
+	db_prefix = "MAIN";
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    xfrom = gaiaDoubleQuotedSql (from_column);
+    xto = gaiaDoubleQuotedSql (to_column);
+    sql = sqlite3_mprintf ("UPDATE \"%s\".\"%s\" SET \"%s\" = ?, \"%s\" = ? "
+			   "WHERE ROWID = ?", xprefix, xtable, xfrom, xto);
+    free (xprefix);
+    free (xtable);
+    free (xfrom);
+    free (xto);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_upd, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* populating the Temp Aux Nodes */
+    while (1)
+      {
+	  ret = sqlite3_step (stmt_q1);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		const unsigned char *blob;
+		int size;
+		gaiaGeomCollPtr geom;
+		gaiaPointPtr pt;
+		double x;
+		double y;
+		double z;
+		char *msg;
+		if (sqlite3_column_type (stmt_q1, 1) == SQLITE_BLOB)
+		  {
+		      blob =
+			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
+								       1);
+		      size = sqlite3_column_bytes (stmt_q1, 1);
+		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+		      if (geom)
+			{
+			    pt = geom->FirstPoint;
+			    x = pt->X;
+			    y = pt->Y;
+			    if (geom->DimensionModel == GAIA_XY_Z
+				|| geom->DimensionModel == GAIA_XY_Z_M)
+				z = pt->Z;
+			    else
+				z = 0.0;
+			    gaiaFreeGeomColl (geom);
+			    if (!do_insert_temp_aux_node
+				(db_handle, stmt_ins, x, y, z, &msg))
+			      {
+				  gaia_create_routing_set_error (cache, msg);
+				  sqlite3_free (msg);
+				  goto error;
+			      }
+			}
+		  }
+		if (sqlite3_column_type (stmt_q1, 2) == SQLITE_BLOB)
+		  {
+		      blob =
+			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
+								       2);
+		      size = sqlite3_column_bytes (stmt_q1, 2);
+		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+		      if (geom)
+			{
+			    pt = geom->FirstPoint;
+			    x = pt->X;
+			    y = pt->Y;
+			    if (geom->DimensionModel == GAIA_XY_Z
+				|| geom->DimensionModel == GAIA_XY_Z_M)
+				z = pt->Z;
+			    else
+				z = 0.0;
+			    gaiaFreeGeomColl (geom);
+			    if (!do_insert_temp_aux_node
+				(db_handle, stmt_ins, x, y, z, &msg))
+			      {
+				  gaia_create_routing_set_error (cache, msg);
+				  sqlite3_free (msg);
+				  goto error;
+			      }
+			}
+		  }
+	    }
+	  else
+	    {
+		char *msg = sqlite3_mprintf ("SQL error: %s",
+					     sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		goto error;
+	    }
+      }
+
+/* updating the Spatial Table */
+    sqlite3_reset (stmt_q1);
+    while (1)
+      {
+	  ret = sqlite3_step (stmt_q1);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		const unsigned char *blob;
+		int size;
+		gaiaGeomCollPtr geom;
+		gaiaPointPtr pt;
+		double from_x = DBL_MIN;
+		double from_y = DBL_MIN;
+		double from_z = DBL_MIN;
+		double to_x = DBL_MIN;
+		double to_y = DBL_MIN;
+		double to_z = DBL_MIN;
+		char *msg;
+		int rowid = sqlite3_column_int (stmt_q1, 0);
+		if (sqlite3_column_type (stmt_q1, 1) == SQLITE_BLOB)
+		  {
+		      blob =
+			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
+								       1);
+		      size = sqlite3_column_bytes (stmt_q1, 1);
+		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+		      if (geom)
+			{
+			    pt = geom->FirstPoint;
+			    from_x = pt->X;
+			    from_y = pt->Y;
+			    if (geom->DimensionModel == GAIA_XY_Z
+				|| geom->DimensionModel == GAIA_XY_Z_M)
+				from_z = pt->Z;
+			    else
+				from_z = 0.0;
+			    gaiaFreeGeomColl (geom);
+			}
+		  }
+		if (sqlite3_column_type (stmt_q1, 2) == SQLITE_BLOB)
+		  {
+		      blob =
+			  (const unsigned char *) sqlite3_column_blob (stmt_q1,
+								       2);
+		      size = sqlite3_column_bytes (stmt_q1, 2);
+		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+		      if (geom)
+			{
+			    pt = geom->FirstPoint;
+			    to_x = pt->X;
+			    to_y = pt->Y;
+			    if (geom->DimensionModel == GAIA_XY_Z
+				|| geom->DimensionModel == GAIA_XY_Z_M)
+				to_z = pt->Z;
+			    else
+				to_z = 0.0;
+			    gaiaFreeGeomColl (geom);
+			}
+		  }
+		if (!do_update_link
+		    (db_handle, stmt_q2, stmt_upd, rowid, from_x, from_y,
+		     from_z, to_x, to_y, to_z, &msg))
+		  {
+		      gaia_create_routing_set_error (cache, msg);
+		      sqlite3_free (msg);
+		      goto error;
+		  }
+	    }
+	  else
+	    {
+		char *msg = sqlite3_mprintf ("SQL error: %s",
+					     sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		goto error;
+	    }
+      }
+
+    sqlite3_finalize (stmt_q1);
+    sqlite3_finalize (stmt_q2);
+    sqlite3_finalize (stmt_ins);
+    sqlite3_finalize (stmt_upd);
+
+/* dropping the Temporary Aux Table */
+    sql = "DROP TABLE temp_create_routing_aux_nodes";
+    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+
+/* COMMIT */
+    sql = "RELEASE SAVEPOINT create_routing_nodes";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+    return 1;
+
+  error:
+    if (stmt_q1 != NULL)
+	sqlite3_finalize (stmt_q1);
+    if (stmt_q2 != NULL)
+	sqlite3_finalize (stmt_q2);
+    if (stmt_ins != NULL)
+	sqlite3_finalize (stmt_ins);
+    if (stmt_upd != NULL)
+	sqlite3_finalize (stmt_upd);
+/* ROLLBACK */
+    sql = "ROLLBACK TO create_routing_nodes";
+    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    return 0;
+}
+
+SPATIALITE_DECLARE int
+gaia_create_routing_nodes (sqlite3 * db_handle,
+			   const void *cache,
+			   const char *db_prefix,
+			   const char *table,
+			   const char *geom_column,
+			   const char *from_column, const char *to_column)
+{
+/* attempting to create a Routing Nodes columns for a spatial table */
+    const char *sql;
+    int ret;
+    char *geom_name = NULL;
+
+    if (db_handle == NULL || cache == NULL)
+	return 0;
+
+    if (table == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "Spatial Table Name is NULL");
+	  return 0;
+      }
+    if (from_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "FromNode Column Name is NULL");
+	  return 0;
+      }
+    if (to_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "ToNode Column Name is NULL");
+	  return 0;
+      }
+
+/* testing the spatial table */
+    if (!do_check_spatial_table
+	(db_handle, cache, db_prefix, table, geom_column, from_column,
+	 to_column, &geom_name))
+	goto error;
+
+/* setting a global Savepoint */
+    sql = "SAVEPOINT create_routing_nodes";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+
+/* creating and populating the Routing Nodes columns */
+    if (!do_create_routing_nodes
+	(db_handle, cache, db_prefix, table, geom_name, from_column, to_column))
+	goto error;
+
+    free (geom_name);
+    return 1;
+
+  error:
+    if (geom_name != NULL)
+	free (geom_name);
+    return 0;
+}
+
+SPATIALITE_DECLARE int
+gaia_create_routing (sqlite3 * db_handle,
+		     const void *cache,
+		     const char *routing_data_table,
+		     const char
+		     *virtual_routing_table,
+		     const char *input_table,
+		     const char *from_column,
+		     const char *to_column,
+		     const char *geom_column,
+		     const char *cost_column,
+		     const char *name_column,
+		     int a_star_enabled,
+		     int bidirectional,
+		     const char *oneway_from,
+		     const char *oneway_to, int overwrite)
+{
+/* attempting to create a VirtualRouting from an input table */
+    return gaia_create_routing_ex (db_handle, cache, routing_data_table,
+				   virtual_routing_table, input_table,
+				   from_column, to_column, geom_column,
+				   cost_column, name_column, a_star_enabled,
+				   bidirectional, oneway_from, oneway_to,
+				   overwrite, 0);
+}
+
+SPATIALITE_DECLARE int
+gaia_create_routing_ex (sqlite3 * db_handle,
+			const void *cache,
+			const char *routing_data_table,
+			const char
+			*virtual_routing_table,
+			const char *input_table,
+			const char *from_column,
+			const char *to_column,
+			const char *geom_column,
+			const char *cost_column,
+			const char *name_column,
+			int a_star_enabled,
+			int bidirectional,
+			const char *oneway_from,
+			const char *oneway_to, int overwrite,
+			int contraction_hierarchies)
+{
+/* 
+/ attempting to create a VirtualRouting from an input table 
+/ optionally supporting Contraction Hierarchies 
+*/
+    return gaia_create_routing_ex2 (db_handle, cache, routing_data_table,
+				    virtual_routing_table, input_table,
+				    from_column, to_column, geom_column,
+				    cost_column, name_column, a_star_enabled,
+				    bidirectional, oneway_from, oneway_to,
+				    overwrite, contraction_hierarchies, NULL,
+				    NULL);
+}
+
+SPATIALITE_DECLARE int
+gaia_create_routing_ex2 (sqlite3 * db_handle,
+			 const void *cache,
+			 const char *routing_data_table,
+			 const char
+			 *virtual_routing_table,
+			 const char *input_table,
+			 const char *from_column,
+			 const char *to_column,
+			 const char *geom_column,
+			 const char *cost_column,
+			 const char *name_column,
+			 int a_star_enabled,
+			 int bidirectional,
+			 const char *oneway_from,
+			 const char *oneway_to, int overwrite,
+			 int contraction_hierarchies,
+			 const char *time_profiles_table,
+			 const char *turn_restrictions_table)
+{
+/* 
+/ attempting to create a VirtualRouting from an input table 
+/ optionally supporting Contraction Hierarchies, Time Profiles
+/ and Turn Restrictions
+*/
+    int has_ids;
+    int n_nodes = 0;
+    int max_code_length = 0;
+    double a_star_coeff = DBL_MAX;
+    const char *sql;
+    int ret;
+    RoutingArcs ch_arcs;
+
+    if (db_handle == NULL || cache == NULL)
+	return 0;
+
+    gaia_create_routing_set_error (cache, NULL);
+    if (routing_data_table == NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "Routing Data Table Name is NULL");
+	  return 0;
+      }
+    if (virtual_routing_table == NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "VirtualRouting Table Name is NULL");
+	  return 0;
+      }
+    if (input_table == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "Input Table Name is NULL");
+	  return 0;
+      }
+    if (from_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "FromNode Column Name is NULL");
+	  return 0;
+      }
+    if (to_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache, "ToNode Column Name is NULL");
+	  return 0;
+      }
+    if (geom_column == NULL && cost_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "Both Geometry Column and Cost Column Names are NULL at the same time");
+	  return 0;
+      }
+    if (oneway_from == NULL && oneway_to != NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "OnewayFromTo is NULL but OnewayToFrom is NOT NULL");
+	  return 0;
+      }
+    if (oneway_from != NULL && oneway_to == NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "OnewayFromTo is NOT NULL but OnewayToFrom is NULL");
+	  return 0;
+      }
+    if (oneway_from != NULL && oneway_to != NULL && !bidirectional)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "Both OnewayFromTo and OnewayToFrom are NOT NULL but Unidirectional has been specified");
+	  return 0;
+      }
+    if (a_star_enabled && geom_column == NULL)
+      {
+	  gaia_create_routing_set_error (cache,
+					 "Geometry Columns is NULL but A* is enabled");
+	  return 0;
+      }
+    if (contraction_hierarchies
+	&& (time_profiles_table != NULL || turn_restrictions_table != NULL))
+      {
+	  gaia_create_routing_set_error (cache,
+					 "Contraction Hierarchies cannot be combined with Time Profiles or Turn Restrictions");
+	  return 0;
+      }
+
+/* setting a global Savepoint */
+    sql = "SAVEPOINT create_routing_zero";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+
+/* dropping the TempTables (just in case) */
+    do_drop_temp_tables (db_handle);
+
+    if (overwrite)
+      {
+	  /* attempting to drop existing tables (just in case) */
+	  do_drop_tables (db_handle, routing_data_table, virtual_routing_table);
+      }
+
+/* testing for existing tables */
+    if (do_check_data_table (db_handle, routing_data_table))
+      {
+	  char *msg =
+	      sqlite3_mprintf ("Routing Data Table \"%s\" already exists",
+			       routing_data_table);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    if (do_check_virtual_table (db_handle, virtual_routing_table))
+      {
+	  char *msg =
+	      sqlite3_mprintf ("VirtualRouting Table \"%s\" already exists",
+			       virtual_routing_table);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+
+/* testing the input table */
+    if (!do_check_input_table
+	(db_handle, cache, input_table, from_column, to_column, geom_column,
+	 cost_column, name_column, oneway_from, oneway_to, a_star_enabled,
+	 bidirectional, &has_ids, &n_nodes, &max_code_length, &a_star_coeff))
+	return 0;
+
+/* creating and populating the Routing Data table */
+    ch_arcs.Arcs = NULL;
+    ch_arcs.Count = 0;
+    ch_arcs.Max = 0;
+    if (!do_create_data
+	(db_handle, cache, routing_data_table, input_table, from_column,
+	 to_column, geom_column, name_column, a_star_enabled, a_star_coeff,
+	 has_ids, n_nodes, max_code_length,
+	 contraction_hierarchies ? &ch_arcs : NULL))
+      {
+	  if (ch_arcs.Arcs != NULL)
+	      free (ch_arcs.Arcs);
+	  return 0;
+      }
+
+    if (contraction_hierarchies)
+      {
+	  /* adding the Contraction Hierarchies data */
+	  ret =
+	      do_create_ch_data (db_handle, cache, routing_data_table, n_nodes,
+				 &ch_arcs);
+	  if (ch_arcs.Arcs != NULL)
+	      free (ch_arcs.Arcs);
+	  if (!ret)
+	      return 0;
+      }
+
+    if (time_profiles_table != NULL || turn_restrictions_table != NULL)
+      {
+	  /* adding the Time Profiles and Turn Restrictions data */
+	  if (!do_create_td_data
+	      (db_handle, cache, routing_data_table, time_profiles_table,
+	       turn_restrictions_table))
+	      return 0;
+      }
+
+/* creating the VirtualRouting table */
+    if (!do_create_virtual_routing
+	(db_handle, cache, routing_data_table, virtual_routing_table))
+	return 0;
+
+    return 1;
+}
+
+/*
+/ incremental updates of an existing Routing Data table
+/
+/ the changes are read from a table laid out as:
+/    link_id INTEGER     - the ROWID of the Link into the input table
+/    node_from           - the FromNode (INTEGER Id or TEXT Code)
+/    node_to             - the ToNode (INTEGER Id or TEXT Code)
+/    cost DOUBLE         - the new Cost; NULL means a deleted arc
+/
+/ each row identifies a single arc (NodeFrom -> NodeTo) of some Link:
+/ an existing arc will be updated or deleted, otherwise a new arc will
+/ be inserted. Only the blocks containing the NodeFrom of some changed
+/ arc are rewritten; new Nodes can't be added this way, and any
+/ Contraction Hierarchies data will be discarded (they depend on the
+/ Cost of every Link). A REVISION block is then moved at the end of
+/ the table, so that any cached NETWORK could be recognized as outdated.
+*/
+
+typedef struct UpdRoutingBlockStruct
+{
+/* a Nodes block of the Routing Data table */
+    sqlite3_int64 Id;
+    sqlite3_int64 FirstNodeId;	/* the first Node: INTEGER Id */
+    char *FirstNodeCode;	/* the first Node: TEXT Code */
+    unsigned char *Blob;	/* NULL until actually required */
+    int Size;
+    int Allocated;
+    int Changed;
+} UpdRoutingBlock;
+typedef UpdRoutingBlock *UpdRoutingBlockPtr;
+
+typedef struct UpdRoutingStruct
+{
+/* an incremental update of some Routing Data table */
+    int Net64;
+    int AStar;
+    int NodeCode;
+    int MaxCodeLength;
+    int KeySize;		/* the Node Id or Code */
+    int NodeSize;		/* a Node, excluding its Arcs and the last END */
+    int ArcSize;
+    int EndianArch;
+    unsigned char *Header;
+    int HeaderSize;
+    double AStarCoeff;
+    int HeaderChanged;
+    int NumBlocks;
+    int MaxBlocks;
+    UpdRoutingBlockPtr Blocks;
+    int NumOther;		/* Contraction Hierarchies blocks */
+    int MaxOther;
+    sqlite3_int64 *Other;
+    sqlite3_int64 RevisionId;	/* -1 if there is no REVISION block */
+    int Revision;
+    sqlite3_stmt *StmtLoad;
+} UpdRouting;
+typedef UpdRouting *UpdRoutingPtr;
+
+static void
+upd_routing_free (UpdRoutingPtr upd)
+{
+/* memory cleanup; freeing an incremental update */
+    int i;
+    for (i = 0; i < upd->NumBlocks; i++)
+      {
+	  UpdRoutingBlockPtr blk = upd->Blocks + i;
+	  if (blk->FirstNodeCode != NULL)
+	      free (blk->FirstNodeCode);
+	  if (blk->Blob != NULL)
+	      free (blk->Blob);
+      }
+    if (upd->Blocks != NULL)
+	free (upd->Blocks);
+    if (upd->Other != NULL)
+	free (upd->Other);
+    if (upd->Header != NULL)
+	free (upd->Header);
+    if (upd->StmtLoad != NULL)
+	sqlite3_finalize (upd->StmtLoad);
+}
+
+static int
+upd_routing_header (sqlite3 * db_handle, const void *cache,
+		    const char *routing_data_table, UpdRoutingPtr upd)
+{
+/* loading and checking the HEADER block */
+    char *sql;
+    char *xtable;
+    int ret;
+    const unsigned char *blob;
+    int size;
+    sqlite3_stmt *stmt = NULL;
+    int ok = 0;
+
+    xtable = gaiaDoubleQuotedSql (routing_data_table);
+    sql =
+	sqlite3_mprintf ("SELECT NetworkData FROM \"%s\" WHERE Id = 0",
+			 xtable);
+    free (xtable);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg = sqlite3_mprintf ("Routing Data table \"%s\": %s",
+				       routing_data_table,
+				       sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW && sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
+      {
+	  blob = sqlite3_column_blob (stmt, 0);
+	  size = sqlite3_column_bytes (stmt, 0);
+	  if (size >= 9 && *(blob + 1) == GAIA_NET_HEADER)
+	    {
+		ok = 1;
+		if (*(blob + 0) == GAIA_NET_START)
+		    upd->Net64 = 0;
+		else if (*(blob + 0) == GAIA_NET64_START)
+		    upd->Net64 = 1;
+		else if (*(blob + 0) == GAIA_NET64_A_STAR_START)
+		  {
+		      upd->Net64 = 1;
+		      upd->AStar = 1;
+		  }
+		else
+		    ok = 0;
+		if (*(blob + 6) == GAIA_NET_CODE)
+		    upd->NodeCode = 1;
+		else if (*(blob + 6) != GAIA_NET_ID)
+		    ok = 0;
+		upd->MaxCodeLength = *(blob + 7);
+		if (upd->AStar)
+		  {
+		      /* the A* Heuristic Coeff always is the last item */
+		      if (size < 19 || *(blob + size - 10) != GAIA_NET_A_STAR_COEFF
+			  || *(blob + size - 1) != GAIA_NET_END)
+			  ok = 0;
+		      else
+			  upd->AStarCoeff =
+			      gaiaImport64 (blob + size - 9, 1,
+					    upd->EndianArch);
+		  }
+		if (ok)
+		  {
+		      upd->Header = malloc (size);
+		      memcpy (upd->Header, blob, size);
+		      upd->HeaderSize = size;
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (!ok)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("Routing Data table \"%s\": invalid Header block",
+			       routing_data_table);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    if (upd->NodeCode)
+	upd->KeySize = upd->MaxCodeLength;
+    else
+	upd->KeySize = upd->Net64 ? 8 : 4;
+    upd->NodeSize = 1 + 4 + upd->KeySize + (upd->AStar ? 16 : 0) + 2;
+    upd->ArcSize = upd->Net64 ? 22 : 18;
+    return 1;
+}
+
+static int
+upd_routing_directory (sqlite3 * db_handle, const void *cache,
+		       const char *routing_data_table, UpdRoutingPtr upd)
+{
+/* 
+/ building the directory of all Nodes blocks (just reading the
+/ first bytes of each block): Nodes are stored by increasing 
+/ internal index, and thus they are sorted by Id (or Code)
+*/
+    char *sql;
+    char *xtable;
+    int ret;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_blob *blob = NULL;
+    unsigned char *buf;
+    int need = 8 + upd->KeySize;
+    int nodes_done = 0;
+    int error = 0;
+
+    xtable = gaiaDoubleQuotedSql (routing_data_table);
+    sql =
+	sqlite3_mprintf ("SELECT Id FROM \"%s\" WHERE Id > 0 ORDER BY Id",
+			 xtable);
+    free (xtable);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    buf = malloc (need);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  sqlite3_int64 id;
+	  int bytes;
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret != SQLITE_ROW)
+	    {
+		error = 1;
+		break;
+	    }
+	  id = sqlite3_column_int64 (stmt, 0);
+	  if (blob == NULL)
+	      ret =
+		  sqlite3_blob_open (db_handle, "main", routing_data_table,
+				     "NetworkData", id, 0, &blob);
+	  else
+	      ret = sqlite3_blob_reopen (blob, id);
+	  if (ret != SQLITE_OK)
+	    {
+		error = 1;
+		break;
+	    }
+	  bytes = sqlite3_blob_bytes (blob);
+	  if (bytes < 1 || sqlite3_blob_read (blob, buf, 1, 0) != SQLITE_OK)
+	    {
+		error = 1;
+		break;
+	    }
+	  if (*buf == GAIA_NET_BLOCK)
+	    {
+		/* a Nodes block */
+		UpdRoutingBlockPtr blk;
+		if (nodes_done || bytes < need
+		    || sqlite3_blob_read (blob, buf, need, 0) != SQLITE_OK
+		    || *(buf + 3) != GAIA_NET_NODE)
+		  {
+		      error = 1;
+		      break;
+		  }
+		if (upd->NumBlocks == upd->MaxBlocks)
+		  {
+		      upd->MaxBlocks =
+			  (upd->MaxBlocks == 0) ? 256 : upd->MaxBlocks * 2;
+		      upd->Blocks =
+			  realloc (upd->Blocks,
+				   sizeof (UpdRoutingBlock) * upd->MaxBlocks);
+		  }
+		blk = upd->Blocks + upd->NumBlocks;
+		upd->NumBlocks += 1;
+		blk->Id = id;
+		blk->FirstNodeId = -1;
+		blk->FirstNodeCode = NULL;
+		blk->Blob = NULL;
+		blk->Size = 0;
+		blk->Allocated = 0;
+		blk->Changed = 0;
+		if (upd->NodeCode)
+		  {
+		      blk->FirstNodeCode = malloc (upd->MaxCodeLength + 1);
+		      memcpy (blk->FirstNodeCode, buf + 8, upd->MaxCodeLength);
+		      *(blk->FirstNodeCode + upd->MaxCodeLength) = '\0';
+		  }
+		else if (upd->Net64)
+		    blk->FirstNodeId =
+			gaiaImportI64 (buf + 8, 1, upd->EndianArch);
+		else
+		    blk->FirstNodeId = gaiaImport32 (buf + 8, 1, upd->EndianArch);
+		continue;
+	    }
+	  /* any other block follows all Nodes blocks */
+	  nodes_done = 1;
+	  if (*buf == GAIA_NET_CH_HEADER || *buf == GAIA_NET_CH_BLOCK)
+	    {
+		/* Contraction Hierarchies: to be discarded */
+		if (upd->NumOther == upd->MaxOther)
+		  {
+		      upd->MaxOther =
+			  (upd->MaxOther == 0) ? 64 : upd->MaxOther * 2;
+		      upd->Other =
+			  realloc (upd->Other,
+				   sizeof (sqlite3_int64) * upd->MaxOther);
+		  }
+		upd->Other[upd->NumOther] = id;
+		upd->NumOther += 1;
+	    }
+	  else if (*buf == GAIA_NET_REVISION)
+	    {
+		if (bytes < 6 || sqlite3_blob_read (blob, buf, 6, 0) != SQLITE_OK)
+		  {
+		      error = 1;
+		      break;
+		  }
+		upd->RevisionId = id;
+		upd->Revision = gaiaImport32 (buf + 1, 1, upd->EndianArch);
+	    }
+      }
+    free (buf);
+    if (blob != NULL)
+	sqlite3_blob_close (blob);
+    sqlite3_finalize (stmt);
+    if (error || upd->NumBlocks == 0)
+      {
+	  char *msg =
+	      sqlite3_mprintf ("Routing Data table \"%s\": invalid Nodes blocks",
+			       routing_data_table);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+upd_routing_cmp_key (UpdRoutingPtr upd, const unsigned char *p,
+		     sqlite3_int64 id, const char *code)
+{
+/* comparing the searched Node against a stored Node Id (or Code) */
+    if (upd->NodeCode)
+      {
+	  char stored[256];
+	  memcpy (stored, p, upd->MaxCodeLength);
+	  stored[upd->MaxCodeLength] = '\0';
+	  return strcmp (code, stored);
+      }
+    else
+      {
+	  sqlite3_int64 stored;
+	  if (upd->Net64)
+	      stored = gaiaImportI64 (p, 1, upd->EndianArch);
+	  else
+	      stored = gaiaImport32 (p, 1, upd->EndianArch);
+	  if (id == stored)
+	      return 0;
+	  return (id > stored) ? 1 : -1;
+      }
+}
+
+static int
+upd_routing_load_block (sqlite3 * db_handle, const void *cache,
+			UpdRoutingPtr upd, UpdRoutingBlockPtr blk)
+{
+/* loading a Nodes block */
+    int ret;
+    int ok = 0;
+    if (blk->Blob != NULL)
+	return 1;
+    sqlite3_reset (upd->StmtLoad);
+    sqlite3_clear_bindings (upd->StmtLoad);
+    sqlite3_bind_int64 (upd->StmtLoad, 1, blk->Id);
+    ret = sqlite3_step (upd->StmtLoad);
+    if (ret == SQLITE_ROW
+	&& sqlite3_column_type (upd->StmtLoad, 0) == SQLITE_BLOB)
+      {
+	  const unsigned char *blob = sqlite3_column_blob (upd->StmtLoad, 0);
+	  int size = sqlite3_column_bytes (upd->StmtLoad, 0);
+	  /* some room for a few more Arcs */
+	  blk->Allocated = size + (64 * upd->ArcSize);
+	  blk->Blob = malloc (blk->Allocated);
+	  memcpy (blk->Blob, blob, size);
+	  blk->Size = size;
+	  ok = 1;
+      }
+    sqlite3_reset (upd->StmtLoad);
+    if (!ok)
+      {
+	  char *msg = sqlite3_mprintf ("SQL error: %s",
+				       sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+upd_routing_find_node (sqlite3 * db_handle, const void *cache,
+		       UpdRoutingPtr upd, sqlite3_int64 id, const char *code,
+		       UpdRoutingBlockPtr * block, int *offset)
+{
+/* 
+/ searching a Node: the block is identified by the directory,
+/ then the Node itself is searched into the block
+/ returns 1 if found, 0 if not found and -1 on error
+*/
+    int lo = 0;
+    int hi = upd->NumBlocks - 1;
+    int found = -1;
+    int nodes;
+    int i;
+    int off;
+    UpdRoutingBlockPtr blk;
+    if (upd->NodeCode && (code == NULL
+			  || (int) strlen (code) > upd->MaxCodeLength))
+	return 0;
+    while (lo <= hi)
+      {
+	  /* the last block starting with a Node not greater than the searched one */
+	  int mid = (lo + hi) / 2;
+	  int cmp;
+	  blk = upd->Blocks + mid;
+	  if (upd->NodeCode)
+	      cmp = strcmp (code, blk->FirstNodeCode);
+	  else
+	      cmp = (id == blk->FirstNodeId) ? 0
+		  : ((id > blk->FirstNodeId) ? 1 : -1);
+	  if (cmp >= 0)
+	    {
+		found = mid;
+		lo = mid + 1;
+	    }
+	  else
+	      hi = mid - 1;
+      }
+    if (found < 0)
+	return 0;
+    blk = upd->Blocks + found;
+    if (!upd_routing_load_block (db_handle, cache, upd, blk))
+	return -1;
+    nodes = gaiaImport16 (blk->Blob + 1, 1, upd->EndianArch);
+    off = 3;
+    for (i = 0; i < nodes; i++)
+      {
+	  int arcs;
+	  int cmp;
+	  if (off + upd->NodeSize + 1 > blk->Size
+	      || *(blk->Blob + off) != GAIA_NET_NODE)
+	    {
+		gaia_create_routing_set_error (cache,
+					       "Routing Data table: invalid Nodes block");
+		return -1;
+	    }
+	  arcs =
+	      gaiaImport16 (blk->Blob + off + upd->NodeSize - 2, 1,
+			    upd->EndianArch);
+	  cmp = upd_routing_cmp_key (upd, blk->Blob + off + 5, id, code);
+	  if (cmp == 0)
+	    {
+		*block = blk;
+		*offset = off;
+		return 1;
+	    }
+	  if (cmp < 0)
+	      break;		/* Nodes are sorted */
+	  off += upd->NodeSize + (arcs * upd->ArcSize) + 1;
+      }
+    return 0;
+}
+
+static int
+upd_routing_apply (sqlite3 * db_handle, const void *cache, UpdRoutingPtr upd,
+		   sqlite3_int64 link_id, sqlite3_int64 id_from,
+		   const char *code_from, sqlite3_int64 id_to,
+		   const char *code_to, int deleted, double cost)
+{
+/* applying a single change to the Nodes blocks */
+    UpdRoutingBlockPtr blk_from;
+    UpdRoutingBlockPtr blk_to;
+    int off_from;
+    int off_to;
+    int index_to;
+    int arcs;
+    int i;
+    int ret;
+    int rowid_size = upd->Net64 ? 8 : 4;
+    unsigned char *node;
+    unsigned char *arc = NULL;
+    double x_from = 0.0;
+    double y_from = 0.0;
+    double x_to = 0.0;
+    double y_to = 0.0;
+
+    ret =
+	upd_routing_find_node (db_handle, cache, upd, id_from, code_from,
+			       &blk_from, &off_from);
+    if (ret < 0)
+	return 0;
+    if (ret == 0)
+      {
+	  char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+				       " references a NodeFrom that does not exist",
+				       link_id);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    ret =
+	upd_routing_find_node (db_handle, cache, upd, id_to, code_to, &blk_to,
+			       &off_to);
+    if (ret < 0)
+	return 0;
+    if (ret == 0)
+      {
+	  char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+				       " references a NodeTo that does not exist",
+				       link_id);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  return 0;
+      }
+    index_to = gaiaImport32 (blk_to->Blob + off_to + 1, 1, upd->EndianArch);
+    if (upd->AStar)
+      {
+	  /* both Nodes will be moved by inserting or deleting Arcs */
+	  node = blk_from->Blob + off_from + 5 + upd->KeySize;
+	  x_from = gaiaImport64 (node, 1, upd->EndianArch);
+	  y_from = gaiaImport64 (node + 8, 1, upd->EndianArch);
+	  node = blk_to->Blob + off_to + 5 + upd->KeySize;
+	  x_to = gaiaImport64 (node, 1, upd->EndianArch);
+	  y_to = gaiaImport64 (node + 8, 1, upd->EndianArch);
+      }
+
+/* searching the Arc */
+    node = blk_from->Blob + off_from;
+    arcs = gaiaImport16 (node + upd->NodeSize - 2, 1, upd->EndianArch);
+    for (i = 0; i < arcs; i++)
+      {
+	  unsigned char *p = node + upd->NodeSize + (i * upd->ArcSize);
+	  sqlite3_int64 rowid;
+	  if (upd->Net64)
+	      rowid = gaiaImportI64 (p + 1, 1, upd->EndianArch);
+	  else
+	      rowid = gaiaImport32 (p + 1, 1, upd->EndianArch);
+	  if (rowid == link_id
+	      && gaiaImport32 (p + 1 + rowid_size, 1,
+			       upd->EndianArch) == index_to)
+	    {
+		arc = p;
+		break;
+	    }
+      }
+
+    if (deleted)
+      {
+	  /* removing the Arc */
+	  unsigned char *end = blk_from->Blob + blk_from->Size;
+	  if (arc == NULL)
+	    {
+		char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+					     " does not exist", link_id);
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		return 0;
+	    }
+	  memmove (arc, arc + upd->ArcSize, end - (arc + upd->ArcSize));
+	  blk_from->Size -= upd->ArcSize;
+	  gaiaExport16 (node + upd->NodeSize - 2, arcs - 1, 1,
+			upd->EndianArch);
+	  blk_from->Changed = 1;
+	  return 1;
+      }
+
+    if (arc == NULL)
+      {
+	  /* inserting a new Arc after all the other ones */
+	  unsigned char *end;
+	  if (arcs >= 32767)
+	    {
+		char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+					     " exceeds the max number of Links of its NodeFrom",
+					     link_id);
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		return 0;
+	    }
+	  if (blk_from->Size + upd->ArcSize > blk_from->Allocated)
+	    {
+		blk_from->Allocated =
+		    blk_from->Size + (64 * upd->ArcSize) +
+		    (blk_from->Allocated / 4);
+		blk_from->Blob = realloc (blk_from->Blob, blk_from->Allocated);
+		node = blk_from->Blob + off_from;
+	    }
+	  arc = node + upd->NodeSize + (arcs * upd->ArcSize);
+	  end = blk_from->Blob + blk_from->Size;
+	  memmove (arc + upd->ArcSize, arc, end - arc);
+	  blk_from->Size += upd->ArcSize;
+	  gaiaExport16 (node + upd->NodeSize - 2, arcs + 1, 1,
+			upd->EndianArch);
+	  *arc = GAIA_NET_ARC;
+	  if (upd->Net64)
+	      gaiaExportI64 (arc + 1, link_id, 1, upd->EndianArch);	/* the Arc rowid */
+	  else
+	      gaiaExport32 (arc + 1, (int) link_id, 1, upd->EndianArch);
+	  gaiaExport32 (arc + 1 + rowid_size, index_to, 1, upd->EndianArch);	/* the ToNode internal index */
+	  *(arc + upd->ArcSize - 1) = GAIA_NET_END;
+      }
+    gaiaExport64 (arc + upd->ArcSize - 9, cost, 1, upd->EndianArch);	/* the Arc Cost */
+    blk_from->Changed = 1;
+
+    if (upd->AStar)
+      {
+	  /* the A* heuristic must never overestimate the Cost */
+	  double dist =
+	      sqrt (((x_to - x_from) * (x_to - x_from)) +
+		    ((y_to - y_from) * (y_to - y_from)));
+	  if (dist > 0.0 && cost / dist < upd->AStarCoeff)
+	    {
+		upd->AStarCoeff = cost / dist;
+		upd->HeaderChanged = 1;
+	    }
+      }
+    return 1;
+}
+
+static int
+upd_routing_write (sqlite3 * db_handle, const void *cache,
+		   const char *routing_data_table, UpdRoutingPtr upd)
+{
+/* writing back all changed blocks */
+    char *sql;
+    char *xtable;
+    int ret;
+    int i;
+    sqlite3_stmt *stmt_upd = NULL;
+    sqlite3_stmt *stmt_del = NULL;
+    sqlite3_stmt *stmt_ins = NULL;
+    unsigned char revision[6];
+    int error = 0;
+
+    xtable = gaiaDoubleQuotedSql (routing_data_table);
+    sql =
+	sqlite3_mprintf
+	("UPDATE \"%s\" SET NetworkData = ? WHERE Id = ?", xtable);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_upd, NULL);
+    sqlite3_free (sql);
+    if (ret == SQLITE_OK)
+      {
+	  sql = sqlite3_mprintf ("DELETE FROM \"%s\" WHERE Id = ?", xtable);
+	  ret =
+	      sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_del,
+				  NULL);
+	  sqlite3_free (sql);
+      }
+    if (ret == SQLITE_OK)
+      {
+	  sql =
+	      sqlite3_mprintf
+	      ("INSERT INTO \"%s\" (Id, NetworkData) VALUES (NULL, ?)",
+	       xtable);
+	  ret =
+	      sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt_ins,
+				  NULL);
+	  sqlite3_free (sql);
+      }
+    free (xtable);
+    if (ret != SQLITE_OK)
+      {
+	  error = 1;
+	  goto stop;
+      }
+
+/* updating the Nodes blocks */
+    for (i = 0; i < upd->NumBlocks; i++)
+      {
+	  UpdRoutingBlockPtr blk = upd->Blocks + i;
+	  if (!blk->Changed)
+	      continue;
+	  sqlite3_reset (stmt_upd);
+	  sqlite3_clear_bindings (stmt_upd);
+	  sqlite3_bind_blob (stmt_upd, 1, blk->Blob, blk->Size, SQLITE_STATIC);
+	  sqlite3_bind_int64 (stmt_upd, 2, blk->Id);
+	  ret = sqlite3_step (stmt_upd);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		error = 1;
+		goto stop;
+	    }
+      }
+
+    if (upd->HeaderChanged)
+      {
+	  /* updating the A* Heuristic Coeff */
+	  gaiaExport64 (upd->Header + upd->HeaderSize - 9, upd->AStarCoeff, 1,
+			upd->EndianArch);
+	  sqlite3_reset (stmt_upd);
+	  sqlite3_clear_bindings (stmt_upd);
+	  sqlite3_bind_blob (stmt_upd, 1, upd->Header, upd->HeaderSize,
+			     SQLITE_STATIC);
+	  sqlite3_bind_int64 (stmt_upd, 2, 0);
+	  ret = sqlite3_step (stmt_upd);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		error = 1;
+		goto stop;
+	    }
+      }
+
+/* discarding the Contraction Hierarchies */
+    for (i = 0; i < upd->NumOther; i++)
+      {
+	  sqlite3_reset (stmt_del);
+	  sqlite3_clear_bindings (stmt_del);
+	  sqlite3_bind_int64 (stmt_del, 1, upd->Other[i]);
+	  ret = sqlite3_step (stmt_del);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		error = 1;
+		goto stop;
+	    }
+      }
+
+/* 
+/ inserting the new REVISION block at the end of the table, 
+/ and only then removing the previous one: so the max Id 
+/ will always change
+*/
+    revision[0] = GAIA_NET_REVISION;
+    gaiaExport32 (revision + 1, upd->Revision + 1, 1, upd->EndianArch);
+    revision[5] = GAIA_NET_END;
+    sqlite3_reset (stmt_ins);
+    sqlite3_clear_bindings (stmt_ins);
+    sqlite3_bind_blob (stmt_ins, 1, revision, 6, SQLITE_STATIC);
+    ret = sqlite3_step (stmt_ins);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+      {
+	  error = 1;
+	  goto stop;
+      }
+    if (upd->RevisionId >= 0)
+      {
+	  sqlite3_reset (stmt_del);
+	  sqlite3_clear_bindings (stmt_del);
+	  sqlite3_bind_int64 (stmt_del, 1, upd->RevisionId);
+	  ret = sqlite3_step (stmt_del);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	      error = 1;
+      }
 
-/* COMMIT */
-    sql = "RELEASE SAVEPOINT create_routing_nodes";
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    if (ret != SQLITE_OK)
+  stop:
+    if (error)
       {
 	  char *msg =
 	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
 	  gaia_create_routing_set_error (cache, msg);
 	  sqlite3_free (msg);
-	  goto error;
       }
-    return 1;
-
-  error:
-    if (stmt_q1 != NULL)
-	sqlite3_finalize (stmt_q1);
-    if (stmt_q2 != NULL)
-	sqlite3_finalize (stmt_q2);
-    if (stmt_ins != NULL)
-	sqlite3_finalize (stmt_ins);
     if (stmt_upd != NULL)
 	sqlite3_finalize (stmt_upd);
-/* ROLLBACK */
-    sql = "ROLLBACK TO create_routing_nodes";
-    sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
-    return 0;
+    if (stmt_del != NULL)
+	sqlite3_finalize (stmt_del);
+    if (stmt_ins != NULL)
+	sqlite3_finalize (stmt_ins);
+    return !error;
 }
 
-SPATIALITE_DECLARE int
-gaia_create_routing_nodes (sqlite3 * db_handle,
-			   const void *cache,
-			   const char *db_prefix,
-			   const char *table,
-			   const char *geom_column,
-			   const char *from_column, const char *to_column)
+static int
+do_update_routing (sqlite3 * db_handle, const void *cache,
+		   const char *routing_data_table, const char *changes_table)
 {
-/* attempting to create a Routing Nodes columns for a spatial table */
-    const char *sql;
+/* applying all changes to the Routing Data table */
+    char *sql;
+    char *xtable;
     int ret;
-    char *geom_name = NULL;
-
-    if (db_handle == NULL || cache == NULL)
-	return 0;
-
-    if (table == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "Spatial Table Name is NULL");
-	  return 0;
-      }
-    if (from_column == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "FromNode Column Name is NULL");
-	  return 0;
-      }
-    if (to_column == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "ToNode Column Name is NULL");
-	  return 0;
-      }
+    sqlite3_stmt *stmt = NULL;
+    UpdRouting upd;
+    int changes = 0;
+    int error = 0;
 
-/* testing the spatial table */
-    if (!do_check_spatial_table
-	(db_handle, cache, db_prefix, table, geom_column, from_column,
-	 to_column, &geom_name))
+    memset (&upd, 0, sizeof (UpdRouting));
+    upd.EndianArch = gaiaEndianArch ();
+    upd.RevisionId = -1;
+    if (!upd_routing_header (db_handle, cache, routing_data_table, &upd))
 	goto error;
-
-/* setting a global Savepoint */
-    sql = "SAVEPOINT create_routing_nodes";
-    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (!upd_routing_directory (db_handle, cache, routing_data_table, &upd))
+	goto error;
+    xtable = gaiaDoubleQuotedSql (routing_data_table);
+    sql =
+	sqlite3_mprintf ("SELECT NetworkData FROM \"%s\" WHERE Id = ?",
+			 xtable);
+    free (xtable);
+    ret =
+	sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &(upd.StmtLoad),
+			    NULL);
+    sqlite3_free (sql);
     if (ret != SQLITE_OK)
       {
 	  char *msg =
@@ -3061,42 +5315,126 @@ gaia_create_routing_nodes (sqlite3 * db_handle,
 	  goto error;
       }
 
-/* creating and populating the Routing Nodes columns */
-    if (!do_create_routing_nodes
-	(db_handle, cache, db_prefix, table, geom_name, from_column, to_column))
+/* reading the changes */
+    xtable = gaiaDoubleQuotedSql (changes_table);
+    sql =
+	sqlite3_mprintf
+	("SELECT link_id, node_from, node_to, cost FROM \"%s\"", xtable);
+    free (xtable);
+    ret = sqlite3_prepare_v2 (db_handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  char *msg = sqlite3_mprintf ("Changes table \"%s\": %s",
+				       changes_table,
+				       sqlite3_errmsg (db_handle));
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
+	  goto error;
+      }
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  sqlite3_int64 link_id;
+	  sqlite3_int64 id_from = -1;
+	  sqlite3_int64 id_to = -1;
+	  const char *code_from = NULL;
+	  const char *code_to = NULL;
+	  int deleted = 0;
+	  double cost = 0.0;
+	  int node_type = upd.NodeCode ? SQLITE_TEXT : SQLITE_INTEGER;
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret != SQLITE_ROW)
+	    {
+		char *msg = sqlite3_mprintf ("SQL error: %s",
+					     sqlite3_errmsg (db_handle));
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		error = 1;
+		break;
+	    }
+	  if (sqlite3_column_type (stmt, 0) != SQLITE_INTEGER
+	      || sqlite3_column_type (stmt, 1) != node_type
+	      || sqlite3_column_type (stmt, 2) != node_type)
+	    {
+		gaia_create_routing_set_error (cache,
+					       "Changes: found a row containing invalid Link or Node ids");
+		error = 1;
+		break;
+	    }
+	  link_id = sqlite3_column_int64 (stmt, 0);
+	  if (!upd.Net64 && (link_id < -2147483647 || link_id > 2147483647))
+	    {
+		char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+					     " exceeds the 32 bit range of this Network",
+					     link_id);
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		error = 1;
+		break;
+	    }
+	  if (upd.NodeCode)
+	    {
+		code_from = (const char *) sqlite3_column_text (stmt, 1);
+		code_to = (const char *) sqlite3_column_text (stmt, 2);
+	    }
+	  else
+	    {
+		id_from = sqlite3_column_int64 (stmt, 1);
+		id_to = sqlite3_column_int64 (stmt, 2);
+	    }
+	  if (sqlite3_column_type (stmt, 3) == SQLITE_NULL)
+	      deleted = 1;
+	  else if (sqlite3_column_type (stmt, 3) == SQLITE_INTEGER
+		   || sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
+	      cost = sqlite3_column_double (stmt, 3);
+	  else
+	      cost = -1.0;
+	  if (cost < 0.0)
+	    {
+		char *msg = sqlite3_mprintf ("Changes: Link " FRMT64
+					     " has an invalid cost", link_id);
+		gaia_create_routing_set_error (cache, msg);
+		sqlite3_free (msg);
+		error = 1;
+		break;
+	    }
+	  if (!upd_routing_apply
+	      (db_handle, cache, &upd, link_id, id_from, code_from, id_to,
+	       code_to, deleted, cost))
+	    {
+		error = 1;
+		break;
+	    }
+	  changes++;
+      }
+    sqlite3_finalize (stmt);
+    if (error)
 	goto error;
 
-    free (geom_name);
+    if (changes > 0)
+      {
+	  /* writing back all changed blocks */
+	  if (!upd_routing_write (db_handle, cache, routing_data_table, &upd))
+	      goto error;
+      }
+    upd_routing_free (&upd);
     return 1;
 
   error:
-    if (geom_name != NULL)
-	free (geom_name);
+    upd_routing_free (&upd);
     return 0;
 }
 
 SPATIALITE_DECLARE int
-gaia_create_routing (sqlite3 * db_handle,
-		     const void *cache,
-		     const char *routing_data_table,
-		     const char
-		     *virtual_routing_table,
-		     const char *input_table,
-		     const char *from_column,
-		     const char *to_column,
-		     const char *geom_column,
-		     const char *cost_column,
-		     const char *name_column,
-		     int a_star_enabled,
-		     int bidirectional,
-		     const char *oneway_from,
-		     const char *oneway_to, int overwrite)
+gaia_update_routing (sqlite3 * db_handle, const void *cache,
+		     const char *routing_data_table, const char *changes_table)
 {
-/* attempting to create a VirtualRouting from an input table */
-    int has_ids;
-    int n_nodes = 0;
-    int max_code_length = 0;
-    double a_star_coeff = DBL_MAX;
+/* 
+/ attempting to incrementally update an existing Routing Data table
+*/
     const char *sql;
     int ret;
 
@@ -3110,60 +5448,23 @@ gaia_create_routing (sqlite3 * db_handle,
 					 "Routing Data Table Name is NULL");
 	  return 0;
       }
-    if (virtual_routing_table == NULL)
-      {
-	  gaia_create_routing_set_error (cache,
-					 "VirtualRouting Table Name is NULL");
-	  return 0;
-      }
-    if (input_table == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "Input Table Name is NULL");
-	  return 0;
-      }
-    if (from_column == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "FromNode Column Name is NULL");
-	  return 0;
-      }
-    if (to_column == NULL)
-      {
-	  gaia_create_routing_set_error (cache, "ToNode Column Name is NULL");
-	  return 0;
-      }
-    if (geom_column == NULL && cost_column == NULL)
-      {
-	  gaia_create_routing_set_error (cache,
-					 "Both Geometry Column and Cost Column Names are NULL at the same time");
-	  return 0;
-      }
-    if (oneway_from == NULL && oneway_to != NULL)
-      {
-	  gaia_create_routing_set_error (cache,
-					 "OnewayFromTo is NULL but OnewayToFrom is NOT NULL");
-	  return 0;
-      }
-    if (oneway_from != NULL && oneway_to == NULL)
-      {
-	  gaia_create_routing_set_error (cache,
-					 "OnewayFromTo is NOT NULL but OnewayToFrom is NULL");
-	  return 0;
-      }
-    if (oneway_from != NULL && oneway_to != NULL && !bidirectional)
+    if (changes_table == NULL)
       {
-	  gaia_create_routing_set_error (cache,
-					 "Both OnewayFromTo and OnewayToFrom are NOT NULL but Unidirectional has been specified");
+	  gaia_create_routing_set_error (cache, "Changes Table Name is NULL");
 	  return 0;
       }
-    if (a_star_enabled && geom_column == NULL)
+    if (!do_check_data_table (db_handle, routing_data_table))
       {
-	  gaia_create_routing_set_error (cache,
-					 "Geometry Columns is NULL but A* is enabled");
+	  char *msg =
+	      sqlite3_mprintf ("Routing Data Table \"%s\" does not exist",
+			       routing_data_table);
+	  gaia_create_routing_set_error (cache, msg);
+	  sqlite3_free (msg);
 	  return 0;
       }
 
-/* setting a global Savepoint */
-    sql = "SAVEPOINT create_routing_zero";
+/* setting a Savepoint */
+    sql = "SAVEPOINT update_routing";
     ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
     if (ret != SQLITE_OK)
       {
@@ -3174,53 +5475,30 @@ gaia_create_routing (sqlite3 * db_handle,
 	  return 0;
       }
 
-/* dropping the TempTables (just in case) */
-    do_drop_temp_tables (db_handle);
-
-    if (overwrite)
-      {
-	  /* attempting to drop existing tables (just in case) */
-	  do_drop_tables (db_handle, routing_data_table, virtual_routing_table);
-      }
-
-/* testing for existing tables */
-    if (do_check_data_table (db_handle, routing_data_table))
+    if (!do_update_routing
+	(db_handle, cache, routing_data_table, changes_table))
       {
-	  char *msg =
-	      sqlite3_mprintf ("Routing Data Table \"%s\" already exists",
-			       routing_data_table);
-	  gaia_create_routing_set_error (cache, msg);
-	  sqlite3_free (msg);
+	  /* rolling back the Savepoint */
+	  sqlite3_exec (db_handle, "ROLLBACK TO update_routing", NULL, NULL,
+			NULL);
+	  sqlite3_exec (db_handle, "RELEASE SAVEPOINT update_routing", NULL,
+			NULL, NULL);
 	  return 0;
       }
-    if (do_check_virtual_table (db_handle, virtual_routing_table))
+
+/* releasing the Savepoint */
+    sql = "RELEASE SAVEPOINT update_routing";
+    ret = sqlite3_exec (db_handle, sql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
       {
 	  char *msg =
-	      sqlite3_mprintf ("VirtualRouting Table \"%s\" already exists",
-			       virtual_routing_table);
+	      sqlite3_mprintf ("SQL error: %s", sqlite3_errmsg (db_handle));
 	  gaia_create_routing_set_error (cache, msg);
 	  sqlite3_free (msg);
 	  return 0;
       }
 
-/* testing the input table */
-    if (!do_check_input_table
-	(db_handle, cache, input_table, from_column, to_column, geom_column,
-	 cost_column, name_column, oneway_from, oneway_to, a_star_enabled,
-	 bidirectional, &has_ids, &n_nodes, &max_code_length, &a_star_coeff))
-	return 0;
-
-/* creating and populating the Routing Data table */
-    if (!do_create_data
-	(db_handle, cache, routing_data_table, input_table, from_column,
-	 to_column, geom_column, name_column, a_star_enabled, a_star_coeff,
-	 has_ids, n_nodes, max_code_length))
-	return 0;
-
-/* creating the VirtualRouting table */
-    if (!do_create_virtual_routing
-	(db_handle, cache, routing_data_table, virtual_routing_table))
-	return 0;
-
+/* any VirtualRouting based on this table will now reload the NETWORK */
+    splite_routing_cache_outdate (db_handle, routing_data_table);
     return 1;
 }
@@ -49,6 +49,12 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <string.h>
 #include <float.h>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
 #else
@@ -59,6 +65,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <spatialite/debug.h>
 
 #include <spatialite/spatialite.h>
+#include <spatialite_private.h>
 #include <spatialite/gaiageo.h>
 #include <spatialite/gaiaaux.h>
 
@@ -85,26 +92,18 @@ excessive memory fragmentation and achieve better performance
 
 - the cache is a linked-list of cache page elements
   - each cache page contains an array of 32 cache blocks
-    - each cache block contains an array of 32 cache cells
+    - each cache block contains 32 cache cells
 so a single cache page con store up to 1024 cache cells
 
-*/
+cells are stored as a structure of arrays (one array for the
+ROWIDs and one for each MBR coordinate), and each page keeps the
+same kind of arrays summarizing the MBR of each block, so that
+a search frame can be tested against 32 MBRs at once (using SIMD
+instructions whenever available), thus always returning a bitmap
+of the matching blocks or cells
 
-struct mbr_cache_cell
-{
-/* 
-a  cached entity 
 */
 
-/* the entity's ROWID */
-    sqlite3_int64 rowid;
-/* the MBR */
-    double minx;
-    double miny;
-    double maxx;
-    double maxy;
-};
-
 struct mbr_cache_block
 {
 /*
@@ -117,16 +116,13 @@ allocation bitmap: the meaning of each bit is:
 0 - corresponding cache cell is unused
 */
     unsigned int bitmap;
-/* 
-the MBR corresponding to this cache block 
-i.e. the combined MBR for any contained cell
-*/
-    double minx;
-    double miny;
-    double maxx;
-    double maxy;
-/* the cache cells array */
-    struct mbr_cache_cell cells[32];
+/* the entity's ROWIDs */
+    sqlite3_int64 rowid[32];
+/* the MBRs */
+    double minx[32];
+    double miny[32];
+    double maxx[32];
+    double maxy[32];
 };
 
 struct mbr_cache_page
@@ -149,11 +145,23 @@ i.e. the combined MBR for any contained block
     double miny;
     double maxx;
     double maxy;
+/* 
+the MBRs corresponding to each cache block
+i.e. the combined MBR for any contained cell
+*/
+    double block_minx[32];
+    double block_miny[32];
+    double block_maxx[32];
+    double block_maxy[32];
 /* the cache blocks array */
     struct mbr_cache_block blocks[32];
 /* the min-max rowid for this page */
     sqlite3_int64 min_rowid;
     sqlite3_int64 max_rowid;
+/* the page number (1-based) into the persistent snapshot */
+    int page_no;
+/* TRUE if this page has to be written into the persistent snapshot */
+    int dirty;
 /* pointer to next element into the cached pages linked list */
     struct mbr_cache_page *next;
 };
@@ -172,6 +180,44 @@ implemented as a cache pages linked list
  pointer used to identify the current cache page when inserting a new cache cell
  */
     struct mbr_cache_page *current;
+/* the number of cache pages */
+    int page_count;
+};
+
+/*
+
+transactions and the persistent snapshot
+
+any change is immediately applied to the MBR's cache (so to be
+visible to any further query within the same transaction), and
+recorded into an undo log; ROLLBACK and ROLLBACK TO will then 
+revert the cache by replaying the undo log backwards
+
+each cache page is persistently stored as a BLOB into the
+"<virtual-table>_snapshot" shadow table, so that connecting
+again will not require to scan the whole geometry column;
+all the pages changed by a transaction are written in a single 
+batch on commit, tagged by a new snapshot generation, so that
+any other connection will only reload the changed pages
+
+*/
+
+#define MBRC_UNDO_INSERT	1
+#define MBRC_UNDO_DELETE	2
+#define MBRC_UNDO_UPDATE	3
+
+#define MBRC_SNAPSHOT_MAGIC	0x6d627263
+
+struct mbr_cache_undo
+{
+/* an undo log entry */
+    int op;
+    sqlite3_int64 rowid;
+/* the previous MBR (DELETE and UPDATE) */
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
 };
 
 typedef struct MbrCacheStruct
@@ -185,9 +231,32 @@ typedef struct MbrCacheStruct
     char *table_name;		/* the main table to be cached */
     char *column_name;		/* the column to be cached */
     int error;			/* some previous error disables any operation */
+    char *db_prefix;		/* the DB containing the virtual table */
+    char *vtable_name;		/* the virtual table name */
+    int snapshot;		/* TRUE if the persistent snapshot is available */
+    int snapshot_stale;		/* TRUE if the whole snapshot must be rewritten */
+    sqlite3_int64 generation;	/* the currently cached snapshot generation */
+    sqlite3_int64 data_version;	/* the last checked PRAGMA data_version */
+    int n_cursors;		/* the number of currently open cursors */
+    int in_transaction;		/* TRUE within a write transaction */
+    int loaded_in_transaction;	/* TRUE if the cache was loaded within the current transaction */
+    struct mbr_cache_undo *undo;	/* the undo log */
+    int undo_count;		/* the number of undo log entries */
+    int undo_max;		/* the allocated undo log entries */
+    int *savepoints;		/* the undo log position for each savepoint */
+    int n_savepoints;		/* the number of active savepoints */
 } MbrCache;
 typedef MbrCache *MbrCachePtr;
 
+struct mbr_cache_position
+{
+/* a cached cell, as referenced by a sequential scan */
+    sqlite3_int64 rowid;
+    struct mbr_cache_page *page;
+    int i_block;
+    int i_cell;
+};
+
 typedef struct MbrCacheCursortStruct
 {
 /* extends the sqlite3_vtab_cursor struct */
@@ -199,7 +268,14 @@ positioning parameters while performing a cache search
     struct mbr_cache_page *current_page;
     int current_block_index;
     int current_cell_index;
-    struct mbr_cache_cell *current_cell;
+    int valid_cell;
+/*
+bitmaps of the still unvisited candidates:
+    pending_blocks: blocks of the current page
+    pending_cells: cells of the current block
+*/
+    unsigned int pending_blocks;
+    unsigned int pending_cells;
 /* 
 the strategy to use:
     0 = sequential scan
@@ -218,6 +294,13 @@ the MBR search mode:
     1 = CONTAIN
 */
     int mbr_mode;
+/*
+sequential scans return the cells sorted by ROWID
+(cells are physically stored in Hilbert order)
+*/
+    struct mbr_cache_position *positions;
+    int n_positions;
+    int next_position;
 } MbrCacheCursor;
 typedef MbrCacheCursor *MbrCacheCursorPtr;
 
@@ -225,74 +308,118 @@ static unsigned int
 cache_bitmask (int x)
 {
 /* return the bitmask corresponding to index X */
-    switch (x)
-      {
-      case 0:
-	  return 0x80000000;
-      case 1:
-	  return 0x40000000;
-      case 2:
-	  return 0x20000000;
-      case 3:
-	  return 0x10000000;
-      case 4:
-	  return 0x08000000;
-      case 5:
-	  return 0x04000000;
-      case 6:
-	  return 0x02000000;
-      case 7:
-	  return 0x01000000;
-      case 8:
-	  return 0x00800000;
-      case 9:
-	  return 0x00400000;
-      case 10:
-	  return 0x00200000;
-      case 11:
-	  return 0x00100000;
-      case 12:
-	  return 0x00080000;
-      case 13:
-	  return 0x00040000;
-      case 14:
-	  return 0x00020000;
-      case 15:
-	  return 0x00010000;
-      case 16:
-	  return 0x00008000;
-      case 17:
-	  return 0x00004000;
-      case 18:
-	  return 0x00002000;
-      case 19:
-	  return 0x00001000;
-      case 20:
-	  return 0x00000800;
-      case 21:
-	  return 0x00000400;
-      case 22:
-	  return 0x00000200;
-      case 23:
-	  return 0x00000100;
-      case 24:
-	  return 0x00000080;
-      case 25:
-	  return 0x00000040;
-      case 26:
-	  return 0x00000020;
-      case 27:
-	  return 0x00000010;
-      case 28:
-	  return 0x00000008;
-      case 29:
-	  return 0x00000004;
-      case 30:
-	  return 0x00000002;
-      case 31:
-	  return 0x00000001;
-      };
-    return 0x00000000;
+    return 0x00000001u << x;
+}
+
+static int
+cache_first_bit (unsigned int bitmap)
+{
+/* return the index of the lowest bit set into a (not empty) bitmap */
+#if defined(__GNUC__)
+    return __builtin_ctz (bitmap);
+#else
+    int x;
+    for (x = 0; x < 32; x++)
+      {
+	  if (bitmap & cache_bitmask (x))
+	      return x;
+      }
+    return -1;
+#endif
+}
+
+static unsigned int
+cache_filter_32 (const double *p, const double *q, const double *r,
+		 const double *s, double a, double b, double c, double d)
+{
+/*
+/ testing 32 MBRs at once; returns the bitmap of the ones
+/ satisfying: P >= a AND Q <= b AND R >= c AND S <= d
+*/
+    unsigned int bitmap = 0;
+    int i;
+#if defined(__AVX__)
+    __m256d va = _mm256_set1_pd (a);
+    __m256d vb = _mm256_set1_pd (b);
+    __m256d vc = _mm256_set1_pd (c);
+    __m256d vd = _mm256_set1_pd (d);
+    for (i = 0; i < 32; i += 4)
+      {
+	  __m256d m1 =
+	      _mm256_and_pd (_mm256_cmp_pd (_mm256_loadu_pd (p + i), va,
+					    _CMP_GE_OQ),
+			     _mm256_cmp_pd (_mm256_loadu_pd (q + i), vb,
+					    _CMP_LE_OQ));
+	  __m256d m2 =
+	      _mm256_and_pd (_mm256_cmp_pd (_mm256_loadu_pd (r + i), vc,
+					    _CMP_GE_OQ),
+			     _mm256_cmp_pd (_mm256_loadu_pd (s + i), vd,
+					    _CMP_LE_OQ));
+	  bitmap |=
+	      (unsigned int) _mm256_movemask_pd (_mm256_and_pd (m1, m2)) << i;
+      }
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128d va = _mm_set1_pd (a);
+    __m128d vb = _mm_set1_pd (b);
+    __m128d vc = _mm_set1_pd (c);
+    __m128d vd = _mm_set1_pd (d);
+    for (i = 0; i < 32; i += 2)
+      {
+	  __m128d m1 = _mm_and_pd (_mm_cmpge_pd (_mm_loadu_pd (p + i), va),
+				   _mm_cmple_pd (_mm_loadu_pd (q + i), vb));
+	  __m128d m2 = _mm_and_pd (_mm_cmpge_pd (_mm_loadu_pd (r + i), vc),
+				   _mm_cmple_pd (_mm_loadu_pd (s + i), vd));
+	  bitmap |= (unsigned int) _mm_movemask_pd (_mm_and_pd (m1, m2)) << i;
+      }
+#else
+    for (i = 0; i < 32; i++)
+      {
+	  /* branch-free, so to be easily vectorized by the compiler */
+	  unsigned int ok = (p[i] >= a) & (q[i] <= b) & (r[i] >= c)
+	      & (s[i] <= d);
+	  bitmap |= ok << i;
+      }
+#endif
+    return bitmap;
+}
+
+static unsigned int
+cache_filter_blocks (struct mbr_cache_page *pp, double minx, double miny,
+		     double maxx, double maxy)
+{
+/* returns the bitmap of the page blocks intersecting the search frame */
+    return cache_filter_32 (pp->block_maxx, pp->block_minx, pp->block_maxy,
+			    pp->block_miny, minx, maxx, miny, maxy);
+}
+
+static unsigned int
+cache_filter_cells (struct mbr_cache_block *pb, double minx, double miny,
+		    double maxx, double maxy, int mode)
+{
+/* returns the bitmap of the block cells satisfying the MBR spatial relation */
+    unsigned int bitmap;
+    if (mode == GAIA_FILTER_MBR_INTERSECTS)
+      {
+	  /* MBR INTERSECTS */
+	  bitmap =
+	      cache_filter_32 (pb->maxx, pb->minx, pb->maxy, pb->miny, minx,
+			       maxx, miny, maxy);
+      }
+    else if (mode == GAIA_FILTER_MBR_CONTAINS)
+      {
+	  /* MBR CONTAINS */
+	  bitmap =
+	      cache_filter_32 (pb->maxx, pb->minx, pb->maxy, pb->miny, maxx,
+			       minx, maxy, miny);
+      }
+    else
+      {
+	  /* MBR WITHIN */
+	  bitmap =
+	      cache_filter_32 (pb->minx, pb->maxx, pb->miny, pb->maxy, minx,
+			       maxx, miny, maxy);
+      }
+    return bitmap & pb->bitmap;
 }
 
 static struct mbr_cache *
@@ -303,16 +430,27 @@ cache_alloc (void)
     p->first = NULL;
     p->last = NULL;
     p->current = NULL;
+    p->page_count = 0;
     return p;
 }
 
+static void
+cache_reset_block_mbr (struct mbr_cache_page *pp, int i_block)
+{
+/* resetting the MBR of an empty cache block */
+    pp->block_minx[i_block] = DBL_MAX;
+    pp->block_miny[i_block] = DBL_MAX;
+    pp->block_maxx[i_block] = -DBL_MAX;
+    pp->block_maxy[i_block] = -DBL_MAX;
+}
+
 static struct mbr_cache_page *
 cache_page_alloc (void)
 {
 /* allocates and initializes a cache page */
     int i;
-    struct mbr_cache_block *pb;
     struct mbr_cache_page *p = malloc (sizeof (struct mbr_cache_page));
+    memset (p, 0, sizeof (struct mbr_cache_page));
     p->bitmap = 0x00000000;
     p->next = NULL;
     p->minx = DBL_MAX;
@@ -321,15 +459,13 @@ cache_page_alloc (void)
     p->maxy = -DBL_MAX;
     for (i = 0; i < 32; i++)
       {
-	  pb = p->blocks + i;
-	  pb->bitmap = 0x00000000;
-	  pb->minx = DBL_MAX;
-	  pb->miny = DBL_MAX;
-	  pb->maxx = -DBL_MAX;
-	  pb->maxy = DBL_MAX;
+	  p->blocks[i].bitmap = 0x00000000;
+	  cache_reset_block_mbr (p, i);
       }
     p->max_rowid = LONG64_MIN;
     p->min_rowid = LONG64_MAX;
+    p->page_no = 0;
+    p->dirty = 0;
     return p;
 }
 
@@ -355,27 +491,19 @@ static int
 cache_get_free_block (struct mbr_cache_page *pp)
 {
 /* scans a cache page, returning the index of the first available block containing a free cell */
-    int ib;
-    for (ib = 0; ib < 32; ib++)
-      {
-	  if ((pp->bitmap & cache_bitmask (ib)) == 0x00000000)
-	      return ib;
-      }
-    return -1;
+    if (pp->bitmap == 0xffffffff)
+	return -1;
+    return cache_first_bit (~(pp->bitmap));
 }
 
 static void
-cache_fix_page_bitmap (struct mbr_cache_page *pp)
+cache_fix_page_bitmap (struct mbr_cache_page *pp, int i_block)
 {
 /* updating the cache page bitmap */
-    int ib;
-    for (ib = 0; ib < 32; ib++)
+    if (pp->blocks[i_block].bitmap == 0xffffffff)
       {
-	  if (pp->blocks[ib].bitmap == 0xffffffff)
-	    {
-		/* all the cells into this block are used; marking the page bitmap */
-		pp->bitmap |= cache_bitmask (ib);
-	    }
+	  /* all the cells into this block are used; marking the page bitmap */
+	  pp->bitmap |= cache_bitmask (i_block);
       }
 }
 
@@ -383,13 +511,24 @@ static int
 cache_get_free_cell (struct mbr_cache_block *pb)
 {
 /* scans a cache block, returning the index of the first free cell */
-    int ic;
-    for (ic = 0; ic < 32; ic++)
-      {
-	  if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-	      return ic;
-      }
-    return -1;
+    if (pb->bitmap == 0xffffffff)
+	return -1;
+    return cache_first_bit (~(pb->bitmap));
+}
+
+static struct mbr_cache_page *
+cache_append_page (struct mbr_cache *p)
+{
+/* allocates a new cache page at the end of the linked list */
+    struct mbr_cache_page *pp = cache_page_alloc ();
+    p->page_count += 1;
+    pp->page_no = p->page_count;
+    if (p->first == NULL)
+	p->first = pp;
+    if (p->last != NULL)
+	p->last->next = pp;
+    p->last = pp;
+    return pp;
 }
 
 static struct mbr_cache_page *
@@ -400,9 +539,7 @@ cache_get_free_page (struct mbr_cache *p)
     if (!(p->first))
       {
 	  /* the cache is empty; so we surely need to allocate the first page */
-	  pp = cache_page_alloc ();
-	  p->first = pp;
-	  p->last = pp;
+	  pp = cache_append_page (p);
 	  p->current = pp;
 	  return pp;
       }
@@ -424,9 +561,7 @@ cache_get_free_page (struct mbr_cache *p)
 	  pp = pp->next;
       }
 /* we have to allocate a new page */
-    pp = cache_page_alloc ();
-    p->last->next = pp;
-    p->last = pp;
+    pp = cache_append_page (p);
     p->current = pp;
     return pp;
 }
@@ -440,23 +575,22 @@ cache_insert_cell (struct mbr_cache *p, sqlite3_int64 rowid, double minx,
     int ib = cache_get_free_block (pp);
     struct mbr_cache_block *pb = pp->blocks + ib;
     int ic = cache_get_free_cell (pb);
-    struct mbr_cache_cell *pc = pb->cells + ic;
-    pc->rowid = rowid;
-    pc->minx = minx;
-    pc->miny = miny;
-    pc->maxx = maxx;
-    pc->maxy = maxy;
+    pb->rowid[ic] = rowid;
+    pb->minx[ic] = minx;
+    pb->miny[ic] = miny;
+    pb->maxx[ic] = maxx;
+    pb->maxy[ic] = maxy;
 /* marking the cache cell as used into the block bitmap */
     pb->bitmap |= cache_bitmask (ic);
 /* updating the cache block MBR */
-    if (pb->minx > minx)
-	pb->minx = minx;
-    if (pb->maxx < maxx)
-	pb->maxx = maxx;
-    if (pb->miny > miny)
-	pb->miny = miny;
-    if (pb->maxy < maxy)
-	pb->maxy = maxy;
+    if (pp->block_minx[ib] > minx)
+	pp->block_minx[ib] = minx;
+    if (pp->block_maxx[ib] < maxx)
+	pp->block_maxx[ib] = maxx;
+    if (pp->block_miny[ib] > miny)
+	pp->block_miny[ib] = miny;
+    if (pp->block_maxy[ib] < maxy)
+	pp->block_maxy[ib] = maxy;
 /* updating the cache page MBR */
     if (pp->minx > minx)
 	pp->minx = minx;
@@ -467,12 +601,121 @@ cache_insert_cell (struct mbr_cache *p, sqlite3_int64 rowid, double minx,
     if (pp->maxy < maxy)
 	pp->maxy = maxy;
 /* fixing the cache page bitmap */
-    cache_fix_page_bitmap (pp);
+    cache_fix_page_bitmap (pp, ib);
 /* updating min-max rowid into the cache page */
     if (pp->min_rowid > rowid)
 	pp->min_rowid = rowid;
     if (pp->max_rowid < rowid)
 	pp->max_rowid = rowid;
+    pp->dirty = 1;
+}
+
+struct mbr_cache_load_item
+{
+/* an entity being loaded, waiting to be sorted */
+    sqlite3_int64 rowid;
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+};
+
+SPATIALITE_PRIVATE unsigned int
+splite_hilbert_index (unsigned int x, unsigned int y)
+{
+/* computing the Hilbert curve index of a cell into a 65536 x 65536 grid */
+    unsigned int n = 65536;
+    unsigned int rx;
+    unsigned int ry;
+    unsigned int s;
+    unsigned int t;
+    unsigned int d = 0;
+    for (s = n / 2; s > 0; s /= 2)
+      {
+	  rx = (x & s) > 0;
+	  ry = (y & s) > 0;
+	  d += s * s * ((3 * rx) ^ ry);
+	  if (ry == 0)
+	    {
+		/* rotating the quadrant */
+		if (rx == 1)
+		  {
+		      x = n - 1 - x;
+		      y = n - 1 - y;
+		  }
+		t = x;
+		x = y;
+		y = t;
+	    }
+      }
+    return d;
+}
+
+static int
+cache_cmp_hilbert (const void *p1, const void *p2)
+{
+/* comparison function for QSORT */
+    sqlite3_uint64 k1 = *((const sqlite3_uint64 *) p1);
+    sqlite3_uint64 k2 = *((const sqlite3_uint64 *) p2);
+    if (k1 < k2)
+	return -1;
+    if (k1 > k2)
+	return 1;
+    return 0;
+}
+
+static sqlite3_uint64 *
+cache_sort_items (struct mbr_cache_load_item *items, int count)
+{
+/*
+/ sorting the loaded entities accordingly to the Hilbert curve
+/ of their MBR centers, so that any cache block and cache page 
+/ will contain spatially near entities, and their combined MBRs
+/ will effectively allow to skip most of them while searching
+/
+/ returns an array of sort keys: the lower 32 bits of each key
+/ are the index of the corresponding item
+*/
+    int i;
+    unsigned int hilbert;
+    sqlite3_uint64 *keys;
+    double minx = DBL_MAX;
+    double miny = DBL_MAX;
+    double maxx = -DBL_MAX;
+    double maxy = -DBL_MAX;
+    double scale_x;
+    double scale_y;
+    struct mbr_cache_load_item *p;
+    for (i = 0; i < count; i++)
+      {
+	  p = items + i;
+	  if (p->minx < minx)
+	      minx = p->minx;
+	  if (p->miny < miny)
+	      miny = p->miny;
+	  if (p->maxx > maxx)
+	      maxx = p->maxx;
+	  if (p->maxy > maxy)
+	      maxy = p->maxy;
+      }
+    scale_x = (maxx > minx) ? 65535.0 / (maxx - minx) : 0.0;
+    scale_y = (maxy > miny) ? 65535.0 / (maxy - miny) : 0.0;
+    keys = malloc (sizeof (sqlite3_uint64) * count);
+    if (keys == NULL)
+	return NULL;
+    for (i = 0; i < count; i++)
+      {
+	  p = items + i;
+	  hilbert =
+	      splite_hilbert_index ((unsigned int)
+				    ((((p->minx + p->maxx) / 2.0) -
+				      minx) * scale_x),
+				    (unsigned int) ((((p->miny + p->maxy) /
+						      2.0) - miny) * scale_y));
+	  keys[i] = ((sqlite3_uint64) hilbert << 32) | (sqlite3_uint64) i;
+      }
+    qsort (keys, count, sizeof (sqlite3_uint64), cache_cmp_hilbert);
+    return keys;
 }
 
 static struct mbr_cache *
@@ -484,18 +727,19 @@ retrieving any existing entity from the main table
 */
     sqlite3_stmt *stmt;
     int ret;
+    int i;
     char *sql_statement;
-    sqlite3_int64 rowid;
-    double minx;
-    double maxx;
-    double miny;
-    double maxy;
     int v1;
     int v2;
     int v3;
     int v4;
     int v5;
     struct mbr_cache *p_cache;
+    struct mbr_cache_load_item *items = NULL;
+    struct mbr_cache_load_item *p;
+    sqlite3_uint64 *keys = NULL;
+    int count = 0;
+    int allocated = 0;
     char *xcolumn;
     char *xtable;
     xcolumn = gaiaDoubleQuotedSql (column);
@@ -516,7 +760,6 @@ retrieving any existing entity from the main table
 	  spatialite_e ("cache SQL error: %s\n", sqlite3_errmsg (handle));
 	  return NULL;
       }
-    p_cache = cache_alloc ();
     while (1)
       {
 	  ret = sqlite3_step (stmt);
@@ -533,22 +776,36 @@ retrieving any existing entity from the main table
 		    v1 = 1;
 		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
 		    v2 = 1;
-		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+		if (sqlite3_column_type (stmt, 2) == SQLITE_FLOAT)
 		    v3 = 1;
-		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+		if (sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
 		    v4 = 1;
-		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+		if (sqlite3_column_type (stmt, 4) == SQLITE_FLOAT)
 		    v5 = 1;
 		if (v1 && v2 && v3 && v4 && v5)
 		  {
-		      /* ok, this entity is a valid one; inserting them into the MBR's cache */
-		      rowid = sqlite3_column_int (stmt, 0);
-		      minx = sqlite3_column_double (stmt, 1);
-		      miny = sqlite3_column_double (stmt, 2);
-		      maxx = sqlite3_column_double (stmt, 3);
-		      maxy = sqlite3_column_double (stmt, 4);
-		      cache_insert_cell (p_cache, rowid, minx, miny, maxx,
-					 maxy);
+		      /* ok, this entity is a valid one; it will be inserted into the MBR's cache */
+		      if (count == allocated)
+			{
+			    struct mbr_cache_load_item *save = items;
+			    allocated = (allocated == 0) ? 4096 : allocated * 2;
+			    items =
+				realloc (items,
+					 sizeof (struct mbr_cache_load_item) *
+					 allocated);
+			    if (items == NULL)
+			      {
+				  free (save);
+				  sqlite3_finalize (stmt);
+				  return NULL;
+			      }
+			}
+		      p = items + count++;
+		      p->rowid = sqlite3_column_int64 (stmt, 0);
+		      p->minx = sqlite3_column_double (stmt, 1);
+		      p->miny = sqlite3_column_double (stmt, 2);
+		      p->maxx = sqlite3_column_double (stmt, 3);
+		      p->maxy = sqlite3_column_double (stmt, 4);
 		  }
 	    }
 	  else
@@ -557,150 +814,237 @@ retrieving any existing entity from the main table
 		spatialite_e ("sqlite3_step() error: %s\n",
 			      sqlite3_errmsg (handle));
 		sqlite3_finalize (stmt);
-		cache_destroy (p_cache);
+		if (items != NULL)
+		    free (items);
 		return NULL;
 	    }
       }
 /* we have now to finalize the query [memory cleanup] */
     sqlite3_finalize (stmt);
+
+/* inserting all entities into the MBR's cache, spatially clustered */
+    p_cache = cache_alloc ();
+    if (count > 0)
+	keys = cache_sort_items (items, count);
+    for (i = 0; i < count; i++)
+      {
+	  if (keys != NULL)
+	      p = items + (keys[i] & 0xffffffff);
+	  else
+	      p = items + i;	/* unsorted fallback */
+	  cache_insert_cell (p_cache, p->rowid, p->minx, p->miny, p->maxx,
+			     p->maxy);
+      }
+    if (keys != NULL)
+	free (keys);
+    if (items != NULL)
+	free (items);
     return p_cache;
 }
 
+static unsigned int
+cache_page_candidates (MbrCacheCursorPtr cursor, struct mbr_cache_page *pp)
+{
+/* returns the bitmap of the page blocks to be visited by a cursor */
+    unsigned int bitmap = 0;
+    int ib;
+    if (cursor->strategy == 2)
+      {
+	  /* spatial search */
+	  if (pp->maxx >= cursor->minx && pp->minx <= cursor->maxx
+	      && pp->maxy >= cursor->miny && pp->miny <= cursor->maxy)
+	      bitmap =
+		  cache_filter_blocks (pp, cursor->minx, cursor->miny,
+				       cursor->maxx, cursor->maxy);
+	  return bitmap;
+      }
+/* sequential scan: any not empty block */
+    for (ib = 0; ib < 32; ib++)
+      {
+	  if (pp->blocks[ib].bitmap != 0x00000000)
+	      bitmap |= cache_bitmask (ib);
+      }
+    return bitmap;
+}
+
+static void
+cache_start_search (MbrCacheCursorPtr cursor, struct mbr_cache_page *first)
+{
+/* positioning a cursor on the first cache page */
+    cursor->current_page = first;
+    cursor->current_block_index = 0;
+    cursor->current_cell_index = 0;
+    cursor->valid_cell = 0;
+    cursor->pending_cells = 0x00000000;
+    cursor->pending_blocks = 0x00000000;
+    if (first != NULL)
+	cursor->pending_blocks = cache_page_candidates (cursor, first);
+}
+
 static int
-cache_find_next_cell (struct mbr_cache_page **page, int *i_block, int *i_cell,
-		      struct mbr_cache_cell **cell)
+cache_find_next (MbrCacheCursorPtr cursor)
 {
-/* finding next cached cell */
-    struct mbr_cache_page *pp = *page;
+/* finding next cached cell, either sequentially or spatially filtered */
+    struct mbr_cache_page *pp = cursor->current_page;
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
-    int sib = *i_block;
-    int sic = *i_cell;
     while (pp)
       {
-	  for (ib = sib; ib < 32; ib++)
+	  if (cursor->pending_cells != 0x00000000)
+	    {
+		/* next candidate cell from the current block */
+		ib = cursor->current_block_index;
+		ic = cache_first_bit (cursor->pending_cells);
+		cursor->pending_cells &= ~(cache_bitmask (ic));
+		if ((pp->blocks[ib].bitmap & cache_bitmask (ic)) == 0x00000000)
+		    continue;	/* deleted in the meanwhile */
+		cursor->current_cell_index = ic;
+		cursor->valid_cell = 1;
+		return 1;
+	    }
+	  if (cursor->pending_blocks != 0x00000000)
 	    {
+		/* next candidate block from the current page */
+		ib = cache_first_bit (cursor->pending_blocks);
+		cursor->pending_blocks &= ~(cache_bitmask (ib));
+		cursor->current_block_index = ib;
 		pb = pp->blocks + ib;
-		for (ic = sic; ic < 32; ic++)
-		  {
-		      if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-			  continue;
-		      pc = pb->cells + ic;
-		      if (pc == *cell)
-			{
-			    /* this one is the current cell */
-			    continue;
-			}
-		      /* next cell found */
-		      *page = pp;
-		      *i_block = ib;
-		      *i_cell = ic;
-		      *cell = pc;
-		      return 1;
-		  }
-		sic = 0;
+		if (cursor->strategy == 2)
+		    cursor->pending_cells =
+			cache_filter_cells (pb, cursor->minx, cursor->miny,
+					    cursor->maxx, cursor->maxy,
+					    cursor->mbr_mode);
+		else
+		    cursor->pending_cells = pb->bitmap;
+		continue;
 	    }
-	  sib = 0;
+	  /* moving to the next page */
 	  pp = pp->next;
+	  cursor->current_page = pp;
+	  if (pp != NULL)
+	      cursor->pending_blocks = cache_page_candidates (cursor, pp);
       }
+    cursor->valid_cell = 0;
     return 0;
 }
 
 static int
-cache_find_next_mbr (struct mbr_cache_page **page, int *i_block, int *i_cell,
-		     struct mbr_cache_cell **cell, double minx, double miny,
-		     double maxx, double maxy, int mode)
+cache_cmp_positions (const void *p1, const void *p2)
+{
+/* comparison function for QSORT */
+    const struct mbr_cache_position *pos1 =
+	(const struct mbr_cache_position *) p1;
+    const struct mbr_cache_position *pos2 =
+	(const struct mbr_cache_position *) p2;
+    if (pos1->rowid < pos2->rowid)
+	return -1;
+    if (pos1->rowid > pos2->rowid)
+	return 1;
+    return 0;
+}
+
+static void
+cache_free_positions (MbrCacheCursorPtr cursor)
+{
+/* releasing the sequential scan positions */
+    if (cursor->positions != NULL)
+	free (cursor->positions);
+    cursor->positions = NULL;
+    cursor->n_positions = 0;
+    cursor->next_position = 0;
+}
+
+static int
+cache_start_scan (MbrCacheCursorPtr cursor, struct mbr_cache_page *first)
 {
-/* finding next cached cell */
-    struct mbr_cache_page *pp = *page;
+/*
+/ preparing a sequential scan: the cached cells are
+/ physically stored in Hilbert order, so their positions 
+/ are collected and sorted by ROWID, thus returning
+/ the rows in the same order of the main table
+*/
+    struct mbr_cache_page *pp;
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
+    struct mbr_cache_position *pos;
+    unsigned int bitmap;
+    int count = 0;
     int ib;
     int ic;
-    int sib = *i_block;
-    int sic = *i_cell;
-    int ok_mbr;
-    while (pp)
+    cache_free_positions (cursor);
+    for (pp = first; pp != NULL; pp = pp->next)
       {
-	  ok_mbr = 0;
-	  if (pp->maxx >= minx && pp->minx <= maxx && pp->maxy >= miny
-	      && pp->miny <= maxy)
-	      ok_mbr = 1;
-	  if (ok_mbr)
+	  for (ib = 0; ib < 32; ib++)
 	    {
-		for (ib = sib; ib < 32; ib++)
+		bitmap = pp->blocks[ib].bitmap;
+		while (bitmap != 0x00000000)
 		  {
-		      pb = pp->blocks + ib;
-		      ok_mbr = 0;
-		      if (pb->maxx >= minx && pb->minx <= maxx
-			  && pb->maxy >= miny && pb->miny <= maxy)
-			  ok_mbr = 1;
-		      if (ok_mbr)
-			{
-			    for (ic = sic; ic < 32; ic++)
-			      {
-				  if ((pb->bitmap & cache_bitmask (ic)) ==
-				      0x00000000)
-				      continue;
-				  pc = pb->cells + ic;
-				  ok_mbr = 0;
-				  if (mode == GAIA_FILTER_MBR_INTERSECTS)
-				    {
-					/* MBR INTERSECTS */
-					if (pc->maxx >= minx && pc->minx <= maxx
-					    && pc->maxy >= miny
-					    && pc->miny <= maxy)
-					    ok_mbr = 1;
-				    }
-				  else if (mode == GAIA_FILTER_MBR_CONTAINS)
-				    {
-					/* MBR CONTAINS */
-					if (minx >= pc->minx && maxx <= pc->maxx
-					    && miny >= pc->miny
-					    && maxy <= pc->maxy)
-					    ok_mbr = 1;
-				    }
-				  else
-				    {
-					/* MBR WITHIN */
-					if (pc->minx >= minx && pc->maxx <= maxx
-					    && pc->miny >= miny
-					    && pc->maxy <= maxy)
-					    ok_mbr = 1;
-				    }
-				  if (ok_mbr)
-				    {
-					if (pc == *cell)
-					  {
-					      /* this one is the current cell */
-					      continue;
-					  }
-					/* next cell found */
-					*page = pp;
-					*i_block = ib;
-					*i_cell = ic;
-					*cell = pc;
-					return 1;
-				    }
-			      }
-			}
-		      sic = 0;
+		      bitmap &= bitmap - 1;
+		      count++;
 		  }
 	    }
-	  sib = 0;
-	  pp = pp->next;
       }
+    if (count == 0)
+	return 1;
+    cursor->positions = malloc (sizeof (struct mbr_cache_position) * count);
+    if (cursor->positions == NULL)
+	return 0;
+    pos = cursor->positions;
+    for (pp = first; pp != NULL; pp = pp->next)
+      {
+	  for (ib = 0; ib < 32; ib++)
+	    {
+		pb = pp->blocks + ib;
+		bitmap = pb->bitmap;
+		while (bitmap != 0x00000000)
+		  {
+		      ic = cache_first_bit (bitmap);
+		      bitmap &= ~(cache_bitmask (ic));
+		      pos->rowid = pb->rowid[ic];
+		      pos->page = pp;
+		      pos->i_block = ib;
+		      pos->i_cell = ic;
+		      pos++;
+		  }
+	    }
+      }
+    qsort (cursor->positions, count, sizeof (struct mbr_cache_position),
+	   cache_cmp_positions);
+    cursor->n_positions = count;
+    return 1;
+}
+
+static int
+cache_scan_next (MbrCacheCursorPtr cursor)
+{
+/* finding next cached cell in ROWID order */
+    struct mbr_cache_position *pos;
+    struct mbr_cache_block *pb;
+    while (cursor->next_position < cursor->n_positions)
+      {
+	  pos = cursor->positions + cursor->next_position;
+	  cursor->next_position += 1;
+	  pb = pos->page->blocks + pos->i_block;
+	  if ((pb->bitmap & cache_bitmask (pos->i_cell)) == 0x00000000
+	      || pb->rowid[pos->i_cell] != pos->rowid)
+	      continue;		/* deleted in the meanwhile */
+	  cursor->current_page = pos->page;
+	  cursor->current_block_index = pos->i_block;
+	  cursor->current_cell_index = pos->i_cell;
+	  cursor->valid_cell = 1;
+	  return 1;
+      }
+    cursor->valid_cell = 0;
     return 0;
 }
 
-static struct mbr_cache_cell *
-cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid)
+static int
+cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid,
+		     struct mbr_cache_page **page, int *i_block, int *i_cell)
 {
 /* trying to find a row by rowid from the Mbr cache */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
+    unsigned int bitmap;
     int ib;
     int ic;
     while (pp)
@@ -710,13 +1054,18 @@ cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid)
 		for (ib = 0; ib < 32; ib++)
 		  {
 		      pb = pp->blocks + ib;
-		      for (ic = 0; ic < 32; ic++)
+		      bitmap = pb->bitmap;
+		      while (bitmap != 0x00000000)
 			{
-			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
-				return pc;
+			    ic = cache_first_bit (bitmap);
+			    bitmap &= ~(cache_bitmask (ic));
+			    if (pb->rowid[ic] == rowid)
+			      {
+				  *page = pp;
+				  *i_block = ib;
+				  *i_cell = ic;
+				  return 1;
+			      }
 			}
 		  }
 	    }
@@ -725,148 +1074,761 @@ cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid)
     return 0;
 }
 
+static void
+cache_update_block (struct mbr_cache_page *pp, int i_block)
+{
+/* updating the cache block MBR */
+    struct mbr_cache_block *pb;
+    unsigned int bitmap;
+    int ic;
+    pb = pp->blocks + i_block;
+    cache_reset_block_mbr (pp, i_block);
+    bitmap = pb->bitmap;
+    while (bitmap != 0x00000000)
+      {
+	  ic = cache_first_bit (bitmap);
+	  bitmap &= ~(cache_bitmask (ic));
+	  if (pp->block_minx[i_block] > pb->minx[ic])
+	      pp->block_minx[i_block] = pb->minx[ic];
+	  if (pp->block_miny[i_block] > pb->miny[ic])
+	      pp->block_miny[i_block] = pb->miny[ic];
+	  if (pp->block_maxx[i_block] < pb->maxx[ic])
+	      pp->block_maxx[i_block] = pb->maxx[ic];
+	  if (pp->block_maxy[i_block] < pb->maxy[ic])
+	      pp->block_maxy[i_block] = pb->maxy[ic];
+      }
+}
+
+static void
+cache_update_page_mbr (struct mbr_cache_page *pp)
+{
+/* updating the cache page MBR and min-max rowid */
+    struct mbr_cache_block *pb;
+    unsigned int bitmap;
+    int ib;
+    int ic;
+    pp->minx = DBL_MAX;
+    pp->miny = DBL_MAX;
+    pp->maxx = -DBL_MAX;
+    pp->maxy = -DBL_MAX;
+    pp->min_rowid = LONG64_MAX;
+    pp->max_rowid = LONG64_MIN;
+    for (ib = 0; ib < 32; ib++)
+      {
+	  pb = pp->blocks + ib;
+	  if (pb->bitmap == 0x00000000)
+	      continue;
+	  if (pp->minx > pp->block_minx[ib])
+	      pp->minx = pp->block_minx[ib];
+	  if (pp->miny > pp->block_miny[ib])
+	      pp->miny = pp->block_miny[ib];
+	  if (pp->maxx < pp->block_maxx[ib])
+	      pp->maxx = pp->block_maxx[ib];
+	  if (pp->maxy < pp->block_maxy[ib])
+	      pp->maxy = pp->block_maxy[ib];
+	  bitmap = pb->bitmap;
+	  while (bitmap != 0x00000000)
+	    {
+		ic = cache_first_bit (bitmap);
+		bitmap &= ~(cache_bitmask (ic));
+		if (pp->min_rowid > pb->rowid[ic])
+		    pp->min_rowid = pb->rowid[ic];
+		if (pp->max_rowid < pb->rowid[ic])
+		    pp->max_rowid = pb->rowid[ic];
+	    }
+      }
+}
+
 static void
 cache_update_page (struct mbr_cache_page *pp, int i_block)
 {
 /* updating the cache block and cache page MBR after a DELETE or UPDATE occurred */
+    cache_update_block (pp, i_block);
+    cache_update_page_mbr (pp);
+    pp->dirty = 1;
+}
+
+static int
+cache_delete_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid)
+{
+/* trying to delete a row identified by rowid from the Mbr cache */
+    int ib;
+    int ic;
+    if (!cache_find_by_rowid (pp, rowid, &pp, &ib, &ic))
+	return 0;
+/* marking the cell as free */
+    pp->blocks[ib].bitmap &= ~(cache_bitmask (ic));
+/* marking the block as not full */
+    pp->bitmap &= ~(cache_bitmask (ib));
+/* updating the cache block and cache page MBR */
+    cache_update_page (pp, ib);
+    return 1;
+}
+
+static int
+cache_update_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid, double minx,
+		   double miny, double maxx, double maxy)
+{
+/* trying to update a row identified by rowid from the Mbr cache */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
-/* updating the cache block MBR */
-    pb = pp->blocks + i_block;
-    pb->minx = DBL_MAX;
-    pb->miny = DBL_MAX;
-    pb->maxx = -DBL_MAX;
-    pb->maxy = -DBL_MAX;
-    for (ic = 0; ic < 32; ic++)
+    if (!cache_find_by_rowid (pp, rowid, &pp, &ib, &ic))
+	return 0;
+/* updating the cell MBR */
+    pb = pp->blocks + ib;
+    pb->minx[ic] = minx;
+    pb->miny[ic] = miny;
+    pb->maxx[ic] = maxx;
+    pb->maxy[ic] = maxy;
+/* updating the cache block and cache page MBR */
+    cache_update_page (pp, ib);
+    return 1;
+}
+
+#define MBRC_PAGE_BLOB_MAX	(32 * (4 + (32 * 40)))
+
+static int
+cache_encode_page (struct mbr_cache_page *pp, unsigned char *blob)
+{
+/* encoding a cache page as a snapshot BLOB; returns the BLOB size */
+    struct mbr_cache_block *pb;
+    unsigned int bitmap;
+    int ib;
+    int ic;
+    int endian_arch = gaiaEndianArch ();
+    unsigned char *p = blob;
+    for (ib = 0; ib < 32; ib++)
+      {
+	  /* each block: the allocation bitmap followed by any used cell */
+	  pb = pp->blocks + ib;
+	  gaiaExportU32 (p, pb->bitmap, 1, endian_arch);
+	  p += 4;
+	  bitmap = pb->bitmap;
+	  while (bitmap != 0x00000000)
+	    {
+		ic = cache_first_bit (bitmap);
+		bitmap &= ~(cache_bitmask (ic));
+		gaiaExportI64 (p, pb->rowid[ic], 1, endian_arch);
+		gaiaExport64 (p + 8, pb->minx[ic], 1, endian_arch);
+		gaiaExport64 (p + 16, pb->miny[ic], 1, endian_arch);
+		gaiaExport64 (p + 24, pb->maxx[ic], 1, endian_arch);
+		gaiaExport64 (p + 32, pb->maxy[ic], 1, endian_arch);
+		p += 40;
+	    }
+      }
+    return p - blob;
+}
+
+static int
+cache_decode_page (struct mbr_cache_page *pp, const unsigned char *blob,
+		   int size)
+{
+/* restoring a cache page from a snapshot BLOB */
+    struct mbr_cache_block *pb;
+    unsigned int bitmap;
+    int ib;
+    int ic;
+    int endian_arch = gaiaEndianArch ();
+    const unsigned char *p = blob;
+    const unsigned char *end = blob + size;
+    pp->bitmap = 0x00000000;
+    for (ib = 0; ib < 32; ib++)
+      {
+	  pb = pp->blocks + ib;
+	  pb->bitmap = 0x00000000;
+	  if (p + 4 > end)
+	      return 0;
+	  bitmap = gaiaImportU32 (p, 1, endian_arch);
+	  p += 4;
+	  pb->bitmap = bitmap;
+	  while (bitmap != 0x00000000)
+	    {
+		ic = cache_first_bit (bitmap);
+		bitmap &= ~(cache_bitmask (ic));
+		if (p + 40 > end)
+		  {
+		      pb->bitmap = 0x00000000;
+		      return 0;
+		  }
+		pb->rowid[ic] = gaiaImportI64 (p, 1, endian_arch);
+		pb->minx[ic] = gaiaImport64 (p + 8, 1, endian_arch);
+		pb->miny[ic] = gaiaImport64 (p + 16, 1, endian_arch);
+		pb->maxx[ic] = gaiaImport64 (p + 24, 1, endian_arch);
+		pb->maxy[ic] = gaiaImport64 (p + 32, 1, endian_arch);
+		p += 40;
+	    }
+	  cache_update_block (pp, ib);
+	  cache_fix_page_bitmap (pp, ib);
+      }
+    cache_update_page_mbr (pp);
+    pp->dirty = 0;
+    if (p != end)
+	return 0;
+    return 1;
+}
+
+static sqlite3_int64
+mbrc_data_version (MbrCachePtr p_vt)
+{
+/* returns the current PRAGMA data_version */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xprefix;
+    sqlite3_int64 version = -1;
+    int ret;
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    sql_statement = sqlite3_mprintf ("PRAGMA \"%s\".data_version", xprefix);
+    free (xprefix);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return -1;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+	version = sqlite3_column_int64 (stmt, 0);
+    sqlite3_finalize (stmt);
+    return version;
+}
+
+static int
+mbrc_base_max_rowid (MbrCachePtr p_vt, sqlite3_int64 * max_rowid)
+{
+/* retrieving the max ROWID from the main table */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xtable;
+    int ret;
+    int ok = 0;
+    xtable = gaiaDoubleQuotedSql (p_vt->table_name);
+    sql_statement = sqlite3_mprintf ("SELECT Max(ROWID) FROM \"%s\"", xtable);
+    free (xtable);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      {
+	  if (sqlite3_column_type (stmt, 0) == SQLITE_INTEGER)
+	      *max_rowid = sqlite3_column_int64 (stmt, 0);
+	  else
+	      *max_rowid = LONG64_MIN;	/* empty table */
+	  ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
+static int
+mbrc_read_snapshot_meta (MbrCachePtr p_vt, sqlite3_int64 * generation,
+			 int *page_count, sqlite3_int64 * max_rowid)
+{
+/* reading the snapshot header [page_no = 0] */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xprefix;
+    char *xname;
+    char *name;
+    int ret;
+    int ok = 0;
+    const unsigned char *blob;
+    int endian_arch = gaiaEndianArch ();
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql_statement =
+	sqlite3_mprintf
+	("SELECT generation, data FROM \"%s\".\"%s\" WHERE page_no = 0",
+	 xprefix, xname);
+    free (xprefix);
+    free (xname);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      {
+	  if (sqlite3_column_type (stmt, 0) == SQLITE_INTEGER
+	      && sqlite3_column_type (stmt, 1) == SQLITE_BLOB
+	      && sqlite3_column_bytes (stmt, 1) == 16)
+	    {
+		blob = sqlite3_column_blob (stmt, 1);
+		if (gaiaImportU32 (blob, 1, endian_arch) ==
+		    MBRC_SNAPSHOT_MAGIC)
+		  {
+		      *generation = sqlite3_column_int64 (stmt, 0);
+		      *page_count = gaiaImportU32 (blob + 4, 1, endian_arch);
+		      *max_rowid = gaiaImportI64 (blob + 8, 1, endian_arch);
+		      ok = 1;
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
+static int
+mbrc_read_snapshot_pages (MbrCachePtr p_vt, struct mbr_cache *cache,
+			  sqlite3_int64 generation, int page_count)
+{
+/* 
+restoring from the snapshot any cache page changed after 
+the given generation
+*/
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xprefix;
+    char *xname;
+    char *name;
+    int ret;
+    int page_no;
+    struct mbr_cache_page *pp;
+    while (cache->page_count < page_count)
+	cache_append_page (cache);
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql_statement =
+	sqlite3_mprintf ("SELECT page_no, data FROM \"%s\".\"%s\" "
+			 "WHERE page_no > 0 AND page_no <= ? AND generation > ? "
+			 "ORDER BY page_no", xprefix, xname);
+    free (xprefix);
+    free (xname);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    sqlite3_bind_int (stmt, 1, page_count);
+    sqlite3_bind_int64 (stmt, 2, generation);
+    pp = cache->first;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret != SQLITE_ROW)
+	      goto error;
+	  if (sqlite3_column_type (stmt, 1) != SQLITE_BLOB)
+	      goto error;
+	  page_no = sqlite3_column_int (stmt, 0);
+	  while (pp != NULL && pp->page_no < page_no)
+	      pp = pp->next;
+	  if (pp == NULL)
+	      goto error;
+	  if (!cache_decode_page
+	      (pp, sqlite3_column_blob (stmt, 1), sqlite3_column_bytes (stmt, 1)))
+	      goto error;
+      }
+    sqlite3_finalize (stmt);
+    cache->current = cache->first;
+    return 1;
+  error:
+    sqlite3_finalize (stmt);
+    return 0;
+}
+
+static int
+mbrc_write_snapshot (MbrCachePtr p_vt, sqlite3_int64 generation)
+{
+/* writing all the changed cache pages into the snapshot */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xprefix;
+    char *xname;
+    char *name;
+    int ret;
+    int size;
+    sqlite3_int64 max_rowid;
+    unsigned char *blob;
+    struct mbr_cache_page *pp;
+    int endian_arch = gaiaEndianArch ();
+    if (!mbrc_base_max_rowid (p_vt, &max_rowid))
+	return 0;
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    if (p_vt->snapshot_stale)
+      {
+	  /* removing any page beyond the current end of the cache */
+	  sql_statement =
+	      sqlite3_mprintf ("DELETE FROM \"%s\".\"%s\" WHERE page_no > %d",
+			       xprefix, xname, p_vt->cache->page_count);
+	  ret = sqlite3_exec (p_vt->db, sql_statement, NULL, NULL, NULL);
+	  sqlite3_free (sql_statement);
+	  if (ret != SQLITE_OK)
+	    {
+		free (xprefix);
+		free (xname);
+		return 0;
+	    }
+      }
+    sql_statement =
+	sqlite3_mprintf ("INSERT OR REPLACE INTO \"%s\".\"%s\" "
+			 "(page_no, generation, data) VALUES (?, ?, ?)",
+			 xprefix, xname);
+    free (xprefix);
+    free (xname);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    blob = malloc (MBRC_PAGE_BLOB_MAX);
+    if (blob == NULL)
+	goto error;
+    pp = p_vt->cache->first;
+    while (pp)
+      {
+	  if (pp->dirty || p_vt->snapshot_stale)
+	    {
+		size = cache_encode_page (pp, blob);
+		sqlite3_reset (stmt);
+		sqlite3_clear_bindings (stmt);
+		sqlite3_bind_int (stmt, 1, pp->page_no);
+		sqlite3_bind_int64 (stmt, 2, generation);
+		sqlite3_bind_blob (stmt, 3, blob, size, SQLITE_TRANSIENT);
+		if (sqlite3_step (stmt) != SQLITE_DONE)
+		    goto error;
+	    }
+	  pp = pp->next;
+      }
+/* updating the snapshot header */
+    gaiaExportU32 (blob, MBRC_SNAPSHOT_MAGIC, 1, endian_arch);
+    gaiaExportU32 (blob + 4, p_vt->cache->page_count, 1, endian_arch);
+    gaiaExportI64 (blob + 8, max_rowid, 1, endian_arch);
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int (stmt, 1, 0);
+    sqlite3_bind_int64 (stmt, 2, generation);
+    sqlite3_bind_blob (stmt, 3, blob, 16, SQLITE_TRANSIENT);
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+	goto error;
+    sqlite3_finalize (stmt);
+    free (blob);
+    return 1;
+  error:
+    sqlite3_finalize (stmt);
+    if (blob != NULL)
+	free (blob);
+    return 0;
+}
+
+static void
+mbrc_drop_cache (MbrCachePtr p_vt)
+{
+/* discarding the MBR cache; it will be lazily loaded again */
+    if (p_vt->cache)
+	cache_destroy (p_vt->cache);
+    p_vt->cache = NULL;
+    p_vt->generation = 0;
+    p_vt->snapshot_stale = 0;
+    p_vt->loaded_in_transaction = 0;
+    p_vt->undo_count = 0;
+    p_vt->n_savepoints = 0;
+}
+
+static void
+mbrc_load_cache (MbrCachePtr p_vt, sqlite3_int64 inserted_rowid)
+{
+/* 
+loading the MBR cache - from the persistent snapshot whenever
+it is still valid, otherwise from the main table
+
+inserted_rowid identifies a row just inserted into the main
+table but not yet into the cache (loading on behalf of INSERT)
+*/
+    sqlite3_int64 generation;
+    int page_count;
+    sqlite3_int64 snapshot_max;
+    sqlite3_int64 base_max;
+    struct mbr_cache_page *pp;
+    mbrc_drop_cache (p_vt);
+    p_vt->data_version = mbrc_data_version (p_vt);
+    if (p_vt->in_transaction || !sqlite3_get_autocommit (p_vt->db))
+	p_vt->loaded_in_transaction = 1;
+    if (p_vt->snapshot)
+      {
+	  if (mbrc_read_snapshot_meta
+	      (p_vt, &generation, &page_count, &snapshot_max))
+	    {
+		p_vt->generation = generation;
+		if (mbrc_base_max_rowid (p_vt, &base_max))
+		  {
+		      if (base_max == snapshot_max
+			  || (inserted_rowid != LONG64_MIN
+			      && inserted_rowid == base_max
+			      && inserted_rowid > snapshot_max))
+			{
+			    /* the snapshot is still valid */
+			    p_vt->cache = cache_alloc ();
+			    if (mbrc_read_snapshot_pages
+				(p_vt, p_vt->cache, 0, page_count))
+				return;
+			    cache_destroy (p_vt->cache);
+			    p_vt->cache = NULL;
+			}
+		  }
+	    }
+      }
+    p_vt->cache = cache_load (p_vt->db, p_vt->table_name, p_vt->column_name);
+    if (p_vt->cache != NULL && p_vt->snapshot)
+      {
+	  /* the whole snapshot has to be written again */
+	  p_vt->snapshot_stale = 1;
+	  pp = p_vt->cache->first;
+	  while (pp)
+	    {
+		pp->dirty = 1;
+		pp = pp->next;
+	    }
+      }
+}
+
+static void
+mbrc_refresh_cache (MbrCachePtr p_vt)
+{
+/* 
+checking if the MBR cache is still in sync with the snapshot,
+possibly changed by some other connection in the meanwhile
+*/
+    sqlite3_int64 version;
+    sqlite3_int64 generation;
+    int page_count;
+    sqlite3_int64 snapshot_max;
+    sqlite3_int64 base_max;
+    if (p_vt->cache == NULL || p_vt->n_cursors > 0 || p_vt->in_transaction)
+	return;
+    if (p_vt->loaded_in_transaction && sqlite3_get_autocommit (p_vt->db))
+      {
+	  /* loaded within some transaction that has been closed in the meanwhile */
+	  mbrc_drop_cache (p_vt);
+	  return;
+      }
+    if (!p_vt->snapshot)
+	return;
+    version = mbrc_data_version (p_vt);
+    if (version == p_vt->data_version)
+	return;
+    p_vt->data_version = version;
+    if (!mbrc_read_snapshot_meta (p_vt, &generation, &page_count, &snapshot_max))
+      {
+	  mbrc_drop_cache (p_vt);
+	  return;
+      }
+    if (generation == p_vt->generation)
+	return;
+    if (generation < p_vt->generation || p_vt->snapshot_stale
+	|| page_count < p_vt->cache->page_count)
+      {
+	  mbrc_drop_cache (p_vt);
+	  return;
+      }
+    if (!mbrc_base_max_rowid (p_vt, &base_max) || base_max != snapshot_max)
+      {
+	  mbrc_drop_cache (p_vt);
+	  return;
+      }
+/* reloading just the pages changed by the other connection */
+    if (!mbrc_read_snapshot_pages
+	(p_vt, p_vt->cache, p_vt->generation, page_count))
+      {
+	  mbrc_drop_cache (p_vt);
+	  return;
+      }
+    p_vt->generation = generation;
+}
+
+static int
+mbrc_undo_push (MbrCachePtr p_vt, int op, sqlite3_int64 rowid,
+		struct mbr_cache_page *pp, int i_block, int i_cell)
+{
+/* appending an entry into the undo log */
+    struct mbr_cache_undo *p_undo;
+    if (p_vt->undo_count == p_vt->undo_max)
       {
-	  if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-	      continue;
-	  pc = pb->cells + ic;
-	  if (pb->minx > pc->minx)
-	      pb->minx = pc->minx;
-	  if (pb->miny > pc->miny)
-	      pb->miny = pc->miny;
-	  if (pb->maxx < pc->maxx)
-	      pb->maxx = pc->maxx;
-	  if (pb->maxy < pc->maxy)
-	      pb->maxy = pc->maxy;
+	  int max = (p_vt->undo_max == 0) ? 256 : p_vt->undo_max * 2;
+	  p_undo = realloc (p_vt->undo, sizeof (struct mbr_cache_undo) * max);
+	  if (p_undo == NULL)
+	      return 0;
+	  p_vt->undo = p_undo;
+	  p_vt->undo_max = max;
       }
-/* updating the cache page MBR */
-    pp->minx = DBL_MAX;
-    pp->miny = DBL_MAX;
-    pp->maxx = -DBL_MAX;
-    pp->maxy = -DBL_MAX;
-    pp->min_rowid = LONG64_MAX;
-    pp->max_rowid = LONG64_MIN;
-    for (ib = 0; ib < 32; ib++)
+    p_undo = p_vt->undo + p_vt->undo_count;
+    p_undo->op = op;
+    p_undo->rowid = rowid;
+    if (pp != NULL)
       {
-	  pb = pp->blocks + ib;
-	  for (ic = 0; ic < 32; ic++)
+	  /* saving the previous MBR */
+	  struct mbr_cache_block *pb = pp->blocks + i_block;
+	  p_undo->minx = pb->minx[i_cell];
+	  p_undo->miny = pb->miny[i_cell];
+	  p_undo->maxx = pb->maxx[i_cell];
+	  p_undo->maxy = pb->maxy[i_cell];
+      }
+    p_vt->undo_count += 1;
+    return 1;
+}
+
+static void
+mbrc_undo (MbrCachePtr p_vt, int mark)
+{
+/* reverting the MBR cache by replaying the undo log backwards */
+    struct mbr_cache_undo *p_undo;
+    while (p_vt->undo_count > mark)
+      {
+	  p_vt->undo_count -= 1;
+	  p_undo = p_vt->undo + p_vt->undo_count;
+	  if (p_vt->cache == NULL)
+	      continue;
+	  switch (p_undo->op)
 	    {
-		if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-		    continue;
-		pc = pb->cells + ic;
-		if (pp->minx > pc->minx)
-		    pp->minx = pc->minx;
-		if (pp->miny > pc->miny)
-		    pp->miny = pc->miny;
-		if (pp->maxx < pc->maxx)
-		    pp->maxx = pc->maxx;
-		if (pp->maxy < pc->maxy)
-		    pp->maxy = pc->maxy;
-		if (pp->min_rowid > pc->rowid)
-		    pp->min_rowid = pc->rowid;
-		if (pp->max_rowid < pc->rowid)
-		    pp->max_rowid = pc->rowid;
-	    }
+	    case MBRC_UNDO_INSERT:
+		cache_delete_cell (p_vt->cache->first, p_undo->rowid);
+		break;
+	    case MBRC_UNDO_DELETE:
+		cache_insert_cell (p_vt->cache, p_undo->rowid, p_undo->minx,
+				   p_undo->miny, p_undo->maxx, p_undo->maxy);
+		break;
+	    case MBRC_UNDO_UPDATE:
+		cache_update_cell (p_vt->cache->first, p_undo->rowid,
+				   p_undo->minx, p_undo->miny, p_undo->maxx,
+				   p_undo->maxy);
+		break;
+	    };
       }
 }
 
-static int
-cache_delete_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid)
+static void
+mbrc_free_vtab (MbrCachePtr p_vt)
 {
-/* trying to delete a row identified by rowid from the Mbr cache */
-    struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
-    int ib;
-    int ic;
+/* memory cleanup; destroying the virtual table struct */
+    if (p_vt->cache)
+	cache_destroy (p_vt->cache);
+    if (p_vt->table_name)
+	sqlite3_free (p_vt->table_name);
+    if (p_vt->column_name)
+	sqlite3_free (p_vt->column_name);
+    if (p_vt->db_prefix)
+	sqlite3_free (p_vt->db_prefix);
+    if (p_vt->vtable_name)
+	sqlite3_free (p_vt->vtable_name);
+    if (p_vt->undo)
+	free (p_vt->undo);
+    if (p_vt->savepoints)
+	free (p_vt->savepoints);
+    sqlite3_free (p_vt);
+}
+
+static void
+mbrc_clear_dirty (struct mbr_cache *cache)
+{
+/* marking all cache pages as saved into the snapshot */
+    struct mbr_cache_page *pp = cache->first;
     while (pp)
       {
-	  if (rowid >= pp->min_rowid && rowid <= pp->max_rowid)
-	    {
-		for (ib = 0; ib < 32; ib++)
-		  {
-		      pb = pp->blocks + ib;
-		      for (ic = 0; ic < 32; ic++)
-			{
-			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
-			      {
-				  /* marking the cell as free */
-				  pb->bitmap &= ~(cache_bitmask (ic));
-				  /* marking the block as not full */
-				  pp->bitmap &= ~(cache_bitmask (ib));
-				  /* updating the cache block and cache page MBR */
-				  cache_update_page (pp, ib);
-				  return 1;
-			      }
-			}
-		  }
-	    }
+	  pp->dirty = 0;
 	  pp = pp->next;
       }
-    return 0;
 }
 
 static int
-cache_update_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid, double minx,
-		   double miny, double maxx, double maxy)
+mbrc_create_snapshot (MbrCachePtr p_vt, char **pzErr)
 {
-/* trying to update a row identified by rowid from the Mbr cache */
-    struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
-    int ib;
-    int ic;
-    while (pp)
+/* creating the snapshot table and storing the initial snapshot */
+    char *sql_statement;
+    char *xprefix;
+    char *xname;
+    char *name;
+    char *err_msg = NULL;
+    int ret;
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql_statement =
+	sqlite3_mprintf ("CREATE TABLE IF NOT EXISTS \"%s\".\"%s\" ("
+			 "page_no INTEGER PRIMARY KEY, "
+			 "generation INTEGER NOT NULL, data BLOB NOT NULL)",
+			 xprefix, xname);
+    free (xprefix);
+    free (xname);
+    ret = sqlite3_exec (p_vt->db, sql_statement, NULL, NULL, &err_msg);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
       {
-	  if (rowid >= pp->min_rowid && rowid <= pp->max_rowid)
-	    {
-		for (ib = 0; ib < 32; ib++)
-		  {
-		      pb = pp->blocks + ib;
-		      for (ic = 0; ic < 32; ic++)
-			{
-			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
-				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
-			      {
-				  /* updating the cell MBR */
-				  pc->minx = minx;
-				  pc->miny = miny;
-				  pc->maxx = maxx;
-				  pc->maxy = maxy;
-				  /* updating the cache block and cache page MBR */
-				  cache_update_page (pp, ib);
-				  return 1;
-			      }
-			}
-		  }
-	    }
-	  pp = pp->next;
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[MbrCache module] CREATE VIRTUAL: unable to create the snapshot table: %s",
+	       err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
       }
-    return 0;
+    p_vt->snapshot = 1;
+    p_vt->cache = cache_load (p_vt->db, p_vt->table_name, p_vt->column_name);
+    if (p_vt->cache == NULL)
+	return 1;
+    p_vt->snapshot_stale = 1;
+    if (!mbrc_write_snapshot (p_vt, 1))
+      {
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[MbrCache module] CREATE VIRTUAL: unable to store the snapshot: %s",
+	       sqlite3_errmsg (p_vt->db));
+	  return 0;
+      }
+    mbrc_clear_dirty (p_vt->cache);
+    p_vt->snapshot_stale = 0;
+    p_vt->generation = 1;
+    p_vt->data_version = mbrc_data_version (p_vt);
+    return 1;
 }
 
 static int
-mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
-	     sqlite3_vtab ** ppVTab, char **pzErr)
+mbrc_check_snapshot (MbrCachePtr p_vt)
+{
+/* checking if the snapshot table exists (not for legacy MbrCaches) */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    char *xprefix;
+    int ret;
+    int exists = 0;
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    sql_statement =
+	sqlite3_mprintf ("SELECT name FROM \"%s\".sqlite_master "
+			 "WHERE type = 'table' AND Lower(name) = Lower(?)",
+			 xprefix);
+    free (xprefix);
+    ret =
+	sqlite3_prepare_v2 (p_vt->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    sql_statement = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    sqlite3_bind_text (stmt, 1, sql_statement, strlen (sql_statement),
+		       sqlite3_free);
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+	exists = 1;
+    sqlite3_finalize (stmt);
+    return exists;
+}
+
+static int
+mbrc_create_vtab (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+		  sqlite3_vtab ** ppVTab, char **pzErr, int create)
 {
-/* creates the virtual table and caches related Geometry column */
+/* creates or connects the virtual table and caches related Geometry column */
     int err;
     int ret;
     int i;
@@ -899,6 +1861,20 @@ mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt->table_name = NULL;
     p_vt->column_name = NULL;
     p_vt->cache = NULL;
+    p_vt->db_prefix = NULL;
+    p_vt->vtable_name = NULL;
+    p_vt->snapshot = 0;
+    p_vt->snapshot_stale = 0;
+    p_vt->generation = 0;
+    p_vt->data_version = -1;
+    p_vt->n_cursors = 0;
+    p_vt->in_transaction = 0;
+    p_vt->loaded_in_transaction = 0;
+    p_vt->undo = NULL;
+    p_vt->undo_count = 0;
+    p_vt->undo_max = 0;
+    p_vt->savepoints = NULL;
+    p_vt->n_savepoints = 0;
 /* checking for table_name and geo_column_name */
     if (argc == 5)
       {
@@ -1015,16 +1991,43 @@ mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  return SQLITE_ERROR;
       }
     sqlite3_free (sql_statement);
+/* setting up the persistent snapshot */
+    len = strlen (argv[1]);
+    p_vt->db_prefix = sqlite3_malloc (len + 1);
+    strcpy (p_vt->db_prefix, argv[1]);
+    len = strlen (vtable);
+    p_vt->vtable_name = sqlite3_malloc (len + 1);
+    strcpy (p_vt->vtable_name, vtable);
+    if (xvtable)
+	free (xvtable);
+    if (create)
+      {
+	  if (!mbrc_create_snapshot (p_vt, pzErr))
+	    {
+		mbrc_free_vtab (p_vt);
+		return SQLITE_ERROR;
+	    }
+      }
+    else
+	p_vt->snapshot = mbrc_check_snapshot (p_vt);
     *ppVTab = (sqlite3_vtab *) p_vt;
     return SQLITE_OK;
 }
 
+static int
+mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+	     sqlite3_vtab ** ppVTab, char **pzErr)
+{
+/* creates the virtual table and its snapshot table */
+    return mbrc_create_vtab (db, pAux, argc, argv, ppVTab, pzErr, 1);
+}
+
 static int
 mbrc_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	      sqlite3_vtab ** ppVTab, char **pzErr)
 {
-/* connects the virtual table - simply aliases mbrc_create() */
-    return mbrc_create (db, pAux, argc, argv, ppVTab, pzErr);
+/* connects the virtual table */
+    return mbrc_create_vtab (db, pAux, argc, argv, ppVTab, pzErr, 0);
 }
 
 static int
@@ -1096,75 +2099,110 @@ static int
 mbrc_disconnect (sqlite3_vtab * pVTab)
 {
 /* disconnects the virtual table */
-    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
-    if (p_vt->cache)
-	cache_destroy (p_vt->cache);
-    if (p_vt->table_name)
-	sqlite3_free (p_vt->table_name);
-    if (p_vt->column_name)
-	sqlite3_free (p_vt->column_name);
-    sqlite3_free (p_vt);
+    mbrc_free_vtab ((MbrCachePtr) pVTab);
     return SQLITE_OK;
 }
 
 static int
 mbrc_destroy (sqlite3_vtab * pVTab)
 {
-/* destroys the virtual table - simply aliases mbrc_disconnect() */
-    return mbrc_disconnect (pVTab);
+/* destroys the virtual table and its snapshot table */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    char *sql_statement;
+    char *xprefix;
+    char *xname;
+    char *name;
+    int ret;
+    if (p_vt->db_prefix != NULL && p_vt->vtable_name != NULL)
+      {
+	  xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+	  name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+	  xname = gaiaDoubleQuotedSql (name);
+	  sqlite3_free (name);
+	  sql_statement =
+	      sqlite3_mprintf ("DROP TABLE IF EXISTS \"%s\".\"%s\"", xprefix,
+			       xname);
+	  free (xprefix);
+	  free (xname);
+	  ret = sqlite3_exec (p_vt->db, sql_statement, NULL, NULL, NULL);
+	  sqlite3_free (sql_statement);
+	  if (ret != SQLITE_OK)
+	      return ret;
+      }
+    mbrc_free_vtab (p_vt);
+    return SQLITE_OK;
+}
+
+static int
+mbrc_rename (sqlite3_vtab * pVTab, const char *zNew)
+{
+/* renaming the virtual table: the snapshot table is renamed as well */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    char *sql_statement;
+    char *xprefix;
+    char *xold;
+    char *xnew;
+    char *name;
+    int ret;
+    int len;
+    if (!p_vt->snapshot)
+	return SQLITE_OK;
+    xprefix = gaiaDoubleQuotedSql (p_vt->db_prefix);
+    name = sqlite3_mprintf ("%s_snapshot", p_vt->vtable_name);
+    xold = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    name = sqlite3_mprintf ("%s_snapshot", zNew);
+    xnew = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql_statement =
+	sqlite3_mprintf ("ALTER TABLE \"%s\".\"%s\" RENAME TO \"%s\"",
+			 xprefix, xold, xnew);
+    free (xprefix);
+    free (xold);
+    free (xnew);
+    ret = sqlite3_exec (p_vt->db, sql_statement, NULL, NULL, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return ret;
+    sqlite3_free (p_vt->vtable_name);
+    len = strlen (zNew);
+    p_vt->vtable_name = sqlite3_malloc (len + 1);
+    strcpy (p_vt->vtable_name, zNew);
+    return SQLITE_OK;
 }
 
 static void
-mbrc_read_row_unfiltered (MbrCacheCursorPtr cursor)
+mbrc_read_row (MbrCacheCursorPtr cursor)
 {
-/* trying to read the next row from the Mbr cache - unfiltered mode */
-    struct mbr_cache_page *page = cursor->current_page;
-    struct mbr_cache_cell *cell = cursor->current_cell;
-    int i_block = cursor->current_block_index;
-    int i_cell = cursor->current_cell_index;
-    if (cache_find_next_cell (&page, &i_block, &i_cell, &cell))
+/* trying to read the next row from the Mbr cache - unfiltered or spatially filter mode */
+    if (cursor->positions != NULL)
       {
-	  cursor->current_page = page;
-	  cursor->current_block_index = i_block;
-	  cursor->current_cell_index = i_cell;
-	  cursor->current_cell = cell;
+	  if (!cache_scan_next (cursor))
+	      cursor->eof = 1;
+	  return;
       }
-    else
+    if (!cache_find_next (cursor))
 	cursor->eof = 1;
 }
 
 static void
-mbrc_read_row_filtered (MbrCacheCursorPtr cursor)
+mbrc_read_row_by_rowid (MbrCacheCursorPtr cursor, sqlite3_int64 rowid)
 {
-/* trying to read the next row from the Mbr cache - spatially filter mode */
-    struct mbr_cache_page *page = cursor->current_page;
-    struct mbr_cache_cell *cell = cursor->current_cell;
-    int i_block = cursor->current_block_index;
-    int i_cell = cursor->current_cell_index;
-    if (cache_find_next_mbr
-	(&page, &i_block, &i_cell, &cell, cursor->minx, cursor->miny,
-	 cursor->maxx, cursor->maxy, cursor->mbr_mode))
+/* trying to find a row by rowid from the Mbr cache */
+    struct mbr_cache_page *page;
+    int i_block;
+    int i_cell;
+    if (cache_find_by_rowid
+	(cursor->pVtab->cache->first, rowid, &page, &i_block, &i_cell))
       {
 	  cursor->current_page = page;
 	  cursor->current_block_index = i_block;
 	  cursor->current_cell_index = i_cell;
-	  cursor->current_cell = cell;
+	  cursor->valid_cell = 1;
       }
-    else
-	cursor->eof = 1;
-}
-
-static void
-mbrc_read_row_by_rowid (MbrCacheCursorPtr cursor, sqlite3_int64 rowid)
-{
-/* trying to find a row by rowid from the Mbr cache */
-    struct mbr_cache_cell *cell =
-	cache_find_by_rowid (cursor->pVtab->cache->first, rowid);
-    if (cell)
-	cursor->current_cell = cell;
     else
       {
-	  cursor->current_cell = NULL;
+	  cursor->valid_cell = 0;
 	  cursor->eof = 1;
       }
 }
@@ -1179,20 +2217,27 @@ mbrc_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
     if (cursor == NULL)
 	return SQLITE_ERROR;
     cursor->pVtab = p_vt;
+    cursor->positions = NULL;
+    cursor->n_positions = 0;
+    cursor->next_position = 0;
     if (p_vt->error)
       {
 	  cursor->eof = 1;
 	  *ppCursor = (sqlite3_vtab_cursor *) cursor;
 	  return SQLITE_OK;
       }
+    mbrc_refresh_cache (p_vt);
     if (!(p_vt->cache))
-	p_vt->cache =
-	    cache_load (p_vt->db, p_vt->table_name, p_vt->column_name);
-    cursor->current_page = cursor->pVtab->cache->first;
-    cursor->current_block_index = 0;
-    cursor->current_cell_index = 0;
-    cursor->current_cell = NULL;
-    cursor->eof = 0;
+	mbrc_load_cache (p_vt, LONG64_MIN);
+    p_vt->n_cursors += 1;
+    cursor->strategy = 0;
+    cache_start_search (cursor, NULL);
+    cursor->eof = 1;
+    if (p_vt->cache != NULL)
+      {
+	  cache_start_search (cursor, p_vt->cache->first);
+	  cursor->eof = 0;
+      }
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
     return SQLITE_OK;
 }
@@ -1201,6 +2246,10 @@ static int
 mbrc_close (sqlite3_vtab_cursor * pCursor)
 {
 /* closing the cursor */
+    MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
+    if (!(cursor->pVtab->error))
+	cursor->pVtab->n_cursors -= 1;
+    cache_free_positions (cursor);
     sqlite3_free (pCursor);
     return SQLITE_OK;
 }
@@ -1213,21 +2262,28 @@ mbrc_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
     if (idxStr || argc)
 	idxStr = idxStr;	/* unused arg warning suppression */
-    if (cursor->pVtab->error)
+    if (cursor->pVtab->error || cursor->pVtab->cache == NULL)
       {
 	  cursor->eof = 1;
 	  return SQLITE_OK;
       }
-    cursor->current_page = cursor->pVtab->cache->first;
-    cursor->current_block_index = 0;
-    cursor->current_cell_index = 0;
-    cursor->current_cell = NULL;
-    cursor->eof = 0;
     cursor->strategy = idxNum;
+    cache_start_search (cursor, NULL);
+    cache_free_positions (cursor);
+    cursor->eof = 0;
     if (idxNum == 0)
       {
 	  /* unfiltered mode */
-	  mbrc_read_row_unfiltered (cursor);
+	  cache_start_search (cursor, cursor->pVtab->cache->first);
+	  if (cache_start_scan (cursor, cursor->pVtab->cache->first)
+	      && cursor->positions == NULL)
+	    {
+		/* empty cache */
+		cursor->eof = 1;
+		return SQLITE_OK;
+	    }
+	  /* on allocation failure the physical order will be used */
+	  mbrc_read_row (cursor);
 	  return SQLITE_OK;
       }
     if (idxNum == 1)
@@ -1265,7 +2321,9 @@ mbrc_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 			    cursor->maxx = maxx;
 			    cursor->maxy = maxy;
 			    cursor->mbr_mode = mode;
-			    mbrc_read_row_filtered (cursor);
+			    cache_start_search (cursor,
+						cursor->pVtab->cache->first);
+			    mbrc_read_row (cursor);
 			}
 		      else
 			  cursor->eof = 1;
@@ -1288,10 +2346,8 @@ mbrc_next (sqlite3_vtab_cursor * pCursor)
 	  cursor->eof = 1;
 	  return SQLITE_OK;
       }
-    if (cursor->strategy == 0)
-	mbrc_read_row_unfiltered (cursor);
-    else if (cursor->strategy == 2)
-	mbrc_read_row_filtered (cursor);
+    if (cursor->strategy == 0 || cursor->strategy == 2)
+	mbrc_read_row (cursor);
     else
 	cursor->eof = 1;
     return SQLITE_OK;
@@ -1311,30 +2367,29 @@ mbrc_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 {
 /* fetching value for the Nth column */
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
-    if (!(cursor->current_cell))
+    struct mbr_cache_block *pb;
+    int ic;
+    if (!(cursor->valid_cell))
 	sqlite3_result_null (pContext);
     else
       {
+	  pb = cursor->current_page->blocks + cursor->current_block_index;
+	  ic = cursor->current_cell_index;
 	  if (column == 0)
 	    {
 		/* the PRIMARY KEY column */
-		sqlite3_result_int64 (pContext, cursor->current_cell->rowid);
+		sqlite3_result_int64 (pContext, pb->rowid[ic]);
 	    }
 	  if (column == 1)
 	    {
 		/* the MBR column */
 		char *envelope = sqlite3_mprintf ("POLYGON(("
 						  "%1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f))",
-						  cursor->current_cell->minx,
-						  cursor->current_cell->miny,
-						  cursor->current_cell->maxx,
-						  cursor->current_cell->miny,
-						  cursor->current_cell->maxx,
-						  cursor->current_cell->maxy,
-						  cursor->current_cell->minx,
-						  cursor->current_cell->maxy,
-						  cursor->current_cell->minx,
-						  cursor->current_cell->miny);
+						  pb->minx[ic], pb->miny[ic],
+						  pb->maxx[ic], pb->miny[ic],
+						  pb->maxx[ic], pb->maxy[ic],
+						  pb->minx[ic], pb->maxy[ic],
+						  pb->minx[ic], pb->miny[ic]);
 		sqlite3_result_text (pContext, envelope, strlen (envelope),
 				     sqlite3_free);
 	    }
@@ -1347,7 +2402,14 @@ mbrc_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
 {
 /* fetching the ROWID */
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
-    *pRowid = cursor->current_cell->rowid;
+    struct mbr_cache_block *pb;
+    if (!(cursor->valid_cell))
+      {
+	  *pRowid = 0;
+	  return SQLITE_OK;
+      }
+    pb = cursor->current_page->blocks + cursor->current_block_index;
+    *pRowid = pb->rowid[cursor->current_cell_index];
     return SQLITE_OK;
 }
 
@@ -1366,20 +2428,38 @@ mbrc_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
     int mode;
     int illegal = 0;
     MbrCachePtr p_vtab = (MbrCachePtr) pVTab;
+    struct mbr_cache_page *page;
+    int i_block;
+    int i_cell;
     if (pRowid)
 	pRowid = pRowid;	/* unused arg warning suppression */
     if (p_vtab->error)
 	return SQLITE_OK;
     if (!(p_vtab->cache))
-	p_vtab->cache =
-	    cache_load (p_vtab->db, p_vtab->table_name, p_vtab->column_name);
+      {
+	  rowid = LONG64_MIN;
+	  if (argc == 4 && sqlite3_value_type (argv[0]) == SQLITE_NULL
+	      && sqlite3_value_type (argv[2]) == SQLITE_INTEGER)
+	      rowid = sqlite3_value_int64 (argv[2]);
+	  mbrc_load_cache (p_vtab, rowid);
+	  if (!(p_vtab->cache))
+	      return SQLITE_ERROR;
+      }
     if (argc == 1)
       {
 	  /* performing a DELETE */
 	  if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER)
 	    {
 		rowid = sqlite3_value_int64 (argv[0]);
-		cache_delete_cell (p_vtab->cache->first, rowid);
+		if (cache_find_by_rowid
+		    (p_vtab->cache->first, rowid, &page, &i_block, &i_cell))
+		  {
+		      if (!mbrc_undo_push
+			  (p_vtab, MBRC_UNDO_DELETE, rowid, page, i_block,
+			   i_cell))
+			  return SQLITE_NOMEM;
+		      cache_delete_cell (page, rowid);
+		  }
 	    }
 	  else
 	      illegal = 1;
@@ -1405,11 +2485,17 @@ mbrc_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 				  if (mode == GAIA_FILTER_MBR_DECLARE)
 				    {
 					if (!cache_find_by_rowid
-					    (p_vtab->cache->first, rowid))
-					    cache_insert_cell (p_vtab->cache,
-							       rowid, minx,
-							       miny, maxx,
-							       maxy);
+					    (p_vtab->cache->first, rowid,
+					     &page, &i_block, &i_cell))
+					  {
+					      if (!mbrc_undo_push
+						  (p_vtab, MBRC_UNDO_INSERT,
+						   rowid, NULL, 0, 0))
+						  return SQLITE_NOMEM;
+					      cache_insert_cell
+						  (p_vtab->cache, rowid, minx,
+						   miny, maxx, maxy);
+					  }
 				    }
 				  else
 				      illegal = 1;
@@ -1440,9 +2526,21 @@ mbrc_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 				 &mode))
 			      {
 				  if (mode == GAIA_FILTER_MBR_DECLARE)
-				      cache_update_cell (p_vtab->cache->first,
-							 rowid, minx, miny,
-							 maxx, maxy);
+				    {
+					if (cache_find_by_rowid
+					    (p_vtab->cache->first, rowid,
+					     &page, &i_block, &i_cell))
+					  {
+					      if (!mbrc_undo_push
+						  (p_vtab, MBRC_UNDO_UPDATE,
+						   rowid, page, i_block,
+						   i_cell))
+						  return SQLITE_NOMEM;
+					      cache_update_cell (page, rowid,
+								 minx, miny,
+								 maxx, maxy);
+					  }
+				    }
 				  else
 				      illegal = 1;
 			      }
@@ -1465,35 +2563,139 @@ static int
 mbrc_begin (sqlite3_vtab * pVTab)
 {
 /* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (p_vt->error)
+	return SQLITE_OK;
+    mbrc_refresh_cache (p_vt);
+    p_vt->in_transaction = 1;
+    p_vt->undo_count = 0;
+    p_vt->n_savepoints = 0;
     return SQLITE_OK;
 }
 
 static int
 mbrc_sync (sqlite3_vtab * pVTab)
 {
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+/* SYNC: writing all the changed cache pages into the snapshot */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    struct mbr_cache_page *pp;
+    int dirty = 0;
+    if (p_vt->error || !(p_vt->snapshot) || p_vt->cache == NULL)
+	return SQLITE_OK;
+    pp = p_vt->cache->first;
+    while (pp)
+      {
+	  if (pp->dirty)
+	    {
+		dirty = 1;
+		break;
+	    }
+	  pp = pp->next;
+      }
+    if (!dirty && !(p_vt->snapshot_stale))
+	return SQLITE_OK;
+    if (!mbrc_write_snapshot (p_vt, p_vt->generation + 1))
+	return SQLITE_ERROR;
     return SQLITE_OK;
 }
 
 static int
 mbrc_commit (sqlite3_vtab * pVTab)
 {
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+/* COMMIT TRANSACTION */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    struct mbr_cache_page *pp;
+    int dirty = 0;
+    if (p_vt->error)
+	return SQLITE_OK;
+    if (p_vt->snapshot && p_vt->cache != NULL)
+      {
+	  /* the snapshot has been successfully written by mbrc_sync() */
+	  pp = p_vt->cache->first;
+	  while (pp)
+	    {
+		if (pp->dirty)
+		    dirty = 1;
+		pp->dirty = 0;
+		pp = pp->next;
+	    }
+	  if (dirty || p_vt->snapshot_stale)
+	      p_vt->generation += 1;
+	  p_vt->snapshot_stale = 0;
+      }
+    p_vt->in_transaction = 0;
+    p_vt->loaded_in_transaction = 0;
+    p_vt->undo_count = 0;
+    p_vt->n_savepoints = 0;
     return SQLITE_OK;
 }
 
 static int
 mbrc_rollback (sqlite3_vtab * pVTab)
 {
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+/* ROLLBACK TRANSACTION */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (p_vt->error)
+	return SQLITE_OK;
+    if (p_vt->loaded_in_transaction)
+      {
+	  /* the cache could contain uncommitted rows: it will be loaded again */
+	  mbrc_drop_cache (p_vt);
+      }
+    else
+	mbrc_undo (p_vt, 0);
+    p_vt->in_transaction = 0;
+    p_vt->n_savepoints = 0;
+    return SQLITE_OK;
+}
+
+static int
+mbrc_savepoint (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* SAVEPOINT: marking the current position into the undo log */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    int *p_save;
+    if (p_vt->error)
+	return SQLITE_OK;
+    p_save = realloc (p_vt->savepoints, sizeof (int) * (iSavepoint + 1));
+    if (p_save == NULL)
+	return SQLITE_NOMEM;
+    p_vt->savepoints = p_save;
+    while (p_vt->n_savepoints <= iSavepoint)
+      {
+	  /* any outer savepoint not yet known starts at the same position */
+	  p_vt->savepoints[p_vt->n_savepoints] = p_vt->undo_count;
+	  p_vt->n_savepoints += 1;
+      }
+    p_vt->savepoints[iSavepoint] = p_vt->undo_count;
+    p_vt->n_savepoints = iSavepoint + 1;
+    return SQLITE_OK;
+}
+
+static int
+mbrc_release (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* RELEASE SAVEPOINT */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (p_vt->error)
+	return SQLITE_OK;
+    if (iSavepoint < p_vt->n_savepoints)
+	p_vt->n_savepoints = iSavepoint;
+    return SQLITE_OK;
+}
+
+static int
+mbrc_rollback_to (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* ROLLBACK TO SAVEPOINT: reverting any change done after the savepoint */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (p_vt->error)
+	return SQLITE_OK;
+    if (iSavepoint < p_vt->n_savepoints)
+      {
+	  mbrc_undo (p_vt, p_vt->savepoints[iSavepoint]);
+	  p_vt->n_savepoints = iSavepoint + 1;
+      }
     return SQLITE_OK;
 }
 
@@ -1501,7 +2703,7 @@ int
 sqlite3MbrCacheInit (sqlite3 * db)
 {
     int rc = SQLITE_OK;
-    my_mbr_module.iVersion = 1;
+    my_mbr_module.iVersion = 2;
     my_mbr_module.xCreate = &mbrc_create;
     my_mbr_module.xConnect = &mbrc_connect;
     my_mbr_module.xBestIndex = &mbrc_best_index;
@@ -1520,6 +2722,10 @@ sqlite3MbrCacheInit (sqlite3 * db)
     my_mbr_module.xCommit = &mbrc_commit;
     my_mbr_module.xRollback = &mbrc_rollback;
     my_mbr_module.xFindFunction = NULL;
+    my_mbr_module.xRename = &mbrc_rename;
+    my_mbr_module.xSavepoint = &mbrc_savepoint;
+    my_mbr_module.xRelease = &mbrc_release;
+    my_mbr_module.xRollbackTo = &mbrc_rollback_to;
     sqlite3_create_module_v2 (db, "MbrCache", &my_mbr_module, NULL, 0);
     return rc;
 }
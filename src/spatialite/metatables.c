@@ -53,6 +53,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <stdio.h>
 #include <string.h>
 #include <float.h>
+#include <math.h>
 
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
@@ -78,6 +79,7 @@ struct spatial_index_str
 /* a struct to implement a linked list of spatial-indexes */
     char ValidRtree;
     char ValidCache;
+    char DropPending;
     char *TableName;
     char *ColumnName;
     struct spatial_index_str *Next;
@@ -3061,16 +3063,62 @@ upgradeGeometryTriggers (void *p_sqlite)
     return retcode;
 }
 
-SPATIALITE_PRIVATE void
-updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
+static int
+check_spatial_index_table (sqlite3 * sqlite, const char *prefix,
+			   const char *table, const char *column,
+			   const char *suffix)
 {
-/* updates triggers for some Spatial Column */
-    sqlite3 *sqlite = (sqlite3 *) p_sqlite;
+/* checking if some SpatialIndex related table does already exist */
+    char *sql_statement;
+    char *raw;
+    int ret;
+    int exists = 0;
+    char **results;
+    int rows;
+    int columns;
+    raw = sqlite3_mprintf ("%s_%s_%s%s", prefix, table, column, suffix);
+    sql_statement =
+	sqlite3_mprintf ("SELECT name FROM main.sqlite_master "
+			 "WHERE type = 'table' AND Lower(name) = Lower(%Q)",
+			 raw);
+    sqlite3_free (raw);
+    ret = sqlite3_get_table (sqlite, sql_statement, &results, &rows, &columns,
+			     NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (rows >= 1)
+	exists = 1;
+    sqlite3_free_table (results);
+    return exists;
+}
+
+static int
+check_deferred_spatial_index (sqlite3 * sqlite, const char *table,
+			      const char *column)
+{
+/* checking if some R*Tree SpatialIndex is in deferred mode */
+    return check_spatial_index_table (sqlite, "idx", table, column,
+				      "_pending");
+}
+
+static void
+update_geometry_triggers (sqlite3 * sqlite, const char *table,
+			  const char *column, int keep_rtree)
+{
+/* 
+/ updates triggers for some Spatial Column
+/
+/ an already existing R*Tree will be preserved only if keep_rtree
+/ is set (just toggling between the immediate and the deferred mode),
+/ otherwise it will be fully rebuilt
+*/
     int ret;
     int col_index;
     const char *col_dims;
     int index;
     int cached;
+    int deferred;
     int dims;
     char *txt_dims = NULL;
     int len;
@@ -3164,10 +3212,15 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 		  }
 		index = 0;
 		cached = 0;
+		deferred = 0;
 		if (col_index == 1)
 		    index = 1;
 		if (col_index == 2)
 		    cached = 1;
+		if (index && metadata_version == 3)
+		    deferred =
+			check_deferred_spatial_index (sqlite, p_table,
+						      p_column);
 
 		/* trying to delete old versions [v2.0, v2.2] triggers[if any] */
 		raw = sqlite3_mprintf ("gti_%s_%s", p_table, p_column);
@@ -3342,7 +3395,16 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 		curr_idx->ColumnName = malloc (len + 1);
 		strcpy (curr_idx->ColumnName, p_column);
 		curr_idx->ValidRtree = (char) index;
+		if (index && keep_rtree
+		    && check_spatial_index_table (sqlite, "idx", p_table,
+						  p_column, ""))
+		  {
+		      /* preserving an already existing R*Tree */
+		      curr_idx->ValidRtree = 0;
+		  }
 		curr_idx->ValidCache = (char) cached;
+		/* no R*Tree: leaving the deferred mode [if any] */
+		curr_idx->DropPending = (!index && metadata_version == 3);
 		curr_idx->Next = NULL;
 		if (!first_idx)
 		    first_idx = curr_idx;
@@ -3558,7 +3620,55 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 		if (ret != SQLITE_OK)
 		    goto error;
 
-		if (index)
+		if (index && deferred)
+		  {
+		      /* deferred RTree: just queueing the changed ROWIDs */
+		      const char *action[3] = { "INSERT", "UPDATE OF", "DELETE" };
+		      const char *prefix[3] = { "gii", "giu", "gid" };
+		      const char *row[3] = { "NEW", "NEW", "OLD" };
+		      int i;
+		      for (i = 0; i < 3; i++)
+			{
+			    raw =
+				sqlite3_mprintf ("%s_%s_%s", prefix[i],
+						 p_table, p_column);
+			    quoted_trigger = gaiaDoubleQuotedSql (raw);
+			    sqlite3_free (raw);
+			    raw =
+				sqlite3_mprintf ("idx_%s_%s_pending", p_table,
+						 p_column);
+			    quoted_rtree = gaiaDoubleQuotedSql (raw);
+			    sqlite3_free (raw);
+			    quoted_table = gaiaDoubleQuotedSql (p_table);
+			    quoted_column = gaiaDoubleQuotedSql (p_column);
+			    if (i == 1)
+				raw =
+				    sqlite3_mprintf ("%s \"%s\"", action[i],
+						     quoted_column);
+			    else
+				raw = sqlite3_mprintf ("%s", action[i]);
+			    sql_statement =
+				sqlite3_mprintf
+				("CREATE TRIGGER \"%s\" AFTER %s ON \"%s\"\n"
+				 "FOR EACH ROW BEGIN\n"
+				 "INSERT OR IGNORE INTO \"%s\" (pkid) VALUES (%s.ROWID);\nEND",
+				 quoted_trigger, raw, quoted_table,
+				 quoted_rtree, row[i]);
+			    sqlite3_free (raw);
+			    free (quoted_trigger);
+			    free (quoted_rtree);
+			    free (quoted_table);
+			    free (quoted_column);
+			    ret =
+				sqlite3_exec (sqlite, sql_statement, NULL,
+					      NULL, &errMsg);
+			    sqlite3_free (sql_statement);
+			    if (ret != SQLITE_OK)
+				goto error;
+			}
+		  }
+
+		if (index && !deferred)
 		  {
 		      /* inserting the new INSERT trigger RTree */
 		      if (metadata_version == 3)
@@ -3958,14 +4068,45 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 				       curr_idx->ColumnName);
 		quoted_rtree = gaiaDoubleQuotedSql (raw);
 		sqlite3_free (raw);
-		sql_statement = sqlite3_mprintf ("CREATE VIRTUAL TABLE \"%s\" "
-						 "USING rtree(pkid, xmin, xmax, ymin, ymax)",
-						 quoted_rtree);
+		if (check_spatial_index_table
+		    (sqlite, "idx", curr_idx->TableName,
+		     curr_idx->ColumnName, ""))
+		  {
+		      /* a stale R*Tree: it will be rebuilt from scratch */
+		      sql_statement =
+			  sqlite3_mprintf ("DELETE FROM \"%s\"", quoted_rtree);
+		  }
+		else
+		    sql_statement =
+			sqlite3_mprintf ("CREATE VIRTUAL TABLE \"%s\" "
+					 "USING rtree(pkid, xmin, xmax, ymin, ymax)",
+					 quoted_rtree);
 		free (quoted_rtree);
 		ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, &errMsg);
 		sqlite3_free (sql_statement);
 		if (ret != SQLITE_OK)
 		    goto error;
+		if (check_deferred_spatial_index
+		    (sqlite, curr_idx->TableName, curr_idx->ColumnName))
+		  {
+		      /* the rebuilt R*Tree has no pending changes */
+		      raw =
+			  sqlite3_mprintf ("idx_%s_%s_pending",
+					   curr_idx->TableName,
+					   curr_idx->ColumnName);
+		      quoted_rtree = gaiaDoubleQuotedSql (raw);
+		      sqlite3_free (raw);
+		      sql_statement =
+			  sqlite3_mprintf ("DELETE FROM main.\"%s\"",
+					   quoted_rtree);
+		      free (quoted_rtree);
+		      ret =
+			  sqlite3_exec (sqlite, sql_statement, NULL, NULL,
+					&errMsg);
+		      sqlite3_free (sql_statement);
+		      if (ret != SQLITE_OK)
+			  goto error;
+		  }
 		status = buildSpatialIndexEx (sqlite,
 					      (unsigned char
 					       *) (curr_idx->TableName),
@@ -3985,6 +4126,22 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 		      goto error;
 		  }
 	    }
+	  if (curr_idx->DropPending)
+	    {
+		/* removing the deferred mode queue [if any] */
+		raw = sqlite3_mprintf ("idx_%s_%s_pending", curr_idx->TableName,
+				       curr_idx->ColumnName);
+		quoted_rtree = gaiaDoubleQuotedSql (raw);
+		sqlite3_free (raw);
+		sql_statement =
+		    sqlite3_mprintf ("DROP TABLE IF EXISTS main.\"%s\"",
+				     quoted_rtree);
+		free (quoted_rtree);
+		ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, &errMsg);
+		sqlite3_free (sql_statement);
+		if (ret != SQLITE_OK)
+		    goto error;
+	    }
 	  if (curr_idx->ValidCache)
 	    {
 		/* building MbrCache SpatialIndex */
@@ -4030,6 +4187,14 @@ updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
 	free (p_column);
 }
 
+SPATIALITE_PRIVATE void
+updateGeometryTriggers (void *p_sqlite, const char *table, const char *column)
+{
+/* updates triggers for some Spatial Column */
+    sqlite3 *sqlite = (sqlite3 *) p_sqlite;
+    update_geometry_triggers (sqlite, table, column, 0);
+}
+
 SPATIALITE_PRIVATE void
 buildSpatialIndex (void *p_sqlite, const unsigned char *table,
 		   const char *column)
@@ -4093,6 +4258,507 @@ validateRowid (void *p_sqlite, const char *table)
     return 0;
 }
 
+struct rtree_bulk_cell
+{
+/* an R*Tree cell [bulk loading] */
+    sqlite3_int64 id;
+    float minx;
+    float maxx;
+    float miny;
+    float maxy;
+};
+
+struct rtree_bulk_loader
+{
+/* a struct supporting R*Tree bulk loading */
+    sqlite3 *sqlite;
+    sqlite3_stmt *stmt_node;
+    sqlite3_stmt *stmt_parent;
+    sqlite3_stmt *stmt_rowid;
+    int node_size;
+    int max_cells;
+    int depth;
+    unsigned char *buf;
+};
+
+/* same rounding adopted by SQLite's own R*Tree (32 bit floats) */
+#define RTREE_BULK_RNDTOWARDS	(1.0 - 1.0 / 8388608.0)
+#define RTREE_BULK_RNDAWAY	(1.0 + 1.0 / 8388608.0)
+
+static float
+rtree_bulk_value_down (double d)
+{
+/* rounding a min-coordinate towards -infinity */
+    float f = (float) d;
+    if (f > d)
+	f = (float) (d * (d < 0 ? RTREE_BULK_RNDAWAY : RTREE_BULK_RNDTOWARDS));
+    return f;
+}
+
+static float
+rtree_bulk_value_up (double d)
+{
+/* rounding a max-coordinate towards +infinity */
+    float f = (float) d;
+    if (f < d)
+	f = (float) (d * (d < 0 ? RTREE_BULK_RNDTOWARDS : RTREE_BULK_RNDAWAY));
+    return f;
+}
+
+static int
+rtree_bulk_cmp_x (const void *p1, const void *p2)
+{
+/* sorting cells by X center [STR packing] */
+    const struct rtree_bulk_cell *c1 = (const struct rtree_bulk_cell *) p1;
+    const struct rtree_bulk_cell *c2 = (const struct rtree_bulk_cell *) p2;
+    double x1 = (double) c1->minx + (double) c1->maxx;
+    double x2 = (double) c2->minx + (double) c2->maxx;
+    if (x1 < x2)
+	return -1;
+    if (x1 > x2)
+	return 1;
+    return 0;
+}
+
+static int
+rtree_bulk_cmp_y (const void *p1, const void *p2)
+{
+/* sorting cells by Y center [STR packing] */
+    const struct rtree_bulk_cell *c1 = (const struct rtree_bulk_cell *) p1;
+    const struct rtree_bulk_cell *c2 = (const struct rtree_bulk_cell *) p2;
+    double y1 = (double) c1->miny + (double) c1->maxy;
+    double y2 = (double) c2->miny + (double) c2->maxy;
+    if (y1 < y2)
+	return -1;
+    if (y1 > y2)
+	return 1;
+    return 0;
+}
+
+static void
+rtree_bulk_str_sort (struct rtree_bulk_cell *cells, int count, int max_cells)
+{
+/* Sort-Tile-Recursive ordering of a level of cells */
+    int nodes = (count + max_cells - 1) / max_cells;
+    int slices = (int) ceil (sqrt ((double) nodes));
+    int slice_size = slices * max_cells;
+    int i;
+    if (count <= max_cells)
+	return;
+    qsort (cells, count, sizeof (struct rtree_bulk_cell), rtree_bulk_cmp_x);
+    for (i = 0; i < count; i += slice_size)
+      {
+	  int n = count - i;
+	  if (n > slice_size)
+	      n = slice_size;
+	  qsort (cells + i, n, sizeof (struct rtree_bulk_cell),
+		 rtree_bulk_cmp_y);
+      }
+}
+
+static void
+rtree_bulk_export_float (unsigned char *p, float value)
+{
+/* exporting a 32 bit float (always big-endian) */
+    unsigned int bits;
+    memcpy (&bits, &value, 4);
+    *(p + 0) = (unsigned char) ((bits >> 24) & 0xff);
+    *(p + 1) = (unsigned char) ((bits >> 16) & 0xff);
+    *(p + 2) = (unsigned char) ((bits >> 8) & 0xff);
+    *(p + 3) = (unsigned char) (bits & 0xff);
+}
+
+static void
+rtree_bulk_export_int64 (unsigned char *p, sqlite3_int64 value)
+{
+/* exporting a 64 bit integer (always big-endian) */
+    int i;
+    for (i = 7; i >= 0; i--)
+      {
+	  *(p + i) = (unsigned char) (value & 0xff);
+	  value >>= 8;
+      }
+}
+
+static int
+rtree_bulk_exec_stmt (sqlite3 * sqlite, sqlite3_stmt * stmt,
+		      sqlite3_int64 key, sqlite3_int64 value)
+{
+/* executing a two-integers INSERT statement */
+    int ret;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int64 (stmt, 1, key);
+    sqlite3_bind_int64 (stmt, 2, value);
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    spatialite_e ("buildSpatialIndex error: \"%s\"\n", sqlite3_errmsg (sqlite));
+    return 0;
+}
+
+static int
+rtree_bulk_write_node (struct rtree_bulk_loader *loader, sqlite3_int64 nodeno,
+		       struct rtree_bulk_cell *cells, int count, int is_leaf,
+		       struct rtree_bulk_cell *mbr)
+{
+/* writing a single R*Tree node into the "_node" shadow table */
+    int ic;
+    int ret;
+    unsigned char *p;
+    memset (loader->buf, 0, loader->node_size);
+    if (nodeno == 1)
+      {
+	  /* the root node always stores the tree depth */
+	  *(loader->buf + 0) = (unsigned char) ((loader->depth >> 8) & 0xff);
+	  *(loader->buf + 1) = (unsigned char) (loader->depth & 0xff);
+      }
+    *(loader->buf + 2) = (unsigned char) ((count >> 8) & 0xff);
+    *(loader->buf + 3) = (unsigned char) (count & 0xff);
+    p = loader->buf + 4;
+    for (ic = 0; ic < count; ic++)
+      {
+	  struct rtree_bulk_cell *cell = cells + ic;
+	  rtree_bulk_export_int64 (p, cell->id);
+	  rtree_bulk_export_float (p + 8, cell->minx);
+	  rtree_bulk_export_float (p + 12, cell->maxx);
+	  rtree_bulk_export_float (p + 16, cell->miny);
+	  rtree_bulk_export_float (p + 20, cell->maxy);
+	  p += 24;
+	  if (ic == 0)
+	    {
+		mbr->minx = cell->minx;
+		mbr->maxx = cell->maxx;
+		mbr->miny = cell->miny;
+		mbr->maxy = cell->maxy;
+	    }
+	  else
+	    {
+		if (cell->minx < mbr->minx)
+		    mbr->minx = cell->minx;
+		if (cell->maxx > mbr->maxx)
+		    mbr->maxx = cell->maxx;
+		if (cell->miny < mbr->miny)
+		    mbr->miny = cell->miny;
+		if (cell->maxy > mbr->maxy)
+		    mbr->maxy = cell->maxy;
+	    }
+	  if (is_leaf)
+	    {
+		if (!rtree_bulk_exec_stmt
+		    (loader->sqlite, loader->stmt_rowid, cell->id, nodeno))
+		    return 0;
+	    }
+	  else
+	    {
+		if (!rtree_bulk_exec_stmt
+		    (loader->sqlite, loader->stmt_parent, cell->id, nodeno))
+		    return 0;
+	    }
+      }
+    mbr->id = nodeno;
+    sqlite3_reset (loader->stmt_node);
+    sqlite3_clear_bindings (loader->stmt_node);
+    sqlite3_bind_int64 (loader->stmt_node, 1, nodeno);
+    sqlite3_bind_blob (loader->stmt_node, 2, loader->buf, loader->node_size,
+		       SQLITE_STATIC);
+    ret = sqlite3_step (loader->stmt_node);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    spatialite_e ("buildSpatialIndex error: \"%s\"\n",
+		  sqlite3_errmsg (loader->sqlite));
+    return 0;
+}
+
+static int
+rtree_bulk_pack (struct rtree_bulk_loader *loader,
+		 struct rtree_bulk_cell *cells, int count)
+{
+/* 
+/ packing all cells into a fully balanced R*Tree (STR)
+/ nodes are numbered top-down, so to always get the root as node #1
+*/
+    int levels = 0;
+    int n;
+    int lv;
+    int i;
+    int level_count[64];
+    sqlite3_int64 level_base[64];
+    sqlite3_int64 base;
+    struct rtree_bulk_cell *parents = NULL;
+    int n_parents;
+
+/* computing how many nodes are required for each level */
+    n = count;
+    while (1)
+      {
+	  n = (n + loader->max_cells - 1) / loader->max_cells;
+	  if (n < 1)
+	      n = 1;
+	  level_count[levels++] = n;
+	  if (n == 1 || levels >= 40)
+	      break;
+      }
+    if (n != 1)
+      {
+	  free (cells);
+	  return 0;
+      }
+    loader->depth = levels - 1;
+    base = 1;
+    for (lv = levels - 1; lv >= 0; lv--)
+      {
+	  level_base[lv] = base;
+	  base += level_count[lv];
+      }
+
+/* writing the nodes, from the leaves up to the root */
+    for (lv = 0; lv < levels; lv++)
+      {
+	  rtree_bulk_str_sort (cells, count, loader->max_cells);
+	  n_parents = level_count[lv];
+	  parents = malloc (sizeof (struct rtree_bulk_cell) * n_parents);
+	  if (parents == NULL)
+	    {
+		free (cells);
+		return 0;
+	    }
+	  for (i = 0; i < n_parents; i++)
+	    {
+		int first = i * loader->max_cells;
+		int n_cells = count - first;
+		if (n_cells > loader->max_cells)
+		    n_cells = loader->max_cells;
+		if (!rtree_bulk_write_node
+		    (loader, level_base[lv] + i, cells + first, n_cells,
+		     (lv == 0), parents + i))
+		  {
+		      free (parents);
+		      free (cells);
+		      return 0;
+		  }
+	    }
+	  free (cells);
+	  cells = parents;
+	  count = n_parents;
+      }
+    free (cells);
+    return 1;
+}
+
+static int
+buildSpatialIndexBulk (sqlite3 * sqlite, const char *table, const char *column)
+{
+/*
+/ loading a SpatialIndex [RTree] in bulk mode:
+/ all MBRs are sorted accordingly to Sort-Tile-Recursive 
+/ and the R*Tree shadow tables are directly written
+/
+/ returns 1 on success, 0 if bulk loading is not possible
+/ (the R*Tree is left untouched) or -1 on failure
+*/
+    struct rtree_bulk_loader loader;
+    struct rtree_bulk_cell *cells = NULL;
+    int count = 0;
+    int allocated = 0;
+    char *raw;
+    char *quoted_rtree;
+    char *quoted_table;
+    char *quoted_column;
+    char *sql_statement;
+    sqlite3_stmt *stmt = NULL;
+    int ret;
+    int retval = 0;
+    int savepoint = 0;
+
+    memset (&loader, 0, sizeof (struct rtree_bulk_loader));
+    loader.sqlite = sqlite;
+
+/* checking the current node size */
+    raw = sqlite3_mprintf ("idx_%s_%s_node", table, column);
+    quoted_rtree = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+    sql_statement =
+	sqlite3_mprintf ("SELECT length(data) FROM \"%s\" WHERE nodeno = 1",
+			 quoted_rtree);
+    free (quoted_rtree);
+    ret = sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			      &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	      loader.node_size = sqlite3_column_int (stmt, 0);
+	  else
+	      break;
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    loader.max_cells = (loader.node_size - 4) / 24;
+    if (loader.max_cells < 2)
+	return 0;
+
+/* loading all MBRs */
+    quoted_table = gaiaDoubleQuotedSql (table);
+    quoted_column = gaiaDoubleQuotedSql (column);
+    sql_statement =
+	sqlite3_mprintf
+	("SELECT ROWID, MbrMinX(\"%s\"), MbrMaxX(\"%s\"), MbrMinY(\"%s\"), MbrMaxY(\"%s\") "
+	 "FROM \"%s\" WHERE MbrMinX(\"%s\") IS NOT NULL", quoted_column,
+	 quoted_column, quoted_column, quoted_column, quoted_table,
+	 quoted_column);
+    free (quoted_table);
+    free (quoted_column);
+    ret = sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			      &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		struct rtree_bulk_cell *cell;
+		if (count == allocated)
+		  {
+		      struct rtree_bulk_cell *save = cells;
+		      allocated = (allocated == 0) ? 4096 : allocated * 2;
+		      cells =
+			  realloc (cells,
+				   sizeof (struct rtree_bulk_cell) * allocated);
+		      if (cells == NULL)
+			{
+			    free (save);
+			    sqlite3_finalize (stmt);
+			    return 0;
+			}
+		  }
+		cell = cells + count++;
+		cell->id = sqlite3_column_int64 (stmt, 0);
+		cell->minx =
+		    rtree_bulk_value_down (sqlite3_column_double (stmt, 1));
+		cell->maxx =
+		    rtree_bulk_value_up (sqlite3_column_double (stmt, 2));
+		cell->miny =
+		    rtree_bulk_value_down (sqlite3_column_double (stmt, 3));
+		cell->maxy =
+		    rtree_bulk_value_up (sqlite3_column_double (stmt, 4));
+	    }
+	  else
+	    {
+		sqlite3_finalize (stmt);
+		if (cells != NULL)
+		    free (cells);
+		return 0;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+
+/* resetting the R*Tree shadow tables */
+    ret =
+	sqlite3_exec (sqlite, "SAVEPOINT splite_rtree_bulk", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	goto stop;
+    savepoint = 1;
+    raw = sqlite3_mprintf ("idx_%s_%s", table, column);
+    quoted_rtree = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+    sql_statement =
+	sqlite3_mprintf ("DELETE FROM \"%s_node\"; DELETE FROM \"%s_parent\"; "
+			 "DELETE FROM \"%s_rowid\"", quoted_rtree, quoted_rtree,
+			 quoted_rtree);
+    ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  /* e.g. shadow tables are read-only (defensive mode) */
+	  free (quoted_rtree);
+	  goto stop;
+      }
+    retval = -1;
+    sql_statement =
+	sqlite3_mprintf
+	("INSERT INTO \"%s_node\" (nodeno, data) VALUES (?, ?)", quoted_rtree);
+    ret = sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			      &(loader.stmt_node), NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  free (quoted_rtree);
+	  goto stop;
+      }
+    sql_statement =
+	sqlite3_mprintf
+	("INSERT INTO \"%s_parent\" (nodeno, parentnode) VALUES (?, ?)",
+	 quoted_rtree);
+    ret = sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			      &(loader.stmt_parent), NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  free (quoted_rtree);
+	  goto stop;
+      }
+    sql_statement =
+	sqlite3_mprintf
+	("INSERT INTO \"%s_rowid\" (rowid, nodeno) VALUES (?, ?)",
+	 quoted_rtree);
+    free (quoted_rtree);
+    ret = sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			      &(loader.stmt_rowid), NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+    loader.buf = malloc (loader.node_size);
+    if (loader.buf == NULL)
+	goto stop;
+
+/* writing a packed R*Tree */
+    if (count == 0)
+      {
+	  /* empty R*Tree: just an empty root node */
+	  struct rtree_bulk_cell mbr;
+	  if (rtree_bulk_write_node (&loader, 1, NULL, 0, 1, &mbr))
+	      retval = 1;
+      }
+    else
+      {
+	  int ok = rtree_bulk_pack (&loader, cells, count);
+	  cells = NULL;		/* always freed by rtree_bulk_pack */
+	  if (ok)
+	      retval = 1;
+      }
+
+  stop:
+    if (loader.stmt_node != NULL)
+	sqlite3_finalize (loader.stmt_node);
+    if (loader.stmt_parent != NULL)
+	sqlite3_finalize (loader.stmt_parent);
+    if (loader.stmt_rowid != NULL)
+	sqlite3_finalize (loader.stmt_rowid);
+    if (loader.buf != NULL)
+	free (loader.buf);
+    if (cells != NULL)
+	free (cells);
+    if (savepoint)
+      {
+	  if (retval != 1)
+	      sqlite3_exec (sqlite, "ROLLBACK TO splite_rtree_bulk", NULL,
+			    NULL, NULL);
+	  sqlite3_exec (sqlite, "RELEASE splite_rtree_bulk", NULL, NULL, NULL);
+      }
+    return retval;
+}
+
 SPATIALITE_PRIVATE int
 buildSpatialIndexEx (void *p_sqlite, const unsigned char *table,
 		     const char *column)
@@ -4115,6 +4781,14 @@ buildSpatialIndexEx (void *p_sqlite, const unsigned char *table,
 	  return -2;
       }
 
+/* attempting first to bulk load a packed R*Tree */
+    ret = buildSpatialIndexBulk (sqlite, (const char *) table, column);
+    if (ret > 0)
+	return 0;
+    if (ret < 0)
+	return -1;
+
+/* falling back to the plain INSERT mode */
     raw = sqlite3_mprintf ("idx_%s_%s", table, column);
     quoted_rtree = gaiaDoubleQuotedSql (raw);
     sqlite3_free (raw);
@@ -4141,6 +4815,261 @@ buildSpatialIndexEx (void *p_sqlite, const unsigned char *table,
     return 0;
 }
 
+static int
+flush_deferred_spatial_index (sqlite3 * sqlite, const char *table,
+			      const char *column)
+{
+/*
+/ applying all pending changes to a deferred SpatialIndex [RTree]
+/ - few changes: the queued ROWIDs are synchronized in a single batch
+/ - many changes: the whole R*Tree is rebuilt in bulk mode
+*/
+    char *raw;
+    char *quoted_rtree;
+    char *quoted_pending;
+    char *quoted_table;
+    char *quoted_column;
+    char *sql_statement;
+    char *errMsg = NULL;
+    int ret;
+    int i;
+    char **results;
+    int rows;
+    int columns;
+    sqlite3_int64 pending = 0;
+    sqlite3_int64 indexed = 0;
+
+    raw = sqlite3_mprintf ("idx_%s_%s", table, column);
+    quoted_rtree = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+    raw = sqlite3_mprintf ("idx_%s_%s_pending", table, column);
+    quoted_pending = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+    sql_statement =
+	sqlite3_mprintf ("SELECT (SELECT Count(*) FROM \"%s\"), "
+			 "(SELECT Count(*) FROM \"%s\")", quoted_pending,
+			 quoted_rtree);
+    ret = sqlite3_get_table (sqlite, sql_statement, &results, &rows, &columns,
+			     &errMsg);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto error;
+    for (i = 1; i <= rows; i++)
+      {
+	  pending = atoll (results[(i * columns) + 0]);
+	  indexed = atoll (results[(i * columns) + 1]);
+      }
+    sqlite3_free_table (results);
+    if (pending == 0)
+      {
+	  /* nothing to do */
+	  free (quoted_rtree);
+	  free (quoted_pending);
+	  return 1;
+      }
+
+    if (pending >= indexed)
+      {
+	  /* rebuilding the whole R*Tree */
+	  sql_statement =
+	      sqlite3_mprintf ("DELETE FROM \"%s\"; DELETE FROM \"%s\"",
+			       quoted_rtree, quoted_pending);
+	  ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, &errMsg);
+	  sqlite3_free (sql_statement);
+	  if (ret != SQLITE_OK)
+	      goto error;
+	  free (quoted_rtree);
+	  free (quoted_pending);
+	  if (buildSpatialIndexEx
+	      (sqlite, (const unsigned char *) table, column) != 0)
+	      return 0;
+	  return 1;
+      }
+
+/* synchronizing all the queued ROWIDs */
+    quoted_table = gaiaDoubleQuotedSql (table);
+    quoted_column = gaiaDoubleQuotedSql (column);
+    sql_statement =
+	sqlite3_mprintf
+	("DELETE FROM \"%s\" WHERE pkid IN (SELECT pkid FROM \"%s\");\n"
+	 "INSERT INTO \"%s\" (pkid, xmin, xmax, ymin, ymax) "
+	 "SELECT ROWID, MbrMinX(\"%s\"), MbrMaxX(\"%s\"), MbrMinY(\"%s\"), MbrMaxY(\"%s\") "
+	 "FROM \"%s\" WHERE ROWID IN (SELECT pkid FROM \"%s\") "
+	 "AND MbrMinX(\"%s\") IS NOT NULL;\n" "DELETE FROM \"%s\"",
+	 quoted_rtree, quoted_pending, quoted_rtree, quoted_column,
+	 quoted_column, quoted_column, quoted_column, quoted_table,
+	 quoted_pending, quoted_column, quoted_pending);
+    free (quoted_table);
+    free (quoted_column);
+    ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, &errMsg);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto error;
+    free (quoted_rtree);
+    free (quoted_pending);
+    return 1;
+
+  error:
+    spatialite_e ("FlushDeferredSpatialIndex error: \"%s\"\n", errMsg);
+    sqlite3_free (errMsg);
+    free (quoted_rtree);
+    free (quoted_pending);
+    return 0;
+}
+
+SPATIALITE_PRIVATE int
+flushDeferredSpatialIndex (void *p_sqlite, const char *table,
+			   const char *column)
+{
+/*
+/ flushing a deferred SpatialIndex [RTree]
+/ if both table and column are NULL any deferred SpatialIndex will be flushed
+/
+/ returns 1 on success, 0 on failure
+*/
+    sqlite3 *sqlite = (sqlite3 *) p_sqlite;
+    char *sql_statement;
+    int ret;
+    int i;
+    char **results;
+    int rows;
+    int columns;
+    int retval = 1;
+
+    if (checkSpatialMetaData (sqlite) != 3)
+	return 0;
+    if (table == NULL || column == NULL)
+	sql_statement =
+	    sqlite3_mprintf ("SELECT f_table_name, f_geometry_column "
+			     "FROM geometry_columns WHERE spatial_index_enabled = 1");
+    else
+	sql_statement =
+	    sqlite3_mprintf ("SELECT f_table_name, f_geometry_column "
+			     "FROM geometry_columns WHERE spatial_index_enabled = 1 "
+			     "AND Lower(f_table_name) = Lower(%Q) "
+			     "AND Lower(f_geometry_column) = Lower(%Q)", table,
+			     column);
+    ret = sqlite3_get_table (sqlite, sql_statement, &results, &rows, &columns,
+			     NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (table != NULL && column != NULL && rows < 1)
+	retval = 0;
+    for (i = 1; i <= rows; i++)
+      {
+	  char *p_table = NULL;
+	  char *p_column = NULL;
+	  if (!getRealSQLnames
+	      (sqlite, results[(i * columns) + 0], results[(i * columns) + 1],
+	       &p_table, &p_column))
+	    {
+		retval = 0;
+		continue;
+	    }
+	  if (check_deferred_spatial_index (sqlite, p_table, p_column))
+	    {
+		if (!flush_deferred_spatial_index (sqlite, p_table, p_column))
+		    retval = 0;
+	    }
+	  else if (table != NULL && column != NULL)
+	    {
+		spatialite_e
+		    ("FlushDeferredSpatialIndex error: \"%s\".\"%s\" isn't in deferred mode\n",
+		     table, column);
+		retval = 0;
+	    }
+	  free (p_table);
+	  free (p_column);
+      }
+    sqlite3_free_table (results);
+    return retval;
+}
+
+SPATIALITE_PRIVATE int
+setDeferredSpatialIndex (void *p_sqlite, const char *table,
+			 const char *column, int deferred)
+{
+/*
+/ enabling or disabling the deferred mode of some SpatialIndex [RTree]
+/
+/ returns 1 on success, 0 on failure
+*/
+    sqlite3 *sqlite = (sqlite3 *) p_sqlite;
+    char *sql_statement;
+    char *raw;
+    char *quoted_pending;
+    char *errMsg = NULL;
+    char *p_table = NULL;
+    char *p_column = NULL;
+    int ret;
+    char **results;
+    int rows;
+    int columns;
+    int retval = 0;
+
+    if (checkSpatialMetaData (sqlite) != 3)
+	return 0;
+    sql_statement =
+	sqlite3_mprintf ("SELECT f_table_name FROM geometry_columns "
+			 "WHERE spatial_index_enabled = 1 "
+			 "AND Lower(f_table_name) = Lower(%Q) "
+			 "AND Lower(f_geometry_column) = Lower(%Q)", table,
+			 column);
+    ret = sqlite3_get_table (sqlite, sql_statement, &results, &rows, &columns,
+			     NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    sqlite3_free_table (results);
+    if (rows < 1)
+      {
+	  spatialite_e
+	      ("DeferredSpatialIndex error: either \"%s\".\"%s\" isn't a Geometry column or no R*Tree SpatialIndex is defined\n",
+	       table, column);
+	  return 0;
+      }
+    if (!getRealSQLnames (sqlite, table, column, &p_table, &p_column))
+	return 0;
+
+    if (!deferred)
+      {
+	  /* applying all pending changes before leaving the deferred mode */
+	  if (check_deferred_spatial_index (sqlite, p_table, p_column))
+	    {
+		if (!flush_deferred_spatial_index (sqlite, p_table, p_column))
+		    goto end;
+	    }
+      }
+    raw = sqlite3_mprintf ("idx_%s_%s_pending", p_table, p_column);
+    quoted_pending = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+    if (deferred)
+	sql_statement =
+	    sqlite3_mprintf
+	    ("CREATE TABLE IF NOT EXISTS main.\"%s\" (pkid INTEGER PRIMARY KEY)",
+	     quoted_pending);
+    else
+	sql_statement =
+	    sqlite3_mprintf ("DROP TABLE IF EXISTS main.\"%s\"",
+			     quoted_pending);
+    free (quoted_pending);
+    ret = sqlite3_exec (sqlite, sql_statement, NULL, NULL, &errMsg);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("DeferredSpatialIndex error: \"%s\"\n", errMsg);
+	  sqlite3_free (errMsg);
+	  goto end;
+      }
+    update_geometry_triggers (sqlite, p_table, p_column, 1);
+    retval = 1;
+  end:
+    free (p_table);
+    free (p_column);
+    return retval;
+}
+
 SPATIALITE_PRIVATE int
 getRealSQLnames (void *p_sqlite, const char *table, const char *column,
 		 char **real_table, char **real_column)
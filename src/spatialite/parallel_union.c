@@ -0,0 +1,921 @@
+/*
+
+ parallel_union.c -- multi-threaded engine supporting the ST_Union aggregate
+
+ version 5.0, 2018 January 15
+
+ Author: Sandro Furieri a.furieri@lqt.it
+
+ ------------------------------------------------------------------------------
+ 
+ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ 
+ The contents of this file are subject to the Mozilla Public License Version
+ 1.1 (the "License"); you may not use this file except in compliance with
+ the License. You may obtain a copy of the License at
+ http://www.mozilla.org/MPL/
+ 
+Software distributed under the License is distributed on an "AS IS" basis,
+WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+for the specific language governing rights and limitations under the
+License.
+
+The Original Code is the SpatiaLite library
+
+The Initial Developer of the Original Code is Alessandro Furieri
+ 
+Portions created by the Initial Developer are Copyright (C) 2018
+the Initial Developer. All Rights Reserved.
+
+Contributor(s):
+
+Alternatively, the contents of this file may be used under the terms of
+either the GNU General Public License Version 2 or later (the "GPL"), or
+the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+in which case the provisions of the GPL or the LGPL are applicable instead
+of those above. If you wish to allow use of your version of this file only
+under the terms of either the GPL or the LGPL, and not to allow others to
+use your version of this file under the terms of the MPL, indicate your
+decision by deleting the provisions above and replace them with the notice
+and other provisions required by the GPL or the LGPL. If you do not delete
+the provisions above, a recipient may use your version of this file under
+the terms of any one of the MPL, the GPL or the LGPL.
+ 
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include "config-msvc.h"
+#else
+#include "config.h"
+#endif
+
+#include <spatialite/sqlite.h>
+#include <spatialite/debug.h>
+#include <spatialite/gaiageo.h>
+
+#include <spatialite.h>
+#include <spatialite_private.h>
+
+#ifndef OMIT_GEOS		/* including GEOS */
+#ifdef GEOS_REENTRANT
+#ifdef GEOS_ONLY_REENTRANT
+#define GEOS_USE_ONLY_R_API	/* only fully thread-safe GEOS API */
+#endif
+#endif
+#include <geos_c.h>
+#endif
+
+SPATIALITE_PRIVATE int
+splite_count_processors (void)
+{
+/* attempting to determine how many CPU cores are available */
+#if defined(_WIN32) && !defined(__MINGW32__)
+    SYSTEM_INFO info;
+    GetSystemInfo (&info);
+    return info.dwNumberOfProcessors;
+#else
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+	return (int) n;
+#endif
+    return 1;
+#endif
+}
+
+SPATIALITE_PRIVATE int
+splite_get_union_threads (const void *p_cache)
+{
+/* returns the number of threads to be used by ST_Union */
+    int n;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return 1;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return 1;
+    if (cache->unionThreads > 0)
+	return cache->unionThreads;
+/* automatic: one thread for each CPU core, but never more than 8 */
+    n = splite_count_processors ();
+    if (n < 1)
+	n = 1;
+    if (n > 8)
+	n = 8;
+    return n;
+}
+
+#ifndef OMIT_GEOS		/* GEOS is supported */
+
+/*
+/ the ST_Union aggregate engine
+/
+/ input Geometries are buffered into a "window"; once the window is
+/ full it's spatially partitioned (STR: Sort-Tile-Recursive) into
+/ batches of nearby Geometries, and each batch is dispatched to a
+/ pool of worker threads performing a cascaded (unary) union.
+/ the partial results are fed back into the window, so that memory
+/ usage stays bounded no matter how many rows are aggregated.
+/ 
+/ the worker pool belongs to the connection: it's lazily started by
+/ the first ST_Union needing it, and it's then shared by all ST_Union
+/ aggregates running on the same connection.
+/ each worker owns a private GEOS handle (not a pooled connection)
+*/
+
+#define UNION_BATCH_SIZE	256
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+typedef CRITICAL_SECTION union_mutex;
+typedef CONDITION_VARIABLE union_cond;
+typedef HANDLE union_thread;
+#else
+typedef pthread_mutex_t union_mutex;
+typedef pthread_cond_t union_cond;
+typedef pthread_t union_thread;
+#endif
+
+struct union_item
+{
+/* a Geometry waiting into the window */
+    gaiaGeomCollPtr geom;
+    double cx;
+    double cy;
+};
+
+struct union_job
+{
+/* a batch of Geometries to be unioned by some worker */
+    struct union_engine *engine;
+    gaiaGeomCollPtr *geoms;
+    int count;
+    struct union_job *next;
+};
+
+struct union_worker
+{
+/* a worker thread */
+    struct union_pool *pool;
+    struct splite_internal_cache *cache;
+    union_thread thread;
+};
+
+struct union_pool
+{
+/* the per-connection pool of worker threads */
+    int n_threads;
+    int n_workers;
+    struct union_worker *workers;
+    struct union_job *first_job;
+    struct union_job *last_job;
+    int n_engines;
+    int shutdown;
+    union_mutex mutex;
+    union_cond job_ready;
+    union_cond job_done;
+};
+
+struct union_engine
+{
+/* the ST_Union engine */
+    const void *cache;
+    struct union_pool *pool;
+    int batch_size;
+    struct union_item *window;
+    int window_count;
+    int window_size;
+    int queued;
+    int max_queued;
+    int busy;
+    gaiaGeomCollPtr *partials;
+    int n_partials;
+    int max_partials;
+    int error;
+};
+
+static void
+union_lock (struct union_pool *pool)
+{
+/* locking the pool mutex (if there is a pool at all) */
+    if (pool == NULL)
+	return;
+#if defined(_WIN32) && !defined(__MINGW32__)
+    EnterCriticalSection (&(pool->mutex));
+#else
+    pthread_mutex_lock (&(pool->mutex));
+#endif
+}
+
+static void
+union_unlock (struct union_pool *pool)
+{
+/* unlocking the pool mutex (if there is a pool at all) */
+    if (pool == NULL)
+	return;
+#if defined(_WIN32) && !defined(__MINGW32__)
+    LeaveCriticalSection (&(pool->mutex));
+#else
+    pthread_mutex_unlock (&(pool->mutex));
+#endif
+}
+
+static void
+union_wait (struct union_pool *pool, union_cond * cond)
+{
+#if defined(_WIN32) && !defined(__MINGW32__)
+    SleepConditionVariableCS (cond, &(pool->mutex), INFINITE);
+#else
+    pthread_cond_wait (cond, &(pool->mutex));
+#endif
+}
+
+static void
+union_signal (union_cond * cond)
+{
+#if defined(_WIN32) && !defined(__MINGW32__)
+    WakeConditionVariable (cond);
+#else
+    pthread_cond_signal (cond);
+#endif
+}
+
+static void
+union_broadcast (union_cond * cond)
+{
+#if defined(_WIN32) && !defined(__MINGW32__)
+    WakeAllConditionVariable (cond);
+#else
+    pthread_cond_broadcast (cond);
+#endif
+}
+
+static gaiaGeomCollPtr
+union_batch (const void *cache, gaiaGeomCollPtr * geoms, int count)
+{
+/* unioning a batch of Geometries; all input Geometries will be freed */
+    int i;
+    gaiaGeomCollPtr aggregate = NULL;
+    gaiaGeomCollPtr result;
+    for (i = 0; i < count; i++)
+      {
+	  if (aggregate == NULL)
+	      aggregate = geoms[i];
+	  else
+	    {
+		/* merging all Geometries into a single Collection */
+		aggregate = gaiaMergeGeometries_r (cache, aggregate, geoms[i]);
+		gaiaFreeGeomColl (geoms[i]);
+	    }
+	  geoms[i] = NULL;
+      }
+    if (aggregate == NULL)
+	return NULL;
+    result = gaiaUnaryUnion_r (cache, aggregate);
+    gaiaFreeGeomColl (aggregate);
+    if (result == NULL)
+	return NULL;
+    gaiaMbrGeometry (result);
+    return result;
+}
+
+static void
+free_union_job (struct union_job *job)
+{
+/* memory cleanup - destroying a job */
+    int i;
+    for (i = 0; i < job->count; i++)
+      {
+	  if (job->geoms[i] != NULL)
+	      gaiaFreeGeomColl (job->geoms[i]);
+      }
+    free (job->geoms);
+    free (job);
+}
+
+static void
+union_store_partial (struct union_engine *engine, const void *cache,
+		     gaiaGeomCollPtr geom)
+{
+/* 
+/ storing a partial result - the mutex must be already locked
+/ (it will be temporarily released while merging on low memory)
+*/
+    gaiaGeomCollPtr *partials;
+    gaiaGeomCollPtr pair[2];
+    while (1)
+      {
+	  if (geom == NULL)
+	    {
+		engine->error = 1;
+		return;
+	    }
+	  if (gaiaIsEmpty (geom))
+	    {
+		/* empty partial results are simply discarded */
+		gaiaFreeGeomColl (geom);
+		return;
+	    }
+	  if (engine->n_partials < engine->max_partials)
+	      break;
+	  partials =
+	      realloc (engine->partials,
+		       sizeof (gaiaGeomCollPtr) * (engine->max_partials +
+						   engine->batch_size));
+	  if (partials != NULL)
+	    {
+		engine->partials = partials;
+		engine->max_partials += engine->batch_size;
+		break;
+	    }
+	  /* insufficient memory: merging into the last partial */
+	  if (engine->n_partials == 0)
+	    {
+		gaiaFreeGeomColl (geom);
+		engine->error = 1;
+		return;
+	    }
+	  pair[0] = engine->partials[engine->n_partials - 1];
+	  pair[1] = geom;
+	  engine->n_partials -= 1;
+	  union_unlock (engine->pool);
+	  geom = union_batch (cache, pair, 2);
+	  union_lock (engine->pool);
+      }
+    engine->partials[engine->n_partials++] = geom;
+}
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+static DWORD WINAPI
+union_worker_main (void *arg)
+#else
+static void *
+union_worker_main (void *arg)
+#endif
+{
+/* the worker thread main loop */
+    struct union_worker *worker = (struct union_worker *) arg;
+    struct union_pool *pool = worker->pool;
+    struct union_engine *engine;
+    struct union_job *job;
+    gaiaGeomCollPtr result;
+    int failed;
+
+    union_lock (pool);
+    while (1)
+      {
+	  while (pool->first_job == NULL && !pool->shutdown)
+	      union_wait (pool, &(pool->job_ready));
+	  if (pool->first_job == NULL)
+	      break;		/* shutting down */
+	  job = pool->first_job;
+	  pool->first_job = job->next;
+	  if (pool->first_job == NULL)
+	      pool->last_job = NULL;
+	  engine = job->engine;
+	  engine->queued -= 1;
+	  engine->busy += 1;
+	  failed = engine->error;
+	  union_unlock (pool);
+
+	  if (failed)
+	      result = NULL;
+	  else
+	      result = union_batch (worker->cache, job->geoms, job->count);
+	  free_union_job (job);
+
+	  union_lock (pool);
+	  union_store_partial (engine, worker->cache, result);
+	  engine->busy -= 1;
+	  union_broadcast (&(pool->job_done));
+      }
+    union_unlock (pool);
+#if defined(_WIN32) && !defined(__MINGW32__)
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static void
+union_submit (struct union_engine *engine, gaiaGeomCollPtr * geoms,
+	      int count)
+{
+/* submitting a batch of Geometries */
+    struct union_pool *pool = engine->pool;
+    struct union_job *job = NULL;
+    gaiaGeomCollPtr result;
+    if (pool != NULL)
+	job = malloc (sizeof (struct union_job));
+    if (job == NULL)
+      {
+	  /* single threaded, or insufficient memory: unioning it now */
+	  result = union_batch (engine->cache, geoms, count);
+	  free (geoms);
+	  union_lock (pool);
+	  union_store_partial (engine, engine->cache, result);
+	  union_unlock (pool);
+	  return;
+      }
+    job->engine = engine;
+    job->geoms = geoms;
+    job->count = count;
+    job->next = NULL;
+    union_lock (pool);
+    while (engine->queued >= engine->max_queued)
+	union_wait (pool, &(pool->job_done));
+    if (pool->last_job == NULL)
+	pool->first_job = job;
+    else
+	pool->last_job->next = job;
+    pool->last_job = job;
+    engine->queued += 1;
+    union_signal (&(pool->job_ready));
+    union_unlock (pool);
+}
+
+static int
+cmp_union_items_x (const void *p1, const void *p2)
+{
+/* sorting window items by X */
+    const struct union_item *i1 = (const struct union_item *) p1;
+    const struct union_item *i2 = (const struct union_item *) p2;
+    if (i1->cx < i2->cx)
+	return -1;
+    if (i1->cx > i2->cx)
+	return 1;
+    return 0;
+}
+
+static int
+cmp_union_items_y (const void *p1, const void *p2)
+{
+/* sorting window items by Y */
+    const struct union_item *i1 = (const struct union_item *) p1;
+    const struct union_item *i2 = (const struct union_item *) p2;
+    if (i1->cy < i2->cy)
+	return -1;
+    if (i1->cy > i2->cy)
+	return 1;
+    return 0;
+}
+
+static void
+union_flush_window (struct union_engine *engine)
+{
+/* 
+/ partitioning the window into spatially coherent batches
+/ (Sort-Tile-Recursive), then submitting each batch
+*/
+    int n = engine->window_count;
+    int n_batches;
+    int n_slabs;
+    int slab_len;
+    int base;
+    int i;
+    if (n == 0)
+	return;
+    n_batches = (n + engine->batch_size - 1) / engine->batch_size;
+    if (n_batches > 1)
+      {
+	  n_slabs = (int) ceil (sqrt ((double) n_batches));
+	  slab_len =
+	      ((n_batches + n_slabs - 1) / n_slabs) * engine->batch_size;
+	  qsort (engine->window, n, sizeof (struct union_item),
+		 cmp_union_items_x);
+	  for (base = 0; base < n; base += slab_len)
+	    {
+		int len = slab_len;
+		if (base + len > n)
+		    len = n - base;
+		qsort (engine->window + base, len, sizeof (struct union_item),
+		       cmp_union_items_y);
+	    }
+      }
+    for (base = 0; base < n; base += engine->batch_size)
+      {
+	  int len = engine->batch_size;
+	  gaiaGeomCollPtr *geoms;
+	  if (base + len > n)
+	      len = n - base;
+	  geoms = malloc (sizeof (gaiaGeomCollPtr) * len);
+	  if (geoms == NULL)
+	    {
+		/* insufficient memory: serially unioning this batch */
+		gaiaGeomCollPtr aggregate = NULL;
+		gaiaGeomCollPtr result;
+		for (i = 0; i < len; i++)
+		  {
+		      gaiaGeomCollPtr geom = engine->window[base + i].geom;
+		      if (aggregate == NULL)
+			  aggregate = geom;
+		      else
+			{
+			    aggregate =
+				gaiaMergeGeometries_r (engine->cache, aggregate,
+						       geom);
+			    gaiaFreeGeomColl (geom);
+			}
+		      engine->window[base + i].geom = NULL;
+		  }
+		result = union_batch (engine->cache, &aggregate, 1);
+		union_lock (engine->pool);
+		union_store_partial (engine, engine->cache, result);
+		union_unlock (engine->pool);
+		continue;
+	    }
+	  for (i = 0; i < len; i++)
+	      geoms[i] = engine->window[base + i].geom;
+	  union_submit (engine, geoms, len);
+      }
+    engine->window_count = 0;
+}
+
+static void
+union_push (struct union_engine *engine, gaiaGeomCollPtr geom)
+{
+/* inserting a Geometry into the window */
+    struct union_item *item;
+    if (engine->window_count >= engine->window_size)
+	union_flush_window (engine);
+    item = engine->window + engine->window_count;
+    item->geom = geom;
+    item->cx = geom->MinX + ((geom->MaxX - geom->MinX) / 2.0);
+    item->cy = geom->MinY + ((geom->MaxY - geom->MinY) / 2.0);
+    engine->window_count += 1;
+}
+
+static int
+union_recycle_partials (struct union_engine *engine, int min_count)
+{
+/* 
+/ feeding back the partial results into the window 
+/ returns the number of recycled items
+*/
+    gaiaGeomCollPtr *partials = NULL;
+    int n = 0;
+    int i;
+    union_lock (engine->pool);
+    if (engine->n_partials >= min_count)
+      {
+	  partials = engine->partials;
+	  n = engine->n_partials;
+	  engine->partials = NULL;
+	  engine->n_partials = 0;
+	  engine->max_partials = 0;
+      }
+    union_unlock (engine->pool);
+    for (i = 0; i < n; i++)
+	union_push (engine, partials[i]);
+    if (partials != NULL)
+	free (partials);
+    return n;
+}
+
+static void
+union_wait_idle (struct union_engine *engine)
+{
+/* waiting until all submitted jobs have been completed */
+    struct union_pool *pool = engine->pool;
+    if (pool == NULL)
+	return;
+    union_lock (pool);
+    while (engine->queued > 0 || engine->busy > 0)
+	union_wait (pool, &(pool->job_done));
+    union_unlock (pool);
+}
+
+#if !defined(GEOS_REENTRANT)
+static void
+union_geos_message (const char *fmt, ...)
+{
+/* 
+/ GEOS messages from the worker threads are simply ignored:
+/ any failure will be reported as a NULL partial result
+*/
+    if (fmt != NULL)
+	return;
+}
+#endif
+
+static struct splite_internal_cache *
+union_worker_cache_alloc (void)
+{
+/* 
+/ creating the minimal cache required by the gaia*_r functions 
+/ wrapping a plain GEOS handle (no pooled connection at all)
+*/
+    struct splite_internal_cache *cache =
+	malloc (sizeof (struct splite_internal_cache));
+    if (cache == NULL)
+	return NULL;
+    memset (cache, 0, sizeof (struct splite_internal_cache));
+    cache->magic1 = SPATIALITE_CACHE_MAGIC1;
+    cache->magic2 = SPATIALITE_CACHE_MAGIC2;
+    cache->pool_index = -1;
+#ifdef GEOS_REENTRANT
+    cache->GEOS_handle = GEOS_init_r ();
+#else
+    cache->GEOS_handle = initGEOS_r (union_geos_message, union_geos_message);
+#endif
+    if (cache->GEOS_handle == NULL)
+      {
+	  free (cache);
+	  return NULL;
+      }
+    return cache;
+}
+
+static void
+union_worker_cache_free (struct splite_internal_cache *cache)
+{
+/* memory cleanup - destroying a worker cache */
+#ifdef GEOS_REENTRANT
+    GEOS_finish_r (cache->GEOS_handle);
+#else
+    finishGEOS_r (cache->GEOS_handle);
+#endif
+    gaiaResetGeosMsg_r (cache);
+    free (cache);
+}
+
+static void
+union_pool_free (struct union_pool *pool)
+{
+/* stopping the worker threads and destroying the pool */
+    int i;
+    if (pool == NULL)
+	return;
+    union_lock (pool);
+    pool->shutdown = 1;
+    union_broadcast (&(pool->job_ready));
+    union_unlock (pool);
+    for (i = 0; i < pool->n_workers; i++)
+      {
+	  struct union_worker *worker = pool->workers + i;
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  WaitForSingleObject (worker->thread, INFINITE);
+	  CloseHandle (worker->thread);
+#else
+	  pthread_join (worker->thread, NULL);
+#endif
+	  union_worker_cache_free (worker->cache);
+      }
+    free (pool->workers);
+#if defined(_WIN32) && !defined(__MINGW32__)
+    DeleteCriticalSection (&(pool->mutex));
+#else
+    pthread_mutex_destroy (&(pool->mutex));
+    pthread_cond_destroy (&(pool->job_ready));
+    pthread_cond_destroy (&(pool->job_done));
+#endif
+    free (pool);
+}
+
+static struct union_pool *
+union_pool_alloc (int n_threads)
+{
+/* creating a pool of worker threads */
+    int i;
+    struct union_pool *pool = malloc (sizeof (struct union_pool));
+    if (pool == NULL)
+	return NULL;
+    pool->n_threads = n_threads;
+    pool->n_workers = 0;
+    pool->first_job = NULL;
+    pool->last_job = NULL;
+    pool->n_engines = 0;
+    pool->shutdown = 0;
+    pool->workers = malloc (sizeof (struct union_worker) * n_threads);
+    if (pool->workers == NULL)
+      {
+	  free (pool);
+	  return NULL;
+      }
+#if defined(_WIN32) && !defined(__MINGW32__)
+    InitializeCriticalSection (&(pool->mutex));
+    InitializeConditionVariable (&(pool->job_ready));
+    InitializeConditionVariable (&(pool->job_done));
+#else
+    pthread_mutex_init (&(pool->mutex), NULL);
+    pthread_cond_init (&(pool->job_ready), NULL);
+    pthread_cond_init (&(pool->job_done), NULL);
+#endif
+    for (i = 0; i < n_threads; i++)
+      {
+	  struct union_worker *worker = pool->workers + pool->n_workers;
+	  worker->pool = pool;
+	  worker->cache = union_worker_cache_alloc ();
+	  if (worker->cache == NULL)
+	      break;
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  worker->thread =
+	      CreateThread (NULL, 0, union_worker_main, worker, 0, NULL);
+	  if (worker->thread == NULL)
+	    {
+		union_worker_cache_free (worker->cache);
+		break;
+	    }
+#else
+	  if (pthread_create
+	      (&(worker->thread), NULL, union_worker_main, worker) != 0)
+	    {
+		union_worker_cache_free (worker->cache);
+		break;
+	    }
+#endif
+	  pool->n_workers += 1;
+      }
+    if (pool->n_workers < 2)
+      {
+	  /* not really worth it: single threaded */
+	  union_pool_free (pool);
+	  return NULL;
+      }
+    return pool;
+}
+
+SPATIALITE_PRIVATE void
+splite_union_pool_free (void *p_pool)
+{
+/* memory cleanup - destroying the per-connection pool of worker threads */
+    union_pool_free ((struct union_pool *) p_pool);
+}
+
+SPATIALITE_PRIVATE void *
+splite_union_engine_alloc (const void *p_cache)
+{
+/* creating an ST_Union engine */
+    int n_threads;
+    struct union_engine *engine;
+    struct union_pool *pool;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return NULL;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return NULL;
+
+    engine = malloc (sizeof (struct union_engine));
+    if (engine == NULL)
+	return NULL;
+    engine->cache = cache;
+    engine->pool = NULL;
+    engine->batch_size = UNION_BATCH_SIZE;
+    engine->window_count = 0;
+    engine->queued = 0;
+    engine->busy = 0;
+    engine->partials = NULL;
+    engine->n_partials = 0;
+    engine->max_partials = 0;
+    engine->error = 0;
+    n_threads = splite_get_union_threads (cache);
+    engine->window_size = engine->batch_size * n_threads;
+    engine->window = malloc (sizeof (struct union_item) * engine->window_size);
+    if (engine->window == NULL)
+      {
+	  free (engine);
+	  return NULL;
+      }
+
+/* lazily (re)starting the per-connection worker pool */
+    pool = (struct union_pool *) (cache->unionPool);
+    if (pool != NULL && pool->n_engines == 0 && pool->n_threads != n_threads)
+      {
+	  /* the number of threads has been changed in the meanwhile */
+	  union_pool_free (pool);
+	  cache->unionPool = NULL;
+	  pool = NULL;
+      }
+    if (pool == NULL && n_threads >= 2)
+      {
+	  pool = union_pool_alloc (n_threads);
+	  cache->unionPool = pool;
+      }
+    if (pool != NULL)
+      {
+	  /* this engine will be served by the worker pool */
+	  union_lock (pool);
+	  pool->n_engines += 1;
+	  union_unlock (pool);
+	  engine->pool = pool;
+      }
+    engine->max_queued = (pool == NULL) ? 0 : pool->n_workers * 2;
+    return engine;
+}
+
+SPATIALITE_PRIVATE int
+splite_union_engine_add (void *p_engine, void *p_geom)
+{
+/* 
+/ adding a Geometry to the ST_Union engine 
+/ the engine takes ownership of the Geometry
+*/
+    struct union_engine *engine = (struct union_engine *) p_engine;
+    gaiaGeomCollPtr geom = (gaiaGeomCollPtr) p_geom;
+    if (engine == NULL || geom == NULL)
+	return 0;
+    gaiaMbrGeometry (geom);
+    union_push (engine, geom);
+/* bounding the number of pending partial results */
+    union_recycle_partials (engine, engine->batch_size);
+    return 1;
+}
+
+SPATIALITE_PRIVATE void *
+splite_union_engine_final (void *p_engine)
+{
+/* 
+/ completing the ST_Union
+/ returns the final result (or NULL on failure)
+*/
+    struct union_engine *engine = (struct union_engine *) p_engine;
+    gaiaGeomCollPtr result = NULL;
+    if (engine == NULL)
+	return NULL;
+    while (1)
+      {
+	  union_flush_window (engine);
+	  union_wait_idle (engine);
+	  if (engine->error)
+	      return NULL;
+	  if (engine->n_partials <= 1)
+	      break;
+	  /* recursively unioning the partial results */
+	  union_recycle_partials (engine, 2);
+      }
+    if (engine->n_partials == 1)
+      {
+	  result = engine->partials[0];
+	  engine->n_partials = 0;
+      }
+    return result;
+}
+
+SPATIALITE_PRIVATE void
+splite_union_engine_free (void *p_engine)
+{
+/* memory cleanup - destroying an ST_Union engine */
+    int i;
+    struct union_job *job;
+    struct union_job *prev = NULL;
+    struct union_job *job_n;
+    struct union_pool *pool;
+    struct union_engine *engine = (struct union_engine *) p_engine;
+    if (engine == NULL)
+	return;
+
+    pool = engine->pool;
+    if (pool != NULL)
+      {
+	  /* withdrawing any pending job, then waiting for the running ones */
+	  union_lock (pool);
+	  job = pool->first_job;
+	  while (job != NULL)
+	    {
+		job_n = job->next;
+		if (job->engine == engine)
+		  {
+		      if (prev == NULL)
+			  pool->first_job = job_n;
+		      else
+			  prev->next = job_n;
+		      if (pool->last_job == job)
+			  pool->last_job = prev;
+		      engine->queued -= 1;
+		      free_union_job (job);
+		  }
+		else
+		    prev = job;
+		job = job_n;
+	    }
+	  while (engine->busy > 0)
+	      union_wait (pool, &(pool->job_done));
+	  pool->n_engines -= 1;
+	  union_unlock (pool);
+      }
+
+    for (i = 0; i < engine->window_count; i++)
+	gaiaFreeGeomColl (engine->window[i].geom);
+    free (engine->window);
+    for (i = 0; i < engine->n_partials; i++)
+	gaiaFreeGeomColl (engine->partials[i]);
+    if (engine->partials != NULL)
+	free (engine->partials);
+    free (engine);
+}
+
+#endif /* end GEOS conditional */
@@ -152,6 +152,13 @@ struct gaia_geom_chain
     struct gaia_geom_chain_item *last;
 };
 
+struct gaia_union_aggregate
+{
+/* a struct used by the Union() aggregate function */
+    void *engine;
+    struct gaia_geom_chain *chain;
+};
+
 #ifndef OMIT_GEOCALLBACKS	/* supporting RTree geometry callbacks */
 struct gaia_rtree_mbr
 {
@@ -2701,6 +2708,64 @@ fnct_CloneTable (sqlite3_context * context, int argc, sqlite3_value ** argv)
     return;
 }
 
+static void
+fnct_ClusterTable (sqlite3_context * context, int argc, sqlite3_value ** argv)
+{
+/* SQL function:
+/ ClusterTable(text table, text geom_column)
+/ ClusterTable(text table, text geom_column, integer resequence)
+/
+/ rewriting a whole table so that its rows are physically stored
+/ accordingly to the Hilbert curve of their MBR centers
+/ returns 1 on success
+/ 0 on failure (NULL on invalid arguments)
+*/
+    const char *table;
+    const char *geometry;
+    int resequence = 0;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
+	table = (const char *) sqlite3_value_text (argv[0]);
+    else
+      {
+	  spatialite_e
+	      ("ClusterTable() error: argument 1 is not of the String or TEXT type\n");
+	  sqlite3_result_null (context);
+	  return;
+      }
+    if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
+	geometry = (const char *) sqlite3_value_text (argv[1]);
+    else
+      {
+	  spatialite_e
+	      ("ClusterTable() error: argument 2 is not of the String or TEXT type\n");
+	  sqlite3_result_null (context);
+	  return;
+      }
+    if (argc > 2)
+      {
+	  if (sqlite3_value_type (argv[2]) == SQLITE_INTEGER)
+	      resequence = sqlite3_value_int (argv[2]);
+	  else
+	    {
+		spatialite_e
+		    ("ClusterTable() error: argument 3 is not of the Integer type\n");
+		sqlite3_result_null (context);
+		return;
+	    }
+      }
+
+    if (!gaiaAuxClusterTable (sqlite, table, geometry, resequence))
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    updateSpatiaLiteHistory (sqlite, table, geometry,
+			     "table rows clustered by Hilbert order");
+    sqlite3_result_int (context, 1);
+}
+
 static void
 fnct_CreateClonedTable (sqlite3_context * context, int argc,
 			sqlite3_value ** argv)
@@ -7579,6 +7644,133 @@ fnct_DisableSpatialIndex (sqlite3_context * context, int argc,
     return;
 }
 
+static void
+fnct_EnableDeferredSpatialIndex (sqlite3_context * context, int argc,
+				 sqlite3_value ** argv)
+{
+/* SQL function:
+/ EnableDeferredSpatialIndex(table, column )
+/
+/ switches a SpatialIndex [RTree] to the deferred mode: changed ROWIDs
+/ will simply be queued, and the R*Tree will be updated only when
+/ FlushDeferredSpatialIndex() is called
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table;
+    const char *column;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("EnableDeferredSpatialIndex() error: argument 1 [table_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    table = (const char *) sqlite3_value_text (argv[0]);
+    if (sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("EnableDeferredSpatialIndex() error: argument 2 [column_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    column = (const char *) sqlite3_value_text (argv[1]);
+    if (!setDeferredSpatialIndex (sqlite, table, column, 1))
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    sqlite3_result_int (context, 1);
+    updateSpatiaLiteHistory (sqlite, table, column,
+			     "SpatialIndex switched to deferred mode");
+}
+
+static void
+fnct_DisableDeferredSpatialIndex (sqlite3_context * context, int argc,
+				  sqlite3_value ** argv)
+{
+/* SQL function:
+/ DisableDeferredSpatialIndex(table, column )
+/
+/ applies all pending changes and then switches a SpatialIndex [RTree]
+/ back to the ordinary (immediate) mode
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table;
+    const char *column;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("DisableDeferredSpatialIndex() error: argument 1 [table_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    table = (const char *) sqlite3_value_text (argv[0]);
+    if (sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("DisableDeferredSpatialIndex() error: argument 2 [column_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    column = (const char *) sqlite3_value_text (argv[1]);
+    if (!setDeferredSpatialIndex (sqlite, table, column, 0))
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    sqlite3_result_int (context, 1);
+    updateSpatiaLiteHistory (sqlite, table, column,
+			     "SpatialIndex switched to immediate mode");
+}
+
+static void
+fnct_FlushDeferredSpatialIndex (sqlite3_context * context, int argc,
+				sqlite3_value ** argv)
+{
+/* SQL function:
+/ FlushDeferredSpatialIndex()
+/ FlushDeferredSpatialIndex(table, column )
+/
+/ applies all pending changes to a deferred SpatialIndex [RTree];
+/ if no argument is specified any deferred SpatialIndex will be flushed
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table = NULL;
+    const char *column = NULL;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (argc == 2)
+      {
+	  if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+	    {
+		spatialite_e
+		    ("FlushDeferredSpatialIndex() error: argument 1 [table_name] is not of the String type\n");
+		sqlite3_result_int (context, 0);
+		return;
+	    }
+	  table = (const char *) sqlite3_value_text (argv[0]);
+	  if (sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+	    {
+		spatialite_e
+		    ("FlushDeferredSpatialIndex() error: argument 2 [column_name] is not of the String type\n");
+		sqlite3_result_int (context, 0);
+		return;
+	    }
+	  column = (const char *) sqlite3_value_text (argv[1]);
+      }
+    if (!flushDeferredSpatialIndex (sqlite, table, column))
+	sqlite3_result_int (context, 0);
+    else
+	sqlite3_result_int (context, 1);
+}
+
 static void
 fnct_RebuildGeometryTriggers (sqlite3_context * context, int argc,
 			      sqlite3_value ** argv)
@@ -9463,6 +9655,38 @@ simplePolygon (gaiaGeomCollPtr geo)
     return NULL;
 }
 
+static int
+simpleView (sqlite3_context * context, const unsigned char *blob, int size,
+	    gaiaGeomViewPtr view)
+{
+/* helper function
+/ attempts to initialize a zero-copy Geometry View
+/ returns 0 if the BLOB is not a valid SpatiaLite Geometry or
+/ if the connection is in GPKG mode (full parsing is required)
+*/
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    if (cache != NULL && cache->gpkg_mode)
+	return 0;
+    return gaiaGeomViewFromBlob (view, blob, size);
+}
+
+static int
+simpleViewItem (gaiaGeomViewPtr view, int type, gaiaGeomViewItemPtr item)
+{
+/* helper function
+/ if this Geometry View contains only one elementary item of the
+/ required type, and no other elementary geometry, the item
+/ will be returned
+*/
+    if (view->NumItems != 1)
+	return 0;
+    if (!gaiaGeomViewGetItem (view, 0, item))
+	return 0;
+    if (item->Type != type)
+	return 0;
+    return 1;
+}
+
 static void
 fnct_AsText (sqlite3_context * context, int argc, sqlite3_value ** argv)
 {
@@ -15086,6 +15310,7 @@ fnct_Dimension (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int dim;
     gaiaGeomCollPtr geo = NULL;
     int gpkg_amphibious = 0;
@@ -15104,6 +15329,12 @@ fnct_Dimension (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, gaiaGeomViewDimension (&view));
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -15129,6 +15360,7 @@ fnct_CoordDimension (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int len;
     char *p_dim = NULL;
     char *p_result = NULL;
@@ -15149,6 +15381,20 @@ fnct_CoordDimension (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (view.DimensionModel == GAIA_XY_Z)
+	      p_dim = "XYZ";
+	  else if (view.DimensionModel == GAIA_XY_M)
+	      p_dim = "XYM";
+	  else if (view.DimensionModel == GAIA_XY_Z_M)
+	      p_dim = "XYZM";
+	  else
+	      p_dim = "XY";
+	  sqlite3_result_text (context, p_dim, strlen (p_dim), SQLITE_STATIC);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -15193,6 +15439,7 @@ fnct_NDims (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int result = 0;
     gaiaGeomCollPtr geo = NULL;
     int gpkg_amphibious = 0;
@@ -15211,6 +15458,18 @@ fnct_NDims (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (view.DimensionModel == GAIA_XY_Z
+	      || view.DimensionModel == GAIA_XY_M)
+	      sqlite3_result_int (context, 3);
+	  else if (view.DimensionModel == GAIA_XY_Z_M)
+	      sqlite3_result_int (context, 4);
+	  else
+	      sqlite3_result_int (context, 2);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -15248,6 +15507,8 @@ fnct_GeometryType (sqlite3_context * context, int argc, sqlite3_value ** argv)
     int n_bytes;
     int len;
     int type;
+    gaiaGeomView view;
+    int view_ok = 0;
     char *p_type = NULL;
     char *p_result = NULL;
     gaiaGeomCollPtr geo = NULL;
@@ -15259,8 +15520,15 @@ fnct_GeometryType (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
-    geo = gaiaFromSpatiaLiteBlobWkb (p_blob, n_bytes);
-    if (!geo)
+    if (gaiaGeomViewFromBlob (&view, p_blob, n_bytes))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  type = gaiaGeomViewGeometryType (&view);
+	  view_ok = 1;
+      }
+    else
+	geo = gaiaFromSpatiaLiteBlobWkb (p_blob, n_bytes);
+    if (!geo && !view_ok)
       {
 #ifdef ENABLE_GEOPACKAGE	/* GEOPACKAGE enabled: supporting GPKG geometries */
 	  if (gaiaIsValidGPB (p_blob, n_bytes))
@@ -15281,7 +15549,8 @@ fnct_GeometryType (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     else
       {
-	  type = gaiaGeometryType (geo);
+	  if (geo != NULL)
+	      type = gaiaGeometryType (geo);
 	  switch (type)
 	    {
 	    case GAIA_POINT:
@@ -15547,6 +15816,7 @@ fnct_SRID (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     gaiaGeomCollPtr geo = NULL;
     GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
     if (sqlite3_value_type (argv[0]) != SQLITE_BLOB)
@@ -15556,6 +15826,12 @@ fnct_SRID (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (gaiaGeomViewFromBlob (&view, p_blob, n_bytes))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, view.Srid);
+	  return;
+      }
     geo = gaiaFromSpatiaLiteBlobWkb (p_blob, n_bytes);
     if (!geo)
       {
@@ -15643,6 +15919,7 @@ fnct_IsEmpty (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     gaiaGeomCollPtr geo = NULL;
     GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
     if (sqlite3_value_type (argv[0]) != SQLITE_BLOB)
@@ -15652,6 +15929,12 @@ fnct_IsEmpty (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (gaiaGeomViewFromBlob (&view, p_blob, n_bytes))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, view.NumItems == 0);
+	  return;
+      }
     geo = gaiaFromSpatiaLiteBlobWkb (p_blob, n_bytes);
     if (!geo)
       {
@@ -17078,6 +17361,12 @@ fnct_X (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
+    double x;
+    double y;
+    double z;
+    double m;
     gaiaGeomCollPtr geo = NULL;
     gaiaPointPtr point;
     int gpkg_amphibious = 0;
@@ -17096,6 +17385,16 @@ fnct_X (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_POINT, &item)
+	      || !gaiaGeomViewGetVertex (&view, &item, 0, &x, &y, &z, &m))
+	      sqlite3_result_null (context);
+	  else
+	      sqlite3_result_double (context, x);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17123,6 +17422,12 @@ fnct_Y (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
+    double x;
+    double y;
+    double z;
+    double m;
     gaiaGeomCollPtr geo = NULL;
     gaiaPointPtr point;
     int gpkg_amphibious = 0;
@@ -17141,6 +17446,16 @@ fnct_Y (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_POINT, &item)
+	      || !gaiaGeomViewGetVertex (&view, &item, 0, &x, &y, &z, &m))
+	      sqlite3_result_null (context);
+	  else
+	      sqlite3_result_double (context, y);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17168,6 +17483,12 @@ fnct_Z (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
+    double x;
+    double y;
+    double z;
+    double m;
     gaiaGeomCollPtr geo = NULL;
     gaiaPointPtr point;
     int gpkg_amphibious = 0;
@@ -17186,6 +17507,19 @@ fnct_Z (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_POINT, &item)
+	      || !gaiaGeomViewGetVertex (&view, &item, 0, &x, &y, &z, &m))
+	      sqlite3_result_null (context);
+	  else if (item.DimensionModel == GAIA_XY_Z
+		   || item.DimensionModel == GAIA_XY_Z_M)
+	      sqlite3_result_double (context, z);
+	  else
+	      sqlite3_result_null (context);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17219,6 +17553,12 @@ fnct_M (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
+    double x;
+    double y;
+    double z;
+    double m;
     gaiaGeomCollPtr geo = NULL;
     gaiaPointPtr point;
     int gpkg_amphibious = 0;
@@ -17237,6 +17577,19 @@ fnct_M (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_POINT, &item)
+	      || !gaiaGeomViewGetVertex (&view, &item, 0, &x, &y, &z, &m))
+	      sqlite3_result_null (context);
+	  else if (item.DimensionModel == GAIA_XY_M
+		   || item.DimensionModel == GAIA_XY_Z_M)
+	      sqlite3_result_double (context, m);
+	  else
+	      sqlite3_result_null (context);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17270,6 +17623,8 @@ fnct_NumPoints (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
     gaiaGeomCollPtr geo = NULL;
     gaiaLinestringPtr line;
     int gpkg_amphibious = 0;
@@ -17288,6 +17643,15 @@ fnct_NumPoints (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_LINESTRING, &item))
+	      sqlite3_result_null (context);
+	  else
+	      sqlite3_result_int (context, item.Points);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17555,6 +17919,8 @@ fnct_NumInteriorRings (sqlite3_context * context, int argc,
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
+    gaiaGeomViewItem item;
     gaiaGeomCollPtr geo = NULL;
     gaiaPolygonPtr polyg;
     int gpkg_amphibious = 0;
@@ -17573,6 +17939,15 @@ fnct_NumInteriorRings (sqlite3_context * context, int argc,
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  if (!simpleViewItem (&view, GAIA_POLYGON, &item))
+	      sqlite3_result_null (context);
+	  else
+	      sqlite3_result_int (context, item.Rings - 1);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17712,6 +18087,7 @@ fnct_NumGeometries (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int cnt = 0;
     gaiaPointPtr point;
     gaiaLinestringPtr line;
@@ -17733,6 +18109,12 @@ fnct_NumGeometries (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, view.NumItems);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17777,6 +18159,7 @@ fnct_NPoints (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int cnt = 0;
     int ib;
     gaiaPointPtr point;
@@ -17800,6 +18183,12 @@ fnct_NPoints (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, view.NumVertices);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -17852,6 +18241,7 @@ fnct_NRings (sqlite3_context * context, int argc, sqlite3_value ** argv)
 */
     unsigned char *p_blob;
     int n_bytes;
+    gaiaGeomView view;
     int cnt = 0;
     gaiaPolygonPtr polyg;
     gaiaGeomCollPtr geo = NULL;
@@ -17871,6 +18261,12 @@ fnct_NRings (sqlite3_context * context, int argc, sqlite3_value ** argv)
       }
     p_blob = (unsigned char *) sqlite3_value_blob (argv[0]);
     n_bytes = sqlite3_value_bytes (argv[0]);
+    if (simpleView (context, p_blob, n_bytes, &view))
+      {
+	  /* fast path: no need to parse the whole Geometry */
+	  sqlite3_result_int (context, view.NumRings);
+	  return;
+      }
     geo =
 	gaiaFromSpatiaLiteBlobWkbEx (p_blob, n_bytes, gpkg_mode,
 				     gpkg_amphibious);
@@ -21478,6 +21874,24 @@ fnct_LocateBetweenMeasures (sqlite3_context * context, int argc,
 
 #ifndef OMIT_PROJ		/* including PROJ.4 */
 
+static void
+checkSridCacheValidity (sqlite3_context * context,
+			struct splite_internal_cache *cache)
+{
+/* 
+/ SRID lookups are cached only within the same SQL statement,
+/ so to always honor any change affecting "spatial_ref_sys"
+*/
+    if (cache == NULL)
+	return;
+    if (sqlite3_get_auxdata (context, 1) == NULL)
+      {
+	  /* first call within this statement */
+	  splite_reset_srid_cache (cache);
+	  sqlite3_set_auxdata (context, 1, cache, NULL);
+      }
+}
+
 static void
 fnct_Transform (sqlite3_context * context, int argc, sqlite3_value ** argv)
 {
@@ -21532,8 +21946,9 @@ fnct_Transform (sqlite3_context * context, int argc, sqlite3_value ** argv)
     else
       {
 	  srid_from = geo->Srid;
-	  getProjParams (sqlite, srid_from, &proj_from);
-	  getProjParams (sqlite, srid_to, &proj_to);
+	  checkSridCacheValidity (context, cache);
+	  getProjParamsEx (sqlite, cache, srid_from, &proj_from);
+	  getProjParamsEx (sqlite, cache, srid_to, &proj_to);
 	  if (proj_to == NULL || proj_from == NULL)
 	    {
 		if (proj_from)
@@ -21629,8 +22044,9 @@ fnct_TransformXY (sqlite3_context * context, int argc, sqlite3_value ** argv)
     else
       {
 	  srid_from = geo->Srid;
-	  getProjParams (sqlite, srid_from, &proj_from);
-	  getProjParams (sqlite, srid_to, &proj_to);
+	  checkSridCacheValidity (context, cache);
+	  getProjParamsEx (sqlite, cache, srid_from, &proj_from);
+	  getProjParamsEx (sqlite, cache, srid_to, &proj_to);
 	  if (proj_to == NULL || proj_from == NULL)
 	    {
 		if (proj_from)
@@ -21664,6 +22080,425 @@ fnct_TransformXY (sqlite3_context * context, int argc, sqlite3_value ** argv)
     gaiaFreeGeomColl (geo);
 }
 
+static int
+do_transform_column_batch (sqlite3 * sqlite, void *data,
+			   sqlite3_stmt * stmt_in, sqlite3_stmt * stmt_out,
+			   char *proj_from, char *proj_to,
+			   int srid_to, int gpkg_mode, int gpkg_amphibious,
+			   int tiny_point, int limit, int first,
+			   sqlite3_int64 * last_rowid)
+{
+/* transforming a single batch of rows; the batch is fully read before
+/ writing anything back, so that the reading cursor never traverses
+/ rows it has just updated
+/ the first batch has no lower ROWID bound, any other one starts 
+/ just after LAST_ROWID
+/
+/ returns the number of rows read, or -1 on failure */
+    int ret;
+    int n = 0;
+    int i;
+    int rows = 0;
+    sqlite3_int64 *rowids;
+    unsigned char **blobs;
+    int *sizes;
+    int ok = 1;
+
+    rowids = malloc (sizeof (sqlite3_int64) * limit);
+    blobs = malloc (sizeof (unsigned char *) * limit);
+    sizes = malloc (sizeof (int) * limit);
+    if (rowids == NULL || blobs == NULL || sizes == NULL)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: insufficient memory\n");
+	  if (rowids != NULL)
+	      free (rowids);
+	  if (blobs != NULL)
+	      free (blobs);
+	  if (sizes != NULL)
+	      free (sizes);
+	  return -1;
+      }
+    sqlite3_reset (stmt_in);
+    sqlite3_clear_bindings (stmt_in);
+    if (first)
+	sqlite3_bind_int (stmt_in, 1, limit);
+    else
+      {
+	  sqlite3_bind_int64 (stmt_in, 1, *last_rowid);
+	  sqlite3_bind_int (stmt_in, 2, limit);
+      }
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  gaiaGeomCollPtr geo;
+	  gaiaGeomCollPtr result;
+	  sqlite3_int64 rowid;
+	  ret = sqlite3_step (stmt_in);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret != SQLITE_ROW)
+	    {
+		spatialite_e ("TransformGeometryColumn() error: %s\n",
+			      sqlite3_errmsg (sqlite));
+		ok = 0;
+		break;
+	    }
+	  rowid = sqlite3_column_int64 (stmt_in, 0);
+	  *last_rowid = rowid;
+	  rows++;
+	  if (sqlite3_column_type (stmt_in, 1) != SQLITE_BLOB)
+	      continue;		/* NULL geometry: nothing to transform */
+	  geo =
+	      gaiaFromSpatiaLiteBlobWkbEx ((const unsigned char *)
+					   sqlite3_column_blob (stmt_in, 1),
+					   sqlite3_column_bytes (stmt_in, 1),
+					   gpkg_mode, gpkg_amphibious);
+	  if (geo == NULL)
+	    {
+		spatialite_e
+		    ("TransformGeometryColumn() error: invalid Geometry at ROWID=%lld\n",
+		     rowid);
+		ok = 0;
+		break;
+	    }
+	  if (data != NULL)
+	      result = gaiaTransform_r (data, geo, proj_from, proj_to);
+	  else
+	      result = gaiaTransform (geo, proj_from, proj_to);
+	  gaiaFreeGeomColl (geo);
+	  if (result == NULL)
+	    {
+		spatialite_e
+		    ("TransformGeometryColumn() error: unable to transform ROWID=%lld\n",
+		     rowid);
+		ok = 0;
+		break;
+	    }
+	  result->Srid = srid_to;
+	  blobs[n] = NULL;
+	  gaiaToSpatiaLiteBlobWkbEx2 (result, &(blobs[n]), &(sizes[n]),
+				      gpkg_mode, tiny_point);
+	  gaiaFreeGeomColl (result);
+	  if (blobs[n] == NULL)
+	    {
+		spatialite_e
+		    ("TransformGeometryColumn() error: insufficient memory\n");
+		ok = 0;
+		break;
+	    }
+	  rowids[n++] = rowid;
+      }
+    sqlite3_reset (stmt_in);
+
+    for (i = 0; i < n; i++)
+      {
+	  /* writing back the transformed Geometries */
+	  if (!ok)
+	    {
+		free (blobs[i]);
+		continue;
+	    }
+	  sqlite3_reset (stmt_out);
+	  sqlite3_clear_bindings (stmt_out);
+	  sqlite3_bind_blob (stmt_out, 1, blobs[i], sizes[i], free);
+	  sqlite3_bind_int64 (stmt_out, 2, rowids[i]);
+	  ret = sqlite3_step (stmt_out);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		spatialite_e ("TransformGeometryColumn() error: %s\n",
+			      sqlite3_errmsg (sqlite));
+		ok = 0;
+	    }
+      }
+    free (rowids);
+    free (blobs);
+    free (sizes);
+    if (!ok)
+	return -1;
+    return rows;
+}
+
+static void
+fnct_TransformGeometryColumn (sqlite3_context * context, int argc,
+			      sqlite3_value ** argv)
+{
+/* SQL function:
+/ TransformGeometryColumn(table, column, srid [, batch_size ] )
+/
+/ reprojects in place all Geometries stored into TABLE.COLUMN,
+/ updating accordingly the SRID registered into GEOMETRY_COLUMNS
+/ rows are processed in batches of BATCH_SIZE (default 1024),
+/ and the whole operation is atomic
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table;
+    const char *column;
+    int srid_from = -1;
+    int srid_to;
+    int batch_size = 1024;
+    int metadata_version;
+    int exists = 0;
+    char *proj_from = NULL;
+    char *proj_to = NULL;
+    char *sql;
+    char *xtable;
+    char *xcolumn;
+    char *errMsg = NULL;
+    int ret;
+    int rows;
+    sqlite3_int64 last_rowid;
+    int first;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *stmt_first = NULL;
+    sqlite3_stmt *stmt_in = NULL;
+    sqlite3_stmt *stmt_out = NULL;
+    int gpkg_amphibious = 0;
+    int gpkg_mode = 0;
+    int tiny_point = 0;
+    void *data = sqlite3_user_data (context);
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache != NULL)
+      {
+	  gpkg_amphibious = cache->gpkg_amphibious_mode;
+	  gpkg_mode = cache->gpkg_mode;
+	  tiny_point = cache->tinyPointEnabled;
+      }
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: argument 1 [table_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    table = (const char *) sqlite3_value_text (argv[0]);
+    if (sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: argument 2 [column_name] is not of the String type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    column = (const char *) sqlite3_value_text (argv[1]);
+    if (sqlite3_value_type (argv[2]) != SQLITE_INTEGER)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: argument 3 [SRID] is not of the Integer type\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    srid_to = sqlite3_value_int (argv[2]);
+    if (argc == 4)
+      {
+	  if (sqlite3_value_type (argv[3]) != SQLITE_INTEGER)
+	    {
+		spatialite_e
+		    ("TransformGeometryColumn() error: argument 4 [batch_size] is not of the Integer type\n");
+		sqlite3_result_int (context, 0);
+		return;
+	    }
+	  batch_size = sqlite3_value_int (argv[3]);
+	  if (batch_size <= 0)
+	    {
+		spatialite_e
+		    ("TransformGeometryColumn() error: argument 4 [batch_size] must be a positive Integer\n");
+		sqlite3_result_int (context, 0);
+		return;
+	    }
+      }
+    metadata_version = checkSpatialMetaData (sqlite);
+    if (metadata_version != 1 && metadata_version != 3)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: unsupported Spatial MetaData layout\n");
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+
+/* retrieving the current SRID */
+    sql = sqlite3_mprintf ("SELECT srid FROM geometry_columns "
+			   "WHERE Lower(f_table_name) = Lower(%Q) "
+			   "AND Lower(f_geometry_column) = Lower(%Q)", table,
+			   column);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n",
+			sqlite3_errmsg (sqlite));
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		srid_from = sqlite3_column_int (stmt, 0);
+		exists = 1;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (!exists)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: %s.%s isn't a registered Geometry column\n",
+	       table, column);
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    if (srid_from == srid_to)
+      {
+	  /* nothing to do */
+	  sqlite3_result_int (context, 1);
+	  return;
+      }
+    checkSridCacheValidity (context, cache);
+    getProjParamsEx (sqlite, cache, srid_from, &proj_from);
+    getProjParamsEx (sqlite, cache, srid_to, &proj_to);
+    if (proj_to == NULL || proj_from == NULL)
+      {
+	  spatialite_e
+	      ("TransformGeometryColumn() error: undefined SRID (%d -> %d)\n",
+	       srid_from, srid_to);
+	  goto stop;
+      }
+
+/* 
+/ the whole operation is wrapped within a SAVEPOINT; the SRID
+/ registered into GEOMETRY_COLUMNS must be updated first, otherwise
+/ the Triggers would reject the transformed Geometries
+*/
+    ret =
+	sqlite3_exec (sqlite, "SAVEPOINT splite_transform_column", NULL, NULL,
+		      &errMsg);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n", errMsg);
+	  sqlite3_free (errMsg);
+	  goto stop;
+      }
+    sql = sqlite3_mprintf ("UPDATE geometry_columns SET srid = %d "
+			   "WHERE Lower(f_table_name) = Lower(%Q) "
+			   "AND Lower(f_geometry_column) = Lower(%Q)", srid_to,
+			   table, column);
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &errMsg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n", errMsg);
+	  sqlite3_free (errMsg);
+	  goto rollback;
+      }
+
+    xtable = gaiaDoubleQuotedSql (table);
+    xcolumn = gaiaDoubleQuotedSql (column);
+    sql =
+	sqlite3_mprintf ("SELECT ROWID, \"%s\" FROM \"%s\" "
+			 "ORDER BY ROWID LIMIT ?", xcolumn, xtable);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_first, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n",
+			sqlite3_errmsg (sqlite));
+	  free (xtable);
+	  free (xcolumn);
+	  goto rollback;
+      }
+    sql =
+	sqlite3_mprintf ("SELECT ROWID, \"%s\" FROM \"%s\" WHERE ROWID > ? "
+			 "ORDER BY ROWID LIMIT ?", xcolumn, xtable);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_in, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n",
+			sqlite3_errmsg (sqlite));
+	  free (xtable);
+	  free (xcolumn);
+	  goto rollback;
+      }
+    sql =
+	sqlite3_mprintf ("UPDATE \"%s\" SET \"%s\" = ? WHERE ROWID = ?",
+			 xtable, xcolumn);
+    free (xtable);
+    free (xcolumn);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_out, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n",
+			sqlite3_errmsg (sqlite));
+	  goto rollback;
+      }
+
+    last_rowid = 0;
+    first = 1;
+    while (1)
+      {
+	  rows =
+	      do_transform_column_batch (sqlite, data,
+					 first ? stmt_first : stmt_in,
+					 stmt_out, proj_from, proj_to, srid_to,
+					 gpkg_mode, gpkg_amphibious,
+					 tiny_point, batch_size, first,
+					 &last_rowid);
+	  if (rows < 0)
+	      goto rollback;
+	  if (rows < batch_size)
+	      break;
+	  first = 0;
+      }
+    sqlite3_finalize (stmt_first);
+    sqlite3_finalize (stmt_in);
+    sqlite3_finalize (stmt_out);
+    stmt_first = NULL;
+    stmt_in = NULL;
+    stmt_out = NULL;
+
+    ret =
+	sqlite3_exec (sqlite, "RELEASE SAVEPOINT splite_transform_column",
+		      NULL, NULL, &errMsg);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("TransformGeometryColumn() error: %s\n", errMsg);
+	  sqlite3_free (errMsg);
+	  goto rollback;
+      }
+    free (proj_from);
+    free (proj_to);
+    sql = sqlite3_mprintf ("Geometry transformed from SRID=%d to SRID=%d",
+			   srid_from, srid_to);
+    updateSpatiaLiteHistory (sqlite, table, column, sql);
+    sqlite3_free (sql);
+    sqlite3_result_int (context, 1);
+    return;
+
+  rollback:
+    if (stmt_first != NULL)
+	sqlite3_finalize (stmt_first);
+    if (stmt_in != NULL)
+	sqlite3_finalize (stmt_in);
+    if (stmt_out != NULL)
+	sqlite3_finalize (stmt_out);
+    sqlite3_exec (sqlite, "ROLLBACK TO SAVEPOINT splite_transform_column",
+		  NULL, NULL, NULL);
+    sqlite3_exec (sqlite, "RELEASE SAVEPOINT splite_transform_column", NULL,
+		  NULL, NULL);
+  stop:
+    if (proj_from)
+	free (proj_from);
+    if (proj_to)
+	free (proj_to);
+    sqlite3_result_int (context, 0);
+}
+
 #endif /* end including PROJ.4 */
 
 #ifndef OMIT_GEOS		/* including GEOS */
@@ -23798,7 +24633,29 @@ fnct_Union_step (sqlite3_context * context, int argc, sqlite3_value ** argv)
 				     gpkg_amphibious);
     if (!geom)
 	return;
-    p = sqlite3_aggregate_context (context, sizeof (struct gaia_geom_chain **));
+    if (cache != NULL)
+      {
+	  /* using the multi-threaded engine */
+	  struct gaia_union_aggregate *aggr =
+	      sqlite3_aggregate_context (context,
+					 sizeof (struct gaia_union_aggregate));
+	  if (aggr->engine == NULL && aggr->chain == NULL)
+	    {
+		/* this is the first row */
+		aggr->engine = splite_union_engine_alloc (cache);
+	    }
+	  if (aggr->engine != NULL)
+	    {
+		if (!splite_union_engine_add (aggr->engine, geom))
+		    gaiaFreeGeomColl (geom);
+		return;
+	    }
+	  /* insufficient memory: using the single-threaded chain */
+	  p = &(aggr->chain);
+      }
+    else
+	p = sqlite3_aggregate_context (context,
+				       sizeof (struct gaia_geom_chain **));
     if (!(*p))
       {
 	  /* this is the first row */
@@ -23869,7 +24726,21 @@ fnct_Union_final (sqlite3_context * context)
 	  sqlite3_result_null (context);
 	  return;
       }
-    chain = *p;
+    if (cache != NULL)
+      {
+	  struct gaia_union_aggregate *aggr =
+	      (struct gaia_union_aggregate *) p;
+	  if (aggr->engine != NULL)
+	    {
+		/* using the multi-threaded engine */
+		result = splite_union_engine_final (aggr->engine);
+		splite_union_engine_free (aggr->engine);
+		goto done;
+	    }
+	  chain = aggr->chain;
+      }
+    else
+	chain = *p;
 
 /* applying UnaryUnion */
     item = chain->first;
@@ -23900,6 +24771,7 @@ fnct_Union_final (sqlite3_context * context)
     gaiaFreeGeomColl (aggregate);
     gaia_free_geom_chain (chain);
 
+  done:
     if (result == NULL)
 	sqlite3_result_null (context);
     else if (gaiaIsEmpty (result))
@@ -34287,6 +35159,19 @@ fnct_create_routing (sqlite3_context * context, int argc, sqlite3_value ** argv)
 /               geom-column TEXT , cost-column TEXT , name-column TEXT ,
 /               a-star-enabled BOOLEAN , bidirectional BOOLEAN ,
 /               oneway-from TEXT , oneway-to TEXT , overwrite BOOLEAN )
+/ CreateRouting(routing-data-table TEXT , virtual-routing-table TEXT , 
+/               input-table TEXT , from-column TEXT , to-column TEXT , 
+/               geom-column TEXT , cost-column TEXT , name-column TEXT ,
+/               a-star-enabled BOOLEAN , bidirectional BOOLEAN ,
+/               oneway-from TEXT , oneway-to TEXT , overwrite BOOLEAN ,
+/               contraction-hierarchies BOOLEAN )
+/ CreateRouting(routing-data-table TEXT , virtual-routing-table TEXT , 
+/               input-table TEXT , from-column TEXT , to-column TEXT , 
+/               geom-column TEXT , cost-column TEXT , name-column TEXT ,
+/               a-star-enabled BOOLEAN , bidirectional BOOLEAN ,
+/               oneway-from TEXT , oneway-to TEXT , overwrite BOOLEAN ,
+/               contraction-hierarchies BOOLEAN , time-profiles TEXT ,
+/               turn-restrictions TEXT )
 /
 / returns:
 / 1 on succes
@@ -34305,6 +35190,9 @@ fnct_create_routing (sqlite3_context * context, int argc, sqlite3_value ** argv)
     const char *oneway_from = NULL;
     const char *oneway_to = NULL;
     int overwrite = 0;
+    int contraction_hierarchies = 0;
+    const char *time_profiles = NULL;
+    const char *turn_restrictions = NULL;
     const char *msg;
     sqlite3 *sqlite = sqlite3_context_db_handle (context);
     struct splite_internal_cache *cache = sqlite3_user_data (context);
@@ -34372,11 +35260,32 @@ fnct_create_routing (sqlite3_context * context, int argc, sqlite3_value ** argv)
 	      goto invalid_argument_13;
 	  overwrite = sqlite3_value_int (argv[12]);
       }
-    if (gaia_create_routing
+    if (argc >= 14)
+      {
+	  if (sqlite3_value_type (argv[13]) != SQLITE_INTEGER)
+	      goto invalid_argument_14;
+	  contraction_hierarchies = sqlite3_value_int (argv[13]);
+      }
+    if (argc >= 16)
+      {
+	  if (sqlite3_value_type (argv[14]) == SQLITE_NULL)
+	      time_profiles = NULL;
+	  else if (sqlite3_value_type (argv[14]) == SQLITE_TEXT)
+	      time_profiles = (const char *) sqlite3_value_text (argv[14]);
+	  else
+	      goto invalid_argument_15;
+	  if (sqlite3_value_type (argv[15]) == SQLITE_NULL)
+	      turn_restrictions = NULL;
+	  else if (sqlite3_value_type (argv[15]) == SQLITE_TEXT)
+	      turn_restrictions = (const char *) sqlite3_value_text (argv[15]);
+	  else
+	      goto invalid_argument_16;
+      }
+    if (gaia_create_routing_ex2
 	(sqlite, cache, routing_data_table, virtual_routing_table,
 	 input_table, from_column, to_column, geom_column, cost_column,
 	 name_column, a_star_enabled, bidirectional, oneway_from, oneway_to,
-	 overwrite))
+	 overwrite, contraction_hierarchies, time_profiles, turn_restrictions))
 	sqlite3_result_int (context, 1);
     else
       {
@@ -34470,6 +35379,84 @@ fnct_create_routing (sqlite3_context * context, int argc, sqlite3_value ** argv)
 	"CreateRouting exception - illegal OverWrite option [not an INTEGER].";
     sqlite3_result_error (context, msg, -1);
     return;
+
+  invalid_argument_14:
+    msg =
+	"CreateRouting exception - illegal ContractionHierarchies option [not an INTEGER].";
+    sqlite3_result_error (context, msg, -1);
+    return;
+
+  invalid_argument_15:
+    msg =
+	"CreateRouting exception - illegal TimeProfiles Table Name [not a TEXT string].";
+    sqlite3_result_error (context, msg, -1);
+    return;
+
+  invalid_argument_16:
+    msg =
+	"CreateRouting exception - illegal TurnRestrictions Table Name [not a TEXT string].";
+    sqlite3_result_error (context, msg, -1);
+    return;
+}
+
+static void
+fnct_update_routing (sqlite3_context * context, int argc, sqlite3_value ** argv)
+{
+/* SQL function:
+/ UpdateRouting(routing-data-table TEXT , changes-table TEXT)
+/
+/ returns:
+/ 1 on succes
+/ raises an exception on invalid arguments or errors
+*/
+    const char *routing_data_table;
+    const char *changes_table;
+    const char *msg;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+	goto invalid_argument_1;
+    routing_data_table = (const char *) sqlite3_value_text (argv[0]);
+    if (sqlite3_value_type (argv[1]) != SQLITE_TEXT)
+	goto invalid_argument_2;
+    changes_table = (const char *) sqlite3_value_text (argv[1]);
+    if (gaia_update_routing (sqlite, cache, routing_data_table, changes_table))
+      {
+	  /*
+	     / gaia_update_routing() could resolve into another copy of the
+	     / library when this one has been loaded as an extension, so the
+	     / NETWORK cache of this copy must be outdated here as well
+	   */
+	  splite_routing_cache_outdate (sqlite, routing_data_table);
+	  sqlite3_result_int (context, 1);
+      }
+    else
+      {
+	  /* there was an error, raising an Exception */
+	  char *msg_err;
+	  msg = gaia_create_routing_get_last_error (cache);
+	  if (msg == NULL)
+	      msg_err =
+		  sqlite3_mprintf ("UpdateRouting exception - Unknown reason");
+	  else
+	      msg_err = sqlite3_mprintf ("UpdateRouting exception - %s", msg);
+	  sqlite3_result_error (context, msg_err, -1);
+	  sqlite3_free (msg_err);
+      }
+    return;
+
+  invalid_argument_1:
+    msg =
+	"UpdateRouting exception - illegal Routing-Data Table Name [not a TEXT string].";
+    sqlite3_result_error (context, msg, -1);
+    return;
+
+  invalid_argument_2:
+    msg =
+	"UpdateRouting exception - illegal Changes Table Name [not a TEXT string].";
+    sqlite3_result_error (context, msg, -1);
+    return;
 }
 
 static void
@@ -41640,6 +42627,240 @@ fnct_isTinyPointEnabled (sqlite3_context * context, int argc,
     sqlite3_result_int (context, enabled);
 }
 
+static void
+fnct_setGeosCacheSize (sqlite3_context * context, int argc,
+		       sqlite3_value ** argv)
+{
+/* SQL function:
+/ SetGeosCacheSize ( int size )
+/ sets the max number of items held by the GEOS cache (LRU)
+/ any currently cached item will be discarded
+/
+/ returns: nothing
+*/
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER)
+	set_geos_cache_size (cache, sqlite3_value_int (argv[0]));
+}
+
+static void
+fnct_getGeosCacheSize (sqlite3_context * context, int argc,
+		       sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetGeosCacheSize ( void )
+/
+/ returns: the max number of items held by the GEOS cache
+*/
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    sqlite3_result_int (context, get_geos_cache_size (cache));
+}
+
+static void
+fnct_getGeosCacheHits (sqlite3_context * context, int argc,
+		       sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetGeosCacheHits ( void )
+/
+/ returns: how many times a cached Prepared Geometry was reused
+*/
+    unsigned long hits;
+    unsigned long misses;
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    get_geos_cache_stats (cache, &hits, &misses);
+    sqlite3_result_int64 (context, hits);
+}
+
+static void
+fnct_getGeosCacheMisses (sqlite3_context * context, int argc,
+			 sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetGeosCacheMisses ( void )
+/
+/ returns: how many times the GEOS cache was unable to supply
+/          a Prepared Geometry
+*/
+    unsigned long hits;
+    unsigned long misses;
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    get_geos_cache_stats (cache, &hits, &misses);
+    sqlite3_result_int64 (context, misses);
+}
+
+static void
+fnct_resetGeosCacheStats (sqlite3_context * context, int argc,
+			  sqlite3_value ** argv)
+{
+/* SQL function:
+/ ResetGeosCacheStats ( void )
+/
+/ returns: nothing
+*/
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    reset_geos_cache_stats (cache);
+}
+
+static void
+fnct_setUnionThreads (sqlite3_context * context, int argc,
+		      sqlite3_value ** argv)
+{
+/* SQL function:
+/ SetUnionThreads ( int threads )
+/ sets the number of worker threads used by the ST_Union aggregate
+/ 0 (or any negative value) means automatic (one for each CPU core)
+/
+/ returns: nothing
+*/
+    int threads;
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL)
+	return;
+    if (sqlite3_value_type (argv[0]) != SQLITE_INTEGER)
+	return;
+    threads = sqlite3_value_int (argv[0]);
+    if (threads < 0)
+	threads = 0;
+    if (threads > UNION_MAX_THREADS)
+	threads = UNION_MAX_THREADS;
+    cache->unionThreads = threads;
+}
+
+static void
+fnct_getUnionThreads (sqlite3_context * context, int argc,
+		      sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetUnionThreads ( void )
+/
+/ returns: the number of worker threads used by the ST_Union aggregate
+*/
+    const void *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    sqlite3_result_int (context, splite_get_union_threads (cache));
+}
+
+static void
+fnct_setRoutingHeap (sqlite3_context * context, int argc,
+		     sqlite3_value ** argv)
+{
+/* SQL function:
+/ SetRoutingHeap ( text kind )
+/ selects the priority queue used by VirtualRouting searches:
+/ 'D-ARY' (indexed 4-ary heap) or 'RADIX' (radix heap)
+/
+/ returns: 1 on success, 0 on failure (unknown kind)
+*/
+    const char *kind;
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL || sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    kind = (const char *) sqlite3_value_text (argv[0]);
+    if (strcasecmp (kind, "D-ARY") == 0 || strcasecmp (kind, "DARY") == 0)
+	cache->routingHeap = ROUTING_HEAP_DARY;
+    else if (strcasecmp (kind, "RADIX") == 0)
+	cache->routingHeap = ROUTING_HEAP_RADIX;
+    else
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    sqlite3_result_int (context, 1);
+}
+
+static void
+fnct_getRoutingHeap (sqlite3_context * context, int argc,
+		     sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetRoutingHeap ( void )
+/
+/ returns: the priority queue used by VirtualRouting searches
+/ ('D-ARY' or 'RADIX')
+*/
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL)
+      {
+	  sqlite3_result_null (context);
+	  return;
+      }
+    if (cache->routingHeap == ROUTING_HEAP_RADIX)
+	sqlite3_result_text (context, "RADIX", -1, SQLITE_STATIC);
+    else
+	sqlite3_result_text (context, "D-ARY", -1, SQLITE_STATIC);
+}
+
+#ifndef OMIT_KNN		/* only if KNN is enabled */
+
+static void
+fnct_enableKnnMirrorMode (sqlite3_context * context, int argc,
+			  sqlite3_value ** argv)
+{
+/* SQL function:
+/ EnableKnnMirrorMode ( void )
+/ KNN queries will use in-memory mirrors of the R*Trees
+/
+/ returns: nothing
+*/
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL)
+	return;
+    cache->knnMirror = 1;
+}
+
+static void
+fnct_disableKnnMirrorMode (sqlite3_context * context, int argc,
+			   sqlite3_value ** argv)
+{
+/* SQL function:
+/ DisableKnnMirrorMode ( void )
+/ releasing all the in-memory R*Tree mirrors
+/
+/ returns: nothing
+*/
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL)
+	return;
+    cache->knnMirror = 0;
+    free_knn_mirrors (cache->knnMirrors);
+    cache->knnMirrors = NULL;
+}
+
+static void
+fnct_getKnnMirrorMode (sqlite3_context * context, int argc,
+		       sqlite3_value ** argv)
+{
+/* SQL function:
+/ GetKnnMirrorMode ( void )
+/
+/ returns: TRUE or FALSE
+*/
+    struct splite_internal_cache *cache = sqlite3_user_data (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (cache == NULL)
+      {
+	  sqlite3_result_int (context, 0);
+	  return;
+      }
+    sqlite3_result_int (context, cache->knnMirror);
+}
+
+#endif /* end KNN conditional */
+
 static void
 fnct_addShapefileExtent (sqlite3_context * context, int argc,
 			 sqlite3_value ** argv)
@@ -42762,6 +43983,18 @@ register_spatialite_sql_functions (void *p_db, const void *p_cache)
     sqlite3_create_function_v2 (db, "CreateMbrCache", 2,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0,
 				fnct_CreateMbrCache, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "EnableDeferredSpatialIndex", 2,
+				SQLITE_UTF8, 0,
+				fnct_EnableDeferredSpatialIndex, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "DisableDeferredSpatialIndex", 2,
+				SQLITE_UTF8, 0,
+				fnct_DisableDeferredSpatialIndex, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "FlushDeferredSpatialIndex", 0,
+				SQLITE_UTF8, 0,
+				fnct_FlushDeferredSpatialIndex, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "FlushDeferredSpatialIndex", 2,
+				SQLITE_UTF8, 0,
+				fnct_FlushDeferredSpatialIndex, 0, 0, 0);
     sqlite3_create_function_v2 (db, "DisableSpatialIndex", 2,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0,
 				fnct_DisableSpatialIndex, 0, 0, 0);
@@ -42897,6 +44130,10 @@ register_spatialite_sql_functions (void *p_db, const void *p_cache)
     sqlite3_create_function_v2 (db, "AsSvg", 3,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, cache,
 				fnct_AsSvg3, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "ClusterTable", 2,
+				SQLITE_UTF8, 0, fnct_ClusterTable, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "ClusterTable", 3,
+				SQLITE_UTF8, 0, fnct_ClusterTable, 0, 0, 0);
     sqlite3_create_function_v2 (db, "CloneTable", 4,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0,
 				fnct_CloneTable, 0, 0, 0);
@@ -44491,6 +45728,12 @@ register_spatialite_sql_functions (void *p_db, const void *p_cache)
 				cache, fnct_create_routing, 0, 0, 0);
     sqlite3_create_function_v2 (db, "CreateRouting", 13, SQLITE_UTF8,
 				cache, fnct_create_routing, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "CreateRouting", 14, SQLITE_UTF8,
+				cache, fnct_create_routing, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "CreateRouting", 16, SQLITE_UTF8,
+				cache, fnct_create_routing, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "UpdateRouting", 2, SQLITE_UTF8,
+				cache, fnct_update_routing, 0, 0, 0);
     sqlite3_create_function_v2 (db, "CreateRouting_GetLastError", 0,
 				SQLITE_UTF8, cache,
 				fnct_create_routing_get_last_error, 0, 0, 0);
@@ -44757,6 +46000,41 @@ register_spatialite_sql_functions (void *p_db, const void *p_cache)
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, cache,
 				fnct_disableTinyPoint, 0, 0, 0);
 
+    sqlite3_create_function_v2 (db, "SetGeosCacheSize", 1,
+				SQLITE_UTF8, cache,
+				fnct_setGeosCacheSize, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetGeosCacheSize", 0,
+				SQLITE_UTF8, cache,
+				fnct_getGeosCacheSize, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetGeosCacheHits", 0,
+				SQLITE_UTF8, cache,
+				fnct_getGeosCacheHits, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetGeosCacheMisses", 0,
+				SQLITE_UTF8, cache,
+				fnct_getGeosCacheMisses, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "ResetGeosCacheStats", 0,
+				SQLITE_UTF8, cache,
+				fnct_resetGeosCacheStats, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "SetUnionThreads", 1,
+				SQLITE_UTF8, cache, fnct_setUnionThreads, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetUnionThreads", 0,
+				SQLITE_UTF8, cache, fnct_getUnionThreads, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "SetRoutingHeap", 1,
+				SQLITE_UTF8, cache, fnct_setRoutingHeap, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetRoutingHeap", 0,
+				SQLITE_UTF8, cache, fnct_getRoutingHeap, 0, 0, 0);
+#ifndef OMIT_KNN		/* only if KNN is enabled */
+    sqlite3_create_function_v2 (db, "EnableKnnMirrorMode", 0,
+				SQLITE_UTF8, cache, fnct_enableKnnMirrorMode, 0,
+				0, 0);
+    sqlite3_create_function_v2 (db, "DisableKnnMirrorMode", 0,
+				SQLITE_UTF8, cache, fnct_disableKnnMirrorMode,
+				0, 0, 0);
+    sqlite3_create_function_v2 (db, "GetKnnMirrorMode", 0,
+				SQLITE_UTF8, cache, fnct_getKnnMirrorMode, 0, 0,
+				0);
+#endif /* end KNN conditional */
+
 /* some Geodesic functions */
     sqlite3_create_function_v2 (db, "GreatCircleLength", 1,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, cache,
@@ -45023,6 +46301,12 @@ register_spatialite_sql_functions (void *p_db, const void *p_cache)
     sqlite3_create_function_v2 (db, "ST_TransformXY", 2,
 				SQLITE_UTF8 | SQLITE_DETERMINISTIC, cache,
 				fnct_TransformXY, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "TransformGeometryColumn", 3,
+				SQLITE_UTF8, cache,
+				fnct_TransformGeometryColumn, 0, 0, 0);
+    sqlite3_create_function_v2 (db, "TransformGeometryColumn", 4,
+				SQLITE_UTF8, cache,
+				fnct_TransformGeometryColumn, 0, 0, 0);
 
 #endif /* end including PROJ.4 */
 
@@ -46669,7 +47953,7 @@ init_spatialite_virtualtables (void *p_db, const void *p_cache)
 /* initializing the VirtualNetwork  extension */
     virtualnetwork_extension_init (db);
 /* initializing the VirtualRouting  extension */
-    virtualrouting_extension_init (db);
+    virtualrouting_extension_init (db, p_cache);
 /* initializing the MbrCache  extension */
     mbrcache_extension_init (db);
 /* initializing the VirtualFDO  extension */
@@ -46683,7 +47967,7 @@ init_spatialite_virtualtables (void *p_db, const void *p_cache)
 
 #ifndef OMIT_KNN		/* only if KNN is enabled */
 /* initializing the VirtualKNN  extension */
-    virtual_knn_extension_init (db);
+    virtual_knn_extension_init (db, p_cache);
 #endif /* end KNN conditional */
 
 #ifdef ENABLE_GEOPACKAGE	/* only if GeoPackage support is enabled */
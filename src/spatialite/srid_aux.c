@@ -1902,3 +1902,83 @@ getProjParams (void *p_sqlite, int srid, char **proj_params)
 /* last opportunity: search within GPKG srs */
     getProjParamsFromGeopackageTable (sqlite, srid, proj_params);
 }
+
+SPATIALITE_PRIVATE void
+getProjParamsEx (void *p_sqlite, const void *p_cache, int srid,
+		 char **proj_params)
+{
+/* 
+/ retrives the PROJ params from SPATIAL_SYS_REF table
+/ (reusing a previous lookup if possible)
+*/
+    int i;
+    int len;
+    struct splite_srid_cache_item *p;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    *proj_params = NULL;
+    if (cache == NULL)
+      {
+	  getProjParams (p_sqlite, srid, proj_params);
+	  return;
+      }
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+      {
+	  getProjParams (p_sqlite, srid, proj_params);
+	  return;
+      }
+
+/* searching within the SRID cache */
+    for (i = 0; i < MAX_SRID_CACHE; i++)
+      {
+	  p = &(cache->sridCache[i]);
+	  if (p->proj_params != NULL && p->srid == srid)
+	    {
+		len = strlen (p->proj_params);
+		*proj_params = malloc (len + 1);
+		strcpy (*proj_params, p->proj_params);
+		return;
+	    }
+      }
+
+    getProjParams (p_sqlite, srid, proj_params);
+    if (*proj_params == NULL)
+	return;
+
+/* updating the SRID cache (round robin) */
+    p = &(cache->sridCache[cache->sridCacheNext]);
+    if (p->proj_params != NULL)
+	free (p->proj_params);
+    p->srid = srid;
+    len = strlen (*proj_params);
+    p->proj_params = malloc (len + 1);
+    strcpy (p->proj_params, *proj_params);
+    cache->sridCacheNext += 1;
+    if (cache->sridCacheNext >= MAX_SRID_CACHE)
+	cache->sridCacheNext = 0;
+}
+
+SPATIALITE_PRIVATE void
+splite_reset_srid_cache (const void *p_cache)
+{
+/* resetting the SRID cache */
+    int i;
+    struct splite_srid_cache_item *p;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return;
+    for (i = 0; i < MAX_SRID_CACHE; i++)
+      {
+	  p = &(cache->sridCache[i]);
+	  if (p->proj_params != NULL)
+	      free (p->proj_params);
+	  p->srid = 0;
+	  p->proj_params = NULL;
+      }
+    cache->sridCacheNext = 0;
+}
@@ -1663,6 +1663,456 @@ has_virts_metadata (sqlite3 * sqlite)
     return defined;
 }
 
+#define SPLITE_SPIDX_HISTOGRAM	16
+
+static int
+do_compute_spatial_index_statistics (sqlite3 * sqlite, const char *table,
+				     const char *column)
+{
+/*
+/ computes SPATIAL_INDEX_STATISTICS [single table/geometry]
+/ - tree depth and node count
+/ - average MBR width and height
+/ - an histogram counting the MBR centers falling into each 
+/   cell of a 16x16 grid covering the whole R*Tree extent
+*/
+    int ret;
+    int i;
+    int error = 0;
+    int depth = 0;
+    sqlite3_int64 node_count = 0;
+    sqlite3_int64 row_count = 0;
+    double min_x = 0.0;
+    double min_y = 0.0;
+    double max_x = 0.0;
+    double max_y = 0.0;
+    double avg_width = 0.0;
+    double avg_height = 0.0;
+    double cell_width;
+    double cell_height;
+    unsigned int histogram[SPLITE_SPIDX_HISTOGRAM * SPLITE_SPIDX_HISTOGRAM];
+    unsigned char blob[SPLITE_SPIDX_HISTOGRAM * SPLITE_SPIDX_HISTOGRAM * 4];
+    char *raw;
+    char *quoted;
+    char *sql_statement;
+    sqlite3_stmt *stmt;
+
+    memset (histogram, 0, sizeof (histogram));
+    raw = sqlite3_mprintf ("idx_%s_%s", table, column);
+    quoted = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+
+/* R*Tree overall figures */
+    sql_statement =
+	sqlite3_mprintf ("SELECT Count(*), Min(xmin), Min(ymin), Max(xmax), "
+			 "Max(ymax), Avg(xmax - xmin), Avg(ymax - ymin), "
+			 "(SELECT Count(*) FROM \"%s_node\"), "
+			 "(SELECT data FROM \"%s_node\" WHERE nodeno = 1) "
+			 "FROM \"%s\"", quoted, quoted, quoted);
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  free (quoted);
+	  return 0;
+      }
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		row_count = sqlite3_column_int64 (stmt, 0);
+		if (row_count > 0)
+		  {
+		      min_x = sqlite3_column_double (stmt, 1);
+		      min_y = sqlite3_column_double (stmt, 2);
+		      max_x = sqlite3_column_double (stmt, 3);
+		      max_y = sqlite3_column_double (stmt, 4);
+		      avg_width = sqlite3_column_double (stmt, 5);
+		      avg_height = sqlite3_column_double (stmt, 6);
+		  }
+		node_count = sqlite3_column_int64 (stmt, 7);
+		if (sqlite3_column_type (stmt, 8) == SQLITE_BLOB
+		    && sqlite3_column_bytes (stmt, 8) >= 2)
+		  {
+		      /* the root node starts with the tree depth */
+		      const unsigned char *node = sqlite3_column_blob (stmt, 8);
+		      depth = (node[0] << 8) | node[1];
+		  }
+	    }
+	  else
+	      error = 1;
+      }
+    sqlite3_finalize (stmt);
+    if (error)
+      {
+	  free (quoted);
+	  return 0;
+      }
+
+/* computing the histogram of MBR centers */
+    cell_width = (max_x - min_x) / SPLITE_SPIDX_HISTOGRAM;
+    cell_height = (max_y - min_y) / SPLITE_SPIDX_HISTOGRAM;
+    sql_statement =
+	sqlite3_mprintf ("SELECT (xmin + xmax) / 2.0, (ymin + ymax) / 2.0 "
+			 "FROM \"%s\"", quoted);
+    free (quoted);
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		int cx = 0;
+		int cy = 0;
+		if (cell_width > 0.0)
+		    cx = (int) ((sqlite3_column_double (stmt, 0) -
+				 min_x) / cell_width);
+		if (cell_height > 0.0)
+		    cy = (int) ((sqlite3_column_double (stmt, 1) -
+				 min_y) / cell_height);
+		if (cx < 0)
+		    cx = 0;
+		if (cx >= SPLITE_SPIDX_HISTOGRAM)
+		    cx = SPLITE_SPIDX_HISTOGRAM - 1;
+		if (cy < 0)
+		    cy = 0;
+		if (cy >= SPLITE_SPIDX_HISTOGRAM)
+		    cy = SPLITE_SPIDX_HISTOGRAM - 1;
+		histogram[(cy * SPLITE_SPIDX_HISTOGRAM) + cx] += 1;
+	    }
+	  else
+	      error = 1;
+      }
+    sqlite3_finalize (stmt);
+    if (error)
+	return 0;
+    for (i = 0; i < SPLITE_SPIDX_HISTOGRAM * SPLITE_SPIDX_HISTOGRAM; i++)
+      {
+	  /* encoding the histogram as little endian 32 bit counters */
+	  blob[(i * 4) + 0] = histogram[i] & 0xff;
+	  blob[(i * 4) + 1] = (histogram[i] >> 8) & 0xff;
+	  blob[(i * 4) + 2] = (histogram[i] >> 16) & 0xff;
+	  blob[(i * 4) + 3] = (histogram[i] >> 24) & 0xff;
+      }
+
+/* updating SPATIAL_INDEX_STATISTICS */
+    sql_statement =
+	sqlite3_mprintf ("INSERT OR REPLACE INTO spatial_index_statistics "
+			 "(f_table_name, f_geometry_column, last_verified, "
+			 "row_count, node_count, tree_depth, extent_min_x, "
+			 "extent_min_y, extent_max_x, extent_max_y, avg_width, "
+			 "avg_height, histogram) VALUES (Lower(?), Lower(?), "
+			 "strftime('%%Y-%%m-%%dT%%H:%%M:%%fZ', 'now'), "
+			 "?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    sqlite3_bind_text (stmt, 1, table, strlen (table), SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 2, column, strlen (column), SQLITE_STATIC);
+    sqlite3_bind_int64 (stmt, 3, row_count);
+    sqlite3_bind_int64 (stmt, 4, node_count);
+    sqlite3_bind_int (stmt, 5, depth);
+    if (row_count > 0)
+      {
+	  sqlite3_bind_double (stmt, 6, min_x);
+	  sqlite3_bind_double (stmt, 7, min_y);
+	  sqlite3_bind_double (stmt, 8, max_x);
+	  sqlite3_bind_double (stmt, 9, max_y);
+	  sqlite3_bind_double (stmt, 10, avg_width);
+	  sqlite3_bind_double (stmt, 11, avg_height);
+      }
+    else
+      {
+	  sqlite3_bind_null (stmt, 6);
+	  sqlite3_bind_null (stmt, 7);
+	  sqlite3_bind_null (stmt, 8);
+	  sqlite3_bind_null (stmt, 9);
+	  sqlite3_bind_null (stmt, 10);
+	  sqlite3_bind_null (stmt, 11);
+      }
+    sqlite3_bind_blob (stmt, 12, blob, sizeof (blob), SQLITE_STATIC);
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	;
+    else
+	error = 1;
+    sqlite3_finalize (stmt);
+    if (error)
+	return 0;
+    return 1;
+}
+
+static int
+spatial_index_statistics (sqlite3 * sqlite, const char *table,
+			  const char *column)
+{
+/* updating SPATIAL_INDEX_STATISTICS [R*Tree Spatial Indices] */
+    char *sql_statement;
+    char *filter;
+    int ret;
+    int i;
+    char **results;
+    int rows;
+    int columns;
+    int error = 0;
+
+    if (checkSpatialMetaData (sqlite) != 3)
+	return 1;
+    ret =
+	sqlite3_exec (sqlite,
+		      "CREATE TABLE IF NOT EXISTS spatial_index_statistics (\n"
+		      "f_table_name TEXT NOT NULL,\n"
+		      "f_geometry_column TEXT NOT NULL,\n"
+		      "last_verified TIMESTAMP,\n"
+		      "row_count INTEGER,\n" "node_count INTEGER,\n"
+		      "tree_depth INTEGER,\n" "extent_min_x DOUBLE,\n"
+		      "extent_min_y DOUBLE,\n" "extent_max_x DOUBLE,\n"
+		      "extent_max_y DOUBLE,\n" "avg_width DOUBLE,\n"
+		      "avg_height DOUBLE,\n" "histogram BLOB,\n"
+		      "CONSTRAINT pk_spidx_statistics PRIMARY KEY "
+		      "(f_table_name, f_geometry_column))", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+
+/* only R*Trees whose statistics are missing or outdated */
+    if (table == NULL && column == NULL)
+	filter = sqlite3_mprintf ("%s", "");
+    else if (column == NULL)
+	filter =
+	    sqlite3_mprintf ("AND Lower(g.f_table_name) = Lower(%Q) ", table);
+    else
+	filter =
+	    sqlite3_mprintf
+	    ("AND Lower(g.f_table_name) = Lower(%Q) "
+	     "AND Lower(g.f_geometry_column) = Lower(%Q) ", table, column);
+    sql_statement =
+	sqlite3_mprintf ("SELECT g.f_table_name, g.f_geometry_column "
+			 "FROM geometry_columns AS g "
+			 "JOIN geometry_columns_statistics AS s ON "
+			 "(Lower(s.f_table_name) = Lower(g.f_table_name) AND "
+			 "Lower(s.f_geometry_column) = Lower(g.f_geometry_column)) "
+			 "LEFT JOIN spatial_index_statistics AS x ON "
+			 "(x.f_table_name = Lower(g.f_table_name) AND "
+			 "x.f_geometry_column = Lower(g.f_geometry_column)) "
+			 "WHERE g.spatial_index_enabled = 1 %s"
+			 "AND (x.last_verified IS NULL OR "
+			 "x.last_verified < s.last_verified)", filter);
+    sqlite3_free (filter);
+    ret =
+	sqlite3_get_table (sqlite, sql_statement, &results, &rows, &columns,
+			   NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 1; i <= rows; i++)
+      {
+	  char *p_table = NULL;
+	  char *p_column = NULL;
+	  if (!getRealSQLnames
+	      (sqlite, results[(i * columns) + 0], results[(i * columns) + 1],
+	       &p_table, &p_column))
+	      continue;
+	  if (!do_compute_spatial_index_statistics (sqlite, p_table, p_column))
+	      error = 1;
+	  free (p_table);
+	  free (p_column);
+	  if (error)
+	      break;
+      }
+    sqlite3_free_table (results);
+    if (error)
+	return 0;
+    return 1;
+}
+
+static double
+spatial_index_overlap (double cell_min, double cell_max, double frame_min,
+		       double frame_max)
+{
+/* fraction of a histogram cell overlapping the search frame */
+    double lo = (cell_min > frame_min) ? cell_min : frame_min;
+    double hi = (cell_max < frame_max) ? cell_max : frame_max;
+    if (cell_max <= cell_min)
+      {
+	  /* degenerate extent */
+	  if (cell_min >= frame_min && cell_min <= frame_max)
+	      return 1.0;
+	  return 0.0;
+      }
+    if (hi <= lo)
+	return 0.0;
+    return (hi - lo) / (cell_max - cell_min);
+}
+
+SPATIALITE_PRIVATE int
+splite_spatial_index_estimate (void *p_sqlite, const char *db_prefix,
+			       const char *table, const char *column,
+			       int has_frame, double min_x, double min_y,
+			       double max_x, double max_y,
+			       double *estimated_rows, double *estimated_cost)
+{
+/*
+/ estimating how many R*Tree entries will be returned by some
+/ search frame, based on SPATIAL_INDEX_STATISTICS
+/ (an unknown search frame is assumed to select 1% of the entries)
+/
+/ returns 1 on success, 0 if no statistics are available
+*/
+    char *sql_statement;
+    char *xprefix;
+    int ret;
+    int ok = 0;
+    int ix;
+    int iy;
+    int depth = 0;
+    double row_count = 0.0;
+    double node_count = 0.0;
+    double ext_min_x = 0.0;
+    double ext_min_y = 0.0;
+    double ext_max_x = 0.0;
+    double ext_max_y = 0.0;
+    double half_width = 0.0;
+    double half_height = 0.0;
+    double rows = 0.0;
+    double fanout;
+    sqlite3_stmt *stmt;
+    sqlite3 *sqlite = (sqlite3 *) p_sqlite;
+
+    xprefix = gaiaDoubleQuotedSql (db_prefix == NULL ? "main" : db_prefix);
+    if (column == NULL)
+	sql_statement =
+	    sqlite3_mprintf
+	    ("SELECT row_count, node_count, tree_depth, extent_min_x, "
+	     "extent_min_y, extent_max_x, extent_max_y, avg_width, avg_height, "
+	     "histogram FROM \"%s\".spatial_index_statistics "
+	     "WHERE f_table_name = Lower(%Q)", xprefix, table);
+    else
+	sql_statement =
+	    sqlite3_mprintf
+	    ("SELECT row_count, node_count, tree_depth, extent_min_x, "
+	     "extent_min_y, extent_max_x, extent_max_y, avg_width, avg_height, "
+	     "histogram FROM \"%s\".spatial_index_statistics "
+	     "WHERE f_table_name = Lower(%Q) AND f_geometry_column = Lower(%Q)",
+	     xprefix, table, column);
+    free (xprefix);
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;		/* no statistics table */
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret != SQLITE_ROW)
+	      break;
+	  if (ok)
+	    {
+		/* ambiguous: more than a single R*Tree */
+		ok = 0;
+		break;
+	    }
+	  row_count = sqlite3_column_double (stmt, 0);
+	  node_count = sqlite3_column_double (stmt, 1);
+	  depth = sqlite3_column_int (stmt, 2);
+	  ext_min_x = sqlite3_column_double (stmt, 3);
+	  ext_min_y = sqlite3_column_double (stmt, 4);
+	  ext_max_x = sqlite3_column_double (stmt, 5);
+	  ext_max_y = sqlite3_column_double (stmt, 6);
+	  half_width = sqlite3_column_double (stmt, 7) / 2.0;
+	  half_height = sqlite3_column_double (stmt, 8) / 2.0;
+	  ok = 1;
+	  if (!has_frame || row_count <= 0.0)
+	    {
+		rows = row_count / 100.0;
+		continue;
+	    }
+	  if (sqlite3_column_type (stmt, 9) != SQLITE_BLOB
+	      || sqlite3_column_bytes (stmt, 9) !=
+	      SPLITE_SPIDX_HISTOGRAM * SPLITE_SPIDX_HISTOGRAM * 4)
+	    {
+		ok = 0;
+		break;
+	    }
+	  else
+	    {
+		/* 
+		 / summing up the histogram cells overlapping the search frame
+		 / enlarged by half the average MBR size, so to approximate
+		 / the MBRs intersecting the frame by their centers
+		 */
+		const unsigned char *blob = sqlite3_column_blob (stmt, 9);
+		double cell_width =
+		    (ext_max_x - ext_min_x) / SPLITE_SPIDX_HISTOGRAM;
+		double cell_height =
+		    (ext_max_y - ext_min_y) / SPLITE_SPIDX_HISTOGRAM;
+		rows = 0.0;
+		for (iy = 0; iy < SPLITE_SPIDX_HISTOGRAM; iy++)
+		  {
+		      double cy0 = ext_min_y + (iy * cell_height);
+		      double oy =
+			  spatial_index_overlap (cy0, cy0 + cell_height,
+						 min_y - half_height,
+						 max_y + half_height);
+		      if (oy <= 0.0)
+			  continue;
+		      for (ix = 0; ix < SPLITE_SPIDX_HISTOGRAM; ix++)
+			{
+			    const unsigned char *p =
+				blob +
+				(((iy * SPLITE_SPIDX_HISTOGRAM) + ix) * 4);
+			    double count =
+				(double) ((unsigned int) p[0] |
+					  ((unsigned int) p[1] << 8) |
+					  ((unsigned int) p[2] << 16) |
+					  ((unsigned int) p[3] << 24));
+			    double cx0 = ext_min_x + (ix * cell_width);
+			    double ox;
+			    if (count <= 0.0)
+				continue;
+			    ox = spatial_index_overlap (cx0, cx0 + cell_width,
+							min_x - half_width,
+							max_x + half_width);
+			    rows += count * ox * oy;
+			}
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (!ok)
+	return 0;
+
+/* cost: visited nodes (root to leaves) plus the returned entries */
+    if (rows < 1.0)
+	rows = 1.0;
+    if (rows > row_count && row_count >= 1.0)
+	rows = row_count;
+    fanout = (node_count > 0.0) ? (row_count + node_count) / node_count : 1.0;
+    if (fanout < 2.0)
+	fanout = 2.0;
+    *estimated_rows = rows;
+    *estimated_cost = (double) (depth + 1) + (rows / fanout) + rows;
+    return 1;
+}
+
 SPATIALITE_DECLARE int
 update_layer_statistics (sqlite3 * sqlite, const char *table,
 			 const char *column)
@@ -1670,6 +2120,8 @@ update_layer_statistics (sqlite3 * sqlite, const char *table,
 /* updating LAYER_STATISTICS metadata [main] */
     if (!genuine_layer_statistics (sqlite, table, column))
 	return 0;
+    if (!spatial_index_statistics (sqlite, table, column))
+	return 0;
     if (has_views_metadata (sqlite))
       {
 	  if (!views_layer_statistics (sqlite, table, column))
@@ -1701,6 +2153,7 @@ struct drop_params
     int ok_virts_geometry_columns_auth;
     int ok_virts_geometry_columns_field_infos;
     int ok_virts_geometry_columns_statistics;
+    int ok_spatial_index_statistics;
     int ok_layer_statistics;
     int ok_views_layer_statistics;
     int ok_virts_layer_statistics;
@@ -1876,6 +2329,23 @@ do_drop_table (sqlite3 * sqlite, const char *prefix, const char *table,
 		return 0;
 	    }
       }
+    if (aux->ok_spatial_index_statistics)
+      {
+	  /* deleting from SPATIAL_INDEX_STATISTICS */
+	  q_prefix = gaiaDoubleQuotedSql (prefix);
+	  sql =
+	      sqlite3_mprintf ("DELETE FROM \"%s\".spatial_index_statistics "
+			       "WHERE lower(f_table_name) = lower(%Q)",
+			       q_prefix, table);
+	  free (q_prefix);
+	  ret = sqlite3_exec (sqlite, sql, NULL, NULL, &errMsg);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	    {
+		aux->error_message = errMsg;
+		return 0;
+	    }
+      }
     if (aux->ok_views_geometry_columns_auth)
       {
 	  /* deleting from VIEWS_GEOMETRY_COLUMNS_AUTH */
@@ -2112,6 +2582,7 @@ do_drop_sub_view (sqlite3 * sqlite, const char *prefix, const char *table,
 	aux->ok_virts_geometry_columns_field_infos;
     aux2.ok_virts_geometry_columns_statistics =
 	aux->ok_virts_geometry_columns_statistics;
+    aux2.ok_spatial_index_statistics = aux->ok_spatial_index_statistics;
     aux2.ok_layer_statistics = aux->ok_layer_statistics;
     aux2.ok_views_layer_statistics = aux->ok_views_layer_statistics;
     aux2.ok_virts_layer_statistics = aux->ok_virts_layer_statistics;
@@ -2210,6 +2681,8 @@ check_drop_layout (sqlite3 * sqlite, const char *prefix, const char *table,
 		      if (strcasecmp (name, "virts_geometry_columns_statistics")
 			  == 0)
 			  aux->ok_virts_geometry_columns_statistics = 1;
+		      if (strcasecmp (name, "spatial_index_statistics") == 0)
+			  aux->ok_spatial_index_statistics = 1;
 		      if (strcasecmp (name, "geometry_columns_field_infos") ==
 			  0)
 			  aux->ok_geometry_columns_field_infos = 1;
@@ -2413,6 +2886,7 @@ gaiaDropTableEx3 (sqlite3 * sqlite, const char *prefix, const char *table,
     aux.ok_virts_geometry_columns_auth = 0;
     aux.ok_virts_geometry_columns_field_infos = 0;
     aux.ok_virts_geometry_columns_statistics = 0;
+    aux.ok_spatial_index_statistics = 0;
     aux.ok_layer_statistics = 0;
     aux.ok_views_layer_statistics = 0;
     aux.ok_virts_layer_statistics = 0;
@@ -60,6 +60,8 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <spatialite_private.h>
 #include <spatialite/gaiaaux.h>
 
+#include <float.h>
+
 #ifdef _WIN32
 #define strcasecmp	_stricmp
 #define strncasecmp	_strnicmp
@@ -174,6 +176,16 @@ struct aux_cloner
     int append;
     int already_existing;
     int create_only;
+    char *hilbert_column;
+};
+
+struct aux_hilbert_item
+{
+/* a row to be sorted accordingly to the Hilbert curve */
+    sqlite3_int64 rowid;
+    double x;
+    double y;
+    int valid;
 };
 
 static int
@@ -972,6 +984,160 @@ create_output_table (struct aux_cloner *cloner)
     return 1;
 }
 
+static int
+cmp_hilbert_keys (const void *p1, const void *p2)
+{
+/* comparison function for QSORT */
+    sqlite3_uint64 k1 = *((const sqlite3_uint64 *) p1);
+    sqlite3_uint64 k2 = *((const sqlite3_uint64 *) p2);
+    if (k1 < k2)
+	return -1;
+    if (k1 > k2)
+	return 1;
+    return 0;
+}
+
+static int
+hilbert_sort_rowids (sqlite3 * sqlite, const char *db_prefix,
+		     const char *table, const char *column,
+		     sqlite3_int64 ** rowids, int *count)
+{
+/*
+/ retrieving all the ROWIDs of some table sorted accordingly 
+/ to the Hilbert curve of the MBR centers of a Geometry column;
+/ any row lacking a valid Geometry will be placed at the end
+*/
+    sqlite3_stmt *stmt = NULL;
+    int ret;
+    int i;
+    char *sql;
+    char *xprefix;
+    char *xtable;
+    char *xcolumn;
+    struct aux_hilbert_item *items = NULL;
+    struct aux_hilbert_item *p;
+    sqlite3_uint64 *keys = NULL;
+    sqlite3_int64 *sorted = NULL;
+    int n_items = 0;
+    int allocated = 0;
+    double minx = DBL_MAX;
+    double miny = DBL_MAX;
+    double maxx = -DBL_MAX;
+    double maxy = -DBL_MAX;
+    double scale_x;
+    double scale_y;
+    unsigned int hilbert;
+
+    *rowids = NULL;
+    *count = 0;
+    xprefix = gaiaDoubleQuotedSql (db_prefix);
+    xtable = gaiaDoubleQuotedSql (table);
+    xcolumn = gaiaDoubleQuotedSql (column);
+    sql =
+	sqlite3_mprintf
+	("SELECT ROWID, (MbrMinX(\"%s\") + MbrMaxX(\"%s\")) / 2.0, "
+	 "(MbrMinY(\"%s\") + MbrMaxY(\"%s\")) / 2.0 FROM \"%s\".\"%s\"",
+	 xcolumn, xcolumn, xcolumn, xcolumn, xprefix, xtable);
+    free (xprefix);
+    free (xtable);
+    free (xcolumn);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("Hilbert sort: \"%s\"\n", sqlite3_errmsg (sqlite));
+	  return 0;
+      }
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret != SQLITE_ROW)
+	    {
+		spatialite_e ("Hilbert sort: \"%s\"\n",
+			      sqlite3_errmsg (sqlite));
+		goto error;
+	    }
+	  if (n_items == allocated)
+	    {
+		struct aux_hilbert_item *save = items;
+		allocated = (allocated == 0) ? 4096 : allocated * 2;
+		items =
+		    realloc (items,
+			     sizeof (struct aux_hilbert_item) * allocated);
+		if (items == NULL)
+		  {
+		      items = save;
+		      goto error;
+		  }
+	    }
+	  p = items + n_items++;
+	  p->rowid = sqlite3_column_int64 (stmt, 0);
+	  p->valid = 0;
+	  if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT
+	      && sqlite3_column_type (stmt, 2) == SQLITE_FLOAT)
+	    {
+		p->valid = 1;
+		p->x = sqlite3_column_double (stmt, 1);
+		p->y = sqlite3_column_double (stmt, 2);
+		if (p->x < minx)
+		    minx = p->x;
+		if (p->y < miny)
+		    miny = p->y;
+		if (p->x > maxx)
+		    maxx = p->x;
+		if (p->y > maxy)
+		    maxy = p->y;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    if (n_items == 0)
+	return 1;
+
+/* sorting by Hilbert keys: the lower 32 bits are the item index */
+    scale_x = (maxx > minx) ? 65535.0 / (maxx - minx) : 0.0;
+    scale_y = (maxy > miny) ? 65535.0 / (maxy - miny) : 0.0;
+    keys = malloc (sizeof (sqlite3_uint64) * n_items);
+    sorted = malloc (sizeof (sqlite3_int64) * n_items);
+    if (keys == NULL || sorted == NULL)
+	goto error;
+    for (i = 0; i < n_items; i++)
+      {
+	  p = items + i;
+	  if (p->valid)
+	      hilbert =
+		  splite_hilbert_index ((unsigned int)
+					((p->x - minx) * scale_x),
+					(unsigned int) ((p->y -
+							 miny) * scale_y));
+	  else
+	      hilbert = 0xffffffff;
+	  keys[i] = ((sqlite3_uint64) hilbert << 32) | (sqlite3_uint64) i;
+      }
+    qsort (keys, n_items, sizeof (sqlite3_uint64), cmp_hilbert_keys);
+    for (i = 0; i < n_items; i++)
+	sorted[i] = items[keys[i] & 0xffffffff].rowid;
+    free (keys);
+    free (items);
+    *rowids = sorted;
+    *count = n_items;
+    return 1;
+
+  error:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (items != NULL)
+	free (items);
+    if (keys != NULL)
+	free (keys);
+    if (sorted != NULL)
+	free (sorted);
+    return 0;
+}
+
 static int
 copy_rows (struct aux_cloner *cloner)
 {
@@ -986,6 +1152,18 @@ copy_rows (struct aux_cloner *cloner)
     char *xtable;
     char *xdb_prefix;
     int first = 1;
+    sqlite3_int64 *rowids = NULL;
+    int n_rowids = 0;
+    int next_rowid = 0;
+
+    if (cloner->hilbert_column != NULL)
+      {
+	  /* copying rows accordingly to the Hilbert curve */
+	  if (!hilbert_sort_rowids
+	      (cloner->sqlite, cloner->db_prefix, cloner->in_table,
+	       cloner->hilbert_column, &rowids, &n_rowids))
+	      return 0;
+      }
 
 /* composing the SELECT statement */
     sql = sqlite3_mprintf ("SELECT ");
@@ -1014,8 +1192,15 @@ copy_rows (struct aux_cloner *cloner)
       }
     xdb_prefix = gaiaDoubleQuotedSql (cloner->db_prefix);
     xtable = gaiaDoubleQuotedSql (cloner->in_table);
-    sql =
-	sqlite3_mprintf ("%s FROM \"%s\".\"%s\"", prev_sql, xdb_prefix, xtable);
+    if (cloner->hilbert_column != NULL)
+	sql =
+	    sqlite3_mprintf ("%s FROM \"%s\".\"%s\" WHERE ROWID = ?",
+			     prev_sql, xdb_prefix, xtable);
+    else
+	sql =
+	    sqlite3_mprintf ("%s FROM \"%s\".\"%s\"", prev_sql, xdb_prefix,
+			     xtable);
+    sqlite3_free (prev_sql);
     free (xdb_prefix);
     free (xtable);
 /* compiling the SELECT FROM statement */
@@ -1116,10 +1301,23 @@ copy_rows (struct aux_cloner *cloner)
 
     while (1)
       {
+	  if (cloner->hilbert_column != NULL)
+	    {
+		/* fetching the next row accordingly to the Hilbert curve */
+		if (next_rowid >= n_rowids)
+		    break;
+		sqlite3_reset (stmt_in);
+		sqlite3_clear_bindings (stmt_in);
+		sqlite3_bind_int64 (stmt_in, 1, rowids[next_rowid++]);
+	    }
 	  /* scrolling the result set rows */
 	  ret = sqlite3_step (stmt_in);
 	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
+	    {
+		if (cloner->hilbert_column != NULL)
+		    continue;
+		break;		/* end of result set */
+	    }
 	  if (ret == SQLITE_ROW)
 	    {
 		/* copying values between input and output tables */
@@ -1193,6 +1391,8 @@ copy_rows (struct aux_cloner *cloner)
       }
     sqlite3_finalize (stmt_in);
     sqlite3_finalize (stmt_out);
+    if (rowids != NULL)
+	free (rowids);
     return 1;
 
   error:
@@ -1200,6 +1400,8 @@ copy_rows (struct aux_cloner *cloner)
 	sqlite3_finalize (stmt_in);
     if (stmt_out != NULL)
 	sqlite3_finalize (stmt_out);
+    if (rowids != NULL)
+	free (rowids);
     return 0;
 }
 
@@ -2023,6 +2225,8 @@ free_cloner (struct aux_cloner *cloner)
 	free (cloner->in_table);
     if (cloner->out_table != NULL)
 	free (cloner->out_table);
+    if (cloner->hilbert_column != NULL)
+	free (cloner->hilbert_column);
     pc = cloner->first_col;
     while (pc != NULL)
       {
@@ -2143,6 +2347,7 @@ gaiaAuxClonerCreateEx (const void *sqlite, const char *db_prefix,
     cloner->append = 0;
     cloner->already_existing = 0;
     cloner->create_only = create_only;
+    cloner->hilbert_column = NULL;
 
 /* exploring the input table - Columns */
     if (!check_input_table_columns (cloner))
@@ -2217,6 +2422,27 @@ check_append (struct aux_cloner *cloner)
     return 1;
 }
 
+static void
+hilbert_order_column (struct aux_cloner *cloner, const char *column)
+{
+/* marking the Geometry Column driving the Hilbert ordering of rows */
+    int len;
+    struct aux_column *pc = cloner->first_col;
+    while (pc != NULL)
+      {
+	  if (strcasecmp (pc->name, column) == 0 && pc->geometry != NULL)
+	    {
+		if (cloner->hilbert_column != NULL)
+		    free (cloner->hilbert_column);
+		len = strlen (pc->name);
+		cloner->hilbert_column = malloc (len + 1);
+		strcpy (cloner->hilbert_column, pc->name);
+		return;
+	    }
+	  pc = pc->next;
+      }
+}
+
 static void
 cast2multi_column (struct aux_cloner *cloner, const char *column)
 {
@@ -2244,6 +2470,8 @@ gaiaAuxClonerAddOption (const void *handle, const char *option)
 	ignore_column (cloner, option + 10);
     if (strncasecmp (option, "::cast2multi::", 14) == 0)
 	cast2multi_column (cloner, option + 14);
+    if (strncasecmp (option, "::hilbert-order::", 17) == 0)
+	hilbert_order_column (cloner, option + 17);
     if (strncasecmp (option, "::resequence::", 14) == 0)
 	cloner->resequence = 1;
     if (strncasecmp (option, "::with-foreign-keys::", 21) == 0)
@@ -2333,3 +2561,355 @@ gaiaAuxClonerExecute (const void *handle)
       }
     return 1;
 }
+
+static int
+cluster_exec (sqlite3 * sqlite, char *sql)
+{
+/* executing an SQL statement (will free the SQL text) */
+    int ret;
+    char *errMsg = NULL;
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &errMsg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("ClusterTable: \"%s\"\n", errMsg);
+	  sqlite3_free (errMsg);
+	  return 0;
+      }
+    return 1;
+}
+
+static char *
+cluster_column_list (struct aux_cloner *cloner, int resequence)
+{
+/* building the list of columns to be copied */
+    char *sql = NULL;
+    char *prev_sql;
+    char *xcolumn;
+    struct aux_column *column = cloner->first_col;
+    while (column != NULL)
+      {
+	  if (resequence && column->pk)
+	    {
+		/* skipping the INTEGER PRIMARY KEY */
+		column = column->next;
+		continue;
+	    }
+	  xcolumn = gaiaDoubleQuotedSql (column->name);
+	  prev_sql = sql;
+	  if (prev_sql == NULL)
+	      sql = sqlite3_mprintf ("\"%s\"", xcolumn);
+	  else
+	    {
+		sql = sqlite3_mprintf ("%s, \"%s\"", prev_sql, xcolumn);
+		sqlite3_free (prev_sql);
+	    }
+	  free (xcolumn);
+	  column = column->next;
+      }
+    return sql;
+}
+
+static int
+is_rowid_alias (struct aux_cloner *cloner)
+{
+/* checking if the PRIMARY KEY is an alias of the ROWID */
+    int count = 0;
+    struct aux_column *pk = NULL;
+    struct aux_column *column = cloner->first_col;
+    while (column != NULL)
+      {
+	  if (column->pk)
+	    {
+		count++;
+		pk = column;
+	    }
+	  column = column->next;
+      }
+    if (count == 1 && pk->type != NULL
+	&& strcasecmp (pk->type, "INTEGER") == 0)
+	return 1;
+    return 0;
+}
+
+static int
+cluster_rebuild_indices (struct aux_cloner *cloner)
+{
+/* rebuilding all Spatial Indices and MBR Caches from scratch */
+    char *raw;
+    char *xname;
+    char *xtable;
+    char *xcolumn;
+    struct aux_column *column = cloner->first_col;
+    while (column != NULL)
+      {
+	  if (column->geometry == NULL)
+	    {
+		column = column->next;
+		continue;
+	    }
+	  if (column->geometry->spatial_index == 1)
+	    {
+		/* R*Tree Spatial Index */
+		raw =
+		    sqlite3_mprintf ("idx_%s_%s", cloner->in_table,
+				     column->name);
+		xname = gaiaDoubleQuotedSql (raw);
+		sqlite3_free (raw);
+		if (!cluster_exec
+		    (cloner->sqlite,
+		     sqlite3_mprintf ("DELETE FROM main.\"%s\"", xname)))
+		  {
+		      free (xname);
+		      return 0;
+		  }
+		free (xname);
+		if (buildSpatialIndexEx
+		    (cloner->sqlite, (const unsigned char *) (cloner->in_table),
+		     column->name) != 0)
+		    return 0;
+	    }
+	  if (column->geometry->spatial_index == 2)
+	    {
+		/* MBR Cache */
+		raw =
+		    sqlite3_mprintf ("cache_%s_%s", cloner->in_table,
+				     column->name);
+		xname = gaiaDoubleQuotedSql (raw);
+		sqlite3_free (raw);
+		if (!cluster_exec
+		    (cloner->sqlite,
+		     sqlite3_mprintf ("DROP TABLE IF EXISTS main.\"%s\"",
+				      xname)))
+		  {
+		      free (xname);
+		      return 0;
+		  }
+		xtable = gaiaDoubleQuotedSql (cloner->in_table);
+		xcolumn = gaiaDoubleQuotedSql (column->name);
+		raw =
+		    sqlite3_mprintf
+		    ("CREATE VIRTUAL TABLE main.\"%s\" USING MbrCache(\"%s\", \"%s\")",
+		     xname, xtable, xcolumn);
+		free (xname);
+		free (xtable);
+		free (xcolumn);
+		if (!cluster_exec (cloner->sqlite, raw))
+		    return 0;
+	    }
+	  column = column->next;
+      }
+    return 1;
+}
+
+static int
+cluster_rows (struct aux_cloner *cloner, const char *geometry,
+	      int resequence)
+{
+/* rewriting all the table rows accordingly to the Hilbert curve */
+    sqlite3 *sqlite = cloner->sqlite;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_int64 *rowids = NULL;
+    int n_rowids = 0;
+    int i;
+    int ret;
+    char *sql;
+    char *raw;
+    char *xtmp;
+    char *xtable;
+    char *columns = NULL;
+    struct aux_trigger *trigger;
+
+    if (!hilbert_sort_rowids
+	(sqlite, "main", cloner->in_table, geometry, &rowids, &n_rowids))
+	return 0;
+    columns = cluster_column_list (cloner, resequence);
+    if (columns == NULL)
+	goto error;
+    xtable = gaiaDoubleQuotedSql (cloner->in_table);
+    raw = sqlite3_mprintf ("tmp_cluster_%s", cloner->in_table);
+    xtmp = gaiaDoubleQuotedSql (raw);
+    sqlite3_free (raw);
+
+/* removing all Triggers; they'll be restored at the end */
+    trigger = cloner->first_trigger;
+    while (trigger != NULL)
+      {
+	  char *xtrigger = gaiaDoubleQuotedSql (trigger->name);
+	  ret =
+	      cluster_exec (sqlite,
+			    sqlite3_mprintf ("DROP TRIGGER main.\"%s\"",
+					     xtrigger));
+	  free (xtrigger);
+	  if (!ret)
+	      goto stop;
+	  trigger = trigger->next;
+      }
+
+/* copying all rows into a TEMPORARY table in Hilbert order */
+    if (!cluster_exec
+	(sqlite,
+	 sqlite3_mprintf
+	 ("CREATE TEMPORARY TABLE \"%s\" AS SELECT %s FROM main.\"%s\" WHERE 0",
+	  xtmp, columns, xtable)))
+	goto stop;
+    sql =
+	sqlite3_mprintf
+	("INSERT INTO temp.\"%s\" SELECT %s FROM main.\"%s\" WHERE ROWID = ?",
+	 xtmp, columns, xtable);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("ClusterTable: \"%s\"\n", sqlite3_errmsg (sqlite));
+	  goto stop;
+      }
+    for (i = 0; i < n_rowids; i++)
+      {
+	  sqlite3_reset (stmt);
+	  sqlite3_clear_bindings (stmt);
+	  sqlite3_bind_int64 (stmt, 1, rowids[i]);
+	  ret = sqlite3_step (stmt);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		spatialite_e ("ClusterTable: \"%s\"\n",
+			      sqlite3_errmsg (sqlite));
+		goto stop;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+
+/* rewriting the table; rows will now be stored in Hilbert order */
+    if (!cluster_exec
+	(sqlite, sqlite3_mprintf ("DELETE FROM main.\"%s\"", xtable)))
+	goto stop;
+    if (!cluster_exec
+	(sqlite,
+	 sqlite3_mprintf
+	 ("INSERT INTO main.\"%s\" (%s) SELECT %s FROM temp.\"%s\" ORDER BY ROWID",
+	  xtable, columns, columns, xtmp)))
+	goto stop;
+    if (!cluster_exec
+	(sqlite, sqlite3_mprintf ("DROP TABLE temp.\"%s\"", xtmp)))
+	goto stop;
+
+/* rebuilding Spatial Indices and restoring all Triggers */
+    if (!cluster_rebuild_indices (cloner))
+	goto stop;
+    trigger = cloner->first_trigger;
+    while (trigger != NULL)
+      {
+	  if (!cluster_exec (sqlite, sqlite3_mprintf ("%s", trigger->sql)))
+	      goto stop;
+	  trigger = trigger->next;
+      }
+    free (xtable);
+    free (xtmp);
+    sqlite3_free (columns);
+    free (rowids);
+    return 1;
+
+  stop:
+    free (xtable);
+    free (xtmp);
+  error:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (columns != NULL)
+	sqlite3_free (columns);
+    if (rowids != NULL)
+	free (rowids);
+    return 0;
+}
+
+SPATIALITE_PRIVATE int
+gaiaAuxClusterTable (const void *handle, const char *table,
+		     const char *geometry, int resequence)
+{
+/* rewriting a whole table accordingly to the Hilbert curve */
+    sqlite3 *sqlite = (sqlite3 *) handle;
+    struct aux_cloner *cloner;
+    struct aux_column *column;
+    int ret;
+    int ok_geom = 0;
+    int foreign_keys = 0;
+    char **results;
+    int rows;
+    int columns;
+    int i;
+
+    if (!validateRowid (sqlite, table))
+      {
+	  spatialite_e
+	      ("ClusterTable: a physical column named ROWID shadows the real ROWID\n");
+	  return 0;
+      }
+    ret =
+	sqlite3_get_table (sqlite, "PRAGMA foreign_keys", &results, &rows,
+			   &columns, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 1; i <= rows; i++)
+	foreign_keys = atoi (results[(i * columns) + 0]);
+    sqlite3_free_table (results);
+    if (foreign_keys)
+      {
+	  spatialite_e
+	      ("ClusterTable: can't be applied while PRAGMA foreign_keys is ON\n");
+	  return 0;
+      }
+
+    cloner =
+	(struct aux_cloner *) gaiaAuxClonerCreate (sqlite, "main", table,
+						   table);
+    if (cloner == NULL)
+	return 0;
+    column = cloner->first_col;
+    while (column != NULL)
+      {
+	  if (strcasecmp (column->name, geometry) == 0
+	      && column->geometry != NULL)
+	      ok_geom = 1;
+	  column = column->next;
+      }
+    if (!ok_geom)
+      {
+	  spatialite_e
+	      ("ClusterTable: \"%s\".\"%s\" isn't a registered Geometry\n",
+	       table, geometry);
+	  goto error;
+      }
+    if (!is_rowid_alias (cloner))
+	resequence = 0;
+    else if (!resequence)
+      {
+	  /* rows are physically sorted by ROWID, and this is the ROWID */
+	  spatialite_e
+	      ("ClusterTable: \"%s\" has an INTEGER PRIMARY KEY; resequence is required\n",
+	       table);
+	  goto error;
+      }
+
+    if (!cluster_exec
+	(sqlite, sqlite3_mprintf ("SAVEPOINT splite_cluster_table")))
+	goto error;
+    if (!cluster_rows (cloner, geometry, resequence))
+      {
+	  cluster_exec (sqlite,
+			sqlite3_mprintf
+			("ROLLBACK TO SAVEPOINT splite_cluster_table"));
+	  cluster_exec (sqlite,
+			sqlite3_mprintf ("RELEASE SAVEPOINT splite_cluster_table"));
+	  goto error;
+      }
+    if (!cluster_exec
+	(sqlite, sqlite3_mprintf ("RELEASE SAVEPOINT splite_cluster_table")))
+	goto error;
+    free_cloner (cloner);
+    return 1;
+
+  error:
+    free_cloner (cloner);
+    return 0;
+}
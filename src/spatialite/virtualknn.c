@@ -108,6 +108,30 @@ previous query is less than requested, then the buffer
 radius will be repeatedly expanded until all requested
 nearest features will be found.
 
+
+IMPORTANT NOTE: how KNN Batch works
+
+the VirtualKNNBatch module solves a KNN query for each Geometry
+found into a Query table (e.g. for joining many Points against
+the nearest POIs), so it's very important to avoid executing any
+SQL query for each Tree level and for each Query Geometry.
+
+the R*Tree node pages will be directly read from the shadow table
+"idx_<table>_<geom>_node" and then decoded (and cached), so to
+perform a best-first traversal of the whole Tree hierarchy
+driven by a priority queue; the exact distance (directly computed
+in C) will be evaluated only for the indexed features whose BBOX is
+nearest to the Query Geometry.
+
+
+IMPORTANT NOTE: KNN Mirror mode
+
+when the KNN Mirror mode is enabled (EnableKnnMirrorMode) the decoded
+R*Tree nodes will be kept in memory and shared by all KNN queries on
+the same connection, until any change is detected; VirtualKNN will
+then use the same incremental best-first search of VirtualKNNBatch
+instead of the four steps described above.
+
 */
 
 #include <sys/types.h>
@@ -127,6 +151,8 @@ nearest features will be found.
 
 #include <spatialite/sqlite.h>
 
+#include <spatialite.h>
+#include <spatialite_private.h>
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiaaux.h>
 #include <spatialite/gaiageo.h>
@@ -137,6 +163,12 @@ nearest features will be found.
 #endif
 
 static struct sqlite3_module my_knn_module;
+static struct sqlite3_module my_knn_batch_module;
+
+#define VKNN_LEAF	-1	/* indexed feature: BBOX distance */
+#define VKNN_EXACT	-2	/* indexed feature: exact distance */
+#define VKNN_MAX_NODES	0x4000000	/* max R*Tree node number */
+#define VKNN_DEGREE_METERS	110000.0	/* a latitude degree is never shorter */
 
 /******************************************************************************
 /
@@ -152,6 +184,97 @@ typedef struct VKnnItemStruct
 } VKnnItem;
 typedef VKnnItem *VKnnItemPtr;
 
+typedef struct VKnnNodeStruct
+{
+/* an R*Tree node decoded from the shadow table */
+    int count;			/* number of cells */
+    sqlite3_int64 *ids;		/* child node numbers or indexed ROWIDs */
+    float *mbrs;		/* minx, maxx, miny, maxy for each cell */
+} VKnnNode;
+typedef VKnnNode *VKnnNodePtr;
+
+typedef struct VKnnTreeStruct
+{
+/* R*Tree nodes decoded from the "idx_<table>_<geom>_node" shadow table */
+    int depth;			/* Tree depth; -1 if still unknown */
+    VKnnNodePtr *nodes;		/* decoded nodes, indexed by node number */
+    int max_nodes;
+} VKnnTree;
+typedef VKnnTree *VKnnTreePtr;
+
+typedef struct VKnnMirrorStruct
+{
+/* an in-memory R*Tree mirror (shared by the whole connection) */
+    char *db_prefix;
+    char *table_name;
+    char *column_name;
+    int changes;		/* sqlite3_total_changes() when validated */
+    sqlite3_int64 data_version;	/* PRAGMA data_version when validated */
+    int stable;			/* no uncommitted changes when validated */
+    int refs;			/* # searches currently using this mirror */
+    int detached;		/* no longer owned by the connection */
+    VKnnTree tree;
+    struct VKnnMirrorStruct *next;
+} VKnnMirror;
+typedef VKnnMirror *VKnnMirrorPtr;
+
+typedef struct VKnnQueueItemStruct
+{
+/* an item into the best-first priority queue */
+    double dist;		/* BBOX or exact distance */
+    sqlite3_int64 id;		/* node number or indexed ROWID */
+    int level;			/* Tree level or VKNN_LEAF/VKNN_EXACT */
+} VKnnQueueItem;
+typedef VKnnQueueItem *VKnnQueueItemPtr;
+
+typedef struct VKnnPartStruct
+{
+/* a Point, Linestring or Ring as a plain sequence of vertices */
+    const double *coords;	/* NULL for a Point */
+    int dims;
+    int points;
+    double x;			/* Point coordinates */
+    double y;
+} VKnnPart;
+typedef VKnnPart *VKnnPartPtr;
+
+typedef struct VKnnClosestStruct
+{
+/* the closest points between two Geometries */
+    double dist;
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+} VKnnClosest;
+typedef VKnnClosest *VKnnClosestPtr;
+
+typedef struct VKnnSearchStruct
+{
+/* an incremental best-first KNN search */
+    sqlite3 *db;
+    VKnnTreePtr tree;		/* the decoded R*Tree nodes */
+    VKnnMirrorPtr mirror;	/* the R*Tree mirror (if any) */
+    VKnnTree own_tree;		/* private nodes (no mirror) */
+    sqlite3_stmt *stmt_node;	/* R*Tree node pages */
+    sqlite3_stmt *stmt_geom;	/* indexed Geometries */
+    int is_geographic;
+    int ellps_srid;
+    int ellps_ok;
+    double a;
+    double b;
+    double rf;
+    gaiaGeomCollPtr geom;	/* the current Query Geometry */
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    VKnnQueueItemPtr queue;	/* binary heap */
+    int queue_count;
+    int queue_max;
+} VKnnSearch;
+typedef VKnnSearch *VKnnSearchPtr;
+
 typedef struct VKnnContextStruct
 {
 /* current KNN context */
@@ -186,6 +309,7 @@ typedef struct VKnnContextStruct
     double max_dist;
     int curr_items;
     int rtree_count;
+    VKnnSearchPtr search;	/* best-first search (R*Tree mirror) */
 } VKnnContext;
 typedef VKnnContext *VKnnContextPtr;
 
@@ -196,6 +320,7 @@ typedef struct VirtualKnnStruct
     int nRef;			/* # references: USED INTERNALLY BY SQLITE */
     char *zErrMsg;		/* error message: USE INTERNALLY BY SQLITE */
     sqlite3 *db;		/* the sqlite db holding the virtual table */
+    const void *p_cache;	/* pointer to the internal cache */
     VKnnContextPtr knn_ctx;	/* KNN context */
 } VirtualKnn;
 typedef VirtualKnn *VirtualKnnPtr;
@@ -209,99 +334,142 @@ typedef struct VirtualKnnCursorStruct
 } VirtualKnnCursor;
 typedef VirtualKnnCursor *VirtualKnnCursorPtr;
 
+/******************************************************************************
+/
+/ best-first KNN search
+/
+/ the R*Tree node pages stored into the "idx_<table>_<geom>_node"
+/ shadow table are directly decoded and traversed in best-first order;
+/ a priority queue holds both Tree nodes (keyed by their BBOX distance)
+/ and indexed features (keyed first by their BBOX distance, then by
+/ their exact distance), so that the nearest features will always be
+/ popped first and one at each time.
+/
+/ decoded nodes could be optionally kept into a per-connection mirror
+/ (see EnableKnnMirrorMode), that will be discarded as soon as any
+/ change is detected.
+/
+******************************************************************************/
+
 static void
-vknn_empty_context (VKnnContextPtr ctx)
+vknn_free_node (VKnnNodePtr node)
 {
-/* setting an empty KNN context */
-    if (ctx == NULL)
+/* freeing a decoded R*Tree node */
+    if (node == NULL)
 	return;
-    ctx->table_name = NULL;
-    ctx->column_name = NULL;
-    ctx->blob = NULL;
-    ctx->blob_size = 0;
-    ctx->stmt_dist = NULL;
-    ctx->stmt_map_dist = NULL;
-    ctx->stmt_rect_dist = NULL;
-    ctx->stmt_pt_dist = NULL;
-    ctx->stmt_buffer = NULL;
-    ctx->stmt_rtree = NULL;
-    ctx->stmt_rtree_count = NULL;
-    ctx->bbox_minx = -DBL_MAX;
-    ctx->bbox_miny = -DBL_MAX;
-    ctx->bbox_maxx = DBL_MAX;
-    ctx->bbox_maxy = DBL_MAX;
-    ctx->minx = DBL_MAX;
-    ctx->miny = DBL_MAX;
-    ctx->maxx = -DBL_MAX;
-    ctx->maxy = -DBL_MAX;
-    ctx->min_dist = DBL_MAX;
-    ctx->rtree_minx = -DBL_MAX;
-    ctx->rtree_miny = -DBL_MAX;
-    ctx->rtree_maxx = DBL_MAX;
-    ctx->rtree_maxy = DBL_MAX;
-    ctx->current_level = 0;
-    ctx->max_items = 0;
-    ctx->knn_array = NULL;
-    ctx->curr_items = 0;
-    ctx->rtree_count = 0;
-    ctx->max_dist = -DBL_MAX;
+    if (node->ids != NULL)
+	free (node->ids);
+    if (node->mbrs != NULL)
+	free (node->mbrs);
+    free (node);
 }
 
-static VKnnContextPtr
-vknn_create_context (void)
+static void
+vknn_tree_init (VKnnTreePtr tree)
 {
-/* creating an empty KNN context */
-    VKnnContextPtr ctx = malloc (sizeof (VKnnContext));
-    vknn_empty_context (ctx);
-    return ctx;
+/* initializing an empty set of R*Tree nodes */
+    tree->depth = -1;
+    tree->nodes = NULL;
+    tree->max_nodes = 0;
 }
 
 static void
-vknn_reset_context (VKnnContextPtr ctx)
+vknn_tree_reset (VKnnTreePtr tree)
 {
-/* freeing a KNN context */
-    if (ctx == NULL)
-	return;
-    if (ctx->table_name != NULL)
-	free (ctx->table_name);
-    if (ctx->column_name != NULL)
-	free (ctx->column_name);
-    if (ctx->blob != NULL)
-	free (ctx->blob);
-    if (ctx->stmt_dist != NULL)
-	sqlite3_finalize (ctx->stmt_dist);
-    if (ctx->stmt_map_dist != NULL)
-	sqlite3_finalize (ctx->stmt_map_dist);
-    if (ctx->stmt_rect_dist != NULL)
-	sqlite3_finalize (ctx->stmt_rect_dist);
-    if (ctx->stmt_pt_dist != NULL)
-	sqlite3_finalize (ctx->stmt_pt_dist);
-    if (ctx->stmt_buffer != NULL)
-	sqlite3_finalize (ctx->stmt_buffer);
-    if (ctx->stmt_rtree != NULL)
-	sqlite3_finalize (ctx->stmt_rtree);
-    if (ctx->stmt_rtree_count != NULL)
-	sqlite3_finalize (ctx->stmt_rtree_count);
-    if (ctx->knn_array != NULL)
-	free (ctx->knn_array);
-    vknn_empty_context (ctx);
+/* freeing all decoded R*Tree nodes */
+    int i;
+    if (tree->nodes != NULL)
+      {
+	  for (i = 0; i < tree->max_nodes; i++)
+	      vknn_free_node (*(tree->nodes + i));
+	  free (tree->nodes);
+      }
+    vknn_tree_init (tree);
 }
 
-static void
-vknn_rtree_count (VKnnContextPtr ctx)
+static sqlite3_int64
+vknn_import64 (const unsigned char *p)
 {
-/* approximatively counting how many entries are into the R*Tree */
-    int ret;
-    sqlite3_stmt *stmt;
+/* decoding a big-endian 64 bit integer (R*Tree format) */
+    sqlite3_uint64 value = 0;
+    int i;
+    for (i = 0; i < 8; i++)
+	value = (value << 8) | p[i];
+    return (sqlite3_int64) value;
+}
 
+static float
+vknn_import_float (const unsigned char *p)
+{
+/* decoding a big-endian 32 bit float (R*Tree format) */
+    union
+    {
+	float flt_value;
+	unsigned int int_value;
+    } convert;
+    convert.int_value =
+	((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) |
+	((unsigned int) p[2] << 8) | (unsigned int) p[3];
+    return convert.flt_value;
+}
 
-    ctx->rtree_count = 0;
-    if (ctx == NULL)
-	return;
-    stmt = ctx->stmt_rtree_count;
-    if (stmt == NULL)
-	return;
+static VKnnNodePtr
+vknn_decode_node (const unsigned char *blob, int size)
+{
+/* decoding an R*Tree node page */
+    VKnnNodePtr node;
+    const unsigned char *p;
+    int count;
+    int i;
+    if (size < 4)
+	return NULL;
+    count = (blob[2] << 8) | blob[3];
+    if (size < 4 + (count * 24))
+	return NULL;
+    node = malloc (sizeof (VKnnNode));
+    if (node == NULL)
+	return NULL;
+    node->count = count;
+    node->ids = malloc (sizeof (sqlite3_int64) * (count + 1));
+    node->mbrs = malloc (sizeof (float) * 4 * (count + 1));
+    if (node->ids == NULL || node->mbrs == NULL)
+      {
+	  vknn_free_node (node);
+	  return NULL;
+      }
+    p = blob + 4;
+    for (i = 0; i < count; i++)
+      {
+	  /* each cell: ID followed by minx, maxx, miny, maxy */
+	  *(node->ids + i) = vknn_import64 (p);
+	  *(node->mbrs + (i * 4)) = vknn_import_float (p + 8);
+	  *(node->mbrs + (i * 4) + 1) = vknn_import_float (p + 12);
+	  *(node->mbrs + (i * 4) + 2) = vknn_import_float (p + 16);
+	  *(node->mbrs + (i * 4) + 3) = vknn_import_float (p + 20);
+	  p += 24;
+      }
+    return node;
+}
+
+static VKnnNodePtr
+vknn_tree_load_node (VKnnTreePtr tree, sqlite3_stmt * stmt,
+		     sqlite3_int64 nodeno)
+{
+/* fetching an R*Tree node (possibly already decoded) */
+    VKnnNodePtr node = NULL;
+    int ret;
+    int i;
+    if (nodeno < 1 || nodeno >= VKNN_MAX_NODES)
+	return NULL;
+    if (nodeno < tree->max_nodes)
+      {
+	  node = *(tree->nodes + nodeno);
+	  if (node != NULL)
+	      return node;
+      }
     sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int64 (stmt, 1, nodeno);
     while (1)
       {
 	  /* scrolling the result set rows */
@@ -310,706 +478,996 @@ vknn_rtree_count (VKnnContextPtr ctx)
 	      break;		/* end of result set */
 	  if (ret == SQLITE_ROW)
 	    {
-		ctx->rtree_count += 1;
+		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB && node == NULL)
+		  {
+		      const unsigned char *blob = sqlite3_column_blob (stmt, 0);
+		      int size = sqlite3_column_bytes (stmt, 0);
+		      node = vknn_decode_node (blob, size);
+		      if (node != NULL && nodeno == 1)
+			  tree->depth = (blob[0] << 8) | blob[1];
+		  }
 	    }
 	  else
+	      break;
+      }
+    sqlite3_reset (stmt);
+    if (node == NULL)
+	return NULL;
+
+/* inserting into the decoded nodes */
+    if (nodeno >= tree->max_nodes)
+      {
+	  int max = (tree->max_nodes == 0) ? 64 : tree->max_nodes;
+	  VKnnNodePtr *nodes;
+	  while (max <= nodeno)
+	      max *= 2;
+	  nodes = realloc (tree->nodes, sizeof (VKnnNodePtr) * max);
+	  if (nodes == NULL)
 	    {
-		ctx->rtree_count = 0;
-		break;
+		vknn_free_node (node);
+		return NULL;
 	    }
+	  for (i = tree->max_nodes; i < max; i++)
+	      *(nodes + i) = NULL;
+	  tree->nodes = nodes;
+	  tree->max_nodes = max;
       }
+    *(tree->nodes + nodeno) = node;
+    return node;
 }
 
 static void
-vknn_init_context (VKnnContextPtr ctx, const char *table, const char *column,
-		   gaiaGeomCollPtr geom, int max_items,
-		   sqlite3_stmt * stmt_dist, sqlite3_stmt * stmt_map_dist,
-		   sqlite3_stmt * stmt_rect_dist, sqlite3_stmt * stmt_pt_dist,
-		   sqlite3_stmt * stmt_buffer, sqlite3_stmt * stmt_rtree,
-		   sqlite3_stmt * stmt_rtree_count)
+vknn_mirror_free (VKnnMirrorPtr mirror)
 {
-/* initializing a KNN context */
-    int i;
-    if (ctx == NULL)
-	return;
-    vknn_reset_context (ctx);
-    i = strlen (table);
-    ctx->table_name = malloc (i + 1);
-    strcpy (ctx->table_name, table);
-    i = strlen (column);
-    ctx->column_name = malloc (i + 1);
-    strcpy (ctx->column_name, column);
-    gaiaToSpatiaLiteBlobWkb (geom, &(ctx->blob), &(ctx->blob_size));
-    ctx->stmt_dist = stmt_dist;
-    ctx->stmt_map_dist = stmt_map_dist;
-    ctx->stmt_rect_dist = stmt_rect_dist;
-    ctx->stmt_pt_dist = stmt_pt_dist;
-    ctx->stmt_buffer = stmt_buffer;
-    ctx->stmt_rtree = stmt_rtree;
-    ctx->stmt_rtree_count = stmt_rtree_count;
-    ctx->max_items = max_items;
-    ctx->knn_array = malloc (sizeof (VKnnItem) * max_items);
-    for (i = 0; i < max_items; i++)
-      {
-	  /* initializing the KNN sorted array */
-	  VKnnItemPtr item = ctx->knn_array + i;
-	  item->rowid = 0;
-	  item->dist = DBL_MAX;
-      }
-    ctx->curr_items = 0;
-    vknn_rtree_count (ctx);
+/* freeing an R*Tree mirror */
+    if (mirror->db_prefix != NULL)
+	free (mirror->db_prefix);
+    if (mirror->table_name != NULL)
+	free (mirror->table_name);
+    if (mirror->column_name != NULL)
+	free (mirror->column_name);
+    vknn_tree_reset (&(mirror->tree));
+    free (mirror);
 }
 
-static void
-vknn_free_context (void *p)
+SPATIALITE_PRIVATE void
+free_knn_mirrors (void *first)
 {
-/* freeing a KNN context */
-    VKnnContextPtr ctx = (VKnnContextPtr) p;
-    vknn_reset_context (ctx);
-    free (ctx);
+/* freeing all the R*Tree mirrors of a connection */
+    VKnnMirrorPtr mirror = (VKnnMirrorPtr) first;
+    VKnnMirrorPtr mirror_n;
+    while (mirror != NULL)
+      {
+	  mirror_n = mirror->next;
+	  if (mirror->refs > 0)
+	    {
+		/* still in use: will be freed on release */
+		mirror->detached = 1;
+		mirror->next = NULL;
+	    }
+	  else
+	      vknn_mirror_free (mirror);
+	  mirror = mirror_n;
+      }
 }
 
-static int
-vknn_check_view_rtree (sqlite3 * sqlite, const char *table_name,
-		       const char *geom_column, char **real_table,
-		       char **real_geom, int *is_geographic)
+static sqlite3_int64
+vknn_mirror_data_version (sqlite3 * db, const char *db_prefix)
 {
-/* checks if the required RTree is actually defined - SpatialView */
+/* querying the DB data version (changes by other connections) */
     sqlite3_stmt *stmt;
     char *sql_statement;
+    char *quoted_db;
     int ret;
-    int count = 0;
-    char *rt = NULL;
-    char *rg = NULL;
-    int is_longlat = 0;
-
-/* testing if views_geometry_columns exists */
-    sql_statement = sqlite3_mprintf ("SELECT tbl_name FROM sqlite_master "
-				     "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'");
+    sqlite3_int64 version = -1;
+    quoted_db = gaiaDoubleQuotedSql (db_prefix);
+    sql_statement = sqlite3_mprintf ("PRAGMA \"%s\".data_version", quoted_db);
+    free (quoted_db);
     ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
+	sqlite3_prepare_v2 (db, sql_statement, strlen (sql_statement), &stmt,
+			    NULL);
     sqlite3_free (sql_statement);
     if (ret != SQLITE_OK)
-	return 0;
-    while (1)
-      {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	      count++;
-      }
+	return -1;
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW)
+	version = sqlite3_column_int64 (stmt, 0);
     sqlite3_finalize (stmt);
-    if (count != 1)
-	return 0;
-    count = 0;
+    return version;
+}
 
-/* attempting to find the RTree Geometry Column */
-    sql_statement =
-	sqlite3_mprintf
-	("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
-	 "FROM views_geometry_columns AS a " "JOIN geometry_columns AS b ON ("
-	 "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
-	 "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
-	 "WHERE Upper(a.view_name) = Upper(%Q) "
-	 "AND Upper(a.view_geometry) = Upper(%Q) AND b.spatial_index_enabled = 1",
-	 table_name, geom_column);
-    ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+static int
+vknn_mirror_is_stable (sqlite3 * db, const char *db_prefix)
+{
+/* checking that no uncommitted change could be later rolled back */
+    if (sqlite3_get_autocommit (db))
+	return 1;
+#if SQLITE_VERSION_NUMBER >= 3034000
+    if (sqlite3_txn_state (db, db_prefix) != SQLITE_TXN_WRITE)
+	return 1;
+#else
+    if (db_prefix != NULL)
+	db_prefix = db_prefix;	/* unused arg warning suppression */
+#endif
+    return 0;
+}
+
+static VKnnMirrorPtr
+vknn_mirror_acquire (sqlite3 * db, const void *p_cache,
+		     const char *db_prefix, const char *table,
+		     const char *column)
+{
+/* 
+/ returns the R*Tree mirror to be used by a search, or NULL
+/ if the mirror mode isn't enabled on this connection
+*/
+    VKnnMirrorPtr mirror;
+    int changes;
+    sqlite3_int64 version;
+    int len;
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return NULL;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return NULL;
+    if (!cache->knnMirror)
+	return NULL;
+    if (db_prefix == NULL)
+	db_prefix = "main";
+
+    mirror = (VKnnMirrorPtr) (cache->knnMirrors);
+    while (mirror != NULL)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		const char *v = (const char *) sqlite3_column_text (stmt, 0);
-		int len = sqlite3_column_bytes (stmt, 0);
-		if (rt)
-		    free (rt);
-		rt = malloc (len + 1);
-		strcpy (rt, v);
-		v = (const char *) sqlite3_column_text (stmt, 1);
-		len = sqlite3_column_bytes (stmt, 1);
-		if (rg)
-		    free (rg);
-		rg = malloc (len + 1);
-		strcpy (rg, v);
-		is_longlat = sqlite3_column_int (stmt, 2);
-		count++;
-	    }
+	  if (strcasecmp (mirror->db_prefix, db_prefix) == 0
+	      && strcasecmp (mirror->table_name, table) == 0
+	      && strcasecmp (mirror->column_name, column) == 0)
+	      break;
+	  mirror = mirror->next;
       }
-    sqlite3_finalize (stmt);
-    if (count != 1)
-	return 0;
-    if (!validateRowid (sqlite, rt))
+    if (mirror == NULL)
       {
-	  free (rt);
-	  free (rg);
-	  return 0;
+	  /* creating a new (still empty) mirror */
+	  mirror = malloc (sizeof (VKnnMirror));
+	  if (mirror == NULL)
+	      return NULL;
+	  len = strlen (db_prefix);
+	  mirror->db_prefix = malloc (len + 1);
+	  strcpy (mirror->db_prefix, db_prefix);
+	  len = strlen (table);
+	  mirror->table_name = malloc (len + 1);
+	  strcpy (mirror->table_name, table);
+	  len = strlen (column);
+	  mirror->column_name = malloc (len + 1);
+	  strcpy (mirror->column_name, column);
+	  mirror->changes = -1;
+	  mirror->data_version = -1;
+	  mirror->stable = 0;
+	  mirror->refs = 0;
+	  mirror->detached = 0;
+	  vknn_tree_init (&(mirror->tree));
+	  mirror->next = (VKnnMirrorPtr) (cache->knnMirrors);
+	  cache->knnMirrors = mirror;
       }
-    *real_table = rt;
-    *real_geom = rg;
-    *is_geographic = is_longlat;
-    return 1;
+
+/* discarding all decoded nodes if anything could have been changed */
+    changes = sqlite3_total_changes (db);
+    version = vknn_mirror_data_version (db, db_prefix);
+    if (!mirror->stable || mirror->changes != changes
+	|| mirror->data_version != version || version < 0)
+	vknn_tree_reset (&(mirror->tree));
+    mirror->changes = changes;
+    mirror->data_version = version;
+    mirror->stable = vknn_mirror_is_stable (db, db_prefix);
+    mirror->refs += 1;
+    return mirror;
 }
 
-static int
-vknn_check_rtree (sqlite3 * sqlite, const char *db_prefix,
-		  const char *table_name, const char *geom_column,
-		  char **real_table, char **real_geom, int *is_geographic)
+static void
+vknn_mirror_release (VKnnMirrorPtr mirror)
 {
-/* checks if the required RTree is actually defined */
-    sqlite3_stmt *stmt;
-    char *sql_statement;
-    int ret;
-    int count = 0;
-    char *rt = NULL;
-    char *rg = NULL;
-    int is_longlat = 0;
+/* a search doesn't use this R*Tree mirror any longer */
+    if (mirror == NULL)
+	return;
+    mirror->refs -= 1;
+    if (mirror->refs <= 0 && mirror->detached)
+	vknn_mirror_free (mirror);
+}
 
-    if (db_prefix == NULL)
+static void
+vknn_part_vertex (VKnnPartPtr part, int iv, double *x, double *y)
+{
+/* fetching a vertex from a Point, Linestring or Ring */
+    double z;
+    double m;
+    if (part->coords == NULL)
       {
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
-	       "FROM main.geometry_columns WHERE Upper(f_table_name) = Upper(%Q) AND "
-	       "Upper(f_geometry_column) = Upper(%Q) AND spatial_index_enabled = 1",
-	       table_name, geom_column);
+	  *x = part->x;
+	  *y = part->y;
       }
-    else
+    else if (part->dims == GAIA_XY_Z)
       {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
-	       "FROM \"%s\".geometry_columns WHERE Upper(f_table_name) = Upper(%Q) AND "
-	       "Upper(f_geometry_column) = Upper(%Q) AND spatial_index_enabled = 1",
-	       quoted_db, table_name, geom_column);
-	  free (quoted_db);
+	  gaiaGetPointXYZ (part->coords, iv, x, y, &z);
       }
-    ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+    else if (part->dims == GAIA_XY_M)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		const char *v = (const char *) sqlite3_column_text (stmt, 0);
-		int len = sqlite3_column_bytes (stmt, 0);
-		if (rt)
-		    free (rt);
-		rt = malloc (len + 1);
-		strcpy (rt, v);
-		v = (const char *) sqlite3_column_text (stmt, 1);
-		len = sqlite3_column_bytes (stmt, 1);
-		if (rg)
-		    free (rg);
-		rg = malloc (len + 1);
-		strcpy (rg, v);
-		is_longlat = sqlite3_column_int (stmt, 2);
-		count++;
-	    }
+	  gaiaGetPointXYM (part->coords, iv, x, y, &m);
+      }
+    else if (part->dims == GAIA_XY_Z_M)
+      {
+	  gaiaGetPointXYZM (part->coords, iv, x, y, &z, &m);
       }
-    sqlite3_finalize (stmt);
-    if (count != 1)
-	return vknn_check_view_rtree (sqlite, table_name, geom_column,
-				      real_table, real_geom, is_geographic);
     else
       {
-	  *real_table = rt;
-	  *real_geom = rg;
-	  *is_geographic = is_longlat;
+	  gaiaGetPoint (part->coords, iv, x, y);
       }
-    return 1;
 }
 
-static int
-vknn_find_view_rtree (sqlite3 * sqlite, const char *db_prefix,
-		      const char *table_name, char **real_table,
-		      char **real_geom, int *is_geographic)
+static VKnnPartPtr
+vknn_geometry_parts (gaiaGeomCollPtr geom, int *count)
 {
-/* attempts to find the corresponding RTree Geometry Column - SpatialView */
-    sqlite3_stmt *stmt;
-    char *sql_statement;
-    int ret;
-    int count = 0;
-    char *rt = NULL;
-    char *rg = NULL;
-    int is_longlat = 0;
-
-/* testing if views_geometry_columns exists */
-    if (db_prefix == NULL)
+/* splitting a Geometry into Points, Linestrings and Rings */
+    VKnnPartPtr parts;
+    VKnnPartPtr part;
+    gaiaPointPtr pt;
+    gaiaLinestringPtr ln;
+    gaiaPolygonPtr pg;
+    gaiaRingPtr rng;
+    int n = 0;
+    int ib;
+    pt = geom->FirstPoint;
+    while (pt != NULL)
       {
-	  sql_statement =
-	      sqlite3_mprintf ("SELECT tbl_name FROM main.sqlite_master "
-			       "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'");
+	  n++;
+	  pt = pt->Next;
       }
-    else
+    ln = geom->FirstLinestring;
+    while (ln != NULL)
       {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf ("SELECT tbl_name FROM \"%s\".sqlite_master "
-			       "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'",
-			       quoted_db);
-	  free (quoted_db);
+	  n++;
+	  ln = ln->Next;
       }
-    ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+    pg = geom->FirstPolygon;
+    while (pg != NULL)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	      count++;
+	  n += 1 + pg->NumInteriors;
+	  pg = pg->Next;
       }
-    sqlite3_finalize (stmt);
-    if (count != 1)
-	return 0;
-    count = 0;
-
-/* attempting to find the RTree Geometry Column */
-    if (db_prefix == NULL)
+    *count = 0;
+    if (n == 0)
+	return NULL;
+    parts = malloc (sizeof (VKnnPart) * n);
+    if (parts == NULL)
+	return NULL;
+    part = parts;
+    pt = geom->FirstPoint;
+    while (pt != NULL)
       {
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
-	       "FROM main.views_geometry_columns AS a "
-	       "JOIN main.geometry_columns AS b ON ("
-	       "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
-	       "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
-	       "WHERE Upper(a.view_name) = Upper(%Q) AND b.spatial_index_enabled = 1",
-	       table_name);
+	  part->coords = NULL;
+	  part->dims = GAIA_XY;
+	  part->points = 1;
+	  part->x = pt->X;
+	  part->y = pt->Y;
+	  part++;
+	  pt = pt->Next;
       }
-    else
+    ln = geom->FirstLinestring;
+    while (ln != NULL)
       {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
-	       "FROM \"%s\".views_geometry_columns AS a "
-	       "JOIN \"%s\".geometry_columns AS b ON ("
-	       "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
-	       "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
-	       "WHERE Upper(a.view_name) = Upper(%Q) AND b.spatial_index_enabled = 1",
-	       quoted_db, quoted_db, table_name);
-	  free (quoted_db);
+	  part->coords = ln->Coords;
+	  part->dims = ln->DimensionModel;
+	  part->points = ln->Points;
+	  part++;
+	  ln = ln->Next;
       }
-    ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+    pg = geom->FirstPolygon;
+    while (pg != NULL)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
+	  rng = pg->Exterior;
+	  part->coords = rng->Coords;
+	  part->dims = rng->DimensionModel;
+	  part->points = rng->Points;
+	  part++;
+	  for (ib = 0; ib < pg->NumInteriors; ib++)
 	    {
-		const char *v = (const char *) sqlite3_column_text (stmt, 0);
-		int len = sqlite3_column_bytes (stmt, 0);
-		if (rt)
-		    free (rt);
-		rt = malloc (len + 1);
-		strcpy (rt, v);
-		v = (const char *) sqlite3_column_text (stmt, 1);
-		len = sqlite3_column_bytes (stmt, 1);
-		if (rg)
-		    free (rg);
-		rg = malloc (len + 1);
-		strcpy (rg, v);
-		is_longlat = sqlite3_column_int (stmt, 2);
-		count++;
+		rng = pg->Interiors + ib;
+		part->coords = rng->Coords;
+		part->dims = rng->DimensionModel;
+		part->points = rng->Points;
+		part++;
 	    }
+	  pg = pg->Next;
       }
-    sqlite3_finalize (stmt);
-    if (count != 1)
-	return 0;
-    *real_table = rt;
-    *real_geom = rg;
-    *is_geographic = is_longlat;
-    return 1;
+    *count = n;
+    return parts;
 }
 
 static int
-vknn_find_rtree (sqlite3 * sqlite, const char *db_prefix,
-		 const char *table_name, char **real_table, char **real_geom,
-		 int *is_geographic)
+vknn_within_polygons (gaiaGeomCollPtr geom, double x, double y)
 {
-/* attempts to find the corresponding RTree Geometry Column */
-    sqlite3_stmt *stmt;
-    char *sql_statement;
-    int ret;
-    int count = 0;
-    char *rt = NULL;
-    char *rg = NULL;
-    int is_longlat = 0;
+/* checks if a Point falls inside any Polygon (and outside its holes) */
+    gaiaPolygonPtr pg = geom->FirstPolygon;
+    int ib;
+    int hole;
+    while (pg != NULL)
+      {
+	  if (gaiaIsPointOnRingSurface (pg->Exterior, x, y))
+	    {
+		hole = 0;
+		for (ib = 0; ib < pg->NumInteriors; ib++)
+		  {
+		      if (gaiaIsPointOnRingSurface (pg->Interiors + ib, x, y))
+			{
+			    hole = 1;
+			    break;
+			}
+		  }
+		if (!hole)
+		    return 1;
+	    }
+	  pg = pg->Next;
+      }
+    return 0;
+}
 
-    if (db_prefix == NULL)
+static void
+vknn_closest_update (VKnnClosestPtr closest, double x0, double y0,
+		     double x1, double y1)
+{
+/* updating the closest points */
+    double dist = sqrt (((x1 - x0) * (x1 - x0)) + ((y1 - y0) * (y1 - y0)));
+    if (dist < closest->dist)
       {
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
-	       " FROM main.geometry_columns WHERE Upper(f_table_name) = Upper(%Q) "
-	       "AND spatial_index_enabled = 1", table_name);
+	  closest->dist = dist;
+	  closest->x0 = x0;
+	  closest->y0 = y0;
+	  closest->x1 = x1;
+	  closest->y1 = y1;
       }
-    else
+}
+
+static void
+vknn_point_segment (double px, double py, double x0, double y0, double x1,
+		    double y1, double *cx, double *cy)
+{
+/* the point on a segment nearest to a given Point */
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    double len2 = (dx * dx) + (dy * dy);
+    double u;
+    if (len2 <= 0.0)
       {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
-	       " FROM \"%s\".geometry_columns WHERE Upper(f_table_name) = Upper(%Q) "
-	       "AND spatial_index_enabled = 1", quoted_db, table_name);
-	  free (quoted_db);
+	  *cx = x0;
+	  *cy = y0;
+	  return;
       }
-    ret =
-	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	return 0;
-    while (1)
+    u = (((px - x0) * dx) + ((py - y0) * dy)) / len2;
+    if (u < 0.0)
+	u = 0.0;
+    if (u > 1.0)
+	u = 1.0;
+    *cx = x0 + (u * dx);
+    *cy = y0 + (u * dy);
+}
+
+static int
+vknn_segments_cross (double ax0, double ay0, double ax1, double ay1,
+		     double bx0, double by0, double bx1, double by1)
+{
+/* 
+/ checks if two segments do properly cross each other
+/ (touching segments are already caught by the endpoint distances)
+*/
+    double d1 = ((bx1 - bx0) * (ay0 - by0)) - ((by1 - by0) * (ax0 - bx0));
+    double d2 = ((bx1 - bx0) * (ay1 - by0)) - ((by1 - by0) * (ax1 - bx0));
+    double d3 = ((ax1 - ax0) * (by0 - ay0)) - ((ay1 - ay0) * (bx0 - ax0));
+    double d4 = ((ax1 - ax0) * (by1 - ay0)) - ((ay1 - ay0) * (bx1 - ax0));
+    if (((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0))
+	&& ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0)))
+	return 1;
+    return 0;
+}
+
+static void
+vknn_point_part (VKnnClosestPtr closest, double px, double py,
+		 VKnnPartPtr part, int reverse)
+{
+/* closest points between a Point and a Point/Linestring/Ring */
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+    double cx;
+    double cy;
+    int iv;
+    vknn_part_vertex (part, 0, &x0, &y0);
+    if (part->points < 2)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		const char *v = (const char *) sqlite3_column_text (stmt, 0);
-		int len = sqlite3_column_bytes (stmt, 0);
-		if (rt)
-		    free (rt);
-		rt = malloc (len + 1);
-		strcpy (rt, v);
-		v = (const char *) sqlite3_column_text (stmt, 1);
-		len = sqlite3_column_bytes (stmt, 1);
-		if (rg)
-		    free (rg);
-		rg = malloc (len + 1);
-		strcpy (rg, v);
-		is_longlat = sqlite3_column_int (stmt, 2);
-		count++;
-	    }
+	  if (reverse)
+	      vknn_closest_update (closest, x0, y0, px, py);
+	  else
+	      vknn_closest_update (closest, px, py, x0, y0);
+	  return;
       }
-    sqlite3_finalize (stmt);
-    if (count != 1)
-	return vknn_find_view_rtree (sqlite, db_prefix, table_name,
-				     real_table, real_geom, is_geographic);
-    else
+    for (iv = 1; iv < part->points; iv++)
       {
-	  *real_table = rt;
-	  *real_geom = rg;
-	  *is_geographic = is_longlat;
+	  vknn_part_vertex (part, iv, &x1, &y1);
+	  vknn_point_segment (px, py, x0, y0, x1, y1, &cx, &cy);
+	  if (reverse)
+	      vknn_closest_update (closest, cx, cy, px, py);
+	  else
+	      vknn_closest_update (closest, px, py, cx, cy);
+	  x0 = x1;
+	  y0 = y1;
       }
-    return 1;
 }
 
 static void
-vknn_parse_table_name (const char *tn, char **db_prefix, char **table_name)
-{
-/* attempting to extract an eventual DB prefix */
-    int i;
-    int len = strlen (tn);
-    int i_dot = -1;
-    if (strncasecmp (tn, "DB=", 3) == 0)
-      {
-	  int l_db;
-	  int l_tbl;
-	  for (i = 3; i < len; i++)
-	    {
-		if (tn[i] == '.')
-		  {
-		      i_dot = i;
-		      break;
-		  }
-	    }
-	  if (i_dot > 1)
-	    {
-		l_db = i_dot - 3;
-		l_tbl = len - (i_dot + 1);
-		*db_prefix = malloc (l_db + 1);
-		memset (*db_prefix, '\0', l_db + 1);
-		memcpy (*db_prefix, tn + 3, l_db);
-		*table_name = malloc (l_tbl + 1);
-		strcpy (*table_name, tn + i_dot + 1);
-		return;
-	    }
-      }
-    *table_name = malloc (len + 1);
-    strcpy (*table_name, tn);
-}
-
-static int
-vknn_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
-	     sqlite3_vtab ** ppVTab, char **pzErr)
+vknn_part_part (VKnnClosestPtr closest, VKnnPartPtr part1,
+		VKnnPartPtr part2)
 {
-/* creates the virtual table for R*Tree KNN metahandling */
-    VirtualKnnPtr p_vt;
-    char *buf;
-    char *vtable;
-    char *xname;
-    if (pAux)
-	pAux = pAux;		/* unused arg warning suppression */
-    if (argc == 3)
+/* closest points between two Points/Linestrings/Rings */
+    double ax0;
+    double ay0;
+    double ax1;
+    double ay1;
+    double bx0;
+    double by0;
+    double bx1;
+    double by1;
+    double cx;
+    double cy;
+    int ia;
+    int ib;
+    if (part1->points < 2)
       {
-	  vtable = gaiaDequotedSql ((char *) argv[2]);
+	  vknn_part_vertex (part1, 0, &ax0, &ay0);
+	  vknn_point_part (closest, ax0, ay0, part2, 0);
+	  return;
       }
-    else
+    if (part2->points < 2)
       {
-	  *pzErr =
-	      sqlite3_mprintf
-	      ("[VirtualKNN module] CREATE VIRTUAL: illegal arg list {void}\n");
-	  return SQLITE_ERROR;
+	  vknn_part_vertex (part2, 0, &bx0, &by0);
+	  vknn_point_part (closest, bx0, by0, part1, 1);
+	  return;
       }
-    p_vt = (VirtualKnnPtr) sqlite3_malloc (sizeof (VirtualKnn));
-    if (!p_vt)
-	return SQLITE_NOMEM;
-    p_vt->db = db;
-    p_vt->pModule = &my_knn_module;
-    p_vt->nRef = 0;
-    p_vt->zErrMsg = NULL;
-    p_vt->knn_ctx = vknn_create_context ();
-/* preparing the COLUMNs for this VIRTUAL TABLE */
-    xname = gaiaDoubleQuotedSql (vtable);
-    buf = sqlite3_mprintf ("CREATE TABLE \"%s\" (f_table_name TEXT, "
-			   "f_geometry_column TEXT, ref_geometry BLOB, max_items INTEGER, "
-			   "pos INTEGER, fid INTEGER, distance DOUBLE)", xname);
-    free (xname);
-    free (vtable);
-    if (sqlite3_declare_vtab (db, buf) != SQLITE_OK)
+    for (ia = 1; ia < part1->points; ia++)
       {
-	  sqlite3_free (buf);
-	  *pzErr =
-	      sqlite3_mprintf
-	      ("[VirtualKNN module] CREATE VIRTUAL: invalid SQL statement \"%s\"",
-	       buf);
-	  return SQLITE_ERROR;
+	  vknn_part_vertex (part1, ia - 1, &ax0, &ay0);
+	  vknn_part_vertex (part1, ia, &ax1, &ay1);
+	  for (ib = 1; ib < part2->points; ib++)
+	    {
+		vknn_part_vertex (part2, ib - 1, &bx0, &by0);
+		vknn_part_vertex (part2, ib, &bx1, &by1);
+		if (vknn_segments_cross
+		    (ax0, ay0, ax1, ay1, bx0, by0, bx1, by1))
+		  {
+		      /* intersecting segments */
+		      closest->dist = 0.0;
+		      closest->x0 = ax0;
+		      closest->y0 = ay0;
+		      closest->x1 = ax0;
+		      closest->y1 = ay0;
+		      return;
+		  }
+		vknn_point_segment (ax0, ay0, bx0, by0, bx1, by1, &cx, &cy);
+		vknn_closest_update (closest, ax0, ay0, cx, cy);
+		vknn_point_segment (ax1, ay1, bx0, by0, bx1, by1, &cx, &cy);
+		vknn_closest_update (closest, ax1, ay1, cx, cy);
+		vknn_point_segment (bx0, by0, ax0, ay0, ax1, ay1, &cx, &cy);
+		vknn_closest_update (closest, cx, cy, bx0, by0);
+		vknn_point_segment (bx1, by1, ax0, ay0, ax1, ay1, &cx, &cy);
+		vknn_closest_update (closest, cx, cy, bx1, by1);
+	    }
       }
-    sqlite3_free (buf);
-    *ppVTab = (sqlite3_vtab *) p_vt;
-    return SQLITE_OK;
-}
-
-static int
-vknn_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
-	      sqlite3_vtab ** ppVTab, char **pzErr)
-{
-/* connects the virtual table - simply aliases vknn_create() */
-    return vknn_create (db, pAux, argc, argv, ppVTab, pzErr);
 }
 
 static int
-vknn_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
+vknn_geometry_closest (gaiaGeomCollPtr geom1, gaiaGeomCollPtr geom2,
+		       VKnnClosestPtr closest)
 {
-/* best index selection */
+/* planar closest points between two Geometries */
+    VKnnPartPtr parts1;
+    VKnnPartPtr parts2;
+    int count1;
+    int count2;
     int i;
-    int err = 1;
-    int table = 0;
-    int geom_col = 0;
-    int ref_geom = 0;
-    int max_items = 0;
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-    for (i = 0; i < pIdxInfo->nConstraint; i++)
+    int j;
+    double x;
+    double y;
+    closest->dist = DBL_MAX;
+    parts1 = vknn_geometry_parts (geom1, &count1);
+    parts2 = vknn_geometry_parts (geom2, &count2);
+    if (parts1 == NULL || parts2 == NULL)
+	goto end;
+
+/* any Geometry within a Polygon has a ZERO distance */
+    for (i = 0; i < count1; i++)
       {
-	  /* verifying the constraints */
-	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
-	  if (p->usable)
+	  vknn_part_vertex (parts1 + i, 0, &x, &y);
+	  if (vknn_within_polygons (geom2, x, y))
 	    {
-		if (p->iColumn == 0 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
-		    table++;
-		else if (p->iColumn == 1 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
-		    geom_col++;
-		else if (p->iColumn == 2 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
-		    ref_geom++;
-		else if (p->iColumn == 3 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
-		    max_items++;
+		vknn_closest_update (closest, x, y, x, y);
+		goto end;
 	    }
       }
-    if (table == 1 && (geom_col == 0 || geom_col == 1) && ref_geom == 1
-	&& (max_items == 0 || max_items == 1))
+    for (j = 0; j < count2; j++)
       {
-	  /* this one is a valid KNN query */
-	  if (geom_col == 1)
-	    {
-		if (max_items == 1)
-		    pIdxInfo->idxNum = 3;
-		else
-		    pIdxInfo->idxNum = 1;
-	    }
-	  else
-	    {
-		if (max_items == 1)
-		    pIdxInfo->idxNum = 4;
-		else
-		    pIdxInfo->idxNum = 2;
-	    }
-	  pIdxInfo->estimatedCost = 1.0;
-	  for (i = 0; i < pIdxInfo->nConstraint; i++)
+	  vknn_part_vertex (parts2 + j, 0, &x, &y);
+	  if (vknn_within_polygons (geom1, x, y))
 	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
+		vknn_closest_update (closest, x, y, x, y);
+		goto end;
 	    }
-	  err = 0;
       }
-    if (err)
+
+    for (i = 0; i < count1; i++)
       {
-	  /* illegal query */
-	  pIdxInfo->idxNum = 0;
+	  for (j = 0; j < count2; j++)
+	    {
+		vknn_part_part (closest, parts1 + i, parts2 + j);
+		if (closest->dist <= 0.0)
+		    goto end;
+	    }
       }
-    return SQLITE_OK;
-}
 
-static int
-vknn_disconnect (sqlite3_vtab * pVTab)
-{
-/* disconnects the virtual table */
-    VirtualKnnPtr p_vt = (VirtualKnnPtr) pVTab;
-    if (p_vt->knn_ctx != NULL)
-	vknn_free_context (p_vt->knn_ctx);
-    sqlite3_free (p_vt);
-    return SQLITE_OK;
+  end:
+    if (parts1 != NULL)
+	free (parts1);
+    if (parts2 != NULL)
+	free (parts2);
+    return (closest->dist < DBL_MAX);
 }
 
-static int
-vknn_destroy (sqlite3_vtab * pVTab)
+static void
+vknn_search_free (VKnnSearchPtr search)
 {
-/* destroys the virtual table - simply aliases vknn_disconnect() */
-    return vknn_disconnect (pVTab);
+/* freeing a best-first KNN search */
+    if (search == NULL)
+	return;
+    if (search->stmt_node != NULL)
+	sqlite3_finalize (search->stmt_node);
+    if (search->stmt_geom != NULL)
+	sqlite3_finalize (search->stmt_geom);
+    vknn_tree_reset (&(search->own_tree));
+    vknn_mirror_release (search->mirror);
+    if (search->geom != NULL)
+	gaiaFreeGeomColl (search->geom);
+    if (search->queue != NULL)
+	free (search->queue);
+    free (search);
 }
 
-static int
-vknn_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
+static VKnnSearchPtr
+vknn_search_create (sqlite3 * db, const void *p_cache,
+		    const char *db_prefix, const char *table,
+		    const char *column, int is_geographic)
 {
-/* opening a new cursor */
-    VirtualKnnCursorPtr cursor =
-	(VirtualKnnCursorPtr) sqlite3_malloc (sizeof (VirtualKnnCursor));
-    if (cursor == NULL)
-	return SQLITE_ERROR;
-    cursor->pVtab = (VirtualKnnPtr) pVTab;
-    cursor->eof = 1;
-    *ppCursor = (sqlite3_vtab_cursor *) cursor;
-    return SQLITE_OK;
-}
+/* creating a best-first KNN search */
+    VKnnSearchPtr search;
+    char *sql_statement;
+    char *idx_name;
+    char *idx_nameQ;
+    char *xtableQ;
+    char *xgeomQ;
+    char *xdbQ;
+    int ret;
+    search = malloc (sizeof (VKnnSearch));
+    if (search == NULL)
+	return NULL;
+    search->db = db;
+    search->mirror = NULL;
+    vknn_tree_init (&(search->own_tree));
+    search->tree = &(search->own_tree);
+    search->stmt_node = NULL;
+    search->stmt_geom = NULL;
+    search->is_geographic = is_geographic;
+    search->ellps_srid = -1;
+    search->ellps_ok = 0;
+    search->a = 0.0;
+    search->b = 0.0;
+    search->rf = 0.0;
+    search->geom = NULL;
+    search->minx = DBL_MAX;
+    search->miny = DBL_MAX;
+    search->maxx = -DBL_MAX;
+    search->maxy = -DBL_MAX;
+    search->queue = NULL;
+    search->queue_count = 0;
+    search->queue_max = 0;
+    if (db_prefix == NULL)
+	db_prefix = "main";
 
-static int
-vknn_close (sqlite3_vtab_cursor * pCursor)
-{
-/* closing the cursor */
-    sqlite3_free (pCursor);
-    return SQLITE_OK;
+/* building the R*Tree node query */
+    idx_name = sqlite3_mprintf ("idx_%s_%s_node", table, column);
+    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
+    xdbQ = gaiaDoubleQuotedSql (db_prefix);
+    sql_statement =
+	sqlite3_mprintf ("SELECT data FROM \"%s\".\"%s\" WHERE nodeno = ?",
+			 xdbQ, idx_nameQ);
+    free (xdbQ);
+    free (idx_nameQ);
+    sqlite3_free (idx_name);
+    ret =
+	sqlite3_prepare_v2 (db, sql_statement, strlen (sql_statement),
+			    &(search->stmt_node), NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto error;
+
+/* building the indexed Geometries query */
+    xgeomQ = gaiaDoubleQuotedSql (column);
+    xtableQ = gaiaDoubleQuotedSql (table);
+    xdbQ = gaiaDoubleQuotedSql (db_prefix);
+    sql_statement =
+	sqlite3_mprintf ("SELECT \"%s\" FROM \"%s\".\"%s\" WHERE rowid = ?",
+			 xgeomQ, xdbQ, xtableQ);
+    free (xgeomQ);
+    free (xtableQ);
+    free (xdbQ);
+    ret =
+	sqlite3_prepare_v2 (db, sql_statement, strlen (sql_statement),
+			    &(search->stmt_geom), NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto error;
+
+/* using the R*Tree mirror, if enabled */
+    search->mirror = vknn_mirror_acquire (db, p_cache, db_prefix, table,
+					  column);
+    if (search->mirror != NULL)
+	search->tree = &(search->mirror->tree);
+    return search;
+
+  error:
+    vknn_search_free (search);
+    return NULL;
 }
 
-static void
-vknn_shift_items (VKnnContextPtr ctx, int index)
+static int
+vknn_queue_less (VKnnQueueItemPtr a, VKnnQueueItemPtr b)
 {
-/* shifting down the Features sorted array */
-    int i;
-    for (i = ctx->max_items - 1; i > index; i--)
-      {
-	  VKnnItemPtr item1 = ctx->knn_array + i - 1;
-	  VKnnItemPtr item2 = ctx->knn_array + i;
-	  item2->rowid = item1->rowid;
-	  item2->dist = item1->dist;
-	  if ((i == ctx->max_items - 1) && item2->dist != DBL_MAX)
-	      ctx->max_dist = item2->dist;
-      }
+/* priority order: distance first, exact distances on ties */
+    if (a->dist < b->dist)
+	return 1;
+    if (a->dist > b->dist)
+	return 0;
+    return (a->level < b->level);
 }
 
 static void
-vknn_update_items (VKnnContextPtr ctx, sqlite3_int64 rowid, double dist)
+vknn_queue_push (VKnnSearchPtr search, double dist, sqlite3_int64 id,
+		 int level)
 {
-/* updating the Features sorted array */
+/* inserting an item into the priority queue */
+    VKnnQueueItem item;
     int i;
-    if (ctx->curr_items == ctx->max_items)
+    if (search->queue_count >= search->queue_max)
       {
-	  if (dist >= ctx->max_dist)
+	  int max = (search->queue_max == 0) ? 256 : search->queue_max * 2;
+	  VKnnQueueItemPtr queue =
+	      realloc (search->queue, sizeof (VKnnQueueItem) * max);
+	  if (queue == NULL)
 	      return;
+	  search->queue = queue;
+	  search->queue_max = max;
       }
-    for (i = 0; i < ctx->max_items; i++)
+    item.dist = dist;
+    item.id = id;
+    item.level = level;
+    i = search->queue_count;
+    search->queue_count += 1;
+    while (i > 0)
       {
-	  VKnnItemPtr item = ctx->knn_array + i;
-	  if (rowid == item->rowid)
-	      return;
-	  if (dist < item->dist)
-	    {
-		vknn_shift_items (ctx, i);
-		item->rowid = rowid;
-		item->dist = dist;
-		break;
-	    }
+	  /* sifting up */
+	  int parent = (i - 1) / 2;
+	  if (!vknn_queue_less (&item, search->queue + parent))
+	      break;
+	  *(search->queue + i) = *(search->queue + parent);
+	  i = parent;
       }
-    if (dist > ctx->max_dist)
-	ctx->max_dist = dist;
-    if (ctx->curr_items < ctx->max_items)
-	ctx->curr_items += 1;
+    *(search->queue + i) = item;
 }
 
 static int
-vknn_check_mbr (VKnnContextPtr ctx, double rtree_minx, double rtree_miny,
-		double rtree_maxx, double rtree_maxy)
+vknn_queue_pop (VKnnSearchPtr search, VKnnQueueItemPtr item)
 {
-/* comparing two MBRs */
-    if (rtree_minx >= ctx->bbox_minx && rtree_maxx <= ctx->bbox_maxx
-	&& rtree_miny >= ctx->bbox_miny && rtree_maxy <= ctx->bbox_maxy)
-	return FULLY_WITHIN;
-    if (rtree_maxx < ctx->bbox_minx)
-	return NOT_WITHIN;
-    if (rtree_minx > ctx->bbox_maxx)
-	return NOT_WITHIN;
-    if (rtree_maxy < ctx->bbox_miny)
-	return NOT_WITHIN;
-    if (rtree_miny > ctx->bbox_maxy)
-	return NOT_WITHIN;
-    return PARTLY_WITHIN;
+/* removing the nearest item from the priority queue */
+    VKnnQueueItem last;
+    int i = 0;
+    if (search->queue_count == 0)
+	return 0;
+    *item = *(search->queue);
+    search->queue_count -= 1;
+    if (search->queue_count == 0)
+	return 1;
+    last = *(search->queue + search->queue_count);
+    while (1)
+      {
+	  /* sifting down */
+	  int child = (i * 2) + 1;
+	  if (child >= search->queue_count)
+	      break;
+	  if (child + 1 < search->queue_count
+	      && vknn_queue_less (search->queue + child + 1,
+				  search->queue + child))
+	      child++;
+	  if (!vknn_queue_less (search->queue + child, &last))
+	      break;
+	  *(search->queue + i) = *(search->queue + child);
+	  i = child;
+      }
+    *(search->queue + i) = last;
+    return 1;
 }
 
 static double
-vknn_compute_distance (VKnnContextPtr ctx, sqlite3_int64 rowid)
+vknn_search_bbox_distance (VKnnSearchPtr search, const float *mbr)
 {
-/* computing the distance between two geometries (in meters) */
+/* lower bound of the distance between the Query Geometry and a BBOX */
+    double dx = 0.0;
+    double dy = 0.0;
+    if (mbr[1] < search->minx)
+	dx = search->minx - mbr[1];
+    else if (mbr[0] > search->maxx)
+	dx = mbr[0] - search->maxx;
+    if (mbr[3] < search->miny)
+	dy = search->miny - mbr[3];
+    else if (mbr[2] > search->maxy)
+	dy = mbr[2] - search->maxy;
+    if (search->is_geographic)
+      {
+	  /* 
+	     / longitude degrees shrink toward the Poles, so only
+	     / the latitude gap gives a safe bound (in meters)
+	   */
+	  return dy * VKNN_DEGREE_METERS;
+      }
+    return sqrt ((dx * dx) + (dy * dy));
+}
+
+static double
+vknn_search_distance (VKnnSearchPtr search, sqlite3_int64 rowid)
+{
+/* 
+/ computing the exact distance from the Query Geometry
+/ (the same as ST_Distance(query, geom [, 1]) would return)
+*/
     double dist = DBL_MAX;
+    int ret;
+    VKnnClosest closest;
+    gaiaGeomCollPtr geom = NULL;
+    sqlite3_stmt *stmt = search->stmt_geom;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int64 (stmt, 1, rowid);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB
+		    && geom == NULL)
+		    geom =
+			gaiaFromSpatiaLiteBlobWkb (sqlite3_column_blob
+						   (stmt, 0),
+						   sqlite3_column_bytes (stmt,
+									 0));
+	    }
+	  else
+	      break;
+      }
+    sqlite3_reset (stmt);
+    if (geom == NULL)
+	return DBL_MAX;
+    if (vknn_geometry_closest (search->geom, geom, &closest))
+      {
+	  if (!search->is_geographic || closest.dist <= 0.0)
+	      dist = closest.dist;
+	  else if (search->ellps_ok)
+	    {
+		/* geodesic distance between the closest points */
+		dist =
+		    gaiaGeodesicDistance (search->a, search->b, search->rf,
+					  closest.y0, closest.x0, closest.y1,
+					  closest.x1);
+		if (dist < 0.0)
+		  {
+		      /* nearly antipodal points: Vincenty not converging */
+		      dist =
+			  gaiaGreatCircleDistance (search->a, search->b,
+						   closest.y0, closest.x0,
+						   closest.y1, closest.x1);
+		  }
+	    }
+      }
+    gaiaFreeGeomColl (geom);
+    return dist;
+}
+
+static int
+vknn_search_start (VKnnSearchPtr search, const unsigned char *blob,
+		   int size)
+{
+/* starting a new search for the given Query Geometry */
+    gaiaGeomCollPtr geom;
+    search->queue_count = 0;
+    if (search->geom != NULL)
+	gaiaFreeGeomColl (search->geom);
+    search->geom = NULL;
+    geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+    if (geom == NULL)
+	return 0;
+    if (geom->FirstPoint == NULL && geom->FirstLinestring == NULL
+	&& geom->FirstPolygon == NULL)
+      {
+	  /* empty Geometry */
+	  gaiaFreeGeomColl (geom);
+	  return 0;
+      }
+    gaiaMbrGeometry (geom);
+    search->geom = geom;
+    search->minx = geom->MinX;
+    search->miny = geom->MinY;
+    search->maxx = geom->MaxX;
+    search->maxy = geom->MaxY;
+    if (search->is_geographic && geom->Srid != search->ellps_srid)
+      {
+	  /* retrieving the ellipsoid params */
+	  search->ellps_srid = geom->Srid;
+	  search->ellps_ok =
+	      getEllipsoidParams (search->db, geom->Srid, &(search->a),
+				  &(search->b), &(search->rf));
+      }
+    if (search->tree->depth < 0)
+      {
+	  /* loading the Root node so to know the Tree depth */
+	  if (vknn_tree_load_node (search->tree, search->stmt_node, 1) == NULL
+	      || search->tree->depth < 0)
+	      return 0;
+      }
+    vknn_queue_push (search, 0.0, 1, search->tree->depth);
+    return 1;
+}
+
+static int
+vknn_search_next (VKnnSearchPtr search, sqlite3_int64 * rowid, double *dist)
+{
+/* fetching the next nearest feature */
+    VKnnQueueItem item;
+    VKnnNodePtr node;
+    int i;
+    while (vknn_queue_pop (search, &item))
+      {
+	  if (item.level == VKNN_EXACT)
+	    {
+		/* no other feature could be nearer than this one */
+		*rowid = item.id;
+		*dist = item.dist;
+		return 1;
+	    }
+	  if (item.level == VKNN_LEAF)
+	    {
+		/* refining the BBOX distance */
+		double d = vknn_search_distance (search, item.id);
+		if (d < DBL_MAX)
+		    vknn_queue_push (search, d, item.id, VKNN_EXACT);
+		continue;
+	    }
+	  node = vknn_tree_load_node (search->tree, search->stmt_node, item.id);
+	  if (node == NULL)
+	      continue;
+	  for (i = 0; i < node->count; i++)
+	    {
+		/* expanding the Tree node */
+		double d = vknn_search_bbox_distance (search,
+						      node->mbrs + (i * 4));
+		int level = (item.level > 0) ? item.level - 1 : VKNN_LEAF;
+		vknn_queue_push (search, d, *(node->ids + i), level);
+	    }
+      }
+    return 0;
+}
+
+static void
+vknn_empty_context (VKnnContextPtr ctx)
+{
+/* setting an empty KNN context */
+    if (ctx == NULL)
+	return;
+    ctx->table_name = NULL;
+    ctx->column_name = NULL;
+    ctx->blob = NULL;
+    ctx->blob_size = 0;
+    ctx->stmt_dist = NULL;
+    ctx->stmt_map_dist = NULL;
+    ctx->stmt_rect_dist = NULL;
+    ctx->stmt_pt_dist = NULL;
+    ctx->stmt_buffer = NULL;
+    ctx->stmt_rtree = NULL;
+    ctx->stmt_rtree_count = NULL;
+    ctx->bbox_minx = -DBL_MAX;
+    ctx->bbox_miny = -DBL_MAX;
+    ctx->bbox_maxx = DBL_MAX;
+    ctx->bbox_maxy = DBL_MAX;
+    ctx->minx = DBL_MAX;
+    ctx->miny = DBL_MAX;
+    ctx->maxx = -DBL_MAX;
+    ctx->maxy = -DBL_MAX;
+    ctx->min_dist = DBL_MAX;
+    ctx->rtree_minx = -DBL_MAX;
+    ctx->rtree_miny = -DBL_MAX;
+    ctx->rtree_maxx = DBL_MAX;
+    ctx->rtree_maxy = DBL_MAX;
+    ctx->current_level = 0;
+    ctx->max_items = 0;
+    ctx->knn_array = NULL;
+    ctx->curr_items = 0;
+    ctx->rtree_count = 0;
+    ctx->max_dist = -DBL_MAX;
+    ctx->search = NULL;
+}
+
+static VKnnContextPtr
+vknn_create_context (void)
+{
+/* creating an empty KNN context */
+    VKnnContextPtr ctx = malloc (sizeof (VKnnContext));
+    vknn_empty_context (ctx);
+    return ctx;
+}
+
+static void
+vknn_reset_context (VKnnContextPtr ctx)
+{
+/* freeing a KNN context */
+    if (ctx == NULL)
+	return;
+    if (ctx->table_name != NULL)
+	free (ctx->table_name);
+    if (ctx->column_name != NULL)
+	free (ctx->column_name);
+    if (ctx->blob != NULL)
+	free (ctx->blob);
+    if (ctx->stmt_dist != NULL)
+	sqlite3_finalize (ctx->stmt_dist);
+    if (ctx->stmt_map_dist != NULL)
+	sqlite3_finalize (ctx->stmt_map_dist);
+    if (ctx->stmt_rect_dist != NULL)
+	sqlite3_finalize (ctx->stmt_rect_dist);
+    if (ctx->stmt_pt_dist != NULL)
+	sqlite3_finalize (ctx->stmt_pt_dist);
+    if (ctx->stmt_buffer != NULL)
+	sqlite3_finalize (ctx->stmt_buffer);
+    if (ctx->stmt_rtree != NULL)
+	sqlite3_finalize (ctx->stmt_rtree);
+    if (ctx->stmt_rtree_count != NULL)
+	sqlite3_finalize (ctx->stmt_rtree_count);
+    if (ctx->knn_array != NULL)
+	free (ctx->knn_array);
+    vknn_search_free (ctx->search);
+    vknn_empty_context (ctx);
+}
+
+static void
+vknn_rtree_count (VKnnContextPtr ctx)
+{
+/* approximatively counting how many entries are into the R*Tree */
     int ret;
     sqlite3_stmt *stmt;
+
+
+    ctx->rtree_count = 0;
     if (ctx == NULL)
-	return DBL_MAX;
-    if (ctx->blob == NULL)
-	return DBL_MAX;
-    if (ctx->stmt_dist == NULL)
-	return DBL_MAX;
-    stmt = ctx->stmt_dist;
+	return;
+    stmt = ctx->stmt_rtree_count;
+    if (stmt == NULL)
+	return;
     sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
-    sqlite3_bind_int64 (stmt, 2, rowid);
     while (1)
       {
 	  /* scrolling the result set rows */
@@ -1018,116 +1476,1716 @@ vknn_compute_distance (VKnnContextPtr ctx, sqlite3_int64 rowid)
 	      break;		/* end of result set */
 	  if (ret == SQLITE_ROW)
 	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
-		    dist = sqlite3_column_double (stmt, 0);
+		ctx->rtree_count += 1;
 	    }
 	  else
 	    {
-		dist = DBL_MAX;
+		ctx->rtree_count = 0;
 		break;
 	    }
       }
-    return dist;
 }
 
-static double
-vknn_rect_distance (VKnnContextPtr ctx, double minx, double miny, double maxx,
-		    double maxy)
+static void
+vknn_init_context (VKnnContextPtr ctx, const char *table, const char *column,
+		   gaiaGeomCollPtr geom, int max_items,
+		   sqlite3_stmt * stmt_dist, sqlite3_stmt * stmt_map_dist,
+		   sqlite3_stmt * stmt_rect_dist, sqlite3_stmt * stmt_pt_dist,
+		   sqlite3_stmt * stmt_buffer, sqlite3_stmt * stmt_rtree,
+		   sqlite3_stmt * stmt_rtree_count)
+{
+/* initializing a KNN context */
+    int i;
+    if (ctx == NULL)
+	return;
+    vknn_reset_context (ctx);
+    i = strlen (table);
+    ctx->table_name = malloc (i + 1);
+    strcpy (ctx->table_name, table);
+    i = strlen (column);
+    ctx->column_name = malloc (i + 1);
+    strcpy (ctx->column_name, column);
+    gaiaToSpatiaLiteBlobWkb (geom, &(ctx->blob), &(ctx->blob_size));
+    ctx->stmt_dist = stmt_dist;
+    ctx->stmt_map_dist = stmt_map_dist;
+    ctx->stmt_rect_dist = stmt_rect_dist;
+    ctx->stmt_pt_dist = stmt_pt_dist;
+    ctx->stmt_buffer = stmt_buffer;
+    ctx->stmt_rtree = stmt_rtree;
+    ctx->stmt_rtree_count = stmt_rtree_count;
+    ctx->max_items = max_items;
+    ctx->knn_array = malloc (sizeof (VKnnItem) * max_items);
+    for (i = 0; i < max_items; i++)
+      {
+	  /* initializing the KNN sorted array */
+	  VKnnItemPtr item = ctx->knn_array + i;
+	  item->rowid = 0;
+	  item->dist = DBL_MAX;
+      }
+    ctx->curr_items = 0;
+    vknn_rtree_count (ctx);
+}
+
+static void
+vknn_free_context (void *p)
+{
+/* freeing a KNN context */
+    VKnnContextPtr ctx = (VKnnContextPtr) p;
+    vknn_reset_context (ctx);
+    free (ctx);
+}
+
+static int
+vknn_check_view_rtree (sqlite3 * sqlite, const char *table_name,
+		       const char *geom_column, char **real_table,
+		       char **real_geom, int *is_geographic)
+{
+/* checks if the required RTree is actually defined - SpatialView */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    int ret;
+    int count = 0;
+    char *rt = NULL;
+    char *rg = NULL;
+    int is_longlat = 0;
+
+/* testing if views_geometry_columns exists */
+    sql_statement = sqlite3_mprintf ("SELECT tbl_name FROM sqlite_master "
+				     "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'");
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	      count++;
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return 0;
+    count = 0;
+
+/* attempting to find the RTree Geometry Column */
+    sql_statement =
+	sqlite3_mprintf
+	("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
+	 "FROM views_geometry_columns AS a " "JOIN geometry_columns AS b ON ("
+	 "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
+	 "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
+	 "WHERE Upper(a.view_name) = Upper(%Q) "
+	 "AND Upper(a.view_geometry) = Upper(%Q) AND b.spatial_index_enabled = 1",
+	 table_name, geom_column);
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		const char *v = (const char *) sqlite3_column_text (stmt, 0);
+		int len = sqlite3_column_bytes (stmt, 0);
+		if (rt)
+		    free (rt);
+		rt = malloc (len + 1);
+		strcpy (rt, v);
+		v = (const char *) sqlite3_column_text (stmt, 1);
+		len = sqlite3_column_bytes (stmt, 1);
+		if (rg)
+		    free (rg);
+		rg = malloc (len + 1);
+		strcpy (rg, v);
+		is_longlat = sqlite3_column_int (stmt, 2);
+		count++;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return 0;
+    if (!validateRowid (sqlite, rt))
+      {
+	  free (rt);
+	  free (rg);
+	  return 0;
+      }
+    *real_table = rt;
+    *real_geom = rg;
+    *is_geographic = is_longlat;
+    return 1;
+}
+
+static int
+vknn_check_rtree (sqlite3 * sqlite, const char *db_prefix,
+		  const char *table_name, const char *geom_column,
+		  char **real_table, char **real_geom, int *is_geographic)
+{
+/* checks if the required RTree is actually defined */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    int ret;
+    int count = 0;
+    char *rt = NULL;
+    char *rg = NULL;
+    int is_longlat = 0;
+
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
+	       "FROM main.geometry_columns WHERE Upper(f_table_name) = Upper(%Q) AND "
+	       "Upper(f_geometry_column) = Upper(%Q) AND spatial_index_enabled = 1",
+	       table_name, geom_column);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
+	       "FROM \"%s\".geometry_columns WHERE Upper(f_table_name) = Upper(%Q) AND "
+	       "Upper(f_geometry_column) = Upper(%Q) AND spatial_index_enabled = 1",
+	       quoted_db, table_name, geom_column);
+	  free (quoted_db);
+      }
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		const char *v = (const char *) sqlite3_column_text (stmt, 0);
+		int len = sqlite3_column_bytes (stmt, 0);
+		if (rt)
+		    free (rt);
+		rt = malloc (len + 1);
+		strcpy (rt, v);
+		v = (const char *) sqlite3_column_text (stmt, 1);
+		len = sqlite3_column_bytes (stmt, 1);
+		if (rg)
+		    free (rg);
+		rg = malloc (len + 1);
+		strcpy (rg, v);
+		is_longlat = sqlite3_column_int (stmt, 2);
+		count++;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return vknn_check_view_rtree (sqlite, table_name, geom_column,
+				      real_table, real_geom, is_geographic);
+    else
+      {
+	  *real_table = rt;
+	  *real_geom = rg;
+	  *is_geographic = is_longlat;
+      }
+    return 1;
+}
+
+static int
+vknn_find_view_rtree (sqlite3 * sqlite, const char *db_prefix,
+		      const char *table_name, char **real_table,
+		      char **real_geom, int *is_geographic)
+{
+/* attempts to find the corresponding RTree Geometry Column - SpatialView */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    int ret;
+    int count = 0;
+    char *rt = NULL;
+    char *rg = NULL;
+    int is_longlat = 0;
+
+/* testing if views_geometry_columns exists */
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf ("SELECT tbl_name FROM main.sqlite_master "
+			       "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'");
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf ("SELECT tbl_name FROM \"%s\".sqlite_master "
+			       "WHERE type = 'table' AND tbl_name = 'views_geometry_columns'",
+			       quoted_db);
+	  free (quoted_db);
+      }
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	      count++;
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return 0;
+    count = 0;
+
+/* attempting to find the RTree Geometry Column */
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
+	       "FROM main.views_geometry_columns AS a "
+	       "JOIN main.geometry_columns AS b ON ("
+	       "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
+	       "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
+	       "WHERE Upper(a.view_name) = Upper(%Q) AND b.spatial_index_enabled = 1",
+	       table_name);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT a.f_table_name, a.f_geometry_column, SridIsGeographic(b.srid) "
+	       "FROM \"%s\".views_geometry_columns AS a "
+	       "JOIN \"%s\".geometry_columns AS b ON ("
+	       "Upper(a.f_table_name) = Upper(b.f_table_name) AND "
+	       "Upper(a.f_geometry_column) = Upper(b.f_geometry_column)) "
+	       "WHERE Upper(a.view_name) = Upper(%Q) AND b.spatial_index_enabled = 1",
+	       quoted_db, quoted_db, table_name);
+	  free (quoted_db);
+      }
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		const char *v = (const char *) sqlite3_column_text (stmt, 0);
+		int len = sqlite3_column_bytes (stmt, 0);
+		if (rt)
+		    free (rt);
+		rt = malloc (len + 1);
+		strcpy (rt, v);
+		v = (const char *) sqlite3_column_text (stmt, 1);
+		len = sqlite3_column_bytes (stmt, 1);
+		if (rg)
+		    free (rg);
+		rg = malloc (len + 1);
+		strcpy (rg, v);
+		is_longlat = sqlite3_column_int (stmt, 2);
+		count++;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return 0;
+    *real_table = rt;
+    *real_geom = rg;
+    *is_geographic = is_longlat;
+    return 1;
+}
+
+static int
+vknn_find_rtree (sqlite3 * sqlite, const char *db_prefix,
+		 const char *table_name, char **real_table, char **real_geom,
+		 int *is_geographic)
+{
+/* attempts to find the corresponding RTree Geometry Column */
+    sqlite3_stmt *stmt;
+    char *sql_statement;
+    int ret;
+    int count = 0;
+    char *rt = NULL;
+    char *rg = NULL;
+    int is_longlat = 0;
+
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
+	       " FROM main.geometry_columns WHERE Upper(f_table_name) = Upper(%Q) "
+	       "AND spatial_index_enabled = 1", table_name);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT f_table_name, f_geometry_column, SridIsGeographic(srid) "
+	       " FROM \"%s\".geometry_columns WHERE Upper(f_table_name) = Upper(%Q) "
+	       "AND spatial_index_enabled = 1", quoted_db, table_name);
+	  free (quoted_db);
+      }
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		const char *v = (const char *) sqlite3_column_text (stmt, 0);
+		int len = sqlite3_column_bytes (stmt, 0);
+		if (rt)
+		    free (rt);
+		rt = malloc (len + 1);
+		strcpy (rt, v);
+		v = (const char *) sqlite3_column_text (stmt, 1);
+		len = sqlite3_column_bytes (stmt, 1);
+		if (rg)
+		    free (rg);
+		rg = malloc (len + 1);
+		strcpy (rg, v);
+		is_longlat = sqlite3_column_int (stmt, 2);
+		count++;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+	return vknn_find_view_rtree (sqlite, db_prefix, table_name,
+				     real_table, real_geom, is_geographic);
+    else
+      {
+	  *real_table = rt;
+	  *real_geom = rg;
+	  *is_geographic = is_longlat;
+      }
+    return 1;
+}
+
+static void
+vknn_parse_table_name (const char *tn, char **db_prefix, char **table_name)
+{
+/* attempting to extract an eventual DB prefix */
+    int i;
+    int len = strlen (tn);
+    int i_dot = -1;
+    if (strncasecmp (tn, "DB=", 3) == 0)
+      {
+	  int l_db;
+	  int l_tbl;
+	  for (i = 3; i < len; i++)
+	    {
+		if (tn[i] == '.')
+		  {
+		      i_dot = i;
+		      break;
+		  }
+	    }
+	  if (i_dot > 1)
+	    {
+		l_db = i_dot - 3;
+		l_tbl = len - (i_dot + 1);
+		*db_prefix = malloc (l_db + 1);
+		memset (*db_prefix, '\0', l_db + 1);
+		memcpy (*db_prefix, tn + 3, l_db);
+		*table_name = malloc (l_tbl + 1);
+		strcpy (*table_name, tn + i_dot + 1);
+		return;
+	    }
+      }
+    *table_name = malloc (len + 1);
+    strcpy (*table_name, tn);
+}
+
+static int
+vknn_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+	     sqlite3_vtab ** ppVTab, char **pzErr)
+{
+/* creates the virtual table for R*Tree KNN metahandling */
+    VirtualKnnPtr p_vt;
+    char *buf;
+    char *vtable;
+    char *xname;
+    if (argc == 3)
+      {
+	  vtable = gaiaDequotedSql ((char *) argv[2]);
+      }
+    else
+      {
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[VirtualKNN module] CREATE VIRTUAL: illegal arg list {void}\n");
+	  return SQLITE_ERROR;
+      }
+    p_vt = (VirtualKnnPtr) sqlite3_malloc (sizeof (VirtualKnn));
+    if (!p_vt)
+	return SQLITE_NOMEM;
+    p_vt->db = db;
+    p_vt->p_cache = pAux;
+    p_vt->pModule = &my_knn_module;
+    p_vt->nRef = 0;
+    p_vt->zErrMsg = NULL;
+    p_vt->knn_ctx = vknn_create_context ();
+/* preparing the COLUMNs for this VIRTUAL TABLE */
+    xname = gaiaDoubleQuotedSql (vtable);
+    buf = sqlite3_mprintf ("CREATE TABLE \"%s\" (f_table_name TEXT, "
+			   "f_geometry_column TEXT, ref_geometry BLOB, max_items INTEGER, "
+			   "pos INTEGER, fid INTEGER, distance DOUBLE)", xname);
+    free (xname);
+    free (vtable);
+    if (sqlite3_declare_vtab (db, buf) != SQLITE_OK)
+      {
+	  sqlite3_free (buf);
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[VirtualKNN module] CREATE VIRTUAL: invalid SQL statement \"%s\"",
+	       buf);
+	  return SQLITE_ERROR;
+      }
+    sqlite3_free (buf);
+    *ppVTab = (sqlite3_vtab *) p_vt;
+    return SQLITE_OK;
+}
+
+static int
+vknn_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+	      sqlite3_vtab ** ppVTab, char **pzErr)
+{
+/* connects the virtual table - simply aliases vknn_create() */
+    return vknn_create (db, pAux, argc, argv, ppVTab, pzErr);
+}
+
+static int
+vknn_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
+{
+/* best index selection */
+    int i;
+    int err = 1;
+    int table = 0;
+    int geom_col = 0;
+    int ref_geom = 0;
+    int max_items = 0;
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    for (i = 0; i < pIdxInfo->nConstraint; i++)
+      {
+	  /* verifying the constraints */
+	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
+	  if (p->usable)
+	    {
+		if (p->iColumn == 0 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    table++;
+		else if (p->iColumn == 1 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    geom_col++;
+		else if (p->iColumn == 2 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    ref_geom++;
+		else if (p->iColumn == 3 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    max_items++;
+	    }
+      }
+    if (table == 1 && (geom_col == 0 || geom_col == 1) && ref_geom == 1
+	&& (max_items == 0 || max_items == 1))
+      {
+	  /* this one is a valid KNN query */
+	  if (geom_col == 1)
+	    {
+		if (max_items == 1)
+		    pIdxInfo->idxNum = 3;
+		else
+		    pIdxInfo->idxNum = 1;
+	    }
+	  else
+	    {
+		if (max_items == 1)
+		    pIdxInfo->idxNum = 4;
+		else
+		    pIdxInfo->idxNum = 2;
+	    }
+	  pIdxInfo->estimatedCost = 1.0;
+	  for (i = 0; i < pIdxInfo->nConstraint; i++)
+	    {
+		if (pIdxInfo->aConstraint[i].usable)
+		  {
+		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
+		      pIdxInfo->aConstraintUsage[i].omit = 1;
+		  }
+	    }
+	  err = 0;
+      }
+    if (err)
+      {
+	  /* illegal query */
+	  pIdxInfo->idxNum = 0;
+      }
+    return SQLITE_OK;
+}
+
+static int
+vknn_disconnect (sqlite3_vtab * pVTab)
+{
+/* disconnects the virtual table */
+    VirtualKnnPtr p_vt = (VirtualKnnPtr) pVTab;
+    if (p_vt->knn_ctx != NULL)
+	vknn_free_context (p_vt->knn_ctx);
+    sqlite3_free (p_vt);
+    return SQLITE_OK;
+}
+
+static int
+vknn_destroy (sqlite3_vtab * pVTab)
+{
+/* destroys the virtual table - simply aliases vknn_disconnect() */
+    return vknn_disconnect (pVTab);
+}
+
+static int
+vknn_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
+{
+/* opening a new cursor */
+    VirtualKnnCursorPtr cursor =
+	(VirtualKnnCursorPtr) sqlite3_malloc (sizeof (VirtualKnnCursor));
+    if (cursor == NULL)
+	return SQLITE_ERROR;
+    cursor->pVtab = (VirtualKnnPtr) pVTab;
+    cursor->eof = 1;
+    *ppCursor = (sqlite3_vtab_cursor *) cursor;
+    return SQLITE_OK;
+}
+
+static int
+vknn_close (sqlite3_vtab_cursor * pCursor)
+{
+/* closing the cursor */
+    sqlite3_free (pCursor);
+    return SQLITE_OK;
+}
+
+static void
+vknn_shift_items (VKnnContextPtr ctx, int index)
+{
+/* shifting down the Features sorted array */
+    int i;
+    for (i = ctx->max_items - 1; i > index; i--)
+      {
+	  VKnnItemPtr item1 = ctx->knn_array + i - 1;
+	  VKnnItemPtr item2 = ctx->knn_array + i;
+	  item2->rowid = item1->rowid;
+	  item2->dist = item1->dist;
+	  if ((i == ctx->max_items - 1) && item2->dist != DBL_MAX)
+	      ctx->max_dist = item2->dist;
+      }
+}
+
+static void
+vknn_update_items (VKnnContextPtr ctx, sqlite3_int64 rowid, double dist)
+{
+/* updating the Features sorted array */
+    int i;
+    if (ctx->curr_items == ctx->max_items)
+      {
+	  if (dist >= ctx->max_dist)
+	      return;
+      }
+    for (i = 0; i < ctx->max_items; i++)
+      {
+	  VKnnItemPtr item = ctx->knn_array + i;
+	  if (rowid == item->rowid)
+	      return;
+	  if (dist < item->dist)
+	    {
+		vknn_shift_items (ctx, i);
+		item->rowid = rowid;
+		item->dist = dist;
+		break;
+	    }
+      }
+    if (dist > ctx->max_dist)
+	ctx->max_dist = dist;
+    if (ctx->curr_items < ctx->max_items)
+	ctx->curr_items += 1;
+}
+
+static int
+vknn_check_mbr (VKnnContextPtr ctx, double rtree_minx, double rtree_miny,
+		double rtree_maxx, double rtree_maxy)
+{
+/* comparing two MBRs */
+    if (rtree_minx >= ctx->bbox_minx && rtree_maxx <= ctx->bbox_maxx
+	&& rtree_miny >= ctx->bbox_miny && rtree_maxy <= ctx->bbox_maxy)
+	return FULLY_WITHIN;
+    if (rtree_maxx < ctx->bbox_minx)
+	return NOT_WITHIN;
+    if (rtree_minx > ctx->bbox_maxx)
+	return NOT_WITHIN;
+    if (rtree_maxy < ctx->bbox_miny)
+	return NOT_WITHIN;
+    if (rtree_miny > ctx->bbox_maxy)
+	return NOT_WITHIN;
+    return PARTLY_WITHIN;
+}
+
+static double
+vknn_compute_distance (VKnnContextPtr ctx, sqlite3_int64 rowid)
+{
+/* computing the distance between two geometries (in meters) */
+    double dist = DBL_MAX;
+    int ret;
+    sqlite3_stmt *stmt;
+    if (ctx == NULL)
+	return DBL_MAX;
+    if (ctx->blob == NULL)
+	return DBL_MAX;
+    if (ctx->stmt_dist == NULL)
+	return DBL_MAX;
+    stmt = ctx->stmt_dist;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
+    sqlite3_bind_int64 (stmt, 2, rowid);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
+		    dist = sqlite3_column_double (stmt, 0);
+	    }
+	  else
+	    {
+		dist = DBL_MAX;
+		break;
+	    }
+      }
+    return dist;
+}
+
+static double
+vknn_rect_distance (VKnnContextPtr ctx, double minx, double miny, double maxx,
+		    double maxy)
+{
+/* computing the distance between the geometry and an R*Tree BBOX */
+    double dist = DBL_MAX;
+    int ret;
+    sqlite3_stmt *stmt;
+    if (ctx == NULL)
+	return DBL_MAX;
+    if (ctx->blob == NULL)
+	return DBL_MAX;
+    if (ctx->stmt_rect_dist == NULL)
+	return DBL_MAX;
+    stmt = ctx->stmt_rect_dist;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
+    sqlite3_bind_double (stmt, 2, minx);
+    sqlite3_bind_double (stmt, 3, miny);
+    sqlite3_bind_double (stmt, 4, maxx);
+    sqlite3_bind_double (stmt, 5, maxy);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
+		    dist = sqlite3_column_double (stmt, 0);
+	    }
+	  else
+	    {
+		dist = DBL_MAX;
+		break;
+	    }
+      }
+    return dist;
+}
+
+static double
+vknn_pt_distance (VKnnContextPtr ctx, double x, double y)
+{
+/* computing the distance between the geometry and a point */
+    double dist = DBL_MAX;
+    int ret;
+    sqlite3_stmt *stmt;
+    if (ctx == NULL)
+	return DBL_MAX;
+    if (ctx->blob == NULL)
+	return DBL_MAX;
+    if (ctx->stmt_pt_dist == NULL)
+	return DBL_MAX;
+    stmt = ctx->stmt_pt_dist;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
+    sqlite3_bind_double (stmt, 2, x);
+    sqlite3_bind_double (stmt, 3, y);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
+		    dist = sqlite3_column_double (stmt, 0);
+	    }
+	  else
+	    {
+		dist = DBL_MAX;
+		break;
+	    }
+      }
+    return dist;
+}
+
+static int
+vknn_bufferize (VKnnContextPtr ctx, double radius)
+{
+/* computing the frame for an R*Tree query */
+    int ret;
+    sqlite3_stmt *stmt;
+    if (ctx == NULL)
+	return 0;
+    if (ctx->blob == NULL)
+	return 0;
+    if (ctx->stmt_buffer == NULL)
+	return 0;
+    stmt = ctx->stmt_buffer;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
+    sqlite3_bind_double (stmt, 2, radius);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
+		    ctx->rtree_minx = sqlite3_column_double (stmt, 0);
+		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+		    ctx->rtree_miny = sqlite3_column_double (stmt, 1);
+		if (sqlite3_column_type (stmt, 2) == SQLITE_FLOAT)
+		    ctx->rtree_maxx = sqlite3_column_double (stmt, 2);
+		if (sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
+		    ctx->rtree_maxy = sqlite3_column_double (stmt, 3);
+	    }
+	  else
+	    {
+		return 0;
+		break;
+	    }
+      }
+    return 1;
+}
+
+static int
+vknn_rtree_query (VKnnContextPtr ctx)
+{
+/* Querying the RTree - Intersections */
+    int err = 0;
+    int count = 0;
+    int ret;
+    sqlite3_stmt *stmt;
+    if (ctx == NULL)
+	return 0;
+    if (ctx->stmt_rtree == NULL)
+	return 0;
+    stmt = ctx->stmt_rtree;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_double (stmt, 1, ctx->rtree_maxx);
+    sqlite3_bind_double (stmt, 2, ctx->rtree_minx);
+    sqlite3_bind_double (stmt, 3, ctx->rtree_maxy);
+    sqlite3_bind_double (stmt, 4, ctx->rtree_miny);
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		double dist;
+		sqlite3_int64 rowid = sqlite3_column_int64 (stmt, 0);
+		dist = vknn_compute_distance (ctx, rowid);
+		vknn_update_items (ctx, rowid, dist);
+		count++;
+	    }
+	  else
+	    {
+		err = 1;
+		break;
+	    }
+      }
+    if (err)
+	return -1;
+    return count;
+}
+
+static int
+vknn_query_callback (sqlite3_rtree_query_info * info)
+{
+/* R*Tree Query Callback function */
+    double rtree_minx;
+    double rtree_maxx;
+    double rtree_miny;
+    double rtree_maxy;
+    double dist;
+    int mode;
+    VKnnContextPtr ctx = (VKnnContextPtr) (info->pContext);
+    if (info->nCoord != 4)
+      {
+	  /* invalid RTree */
+	  info->eWithin = NOT_WITHIN;
+	  return SQLITE_OK;
+      }
+
+/* fetching the node's BBOX */
+    rtree_minx = info->aCoord[0];
+    rtree_maxx = info->aCoord[1];
+    rtree_miny = info->aCoord[2];
+    rtree_maxy = info->aCoord[3];
+    if (info->iLevel > ctx->current_level)
+      {
+	  mode =
+	      vknn_check_mbr (ctx, rtree_minx, rtree_miny, rtree_maxx,
+			      rtree_maxy);
+	  if (mode == FULLY_WITHIN || mode == PARTLY_WITHIN)
+	    {
+		/* overlaps the current reference frame; to be further expanded */
+		info->eWithin = FULLY_WITHIN;
+	    }
+	  else
+	      info->eWithin = NOT_WITHIN;
+      }
+    else
+      {
+	  dist =
+	      vknn_rect_distance (ctx, rtree_minx, rtree_miny, rtree_maxx,
+				  rtree_maxy);
+	  if (dist < ctx->min_dist)
+	    {
+		ctx->minx = rtree_minx;
+		ctx->miny = rtree_miny;
+		ctx->maxx = rtree_maxx;
+		ctx->maxy = rtree_maxy;
+		ctx->min_dist = dist;
+		ctx->level = info->iLevel;
+	    }
+	  info->eWithin = NOT_WITHIN;
+      }
+    return SQLITE_OK;
+}
+
+static int
+vknn_mirror_enabled (const void *p_cache)
+{
+/* checks if the R*Tree mirror mode is enabled on this connection */
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) p_cache;
+    if (cache == NULL)
+	return 0;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return 0;
+    return cache->knnMirror;
+}
+
+static void
+vknn_fetch_next (VKnnContextPtr ctx)
+{
+/* incremental KNN: fetching the next nearest feature */
+    VKnnItemPtr item;
+    if (ctx->search == NULL || ctx->curr_items >= ctx->max_items)
+	return;
+    item = ctx->knn_array + ctx->curr_items;
+    if (vknn_search_next (ctx->search, &(item->rowid), &(item->dist)))
+	ctx->curr_items += 1;
+}
+
+static int
+vknn_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
+	     int argc, sqlite3_value ** argv)
+{
+/* setting up a cursor filter */
+    char *db_prefix = NULL;
+    char *table_name = NULL;
+    char *geom_column = NULL;
+    char *xtable = NULL;
+    char *xgeom = NULL;
+    char *xgeomQ;
+    char *xtableQ;
+    char *idx_name;
+    char *idx_nameQ;
+    char *sql_statement;
+    gaiaGeomCollPtr geom = NULL;
+    int ok_table = 0;
+    int ok_geom = 0;
+    int ok_max = 0;
+    int max_items = 3;
+    int is_geographic;
+    const unsigned char *blob;
+    int size;
+    int exists;
+    int ret;
+    double radius;
+    double dist;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *stmt_dist = NULL;
+    sqlite3_stmt *stmt_map_dist = NULL;
+    sqlite3_stmt *stmt_rect_dist = NULL;
+    sqlite3_stmt *stmt_pt_dist = NULL;
+    sqlite3_stmt *stmt_buffer = NULL;
+    sqlite3_stmt *stmt_rtree = NULL;
+    sqlite3_stmt *stmt_rtree_count = NULL;
+    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    VirtualKnnPtr knn = (VirtualKnnPtr) cursor->pVtab;
+    VKnnContextPtr vknn_context = knn->knn_ctx;
+    if (idxStr)
+	idxStr = idxStr;	/* unused arg warning suppression */
+    cursor->eof = 1;
+    if (idxStr)
+	idxStr = idxStr;	/* unused arg warning suppression */
+    cursor->eof = 1;
+    if (idxNum == 1 && argc == 3)
+      {
+	  /* retrieving the Table/Column/Geometry params */
+	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
+	    {
+		char *tn = (char *) sqlite3_value_text (argv[0]);
+		vknn_parse_table_name (tn, &db_prefix, &table_name);
+		ok_table = 1;
+	    }
+	  if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
+	    {
+		geom_column = (char *) sqlite3_value_text (argv[1]);
+		ok_geom = 1;
+	    }
+	  if (sqlite3_value_type (argv[2]) == SQLITE_BLOB)
+	    {
+		blob = sqlite3_value_blob (argv[2]);
+		size = sqlite3_value_bytes (argv[2]);
+		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+	    }
+	  if (ok_table && ok_geom && geom)
+	      ;
+	  else
+	    {
+		/* invalid args */
+		goto stop;
+	    }
+      }
+    if (idxNum == 2 && argc == 2)
+      {
+	  /* retrieving the Table/Geometry params */
+	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
+	    {
+		char *tn = (char *) sqlite3_value_text (argv[0]);
+		vknn_parse_table_name (tn, &db_prefix, &table_name);
+		ok_table = 1;
+	    }
+	  if (sqlite3_value_type (argv[1]) == SQLITE_BLOB)
+	    {
+		blob = sqlite3_value_blob (argv[1]);
+		size = sqlite3_value_bytes (argv[1]);
+		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+	    }
+	  if (ok_table && geom)
+	      ;
+	  else
+	    {
+		/* invalid args */
+		goto stop;
+	    }
+      }
+    if (idxNum == 3 && argc == 4)
+      {
+	  /* retrieving the Table/Column/Geometry/MaxItems params */
+	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
+	    {
+		char *tn = (char *) sqlite3_value_text (argv[0]);
+		vknn_parse_table_name (tn, &db_prefix, &table_name);
+		ok_table = 1;
+	    }
+	  if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
+	    {
+		geom_column = (char *) sqlite3_value_text (argv[1]);
+		ok_geom = 1;
+	    }
+	  if (sqlite3_value_type (argv[2]) == SQLITE_BLOB)
+	    {
+		blob = sqlite3_value_blob (argv[2]);
+		size = sqlite3_value_bytes (argv[2]);
+		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+	    }
+	  if (sqlite3_value_type (argv[3]) == SQLITE_INTEGER)
+	    {
+		max_items = sqlite3_value_int (argv[3]);
+		if (max_items > 1024)
+		    max_items = 1024;
+		if (max_items < 1)
+		    max_items = 1;
+		ok_max = 1;
+	    }
+	  if (ok_table && ok_geom && geom && ok_max)
+	      ;
+	  else
+	    {
+		/* invalid args */
+		goto stop;
+	    }
+      }
+    if (idxNum == 4 && argc == 3)
+      {
+	  /* retrieving the Table/Geometry/MaxItems params */
+	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
+	    {
+		char *tn = (char *) sqlite3_value_text (argv[0]);
+		vknn_parse_table_name (tn, &db_prefix, &table_name);
+		ok_table = 1;
+	    }
+	  if (sqlite3_value_type (argv[1]) == SQLITE_BLOB)
+	    {
+		blob = sqlite3_value_blob (argv[1]);
+		size = sqlite3_value_bytes (argv[1]);
+		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+	    }
+	  if (sqlite3_value_type (argv[2]) == SQLITE_INTEGER)
+	    {
+		max_items = sqlite3_value_int (argv[2]);
+		if (max_items > 1024)
+		    max_items = 1024;
+		if (max_items < 1)
+		    max_items = 1;
+		ok_max = 1;
+	    }
+	  if (ok_table && geom && ok_max)
+	      ;
+	  else
+	    {
+		/* invalid args */
+		goto stop;
+	    }
+      }
+
+/* checking if the corresponding R*Tree exists */
+    if (ok_geom)
+	exists =
+	    vknn_check_rtree (knn->db, db_prefix, table_name, geom_column,
+			      &xtable, &xgeom, &is_geographic);
+    else
+	exists =
+	    vknn_find_rtree (knn->db, db_prefix, table_name, &xtable,
+			     &xgeom, &is_geographic);
+    if (!exists)
+	goto stop;
+
+    if (vknn_mirror_enabled (knn->p_cache))
+      {
+	  /* incremental best-first search on the R*Tree mirror */
+	  gaiaMbrGeometry (geom);
+	  vknn_init_context (vknn_context, xtable, xgeom, geom, max_items,
+			     NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+	  vknn_context->search =
+	      vknn_search_create (knn->db, knn->p_cache, db_prefix, xtable,
+				  xgeom, is_geographic);
+	  if (vknn_context->search == NULL)
+	      goto stop;
+	  if (vknn_search_start
+	      (vknn_context->search, vknn_context->blob,
+	       vknn_context->blob_size))
+	      vknn_fetch_next (vknn_context);
+	  if (vknn_context->curr_items > 0)
+	      cursor->eof = 0;
+	  cursor->CurrentIndex = 0;
+	  goto stop;
+      }
+
+/* building the Distance query */
+    xgeomQ = gaiaDoubleQuotedSql (xgeom);
+    xtableQ = gaiaDoubleQuotedSql (xtable);
+    if (is_geographic)
+	sql_statement =
+	    sqlite3_mprintf
+	    ("SELECT ST_Distance(?, \"%s\", 1) FROM \"%s\" WHERE rowid = ?",
+	     xgeomQ, xtableQ);
+    else
+	sql_statement =
+	    sqlite3_mprintf
+	    ("SELECT ST_Distance(?, \"%s\") FROM \"%s\" WHERE rowid = ?",
+	     xgeomQ, xtableQ);
+    free (xgeomQ);
+    free (xtableQ);
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_dist, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the Distance query - map units */
+    xgeomQ = gaiaDoubleQuotedSql (xgeom);
+    xtableQ = gaiaDoubleQuotedSql (xtable);
+    sql_statement =
+	sqlite3_mprintf
+	("SELECT ST_Distance(?, \"%s\") FROM \"%s\" WHERE rowid = ?",
+	 xgeomQ, xtableQ);
+    free (xgeomQ);
+    free (xtableQ);
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_map_dist, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the Distance query - RTree MBR */
+    sql_statement = "SELECT ST_Distance(?, BuildMbr(?, ?, ?, ?))";
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_rect_dist, NULL);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the Distance query - Point */
+    sql_statement = "SELECT ST_Distance(?, MakePoint(?, ?))";
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_pt_dist, NULL);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the Buffer query */
+    sql_statement =
+	"SELECT MbrMinX(x.g), MbrMinY(x.g), MbrMaxX(x.g), MbrMaxY(x.g) "
+	"FROM (SELECT ST_Buffer(?, ?) AS g) AS x";
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_buffer, NULL);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the RTree query - Intersects */
+    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
+    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT pkid FROM main.\"%s\" WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?",
+	       idx_nameQ);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT pkid FROM \"%s\".\"%s\" WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?",
+	       quoted_db, idx_nameQ);
+	  free (quoted_db);
+      }
+    free (idx_nameQ);
+    sqlite3_free (idx_name);
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_rtree, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* building the RTree query - count items */
+    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
+    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf ("SELECT pkid FROM \"%s\" LIMIT 1024", idx_nameQ);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf ("SELECT pkid FROM \"%s\".\"%s\" LIMIT 1024",
+			       quoted_db, idx_nameQ);
+	  free (quoted_db);
+      }
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt_rtree_count, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+/* installing the R*Tree query callback */
+    gaiaMbrGeometry (geom);
+    vknn_init_context (vknn_context, xtable, xgeom, geom, max_items,
+		       stmt_dist, stmt_map_dist, stmt_rect_dist, stmt_pt_dist,
+		       stmt_buffer, stmt_rtree, stmt_rtree_count);
+    gaiaFreeGeomColl (geom);
+    geom = NULL;		/* releasing ownership on geom */
+    stmt_dist = NULL;		/* releasing ownership on stmt_dist */
+    stmt_map_dist = NULL;	/* releasing ownership on stmt_map_dist */
+    stmt_rect_dist = NULL;	/* releasing ownership on stmt_rect */
+    stmt_pt_dist = NULL;	/* releasing ownership on stmt_point */
+    stmt_buffer = NULL;		/* releasing ownership on stmt_buffer */
+    stmt_rtree = NULL;		/* releasing ownership on stmt_rtree */
+    stmt_rtree_count = NULL;	/* releasing ownership on stmt_rtree_count */
+    sqlite3_rtree_query_callback (knn->db, "knn_position", vknn_query_callback,
+				  vknn_context, NULL);
+
+/* building the RTree query - callback */
+    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
+    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
+    if (db_prefix == NULL)
+      {
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT pkid FROM main.\"%s\" WHERE pkid MATCH knn_position(1)",
+	       idx_nameQ);
+      }
+    else
+      {
+	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
+	  sql_statement =
+	      sqlite3_mprintf
+	      ("SELECT pkid FROM \"%s\".\"%s\" WHERE pkid MATCH knn_position(1)",
+	       quoted_db, idx_nameQ);
+	  free (quoted_db);
+      }
+    free (idx_nameQ);
+    sqlite3_free (idx_name);
+    ret =
+	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
+	goto stop;
+
+    vknn_context->bbox_minx = -DBL_MAX;
+    vknn_context->bbox_miny = -DBL_MAX;
+    vknn_context->bbox_maxx = DBL_MAX;
+    vknn_context->bbox_maxy = DBL_MAX;
+    vknn_context->current_level = 1024;
+    while (1)
+      {
+	  /* repeatedly querying the R*Tree until finding the nearest BBOX */
+	  vknn_context->minx = DBL_MAX;
+	  vknn_context->miny = DBL_MAX;
+	  vknn_context->maxx = -DBL_MAX;
+	  vknn_context->maxy = -DBL_MAX;
+	  vknn_context->min_dist = DBL_MAX;
+	  sqlite3_step (stmt);
+	  vknn_context->bbox_minx = vknn_context->minx;
+	  vknn_context->bbox_miny = vknn_context->miny;
+	  vknn_context->bbox_maxx = vknn_context->maxx;
+	  vknn_context->bbox_maxy = vknn_context->maxy;
+	  if (vknn_context->level <= 1)
+	      break;
+	  vknn_context->current_level = vknn_context->level - 1;
+      }
+    radius =
+	vknn_pt_distance (vknn_context, vknn_context->bbox_minx,
+			  vknn_context->bbox_miny);
+    dist =
+	vknn_pt_distance (vknn_context, vknn_context->bbox_minx,
+			  vknn_context->bbox_maxy);
+    if (dist > radius)
+	radius = dist;
+    dist =
+	vknn_pt_distance (vknn_context, vknn_context->bbox_maxx,
+			  vknn_context->bbox_miny);
+    if (dist > radius)
+	radius = dist;
+    dist =
+	vknn_pt_distance (vknn_context, vknn_context->bbox_maxx,
+			  vknn_context->bbox_maxy);
+    if (dist > radius)
+	radius = dist;
+
+    while (1)
+      {
+	  if (!vknn_bufferize (vknn_context, radius))
+	      break;
+	  ret = vknn_rtree_query (vknn_context);
+	  if (ret <= 0 || ret >= max_items || ret >= vknn_context->rtree_count)
+	      break;
+	  radius *= 1.05;
+      }
+
+    if (vknn_context->curr_items == 0)
+	cursor->eof = 1;
+    else
+	cursor->eof = 0;
+    cursor->CurrentIndex = 0;
+  stop:
+    if (geom)
+	gaiaFreeGeomColl (geom);
+    if (xtable)
+	free (xtable);
+    if (xgeom)
+	free (xgeom);
+    if (db_prefix)
+	free (db_prefix);
+    if (table_name)
+	free (table_name);
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (stmt_dist != NULL)
+	sqlite3_finalize (stmt_dist);
+    if (stmt_map_dist != NULL)
+	sqlite3_finalize (stmt_map_dist);
+    if (stmt_rect_dist != NULL)
+	sqlite3_finalize (stmt_rect_dist);
+    if (stmt_pt_dist != NULL)
+	sqlite3_finalize (stmt_pt_dist);
+    if (stmt_buffer != NULL)
+	sqlite3_finalize (stmt_buffer);
+    if (stmt_rtree != NULL)
+	sqlite3_finalize (stmt_rtree);
+    if (stmt_rtree_count != NULL)
+	sqlite3_finalize (stmt_rtree_count);
+    return SQLITE_OK;
+}
+
+static int
+vknn_next (sqlite3_vtab_cursor * pCursor)
+{
+/* fetching a next row from cursor */
+    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    VKnnContextPtr ctx = cursor->pVtab->knn_ctx;
+    cursor->CurrentIndex += 1;
+    if (cursor->CurrentIndex >= ctx->curr_items)
+	vknn_fetch_next (ctx);
+    if (cursor->CurrentIndex >= ctx->curr_items)
+	cursor->eof = 1;
+    return SQLITE_OK;
+}
+
+static int
+vknn_eof (sqlite3_vtab_cursor * pCursor)
+{
+/* cursor EOF */
+    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    return cursor->eof;
+}
+
+static int
+vknn_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
+	     int column)
+{
+/* fetching value for the Nth column */
+    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    VKnnContextPtr ctx = cursor->pVtab->knn_ctx;
+    VKnnItemPtr item = NULL;
+    if (cursor || column)
+	cursor = cursor;	/* unused arg warning suppression */
+    if (column)
+	column = column;	/* unused arg warning suppression */
+    if (cursor->CurrentIndex < ctx->curr_items)
+	item = ctx->knn_array + cursor->CurrentIndex;
+    if (column == 0)
+      {
+	  /* the Table Name column */
+	  sqlite3_result_text (pContext, ctx->table_name,
+			       strlen (ctx->table_name), SQLITE_STATIC);
+      }
+    else if (column == 1)
+      {
+	  /* the GeometryColumn Name column */
+	  sqlite3_result_text (pContext, ctx->column_name,
+			       strlen (ctx->column_name), SQLITE_STATIC);
+      }
+    else if (column == 2)
+      {
+	  /* the Reference Geometry column */
+	  sqlite3_result_blob (pContext, ctx->blob, ctx->blob_size,
+			       SQLITE_STATIC);
+      }
+    else if (column == 3)
+      {
+	  /* the Max Items column */
+	  sqlite3_result_int (pContext, ctx->max_items);
+      }
+    else if (column == 4)
+      {
+	  /* the index column */
+	  sqlite3_result_int (pContext, cursor->CurrentIndex + 1);
+      }
+    else if ((column == 5 || column == 6) && item != NULL)
+      {
+	  if (column == 5)
+	    {
+		/* the RowID column */
+		sqlite3_result_int64 (pContext, item->rowid);
+	    }
+	  else if (column == 6)
+	    {
+		/* the Distance column */
+		sqlite3_result_double (pContext, item->dist);
+	    }
+	  else
+	      sqlite3_result_null (pContext);
+      }
+    else
+	sqlite3_result_null (pContext);
+    return SQLITE_OK;
+}
+
+static int
+vknn_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
+{
+/* fetching the ROWID */
+    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    *pRowid = cursor->CurrentIndex;
+    return SQLITE_OK;
+}
+
+static int
+vknn_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
+	     sqlite_int64 * pRowid)
+{
+/* generic update [INSERT / UPDATE / DELETE */
+    if (pRowid || argc || argv || pVTab)
+	pRowid = pRowid;	/* unused arg warning suppression */
+/* read only datasource */
+    return SQLITE_READONLY;
+}
+
+static int
+vknn_begin (sqlite3_vtab * pVTab)
+{
+/* BEGIN TRANSACTION */
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    return SQLITE_OK;
+}
+
+static int
+vknn_sync (sqlite3_vtab * pVTab)
+{
+/* BEGIN TRANSACTION */
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    return SQLITE_OK;
+}
+
+static int
+vknn_commit (sqlite3_vtab * pVTab)
+{
+/* BEGIN TRANSACTION */
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    return SQLITE_OK;
+}
+
+static int
+vknn_rollback (sqlite3_vtab * pVTab)
+{
+/* BEGIN TRANSACTION */
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    return SQLITE_OK;
+}
+
+static int
+vknn_rename (sqlite3_vtab * pVTab, const char *zNew)
+{
+/* BEGIN TRANSACTION */
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    if (zNew)
+	zNew = zNew;		/* unused arg warning suppression */
+    return SQLITE_ERROR;
+}
+
+/******************************************************************************
+/
+/ VirtualKNNBatch: a KNN solution for each Geometry of a query table
+/
+******************************************************************************/
+
+typedef struct VKnnBatchContextStruct
+{
+/* current KNN Batch context */
+    char *table_name;
+    char *column_name;
+    char *q_table_name;
+    char *q_column_name;
+    int max_items;
+    sqlite3_stmt *stmt_query;
+    VKnnSearchPtr search;
+    sqlite3_int64 q_rowid;
+    VKnnItemPtr knn_array;
+    int curr_items;
+} VKnnBatchContext;
+typedef VKnnBatchContext *VKnnBatchContextPtr;
+
+typedef struct VirtualKnnBatchStruct
+{
+/* extends the sqlite3_vtab struct */
+    const sqlite3_module *pModule;	/* ptr to sqlite module: USED INTERNALLY BY SQLITE */
+    int nRef;			/* # references: USED INTERNALLY BY SQLITE */
+    char *zErrMsg;		/* error message: USE INTERNALLY BY SQLITE */
+    sqlite3 *db;		/* the sqlite db holding the virtual table */
+    const void *p_cache;	/* pointer to the internal cache */
+} VirtualKnnBatch;
+typedef VirtualKnnBatch *VirtualKnnBatchPtr;
+
+typedef struct VirtualKnnBatchCursorStruct
+{
+/* extends the sqlite3_vtab_cursor struct */
+    VirtualKnnBatchPtr pVtab;	/* Virtual table of this cursor */
+    int eof;			/* the EOF marker */
+    int CurrentIndex;		/* index of the current KNN item */
+    sqlite3_int64 CurrentRowid;	/* progressive row number */
+    VKnnBatchContextPtr ctx;	/* KNN Batch context */
+} VirtualKnnBatchCursor;
+typedef VirtualKnnBatchCursor *VirtualKnnBatchCursorPtr;
+
+static VKnnBatchContextPtr
+vknn_batch_create_context (void)
+{
+/* creating an empty KNN Batch context */
+    VKnnBatchContextPtr ctx = malloc (sizeof (VKnnBatchContext));
+    if (ctx == NULL)
+	return NULL;
+    ctx->table_name = NULL;
+    ctx->column_name = NULL;
+    ctx->q_table_name = NULL;
+    ctx->q_column_name = NULL;
+    ctx->max_items = 0;
+    ctx->stmt_query = NULL;
+    ctx->search = NULL;
+    ctx->q_rowid = 0;
+    ctx->knn_array = NULL;
+    ctx->curr_items = 0;
+    return ctx;
+}
+
+static void
+vknn_batch_free_context (VKnnBatchContextPtr ctx)
 {
-/* computing the distance between the geometry and an R*Tree BBOX */
-    double dist = DBL_MAX;
-    int ret;
-    sqlite3_stmt *stmt;
+/* freeing a KNN Batch context */
     if (ctx == NULL)
-	return DBL_MAX;
-    if (ctx->blob == NULL)
-	return DBL_MAX;
-    if (ctx->stmt_rect_dist == NULL)
-	return DBL_MAX;
-    stmt = ctx->stmt_rect_dist;
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
-    sqlite3_bind_double (stmt, 2, minx);
-    sqlite3_bind_double (stmt, 3, miny);
-    sqlite3_bind_double (stmt, 4, maxx);
-    sqlite3_bind_double (stmt, 5, maxy);
-    while (1)
-      {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
-		    dist = sqlite3_column_double (stmt, 0);
-	    }
-	  else
-	    {
-		dist = DBL_MAX;
-		break;
-	    }
-      }
-    return dist;
+	return;
+    if (ctx->table_name != NULL)
+	free (ctx->table_name);
+    if (ctx->column_name != NULL)
+	free (ctx->column_name);
+    if (ctx->q_table_name != NULL)
+	free (ctx->q_table_name);
+    if (ctx->q_column_name != NULL)
+	free (ctx->q_column_name);
+    if (ctx->stmt_query != NULL)
+	sqlite3_finalize (ctx->stmt_query);
+    vknn_search_free (ctx->search);
+    if (ctx->knn_array != NULL)
+	free (ctx->knn_array);
+    free (ctx);
 }
 
-static double
-vknn_pt_distance (VKnnContextPtr ctx, double x, double y)
+static int
+vknn_batch_next_query (VKnnBatchContextPtr ctx)
 {
-/* computing the distance between the geometry and a point */
-    double dist = DBL_MAX;
+/* fetching the next Query Geometry and solving its KNN */
     int ret;
-    sqlite3_stmt *stmt;
-    if (ctx == NULL)
-	return DBL_MAX;
-    if (ctx->blob == NULL)
-	return DBL_MAX;
-    if (ctx->stmt_pt_dist == NULL)
-	return DBL_MAX;
-    stmt = ctx->stmt_pt_dist;
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
-    sqlite3_bind_double (stmt, 2, x);
-    sqlite3_bind_double (stmt, 3, y);
+    VKnnItemPtr item;
+    sqlite3_stmt *stmt = ctx->stmt_query;
     while (1)
       {
 	  /* scrolling the result set rows */
 	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
-		    dist = sqlite3_column_double (stmt, 0);
-	    }
-	  else
+	  if (ret != SQLITE_ROW)
+	      return 0;
+	  if (sqlite3_column_type (stmt, 1) != SQLITE_BLOB)
+	      continue;
+	  if (!vknn_search_start
+	      (ctx->search, sqlite3_column_blob (stmt, 1),
+	       sqlite3_column_bytes (stmt, 1)))
+	      continue;
+	  ctx->q_rowid = sqlite3_column_int64 (stmt, 0);
+	  ctx->curr_items = 0;
+	  while (ctx->curr_items < ctx->max_items)
 	    {
-		dist = DBL_MAX;
-		break;
+		item = ctx->knn_array + ctx->curr_items;
+		if (!vknn_search_next
+		    (ctx->search, &(item->rowid), &(item->dist)))
+		    break;
+		ctx->curr_items += 1;
 	    }
+	  if (ctx->curr_items > 0)
+	      return 1;
       }
-    return dist;
 }
 
 static int
-vknn_bufferize (VKnnContextPtr ctx, double radius)
+vknn_batch_find_geometry (sqlite3 * sqlite, const char *db_prefix,
+			  const char *table_name, char **geom_column)
 {
-/* computing the frame for an R*Tree query */
-    int ret;
+/* attempts to find the unique Geometry Column of the Query table */
     sqlite3_stmt *stmt;
-    if (ctx == NULL)
-	return 0;
-    if (ctx->blob == NULL)
-	return 0;
-    if (ctx->stmt_buffer == NULL)
+    char *sql_statement;
+    char *quoted_db;
+    int ret;
+    int count = 0;
+    char *gc = NULL;
+
+    if (db_prefix == NULL)
+	quoted_db = gaiaDoubleQuotedSql ("main");
+    else
+	quoted_db = gaiaDoubleQuotedSql (db_prefix);
+    sql_statement =
+	sqlite3_mprintf
+	("SELECT f_geometry_column FROM \"%s\".geometry_columns "
+	 "WHERE Upper(f_table_name) = Upper(%Q)", quoted_db, table_name);
+    free (quoted_db);
+    ret =
+	sqlite3_prepare_v2 (sqlite, sql_statement, strlen (sql_statement),
+			    &stmt, NULL);
+    sqlite3_free (sql_statement);
+    if (ret != SQLITE_OK)
 	return 0;
-    stmt = ctx->stmt_buffer;
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_blob (stmt, 1, ctx->blob, ctx->blob_size, SQLITE_STATIC);
-    sqlite3_bind_double (stmt, 2, radius);
     while (1)
       {
 	  /* scrolling the result set rows */
@@ -1136,578 +3194,403 @@ vknn_bufferize (VKnnContextPtr ctx, double radius)
 	      break;		/* end of result set */
 	  if (ret == SQLITE_ROW)
 	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_FLOAT)
-		    ctx->rtree_minx = sqlite3_column_double (stmt, 0);
-		if (sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
-		    ctx->rtree_miny = sqlite3_column_double (stmt, 1);
-		if (sqlite3_column_type (stmt, 2) == SQLITE_FLOAT)
-		    ctx->rtree_maxx = sqlite3_column_double (stmt, 2);
-		if (sqlite3_column_type (stmt, 3) == SQLITE_FLOAT)
-		    ctx->rtree_maxy = sqlite3_column_double (stmt, 3);
+		const char *v = (const char *) sqlite3_column_text (stmt, 0);
+		int len = sqlite3_column_bytes (stmt, 0);
+		if (gc)
+		    free (gc);
+		gc = malloc (len + 1);
+		strcpy (gc, v);
+		count++;
 	    }
 	  else
-	    {
-		return 0;
-		break;
-	    }
+	      break;
+      }
+    sqlite3_finalize (stmt);
+    if (count != 1)
+      {
+	  if (gc)
+	      free (gc);
+	  return 0;
       }
+    *geom_column = gc;
     return 1;
 }
 
 static int
-vknn_rtree_query (VKnnContextPtr ctx)
+vknn_batch_create (sqlite3 * db, void *pAux, int argc,
+		   const char *const *argv, sqlite3_vtab ** ppVTab,
+		   char **pzErr)
 {
-/* Querying the RTree - Intersections */
-    int err = 0;
-    int count = 0;
-    int ret;
-    sqlite3_stmt *stmt;
-    if (ctx == NULL)
-	return 0;
-    if (ctx->stmt_rtree == NULL)
-	return 0;
-    stmt = ctx->stmt_rtree;
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, ctx->rtree_maxx);
-    sqlite3_bind_double (stmt, 2, ctx->rtree_minx);
-    sqlite3_bind_double (stmt, 3, ctx->rtree_maxy);
-    sqlite3_bind_double (stmt, 4, ctx->rtree_miny);
-    while (1)
+/* creates the virtual table for R*Tree KNN Batch metahandling */
+    VirtualKnnBatchPtr p_vt;
+    char *buf;
+    char *vtable;
+    char *xname;
+    if (argc == 3)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		double dist;
-		sqlite3_int64 rowid = sqlite3_column_int64 (stmt, 0);
-		dist = vknn_compute_distance (ctx, rowid);
-		vknn_update_items (ctx, rowid, dist);
-		count++;
-	    }
-	  else
-	    {
-		err = 1;
-		break;
-	    }
+	  vtable = gaiaDequotedSql ((char *) argv[2]);
       }
-    if (err)
-	return -1;
-    return count;
+    else
+      {
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[VirtualKNNBatch module] CREATE VIRTUAL: illegal arg list {void}\n");
+	  return SQLITE_ERROR;
+      }
+    p_vt = (VirtualKnnBatchPtr) sqlite3_malloc (sizeof (VirtualKnnBatch));
+    if (!p_vt)
+	return SQLITE_NOMEM;
+    p_vt->db = db;
+    p_vt->p_cache = pAux;
+    p_vt->pModule = &my_knn_batch_module;
+    p_vt->nRef = 0;
+    p_vt->zErrMsg = NULL;
+/* preparing the COLUMNs for this VIRTUAL TABLE */
+    xname = gaiaDoubleQuotedSql (vtable);
+    buf = sqlite3_mprintf ("CREATE TABLE \"%s\" (f_table_name TEXT, "
+			   "f_geometry_column TEXT, q_table_name TEXT, "
+			   "q_geometry_column TEXT, max_items INTEGER, "
+			   "q_rowid INTEGER, pos INTEGER, fid INTEGER, "
+			   "distance DOUBLE)", xname);
+    free (xname);
+    free (vtable);
+    if (sqlite3_declare_vtab (db, buf) != SQLITE_OK)
+      {
+	  *pzErr =
+	      sqlite3_mprintf
+	      ("[VirtualKNNBatch module] CREATE VIRTUAL: invalid SQL statement \"%s\"",
+	       buf);
+	  sqlite3_free (buf);
+	  sqlite3_free (p_vt);
+	  return SQLITE_ERROR;
+      }
+    sqlite3_free (buf);
+    *ppVTab = (sqlite3_vtab *) p_vt;
+    return SQLITE_OK;
 }
 
 static int
-vknn_query_callback (sqlite3_rtree_query_info * info)
+vknn_batch_connect (sqlite3 * db, void *pAux, int argc,
+		    const char *const *argv, sqlite3_vtab ** ppVTab,
+		    char **pzErr)
 {
-/* R*Tree Query Callback function */
-    double rtree_minx;
-    double rtree_maxx;
-    double rtree_miny;
-    double rtree_maxy;
-    double dist;
-    int mode;
-    VKnnContextPtr ctx = (VKnnContextPtr) (info->pContext);
-    if (info->nCoord != 4)
+/* connects the virtual table - simply aliases vknn_batch_create() */
+    return vknn_batch_create (db, pAux, argc, argv, ppVTab, pzErr);
+}
+
+static int
+vknn_batch_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
+{
+/* best index selection */
+    int i;
+    int col;
+    int arg = 0;
+    int count[5];
+    int which[5];
+    if (pVTab)
+	pVTab = pVTab;		/* unused arg warning suppression */
+    for (col = 0; col < 5; col++)
       {
-	  /* invalid RTree */
-	  info->eWithin = NOT_WITHIN;
-	  return SQLITE_OK;
+	  count[col] = 0;
+	  which[col] = -1;
       }
-
-/* fetching the node's BBOX */
-    rtree_minx = info->aCoord[0];
-    rtree_maxx = info->aCoord[1];
-    rtree_miny = info->aCoord[2];
-    rtree_maxy = info->aCoord[3];
-    if (info->iLevel > ctx->current_level)
+    for (i = 0; i < pIdxInfo->nConstraint; i++)
       {
-	  mode =
-	      vknn_check_mbr (ctx, rtree_minx, rtree_miny, rtree_maxx,
-			      rtree_maxy);
-	  if (mode == FULLY_WITHIN || mode == PARTLY_WITHIN)
+	  /* verifying the constraints */
+	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
+	  if (p->usable && p->op == SQLITE_INDEX_CONSTRAINT_EQ
+	      && p->iColumn >= 0 && p->iColumn < 5)
 	    {
-		/* overlaps the current reference frame; to be further expanded */
-		info->eWithin = FULLY_WITHIN;
+		count[p->iColumn] += 1;
+		which[p->iColumn] = i;
 	    }
-	  else
-	      info->eWithin = NOT_WITHIN;
       }
-    else
+    pIdxInfo->idxNum = 0;
+    for (col = 0; col < 5; col++)
       {
-	  dist =
-	      vknn_rect_distance (ctx, rtree_minx, rtree_miny, rtree_maxx,
-				  rtree_maxy);
-	  if (dist < ctx->min_dist)
-	    {
-		ctx->minx = rtree_minx;
-		ctx->miny = rtree_miny;
-		ctx->maxx = rtree_maxx;
-		ctx->maxy = rtree_maxy;
-		ctx->min_dist = dist;
-		ctx->level = info->iLevel;
-	    }
-	  info->eWithin = NOT_WITHIN;
+	  if (count[col] > 1)
+	      return SQLITE_OK;	/* illegal query */
+      }
+    if (count[0] != 1 || count[2] != 1)
+      {
+	  /* both the Table Names are mandatory */
+	  pIdxInfo->estimatedCost = 1.0e12;
+	  return SQLITE_OK;
       }
+
+/* 
+/ this one is a valid KNN Batch query
+/ idxNum bitmask: 1=Tables, 2=f_geometry_column, 4=q_geometry_column, 8=max_items
+*/
+    pIdxInfo->idxNum = 1;
+    if (count[1])
+	pIdxInfo->idxNum |= 2;
+    if (count[3])
+	pIdxInfo->idxNum |= 4;
+    if (count[4])
+	pIdxInfo->idxNum |= 8;
+    for (col = 0; col < 5; col++)
+      {
+	  /* passing the arguments in column order */
+	  if (which[col] < 0)
+	      continue;
+	  arg++;
+	  pIdxInfo->aConstraintUsage[which[col]].argvIndex = arg;
+	  pIdxInfo->aConstraintUsage[which[col]].omit = 1;
+      }
+    pIdxInfo->estimatedCost = 1.0;
+    return SQLITE_OK;
+}
+
+static int
+vknn_batch_disconnect (sqlite3_vtab * pVTab)
+{
+/* disconnects the virtual table */
+    VirtualKnnBatchPtr p_vt = (VirtualKnnBatchPtr) pVTab;
+    sqlite3_free (p_vt);
     return SQLITE_OK;
 }
 
 static int
-vknn_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
-	     int argc, sqlite3_value ** argv)
+vknn_batch_destroy (sqlite3_vtab * pVTab)
+{
+/* destroys the virtual table - simply aliases vknn_batch_disconnect() */
+    return vknn_batch_disconnect (pVTab);
+}
+
+static int
+vknn_batch_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
+{
+/* opening a new cursor */
+    VirtualKnnBatchCursorPtr cursor =
+	(VirtualKnnBatchCursorPtr)
+	sqlite3_malloc (sizeof (VirtualKnnBatchCursor));
+    if (cursor == NULL)
+	return SQLITE_ERROR;
+    cursor->pVtab = (VirtualKnnBatchPtr) pVTab;
+    cursor->eof = 1;
+    cursor->CurrentIndex = 0;
+    cursor->CurrentRowid = 0;
+    cursor->ctx = NULL;
+    *ppCursor = (sqlite3_vtab_cursor *) cursor;
+    return SQLITE_OK;
+}
+
+static int
+vknn_batch_close (sqlite3_vtab_cursor * pCursor)
+{
+/* closing the cursor */
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
+    vknn_batch_free_context (cursor->ctx);
+    sqlite3_free (pCursor);
+    return SQLITE_OK;
+}
+
+static int
+vknn_batch_filter (sqlite3_vtab_cursor * pCursor, int idxNum,
+		   const char *idxStr, int argc, sqlite3_value ** argv)
 {
 /* setting up a cursor filter */
     char *db_prefix = NULL;
     char *table_name = NULL;
-    char *geom_column = NULL;
+    char *q_db_prefix = NULL;
+    char *q_table_name = NULL;
     char *xtable = NULL;
     char *xgeom = NULL;
+    char *q_geom = NULL;
     char *xgeomQ;
     char *xtableQ;
-    char *idx_name;
-    char *idx_nameQ;
+    char *xdbQ;
     char *sql_statement;
-    gaiaGeomCollPtr geom = NULL;
-    int ok_table = 0;
-    int ok_geom = 0;
-    int ok_max = 0;
     int max_items = 3;
     int is_geographic;
-    const unsigned char *blob;
-    int size;
     int exists;
     int ret;
-    double radius;
-    double dist;
-    sqlite3_stmt *stmt = NULL;
-    sqlite3_stmt *stmt_dist = NULL;
-    sqlite3_stmt *stmt_map_dist = NULL;
-    sqlite3_stmt *stmt_rect_dist = NULL;
-    sqlite3_stmt *stmt_pt_dist = NULL;
-    sqlite3_stmt *stmt_buffer = NULL;
-    sqlite3_stmt *stmt_rtree = NULL;
-    sqlite3_stmt *stmt_rtree_count = NULL;
-    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
-    VirtualKnnPtr knn = (VirtualKnnPtr) cursor->pVtab;
-    VKnnContextPtr vknn_context = knn->knn_ctx;
-    if (idxStr)
-	idxStr = idxStr;	/* unused arg warning suppression */
-    cursor->eof = 1;
+    int arg = 0;
+    const char *geom_column = NULL;
+    const char *q_geom_column = NULL;
+    VKnnBatchContextPtr ctx;
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
+    VirtualKnnBatchPtr knn = (VirtualKnnBatchPtr) cursor->pVtab;
     if (idxStr)
 	idxStr = idxStr;	/* unused arg warning suppression */
     cursor->eof = 1;
-    if (idxNum == 1 && argc == 3)
+    cursor->CurrentIndex = 0;
+    cursor->CurrentRowid = 0;
+    vknn_batch_free_context (cursor->ctx);
+    cursor->ctx = NULL;
+    if (!(idxNum & 1))
+	return SQLITE_OK;
+
+/* retrieving the Table/Column/QueryTable/QueryColumn/MaxItems params */
+    if (arg < argc && sqlite3_value_type (argv[arg]) == SQLITE_TEXT)
       {
-	  /* retrieving the Table/Column/Geometry params */
-	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
-	    {
-		char *tn = (char *) sqlite3_value_text (argv[0]);
-		vknn_parse_table_name (tn, &db_prefix, &table_name);
-		ok_table = 1;
-	    }
-	  if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
-	    {
-		geom_column = (char *) sqlite3_value_text (argv[1]);
-		ok_geom = 1;
-	    }
-	  if (sqlite3_value_type (argv[2]) == SQLITE_BLOB)
-	    {
-		blob = sqlite3_value_blob (argv[2]);
-		size = sqlite3_value_bytes (argv[2]);
-		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-	    }
-	  if (ok_table && ok_geom && geom)
-	      ;
-	  else
-	    {
-		/* invalid args */
-		goto stop;
-	    }
+	  char *tn = (char *) sqlite3_value_text (argv[arg]);
+	  vknn_parse_table_name (tn, &db_prefix, &table_name);
       }
-    if (idxNum == 2 && argc == 2)
+    arg++;
+    if (idxNum & 2)
       {
-	  /* retrieving the Table/Geometry params */
-	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
-	    {
-		char *tn = (char *) sqlite3_value_text (argv[0]);
-		vknn_parse_table_name (tn, &db_prefix, &table_name);
-		ok_table = 1;
-	    }
-	  if (sqlite3_value_type (argv[1]) == SQLITE_BLOB)
-	    {
-		blob = sqlite3_value_blob (argv[1]);
-		size = sqlite3_value_bytes (argv[1]);
-		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-	    }
-	  if (ok_table && geom)
-	      ;
-	  else
-	    {
-		/* invalid args */
-		goto stop;
-	    }
+	  if (arg < argc && sqlite3_value_type (argv[arg]) == SQLITE_TEXT)
+	      geom_column = (const char *) sqlite3_value_text (argv[arg]);
+	  if (geom_column == NULL)
+	      goto stop;
+	  arg++;
       }
-    if (idxNum == 3 && argc == 4)
+    if (arg < argc && sqlite3_value_type (argv[arg]) == SQLITE_TEXT)
       {
-	  /* retrieving the Table/Column/Geometry/MaxItems params */
-	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
-	    {
-		char *tn = (char *) sqlite3_value_text (argv[0]);
-		vknn_parse_table_name (tn, &db_prefix, &table_name);
-		ok_table = 1;
-	    }
-	  if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
-	    {
-		geom_column = (char *) sqlite3_value_text (argv[1]);
-		ok_geom = 1;
-	    }
-	  if (sqlite3_value_type (argv[2]) == SQLITE_BLOB)
-	    {
-		blob = sqlite3_value_blob (argv[2]);
-		size = sqlite3_value_bytes (argv[2]);
-		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-	    }
-	  if (sqlite3_value_type (argv[3]) == SQLITE_INTEGER)
-	    {
-		max_items = sqlite3_value_int (argv[3]);
-		if (max_items > 1024)
-		    max_items = 1024;
-		if (max_items < 1)
-		    max_items = 1;
-		ok_max = 1;
-	    }
-	  if (ok_table && ok_geom && geom && ok_max)
-	      ;
-	  else
-	    {
-		/* invalid args */
-		goto stop;
-	    }
+	  char *tn = (char *) sqlite3_value_text (argv[arg]);
+	  vknn_parse_table_name (tn, &q_db_prefix, &q_table_name);
       }
-    if (idxNum == 4 && argc == 3)
+    arg++;
+    if (idxNum & 4)
       {
-	  /* retrieving the Table/Geometry/MaxItems params */
-	  if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
-	    {
-		char *tn = (char *) sqlite3_value_text (argv[0]);
-		vknn_parse_table_name (tn, &db_prefix, &table_name);
-		ok_table = 1;
-	    }
-	  if (sqlite3_value_type (argv[1]) == SQLITE_BLOB)
-	    {
-		blob = sqlite3_value_blob (argv[1]);
-		size = sqlite3_value_bytes (argv[1]);
-		geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-	    }
-	  if (sqlite3_value_type (argv[2]) == SQLITE_INTEGER)
+	  if (arg < argc && sqlite3_value_type (argv[arg]) == SQLITE_TEXT)
+	      q_geom_column = (const char *) sqlite3_value_text (argv[arg]);
+	  if (q_geom_column == NULL)
+	      goto stop;
+	  arg++;
+      }
+    if (idxNum & 8)
+      {
+	  if (arg < argc && sqlite3_value_type (argv[arg]) == SQLITE_INTEGER)
 	    {
-		max_items = sqlite3_value_int (argv[2]);
+		max_items = sqlite3_value_int (argv[arg]);
 		if (max_items > 1024)
 		    max_items = 1024;
 		if (max_items < 1)
 		    max_items = 1;
-		ok_max = 1;
 	    }
-	  if (ok_table && geom && ok_max)
-	      ;
 	  else
-	    {
-		/* invalid args */
-		goto stop;
-	    }
+	      goto stop;
+	  arg++;
       }
+    if (table_name == NULL || q_table_name == NULL)
+	goto stop;
 
 /* checking if the corresponding R*Tree exists */
-    if (ok_geom)
+    if (geom_column != NULL)
 	exists =
 	    vknn_check_rtree (knn->db, db_prefix, table_name, geom_column,
 			      &xtable, &xgeom, &is_geographic);
     else
 	exists =
 	    vknn_find_rtree (knn->db, db_prefix, table_name, &xtable,
-			     &xgeom, &is_geographic);
-    if (!exists)
-	goto stop;
-
-/* building the Distance query */
-    xgeomQ = gaiaDoubleQuotedSql (xgeom);
-    xtableQ = gaiaDoubleQuotedSql (xtable);
-    if (is_geographic)
-	sql_statement =
-	    sqlite3_mprintf
-	    ("SELECT ST_Distance(?, \"%s\", 1) FROM \"%s\" WHERE rowid = ?",
-	     xgeomQ, xtableQ);
-    else
-	sql_statement =
-	    sqlite3_mprintf
-	    ("SELECT ST_Distance(?, \"%s\") FROM \"%s\" WHERE rowid = ?",
-	     xgeomQ, xtableQ);
-    free (xgeomQ);
-    free (xtableQ);
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_dist, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	goto stop;
-
-/* building the Distance query - map units */
-    xgeomQ = gaiaDoubleQuotedSql (xgeom);
-    xtableQ = gaiaDoubleQuotedSql (xtable);
-    sql_statement =
-	sqlite3_mprintf
-	("SELECT ST_Distance(?, \"%s\") FROM \"%s\" WHERE rowid = ?",
-	 xgeomQ, xtableQ);
-    free (xgeomQ);
-    free (xtableQ);
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_map_dist, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
-	goto stop;
-
-/* building the Distance query - RTree MBR */
-    sql_statement = "SELECT ST_Distance(?, BuildMbr(?, ?, ?, ?))";
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_rect_dist, NULL);
-    if (ret != SQLITE_OK)
-	goto stop;
-
-/* building the Distance query - Point */
-    sql_statement = "SELECT ST_Distance(?, MakePoint(?, ?))";
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_pt_dist, NULL);
-    if (ret != SQLITE_OK)
-	goto stop;
-
-/* building the Buffer query */
-    sql_statement =
-	"SELECT MbrMinX(x.g), MbrMinY(x.g), MbrMaxX(x.g), MbrMaxY(x.g) "
-	"FROM (SELECT ST_Buffer(?, ?) AS g) AS x";
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_buffer, NULL);
-    if (ret != SQLITE_OK)
-	goto stop;
-
-/* building the RTree query - Intersects */
-    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
-    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
-    if (db_prefix == NULL)
-      {
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT pkid FROM main.\"%s\" WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?",
-	       idx_nameQ);
-      }
-    else
-      {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT pkid FROM \"%s\".\"%s\" WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?",
-	       quoted_db, idx_nameQ);
-	  free (quoted_db);
-      }
-    free (idx_nameQ);
-    sqlite3_free (idx_name);
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_rtree, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
+			     &xgeom, &is_geographic);
+    if (!exists)
 	goto stop;
 
-/* building the RTree query - count items */
-    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
-    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
-    if (db_prefix == NULL)
-      {
-	  sql_statement =
-	      sqlite3_mprintf ("SELECT pkid FROM \"%s\" LIMIT 1024", idx_nameQ);
-      }
-    else
+/* identifying the Query Geometry column */
+    if (q_geom_column != NULL)
       {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf ("SELECT pkid FROM \"%s\".\"%s\" LIMIT 1024",
-			       quoted_db, idx_nameQ);
-	  free (quoted_db);
+	  int len = strlen (q_geom_column);
+	  q_geom = malloc (len + 1);
+	  strcpy (q_geom, q_geom_column);
       }
-    ret =
-	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt_rtree_count, NULL);
-    sqlite3_free (sql_statement);
-    if (ret != SQLITE_OK)
+    else if (!vknn_batch_find_geometry
+	     (knn->db, q_db_prefix, q_table_name, &q_geom))
 	goto stop;
 
-/* installing the R*Tree query callback */
-    gaiaMbrGeometry (geom);
-    vknn_init_context (vknn_context, xtable, xgeom, geom, max_items,
-		       stmt_dist, stmt_map_dist, stmt_rect_dist, stmt_pt_dist,
-		       stmt_buffer, stmt_rtree, stmt_rtree_count);
-    gaiaFreeGeomColl (geom);
-    geom = NULL;		/* releasing ownership on geom */
-    stmt_dist = NULL;		/* releasing ownership on stmt_dist */
-    stmt_map_dist = NULL;	/* releasing ownership on stmt_map_dist */
-    stmt_rect_dist = NULL;	/* releasing ownership on stmt_rect */
-    stmt_pt_dist = NULL;	/* releasing ownership on stmt_point */
-    stmt_buffer = NULL;		/* releasing ownership on stmt_buffer */
-    stmt_rtree = NULL;		/* releasing ownership on stmt_rtree */
-    stmt_rtree_count = NULL;	/* releasing ownership on stmt_rtree_count */
-    sqlite3_rtree_query_callback (knn->db, "knn_position", vknn_query_callback,
-				  vknn_context, NULL);
+    ctx = vknn_batch_create_context ();
+    if (ctx == NULL)
+	goto stop;
+    cursor->ctx = ctx;
+    ctx->table_name = xtable;
+    ctx->column_name = xgeom;
+    ctx->q_table_name = q_table_name;
+    ctx->q_column_name = q_geom;
+    xtable = NULL;		/* releasing ownership on xtable */
+    xgeom = NULL;		/* releasing ownership on xgeom */
+    q_table_name = NULL;	/* releasing ownership on q_table_name */
+    q_geom = NULL;		/* releasing ownership on q_geom */
+    ctx->max_items = max_items;
+    ctx->knn_array = malloc (sizeof (VKnnItem) * max_items);
+    if (ctx->knn_array == NULL)
+	goto stop;
 
-/* building the RTree query - callback */
-    idx_name = sqlite3_mprintf ("idx_%s_%s", xtable, xgeom);
-    idx_nameQ = gaiaDoubleQuotedSql (idx_name);
-    if (db_prefix == NULL)
-      {
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT pkid FROM main.\"%s\" WHERE pkid MATCH knn_position(1)",
-	       idx_nameQ);
-      }
-    else
-      {
-	  char *quoted_db = gaiaDoubleQuotedSql (db_prefix);
-	  sql_statement =
-	      sqlite3_mprintf
-	      ("SELECT pkid FROM \"%s\".\"%s\" WHERE pkid MATCH knn_position(1)",
-	       quoted_db, idx_nameQ);
-	  free (quoted_db);
-      }
-    free (idx_nameQ);
-    sqlite3_free (idx_name);
+/* preparing the best-first search */
+    ctx->search =
+	vknn_search_create (knn->db, knn->p_cache, db_prefix, ctx->table_name,
+			    ctx->column_name, is_geographic);
+    if (ctx->search == NULL)
+	goto stop;
+
+/* building the Query Geometries query */
+    xgeomQ = gaiaDoubleQuotedSql (ctx->q_column_name);
+    xtableQ = gaiaDoubleQuotedSql (ctx->q_table_name);
+    xdbQ = gaiaDoubleQuotedSql ((q_db_prefix == NULL) ? "main" : q_db_prefix);
+    sql_statement =
+	sqlite3_mprintf ("SELECT ROWID, \"%s\" FROM \"%s\".\"%s\"", xgeomQ,
+			 xdbQ, xtableQ);
+    free (xgeomQ);
+    free (xtableQ);
+    free (xdbQ);
     ret =
 	sqlite3_prepare_v2 (knn->db, sql_statement, strlen (sql_statement),
-			    &stmt, NULL);
+			    &(ctx->stmt_query), NULL);
     sqlite3_free (sql_statement);
     if (ret != SQLITE_OK)
 	goto stop;
 
-    vknn_context->bbox_minx = -DBL_MAX;
-    vknn_context->bbox_miny = -DBL_MAX;
-    vknn_context->bbox_maxx = DBL_MAX;
-    vknn_context->bbox_maxy = DBL_MAX;
-    vknn_context->current_level = 1024;
-    while (1)
-      {
-	  /* repeatedly querying the R*Tree until finding the nearest BBOX */
-	  vknn_context->minx = DBL_MAX;
-	  vknn_context->miny = DBL_MAX;
-	  vknn_context->maxx = -DBL_MAX;
-	  vknn_context->maxy = -DBL_MAX;
-	  vknn_context->min_dist = DBL_MAX;
-	  sqlite3_step (stmt);
-	  vknn_context->bbox_minx = vknn_context->minx;
-	  vknn_context->bbox_miny = vknn_context->miny;
-	  vknn_context->bbox_maxx = vknn_context->maxx;
-	  vknn_context->bbox_maxy = vknn_context->maxy;
-	  if (vknn_context->level <= 1)
-	      break;
-	  vknn_context->current_level = vknn_context->level - 1;
-      }
-    radius =
-	vknn_pt_distance (vknn_context, vknn_context->bbox_minx,
-			  vknn_context->bbox_miny);
-    dist =
-	vknn_pt_distance (vknn_context, vknn_context->bbox_minx,
-			  vknn_context->bbox_maxy);
-    if (dist > radius)
-	radius = dist;
-    dist =
-	vknn_pt_distance (vknn_context, vknn_context->bbox_maxx,
-			  vknn_context->bbox_miny);
-    if (dist > radius)
-	radius = dist;
-    dist =
-	vknn_pt_distance (vknn_context, vknn_context->bbox_maxx,
-			  vknn_context->bbox_maxy);
-    if (dist > radius)
-	radius = dist;
-
-    while (1)
-      {
-	  if (!vknn_bufferize (vknn_context, radius))
-	      break;
-	  ret = vknn_rtree_query (vknn_context);
-	  if (ret <= 0 || ret >= max_items || ret >= vknn_context->rtree_count)
-	      break;
-	  radius *= 1.05;
-      }
-
-    if (vknn_context->curr_items == 0)
-	cursor->eof = 1;
-    else
+/* solving the first Query Geometry */
+    if (vknn_batch_next_query (ctx))
 	cursor->eof = 0;
-    cursor->CurrentIndex = 0;
+
   stop:
-    if (geom)
-	gaiaFreeGeomColl (geom);
-    if (xtable)
-	free (xtable);
-    if (xgeom)
-	free (xgeom);
-    if (db_prefix)
+    if (db_prefix != NULL)
 	free (db_prefix);
-    if (table_name)
+    if (table_name != NULL)
 	free (table_name);
-    if (stmt != NULL)
-	sqlite3_finalize (stmt);
-    if (stmt_dist != NULL)
-	sqlite3_finalize (stmt_dist);
-    if (stmt_map_dist != NULL)
-	sqlite3_finalize (stmt_map_dist);
-    if (stmt_rect_dist != NULL)
-	sqlite3_finalize (stmt_rect_dist);
-    if (stmt_pt_dist != NULL)
-	sqlite3_finalize (stmt_pt_dist);
-    if (stmt_buffer != NULL)
-	sqlite3_finalize (stmt_buffer);
-    if (stmt_rtree != NULL)
-	sqlite3_finalize (stmt_rtree);
-    if (stmt_rtree_count != NULL)
-	sqlite3_finalize (stmt_rtree_count);
+    if (q_db_prefix != NULL)
+	free (q_db_prefix);
+    if (q_table_name != NULL)
+	free (q_table_name);
+    if (xtable != NULL)
+	free (xtable);
+    if (xgeom != NULL)
+	free (xgeom);
+    if (q_geom != NULL)
+	free (q_geom);
     return SQLITE_OK;
 }
 
 static int
-vknn_next (sqlite3_vtab_cursor * pCursor)
+vknn_batch_next (sqlite3_vtab_cursor * pCursor)
 {
 /* fetching a next row from cursor */
-    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
-    VKnnContextPtr ctx = cursor->pVtab->knn_ctx;
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
+    VKnnBatchContextPtr ctx = cursor->ctx;
     cursor->CurrentIndex += 1;
-    if (cursor->CurrentIndex >= ctx->curr_items)
+    cursor->CurrentRowid += 1;
+    if (cursor->CurrentIndex < ctx->curr_items)
+	return SQLITE_OK;
+    cursor->CurrentIndex = 0;
+    if (!vknn_batch_next_query (ctx))
 	cursor->eof = 1;
     return SQLITE_OK;
 }
 
 static int
-vknn_eof (sqlite3_vtab_cursor * pCursor)
+vknn_batch_eof (sqlite3_vtab_cursor * pCursor)
 {
 /* cursor EOF */
-    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
     return cursor->eof;
 }
 
 static int
-vknn_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
-	     int column)
+vknn_batch_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
+		   int column)
 {
 /* fetching value for the Nth column */
-    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
-    VKnnContextPtr ctx = cursor->pVtab->knn_ctx;
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
+    VKnnBatchContextPtr ctx = cursor->ctx;
     VKnnItemPtr item = NULL;
-    if (cursor || column)
-	cursor = cursor;	/* unused arg warning suppression */
-    if (column)
-	column = column;	/* unused arg warning suppression */
+    if (ctx == NULL)
+      {
+	  sqlite3_result_null (pContext);
+	  return SQLITE_OK;
+      }
     if (cursor->CurrentIndex < ctx->curr_items)
 	item = ctx->knn_array + cursor->CurrentIndex;
     if (column == 0)
@@ -1724,34 +3607,40 @@ vknn_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
       }
     else if (column == 2)
       {
-	  /* the Reference Geometry column */
-	  sqlite3_result_blob (pContext, ctx->blob, ctx->blob_size,
-			       SQLITE_STATIC);
+	  /* the Query Table Name column */
+	  sqlite3_result_text (pContext, ctx->q_table_name,
+			       strlen (ctx->q_table_name), SQLITE_STATIC);
       }
     else if (column == 3)
+      {
+	  /* the Query GeometryColumn Name column */
+	  sqlite3_result_text (pContext, ctx->q_column_name,
+			       strlen (ctx->q_column_name), SQLITE_STATIC);
+      }
+    else if (column == 4)
       {
 	  /* the Max Items column */
 	  sqlite3_result_int (pContext, ctx->max_items);
       }
-    else if (column == 4)
+    else if (column == 5)
+      {
+	  /* the Query RowID column */
+	  sqlite3_result_int64 (pContext, ctx->q_rowid);
+      }
+    else if (column == 6)
       {
 	  /* the index column */
 	  sqlite3_result_int (pContext, cursor->CurrentIndex + 1);
       }
-    else if ((column == 5 || column == 6) && item != NULL)
+    else if (column == 7 && item != NULL)
       {
-	  if (column == 5)
-	    {
-		/* the RowID column */
-		sqlite3_result_int64 (pContext, item->rowid);
-	    }
-	  else if (column == 6)
-	    {
-		/* the Distance column */
-		sqlite3_result_double (pContext, item->dist);
-	    }
-	  else
-	      sqlite3_result_null (pContext);
+	  /* the RowID column */
+	  sqlite3_result_int64 (pContext, item->rowid);
+      }
+    else if (column == 8 && item != NULL)
+      {
+	  /* the Distance column */
+	  sqlite3_result_double (pContext, item->dist);
       }
     else
 	sqlite3_result_null (pContext);
@@ -1759,74 +3648,16 @@ vknn_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 }
 
 static int
-vknn_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
+vknn_batch_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
 {
 /* fetching the ROWID */
-    VirtualKnnCursorPtr cursor = (VirtualKnnCursorPtr) pCursor;
-    *pRowid = cursor->CurrentIndex;
-    return SQLITE_OK;
-}
-
-static int
-vknn_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
-	     sqlite_int64 * pRowid)
-{
-/* generic update [INSERT / UPDATE / DELETE */
-    if (pRowid || argc || argv || pVTab)
-	pRowid = pRowid;	/* unused arg warning suppression */
-/* read only datasource */
-    return SQLITE_READONLY;
-}
-
-static int
-vknn_begin (sqlite3_vtab * pVTab)
-{
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-    return SQLITE_OK;
-}
-
-static int
-vknn_sync (sqlite3_vtab * pVTab)
-{
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-    return SQLITE_OK;
-}
-
-static int
-vknn_commit (sqlite3_vtab * pVTab)
-{
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-    return SQLITE_OK;
-}
-
-static int
-vknn_rollback (sqlite3_vtab * pVTab)
-{
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+    VirtualKnnBatchCursorPtr cursor = (VirtualKnnBatchCursorPtr) pCursor;
+    *pRowid = cursor->CurrentRowid;
     return SQLITE_OK;
 }
 
 static int
-vknn_rename (sqlite3_vtab * pVTab, const char *zNew)
-{
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-    if (zNew)
-	zNew = zNew;		/* unused arg warning suppression */
-    return SQLITE_ERROR;
-}
-
-static int
-spliteKnnInit (sqlite3 * db)
+spliteKnnInit (sqlite3 * db, void *p_cache)
 {
     int rc = SQLITE_OK;
     my_knn_module.iVersion = 1;
@@ -1849,15 +3680,39 @@ spliteKnnInit (sqlite3 * db)
     my_knn_module.xRollback = &vknn_rollback;
     my_knn_module.xFindFunction = NULL;
     my_knn_module.xRename = &vknn_rename;
-    sqlite3_create_module_v2 (db, "VirtualKNN", &my_knn_module, NULL, 0);
+    sqlite3_create_module_v2 (db, "VirtualKNN", &my_knn_module, p_cache,
+			      0);
+
+    my_knn_batch_module.iVersion = 1;
+    my_knn_batch_module.xCreate = &vknn_batch_create;
+    my_knn_batch_module.xConnect = &vknn_batch_connect;
+    my_knn_batch_module.xBestIndex = &vknn_batch_best_index;
+    my_knn_batch_module.xDisconnect = &vknn_batch_disconnect;
+    my_knn_batch_module.xDestroy = &vknn_batch_destroy;
+    my_knn_batch_module.xOpen = &vknn_batch_open;
+    my_knn_batch_module.xClose = &vknn_batch_close;
+    my_knn_batch_module.xFilter = &vknn_batch_filter;
+    my_knn_batch_module.xNext = &vknn_batch_next;
+    my_knn_batch_module.xEof = &vknn_batch_eof;
+    my_knn_batch_module.xColumn = &vknn_batch_column;
+    my_knn_batch_module.xRowid = &vknn_batch_rowid;
+    my_knn_batch_module.xUpdate = &vknn_update;
+    my_knn_batch_module.xBegin = &vknn_begin;
+    my_knn_batch_module.xSync = &vknn_sync;
+    my_knn_batch_module.xCommit = &vknn_commit;
+    my_knn_batch_module.xRollback = &vknn_rollback;
+    my_knn_batch_module.xFindFunction = NULL;
+    my_knn_batch_module.xRename = &vknn_rename;
+    sqlite3_create_module_v2 (db, "VirtualKNNBatch", &my_knn_batch_module,
+			      p_cache, 0);
     return rc;
 }
 
 SPATIALITE_PRIVATE int
-virtual_knn_extension_init (void *xdb)
+virtual_knn_extension_init (void *xdb, const void *p_cache)
 {
     sqlite3 *db = (sqlite3 *) xdb;
-    return spliteKnnInit (db);
+    return spliteKnnInit (db, (void *) p_cache);
 }
 
 #endif /* end KNN conditional */
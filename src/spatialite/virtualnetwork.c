@@ -67,6 +67,8 @@ static struct sqlite3_module my_net_module;
 
 #define VNET_DIJKSTRA_ALGORITHM	1
 #define VNET_A_STAR_ALGORITHM	2
+#define VNET_BIDIJKSTRA_ALGORITHM	3
+#define VNET_BIDI_A_STAR_ALGORITHM	4
 
 #define VNET_ROUTING_SOLUTION	0xdd
 #define VNET_RANGE_SOLUTION		0xbb
@@ -197,12 +199,20 @@ typedef struct RoutingNode
     struct RoutingNode **To;
     NetworkArcPtr *Link;
     int DimTo;
+    struct RoutingNode **From;
+    NetworkArcPtr *BackLink;
+    int DimFrom;
     struct RoutingNode *PreviousNode;
     NetworkNodePtr Node;
     NetworkArcPtr Arc;
     double Distance;
     double HeuristicDistance;
     int Inspected;
+/* the backward search state (bidirectional algorithms) */
+    struct RoutingNode *NextNode;
+    NetworkArcPtr BackArc;
+    double BackDistance;
+    int BackInspected;
 } RoutingNode;
 typedef RoutingNode *RoutingNodePtr;
 
@@ -211,6 +221,8 @@ typedef struct RoutingNodes
     RoutingNodePtr Nodes;
     NetworkArcPtr *ArcsBuffer;
     RoutingNodePtr *NodesBuffer;
+    NetworkArcPtr *BackArcsBuffer;
+    RoutingNodePtr *BackNodesBuffer;
     int Dim;
     int DimLink;
 } RoutingNodes;
@@ -312,6 +324,38 @@ routing_init (NetworkPtr graph)
 		ndn->Link[j] = nn->Arcs + j;
 	    }
       }
+
+/* setting the incoming Arcs (bidirectional algorithms) */
+    nd->BackNodesBuffer = malloc (sizeof (RoutingNodePtr) * cnt);
+    nd->BackArcsBuffer = malloc (sizeof (NetworkArcPtr) * cnt);
+    for (i = 0; i < graph->NumNodes; i++)
+	nd->Nodes[i].DimFrom = 0;
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  nn = graph->Nodes + i;
+	  for (j = 0; j < nn->NumArcs; j++)
+	      nd->Nodes[nn->Arcs[j].NodeTo->InternalIndex].DimFrom += 1;
+      }
+    cnt = 0;
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  ndn = nd->Nodes + i;
+	  ndn->From = &(nd->BackNodesBuffer[cnt]);
+	  ndn->BackLink = &(nd->BackArcsBuffer[cnt]);
+	  cnt += ndn->DimFrom;
+	  ndn->DimFrom = 0;
+      }
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  nn = graph->Nodes + i;
+	  for (j = 0; j < nn->NumArcs; j++)
+	    {
+		ndn = nd->Nodes + nn->Arcs[j].NodeTo->InternalIndex;
+		ndn->From[ndn->DimFrom] = nd->Nodes + i;
+		ndn->BackLink[ndn->DimFrom] = nn->Arcs + j;
+		ndn->DimFrom += 1;
+	    }
+      }
     return (nd);
 }
 
@@ -321,6 +365,8 @@ routing_free (RoutingNodes * e)
 /* memory cleanup; freeing the ROUTING struct */
     free (e->ArcsBuffer);
     free (e->NodesBuffer);
+    free (e->BackArcsBuffer);
+    free (e->BackNodesBuffer);
     free (e->Nodes);
     free (e);
 }
@@ -441,8 +487,8 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
 /* setting From/To */
     from = pfrom->InternalIndex;
     to = pto->InternalIndex;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
+/* initializing the heap (lazy deletion: one entry for each relaxed Arc) */
+    heap = routing_heap_init (e->DimLink + 1);
 /* initializing the graph */
     for (i = 0; i < e->Dim; i++)
       {
@@ -459,6 +505,11 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
       {
 	  /* Dijsktra loop */
 	  n = routing_dequeue (heap);
+	  if (n->Inspected)
+	    {
+		/* stale entry: already settled at a lower Distance */
+		continue;
+	    }
 	  if (n->Id == to)
 	    {
 		/* destination reached */
@@ -485,6 +536,7 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
 			    p_to->Distance = n->Distance + p_link->Cost;
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
+			    dijkstra_enqueue (heap, p_to);
 			}
 		  }
 	    }
@@ -530,8 +582,8 @@ dijkstra_range_analysis (RoutingNodesPtr e, NetworkNodePtr pfrom,
     RoutingHeapPtr heap;
 /* setting From */
     from = pfrom->InternalIndex;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
+/* initializing the heap (lazy deletion: one entry for each relaxed Arc) */
+    heap = routing_heap_init (e->DimLink + 1);
 /* initializing the graph */
     for (i = 0; i < e->Dim; i++)
       {
@@ -548,6 +600,11 @@ dijkstra_range_analysis (RoutingNodesPtr e, NetworkNodePtr pfrom,
       {
 	  /* Dijsktra loop */
 	  n = routing_dequeue (heap);
+	  if (n->Inspected)
+	    {
+		/* stale entry: already settled at a lower Distance */
+		continue;
+	    }
 	  n->Inspected = 1;
 	  for (i = 0; i < n->DimTo; i++)
 	    {
@@ -572,6 +629,7 @@ dijkstra_range_analysis (RoutingNodesPtr e, NetworkNodePtr pfrom,
 			    p_to->Distance = n->Distance + p_link->Cost;
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
+			    dijkstra_enqueue (heap, p_to);
 			}
 		  }
 	    }
@@ -671,8 +729,8 @@ astar_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
     pOrg = nodes + pAux->Id;
     pAux = e->Nodes + to;
     pDest = nodes + pAux->Id;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
+/* initializing the heap (lazy deletion: one entry for each relaxed Arc) */
+    heap = routing_heap_init (e->DimLink + 1);
 /* initializing the graph */
     for (i = 0; i < e->Dim; i++)
       {
@@ -692,6 +750,11 @@ astar_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
       {
 	  /* A* loop */
 	  n = routing_dequeue (heap);
+	  if (n->Inspected)
+	    {
+		/* stale entry: already settled at a lower Distance */
+		continue;
+	    }
 	  if (n->Id == to)
 	    {
 		/* destination reached */
@@ -728,6 +791,7 @@ astar_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 							  heuristic_coeff);
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
+			    astar_enqueue (heap, p_to);
 			}
 		  }
 	    }
@@ -758,6 +822,205 @@ astar_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 
 /* END of A* Shortest Path implementation */
 
+/*
+/
+/  implementation of the bidirectional Dijkstra and A* algorithms
+/
+/ a forward search starting from the origin and a backward search
+/ starting from the destination (following the incoming Arcs) are
+/ performed in turn, each time advancing the one having the smaller
+/ queue; the searches stop as soon as the sum of the two smallest
+/ queued keys cannot improve the best path connecting them.
+/ the bidirectional A* uses the average potential:
+/   p(v) = (h(v, To) - h(v, From)) / 2
+/ keying the forward search by Distance + p(v) and the backward one
+/ by Distance - p(v), so that the same stopping criterion holds
+/
+*/
+
+static void
+bidir_enqueue (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* enqueuing a Node into the heap (a Node could be queued many times) */
+    int i;
+    HeapNode tmp;
+    HeapNodePtr nodes = heap->Nodes;
+    heap->Count += 1;
+    i = heap->Count;
+    nodes[i].Node = node;
+    nodes[i].Distance = key;
+    while (i > 1 && nodes[i].Distance < nodes[i / 2].Distance)
+      {
+	  tmp = nodes[i];
+	  nodes[i] = nodes[i / 2];
+	  nodes[i / 2] = tmp;
+	  i /= 2;
+      }
+}
+
+static double
+bidir_potential (NetworkNodePtr nodes, RoutingNodePtr n, NetworkNodePtr pOrg,
+		 NetworkNodePtr pDest, double heuristic_coeff, int a_star)
+{
+/* the bidirectional A* potential of a Node (always 0 for Dijkstra) */
+    NetworkNodePtr pN;
+    if (!a_star)
+	return 0.0;
+    pN = nodes + n->Id;
+    return (astar_heuristic_distance (pN, pDest, heuristic_coeff) -
+	    astar_heuristic_distance (pN, pOrg, heuristic_coeff)) / 2.0;
+}
+
+static NetworkArcPtr *
+bidir_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
+		     NetworkNodePtr pfrom, NetworkNodePtr pto,
+		     double heuristic_coeff, int a_star, int *ll)
+{
+/* identifying the Shortest Path - bidirectional Dijkstra or A* */
+    int i;
+    int k;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    RoutingNodePtr meeting = NULL;
+    NetworkArcPtr p_link;
+    double best = DBL_MAX;
+    double dist;
+    int cnt;
+    NetworkArcPtr *result;
+    RoutingHeapPtr fwd;
+    RoutingHeapPtr bwd;
+/* initializing the heaps */
+    fwd = routing_heap_init (e->DimLink + 1);
+    bwd = routing_heap_init (e->DimLink + 1);
+/* initializing the graph */
+    for (i = 0; i < e->Dim; i++)
+      {
+	  n = e->Nodes + i;
+	  n->PreviousNode = NULL;
+	  n->Arc = NULL;
+	  n->Inspected = 0;
+	  n->Distance = DBL_MAX;
+	  n->NextNode = NULL;
+	  n->BackArc = NULL;
+	  n->BackInspected = 0;
+	  n->BackDistance = DBL_MAX;
+      }
+/* queuing the From node into the forward heap */
+    n = e->Nodes + pfrom->InternalIndex;
+    n->Distance = 0.0;
+    bidir_enqueue (fwd, n,
+		   bidir_potential (nodes, n, pfrom, pto, heuristic_coeff,
+				    a_star));
+/* queuing the To node into the backward heap */
+    n = e->Nodes + pto->InternalIndex;
+    n->BackDistance = 0.0;
+    bidir_enqueue (bwd, n,
+		   -bidir_potential (nodes, n, pfrom, pto, heuristic_coeff,
+				     a_star));
+    if (pfrom == pto)
+      {
+	  best = 0.0;
+	  meeting = n;
+      }
+    while (fwd->Count > 0 && bwd->Count > 0)
+      {
+	  /* bidirectional loop */
+	  if (fwd->Nodes[1].Distance + bwd->Nodes[1].Distance >= best)
+	      break;		/* the best path cannot be improved */
+	  if (fwd->Count <= bwd->Count)
+	    {
+		/* a forward step */
+		n = routing_dequeue (fwd);
+		if (n->Inspected)
+		    continue;
+		n->Inspected = 1;
+		for (i = 0; i < n->DimTo; i++)
+		  {
+		      p_to = *(n->To + i);
+		      p_link = *(n->Link + i);
+		      dist = n->Distance + p_link->Cost;
+		      if (p_to->Inspected == 0 && dist < p_to->Distance)
+			{
+			    p_to->Distance = dist;
+			    p_to->PreviousNode = n;
+			    p_to->Arc = p_link;
+			    bidir_enqueue (fwd, p_to,
+					   dist + bidir_potential (nodes, p_to,
+								   pfrom, pto,
+								   heuristic_coeff,
+								   a_star));
+			}
+		      if (p_to->BackDistance != DBL_MAX
+			  && p_to->Distance + p_to->BackDistance < best)
+			{
+			    best = p_to->Distance + p_to->BackDistance;
+			    meeting = p_to;
+			}
+		  }
+	    }
+	  else
+	    {
+		/* a backward step */
+		n = routing_dequeue (bwd);
+		if (n->BackInspected)
+		    continue;
+		n->BackInspected = 1;
+		for (i = 0; i < n->DimFrom; i++)
+		  {
+		      p_to = *(n->From + i);
+		      p_link = *(n->BackLink + i);
+		      dist = n->BackDistance + p_link->Cost;
+		      if (p_to->BackInspected == 0 && dist < p_to->BackDistance)
+			{
+			    p_to->BackDistance = dist;
+			    p_to->NextNode = n;
+			    p_to->BackArc = p_link;
+			    bidir_enqueue (bwd, p_to,
+					   dist - bidir_potential (nodes, p_to,
+								   pfrom, pto,
+								   heuristic_coeff,
+								   a_star));
+			}
+		      if (p_to->Distance != DBL_MAX
+			  && p_to->Distance + p_to->BackDistance < best)
+			{
+			    best = p_to->Distance + p_to->BackDistance;
+			    meeting = p_to;
+			}
+		  }
+	    }
+      }
+    routing_heap_free (fwd);
+    routing_heap_free (bwd);
+    cnt = 0;
+    if (meeting != NULL)
+      {
+	  /* counting how many Arcs are into the Shortest Path solution */
+	  for (n = meeting; n->PreviousNode != NULL; n = n->PreviousNode)
+	      cnt++;
+	  for (n = meeting; n->NextNode != NULL; n = n->NextNode)
+	      cnt++;
+      }
+/* allocating the solution */
+    result = malloc (sizeof (NetworkArcPtr) * (cnt + 1));
+    if (meeting != NULL)
+      {
+	  /* inserting the Arcs into the solution */
+	  k = 0;
+	  for (n = meeting; n->PreviousNode != NULL; n = n->PreviousNode)
+	      k++;
+	  i = k;
+	  for (n = meeting; n->PreviousNode != NULL; n = n->PreviousNode)
+	      result[--i] = n->Arc;
+	  for (n = meeting; n->NextNode != NULL; n = n->NextNode)
+	      result[k++] = n->BackArc;
+      }
+    *ll = cnt;
+    return (result);
+}
+
+/* END of bidirectional Shortest Path implementation */
+
 static int
 cmp_nodes_code (const void *p1, const void *p2)
 {
@@ -1503,6 +1766,19 @@ astar_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
     build_solution (handle, graph, solution, shortest_path, cnt);
 }
 
+static void
+bidir_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
+	     SolutionPtr solution, int a_star)
+{
+/* computing a bidirectional Dijkstra or A* Shortest Path solution */
+    int cnt;
+    NetworkArcPtr *shortest_path =
+	bidir_shortest_path (routing, graph->Nodes, solution->From,
+			     solution->To, graph->AStarHeuristicCoeff, a_star,
+			     &cnt);
+    build_solution (handle, graph, solution, shortest_path, cnt);
+}
+
 static void
 dijkstra_within_cost_range (RoutingNodesPtr routing, SolutionPtr solution,
 			    int srid)
@@ -1892,7 +2168,16 @@ load_network (sqlite3 * handle, const char *table)
 				  sqlite3_finalize (stmt);
 				  goto abort;
 			      }
-			    if (!network_block (graph, blob, size))
+			    if (size > 0 && (*blob == GAIA_NET_CH_HEADER
+					     || *blob == GAIA_NET_CH_BLOCK))
+				;	/* ignoring Contraction Hierarchies data */
+			    else if (size > 0
+				     && (*blob == GAIA_NET_TD_HEADER
+					 || *blob == GAIA_NET_TD_BLOCK))
+				;	/* ignoring Time Profiles and Turn Restrictions */
+			    else if (size > 0 && *blob == GAIA_NET_REVISION)
+				;	/* ignoring UpdateRouting() revisions */
+			    else if (!network_block (graph, blob, size))
 			      {
 				  sqlite3_finalize (stmt);
 				  goto abort;
@@ -2366,6 +2651,12 @@ vnet_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  cursor->solution->Mode = VNET_ROUTING_SOLUTION;
 	  if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
 	      astar_solve (net->db, net->graph, net->routing, cursor->solution);
+	  else if (net->currentAlgorithm == VNET_BIDIJKSTRA_ALGORITHM)
+	      bidir_solve (net->db, net->graph, net->routing,
+			   cursor->solution, 0);
+	  else if (net->currentAlgorithm == VNET_BIDI_A_STAR_ALGORITHM)
+	      bidir_solve (net->db, net->graph, net->routing,
+			   cursor->solution, 1);
 	  else
 	      dijkstra_solve (net->db, net->graph, net->routing,
 			      cursor->solution);
@@ -2376,7 +2667,8 @@ vnet_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  int srid = find_srid (net->db, net->graph);
 	  cursor->eof = 0;
 	  cursor->solution->Mode = VNET_RANGE_SOLUTION;
-	  if (net->currentAlgorithm == VNET_DIJKSTRA_ALGORITHM)
+	  if (net->currentAlgorithm == VNET_DIJKSTRA_ALGORITHM
+	      || net->currentAlgorithm == VNET_BIDIJKSTRA_ALGORITHM)
 	    {
 		dijkstra_within_cost_range (net->routing, cursor->solution,
 					    srid);
@@ -2518,6 +2810,12 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 		      /* the currently used Algorithm */
 		      if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
 			  algorithm = "A*";
+		      else if (net->currentAlgorithm ==
+			       VNET_BIDIJKSTRA_ALGORITHM)
+			  algorithm = "Bidirectional Dijkstra";
+		      else if (net->currentAlgorithm ==
+			       VNET_BIDI_A_STAR_ALGORITHM)
+			  algorithm = "Bidirectional A*";
 		      else
 			  algorithm = "Dijkstra";
 		      sqlite3_result_text (pContext, algorithm,
@@ -2596,6 +2894,12 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 		      /* the currently used Algorithm */
 		      if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
 			  algorithm = "A*";
+		      else if (net->currentAlgorithm ==
+			       VNET_BIDIJKSTRA_ALGORITHM)
+			  algorithm = "Bidirectional Dijkstra";
+		      else if (net->currentAlgorithm ==
+			       VNET_BIDI_A_STAR_ALGORITHM)
+			  algorithm = "Bidirectional A*";
 		      else
 			  algorithm = "Dijkstra";
 		      sqlite3_result_text (pContext, algorithm,
@@ -2698,9 +3002,25 @@ vnet_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 			    if (strcmp ((char *) algorithm, "a*") == 0)
 				p_vtab->currentAlgorithm =
 				    VNET_A_STAR_ALGORITHM;
+			    if (strcasecmp ((char *) algorithm, "BiDijkstra")
+				== 0
+				|| strcasecmp ((char *) algorithm,
+					       "Bidirectional Dijkstra") == 0)
+				p_vtab->currentAlgorithm =
+				    VNET_BIDIJKSTRA_ALGORITHM;
+			    if (strcasecmp ((char *) algorithm, "BiA*") == 0
+				|| strcasecmp ((char *) algorithm,
+					       "Bidirectional A*") == 0)
+				p_vtab->currentAlgorithm =
+				    VNET_BIDI_A_STAR_ALGORITHM;
 			}
-		      if (p_vtab->graph->AStar == 0)
+		      if (p_vtab->graph->AStar == 0
+			  && p_vtab->currentAlgorithm == VNET_A_STAR_ALGORITHM)
 			  p_vtab->currentAlgorithm = VNET_DIJKSTRA_ALGORITHM;
+		      if (p_vtab->graph->AStar == 0
+			  && p_vtab->currentAlgorithm ==
+			  VNET_BIDI_A_STAR_ALGORITHM)
+			  p_vtab->currentAlgorithm = VNET_BIDIJKSTRA_ALGORITHM;
 		  }
 		return SQLITE_OK;
 	    }
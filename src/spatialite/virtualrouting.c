@@ -52,6 +52,12 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <float.h>
 #include <ctype.h>
 
+#if defined(_WIN32) && !defined(__MINGW32__)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
 #else
@@ -61,20 +67,29 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <spatialite/sqlite.h>
 
 #include <spatialite.h>
+#include <spatialite_private.h>
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiaaux.h>
 #include <spatialite/gaiageo.h>
 
 static struct sqlite3_module my_route_module;
 
+/* the process-wide NETWORK cache - protected by the cache semaphore */
+static struct RoutingCacheItemStruct *routing_cache_first = NULL;
+
 #define VROUTE_DIJKSTRA_ALGORITHM	1
 #define VROUTE_A_STAR_ALGORITHM	2
+#define VROUTE_CH_ALGORITHM	3
+#define VROUTE_BIDIJKSTRA_ALGORITHM	4
+#define VROUTE_BIDI_A_STAR_ALGORITHM	5
 
 #define VROUTE_ROUTING_SOLUTION		0xdd
 #define VROUTE_POINT2POINT_SOLUTION	0xcc
 #define VROUTE_POINT2POINT_ERROR	0xca
 #define VROUTE_RANGE_SOLUTION		0xbb
 #define VROUTE_TSP_SOLUTION			0xee
+#define VROUTE_MATRIX_SOLUTION		0xaa
+#define VROUTE_ISOCHRONE_SOLUTION	0xab
 
 #define VROUTE_SHORTEST_PATH_FULL		0x70
 #define VROUTE_SHORTEST_PATH_NO_LINKS	0x71
@@ -85,20 +100,38 @@ static struct sqlite3_module my_route_module;
 #define VROUTE_SHORTEST_PATH			0x91
 #define VROUTE_TSP_NN					0x92
 #define VROUTE_TSP_GA					0x93
+#define VROUTE_MATRIX					0x94
+#define VROUTE_ISOCHRONE				0x95
 
 #define VROUTE_INVALID_SRID	-1234
 
 #define	VROUTE_TSP_GA_MAX_ITERATIONS	512
+#define	VROUTE_TSP_GA_MIN_PARALLEL	32
+
+#define VROUTE_CACHE_MAX_IDLE	4
+
+#define VROUTE_ISOCHRONE_FACTOR	3.0
+
+#define VROUTE_MATRIX_MAX_THREADS	8
+#define VROUTE_MATRIX_DIJKSTRA		0
+#define VROUTE_MATRIX_CH_BUCKETS	1
+#define VROUTE_MATRIX_CH_SCAN		2
 
 #define VROUTE_POINT2POINT_FROM	1
 #define VROUTE_POINT2POINT_TO	2
 
+#define VROUTE_SNAP_FANOUT		16
+#define VROUTE_SNAP_CANDIDATES	4
+
 #define VROUTE_POINT2POINT_NONE		0
 #define VROUTE_POINT2POINT_INGRESS	1
 #define VROUTE_POINT2POINT_START	2
 #define VROUTE_POINT2POINT_END		3
 #define VROUTE_POINT2POINT_EGRESS	4
 
+#define VROUTE_HEAP_ARITY	4
+#define VROUTE_HEAP_BUCKETS	65
+
 #ifdef _WIN32
 #define strcasecmp	_stricmp
 #endif /* not WIN32 */
@@ -158,6 +191,173 @@ typedef struct RouteNodeStruct
 } RouteNode;
 typedef RouteNode *RouteNodePtr;
 
+typedef struct RouteCHArcStruct
+{
+/* a Contraction Hierarchies arc: an original Link or a Shortcut */
+    int NodeFrom;
+    int NodeTo;
+    double Cost;
+    int Child1;			/* first half of a Shortcut; -1 for original Links */
+    int Child2;			/* second half of a Shortcut; -1 for original Links */
+    RouteLinkPtr Link;		/* the corresponding Link; NULL for Shortcuts */
+} RouteCHArc;
+typedef RouteCHArc *RouteCHArcPtr;
+
+typedef struct RouteCHHeapItemStruct
+{
+/* a CH Heap item */
+    int Node;
+    double Key;
+} RouteCHHeapItem;
+typedef RouteCHHeapItem *RouteCHHeapItemPtr;
+
+typedef struct RouteCHHeapStruct
+{
+/* a CH binary min-Heap (supporting lazy deletion) */
+    RouteCHHeapItemPtr Items;
+    int Count;
+    int Max;
+} RouteCHHeap;
+typedef RouteCHHeap *RouteCHHeapPtr;
+
+typedef struct RouteCHStruct
+{
+/* the Contraction Hierarchies data */
+    int NumNodes;
+    int NumLinks;		/* how many original Links */
+    int NumArcs;		/* original Links + Shortcuts */
+    int NextShortcut;		/* next Shortcut to be loaded */
+    RouteCHArcPtr Arcs;
+    int *Rank;
+    int *UpFirst;		/* forward search: arcs towards higher ranked Nodes */
+    int *UpArcs;
+    int *DownFirst;		/* backward search: arcs coming from higher ranked Nodes */
+    int *DownArcs;
+} RouteCH;
+typedef RouteCH *RouteCHPtr;
+
+typedef struct RouteCHWorkspaceStruct
+{
+/* the Contraction Hierarchies query workspace (owned by each VirtualTable) */
+    double *FwdDist;
+    double *BwdDist;
+    int *FwdArc;
+    int *BwdArc;
+    int *Touched;
+    int NumTouched;
+    RouteCHHeap FwdHeap;
+    RouteCHHeap BwdHeap;
+} RouteCHWorkspace;
+typedef RouteCHWorkspace *RouteCHWorkspacePtr;
+
+typedef struct RouteTDProfileStruct
+{
+/* the time-dependent Cost of a Link: piecewise constant along the day */
+    int First;			/* the first step */
+    int Count;			/* how many steps */
+} RouteTDProfile;
+typedef RouteTDProfile *RouteTDProfilePtr;
+
+typedef struct RouteTDTurnStruct
+{
+/* a Turn Restriction as stored into the NETWORK-DATA blocks */
+    sqlite3_int64 FromRowid;
+    sqlite3_int64 ToRowid;
+    double Cost;		/* DBL_MAX for a banned turn */
+} RouteTDTurn;
+typedef RouteTDTurn *RouteTDTurnPtr;
+
+typedef struct RouteTDStruct
+{
+/* Time Profiles and Turn Restrictions */
+    int NumSteps;
+    int NextStep;		/* next step to be loaded */
+    int *StepTime;		/* step start: seconds since midnight */
+    double *StepCost;
+    int NumProfiles;
+    int MaxProfiles;
+    RouteTDProfilePtr Profiles;
+    sqlite3_int64 *ProfileRowid;	/* while loading: the Link of each profile */
+    int *LinkProfile;		/* the profile of each Link, -1 if static */
+    int NumTurns;
+    int NextTurn;		/* next turn to be loaded */
+    RouteTDTurnPtr Turns;	/* while loading */
+    int *TurnFirst;		/* turns from Link i are [TurnFirst[i], TurnFirst[i + 1]) */
+    int *TurnLink;		/* the outgoing Link of each turn */
+    double *TurnCost;		/* the penalty of each turn; DBL_MAX if banned */
+    double AStarHeuristicCoeff;	/* never overestimating any profile Cost */
+} RouteTD;
+typedef RouteTD *RouteTDPtr;
+
+typedef struct RouteTDWorkspaceStruct
+{
+/* 
+/ the time-dependent query workspace (owned by each VirtualTable):
+/ the search state belongs to Links, so that turns could be evaluated
+*/
+    unsigned int Generation;	/* the current query */
+    unsigned int *Stamp;	/* the query each Link state belongs to */
+    double *Dist;		/* Cost up to the end of the Link */
+    int *Prev;			/* the previous Link, -1 at the origin */
+    char *Settled;
+    RouteCHHeap Heap;
+} RouteTDWorkspace;
+typedef RouteTDWorkspace *RouteTDWorkspacePtr;
+
+typedef struct RouteSnapLinkStruct
+{
+/* a Link Geometry supporting Point2Point snapping */
+    sqlite3_int64 LinkRowid;
+    int Direct;			/* the Link following the Geometry, or -1 */
+    int Reverse;		/* the Link running backwards, or -1 */
+    int DimensionModel;
+    int Points;
+    int Offset;			/* first coordinate into the Coords pool */
+    double MinX;
+    double MinY;
+    double MaxX;
+    double MaxY;
+} RouteSnapLink;
+typedef RouteSnapLink *RouteSnapLinkPtr;
+
+typedef struct RouteSnapNodeStruct
+{
+/* a packed R-Tree node: children are [First, First + Count) */
+    int First;
+    int Count;
+    double MinX;
+    double MinY;
+    double MaxX;
+    double MaxY;
+} RouteSnapNode;
+typedef RouteSnapNode *RouteSnapNodePtr;
+
+typedef struct RouteSnapIndexStruct
+{
+/* 
+/ the Point2Point snapping index: a packed (STR) R-Tree
+/ built on the Link Geometries, leaf nodes first and root last
+*/
+    int Srid;
+    int Geographic;
+    int NumLinks;
+    RouteSnapLinkPtr Links;
+    double *Coords;
+    int NumLeaves;		/* children of the first NumLeaves nodes are Links */
+    int NumNodes;
+    RouteSnapNodePtr Nodes;
+} RouteSnapIndex;
+typedef RouteSnapIndex *RouteSnapIndexPtr;
+
+typedef struct RouteSnapCandidateStruct
+{
+/* a Link found by the snapping index */
+    RouteSnapLinkPtr Link;
+    double Distance;		/* from the input Point */
+    double Fraction;		/* projection, as a fraction of 2D length */
+} RouteSnapCandidate;
+typedef RouteSnapCandidate *RouteSnapCandidatePtr;
+
 typedef struct RoutingStruct
 {
 /* the main NETWORK structure */
@@ -176,9 +376,90 @@ typedef struct RoutingStruct
     double AStarHeuristicCoeff;
     int Srid;
     RouteNodePtr Nodes;
+    char *CodesPool;		/* all Node Codes: MaxCodeLength + 1 bytes each */
+    int NumLinks;
+    int MaxLinks;		/* allocated Links while loading the graph */
+    RouteLinkPtr Links;		/* all Links, sorted by NodeFrom */
+    int *LinkFirst;		/* CSR offsets: Links of Node i are [LinkFirst[i], LinkFirst[i + 1]) */
+    int *LinkTarget;		/* CSR: NodeTo internal index of each Link */
+    double *LinkCost;		/* CSR: Cost of each Link */
+    int *RevFirst;		/* reverse CSR: Links entering Node i are [RevFirst[i], RevFirst[i + 1]) */
+    int *RevLinks;		/* reverse CSR: the index of each entering Link */
+    RouteCHPtr CH;		/* Contraction Hierarchies: may be NULL */
+    RouteTDPtr TD;		/* Time Profiles and Turn Restrictions: may be NULL */
+    RouteSnapIndexPtr SnapIndex;	/* Point2Point: built on demand, may be NULL */
 } Routing;
 typedef Routing *RoutingPtr;
 
+typedef struct RoutingCacheItemStruct
+{
+/* 
+/ a NETWORK shared by all connections of the current process
+/ (once loaded a NETWORK is never modified, so it's safely
+/ shared by any number of VirtualRouting tables)
+*/
+    char *DbPath;		/* NULL for NETWORKs private to a connection */
+    sqlite3 *Handle;		/* the connection owning a private NETWORK */
+    char *TableName;
+    int SchemaVersion;		/* PRAGMA schema_version when loaded */
+    sqlite3_int64 Blocks;	/* # NetworkData rows when loaded */
+    sqlite3_int64 Bytes;	/* total NetworkData size when loaded */
+    sqlite3_int64 MaxId;	/* max NetworkData Id when loaded */
+    RoutingPtr Graph;
+    int RefCount;
+    int Outdated;		/* changed by UpdateRouting() */
+    struct RoutingCacheItemStruct *Next;
+} RoutingCacheItem;
+typedef RoutingCacheItem *RoutingCacheItemPtr;
+
+typedef struct MatrixBucketItemStruct
+{
+/* a Cost Matrix bucket entry: the Cost from some Node to a destination */
+    int Node;
+    int Target;
+    double Cost;
+} MatrixBucketItem;
+typedef MatrixBucketItem *MatrixBucketItemPtr;
+
+typedef struct MatrixJobStruct
+{
+/* the shared (read-only) state of a Cost Matrix request */
+    RoutingPtr Graph;
+    int Phase;
+    int NumFrom;
+    int NumTo;
+    const int *From;		/* origin Node indices; -1 if undefined */
+    const int *To;		/* destination Node indices; -1 if undefined */
+    const int *TargetFirst;	/* Dijkstra: first destination of each Node, or -1 */
+    const int *TargetNext;	/* Dijkstra: next destination on the same Node, or -1 */
+    int NumTargets;		/* Dijkstra: # distinct destination Nodes */
+    const int *BucketFirst;	/* CH: bucket offsets of each Node */
+    const MatrixBucketItem *Buckets;	/* CH: bucket entries sorted by Node */
+    double *Matrix;		/* NumFrom x NumTo; DBL_MAX if unreachable */
+    int NumThreads;
+} MatrixJob;
+typedef MatrixJob *MatrixJobPtr;
+
+typedef struct MatrixWorkerStruct
+{
+/* a Cost Matrix worker: processes items Index, Index + NumThreads ... */
+    MatrixJobPtr Job;
+    int Index;
+    double *Dist;		/* private search workspace */
+    int *Touched;
+    int NumTouched;
+    RouteCHHeap Heap;
+    MatrixBucketItemPtr Items;	/* CH: bucket entries found by this worker */
+    int NumItems;
+    int MaxItems;
+#if defined(_WIN32) && !defined(__MINGW32__)
+    HANDLE Thread;
+#else
+    pthread_t Thread;
+#endif
+} MatrixWorker;
+typedef MatrixWorker *MatrixWorkerPtr;
+
 typedef struct LinkSolutionStruct
 {
 /* Geometry corresponding to a Link used by Dijkstra shortest path solution */
@@ -201,6 +482,7 @@ typedef struct RowSolutionStruct
 {
 /* a row into the shortest path solution */
     RouteLinkPtr Link;
+    double Cost;
     char *Name;
     struct RowSolutionStruct *Next;
 
@@ -278,6 +560,11 @@ typedef struct MultiSolutionStruct
     RouteNodePtr From;
     double MaxCost;
     RoutingMultiDestPtr MultiTo;
+    RoutingMultiDestPtr MultiFrom;	/* Cost Matrix: multiple origins */
+    double *Matrix;		/* Cost Matrix: MultiFrom x MultiTo costs */
+    int NumBands;		/* Isochrones: number of Cost bands */
+    double *Bands;		/* Isochrones: ascending Cost limits */
+    gaiaGeomCollPtr *Isochrones;	/* Isochrones: a Geometry for each band */
     ResultsetRowPtr FirstRow;
     ResultsetRowPtr LastRow;
     ResultsetRowPtr CurrentRow;
@@ -309,6 +596,8 @@ typedef struct Point2PointCandidateStruct
     double pathLen;
     double extraLen;
     double percent;
+    double linkCost;
+    RouteSnapLinkPtr snap;
     struct Point2PointCandidateStruct *next;
 } Point2PointCandidate;
 typedef Point2PointCandidate *Point2PointCandidatePtr;
@@ -347,6 +636,9 @@ typedef struct Point2PointSolutionStruct
     double totalCost;
     Point2PointCandidatePtr fromCandidate;
     Point2PointCandidatePtr toCandidate;
+    int sameLink;		/* both Points lay on the same Link */
+    gaiaGeomCollPtr sameLinkPath;
+    double sameLinkLen;
     gaiaDynamicLinePtr dynLine;
     int hasZ;
     ResultsetRowPtr FirstRow;
@@ -377,30 +669,12 @@ typedef struct TspTargetsStruct
 } TspTargets;
 typedef TspTargets *TspTargetsPtr;
 
-typedef struct TspGaSubDistanceStruct
-{
-/* a cache sub-item for storing TSP GA costs */
-    RouteNodePtr CityTo;
-    double Cost;
-} TspGaSubDistance;
-typedef TspGaSubDistance *TspGaSubDistancePtr;
-
-typedef struct TspGaDistanceStruct
-{
-/* a cache item for storing TSP GA costs */
-    RouteNodePtr CityFrom;
-    int Cities;
-    TspGaSubDistancePtr *Distances;
-    int NearestIndex;
-} TspGaDistance;
-typedef TspGaDistance *TspGaDistancePtr;
-
 typedef struct TspGaSolutionStruct
 {
-/* TSP GA solution struct */
+/* TSP GA solution struct: Cities are identified by their index */
     int Cities;
-    RouteNodePtr *CitiesFrom;
-    RouteNodePtr *CitiesTo;
+    int *CitiesFrom;
+    int *CitiesTo;
     double *Costs;
     double TotalCost;
 } TspGaSolution;
@@ -413,12 +687,28 @@ typedef struct TspGaPopulationStruct
     int Cities;
     TspGaSolutionPtr *Solutions;
     TspGaSolutionPtr *Offsprings;
-    TspGaDistancePtr *Distances;
-    char *RandomSolutionsSql;
-    char *RandomIntervalSql;
+    RouteNodePtr *CityNodes;	/* City index to Node */
+    double *Distances;		/* dense Cities x Cities cost matrix */
+    int Generation;
 } TspGaPopulation;
 typedef TspGaPopulation *TspGaPopulationPtr;
 
+typedef struct TspGaWorkerStruct
+{
+/* a TSP GA worker: breeds offsprings Index, Index + NumThreads ... */
+    TspGaPopulationPtr Ga;
+    int Index;
+    int NumThreads;
+    sqlite3_uint64 Random;	/* private PRNG state */
+    char *Used;
+#if defined(_WIN32) && !defined(__MINGW32__)
+    HANDLE Thread;
+#else
+    pthread_t Thread;
+#endif
+} TspGaWorker;
+typedef TspGaWorker *TspGaWorkerPtr;
+
 /******************************************************************************
 /
 / Dijkstra and A* common structs
@@ -428,25 +718,35 @@ typedef TspGaPopulation *TspGaPopulationPtr;
 typedef struct RoutingNode
 {
     int Id;
-    struct RoutingNode **To;
-    RouteLinkPtr *Link;
-    int DimTo;
+    unsigned int Generation;	/* the query this Node state belongs to */
     struct RoutingNode *PreviousNode;
     RouteNodePtr Node;
     RouteLinkPtr xLink;
     double Distance;
     double HeuristicDistance;
     int Inspected;
+    int HeapIndex;		/* position into the heap: -1 if not queued */
+    int HeapBucket;		/* Radix heap only: the bucket holding the Node */
 } RoutingNode;
 typedef RoutingNode *RoutingNodePtr;
 
 typedef struct RoutingNodes
 {
     RoutingNodePtr Nodes;
-    RouteLinkPtr *LinksBuffer;
-    RoutingNodePtr *NodesBuffer;
     int Dim;
     int DimLink;
+/* the graph's CSR arrays (not owned) */
+    const int *LinkFirst;
+    const int *LinkTarget;
+    const double *LinkCost;
+    RouteLinkPtr Links;
+    RouteCHWorkspacePtr CH;	/* Contraction Hierarchies: may be NULL */
+    RouteTDWorkspacePtr TD;	/* Time Profiles and Turn Restrictions: may be NULL */
+    RouteCHWorkspacePtr Bidir;	/* bidirectional searches: allocated on demand */
+/* the reusable query workspace */
+    unsigned int Generation;	/* the current query */
+    struct RoutingHeapStruct *Heap;
+    int HeapKind;		/* the heap to be used by Dijkstra searches */
 } RoutingNodes;
 typedef RoutingNodes *RoutingNodesPtr;
 
@@ -457,10 +757,27 @@ typedef struct HeapNode
 } HeapNode;
 typedef HeapNode *HeapNodePtr;
 
-typedef struct RoutingHeapStruct
+typedef struct RoutingHeapBucketStruct
 {
-    HeapNodePtr Nodes;
+/* a Radix heap bucket: an unordered array of Nodes */
+    HeapNodePtr Items;
     int Count;
+    int Max;
+} RoutingHeapBucket;
+typedef RoutingHeapBucket *RoutingHeapBucketPtr;
+
+typedef struct RoutingHeapStruct
+{
+/*
+/ the min-priority queue used by Dijkstra and A*; Kind is
+/ ROUTING_HEAP_DARY (indexed D-ary heap) or ROUTING_HEAP_RADIX
+*/
+    int Kind;
+    HeapNodePtr Nodes;		/* D-ary heap items */
+    int Count;			/* how many queued Nodes */
+    RoutingHeapBucket Buckets[VROUTE_HEAP_BUCKETS];	/* Radix heap buckets */
+    double Last;		/* Radix heap: the last extracted key */
+    sqlite3_uint64 LastBits;	/* Radix heap: the same as IEEE-754 bits */
 } RoutingHeap;
 typedef RoutingHeap *RoutingHeapPtr;
 
@@ -477,6 +794,8 @@ typedef struct virtualroutingStruct
     int nRef;			/* # references: USED INTERNALLY BY SQLITE */
     char *zErrMsg;		/* error message: USE INTERNALLY BY SQLITE */
     sqlite3 *db;		/* the sqlite db holding the virtual table */
+    const void *p_cache;	/* pointer to the internal cache */
+    char *table;		/* the NETWORK-DATA table */
     RoutingPtr graph;		/* the NETWORK structure */
     RoutingNodesPtr routing;	/* the ROUTING structure */
     int currentAlgorithm;	/* the currently selected Shortest Path Algorithm */
@@ -484,6 +803,7 @@ typedef struct virtualroutingStruct
     int currentOptions;		/* the currently selected Shortest Path Options */
     char currentDelimiter;	/* the currently set delimiter char */
     double Tolerance;		/* the currently set Tolerance value [Point2Point] */
+    double DepartureTime;	/* the currently set Departure Time [seconds] */
     MultiSolutionPtr multiSolution;	/* the current multiple solution */
     Point2PointSolutionPtr point2PointSolution;	/* the current Point2Point solution */
     int eof;			/* the EOF marker */
@@ -508,166 +828,527 @@ typedef virtualroutingCursor *virtualroutingCursorPtr;
 /
 */
 
+static RouteCHWorkspacePtr
+ch_workspace_alloc (int nodes)
+{
+/* allocating and initializing a bidirectional search workspace */
+    int i;
+    RouteCHWorkspacePtr ws = malloc (sizeof (RouteCHWorkspace));
+    ws->FwdDist = malloc (sizeof (double) * nodes);
+    ws->BwdDist = malloc (sizeof (double) * nodes);
+    ws->FwdArc = malloc (sizeof (int) * nodes);
+    ws->BwdArc = malloc (sizeof (int) * nodes);
+    ws->Touched = malloc (sizeof (int) * nodes);
+    for (i = 0; i < nodes; i++)
+      {
+	  ws->FwdDist[i] = DBL_MAX;
+	  ws->BwdDist[i] = DBL_MAX;
+	  ws->FwdArc[i] = -1;
+	  ws->BwdArc[i] = -1;
+      }
+    ws->NumTouched = 0;
+    ws->FwdHeap.Items = NULL;
+    ws->FwdHeap.Count = 0;
+    ws->FwdHeap.Max = 0;
+    ws->BwdHeap.Items = NULL;
+    ws->BwdHeap.Count = 0;
+    ws->BwdHeap.Max = 0;
+    return ws;
+}
+
+static void
+ch_workspace_free (RouteCHWorkspacePtr ws)
+{
+/* memory cleanup; freeing a bidirectional search workspace */
+    free (ws->FwdDist);
+    free (ws->BwdDist);
+    free (ws->FwdArc);
+    free (ws->BwdArc);
+    free (ws->Touched);
+    if (ws->FwdHeap.Items)
+	free (ws->FwdHeap.Items);
+    if (ws->BwdHeap.Items)
+	free (ws->BwdHeap.Items);
+    free (ws);
+}
+
+static RouteTDWorkspacePtr
+td_workspace_alloc (int links)
+{
+/* allocating and initializing a time-dependent search workspace */
+    int i;
+    RouteTDWorkspacePtr ws = malloc (sizeof (RouteTDWorkspace));
+    ws->Stamp = malloc (sizeof (unsigned int) * (links + 1));
+    ws->Dist = malloc (sizeof (double) * (links + 1));
+    ws->Prev = malloc (sizeof (int) * (links + 1));
+    ws->Settled = malloc (links + 1);
+    for (i = 0; i <= links; i++)
+	ws->Stamp[i] = 0;
+    ws->Generation = 0;
+    ws->Heap.Items = NULL;
+    ws->Heap.Count = 0;
+    ws->Heap.Max = 0;
+    return ws;
+}
+
+static void
+td_workspace_free (RouteTDWorkspacePtr ws)
+{
+/* memory cleanup; freeing a time-dependent search workspace */
+    free (ws->Stamp);
+    free (ws->Dist);
+    free (ws->Prev);
+    free (ws->Settled);
+    if (ws->Heap.Items)
+	free (ws->Heap.Items);
+    free (ws);
+}
+
 static RoutingNodesPtr
 routing_init (RoutingPtr graph)
 {
 /* allocating and initializing the ROUTING struct */
     int i;
-    int j;
-    int cnt = 0;
     RoutingNodesPtr nd;
     RoutingNodePtr ndn;
-    RouteNodePtr nn;
 /* allocating the main Nodes struct */
     nd = malloc (sizeof (RoutingNodes));
 /* allocating and initializing  Nodes array */
     nd->Nodes = malloc (sizeof (RoutingNode) * graph->NumNodes);
     nd->Dim = graph->NumNodes;
-    nd->DimLink = 0;
-/* pre-alloc buffer strategy - GENSCHER 2010-01-05 */
-    for (i = 0; i < graph->NumNodes; cnt += graph->Nodes[i].NumLinks, i++);
-    nd->NodesBuffer = malloc (sizeof (RoutingNodePtr) * cnt);
-    nd->LinksBuffer = malloc (sizeof (RouteLinkPtr) * cnt);
-
-    cnt = 0;
+    nd->DimLink = graph->NumLinks;
+/* the outcoming Links are directly read from the graph's CSR arrays */
+    nd->LinkFirst = graph->LinkFirst;
+    nd->LinkTarget = graph->LinkTarget;
+    nd->LinkCost = graph->LinkCost;
+    nd->Links = graph->Links;
     for (i = 0; i < graph->NumNodes; i++)
       {
 	  /* initializing the Nodes array */
-	  nn = graph->Nodes + i;
 	  ndn = nd->Nodes + i;
-	  ndn->Id = nn->InternalIndex;
-	  ndn->DimTo = nn->NumLinks;
-	  ndn->Node = nn;
-	  ndn->To = &(nd->NodesBuffer[cnt]);
-	  ndn->Link = &(nd->LinksBuffer[cnt]);
-	  cnt += nn->NumLinks;
-
-	  for (j = 0; j < nn->NumLinks; j++)
-	    {
-		/*  setting the outcoming Links for the current Node */
-		nd->DimLink++;
-		ndn->To[j] = nd->Nodes + nn->Links[j].NodeTo->InternalIndex;
-		ndn->Link[j] = nn->Links + j;
-	    }
+	  ndn->Id = i;
+	  ndn->Generation = 0;
+	  ndn->Node = graph->Nodes + i;
+      }
+    nd->Generation = 0;
+    nd->Heap = NULL;
+    nd->HeapKind = ROUTING_HEAP_DARY;
+    nd->CH = NULL;
+    if (graph->CH != NULL)
+      {
+	  /* allocating the Contraction Hierarchies query workspace */
+	  nd->CH = ch_workspace_alloc (graph->NumNodes);
+      }
+    nd->Bidir = NULL;
+    nd->TD = NULL;
+    if (graph->TD != NULL)
+      {
+	  /* allocating the time-dependent query workspace */
+	  nd->TD = td_workspace_alloc (graph->NumLinks);
       }
     return (nd);
 }
 
-static void
-routing_free (RoutingNodes * e)
-{
-/* memory cleanup; freeing the ROUTING struct */
-    free (e->LinksBuffer);
-    free (e->NodesBuffer);
-    free (e->Nodes);
-    free (e);
-}
-
 static RoutingHeapPtr
 routing_heap_init (int n)
 {
 /* allocating and initializing the Heap (min-priority queue) */
+    int i;
     RoutingHeapPtr heap = malloc (sizeof (RoutingHeap));
+    heap->Kind = ROUTING_HEAP_DARY;
     heap->Count = 0;
-    heap->Nodes = malloc (sizeof (HeapNode) * (n + 1));
+    heap->Nodes = malloc (sizeof (HeapNode) * n);
+    for (i = 0; i < VROUTE_HEAP_BUCKETS; i++)
+      {
+	  /* radix buckets are allocated on demand */
+	  heap->Buckets[i].Items = NULL;
+	  heap->Buckets[i].Count = 0;
+	  heap->Buckets[i].Max = 0;
+      }
+    heap->Last = 0.0;
+    heap->LastBits = 0;
     return heap;
 }
 
-static void
-routing_heap_reset (RoutingHeapPtr heap)
-{
-/* resetting the Heap (min-priority queue) */
-    if (heap == NULL)
-	return;
-    heap->Count = 0;
-}
-
 static void
 routing_heap_free (RoutingHeapPtr heap)
 {
 /* freeing the Heap (min-priority queue) */
+    int i;
     if (heap->Nodes != NULL)
 	free (heap->Nodes);
+    for (i = 0; i < VROUTE_HEAP_BUCKETS; i++)
+      {
+	  if (heap->Buckets[i].Items != NULL)
+	      free (heap->Buckets[i].Items);
+      }
     free (heap);
 }
 
 static void
-dijkstra_insert (RoutingNodePtr node, HeapNodePtr heap, int size)
+routing_free (RoutingNodes * e)
+{
+/* memory cleanup; freeing the ROUTING struct */
+    if (e->CH != NULL)
+	ch_workspace_free (e->CH);
+    if (e->TD != NULL)
+	td_workspace_free (e->TD);
+    if (e->Bidir != NULL)
+	ch_workspace_free (e->Bidir);
+    if (e->Heap != NULL)
+	routing_heap_free (e->Heap);
+    free (e->Nodes);
+    free (e);
+}
+
+static void
+routing_heap_reset (RoutingHeapPtr heap, int kind)
 {
-/* inserting a new Node and rearranging the heap */
+/* resetting the Heap (min-priority queue) */
     int i;
-    HeapNode tmp;
-    i = size + 1;
-    heap[i].Node = node;
-    heap[i].Distance = node->Distance;
-    if (i / 2 < 1)
+    if (heap == NULL)
 	return;
-    while (heap[i].Distance < heap[i / 2].Distance)
+    heap->Kind = kind;
+    heap->Count = 0;
+    for (i = 0; i < VROUTE_HEAP_BUCKETS; i++)
+	heap->Buckets[i].Count = 0;
+    heap->Last = 0.0;
+    heap->LastBits = 0;
+}
+
+static void
+routing_reset (RoutingNodesPtr e, int heap_kind)
+{
+/* 
+/ starting a new query: the Heap is emptied, and all Nodes
+/ become implicitly unvisited by advancing the generation
+/
+/ the Radix heap requires monotone keys, so it can only
+/ serve Dijkstra searches; A* always passes ROUTING_HEAP_DARY
+*/
+    int i;
+    if (e->Heap == NULL)
       {
-	  tmp = heap[i];
-	  heap[i] = heap[i / 2];
-	  heap[i / 2] = tmp;
-	  i /= 2;
-	  if (i / 2 < 1)
-	      break;
+	  /* a Node is never queued twice (decrease-key) */
+	  e->Heap = routing_heap_init (e->Dim);
+      }
+    routing_heap_reset (e->Heap, heap_kind);
+    e->Generation += 1;
+    if (e->Generation == 0)
+      {
+	  /* wrap-around: all stamps must be cleared */
+	  for (i = 0; i < e->Dim; i++)
+	      e->Nodes[i].Generation = 0;
+	  e->Generation = 1;
+      }
+}
+
+static RoutingNodePtr
+routing_node (RoutingNodesPtr e, int index)
+{
+/* returning a Node, initializing its state on first visit */
+    RoutingNodePtr n = e->Nodes + index;
+    if (n->Generation != e->Generation)
+      {
+	  n->Generation = e->Generation;
+	  n->PreviousNode = NULL;
+	  n->xLink = NULL;
+	  n->Inspected = 0;
+	  n->Distance = DBL_MAX;
+	  n->HeuristicDistance = DBL_MAX;
+	  n->HeapIndex = -1;
       }
+    return n;
 }
 
+/*
+/ indexed D-ary heap (D = VROUTE_HEAP_ARITY)
+/
+/ a 0-based array; the children of the item at position i
+/ are at positions (i * D) + 1 ... (i * D) + D, and each Node
+/ keeps track of its own position so to support decrease-key
+*/
+
 static void
-dijkstra_enqueue (RoutingHeapPtr heap, RoutingNodePtr node)
+dary_sift_up (HeapNodePtr items, int i)
 {
-/* enqueuing a Node into the heap */
-    dijkstra_insert (node, heap->Nodes, heap->Count);
-    heap->Count += 1;
+/* moving an item towards the root */
+    int parent;
+    HeapNode tmp = items[i];
+    while (i > 0)
+      {
+	  parent = (i - 1) / VROUTE_HEAP_ARITY;
+	  if (items[parent].Distance <= tmp.Distance)
+	      break;
+	  items[i] = items[parent];
+	  items[i].Node->HeapIndex = i;
+	  i = parent;
+      }
+    items[i] = tmp;
+    tmp.Node->HeapIndex = i;
 }
 
 static void
-dijkstra_shiftdown (HeapNodePtr heap, int size, int i)
+dary_sift_down (HeapNodePtr items, int count, int i)
 {
-/* rearranging the heap after removing */
+/* moving an item towards the leaves */
     int c;
-    HeapNode tmp;
+    int first;
+    int last;
+    int best;
+    HeapNode tmp = items[i];
     for (;;)
       {
-	  c = i * 2;
-	  if (c > size)
+	  first = (i * VROUTE_HEAP_ARITY) + 1;
+	  if (first >= count)
 	      break;
-	  if (c < size)
-	    {
-		if (heap[c].Distance > heap[c + 1].Distance)
-		    ++c;
-	    }
-	  if (heap[c].Distance < heap[i].Distance)
+	  last = first + VROUTE_HEAP_ARITY;
+	  if (last > count)
+	      last = count;
+	  best = first;
+	  for (c = first + 1; c < last; c++)
 	    {
-		/* swapping two Nodes */
-		tmp = heap[c];
-		heap[c] = heap[i];
-		heap[i] = tmp;
-		i = c;
+		/* selecting the smallest child */
+		if (items[c].Distance < items[best].Distance)
+		    best = c;
 	    }
-	  else
+	  if (items[best].Distance >= tmp.Distance)
 	      break;
+	  items[i] = items[best];
+	  items[i].Node->HeapIndex = i;
+	  i = best;
+      }
+    items[i] = tmp;
+    tmp.Node->HeapIndex = i;
+}
+
+static void
+dary_push (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* inserting a new Node into the D-ary heap */
+    int i = heap->Count;
+    heap->Nodes[i].Node = node;
+    heap->Nodes[i].Distance = key;
+    heap->Count += 1;
+    dary_sift_up (heap->Nodes, i);
+}
+
+static void
+dary_decrease (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* lowering the key of an already queued Node */
+    int i = node->HeapIndex;
+    heap->Nodes[i].Distance = key;
+    dary_sift_up (heap->Nodes, i);
+}
+
+static RoutingNodePtr
+dary_pop (RoutingHeapPtr heap)
+{
+/* removing the min-priority Node from the D-ary heap */
+    RoutingNodePtr node = heap->Nodes[0].Node;
+    node->HeapIndex = -1;
+    heap->Count -= 1;
+    if (heap->Count > 0)
+      {
+	  heap->Nodes[0] = heap->Nodes[heap->Count];
+	  dary_sift_down (heap->Nodes, heap->Count, 0);
+      }
+    return node;
+}
+
+/*
+/ Radix heap
+/
+/ a non-negative double compares exactly as its IEEE-754 bit
+/ pattern read as an unsigned integer, so any Cost (not only
+/ the integer-like ones) can be bucketed by the highest bit
+/ in which it differs from the last extracted key: bucket 0
+/ holds keys equal to it, bucket k holds keys differing at
+/ bit (k - 1).
+/ extracting the minimum redistributes a single bucket into
+/ the lower ones, and every item moves down at most 64 times
+*/
+
+static sqlite3_uint64
+radix_key_bits (double key)
+{
+/* returning the IEEE-754 bit pattern of a key */
+    sqlite3_uint64 bits;
+    memcpy (&bits, &key, sizeof (sqlite3_uint64));
+    return bits;
+}
+
+static int
+radix_bucket (RoutingHeapPtr heap, sqlite3_uint64 bits)
+{
+/* returning the bucket index corresponding to a key */
+    sqlite3_uint64 diff = bits ^ heap->LastBits;
+    int index = 0;
+    if (diff == 0)
+	return 0;
+    if (diff >> 32)
+      {
+	  index += 32;
+	  diff >>= 32;
+      }
+    if (diff >> 16)
+      {
+	  index += 16;
+	  diff >>= 16;
+      }
+    if (diff >> 8)
+      {
+	  index += 8;
+	  diff >>= 8;
+      }
+    if (diff >> 4)
+      {
+	  index += 4;
+	  diff >>= 4;
+      }
+    if (diff >> 2)
+      {
+	  index += 2;
+	  diff >>= 2;
+      }
+    if (diff >> 1)
+	index += 1;
+    return index + 1;
+}
+
+static void
+radix_bucket_add (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* appending a Node into the bucket corresponding to its key */
+    int index = radix_bucket (heap, radix_key_bits (key));
+    RoutingHeapBucketPtr bucket = heap->Buckets + index;
+    if (bucket->Count == bucket->Max)
+      {
+	  /* growing the bucket */
+	  bucket->Max = (bucket->Max == 0) ? 64 : bucket->Max * 2;
+	  bucket->Items =
+	      realloc (bucket->Items, sizeof (HeapNode) * bucket->Max);
+      }
+    bucket->Items[bucket->Count].Node = node;
+    bucket->Items[bucket->Count].Distance = key;
+    node->HeapIndex = bucket->Count;
+    node->HeapBucket = index;
+    bucket->Count += 1;
+}
+
+static void
+radix_push (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* inserting a new Node into the Radix heap */
+    if (key < heap->Last)
+      {
+	  /* monotonicity: never below the last extracted key */
+	  key = heap->Last;
+      }
+    radix_bucket_add (heap, node, key);
+    heap->Count += 1;
+}
+
+static void
+radix_decrease (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* lowering the key of an already queued Node */
+    RoutingHeapBucketPtr bucket = heap->Buckets + node->HeapBucket;
+    int i = node->HeapIndex;
+    if (key < heap->Last)
+	key = heap->Last;
+/* unlinking the Node from its current bucket */
+    bucket->Count -= 1;
+    if (i != bucket->Count)
+      {
+	  bucket->Items[i] = bucket->Items[bucket->Count];
+	  bucket->Items[i].Node->HeapIndex = i;
       }
+    radix_bucket_add (heap, node, key);
 }
 
 static RoutingNodePtr
-dijkstra_remove_min (HeapNodePtr heap, int size)
+radix_pop (RoutingHeapPtr heap)
 {
-/* removing the min-priority Node from the heap */
-    RoutingNodePtr node = heap[1].Node;
-    heap[1] = heap[size];
-    --size;
-    dijkstra_shiftdown (heap, size, 1);
+/* removing the min-priority Node from the Radix heap */
+    int i;
+    int index;
+    int best;
+    RoutingHeapBucketPtr bucket = heap->Buckets;
+    RoutingNodePtr node;
+    if (bucket->Count == 0)
+      {
+	  /* redistributing the first non-empty bucket */
+	  HeapNode item;
+	  for (index = 1; index < VROUTE_HEAP_BUCKETS; index++)
+	    {
+		if (heap->Buckets[index].Count > 0)
+		    break;
+	    }
+	  bucket = heap->Buckets + index;
+	  best = 0;
+	  for (i = 1; i < bucket->Count; i++)
+	    {
+		if (bucket->Items[i].Distance < bucket->Items[best].Distance)
+		    best = i;
+	    }
+	  heap->Last = bucket->Items[best].Distance;
+	  heap->LastBits = radix_key_bits (heap->Last);
+	  i = bucket->Count;
+	  bucket->Count = 0;
+	  while (i > 0)
+	    {
+		/* all items move into lower buckets */
+		i--;
+		item = bucket->Items[i];
+		radix_bucket_add (heap, item.Node, item.Distance);
+	    }
+	  bucket = heap->Buckets;
+      }
+    bucket->Count -= 1;
+    node = bucket->Items[bucket->Count].Node;
+    node->HeapIndex = -1;
+    heap->Count -= 1;
     return node;
 }
 
+/*
+/ the priority queue interface shared by Dijkstra and A*
+*/
+
+static void
+routing_enqueue (RoutingHeapPtr heap, RoutingNodePtr node, double key)
+{
+/* enqueuing a Node into the heap, or lowering its key if already queued */
+    if (node->HeapIndex >= 0)
+      {
+	  if (heap->Kind == ROUTING_HEAP_RADIX)
+	      radix_decrease (heap, node, key);
+	  else
+	      dary_decrease (heap, node, key);
+	  return;
+      }
+    if (heap->Kind == ROUTING_HEAP_RADIX)
+	radix_push (heap, node, key);
+    else
+	dary_push (heap, node, key);
+}
+
 static RoutingNodePtr
 routing_dequeue (RoutingHeapPtr heap)
 {
 /* dequeuing a Node from the heap */
-    RoutingNodePtr node = dijkstra_remove_min (heap->Nodes, heap->Count);
-    heap->Count -= 1;
-    return node;
+    if (heap->Kind == ROUTING_HEAP_RADIX)
+	return radix_pop (heap);
+    return dary_pop (heap);
+}
+
+static void
+dijkstra_enqueue (RoutingHeapPtr heap, RoutingNodePtr node)
+{
+/* enqueuing (or updating) a Node into the heap */
+    routing_enqueue (heap, node, node->Distance);
 }
 
 /* END of Luigi Costalli Dijkstra Shortest Path implementation */
@@ -745,14 +1426,16 @@ alloc_solution (void)
 }
 
 static void
-add_link_to_solution (ShortestPathSolutionPtr solution, RouteLinkPtr link)
+add_link_to_solution (ShortestPathSolutionPtr solution, RouteLinkPtr link,
+		      double cost)
 {
 /* inserts a Link into the Shortest Path solution */
     RowSolutionPtr p = malloc (sizeof (RowSolution));
     p->Link = link;
+    p->Cost = cost;
     p->Name = NULL;
     p->Next = NULL;
-    solution->TotalCost += link->Cost;
+    solution->TotalCost += cost;
     if (!(solution->First))
 	solution->First = p;
     if (solution->Last)
@@ -1016,7 +1699,7 @@ findLinkCost (sqlite3_int64 linkRowid, ShortestPathSolutionPtr solution)
 	  if (row->Link != NULL)
 	    {
 		if (row->Link->LinkRowid == linkRowid)
-		    return row->Link->Cost;
+		    return row->Cost;
 	    }
 	  row = row->Next;
       }
@@ -1026,9 +1709,14 @@ findLinkCost (sqlite3_int64 linkRowid, ShortestPathSolutionPtr solution)
 static void
 build_solution (sqlite3 * handle, int options, RoutingPtr graph,
 		ShortestPathSolutionPtr solution, RouteLinkPtr * shortest_path,
-		int cnt)
+		const double *costs, int cnt)
 {
-/* formatting the Shortest Path solution */
+/* 
+/ formatting the Shortest Path solution
+/ 
+/ costs could be NULL (static Link Costs), otherwise it contains
+/ the actual Cost of each Link (time-dependent, including turns)
+*/
     int i;
     char *sql;
     int err;
@@ -1058,13 +1746,16 @@ build_solution (sqlite3 * handle, int options, RoutingPtr graph,
       {
 	  /* building the solution */
 	  for (i = 0; i < cnt; i++)
-	      solution->TotalCost += shortest_path[i]->Cost;
+	      solution->TotalCost +=
+		  (costs != NULL) ? costs[i] : shortest_path[i]->Cost;
       }
     else if (options == VROUTE_SHORTEST_PATH_QUICK)
       {
 	  /* only for internal usage: Point2Point */
 	  for (i = 0; i < cnt; i++)
-	      add_link_to_solution (solution, shortest_path[i]);
+	      add_link_to_solution (solution, shortest_path[i],
+				    (costs !=
+				     NULL) ? costs[i] : shortest_path[i]->Cost);
 	  if (shortest_path)
 	      free (shortest_path);
 	  return;
@@ -1073,7 +1764,9 @@ build_solution (sqlite3 * handle, int options, RoutingPtr graph,
       {
 	  /* building the solution */
 	  for (i = 0; i < cnt; i++)
-	      add_link_to_solution (solution, shortest_path[i]);
+	      add_link_to_solution (solution, shortest_path[i],
+				    (costs !=
+				     NULL) ? costs[i] : shortest_path[i]->Cost);
       }
     if (options == VROUTE_SHORTEST_PATH_SIMPLE)
       {
@@ -2011,20 +2704,13 @@ dijkstra_multi_shortest_path (sqlite3 * handle, int options, RoutingPtr graph,
     RoutingHeapPtr heap;
 /* setting From */
     from = multiSolution->From->InternalIndex;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->xLink = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-      }
+/* initializing the workspace */
+    routing_reset (e, e->HeapKind);
+    heap = e->Heap;
 /* queuing the From node into the heap */
-    e->Nodes[from].Distance = 0.0;
-    dijkstra_enqueue (heap, e->Nodes + from);
+    n = routing_node (e, from);
+    n->Distance = 0.0;
+    dijkstra_enqueue (heap, n);
     while (heap->Count > 0)
       {
 	  /* Dijsktra loop */
@@ -2036,7 +2722,7 @@ dijkstra_multi_shortest_path (sqlite3 * handle, int options, RoutingPtr graph,
 		RouteLinkPtr *result;
 		int cnt = 0;
 		int to = destination->InternalIndex;
-		n = e->Nodes + to;
+		n = routing_node (e, to);
 		while (n->PreviousNode != NULL)
 		  {
 		      /* counting how many Links are into the Shortest Path solution */
@@ -2046,7 +2732,7 @@ dijkstra_multi_shortest_path (sqlite3 * handle, int options, RoutingPtr graph,
 		/* allocating the solution */
 		result = malloc (sizeof (RouteLinkPtr) * cnt);
 		k = cnt - 1;
-		n = e->Nodes + to;
+		n = routing_node (e, to);
 		while (n->PreviousNode != NULL)
 		  {
 		      /* inserting a Link into the solution */
@@ -2057,157 +2743,39 @@ dijkstra_multi_shortest_path (sqlite3 * handle, int options, RoutingPtr graph,
 		solution =
 		    add2multiSolution (multiSolution, multiSolution->From,
 				       destination);
-		build_solution (handle, options, graph, solution, result, cnt);
+		build_solution (handle, options, graph, solution, result, NULL,
+				cnt);
 		/* testing for end (all destinations already reached) */
 		if (end_multiTo (multiSolution->MultiTo))
 		    break;
 	    }
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  for (i = e->LinkFirst[n->Id]; i < e->LinkFirst[n->Id + 1]; i++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		/* iterating the outcoming Links (CSR layout) */
+		p_to = routing_node (e, e->LinkTarget[i]);
+		p_link = e->Links + i;
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* queuing a new node into the heap */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
 			    dijkstra_enqueue (heap, p_to);
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + e->LinkCost[i])
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
+			    dijkstra_enqueue (heap, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (heap);
-}
-
-static RouteNodePtr
-check_targets (RoutingNodePtr node, TspTargetsPtr targets)
-{
-/* testing targets */
-    int i;
-    for (i = 0; i < targets->Count; i++)
-      {
-	  RouteNodePtr to = *(targets->To + i);
-	  if (to == NULL)
-	      continue;
-	  if (*(targets->Found + i) == 'Y')
-	      continue;
-	  if (node->Id == to->InternalIndex)
-	    {
-		*(targets->Found + i) = 'Y';
-		return to;
-	    }
-      }
-    return NULL;
-}
-
-static void
-update_targets (TspTargetsPtr targets, RouteNodePtr destination, double cost,
-		int *stop)
-{
-/* tupdating targets */
-    int i;
-    *stop = 1;
-    for (i = 0; i < targets->Count; i++)
-      {
-	  RouteNodePtr to = *(targets->To + i);
-	  if (to == NULL)
-	      continue;
-	  if (to == destination)
-	      *(targets->Costs + i) = cost;
-	  if (*(targets->Found + i) == 'Y')
-	      continue;
-	  *stop = 0;
-      }
-}
-
-
-static void
-dijkstra_targets_solve (RoutingNodesPtr e, TspTargetsPtr targets)
-{
-/* Shortest Path (multiple destinations) for TSP GA */
-    int from;
-    int i;
-    RouteNodePtr destination;
-    RoutingNodePtr n;
-    RoutingNodePtr p_to;
-    RouteLinkPtr p_link;
-    RoutingHeapPtr heap;
-/* setting From */
-    from = targets->From->InternalIndex;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->xLink = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-      }
-/* queuing the From node into the heap */
-    e->Nodes[from].Distance = 0.0;
-    dijkstra_enqueue (heap, e->Nodes + from);
-    while (heap->Count > 0)
-      {
-	  /* Dijsktra loop */
-	  n = routing_dequeue (heap);
-	  destination = check_targets (n, targets);
-	  if (destination != NULL)
-	    {
-		/* reached one of the targets */
-		int stop = 0;
-		double totalCost = 0.0;
-		int to = destination->InternalIndex;
-		n = e->Nodes + to;
-		while (n->PreviousNode != NULL)
-		  {
-		      /* computing the total Cost */
-		      totalCost += n->xLink->Cost;
-		      n = n->PreviousNode;
-		  }
-		/* updating targets */
-		update_targets (targets, destination, totalCost, &stop);
-		if (stop)
-		    break;
-	    }
-	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
-	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
-		if (p_to->Inspected == 0)
-		  {
-		      if (p_to->Distance == DBL_MAX)
-			{
-			    /* queuing a new node into the heap */
-			    p_to->Distance = n->Distance + p_link->Cost;
-			    p_to->PreviousNode = n;
-			    p_to->xLink = p_link;
-			    dijkstra_enqueue (heap, p_to);
-			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
-			{
-			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
-			    p_to->PreviousNode = n;
-			    p_to->xLink = p_link;
-			}
-		  }
-	    }
-      }
-    routing_heap_free (heap);
 }
 
 static void
@@ -2420,20 +2988,13 @@ dijkstra_tsp_nn (sqlite3 * handle, int options, RoutingPtr graph,
 /* setting From */
     from = targets->From->InternalIndex;
     origin = targets->From;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->xLink = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-      }
+/* initializing the workspace */
+    routing_reset (e, e->HeapKind);
+    heap = e->Heap;
 /* queuing the From node into the heap */
-    e->Nodes[from].Distance = 0.0;
-    dijkstra_enqueue (heap, e->Nodes + from);
+    n = routing_node (e, from);
+    n->Distance = 0.0;
+    dijkstra_enqueue (heap, n);
     while (heap->Count > 0)
       {
 	  /* Dijsktra loop */
@@ -2448,7 +3009,7 @@ dijkstra_tsp_nn (sqlite3 * handle, int options, RoutingPtr graph,
 		RouteLinkPtr *result;
 		int cnt = 0;
 		int to = destination->InternalIndex;
-		n = e->Nodes + to;
+		n = routing_node (e, to);
 		while (n->PreviousNode != NULL)
 		  {
 		      /* counting how many Links are into the Shortest Path solution */
@@ -2458,7 +3019,7 @@ dijkstra_tsp_nn (sqlite3 * handle, int options, RoutingPtr graph,
 		/* allocating the solution */
 		result = malloc (sizeof (RouteLinkPtr) * cnt);
 		k = cnt - 1;
-		n = e->Nodes + to;
+		n = routing_node (e, to);
 		while (n->PreviousNode != NULL)
 		  {
 		      /* inserting a Link into the solution */
@@ -2471,7 +3032,8 @@ dijkstra_tsp_nn (sqlite3 * handle, int options, RoutingPtr graph,
 			add2tspLastSolution (targets, origin, destination);
 		else
 		    solution = add2tspSolution (targets, origin, destination);
-		build_solution (handle, options, graph, solution, result, cnt);
+		build_solution (handle, options, graph, solution, result, NULL,
+				cnt);
 		targets->TotalCost += solution->TotalCost;
 
 		/* testing for end (all destinations already reached) */
@@ -2485,46 +3047,40 @@ dijkstra_tsp_nn (sqlite3 * handle, int options, RoutingPtr graph,
 
 		/* restarting from the current target */
 		from = to;
-		for (i = 0; i < e->Dim; i++)
-		  {
-		      n = e->Nodes + i;
-		      n->PreviousNode = NULL;
-		      n->xLink = NULL;
-		      n->Inspected = 0;
-		      n->Distance = DBL_MAX;
-		  }
-		e->Nodes[from].Distance = 0.0;
-		routing_heap_reset (heap);
-		dijkstra_enqueue (heap, e->Nodes + from);
+		routing_reset (e, e->HeapKind);
+		n = routing_node (e, from);
+		n->Distance = 0.0;
+		dijkstra_enqueue (heap, n);
 		origin = destination;
 		continue;
 	    }
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  for (i = e->LinkFirst[n->Id]; i < e->LinkFirst[n->Id + 1]; i++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		/* iterating the outcoming Links (CSR layout) */
+		p_to = routing_node (e, e->LinkTarget[i]);
+		p_link = e->Links + i;
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* queuing a new node into the heap */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
 			    dijkstra_enqueue (heap, p_to);
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + e->LinkCost[i])
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
+			    dijkstra_enqueue (heap, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (heap);
 }
 
 static RoutingNodePtr *
@@ -2542,53 +3098,47 @@ dijkstra_range_analysis (RoutingNodesPtr e, RouteNodePtr pfrom,
     RoutingHeapPtr heap;
 /* setting From */
     from = pfrom->InternalIndex;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->xLink = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-      }
+/* initializing the workspace */
+    routing_reset (e, e->HeapKind);
+    heap = e->Heap;
 /* queuing the From node into the heap */
-    e->Nodes[from].Distance = 0.0;
-    dijkstra_enqueue (heap, e->Nodes + from);
+    n = routing_node (e, from);
+    n->Distance = 0.0;
+    dijkstra_enqueue (heap, n);
     while (heap->Count > 0)
       {
 	  /* Dijsktra loop */
 	  n = routing_dequeue (heap);
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  for (i = e->LinkFirst[n->Id]; i < e->LinkFirst[n->Id + 1]; i++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		/* iterating the outcoming Links (CSR layout) */
+		p_to = routing_node (e, e->LinkTarget[i]);
+		p_link = e->Links + i;
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* queuing a new node into the heap */
-			    if (n->Distance + p_link->Cost <= max_cost)
+			    if (n->Distance + e->LinkCost[i] <= max_cost)
 			      {
-				  p_to->Distance = n->Distance + p_link->Cost;
+				  p_to->Distance = n->Distance + e->LinkCost[i];
 				  p_to->PreviousNode = n;
 				  p_to->xLink = p_link;
 				  dijkstra_enqueue (heap, p_to);
 			      }
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + e->LinkCost[i])
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
+			    dijkstra_enqueue (heap, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (heap);
     cnt = 0;
     for (i = 0; i < e->Dim; i++)
       {
@@ -2596,7 +3146,7 @@ dijkstra_range_analysis (RoutingNodesPtr e, RouteNodePtr pfrom,
 	  n = e->Nodes + i;
 	  if (n->Node->InternalIndex == from)
 	      continue;
-	  if (n->Inspected)
+	  if (n->Generation == e->Generation && n->Inspected)
 	      cnt++;
       }
 /* allocating the solution */
@@ -2608,7 +3158,7 @@ dijkstra_range_analysis (RoutingNodesPtr e, RouteNodePtr pfrom,
 	  n = e->Nodes + i;
 	  if (n->Node->InternalIndex == from)
 	      continue;
-	  if (n->Inspected)
+	  if (n->Generation == e->Generation && n->Inspected)
 	      result[cnt++] = n;
       }
     *ll = cnt;
@@ -2621,34 +3171,11 @@ dijkstra_range_analysis (RoutingNodesPtr e, RouteNodePtr pfrom,
 /
 */
 
-static void
-astar_insert (RoutingNodePtr node, HeapNodePtr heap, int size)
-{
-/* inserting a new Node and rearranging the heap */
-    int i;
-    HeapNode tmp;
-    i = size + 1;
-    heap[i].Node = node;
-    heap[i].Distance = node->HeuristicDistance;
-    if (i / 2 < 1)
-	return;
-    while (heap[i].Distance < heap[i / 2].Distance)
-      {
-	  tmp = heap[i];
-	  heap[i] = heap[i / 2];
-	  heap[i / 2] = tmp;
-	  i /= 2;
-	  if (i / 2 < 1)
-	      break;
-      }
-}
-
 static void
 astar_enqueue (RoutingHeapPtr heap, RoutingNodePtr node)
 {
-/* enqueuing a Node into the heap */
-    astar_insert (node, heap->Nodes, heap->Count);
-    heap->Count += 1;
+/* enqueuing (or updating) a Node into the heap */
+    routing_enqueue (heap, node, node->HeuristicDistance);
 }
 
 static double
@@ -2666,7 +3193,11 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 		     RouteNodePtr pfrom, RouteNodePtr pto,
 		     double heuristic_coeff, int *ll)
 {
-/* identifying the Shortest Path - A* algorithm */
+/* 
+/ identifying the Shortest Path - A* algorithm
+/
+/ returns NULL if the destination cannot be reached
+*/
     int from;
     int to;
     int i;
@@ -2687,23 +3218,15 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
     pOrg = nodes + pAux->Id;
     pAux = e->Nodes + to;
     pDest = nodes + pAux->Id;
-/* initializing the heap */
-    heap = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->xLink = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-	  n->HeuristicDistance = DBL_MAX;
-      }
+/* initializing the workspace */
+    routing_reset (e, ROUTING_HEAP_DARY);
+    heap = e->Heap;
 /* queuing the From node into the heap */
-    e->Nodes[from].Distance = 0.0;
-    e->Nodes[from].HeuristicDistance =
+    n = routing_node (e, from);
+    n->Distance = 0.0;
+    n->HeuristicDistance =
 	astar_heuristic_distance (pOrg, pDest, heuristic_coeff);
-    astar_enqueue (heap, e->Nodes + from);
+    astar_enqueue (heap, n);
     while (heap->Count > 0)
       {
 	  /* A* loop */
@@ -2714,16 +3237,17 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 		break;
 	    }
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  for (i = e->LinkFirst[n->Id]; i < e->LinkFirst[n->Id + 1]; i++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		/* iterating the outcoming Links (CSR layout) */
+		p_to = routing_node (e, e->LinkTarget[i]);
+		p_link = e->Links + i;
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* queuing a new node into the heap */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    pOrg = nodes + p_to->Id;
 			    p_to->HeuristicDistance =
 				p_to->Distance +
@@ -2733,10 +3257,10 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 			    p_to->xLink = p_link;
 			    astar_enqueue (heap, p_to);
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + e->LinkCost[i])
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + e->LinkCost[i];
 			    pOrg = nodes + p_to->Id;
 			    p_to->HeuristicDistance =
 				p_to->Distance +
@@ -2744,13 +3268,19 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 							  heuristic_coeff);
 			    p_to->PreviousNode = n;
 			    p_to->xLink = p_link;
+			    astar_enqueue (heap, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (heap);
+    n = routing_node (e, to);
+    if (n->Distance == DBL_MAX)
+      {
+	  /* unreachable destination */
+	  *ll = 0;
+	  return NULL;
+      }
     cnt = 0;
-    n = e->Nodes + to;
     while (n->PreviousNode != NULL)
       {
 	  /* counting how many Links are into the Shortest Path solution */
@@ -2760,7 +3290,7 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 /* allocating the solution */
     result = malloc (sizeof (RouteLinkPtr) * cnt);
     k = cnt - 1;
-    n = e->Nodes + to;
+    n = routing_node (e, to);
     while (n->PreviousNode != NULL)
       {
 	  /* inserting a Link into the solution */
@@ -2774,90 +3304,762 @@ astar_shortest_path (RoutingNodesPtr e, RouteNodePtr nodes,
 
 /* END of A* Shortest Path implementation */
 
-static int
-cmp_nodes_code (const void *p1, const void *p2)
+/* START of Contraction Hierarchies Shortest Path implementation */
+
+static void
+ch_heap_push (RouteCHHeapPtr heap, int node, double key)
 {
-/* compares two nodes  by CODE [for BSEARCH] */
-    RouteNodePtr pN1 = (RouteNodePtr) p1;
-    RouteNodePtr pN2 = (RouteNodePtr) p2;
-    return strcmp (pN1->Code, pN2->Code);
+/* inserting an item into the CH Heap */
+    int i;
+    int parent;
+    RouteCHHeapItem tmp;
+    if (heap->Count == heap->Max)
+      {
+	  heap->Max = (heap->Max == 0) ? 256 : heap->Max * 2;
+	  heap->Items =
+	      realloc (heap->Items, sizeof (RouteCHHeapItem) * heap->Max);
+      }
+    i = heap->Count++;
+    heap->Items[i].Node = node;
+    heap->Items[i].Key = key;
+    while (i > 0)
+      {
+	  parent = (i - 1) / 2;
+	  if (heap->Items[parent].Key <= heap->Items[i].Key)
+	      break;
+	  tmp = heap->Items[parent];
+	  heap->Items[parent] = heap->Items[i];
+	  heap->Items[i] = tmp;
+	  i = parent;
+      }
 }
 
-static int
-cmp_nodes_id (const void *p1, const void *p2)
+static RouteCHHeapItem
+ch_heap_pop (RouteCHHeapPtr heap)
 {
-/* compares two nodes  by ID [for BSEARCH] */
-    RouteNodePtr pN1 = (RouteNodePtr) p1;
-    RouteNodePtr pN2 = (RouteNodePtr) p2;
-    if (pN1->Id == pN2->Id)
-	return 0;
-    if (pN1->Id > pN2->Id)
-	return 1;
-    return -1;
+/* removing the topmost item from the CH Heap */
+    int i = 0;
+    int child;
+    RouteCHHeapItem tmp;
+    RouteCHHeapItem top = heap->Items[0];
+    heap->Items[0] = heap->Items[--heap->Count];
+    while (1)
+      {
+	  child = (2 * i) + 1;
+	  if (child >= heap->Count)
+	      break;
+	  if (child + 1 < heap->Count
+	      && heap->Items[child + 1].Key < heap->Items[child].Key)
+	      child++;
+	  if (heap->Items[i].Key <= heap->Items[child].Key)
+	      break;
+	  tmp = heap->Items[child];
+	  heap->Items[child] = heap->Items[i];
+	  heap->Items[i] = tmp;
+	  i = child;
+      }
+    return top;
 }
 
-static RouteNodePtr
-find_node_by_code (RoutingPtr graph, const char *code)
+static void
+ch_touch (RouteCHWorkspacePtr ws, int node)
 {
-/* searching a Node (by Code) into the sorted list */
-    RouteNodePtr ret;
-    RouteNode pN;
-    pN.Code = (char *) code;
-    ret =
-	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (RouteNode),
-		 cmp_nodes_code);
-    return ret;
+/* registering a Node touched by the current query */
+    if (ws->FwdDist[node] == DBL_MAX && ws->BwdDist[node] == DBL_MAX)
+	ws->Touched[ws->NumTouched++] = node;
 }
 
-static RouteNodePtr
-find_node_by_id (RoutingPtr graph, const sqlite3_int64 id)
+static void
+ch_reset (RouteCHWorkspacePtr ws)
 {
-/* searching a Node (by Id) into the sorted list */
-    RouteNodePtr ret;
-    RouteNode pN;
-    pN.Id = id;
-    ret =
-	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (RouteNode),
-		 cmp_nodes_id);
-    return ret;
+/* resetting the query workspace */
+    int i;
+    for (i = 0; i < ws->NumTouched; i++)
+      {
+	  int node = ws->Touched[i];
+	  ws->FwdDist[node] = DBL_MAX;
+	  ws->BwdDist[node] = DBL_MAX;
+	  ws->FwdArc[node] = -1;
+	  ws->BwdArc[node] = -1;
+      }
+    ws->NumTouched = 0;
+    ws->FwdHeap.Count = 0;
+    ws->BwdHeap.Count = 0;
 }
 
 static void
-vroute_delete_multiple_destinations (RoutingMultiDestPtr multiple)
+ch_unpack_arc (RouteCHPtr ch, int arc, int **stack, int *max_stack,
+	       RouteLinkPtr ** result, int *count, int *max)
 {
-/* deleting a multiple destinations request */
-    if (multiple == NULL)
-	return;
-    if (multiple->Found != NULL)
-	free (multiple->Found);
-    if (multiple->To != NULL)
-	free (multiple->To);
-    if (multiple->Ids != NULL)
-	free (multiple->Ids);
-    if (multiple->Codes != NULL)
+/* expanding a Shortcut into the corresponding sequence of original Links */
+    int depth = 0;
+    (*stack)[depth++] = arc;
+    while (depth > 0)
       {
-	  int i;
-	  for (i = 0; i < multiple->Items; i++)
+	  RouteCHArcPtr p_arc = ch->Arcs + (*stack)[--depth];
+	  if (p_arc->Link != NULL)
 	    {
-		char *p = *(multiple->Codes + i);
-		if (p != NULL)
-		    free (p);
+		/* an original Link */
+		if (*count == *max)
+		  {
+		      *max = (*max == 0) ? 64 : *max * 2;
+		      *result = realloc (*result, sizeof (RouteLinkPtr) * *max);
+		  }
+		*(*result + *count) = p_arc->Link;
+		*count += 1;
+		continue;
 	    }
-	  free (multiple->Codes);
+	  if (depth + 2 > *max_stack)
+	    {
+		*max_stack *= 2;
+		*stack = realloc (*stack, sizeof (int) * *max_stack);
+	    }
+	  /* the second half is pushed first, so to be expanded last */
+	  (*stack)[depth++] = p_arc->Child2;
+	  (*stack)[depth++] = p_arc->Child1;
       }
-    free (multiple);
 }
 
-static void
-vroute_add_multiple_code (RoutingMultiDestPtr multiple, char *code)
+static RouteLinkPtr *
+ch_shortest_path (RoutingPtr graph, RouteCHWorkspacePtr ws,
+		  RouteNodePtr pfrom, RouteNodePtr pto, int *ll)
 {
-/* adding an item to an helper struct for Multiple Destinations (by Code) */
-    *(multiple->Codes + multiple->Next) = code;
-    multiple->Next += 1;
+/* 
+/ identifying the Shortest Path - Contraction Hierarchies
+/
+/ a forward search starting from the origin and a backward search
+/ starting from the destination are alternated; both only follow
+/ arcs leading towards higher ranked Nodes, and they will finally
+/ meet on the highest ranked Node of the Shortest Path
+/
+/ returns NULL if the destination cannot be reached
+*/
+    RouteCHPtr ch = graph->CH;
+    int from = pfrom->InternalIndex;
+    int to = pto->InternalIndex;
+    int meeting = -1;
+    double best = DBL_MAX;
+    int forward = 1;
+    int node;
+    int i;
+    int max = 0;
+    int cnt = 0;
+    int n_fwd;
+    int n_arcs;
+    int *arcs;
+    int *stack;
+    int max_stack;
+    RouteLinkPtr *result = NULL;
+    RouteCHHeapItem item;
+
+    ch_touch (ws, from);
+    ws->FwdDist[from] = 0.0;
+    ch_heap_push (&(ws->FwdHeap), from, 0.0);
+    ch_touch (ws, to);
+    ws->BwdDist[to] = 0.0;
+    ch_heap_push (&(ws->BwdHeap), to, 0.0);
+    while (1)
+      {
+	  /* discarding any search that cannot improve the current best */
+	  if (ws->FwdHeap.Count > 0 && ws->FwdHeap.Items[0].Key >= best)
+	      ws->FwdHeap.Count = 0;
+	  if (ws->BwdHeap.Count > 0 && ws->BwdHeap.Items[0].Key >= best)
+	      ws->BwdHeap.Count = 0;
+	  if (ws->FwdHeap.Count == 0 && ws->BwdHeap.Count == 0)
+	      break;
+	  if (ws->FwdHeap.Count == 0)
+	      forward = 0;
+	  else if (ws->BwdHeap.Count == 0)
+	      forward = 1;
+	  if (forward)
+	    {
+		/* a forward step */
+		item = ch_heap_pop (&(ws->FwdHeap));
+		node = item.Node;
+		if (item.Key > ws->FwdDist[node])
+		    continue;	/* stale item */
+		if (ws->BwdDist[node] != DBL_MAX
+		    && item.Key + ws->BwdDist[node] < best)
+		  {
+		      best = item.Key + ws->BwdDist[node];
+		      meeting = node;
+		  }
+		for (i = ch->UpFirst[node]; i < ch->UpFirst[node + 1]; i++)
+		  {
+		      RouteCHArcPtr arc = ch->Arcs + ch->UpArcs[i];
+		      double dist = item.Key + arc->Cost;
+		      if (dist < ws->FwdDist[arc->NodeTo])
+			{
+			    ch_touch (ws, arc->NodeTo);
+			    ws->FwdDist[arc->NodeTo] = dist;
+			    ws->FwdArc[arc->NodeTo] = ch->UpArcs[i];
+			    ch_heap_push (&(ws->FwdHeap), arc->NodeTo, dist);
+			}
+		  }
+	    }
+	  else
+	    {
+		/* a backward step */
+		item = ch_heap_pop (&(ws->BwdHeap));
+		node = item.Node;
+		if (item.Key > ws->BwdDist[node])
+		    continue;	/* stale item */
+		if (ws->FwdDist[node] != DBL_MAX
+		    && item.Key + ws->FwdDist[node] < best)
+		  {
+		      best = item.Key + ws->FwdDist[node];
+		      meeting = node;
+		  }
+		for (i = ch->DownFirst[node]; i < ch->DownFirst[node + 1]; i++)
+		  {
+		      RouteCHArcPtr arc = ch->Arcs + ch->DownArcs[i];
+		      double dist = item.Key + arc->Cost;
+		      if (dist < ws->BwdDist[arc->NodeFrom])
+			{
+			    ch_touch (ws, arc->NodeFrom);
+			    ws->BwdDist[arc->NodeFrom] = dist;
+			    ws->BwdArc[arc->NodeFrom] = ch->DownArcs[i];
+			    ch_heap_push (&(ws->BwdHeap), arc->NodeFrom, dist);
+			}
+		  }
+	    }
+	  forward = !forward;
+      }
+    if (meeting < 0)
+      {
+	  /* unreachable destination */
+	  ch_reset (ws);
+	  *ll = 0;
+	  return NULL;
+      }
+
+/* collecting the CH arcs: origin -> meeting Node -> destination */
+    n_fwd = 0;
+    node = meeting;
+    while (ws->FwdArc[node] >= 0)
+      {
+	  n_fwd++;
+	  node = ch->Arcs[ws->FwdArc[node]].NodeFrom;
+      }
+    n_arcs = n_fwd;
+    node = meeting;
+    while (ws->BwdArc[node] >= 0)
+      {
+	  n_arcs++;
+	  node = ch->Arcs[ws->BwdArc[node]].NodeTo;
+      }
+    arcs = malloc (sizeof (int) * (n_arcs + 1));
+    i = n_fwd;
+    node = meeting;
+    while (ws->FwdArc[node] >= 0)
+      {
+	  arcs[--i] = ws->FwdArc[node];
+	  node = ch->Arcs[ws->FwdArc[node]].NodeFrom;
+      }
+    i = n_fwd;
+    node = meeting;
+    while (ws->BwdArc[node] >= 0)
+      {
+	  arcs[i++] = ws->BwdArc[node];
+	  node = ch->Arcs[ws->BwdArc[node]].NodeTo;
+      }
+    ch_reset (ws);
+
+/* unpacking all Shortcuts */
+    cnt = 0;
+    max_stack = 64;
+    stack = malloc (sizeof (int) * max_stack);
+    for (i = 0; i < n_arcs; i++)
+	ch_unpack_arc (ch, arcs[i], &stack, &max_stack, &result, &cnt, &max);
+    free (stack);
+    free (arcs);
+    if (result == NULL)
+	result = malloc (sizeof (RouteLinkPtr));
+    *ll = cnt;
+    return result;
 }
 
-static void
-vroute_add_multiple_id (RoutingMultiDestPtr multiple, int id)
+/* END of Contraction Hierarchies Shortest Path implementation */
+
+/* START of bidirectional Dijkstra and A* Shortest Path implementation */
+
+/*
+/ a forward search starting from the origin (following the outcoming
+/ Links) and a backward search starting from the destination (following
+/ the incoming Links, i.e. the reverse CSR) are performed in turn, each
+/ time advancing the one having the smaller queue.
+/ each time a Link connects a Node reached by the forward search to a
+/ Node reached by the backward one a candidate path is found; the
+/ searches stop as soon as the sum of the two smallest queued keys
+/ cannot improve the best candidate.
+/
+/ the bidirectional A* uses the average potential:
+/   p(v) = (h(v, To) - h(v, From)) / 2
+/ the forward search is keyed by dist + p(v) and the backward one by
+/ dist - p(v), so that both explore the same reduced Costs and the
+/ same stopping criterion holds
+*/
+
+static double
+bidir_potential (RoutingPtr graph, int node, RouteNodePtr pfrom,
+		 RouteNodePtr pto, int a_star)
+{
+/* the bidirectional A* potential of a Node (always 0 for Dijkstra) */
+    RouteNodePtr pN;
+    if (!a_star)
+	return 0.0;
+    pN = graph->Nodes + node;
+    return (astar_heuristic_distance (pN, pto, graph->AStarHeuristicCoeff) -
+	    astar_heuristic_distance (pN, pfrom,
+				      graph->AStarHeuristicCoeff)) / 2.0;
+}
+
+static RouteLinkPtr *
+bidir_shortest_path (RoutingPtr graph, RouteCHWorkspacePtr ws,
+		     RouteNodePtr pfrom, RouteNodePtr pto, int a_star,
+		     int *ll)
+{
+/* 
+/ identifying the Shortest Path - bidirectional Dijkstra or A*
+/
+/ returns NULL if the destination cannot be reached
+*/
+    int from = pfrom->InternalIndex;
+    int to = pto->InternalIndex;
+    int meeting = -1;
+    double best = DBL_MAX;
+    int node;
+    int next;
+    int link;
+    int i;
+    int k;
+    int cnt;
+    double dist;
+    RouteLinkPtr *result;
+    RouteCHHeapItem item;
+
+    ch_touch (ws, from);
+    ws->FwdDist[from] = 0.0;
+    ch_heap_push (&(ws->FwdHeap), from,
+		  bidir_potential (graph, from, pfrom, pto, a_star));
+    ch_touch (ws, to);
+    ws->BwdDist[to] = 0.0;
+    ch_heap_push (&(ws->BwdHeap), to,
+		  -bidir_potential (graph, to, pfrom, pto, a_star));
+    if (from == to)
+      {
+	  best = 0.0;
+	  meeting = from;
+      }
+    while (ws->FwdHeap.Count > 0 && ws->BwdHeap.Count > 0)
+      {
+	  if (ws->FwdHeap.Items[0].Key + ws->BwdHeap.Items[0].Key >= best)
+	      break;		/* the best candidate cannot be improved */
+	  if (ws->FwdHeap.Count <= ws->BwdHeap.Count)
+	    {
+		/* a forward step */
+		item = ch_heap_pop (&(ws->FwdHeap));
+		node = item.Node;
+		dist = ws->FwdDist[node];
+		if (item.Key >
+		    dist + bidir_potential (graph, node, pfrom, pto, a_star))
+		    continue;	/* stale item */
+		for (i = graph->LinkFirst[node]; i < graph->LinkFirst[node + 1];
+		     i++)
+		  {
+		      double d = dist + graph->LinkCost[i];
+		      next = graph->LinkTarget[i];
+		      if (d < ws->FwdDist[next])
+			{
+			    ch_touch (ws, next);
+			    ws->FwdDist[next] = d;
+			    ws->FwdArc[next] = i;
+			    ch_heap_push (&(ws->FwdHeap), next,
+					  d + bidir_potential (graph, next,
+							       pfrom, pto,
+							       a_star));
+			}
+		      if (ws->BwdDist[next] != DBL_MAX
+			  && ws->FwdDist[next] + ws->BwdDist[next] < best)
+			{
+			    best = ws->FwdDist[next] + ws->BwdDist[next];
+			    meeting = next;
+			}
+		  }
+	    }
+	  else
+	    {
+		/* a backward step */
+		item = ch_heap_pop (&(ws->BwdHeap));
+		node = item.Node;
+		dist = ws->BwdDist[node];
+		if (item.Key >
+		    dist - bidir_potential (graph, node, pfrom, pto, a_star))
+		    continue;	/* stale item */
+		for (i = graph->RevFirst[node]; i < graph->RevFirst[node + 1];
+		     i++)
+		  {
+		      double d;
+		      link = graph->RevLinks[i];
+		      d = dist + graph->LinkCost[link];
+		      next = graph->Links[link].NodeFrom->InternalIndex;
+		      if (d < ws->BwdDist[next])
+			{
+			    ch_touch (ws, next);
+			    ws->BwdDist[next] = d;
+			    ws->BwdArc[next] = link;
+			    ch_heap_push (&(ws->BwdHeap), next,
+					  d - bidir_potential (graph, next,
+							       pfrom, pto,
+							       a_star));
+			}
+		      if (ws->FwdDist[next] != DBL_MAX
+			  && ws->FwdDist[next] + ws->BwdDist[next] < best)
+			{
+			    best = ws->FwdDist[next] + ws->BwdDist[next];
+			    meeting = next;
+			}
+		  }
+	    }
+      }
+    if (meeting < 0)
+      {
+	  /* unreachable destination */
+	  ch_reset (ws);
+	  *ll = 0;
+	  return NULL;
+      }
+
+/* collecting the Links: origin -> meeting Node -> destination */
+    cnt = 0;
+    node = meeting;
+    while (ws->FwdArc[node] >= 0)
+      {
+	  cnt++;
+	  node = graph->Links[ws->FwdArc[node]].NodeFrom->InternalIndex;
+      }
+    k = cnt;
+    node = meeting;
+    while (ws->BwdArc[node] >= 0)
+      {
+	  cnt++;
+	  node = graph->LinkTarget[ws->BwdArc[node]];
+      }
+    result = malloc (sizeof (RouteLinkPtr) * (cnt + 1));
+    i = k;
+    node = meeting;
+    while (ws->FwdArc[node] >= 0)
+      {
+	  result[--i] = graph->Links + ws->FwdArc[node];
+	  node = graph->Links[ws->FwdArc[node]].NodeFrom->InternalIndex;
+      }
+    node = meeting;
+    while (ws->BwdArc[node] >= 0)
+      {
+	  result[k++] = graph->Links + ws->BwdArc[node];
+	  node = graph->LinkTarget[ws->BwdArc[node]];
+      }
+    ch_reset (ws);
+    *ll = cnt;
+    return result;
+}
+
+/* END of bidirectional Dijkstra and A* Shortest Path implementation */
+
+/* START of time-dependent Shortest Path implementation */
+
+/*
+/ when Time Profiles or Turn Restrictions are available the search
+/ is performed on Links instead of Nodes (edge-based): the state of
+/ each Link is the Cost required to reach its end, so that the Cost
+/ of the next Link could depend on the incoming Link (turns) and on
+/ the time of arrival (Departure Time + Cost accumulated so far).
+/ Costs are then assumed to be measured in seconds, and the profiles
+/ are assumed to never let a later departure arrive earlier (FIFO).
+*/
+
+#define VROUTE_TD_DAY_SECONDS	86400.0
+
+static double
+td_link_cost (RoutingPtr graph, int link, double time)
+{
+/* returning the Cost of a Link entered at the given time */
+    RouteTDPtr td = graph->TD;
+    RouteTDProfilePtr profile;
+    int lo;
+    int hi;
+    int step;
+    int p = td->LinkProfile[link];
+    if (p < 0)
+	return graph->LinkCost[link];	/* static Cost */
+    profile = td->Profiles + p;
+    time = fmod (time, VROUTE_TD_DAY_SECONDS);
+    if (time < 0.0)
+	time += VROUTE_TD_DAY_SECONDS;
+/* searching the last step starting not after the given time */
+    step = profile->First + profile->Count - 1;	/* wrapping around midnight */
+    lo = profile->First;
+    hi = profile->First + profile->Count - 1;
+    while (lo <= hi)
+      {
+	  int mid = (lo + hi) / 2;
+	  if (td->StepTime[mid] <= time)
+	    {
+		step = mid;
+		lo = mid + 1;
+	    }
+	  else
+	      hi = mid - 1;
+      }
+    return td->StepCost[step];
+}
+
+static double
+td_turn_cost (RouteTDPtr td, int from_link, int to_link)
+{
+/* returning the penalty of a turn (DBL_MAX if banned) */
+    int i;
+    for (i = td->TurnFirst[from_link]; i < td->TurnFirst[from_link + 1]; i++)
+      {
+	  if (td->TurnLink[i] == to_link)
+	      return td->TurnCost[i];
+      }
+    return 0.0;
+}
+
+static void
+td_reset (RouteTDWorkspacePtr ws, int links)
+{
+/* starting a new query: all Links become implicitly unvisited */
+    int i;
+    ws->Heap.Count = 0;
+    ws->Generation += 1;
+    if (ws->Generation == 0)
+      {
+	  /* wrap-around: all stamps must be cleared */
+	  for (i = 0; i < links; i++)
+	      ws->Stamp[i] = 0;
+	  ws->Generation = 1;
+      }
+}
+
+static void
+td_relax (RouteTDWorkspacePtr ws, int link, int prev, double dist,
+	  double key)
+{
+/* updating the state of a Link, if improved */
+    if (ws->Stamp[link] != ws->Generation)
+      {
+	  ws->Stamp[link] = ws->Generation;
+	  ws->Settled[link] = 0;
+	  ws->Dist[link] = DBL_MAX;
+      }
+    if (ws->Settled[link] || dist >= ws->Dist[link])
+	return;
+    ws->Dist[link] = dist;
+    ws->Prev[link] = prev;
+    ch_heap_push (&(ws->Heap), link, key);
+}
+
+static void
+td_add_solution (sqlite3 * handle, int options, RoutingPtr graph,
+		 RouteTDWorkspacePtr ws, MultiSolutionPtr multiSolution,
+		 RouteNodePtr destination, int last)
+{
+/* building the solution ending with the given Link (-1: empty path) */
+    ShortestPathSolutionPtr solution;
+    RouteLinkPtr *result;
+    double *costs;
+    int cnt = 0;
+    int k;
+    int link;
+    for (link = last; link >= 0; link = ws->Prev[link])
+	cnt++;
+    result = malloc (sizeof (RouteLinkPtr) * (cnt + 1));
+    costs = malloc (sizeof (double) * (cnt + 1));
+    k = cnt - 1;
+    for (link = last; link >= 0; link = ws->Prev[link])
+      {
+	  /* inserting a Link into the solution */
+	  int prev = ws->Prev[link];
+	  result[k] = graph->Links + link;
+	  costs[k] = ws->Dist[link] - ((prev >= 0) ? ws->Dist[prev] : 0.0);
+	  k--;
+      }
+    solution =
+	add2multiSolution (multiSolution, multiSolution->From, destination);
+    build_solution (handle, options, graph, solution, result, costs, cnt);
+    free (costs);
+}
+
+static void
+td_multi_shortest_path (sqlite3 * handle, int options, RoutingPtr graph,
+			RoutingNodesPtr e, MultiSolutionPtr multiSolution,
+			RouteNodePtr target, double departure)
+{
+/* 
+/ Shortest Path (multiple destinations) - time-dependent and turn 
+/ aware Dijkstra's algorithm; when a single target is given the
+/ search is guided by the A* heuristic
+*/
+    int i;
+    int from = multiSolution->From->InternalIndex;
+    RouteTDPtr td = graph->TD;
+    RouteTDWorkspacePtr ws = e->TD;
+    RoutingMultiDestPtr multiple = multiSolution->MultiTo;
+    RouteNodePtr destination;
+    double coeff = td->AStarHeuristicCoeff;
+
+    td_reset (ws, graph->NumLinks);
+    destination = check_multiTo (e->Nodes + from, multiple);
+    if (destination != NULL)
+      {
+	  /* the origin itself is a destination */
+	  td_add_solution (handle, options, graph, ws, multiSolution,
+			   destination, -1);
+	  if (end_multiTo (multiple))
+	      return;
+      }
+    for (i = graph->LinkFirst[from]; i < graph->LinkFirst[from + 1]; i++)
+      {
+	  /* queuing all the outcoming Links of the origin */
+	  double dist = td_link_cost (graph, i, departure);
+	  double key = dist;
+	  if (target != NULL)
+	      key +=
+		  astar_heuristic_distance (graph->Nodes +
+					    graph->LinkTarget[i], target,
+					    coeff);
+	  td_relax (ws, i, -1, dist, key);
+      }
+    while (ws->Heap.Count > 0)
+      {
+	  /* Dijkstra loop */
+	  int node;
+	  double time;
+	  RouteCHHeapItem item = ch_heap_pop (&(ws->Heap));
+	  int link = item.Node;
+	  if (ws->Settled[link])
+	      continue;		/* an outdated Heap item */
+	  ws->Settled[link] = 1;
+	  node = graph->LinkTarget[link];
+	  destination = check_multiTo (e->Nodes + node, multiple);
+	  if (destination != NULL)
+	    {
+		/* reached one of the multiple destinations */
+		td_add_solution (handle, options, graph, ws, multiSolution,
+				 destination, link);
+		if (end_multiTo (multiple))
+		    break;
+	    }
+	  time = departure + ws->Dist[link];
+	  for (i = graph->LinkFirst[node]; i < graph->LinkFirst[node + 1]; i++)
+	    {
+		/* iterating the outcoming Links (CSR layout) */
+		double dist;
+		double key;
+		double turn = td_turn_cost (td, link, i);
+		if (turn == DBL_MAX)
+		    continue;	/* banned turn */
+		dist = ws->Dist[link] + turn + td_link_cost (graph, i,
+							     time + turn);
+		key = dist;
+		if (target != NULL)
+		    key +=
+			astar_heuristic_distance (graph->Nodes +
+						  graph->LinkTarget[i], target,
+						  coeff);
+		td_relax (ws, i, link, dist, key);
+	    }
+      }
+}
+
+/* END of time-dependent Shortest Path implementation */
+
+static int
+cmp_nodes_code (const void *p1, const void *p2)
+{
+/* compares two nodes  by CODE [for BSEARCH] */
+    RouteNodePtr pN1 = (RouteNodePtr) p1;
+    RouteNodePtr pN2 = (RouteNodePtr) p2;
+    return strcmp (pN1->Code, pN2->Code);
+}
+
+static int
+cmp_nodes_id (const void *p1, const void *p2)
+{
+/* compares two nodes  by ID [for BSEARCH] */
+    RouteNodePtr pN1 = (RouteNodePtr) p1;
+    RouteNodePtr pN2 = (RouteNodePtr) p2;
+    if (pN1->Id == pN2->Id)
+	return 0;
+    if (pN1->Id > pN2->Id)
+	return 1;
+    return -1;
+}
+
+static RouteNodePtr
+find_node_by_code (RoutingPtr graph, const char *code)
+{
+/* searching a Node (by Code) into the sorted list */
+    RouteNodePtr ret;
+    RouteNode pN;
+    pN.Code = (char *) code;
+    ret =
+	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (RouteNode),
+		 cmp_nodes_code);
+    return ret;
+}
+
+static RouteNodePtr
+find_node_by_id (RoutingPtr graph, const sqlite3_int64 id)
+{
+/* searching a Node (by Id) into the sorted list */
+    RouteNodePtr ret;
+    RouteNode pN;
+    pN.Id = id;
+    ret =
+	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (RouteNode),
+		 cmp_nodes_id);
+    return ret;
+}
+
+static void
+vroute_delete_multiple_destinations (RoutingMultiDestPtr multiple)
+{
+/* deleting a multiple destinations request */
+    if (multiple == NULL)
+	return;
+    if (multiple->Found != NULL)
+	free (multiple->Found);
+    if (multiple->To != NULL)
+	free (multiple->To);
+    if (multiple->Ids != NULL)
+	free (multiple->Ids);
+    if (multiple->Codes != NULL)
+      {
+	  int i;
+	  for (i = 0; i < multiple->Items; i++)
+	    {
+		char *p = *(multiple->Codes + i);
+		if (p != NULL)
+		    free (p);
+	    }
+	  free (multiple->Codes);
+      }
+    free (multiple);
+}
+
+static void
+vroute_add_multiple_code (RoutingMultiDestPtr multiple, char *code)
+{
+/* adding an item to an helper struct for Multiple Destinations (by Code) */
+    *(multiple->Codes + multiple->Next) = code;
+    multiple->Next += 1;
+}
+
+static void
+vroute_add_multiple_id (RoutingMultiDestPtr multiple, int id)
 {
 /* adding an item to an helper struct for Multiple Destinations (by Code) */
     *(multiple->Ids + multiple->Next) = id;
@@ -3143,6 +4345,22 @@ delete_multiSolution (MultiSolutionPtr multiSolution)
 	return;
     if (multiSolution->MultiTo != NULL)
 	vroute_delete_multiple_destinations (multiSolution->MultiTo);
+    if (multiSolution->MultiFrom != NULL)
+	vroute_delete_multiple_destinations (multiSolution->MultiFrom);
+    if (multiSolution->Matrix != NULL)
+	free (multiSolution->Matrix);
+    if (multiSolution->Isochrones != NULL)
+      {
+	  int i;
+	  for (i = 0; i < multiSolution->NumBands; i++)
+	    {
+		if (multiSolution->Isochrones[i] != NULL)
+		    gaiaFreeGeomColl (multiSolution->Isochrones[i]);
+	    }
+	  free (multiSolution->Isochrones);
+      }
+    if (multiSolution->Bands != NULL)
+	free (multiSolution->Bands);
     pS = multiSolution->First;
     while (pS != NULL)
       {
@@ -3203,6 +4421,22 @@ reset_multiSolution (MultiSolutionPtr multiSolution)
 	return;
     if (multiSolution->MultiTo != NULL)
 	vroute_delete_multiple_destinations (multiSolution->MultiTo);
+    if (multiSolution->MultiFrom != NULL)
+	vroute_delete_multiple_destinations (multiSolution->MultiFrom);
+    if (multiSolution->Matrix != NULL)
+	free (multiSolution->Matrix);
+    if (multiSolution->Isochrones != NULL)
+      {
+	  int i;
+	  for (i = 0; i < multiSolution->NumBands; i++)
+	    {
+		if (multiSolution->Isochrones[i] != NULL)
+		    gaiaFreeGeomColl (multiSolution->Isochrones[i]);
+	    }
+	  free (multiSolution->Isochrones);
+      }
+    if (multiSolution->Bands != NULL)
+	free (multiSolution->Bands);
     pS = multiSolution->First;
     while (pS != NULL)
       {
@@ -3221,6 +4455,8 @@ reset_multiSolution (MultiSolutionPtr multiSolution)
     while (pR != NULL)
       {
 	  pRn = pR->Next;
+	  if (pR->Undefined != NULL)
+	      free (pR->Undefined);
 	  free (pR);
 	  pR = pRn;
       }
@@ -3242,6 +4478,11 @@ reset_multiSolution (MultiSolutionPtr multiSolution)
       }
     multiSolution->From = NULL;
     multiSolution->MultiTo = NULL;
+    multiSolution->MultiFrom = NULL;
+    multiSolution->Matrix = NULL;
+    multiSolution->NumBands = 0;
+    multiSolution->Bands = NULL;
+    multiSolution->Isochrones = NULL;
     multiSolution->First = NULL;
     multiSolution->Last = NULL;
     multiSolution->FirstRow = NULL;
@@ -3264,6 +4505,11 @@ alloc_multiSolution (void)
     MultiSolutionPtr p = malloc (sizeof (MultiSolution));
     p->From = NULL;
     p->MultiTo = NULL;
+    p->MultiFrom = NULL;
+    p->Matrix = NULL;
+    p->NumBands = 0;
+    p->Bands = NULL;
+    p->Isochrones = NULL;
     p->First = NULL;
     p->Last = NULL;
     p->FirstRow = NULL;
@@ -3278,6 +4524,7 @@ alloc_multiSolution (void)
     p->FirstGeom = NULL;
     p->LastGeom = NULL;
     p->RouteNum = 0;
+    p->Mode = VROUTE_ROUTING_SOLUTION;
     return p;
 }
 
@@ -3358,11 +4605,15 @@ delete_point2PointSolution (Point2PointSolutionPtr p2pSolution)
 		      free (pR->linkRef);
 		  }
 	    }
+	  if (pR->Undefined != NULL)
+	      free (pR->Undefined);
 	  if (pR->Geometry != NULL)
 	      gaiaFreeGeomColl (pR->Geometry);
 	  free (pR);
 	  pR = pRn;
       }
+    if (p2pSolution->sameLinkPath != NULL)
+	gaiaFreeGeomColl (p2pSolution->sameLinkPath);
     if (p2pSolution->dynLine != NULL)
 	gaiaFreeDynamicLine (p2pSolution->dynLine);
     free (p2pSolution);
@@ -3440,6 +4691,8 @@ reset_point2PointSolution (Point2PointSolutionPtr p2pSolution)
 		      free (pR->linkRef);
 		  }
 	    }
+	  if (pR->Undefined != NULL)
+	      free (pR->Undefined);
 	  if (pR->Geometry != NULL)
 	      gaiaFreeGeomColl (pR->Geometry);
 	  free (pR);
@@ -3452,6 +4705,11 @@ reset_point2PointSolution (Point2PointSolutionPtr p2pSolution)
     p2pSolution->totalCost = DBL_MAX;
     p2pSolution->fromCandidate = NULL;
     p2pSolution->toCandidate = NULL;
+    p2pSolution->sameLink = 0;
+    if (p2pSolution->sameLinkPath != NULL)
+	gaiaFreeGeomColl (p2pSolution->sameLinkPath);
+    p2pSolution->sameLinkPath = NULL;
+    p2pSolution->sameLinkLen = 0.0;
     if (p2pSolution->dynLine != NULL)
 	gaiaFreeDynamicLine (p2pSolution->dynLine);
     p2pSolution->dynLine = NULL;
@@ -3488,6 +4746,9 @@ alloc_point2PointSolution (void)
     p->totalCost = DBL_MAX;
     p->fromCandidate = NULL;
     p->toCandidate = NULL;
+    p->sameLink = 0;
+    p->sameLinkPath = NULL;
+    p->sameLinkLen = 0.0;
     p->dynLine = NULL;
     p->hasZ = 0;
     p->Mode = VROUTE_POINT2POINT_ERROR;
@@ -3543,57 +4804,14 @@ build_range_solution (MultiSolutionPtr multiSolution,
 	free (range_nodes);
 }
 
-static RouteNodePtr
-findSingleTo (RoutingMultiDestPtr multiple)
-{
-/* testing for a single destination */
-    int i;
-    RouteNodePtr to = NULL;
-    int count = 0;
-    for (i = 0; i < multiple->Items; i++)
-      {
-	  RouteNodePtr p_to = *(multiple->To + i);
-	  if (p_to == NULL)
-	      continue;
-	  to = p_to;
-	  count++;
-      }
-    if (count == 1)
-	return to;
-    return NULL;
-}
-
-static void
-astar_solve (sqlite3 * handle, int options, RoutingPtr graph,
-	     RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
-{
-/* computing an A* Shortest Path solution */
-    int cnt;
-    RouteLinkPtr *shortest_path;
-    ShortestPathSolutionPtr solution;
-    RouteNodePtr to = findSingleTo (multiSolution->MultiTo);
-    if (to == NULL)
-	return;
-    shortest_path =
-	astar_shortest_path (routing, graph->Nodes, multiSolution->From,
-			     to, graph->AStarHeuristicCoeff, &cnt);
-    solution = add2multiSolution (multiSolution, multiSolution->From, to);
-    build_solution (handle, options, graph, solution, shortest_path, cnt);
-    build_multi_solution (multiSolution);
-}
-
 static void
-dijkstra_multi_solve (sqlite3 * handle, int options, RoutingPtr graph,
-		      RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
+add_unresolved_to_multiSolution (RoutingPtr graph,
+				 MultiSolutionPtr multiSolution)
 {
-/* computing a Dijkstra Shortest Path multiSolution */
+/* testing if there are undefined or unresolved destinations */
     int i;
     RoutingMultiDestPtr multiple = multiSolution->MultiTo;
     int node_code = graph->NodeCode;
-
-    dijkstra_multi_shortest_path (handle, options, graph, routing,
-				  multiSolution);
-/* testing if there are undefined or unresolved destinations */
     for (i = 0; i < multiple->Items; i++)
       {
 	  ShortestPathSolutionPtr row;
@@ -3648,560 +4866,1103 @@ dijkstra_multi_solve (sqlite3 * handle, int options, RoutingPtr graph,
 		  }
 	    }
       }
-    build_multi_solution (multiSolution);
-}
-
-static void
-dijkstra_within_cost_range (RoutingNodesPtr routing,
-			    MultiSolutionPtr multiSolution, int srid)
-{
-/* computing a Dijkstra "within cost range" solution */
-    int cnt;
-    RoutingNodePtr *range_nodes =
-	dijkstra_range_analysis (routing, multiSolution->From,
-				 multiSolution->MaxCost,
-				 &cnt);
-    build_range_solution (multiSolution, range_nodes, cnt, srid);
 }
 
-static void
-tsp_nn_solve (sqlite3 * handle, int options, RoutingPtr graph,
-	      RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
+static RouteNodePtr
+findSingleTo (RoutingMultiDestPtr multiple)
 {
-/* computing a Dijkstra TSP NN Solution */
+/* testing for a single destination */
     int i;
-    TspTargetsPtr targets = randomize_targets (handle, graph, multiSolution);
-    for (i = 0; i < targets->Count; i++)
+    RouteNodePtr to = NULL;
+    int count = 0;
+    for (i = 0; i < multiple->Items; i++)
       {
-	  /* checking for undefined targets */
-	  if (*(targets->To + i) == NULL)
-	      goto illegal;
+	  RouteNodePtr p_to = *(multiple->To + i);
+	  if (p_to == NULL)
+	      continue;
+	  to = p_to;
+	  count++;
       }
-    dijkstra_tsp_nn (handle, options, graph, routing, targets);
-    build_tsp_solution (multiSolution, targets, graph->Srid);
-    destroy_tsp_targets (targets);
-    return;
-
-  illegal:
-    build_tsp_illegal_solution (multiSolution, targets);
-    destroy_tsp_targets (targets);
+    if (count == 1)
+	return to;
+    return NULL;
 }
 
 static void
-tsp_ga_random_solutions_sql (TspGaPopulationPtr ga)
+astar_solve (sqlite3 * handle, int options, RoutingPtr graph,
+	     RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
 {
-/* building the Solutions randomizing SQL query */
+/* computing an A* Shortest Path solution */
+    int cnt;
+    RouteLinkPtr *shortest_path;
+    ShortestPathSolutionPtr solution;
     int i;
-    char *sql;
-    char *prev_sql;
-
-    for (i = 0; i < ga->Count; i++)
+    RoutingMultiDestPtr multiple = multiSolution->MultiTo;
+    RouteNodePtr to = findSingleTo (multiple);
+    if (to == NULL)
+	return;
+    shortest_path =
+	astar_shortest_path (routing, graph->Nodes, multiSolution->From,
+			     to, graph->AStarHeuristicCoeff, &cnt);
+    if (shortest_path != NULL)
       {
-	  if (i == 0)
-	      sql = sqlite3_mprintf ("SELECT %d, Random() AS rnd\n", i);
-	  else
+	  for (i = 0; i < multiple->Items; i++)
 	    {
-		prev_sql = sql;
-		sql =
-		    sqlite3_mprintf ("%sUNION\nSELECT %d, Random() AS rnd\n",
-				     prev_sql, i);
-		sqlite3_free (prev_sql);
+		if (*(multiple->To + i) == to)
+		    *(multiple->Found + i) = 'Y';
 	    }
+	  solution =
+	      add2multiSolution (multiSolution, multiSolution->From, to);
+	  build_solution (handle, options, graph, solution, shortest_path,
+			  NULL, cnt);
       }
-    prev_sql = sql;
-    sql = sqlite3_mprintf ("%sORDER BY rnd LIMIT 2", prev_sql);
-    sqlite3_free (prev_sql);
-    ga->RandomSolutionsSql = sql;
+    add_unresolved_to_multiSolution (graph, multiSolution);
+    build_multi_solution (multiSolution);
 }
 
 static void
-tsp_ga_random_interval_sql (TspGaPopulationPtr ga)
+pairwise_solve (sqlite3 * handle, int options, int algorithm,
+		RoutingPtr graph, RoutingNodesPtr routing,
+		MultiSolutionPtr multiSolution)
 {
-/* building the Interval randomizing SQL query */
+/* 
+/ computing a Contraction Hierarchies or bidirectional Dijkstra / A*
+/ Shortest Path multiSolution
+*/
     int i;
-    char *sql;
-    char *prev_sql;
+    int cnt;
+    RouteLinkPtr *shortest_path;
+    ShortestPathSolutionPtr solution;
+    RoutingMultiDestPtr multiple = multiSolution->MultiTo;
+    int node_code = graph->NodeCode;
 
-    for (i = 0; i < ga->Cities; i++)
+    for (i = 0; i < multiple->Items; i++)
       {
-	  if (i == 0)
-	      sql = sqlite3_mprintf ("SELECT %d, Random() AS rnd\n", i);
+	  /* resolving each destination by a distinct bidirectional search */
+	  ShortestPathSolutionPtr row;
+	  RouteNodePtr to = *(multiple->To + i);
+	  if (to != NULL)
+	    {
+		if (algorithm == VROUTE_CH_ALGORITHM)
+		    shortest_path =
+			ch_shortest_path (graph, routing->CH,
+					  multiSolution->From, to, &cnt);
+		else
+		  {
+		      if (routing->Bidir == NULL)
+			  routing->Bidir = ch_workspace_alloc (routing->Dim);
+		      shortest_path =
+			  bidir_shortest_path (graph, routing->Bidir,
+					       multiSolution->From, to,
+					       algorithm ==
+					       VROUTE_BIDI_A_STAR_ALGORITHM,
+					       &cnt);
+		  }
+		if (shortest_path != NULL)
+		  {
+		      *(multiple->Found + i) = 'Y';
+		      solution =
+			  add2multiSolution (multiSolution,
+					     multiSolution->From, to);
+		      build_solution (handle, options, graph, solution,
+				      shortest_path, NULL, cnt);
+		      continue;
+		  }
+	    }
+	  /* undefined or unresolved destination */
+	  row = add2multiSolution (multiSolution, multiSolution->From, to);
+	  if (node_code)
+	    {
+		/* Nodes are identified by Codes */
+		const char *code = *(multiple->Codes + i);
+		row->Undefined = malloc (strlen (code) + 1);
+		strcpy (row->Undefined, code);
+	    }
 	  else
 	    {
-		prev_sql = sql;
-		sql =
-		    sqlite3_mprintf ("%sUNION\nSELECT %d, Random() AS rnd\n",
-				     prev_sql, i);
-		sqlite3_free (prev_sql);
+		/* Nodes are identified by Ids */
+		row->Undefined = malloc (4);
+		strcpy (row->Undefined, "???");
+		row->UndefinedId = *(multiple->Ids + i);
 	    }
       }
-    prev_sql = sql;
-    sql = sqlite3_mprintf ("%sORDER BY rnd LIMIT 2", prev_sql);
-    sqlite3_free (prev_sql);
-    ga->RandomIntervalSql = sql;
+    build_multi_solution (multiSolution);
 }
 
-static TspGaDistancePtr
-alloc_tsp_ga_distances (TspTargetsPtr targets)
+/*
+/
+/  implementation of the many-to-many Cost Matrix
+/
+/ when Contraction Hierarchies are available the bucket based
+/ algorithm is used: an upward backward search is performed from
+/ each destination, and each Node it reaches receives a bucket
+/ entry (destination, cost); then an upward forward search is
+/ performed from each origin, scanning the buckets of all the
+/ Nodes it reaches.
+/ otherwise a one-to-many Dijkstra search is performed from each
+/ origin, stopping as soon as all destinations have been reached.
+/
+/ the searches are spread across a pool of worker threads; each
+/ worker owns a private workspace, while the NETWORK is shared
+/
+*/
+
+static void
+matrix_touch (MatrixWorkerPtr worker, int node)
 {
-/* allocating a TSP GA distances struct */
-    int i;
-    TspGaDistancePtr dist = malloc (sizeof (TspGaDistance));
-    dist->Cities = targets->Count;
-    dist->CityFrom = targets->From;
-    dist->Distances = malloc (sizeof (TspGaSubDistancePtr) * dist->Cities);
-    for (i = 0; i < dist->Cities; i++)
-      {
-	  TspGaSubDistancePtr sub = malloc (sizeof (TspGaSubDistance));
-	  double cost = *(targets->Costs + i);
-	  sub->CityTo = *(targets->To + i);
-	  sub->Cost = cost;
-	  *(dist->Distances + i) = sub;
-      }
-    dist->NearestIndex = -1;
-    return dist;
+/* registering a Node touched by the current search */
+    if (worker->Dist[node] == DBL_MAX)
+	worker->Touched[worker->NumTouched++] = node;
 }
 
 static void
-destroy_tsp_ga_distances (TspGaDistancePtr dist)
+matrix_reset (MatrixWorkerPtr worker)
 {
-/* freeing a TSP GA distance struct */
-    if (dist == NULL)
-	return;
-    if (dist->Distances != NULL)
-      {
-	  int i;
-	  for (i = 0; i < dist->Cities; i++)
-	    {
-		TspGaSubDistancePtr sub = *(dist->Distances + i);
-		if (sub != NULL)
-		    free (sub);
-	    }
-	  free (dist->Distances);
-      }
-    free (dist);
+/* resetting the worker's workspace */
+    int i;
+    for (i = 0; i < worker->NumTouched; i++)
+	worker->Dist[worker->Touched[i]] = DBL_MAX;
+    worker->NumTouched = 0;
+    worker->Heap.Count = 0;
 }
 
-static TspGaPopulationPtr
-build_tsp_ga_population (int count)
+static void
+matrix_upward_search (MatrixWorkerPtr worker, int origin, int backward)
 {
-/* creating a TSP GA Population */
+/* 
+/ exhaustive CH upward search: forward from an origin, or
+/ backward from a destination
+*/
+    RouteCHPtr ch = worker->Job->Graph->CH;
+    int *first = backward ? ch->DownFirst : ch->UpFirst;
+    int *arcs = backward ? ch->DownArcs : ch->UpArcs;
     int i;
-    TspGaPopulationPtr ga = malloc (sizeof (TspGaPopulation));
-    ga->Count = count;
-    ga->Cities = count;
-    ga->Solutions = malloc (sizeof (TspGaSolutionPtr) * count);
-    ga->Offsprings = malloc (sizeof (TspGaSolutionPtr) * count);
-    for (i = 0; i < count; i++)
-      {
-	  *(ga->Offsprings + i) = NULL;
-	  *(ga->Solutions + i) = NULL;
+    matrix_touch (worker, origin);
+    worker->Dist[origin] = 0.0;
+    ch_heap_push (&(worker->Heap), origin, 0.0);
+    while (worker->Heap.Count > 0)
+      {
+	  RouteCHHeapItem item = ch_heap_pop (&(worker->Heap));
+	  if (item.Key > worker->Dist[item.Node])
+	      continue;		/* stale item */
+	  for (i = first[item.Node]; i < first[item.Node + 1]; i++)
+	    {
+		RouteCHArcPtr arc = ch->Arcs + arcs[i];
+		int next = backward ? arc->NodeFrom : arc->NodeTo;
+		double dist = item.Key + arc->Cost;
+		if (dist < worker->Dist[next])
+		  {
+		      matrix_touch (worker, next);
+		      worker->Dist[next] = dist;
+		      ch_heap_push (&(worker->Heap), next, dist);
+		  }
+	    }
       }
-    ga->Distances = malloc (sizeof (TspGaDistancePtr) * count);
-    for (i = 0; i < count; i++)
-	*(ga->Distances + i) = NULL;
-    ga->RandomSolutionsSql = NULL;
-    tsp_ga_random_solutions_sql (ga);
-    ga->RandomIntervalSql = NULL;
-    tsp_ga_random_interval_sql (ga);
-    return ga;
 }
 
 static void
-destroy_tsp_ga_solution (TspGaSolutionPtr solution)
+matrix_add_bucket_item (MatrixWorkerPtr worker, int node, int target,
+			double cost)
 {
-/* memory cleanup: destroyng a GA Solution */
-    if (solution == NULL)
-	return;
-    if (solution->CitiesFrom != NULL)
-	free (solution->CitiesFrom);
-    if (solution->CitiesTo != NULL)
-	free (solution->CitiesTo);
-    if (solution->Costs != NULL)
-	free (solution->Costs);
-    free (solution);
+/* adding a bucket entry */
+    MatrixBucketItemPtr item;
+    if (worker->NumItems == worker->MaxItems)
+      {
+	  worker->MaxItems =
+	      (worker->MaxItems == 0) ? 4096 : worker->MaxItems * 2;
+	  worker->Items =
+	      realloc (worker->Items,
+		       sizeof (MatrixBucketItem) * worker->MaxItems);
+      }
+    item = worker->Items + worker->NumItems++;
+    item->Node = node;
+    item->Target = target;
+    item->Cost = cost;
 }
 
 static void
-free_tsp_ga_offsprings (TspGaPopulationPtr ga)
-{
-/* memory cleanup; freeing GA Offsprings */
+matrix_dijkstra (MatrixWorkerPtr worker, int index)
+{
+/* one-to-many Dijkstra search from a single origin */
+    MatrixJobPtr job = worker->Job;
+    RoutingPtr graph = job->Graph;
+    double *row = job->Matrix + ((size_t) index * job->NumTo);
+    int remaining = job->NumTargets;
+    int origin = job->From[index];
     int i;
-    if (ga == NULL)
-	return;
-
-    for (i = 0; i < ga->Count; i++)
-      {
-	  if (*(ga->Offsprings + i) != NULL)
-	      destroy_tsp_ga_solution (*(ga->Offsprings + i));
-	  *(ga->Offsprings + i) = NULL;
+    matrix_touch (worker, origin);
+    worker->Dist[origin] = 0.0;
+    ch_heap_push (&(worker->Heap), origin, 0.0);
+    while (worker->Heap.Count > 0 && remaining > 0)
+      {
+	  RouteCHHeapItem item = ch_heap_pop (&(worker->Heap));
+	  if (item.Key > worker->Dist[item.Node])
+	      continue;		/* stale item */
+	  if (job->TargetFirst[item.Node] >= 0)
+	    {
+		/* reached a destination */
+		for (i = job->TargetFirst[item.Node]; i >= 0;
+		     i = job->TargetNext[i])
+		    row[i] = item.Key;
+		remaining--;
+	    }
+	  for (i = graph->LinkFirst[item.Node];
+	       i < graph->LinkFirst[item.Node + 1]; i++)
+	    {
+		int next = graph->LinkTarget[i];
+		double dist = item.Key + graph->LinkCost[i];
+		if (dist < worker->Dist[next])
+		  {
+		      matrix_touch (worker, next);
+		      worker->Dist[next] = dist;
+		      ch_heap_push (&(worker->Heap), next, dist);
+		  }
+	    }
       }
+    matrix_reset (worker);
 }
 
 static void
-destroy_tsp_ga_population (TspGaPopulationPtr ga)
+matrix_worker_run (MatrixWorkerPtr worker)
 {
-/* memory cleanup; destroyng a GA Population */
+/* processing all items assigned to some worker */
+    MatrixJobPtr job = worker->Job;
     int i;
-    if (ga == NULL)
-	return;
-
-    for (i = 0; i < ga->Count; i++)
-	destroy_tsp_ga_solution (*(ga->Solutions + i));
-    free (ga->Solutions);
-    free_tsp_ga_offsprings (ga);
-    free (ga->Offsprings);
-    if (ga->Distances != NULL)
+    int k;
+    int b;
+    if (job->Phase == VROUTE_MATRIX_CH_BUCKETS)
       {
-	  for (i = 0; i < ga->Cities; i++)
+	  /* CH: building the buckets */
+	  for (i = worker->Index; i < job->NumTo; i += job->NumThreads)
 	    {
-		TspGaDistancePtr dist = *(ga->Distances + i);
-		if (dist != NULL)
-		    destroy_tsp_ga_distances (dist);
+		if (job->To[i] < 0)
+		    continue;
+		matrix_upward_search (worker, job->To[i], 1);
+		for (k = 0; k < worker->NumTouched; k++)
+		  {
+		      int node = worker->Touched[k];
+		      matrix_add_bucket_item (worker, node, i,
+					      worker->Dist[node]);
+		  }
+		matrix_reset (worker);
+	    }
+      }
+    else if (job->Phase == VROUTE_MATRIX_CH_SCAN)
+      {
+	  /* CH: scanning the buckets */
+	  for (i = worker->Index; i < job->NumFrom; i += job->NumThreads)
+	    {
+		double *row;
+		if (job->From[i] < 0)
+		    continue;
+		row = job->Matrix + ((size_t) i * job->NumTo);
+		matrix_upward_search (worker, job->From[i], 0);
+		for (k = 0; k < worker->NumTouched; k++)
+		  {
+		      int node = worker->Touched[k];
+		      double dist = worker->Dist[node];
+		      for (b = job->BucketFirst[node];
+			   b < job->BucketFirst[node + 1]; b++)
+			{
+			    const MatrixBucketItem *item = job->Buckets + b;
+			    if (dist + item->Cost < row[item->Target])
+				row[item->Target] = dist + item->Cost;
+			}
+		  }
+		matrix_reset (worker);
+	    }
+      }
+    else
+      {
+	  /* plain Dijkstra */
+	  for (i = worker->Index; i < job->NumFrom; i += job->NumThreads)
+	    {
+		if (job->From[i] < 0)
+		    continue;
+		matrix_dijkstra (worker, i);
 	    }
       }
-    free (ga->Distances);
-    if (ga->RandomSolutionsSql != NULL)
-	sqlite3_free (ga->RandomSolutionsSql);
-    if (ga->RandomIntervalSql != NULL)
-	sqlite3_free (ga->RandomIntervalSql);
-    free (ga);
-}
-
-static int
-cmp_dist_from (const void *p1, const void *p2)
-{
-/* compares FROM distances [for BSEARCH] */
-    TspGaDistancePtr pD1 = (TspGaDistancePtr) p1;
-    TspGaDistancePtr pD2 = *((TspGaDistancePtr *) p2);
-    RouteNodePtr pN1 = pD1->CityFrom;
-    RouteNodePtr pN2 = pD2->CityFrom;
-    if (pN1 == pN2)
-	return 0;
-    if (pN1 > pN2)
-	return 1;
-    return -1;
-}
-
-static TspGaDistancePtr
-tsp_ga_find_from_distance (TspGaPopulationPtr ga, RouteNodePtr from)
-{
-/* searching the main FROM distance */
-    TspGaDistancePtr *ret;
-    TspGaDistance dist;
-    dist.CityFrom = from;
-    ret =
-	bsearch (&dist, ga->Distances, ga->Cities, sizeof (TspGaDistancePtr),
-		 cmp_dist_from);
-    if (ret == NULL)
-	return NULL;
-    return *ret;
-}
-
-static int
-cmp_dist_to (const void *p1, const void *p2)
-{
-/* compares TO distances [for BSEARCH] */
-    TspGaSubDistancePtr pD1 = (TspGaSubDistancePtr) p1;
-    TspGaSubDistancePtr pD2 = *((TspGaSubDistancePtr *) p2);
-    RouteNodePtr pN1 = pD1->CityTo;
-    RouteNodePtr pN2 = pD2->CityTo;
-    if (pN1 == pN2)
-	return 0;
-    if (pN1 > pN2)
-	return 1;
-    return -1;
-}
-
-static TspGaSubDistancePtr
-tsp_ga_find_to_distance (TspGaDistancePtr dist, RouteNodePtr to)
-{
-/* searching the main FROM distance */
-    TspGaSubDistancePtr *ret;
-    TspGaSubDistance sub;
-    sub.CityTo = to;
-    ret =
-	bsearch (&sub, dist->Distances, dist->Cities,
-		 sizeof (TspGaSubDistancePtr), cmp_dist_to);
-    if (ret == NULL)
-	return NULL;
-    return *ret;
 }
 
-static double
-tsp_ga_find_distance (TspGaPopulationPtr ga, RouteNodePtr from, RouteNodePtr to)
+#if defined(_WIN32) && !defined(__MINGW32__)
+static DWORD WINAPI
+matrix_worker_main (void *arg)
+#else
+static void *
+matrix_worker_main (void *arg)
+#endif
 {
-/* searching a cached distance */
-    TspGaSubDistancePtr sub;
-    TspGaDistancePtr dist = tsp_ga_find_from_distance (ga, from);
-    if (dist == NULL)
-	return DBL_MAX;
-
-    sub = tsp_ga_find_to_distance (dist, to);
-    if (sub != NULL)
-	return sub->Cost;
-    return DBL_MAX;
+/* the Cost Matrix worker thread */
+    matrix_worker_run ((MatrixWorkerPtr) arg);
+#if defined(_WIN32) && !defined(__MINGW32__)
+    return 0;
+#else
+    return NULL;
+#endif
 }
 
 static void
-tsp_ga_random_solutions (sqlite3 * handle, TspGaPopulationPtr ga, int *index1,
-			 int *index2)
+matrix_run_phase (MatrixJobPtr job, MatrixWorkerPtr workers, int phase,
+		  int items)
 {
-/* fetching two random TSP GA solutions */
+/* running a Cost Matrix phase on the worker threads */
     int i;
-    int ret;
-    int n_rows;
-    int n_columns;
-    const char *value = NULL;
-    char **results;
-
-    *index1 = -1;
-    *index2 = -1;
-
-    ret =
-	sqlite3_get_table (handle, ga->RandomSolutionsSql, &results, &n_rows,
-			   &n_columns, NULL);
-    if (ret != SQLITE_OK)
-	return;
-    if (n_rows >= 1)
+    int n_threads = job->NumThreads;
+    char *started;
+    job->Phase = phase;
+    for (i = 0; i < n_threads; i++)
+	workers[i].Job = job;
+    started = malloc (n_threads);
+    for (i = 1; i < n_threads; i++)
+      {
+	  MatrixWorkerPtr worker = workers + i;
+	  started[i] = 0;
+	  if (i >= items)
+	      continue;
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  worker->Thread =
+	      CreateThread (NULL, 0, matrix_worker_main, worker, 0, NULL);
+	  if (worker->Thread != NULL)
+	      started[i] = 1;
+#else
+	  if (pthread_create (&(worker->Thread), NULL, matrix_worker_main,
+			      worker) == 0)
+	      started[i] = 1;
+#endif
+      }
+/* the calling thread acts as the first worker */
+    matrix_worker_run (workers);
+    for (i = 1; i < n_threads; i++)
       {
-	  for (i = 1; i <= n_rows; i++)
+	  MatrixWorkerPtr worker = workers + i;
+	  if (i >= items)
+	      continue;
+	  if (!started[i])
 	    {
-		value = results[(i * n_columns) + 0];
-		if (i == 1)
-		    *index1 = atoi (value);
-		else
-		    *index2 = atoi (value);
+		/* unable to start a thread: running inline */
+		matrix_worker_run (worker);
+		continue;
 	    }
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  WaitForSingleObject (worker->Thread, INFINITE);
+	  CloseHandle (worker->Thread);
+#else
+	  pthread_join (worker->Thread, NULL);
+#endif
       }
-    sqlite3_free_table (results);
+    free (started);
 }
 
-static void
-tsp_ga_random_interval (sqlite3 * handle, TspGaPopulationPtr ga, int *index1,
-			int *index2)
+static int *
+matrix_node_indices (RoutingMultiDestPtr multiple)
 {
-/* fetching a random TSP GA interval */
+/* returning the Node index of each item; -1 if undefined */
     int i;
-    int ret;
-    int n_rows;
-    int n_columns;
-    const char *value = NULL;
-    char **results;
+    int *indices = malloc (sizeof (int) * multiple->Items);
+    for (i = 0; i < multiple->Items; i++)
+      {
+	  RouteNodePtr node = *(multiple->To + i);
+	  indices[i] = (node == NULL) ? -1 : node->InternalIndex;
+      }
+    return indices;
+}
+
+static void
+matrix_compute (RoutingPtr graph, int algorithm, const int *from, int n_from,
+		const int *to, int n_to, double *matrix)
+{
+/* 
+/ computing a many-to-many Cost Matrix between Node indices
+/ (-1 if undefined); unreachable pairs are set to DBL_MAX
+*/
+    MatrixJob job;
+    MatrixWorkerPtr workers;
+    int *target_first = NULL;
+    int *target_next = NULL;
+    int *bucket_first = NULL;
+    MatrixBucketItemPtr buckets = NULL;
+    int n_threads;
+    int items;
+    int i;
+    int k;
+    size_t cell;
+    size_t cells = (size_t) n_from * n_to;
+    for (cell = 0; cell < cells; cell++)
+	matrix[cell] = DBL_MAX;
+
+/* setting up the worker threads */
+    n_threads = splite_count_processors ();
+    if (n_threads > VROUTE_MATRIX_MAX_THREADS)
+	n_threads = VROUTE_MATRIX_MAX_THREADS;
+    items = (n_from > n_to) ? n_from : n_to;
+    if (n_threads > items)
+	n_threads = items;
+    if (n_threads < 1)
+	n_threads = 1;
+    workers = malloc (sizeof (MatrixWorker) * n_threads);
+    for (i = 0; i < n_threads; i++)
+      {
+	  MatrixWorkerPtr worker = workers + i;
+	  worker->Index = i;
+	  worker->Dist = malloc (sizeof (double) * graph->NumNodes);
+	  for (k = 0; k < graph->NumNodes; k++)
+	      worker->Dist[k] = DBL_MAX;
+	  worker->Touched = malloc (sizeof (int) * graph->NumNodes);
+	  worker->NumTouched = 0;
+	  worker->Heap.Items = NULL;
+	  worker->Heap.Count = 0;
+	  worker->Heap.Max = 0;
+	  worker->Items = NULL;
+	  worker->NumItems = 0;
+	  worker->MaxItems = 0;
+      }
+    job.Graph = graph;
+    job.NumFrom = n_from;
+    job.NumTo = n_to;
+    job.From = from;
+    job.To = to;
+    job.TargetFirst = NULL;
+    job.TargetNext = NULL;
+    job.NumTargets = 0;
+    job.BucketFirst = NULL;
+    job.Buckets = NULL;
+    job.Matrix = matrix;
+    job.NumThreads = n_threads;
+
+    if (algorithm == VROUTE_CH_ALGORITHM && graph->CH != NULL)
+      {
+	  /* Contraction Hierarchies: bucket based algorithm */
+	  int total = 0;
+	  matrix_run_phase (&job, workers, VROUTE_MATRIX_CH_BUCKETS, n_to);
+	  /* sorting all bucket entries by Node */
+	  bucket_first = calloc (graph->NumNodes + 1, sizeof (int));
+	  for (i = 0; i < n_threads; i++)
+	    {
+		for (k = 0; k < workers[i].NumItems; k++)
+		    bucket_first[workers[i].Items[k].Node + 1] += 1;
+		total += workers[i].NumItems;
+	    }
+	  for (k = 0; k < graph->NumNodes; k++)
+	      bucket_first[k + 1] += bucket_first[k];
+	  buckets = malloc (sizeof (MatrixBucketItem) * (total + 1));
+	  for (i = 0; i < n_threads; i++)
+	    {
+		for (k = 0; k < workers[i].NumItems; k++)
+		  {
+		      MatrixBucketItemPtr item = workers[i].Items + k;
+		      buckets[bucket_first[item->Node]++] = *item;
+		  }
+		free (workers[i].Items);
+		workers[i].Items = NULL;
+	    }
+	  for (k = graph->NumNodes; k > 0; k--)
+	      bucket_first[k] = bucket_first[k - 1];
+	  bucket_first[0] = 0;
+	  job.BucketFirst = bucket_first;
+	  job.Buckets = buckets;
+	  matrix_run_phase (&job, workers, VROUTE_MATRIX_CH_SCAN, n_from);
+      }
+    else
+      {
+	  /* plain Dijkstra: marking the destination Nodes */
+	  target_first = malloc (sizeof (int) * graph->NumNodes);
+	  for (k = 0; k < graph->NumNodes; k++)
+	      target_first[k] = -1;
+	  target_next = malloc (sizeof (int) * n_to);
+	  for (i = n_to - 1; i >= 0; i--)
+	    {
+		target_next[i] = -1;
+		if (to[i] < 0)
+		    continue;
+		if (target_first[to[i]] < 0)
+		    job.NumTargets += 1;
+		target_next[i] = target_first[to[i]];
+		target_first[to[i]] = i;
+	    }
+	  job.TargetFirst = target_first;
+	  job.TargetNext = target_next;
+	  matrix_run_phase (&job, workers, VROUTE_MATRIX_DIJKSTRA, n_from);
+      }
+
+    for (i = 0; i < n_threads; i++)
+      {
+	  free (workers[i].Dist);
+	  free (workers[i].Touched);
+	  if (workers[i].Heap.Items)
+	      free (workers[i].Heap.Items);
+	  if (workers[i].Items)
+	      free (workers[i].Items);
+      }
+    free (workers);
+    if (target_first)
+	free (target_first);
+    if (target_next)
+	free (target_next);
+    if (bucket_first)
+	free (bucket_first);
+    if (buckets)
+	free (buckets);
+}
 
-    *index1 = -1;
-    *index2 = -1;
+static void
+matrix_solve (RoutingPtr graph, int algorithm, MultiSolutionPtr multiSolution)
+{
+/* computing a Cost Matrix request */
+    int n_from = multiSolution->MultiFrom->Items;
+    int n_to = multiSolution->MultiTo->Items;
+    int *from = matrix_node_indices (multiSolution->MultiFrom);
+    int *to = matrix_node_indices (multiSolution->MultiTo);
+    multiSolution->Matrix = malloc (sizeof (double) * n_from * n_to);
+    matrix_compute (graph, algorithm, from, n_from, to, n_to,
+		    multiSolution->Matrix);
+    free (from);
+    free (to);
+}
 
-    ret =
-	sqlite3_get_table (handle, ga->RandomIntervalSql, &results, &n_rows,
-			   &n_columns, NULL);
-    if (ret != SQLITE_OK)
+static void
+dijkstra_multi_solve (sqlite3 * handle, int options, RoutingPtr graph,
+		      RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
+{
+/* computing a Dijkstra Shortest Path multiSolution */
+    dijkstra_multi_shortest_path (handle, options, graph, routing,
+				  multiSolution);
+    add_unresolved_to_multiSolution (graph, multiSolution);
+    build_multi_solution (multiSolution);
+}
+
+static void
+td_solve (sqlite3 * handle, int options, int algorithm, double departure,
+	  RoutingPtr graph, RoutingNodesPtr routing,
+	  MultiSolutionPtr multiSolution)
+{
+/* computing a time-dependent and turn aware Shortest Path multiSolution */
+    RouteNodePtr target = NULL;
+    if (algorithm == VROUTE_A_STAR_ALGORITHM)
+	target = findSingleTo (multiSolution->MultiTo);
+    td_multi_shortest_path (handle, options, graph, routing, multiSolution,
+			    target, departure);
+    add_unresolved_to_multiSolution (graph, multiSolution);
+    build_multi_solution (multiSolution);
+}
+
+static void
+dijkstra_within_cost_range (RoutingNodesPtr routing,
+			    MultiSolutionPtr multiSolution, int srid)
+{
+/* computing a Dijkstra "within cost range" solution */
+    int cnt;
+    RoutingNodePtr *range_nodes =
+	dijkstra_range_analysis (routing, multiSolution->From,
+				 multiSolution->MaxCost,
+				 &cnt);
+    build_range_solution (multiSolution, range_nodes, cnt, srid);
+}
+
+static void
+isochrone_add_point (double **coords, int **bands, int *count, int *max,
+		     double x, double y, int band)
+{
+/* adding a Point to the Isochrones cloud */
+    if (*count >= *max)
+      {
+	  *max = (*max == 0) ? 1024 : *max * 2;
+	  *coords = realloc (*coords, sizeof (double) * 2 * *max);
+	  *bands = realloc (*bands, sizeof (int) * *max);
+      }
+    (*coords)[*count * 2] = x;
+    (*coords)[(*count * 2) + 1] = y;
+    (*bands)[*count] = band;
+    *count += 1;
+}
+
+static void
+isochrone_add_node (RoutingNodesPtr e, MultiSolutionPtr multiSolution,
+		    RoutingNodePtr n, double **coords, int **bands,
+		    int *count, int *max)
+{
+/* 
+/ adding a reached Node to the Isochrones cloud, followed by
+/ the points interpolated along its partially reached Links
+*/
+    int i;
+    int k;
+    int band;
+    RouteNodePtr from = n->Node;
+    for (band = 0; band < multiSolution->NumBands; band++)
+      {
+	  /* identifying the smallest band including this Node */
+	  if (n->Distance <= multiSolution->Bands[band])
+	      break;
+      }
+    if (band >= multiSolution->NumBands)
 	return;
-    if (n_rows >= 1)
+    isochrone_add_point (coords, bands, count, max, from->CoordX,
+			 from->CoordY, band);
+    for (i = e->LinkFirst[n->Id]; i < e->LinkFirst[n->Id + 1]; i++)
       {
-	  for (i = 1; i <= n_rows; i++)
+	  /* iterating the outcoming Links (CSR layout) */
+	  double cost = e->LinkCost[i];
+	  RouteNodePtr to = e->Nodes[e->LinkTarget[i]].Node;
+	  for (k = band; k < multiSolution->NumBands; k++)
 	    {
-		value = results[(i * n_columns) + 0];
-		if (i == 1)
-		    *index1 = atoi (value);
+		/* interpolating the band limit along the Link */
+		double ratio;
+		if (n->Distance + cost <= multiSolution->Bands[k])
+		    break;	/* fully reached: its end Node is in range */
+		ratio = (multiSolution->Bands[k] - n->Distance) / cost;
+		isochrone_add_point (coords, bands, count, max,
+				     from->CoordX +
+				     ((to->CoordX - from->CoordX) * ratio),
+				     from->CoordY +
+				     ((to->CoordY - from->CoordY) * ratio), k);
+	    }
+      }
+}
+
+static void
+dijkstra_isochrones (const void *p_cache, RoutingNodesPtr routing,
+		     MultiSolutionPtr multiSolution, int srid)
+{
+/* 
+/ computing the Isochrones for all Cost bands by a single
+/ Dijkstra "within cost range" search
+*/
+    int cnt;
+    int i;
+    int k;
+    int n_points = 0;
+    int max_points = 0;
+    double *coords = NULL;
+    int *bands = NULL;
+#ifndef OMIT_GEOS		/* GEOS is supported */
+    gaiaGeomCollPtr hull;
+    gaiaGeomCollPtr prev;
+#endif /* end GEOS conditional */
+    RoutingNodePtr *range_nodes =
+	dijkstra_range_analysis (routing, multiSolution->From,
+				 multiSolution->MaxCost,
+				 &cnt);
+    if (p_cache)
+	p_cache = p_cache;	/* unused arg warning suppression */
+    multiSolution->Isochrones =
+	malloc (sizeof (gaiaGeomCollPtr) * multiSolution->NumBands);
+    for (k = 0; k < multiSolution->NumBands; k++)
+	multiSolution->Isochrones[k] = NULL;
+    if (srid == VROUTE_INVALID_SRID)
+      {
+	  /* no Geometry: the Nodes have no coordinates */
+	  if (range_nodes)
+	      free (range_nodes);
+	  return;
+      }
+
+/* collecting the reached Nodes and the interpolated Points */
+    isochrone_add_node (routing, multiSolution,
+			routing->Nodes + multiSolution->From->InternalIndex,
+			&coords, &bands, &n_points, &max_points);
+    for (i = 0; i < cnt; i++)
+	isochrone_add_node (routing, multiSolution, range_nodes[i], &coords,
+			    &bands, &n_points, &max_points);
+    if (range_nodes)
+	free (range_nodes);
+
+    for (k = 0; k < multiSolution->NumBands; k++)
+      {
+	  /* building the Isochrone of each band */
+	  gaiaGeomCollPtr geom = gaiaAllocGeomColl ();
+	  geom->Srid = srid;
+	  geom->DeclaredType = GAIA_MULTIPOINT;
+	  for (i = 0; i < n_points; i++)
+	    {
+		if (bands[i] <= k)
+		    gaiaAddPointToGeomColl (geom, coords[i * 2],
+					    coords[(i * 2) + 1]);
+	    }
+#ifndef OMIT_GEOS		/* GEOS is supported */
+	  /* replacing the cloud of Points by its Concave (or Convex) Hull */
+	  hull = NULL;
+#ifdef GEOS_ADVANCED		/* GEOS advanced features */
+	  if (p_cache != NULL)
+	      hull =
+		  gaiaConcaveHull_r (p_cache, geom, VROUTE_ISOCHRONE_FACTOR,
+				     0.0, 0);
+	  else
+	      hull = gaiaConcaveHull (geom, VROUTE_ISOCHRONE_FACTOR, 0.0, 0);
+#endif /* end GEOS advanced features */
+	  if (hull == NULL)
+	    {
+		if (p_cache != NULL)
+		    hull = gaiaConvexHull_r (p_cache, geom);
 		else
-		    *index2 = atoi (value);
+		    hull = gaiaConvexHull (geom);
+	    }
+	  if (hull != NULL)
+	    {
+		gaiaFreeGeomColl (geom);
+		geom = hull;
+		prev = (k > 0) ? multiSolution->Isochrones[k - 1] : NULL;
+		if (prev != NULL && prev->FirstPolygon != NULL
+		    && geom->FirstPolygon != NULL)
+		  {
+		      /* Concave Hulls don't always nest: merging the previous band */
+		      gaiaGeomCollPtr merged;
+		      if (p_cache != NULL)
+			  merged = gaiaGeometryUnion_r (p_cache, prev, geom);
+		      else
+			  merged = gaiaGeometryUnion (prev, geom);
+		      if (merged != NULL)
+			{
+			    gaiaFreeGeomColl (geom);
+			    geom = merged;
+			}
+		  }
+		geom->Srid = srid;
 	    }
+#endif /* end GEOS conditional */
+	  multiSolution->Isochrones[k] = geom;
       }
-    sqlite3_free_table (results);
+    if (coords)
+	free (coords);
+    if (bands)
+	free (bands);
+}
+
+static void
+tsp_nn_solve (sqlite3 * handle, int options, RoutingPtr graph,
+	      RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
+{
+/* computing a Dijkstra TSP NN Solution */
+    int i;
+    TspTargetsPtr targets = randomize_targets (handle, graph, multiSolution);
+    for (i = 0; i < targets->Count; i++)
+      {
+	  /* checking for undefined targets */
+	  if (*(targets->To + i) == NULL)
+	      goto illegal;
+      }
+    dijkstra_tsp_nn (handle, options, graph, routing, targets);
+    build_tsp_solution (multiSolution, targets, graph->Srid);
+    destroy_tsp_targets (targets);
+    return;
+
+  illegal:
+    build_tsp_illegal_solution (multiSolution, targets);
+    destroy_tsp_targets (targets);
+}
+
+static int
+tsp_ga_random (TspGaWorkerPtr worker, int range)
+{
+/* returning a pseudo-random number in the 0 - (range - 1) interval */
+    sqlite3_uint64 x = worker->Random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    worker->Random = x;
+    x *= 0x2545F4914F6CDD1DULL;
+    return (int) ((x >> 33) % (sqlite3_uint64) range);
+}
+
+static void
+tsp_ga_random_pair (TspGaWorkerPtr worker, int range, int *index1,
+		    int *index2)
+{
+/* fetching two distinct random indices in the 0 - (range - 1) interval */
+    *index1 = tsp_ga_random (worker, range);
+    *index2 = tsp_ga_random (worker, range - 1);
+    if (*index2 >= *index1)
+	*index2 += 1;
+}
+
+static TspGaPopulationPtr
+build_tsp_ga_population (int count)
+{
+/* creating a TSP GA Population */
+    int i;
+    TspGaPopulationPtr ga = malloc (sizeof (TspGaPopulation));
+    ga->Count = count;
+    ga->Cities = count;
+    ga->Solutions = malloc (sizeof (TspGaSolutionPtr) * count);
+    ga->Offsprings = malloc (sizeof (TspGaSolutionPtr) * count);
+    for (i = 0; i < count; i++)
+      {
+	  *(ga->Offsprings + i) = NULL;
+	  *(ga->Solutions + i) = NULL;
+      }
+    ga->CityNodes = malloc (sizeof (RouteNodePtr) * count);
+    ga->Distances = malloc (sizeof (double) * count * count);
+    ga->Generation = 0;
+    return ga;
+}
+
+static TspGaSolutionPtr
+alloc_tsp_ga_solution (int cities)
+{
+/* allocating an empty TSP GA solution */
+    TspGaSolutionPtr solution = malloc (sizeof (TspGaSolution));
+    solution->Cities = cities;
+    solution->CitiesFrom = malloc (sizeof (int) * cities);
+    solution->CitiesTo = malloc (sizeof (int) * cities);
+    solution->Costs = malloc (sizeof (double) * cities);
+    solution->TotalCost = 0.0;
+    return solution;
+}
+
+static void
+destroy_tsp_ga_solution (TspGaSolutionPtr solution)
+{
+/* memory cleanup: destroyng a GA Solution */
+    if (solution == NULL)
+	return;
+    if (solution->CitiesFrom != NULL)
+	free (solution->CitiesFrom);
+    if (solution->CitiesTo != NULL)
+	free (solution->CitiesTo);
+    if (solution->Costs != NULL)
+	free (solution->Costs);
+    free (solution);
+}
+
+static void
+free_tsp_ga_offsprings (TspGaPopulationPtr ga)
+{
+/* memory cleanup; freeing GA Offsprings */
+    int i;
+    if (ga == NULL)
+	return;
+
+    for (i = 0; i < ga->Count; i++)
+      {
+	  if (*(ga->Offsprings + i) != NULL)
+	      destroy_tsp_ga_solution (*(ga->Offsprings + i));
+	  *(ga->Offsprings + i) = NULL;
+      }
+}
+
+static void
+destroy_tsp_ga_population (TspGaPopulationPtr ga)
+{
+/* memory cleanup; destroyng a GA Population */
+    int i;
+    if (ga == NULL)
+	return;
+
+    for (i = 0; i < ga->Count; i++)
+	destroy_tsp_ga_solution (*(ga->Solutions + i));
+    free (ga->Solutions);
+    free_tsp_ga_offsprings (ga);
+    free (ga->Offsprings);
+    free (ga->CityNodes);
+    free (ga->Distances);
+    free (ga);
 }
 
 static void
-tps_ga_chromosome_update (TspGaSolutionPtr chromosome, RouteNodePtr from,
-			  RouteNodePtr to, double cost)
+tsp_ga_adjust_solution (TspGaPopulationPtr ga, TspGaSolutionPtr solution)
 {
-/* updating a chromosome (missing distance) */
+/* adjusting From/To and Costs after the CitiesFrom sequence changed */
     int j;
-    for (j = 0; j < chromosome->Cities; j++)
+    for (j = 1; j < solution->Cities; j++)
+	*(solution->CitiesTo + j - 1) = *(solution->CitiesFrom + j);
+    *(solution->CitiesTo + solution->Cities - 1) = *(solution->CitiesFrom + 0);
+    solution->TotalCost = 0.0;
+    for (j = 0; j < solution->Cities; j++)
       {
-	  RouteNodePtr n1 = *(chromosome->CitiesFrom + j);
-	  RouteNodePtr n2 = *(chromosome->CitiesTo + j);
-	  if (n1 == from && n2 == to)
-	      *(chromosome->Costs + j) = cost;
+	  int from = *(solution->CitiesFrom + j);
+	  int to = *(solution->CitiesTo + j);
+	  double cost = *(ga->Distances + (from * ga->Cities) + to);
+	  *(solution->Costs + j) = cost;
+	  solution->TotalCost += cost;
       }
 }
 
 static void
-tsp_ga_random_mutation (sqlite3 * handle, TspGaPopulationPtr ga,
-			TspGaSolutionPtr mutant)
+tsp_ga_random_mutation (TspGaWorkerPtr worker, TspGaSolutionPtr mutant)
 {
 /* introducing a random mutation */
-    RouteNodePtr mutation;
-    int j;
+    int mutation;
     int idx1;
     int idx2;
 
 /* applying a random mutation */
-    tsp_ga_random_interval (handle, ga, &idx1, &idx2);
+    tsp_ga_random_pair (worker, worker->Ga->Cities, &idx1, &idx2);
     mutation = *(mutant->CitiesFrom + idx1);
     *(mutant->CitiesFrom + idx1) = *(mutant->CitiesFrom + idx2);
     *(mutant->CitiesFrom + idx2) = mutation;
-
-/* adjusting From/To */
-    for (j = 1; j < mutant->Cities; j++)
-      {
-	  RouteNodePtr pFrom = *(mutant->CitiesFrom + j);
-	  *(mutant->CitiesTo + j - 1) = pFrom;
-      }
-    *(mutant->CitiesTo + mutant->Cities - 1) = *(mutant->CitiesFrom + 0);
-
-/* adjusting Costs */
-    mutant->TotalCost = 0.0;
-    for (j = 0; j < mutant->Cities; j++)
-      {
-	  RouteNodePtr pFrom = *(mutant->CitiesFrom + j);
-	  RouteNodePtr pTo = *(mutant->CitiesTo + j);
-	  double cost = tsp_ga_find_distance (ga, pFrom, pTo);
-	  tps_ga_chromosome_update (mutant, pFrom, pTo, cost);
-	  *(mutant->Costs + j) = cost;
-	  mutant->TotalCost += cost;
-      }
+    tsp_ga_adjust_solution (worker->Ga, mutant);
 }
 
 static TspGaSolutionPtr
 tsp_ga_clone_solution (TspGaPopulationPtr ga, TspGaSolutionPtr original)
 {
 /* cloning a TSP GA solution */
-    int j;
     TspGaSolutionPtr clone;
     if (original == NULL)
 	return NULL;
 
-    clone = malloc (sizeof (TspGaSolution));
-    clone->Cities = original->Cities;
-    clone->CitiesFrom = malloc (sizeof (RouteNodePtr) * ga->Cities);
-    clone->CitiesTo = malloc (sizeof (RouteNodePtr) * ga->Cities);
-    clone->Costs = malloc (sizeof (double) * ga->Cities);
-    for (j = 0; j < ga->Cities; j++)
-      {
-	  *(clone->CitiesFrom + j) = *(original->CitiesFrom + j);
-	  *(clone->CitiesTo + j) = *(original->CitiesTo + j);
-	  *(clone->Costs + j) = *(original->Costs + j);
-      }
-    clone->TotalCost = 0.0;
+    clone = alloc_tsp_ga_solution (ga->Cities);
+    memcpy (clone->CitiesFrom, original->CitiesFrom, sizeof (int) * ga->Cities);
+    memcpy (clone->CitiesTo, original->CitiesTo, sizeof (int) * ga->Cities);
+    memcpy (clone->Costs, original->Costs, sizeof (double) * ga->Cities);
+    clone->TotalCost = original->TotalCost;
     return clone;
 }
 
 static TspGaSolutionPtr
-tsp_ga_crossover (sqlite3 * handle, TspGaPopulationPtr ga, int mutation1,
-		  int mutation2)
+tsp_ga_crossover (TspGaWorkerPtr worker, int mutation1, int mutation2)
 {
 /* creating a Crossover solution */
     int j;
+    int k;
     int idx1;
     int idx2;
+    TspGaPopulationPtr ga = worker->Ga;
     TspGaSolutionPtr hybrid;
-    TspGaSolutionPtr parent1 = NULL;
-    TspGaSolutionPtr parent2 = NULL;
+    TspGaSolutionPtr parent1;
+    TspGaSolutionPtr parent2;
 
 /* randomly choosing two parents */
-    tsp_ga_random_solutions (handle, ga, &idx1, &idx2);
-    if (idx1 >= 0 && idx1 < ga->Count)
-	parent1 = tsp_ga_clone_solution (ga, *(ga->Solutions + idx1));
-    if (idx2 >= 0 && idx2 < ga->Count)
-	parent2 = tsp_ga_clone_solution (ga, *(ga->Solutions + idx2));
-    if (parent1 == NULL || parent2 == NULL)
-	goto stop;
-
+    tsp_ga_random_pair (worker, ga->Count, &idx1, &idx2);
+    parent1 = *(ga->Solutions + idx1);
+    parent2 = *(ga->Solutions + idx2);
     if (mutation1)
-	tsp_ga_random_mutation (handle, ga, parent1);
+      {
+	  parent1 = tsp_ga_clone_solution (ga, parent1);
+	  tsp_ga_random_mutation (worker, parent1);
+      }
     if (mutation2)
-	tsp_ga_random_mutation (handle, ga, parent2);
+      {
+	  parent2 = tsp_ga_clone_solution (ga, parent2);
+	  tsp_ga_random_mutation (worker, parent2);
+      }
 
 /* creating an empty hybrid */
-    hybrid = malloc (sizeof (TspGaSolution));
-    hybrid->Cities = ga->Cities;
-    hybrid->CitiesFrom = malloc (sizeof (RouteNodePtr) * ga->Cities);
-    hybrid->CitiesTo = malloc (sizeof (RouteNodePtr) * ga->Cities);
-    hybrid->Costs = malloc (sizeof (double) * ga->Cities);
+    hybrid = alloc_tsp_ga_solution (ga->Cities);
     for (j = 0; j < ga->Cities; j++)
       {
-	  *(hybrid->CitiesFrom + j) = NULL;
-	  *(hybrid->CitiesTo + j) = NULL;
-	  *(hybrid->Costs + j) = DBL_MAX;
+	  *(hybrid->CitiesFrom + j) = -1;
+	  *(worker->Used + j) = 0;
       }
-    hybrid->TotalCost = 0.0;
 
 /* step #1: inheritance from the fist parent */
-    tsp_ga_random_interval (handle, ga, &idx1, &idx2);
-    if (idx1 < idx2)
+    tsp_ga_random_pair (worker, ga->Cities, &idx1, &idx2);
+    if (idx1 > idx2)
       {
-	  for (j = idx1; j <= idx2; j++)
-	      *(hybrid->CitiesFrom + j) = *(parent1->CitiesFrom + j);
+	  j = idx1;
+	  idx1 = idx2;
+	  idx2 = j;
       }
-    else
+    for (j = idx1; j <= idx2; j++)
       {
-	  for (j = idx2; j <= idx1; j++)
-	      *(hybrid->CitiesFrom + j) = *(parent1->CitiesFrom + j);
+	  int city = *(parent1->CitiesFrom + j);
+	  *(hybrid->CitiesFrom + j) = city;
+	  *(worker->Used + city) = 1;
       }
 
-/* step #2: inheritance from the second parent */
+/* step #2: inheritance from the second parent (filling the empty slots) */
+    k = 0;
     for (j = 0; j < parent2->Cities; j++)
       {
-	  RouteNodePtr p2From = *(parent2->CitiesFrom + j);
-	  int k;
-	  int found = 0;
-	  if (p2From == NULL)
-	      continue;
-	  for (k = 0; k < hybrid->Cities; k++)
-	    {
-		RouteNodePtr p1From = *(hybrid->CitiesFrom + k);
-		if (p1From == NULL)
-		    continue;
-		if (p1From == p2From)
-		  {
-		      /* already present: skipping */
-		      found = 1;
-		      break;
-		  }
-	    }
-	  if (found)
-	      continue;
-	  for (k = 0; k < hybrid->Cities; k++)
-	    {
-		if (*(hybrid->CitiesFrom + k) == NULL
-		    && *(hybrid->CitiesTo + k) == NULL
-		    && *(hybrid->Costs + k) == DBL_MAX)
-		  {
-		      /* found an empty slot: inserting */
-		      *(hybrid->CitiesFrom + k) = p2From;
-		      break;
-		  }
-	    }
+	  int city = *(parent2->CitiesFrom + j);
+	  if (*(worker->Used + city))
+	      continue;		/* already present: skipping */
+	  while (*(hybrid->CitiesFrom + k) >= 0)
+	      k++;
+	  *(hybrid->CitiesFrom + k) = city;
+	  *(worker->Used + city) = 1;
       }
-    destroy_tsp_ga_solution (parent1);
-    destroy_tsp_ga_solution (parent2);
+    if (mutation1)
+	destroy_tsp_ga_solution (parent1);
+    if (mutation2)
+	destroy_tsp_ga_solution (parent2);
 
-/* adjusting From/To */
-    for (j = 1; j < hybrid->Cities; j++)
-      {
-	  RouteNodePtr p1From = *(hybrid->CitiesFrom + j);
-	  *(hybrid->CitiesTo + j - 1) = p1From;
-      }
-    *(hybrid->CitiesTo + hybrid->Cities - 1) = *(hybrid->CitiesFrom + 0);
+/* computing the hybrid's fitness */
+    tsp_ga_adjust_solution (ga, hybrid);
+    return hybrid;
+}
 
-/* retrieving cached costs */
-    for (j = 0; j < hybrid->Cities; j++)
+static void
+tsp_ga_worker_run (TspGaWorkerPtr worker)
+{
+/* breeding the offsprings assigned to this worker */
+    int i;
+    TspGaPopulationPtr ga = worker->Ga;
+    for (i = worker->Index; i < ga->Count; i += worker->NumThreads)
       {
-	  RouteNodePtr pFrom = *(hybrid->CitiesFrom + j);
-	  RouteNodePtr pTo = *(hybrid->CitiesTo + j);
-	  double cost = tsp_ga_find_distance (ga, pFrom, pTo);
-	  tps_ga_chromosome_update (hybrid, pFrom, pTo, cost);
-	  hybrid->TotalCost += cost;
+	  /* Genetic loop - with mutations */
+	  int count = (ga->Generation * ga->Count) + i + 1;
+	  int mutation1 = 0;
+	  int mutation2 = 0;
+	  if (count % 13 == 0)
+	    {
+		/* introducing a random mutation on parent #1 */
+		mutation1 = 1;
+	    }
+	  if (count % 16 == 0)
+	    {
+		/* introducing a random mutation on parent #2 */
+		mutation2 = 1;
+	    }
+	  *(ga->Offsprings + i) = tsp_ga_crossover (worker, mutation1, mutation2);
       }
-    return hybrid;
+}
 
-  stop:
-    if (parent1 != NULL)
-	destroy_tsp_ga_solution (parent1);
-    if (parent2 != NULL)
-	destroy_tsp_ga_solution (parent2);
+#if defined(_WIN32) && !defined(__MINGW32__)
+static DWORD WINAPI
+tsp_ga_worker_main (void *arg)
+#else
+static void *
+tsp_ga_worker_main (void *arg)
+#endif
+{
+/* the TSP GA worker thread */
+    tsp_ga_worker_run ((TspGaWorkerPtr) arg);
+#if defined(_WIN32) && !defined(__MINGW32__)
+    return 0;
+#else
     return NULL;
+#endif
+}
+
+static void
+tsp_ga_breed (TspGaWorkerPtr workers, int n_threads)
+{
+/* breeding a whole generation of offsprings on the worker threads */
+    int i;
+    char started[VROUTE_MATRIX_MAX_THREADS];
+    for (i = 1; i < n_threads; i++)
+      {
+	  TspGaWorkerPtr worker = workers + i;
+	  started[i] = 0;
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  worker->Thread =
+	      CreateThread (NULL, 0, tsp_ga_worker_main, worker, 0, NULL);
+	  if (worker->Thread != NULL)
+	      started[i] = 1;
+#else
+	  if (pthread_create (&(worker->Thread), NULL, tsp_ga_worker_main,
+			      worker) == 0)
+	      started[i] = 1;
+#endif
+      }
+/* the calling thread acts as the first worker */
+    tsp_ga_worker_run (workers);
+    for (i = 1; i < n_threads; i++)
+      {
+	  TspGaWorkerPtr worker = workers + i;
+	  if (!started[i])
+	    {
+		/* unable to start a thread: running inline */
+		tsp_ga_worker_run (worker);
+		continue;
+	    }
+#if defined(_WIN32) && !defined(__MINGW32__)
+	  WaitForSingleObject (worker->Thread, INFINITE);
+	  CloseHandle (worker->Thread);
+#else
+	  pthread_join (worker->Thread, NULL);
+#endif
+      }
 }
 
 static void
@@ -4210,14 +5971,16 @@ evalTspGaFitness (TspGaPopulationPtr ga)
 /* evaluating the comparative fitness of parents and offsprings */
     int j;
     int i;
-    int index;
-    int already_defined = 0;
 
     for (j = 0; j < ga->Count; j++)
       {
 	  /* evaluating an offsprings */
 	  double max_cost = 0.0;
+	  int index = -1;
+	  int already_defined = 0;
 	  TspGaSolutionPtr hybrid = *(ga->Offsprings + j);
+	  if (hybrid == NULL)
+	      continue;
 
 	  for (i = 0; i < ga->Count; i++)
 	    {
@@ -4231,7 +5994,7 @@ evalTspGaFitness (TspGaPopulationPtr ga)
 		if (old->TotalCost == hybrid->TotalCost)
 		    already_defined = 1;
 	    }
-	  if (max_cost > hybrid->TotalCost && !already_defined)
+	  if (index >= 0 && max_cost > hybrid->TotalCost && !already_defined)
 	    {
 		/* inserting the new hybrid by replacing the worst parent */
 		TspGaSolutionPtr kill = *(ga->Solutions + index);
@@ -4312,6 +6075,7 @@ completing_tsp_ga_solution (sqlite3 * handle, int options, RouteNodePtr origin,
 		/* inserts a Link into the Shortest Path solution */
 		RowSolutionPtr p = malloc (sizeof (RowSolution));
 		p->Link = old->Link;
+		p->Cost = old->Cost;
 		p->Name = old->Name;
 		old->Name = NULL;
 		p->Next = NULL;
@@ -4329,8 +6093,8 @@ completing_tsp_ga_solution (sqlite3 * handle, int options, RouteNodePtr origin,
 
 static void
 set_tsp_ga_targets (sqlite3 * handle, int options, RoutingPtr graph,
-		    RoutingNodesPtr routing, TspGaSolutionPtr bestSolution,
-		    TspTargetsPtr targets)
+		    RoutingNodesPtr routing, TspGaPopulationPtr ga,
+		    TspGaSolutionPtr bestSolution, TspTargetsPtr targets)
 {
 /* preparing TSP GA targets (best solution found) */
     int j;
@@ -4339,16 +6103,16 @@ set_tsp_ga_targets (sqlite3 * handle, int options, RoutingPtr graph,
 
     for (j = 0; j < targets->Count; j++)
       {
-	  from = *(bestSolution->CitiesFrom + j);
-	  to = *(bestSolution->CitiesTo + j);
+	  from = *(ga->CityNodes + *(bestSolution->CitiesFrom + j));
+	  to = *(ga->CityNodes + *(bestSolution->CitiesTo + j));
 	  completing_tsp_ga_solution (handle, options, from, to,
 				      graph, routing, targets, j);
 	  *(targets->To + j) = to;
 	  *(targets->Found + j) = 'Y';
       }
     /* this is the final City closing the circular path */
-    from = *(bestSolution->CitiesFrom + targets->Count);
-    to = *(bestSolution->CitiesTo + targets->Count);
+    from = *(ga->CityNodes + *(bestSolution->CitiesFrom + targets->Count));
+    to = *(ga->CityNodes + *(bestSolution->CitiesTo + targets->Count));
     completing_tsp_ga_solution (handle, options, from, to, graph,
 				routing, targets, -1);
 }
@@ -4432,204 +6196,48 @@ tsp_ga_permuted_targets (RouteNodePtr from, RoutingMultiDestPtr multi,
     return targets;
 }
 
-static int
-build_tsp_nn_solution (TspGaPopulationPtr ga, TspTargetsPtr targets, int index)
+static void
+build_tsp_nn_solution (TspGaPopulationPtr ga, int start, int index)
 {
-/* building a TSP NN solution */
+/* building a TSP NN solution starting from the given City */
     int j;
-    int i;
-    RouteNodePtr origin;
-    TspGaDistancePtr dist;
-    TspGaSubDistancePtr sub;
-    RouteNodePtr destination;
-    double cost;
-    TspGaSolutionPtr solution = malloc (sizeof (TspGaSolution));
-    solution->Cities = targets->Count + 1;
-    solution->CitiesFrom = malloc (sizeof (RouteNodePtr) * solution->Cities);
-    solution->CitiesTo = malloc (sizeof (RouteNodePtr) * solution->Cities);
-    solution->Costs = malloc (sizeof (double) * solution->Cities);
-    solution->TotalCost = 0.0;
-
-    origin = targets->From;
-    for (j = 0; j < targets->Count; j++)
-      {
-	  /* searching the nearest City */
-	  dist = tsp_ga_find_from_distance (ga, origin);
-	  if (dist == NULL)
-	      return 0;
-	  destination = NULL;
-	  cost = DBL_MAX;
-
-	  sub = *(dist->Distances + dist->NearestIndex);
-	  destination = sub->CityTo;
-	  cost = sub->Cost;
-	  /* excluding the last City (should be a closed circuit) */
-	  if (destination == targets->From)
-	      destination = NULL;
-	  if (destination != NULL)
-	    {
-		for (i = 0; i < targets->Count; i++)
-		  {
-		      /* checking if this City was already reached */
-		      RouteNodePtr city = *(targets->To + i);
-		      if (city == destination)
-			{
-			    if (*(targets->Found + i) == 'Y')
-				destination = NULL;
-			    else
-				*(targets->Found + i) = 'Y';
-			    break;
-			}
-		  }
-	    }
-	  if (destination == NULL)
+    int k;
+    int origin = start;
+    char *visited = calloc (ga->Cities, sizeof (char));
+    TspGaSolutionPtr solution = alloc_tsp_ga_solution (ga->Cities);
+    visited[start] = 1;
+    for (j = 0; j < ga->Cities - 1; j++)
+      {
+	  /* searching the nearest City not yet reached */
+	  const double *row = ga->Distances + (origin * ga->Cities);
+	  double min = DBL_MAX;
+	  int destination = -1;
+	  for (k = 0; k < ga->Cities; k++)
 	    {
-		/* searching for an alternative destination */
-		double min = DBL_MAX;
-		int ind = -1;
-		int k;
-		for (k = 0; k < dist->Cities; k++)
-		  {
-		      sub = *(dist->Distances + k);
-		      RouteNodePtr city = sub->CityTo;
-		      /* excluding the last City (should be a closed circuit) */
-		      if (city == targets->From)
-			  continue;
-		      for (i = 0; i < targets->Count; i++)
-			{
-			    RouteNodePtr city2 = *(targets->To + i);
-			    if (*(targets->Found + i) == 'Y')
-				continue;
-			    if (city == city2)
-			      {
-				  if (sub->Cost < min)
-				    {
-					min = sub->Cost;
-					ind = k;
-				    }
-			      }
-			}
-		  }
-		if (ind >= 0)
+		if (visited[k])
+		    continue;
+		if (destination < 0 || row[k] < min)
 		  {
-		      sub = *(dist->Distances + ind);
-		      destination = sub->CityTo;
-		      cost = min;
-		      for (i = 0; i < targets->Count; i++)
-			{
-			    RouteNodePtr city = *(targets->To + i);
-			    if (city == destination)
-			      {
-				  *(targets->Found + i) = 'Y';
-				  break;
-			      }
-			}
+		      min = row[k];
+		      destination = k;
 		  }
 	    }
-	  if (destination == NULL)
-	      return 0;
+	  visited[destination] = 1;
 	  *(solution->CitiesFrom + j) = origin;
-	  *(solution->CitiesTo + j) = destination;
-	  *(solution->Costs + j) = cost;
-	  solution->TotalCost += cost;
 	  origin = destination;
       }
+    *(solution->CitiesFrom + ga->Cities - 1) = origin;
+    free (visited);
 
-/* returning to FROM so to close the circular path */
-    destination = targets->From;
-    for (i = 0; i < ga->Cities; i++)
-      {
-	  TspGaDistancePtr d = *(ga->Distances + i);
-	  if (d->CityFrom == origin)
-	    {
-		int k;
-		dist = *(ga->Distances + i);
-		for (k = 0; k < dist->Cities; k++)
-		  {
-		      sub = *(dist->Distances + k);
-		      RouteNodePtr city = sub->CityTo;
-		      if (city == destination)
-			{
-			    cost = sub->Cost;
-			    *(solution->CitiesFrom + targets->Count) = origin;
-			    *(solution->CitiesTo + targets->Count) =
-				destination;
-			    *(solution->Costs + targets->Count) = cost;
-			    solution->TotalCost += cost;
-			}
-		  }
-	    }
-      }
+/* returning to the start City so to close the circular path */
+    tsp_ga_adjust_solution (ga, solution);
 
 /* inserting into the GA population */
     *(ga->Solutions + index) = solution;
-    return 1;
-}
-
-static int
-cmp_nodes_addr (const void *p1, const void *p2)
-{
-/* compares two nodes  by addr [for QSORT] */
-    TspGaDistancePtr pD1 = *((TspGaDistancePtr *) p1);
-    TspGaDistancePtr pD2 = *((TspGaDistancePtr *) p2);
-    RouteNodePtr pN1 = pD1->CityFrom;
-    RouteNodePtr pN2 = pD2->CityFrom;
-    if (pN1 == pN2)
-	return 0;
-    if (pN1 > pN2)
-	return 1;
-    return -1;
-}
-
-static int
-cmp_dist_addr (const void *p1, const void *p2)
-{
-/* compares two nodes  by addr [for QSORT] */
-    TspGaSubDistancePtr pD1 = *((TspGaSubDistancePtr *) p1);
-    TspGaSubDistancePtr pD2 = *((TspGaSubDistancePtr *) p2);
-    RouteNodePtr pN1 = pD1->CityTo;
-    RouteNodePtr pN2 = pD2->CityTo;
-    if (pN1 == pN2)
-	return 0;
-    if (pN1 > pN2)
-	return 1;
-    return -1;
-}
-
-static void
-tsp_ga_sort_distances (TspGaPopulationPtr ga)
-{
-/* sorting Distances/Costs by Node addr */
-    int i;
-    qsort (ga->Distances, ga->Cities, sizeof (RouteNodePtr), cmp_nodes_addr);
-    for (i = 0; i < ga->Cities; i++)
-      {
-	  TspGaDistancePtr dist = *(ga->Distances + i);
-	  qsort (dist->Distances, dist->Cities, sizeof (TspGaSubDistancePtr),
-		 cmp_dist_addr);
-      }
-    for (i = 0; i < ga->Cities; i++)
-      {
-	  int k;
-	  int index = -1;
-	  double min = DBL_MAX;
-	  TspGaDistancePtr dist = *(ga->Distances + i);
-	  for (k = 0; k < dist->Cities; k++)
-	    {
-		TspGaSubDistancePtr sub = *(dist->Distances + k);
-		if (sub->Cost < min)
-		  {
-		      min = sub->Cost;
-		      index = k;
-		  }
-	    }
-	  if (index >= 0)
-	      dist->NearestIndex = index;
-      }
 }
 
 static void
-tsp_ga_solve (sqlite3 * handle, int options, RoutingPtr graph,
+tsp_ga_solve (sqlite3 * handle, int options, int algorithm, RoutingPtr graph,
 	      RoutingNodesPtr routing, MultiSolutionPtr multiSolution)
 {
 /* computing a Dijkstra TSP GA Solution */
@@ -4637,12 +6245,14 @@ tsp_ga_solve (sqlite3 * handle, int options, RoutingPtr graph,
     int j;
     double min;
     TspGaSolutionPtr bestSolution;
-    int count = 0;
     int max_iterations = VROUTE_TSP_GA_MAX_ITERATIONS;
     TspGaPopulationPtr ga = NULL;
+    TspGaWorkerPtr workers;
+    int n_threads;
+    int *cities;
+    sqlite3_uint64 seed;
     RoutingMultiDestPtr multi;
     TspTargetsPtr targets;
-    TspGaDistancePtr dist;
 
     if (multiSolution == NULL)
 	return;
@@ -4650,85 +6260,103 @@ tsp_ga_solve (sqlite3 * handle, int options, RoutingPtr graph,
     if (multi == NULL)
 	return;
 
+    for (j = 0; j < multi->Items; j++)
+      {
+	  /* checking for undefined targets */
+	  if (*(multi->To + j) == NULL)
+	    {
+		targets =
+		    tsp_ga_permuted_targets (multiSolution->From, multi, -1);
+		for (i = 0; i < targets->Count; i++)
+		  {
+		      /* maskinkg unreachable targets */
+		      *(targets->Found + i) = 'Y';
+		  }
+		build_tsp_illegal_solution (multiSolution, targets);
+		destroy_tsp_targets (targets);
+		return;
+	    }
+      }
+
 /* initialinzing the TSP GA helper struct */
     ga = build_tsp_ga_population (multi->Items + 1);
+    *(ga->CityNodes + 0) = multiSolution->From;
+    for (j = 0; j < multi->Items; j++)
+	*(ga->CityNodes + j + 1) = *(multi->To + j);
 
-    for (i = -1; i < multi->Items; i++)
+/* determining all City-to-City distances (costs) at once */
+    cities = malloc (sizeof (int) * ga->Cities);
+    for (j = 0; j < ga->Cities; j++)
+	cities[j] = (*(ga->CityNodes + j))->InternalIndex;
+    matrix_compute (graph, algorithm, cities, ga->Cities, cities, ga->Cities,
+		    ga->Distances);
+    free (cities);
+    for (i = 0; i < ga->Cities; i++)
       {
-	  /* determining all City-to-City distances (costs) */
-	  targets = tsp_ga_permuted_targets (multiSolution->From, multi, i);
+	  /* checking for unreachable targets */
+	  const double *row = ga->Distances + (i * ga->Cities);
+	  int unreachable = 0;
+	  targets = tsp_ga_permuted_targets (multiSolution->From, multi, i - 1);
 	  for (j = 0; j < targets->Count; j++)
 	    {
-		/* checking for undefined targets */
-		if (*(targets->To + j) == NULL)
-		  {
-		      int k;
-		      for (k = 0; k < targets->Count; k++)
-			{
-			    /* maskinkg unreachable targets */
-			    *(targets->Found + k) = 'Y';
-			}
-		      build_tsp_illegal_solution (multiSolution, targets);
-		      destroy_tsp_targets (targets);
-		      goto invalid;
-		  }
+		/* the permuted target #j is City #0 or City #(j + 1) */
+		int city = (j == i - 1) ? 0 : j + 1;
+		*(targets->Costs + j) = row[city];
+		if (row[city] == DBL_MAX)
+		    unreachable = 1;
+		else
+		    *(targets->Found + j) = 'Y';
 	    }
-	  dijkstra_targets_solve (routing, targets);
-	  for (j = 0; j < targets->Count; j++)
+	  if (unreachable)
 	    {
-		/* checking for unreachable targets */
-		if (*(targets->Found + j) != 'Y')
-		  {
-		      build_tsp_illegal_solution (multiSolution, targets);
-		      destroy_tsp_targets (targets);
-		      goto invalid;
-		  }
+		build_tsp_illegal_solution (multiSolution, targets);
+		destroy_tsp_targets (targets);
+		goto invalid;
 	    }
-	  /* inserting the distances/costs into the helper struct */
-	  dist = alloc_tsp_ga_distances (targets);
-	  *(ga->Distances + i + 1) = dist;
 	  destroy_tsp_targets (targets);
       }
-    tsp_ga_sort_distances (ga);
 
-    for (i = -1; i < multi->Items; i++)
+    for (i = 0; i < ga->Cities; i++)
       {
 	  /* initializing GA using permuted NN solutions */
-	  int ret;
-	  targets = tsp_ga_permuted_targets (multiSolution->From, multi, i);
-	  ret = build_tsp_nn_solution (ga, targets, i + 1);
-	  destroy_tsp_targets (targets);
-	  if (!ret)
-	      goto invalid;
+	  build_tsp_nn_solution (ga, i, i);
+      }
+
+/* setting up the worker threads */
+    n_threads = 1;
+    if (ga->Cities >= VROUTE_TSP_GA_MIN_PARALLEL)
+      {
+	  n_threads = splite_count_processors ();
+	  if (n_threads > VROUTE_MATRIX_MAX_THREADS)
+	      n_threads = VROUTE_MATRIX_MAX_THREADS;
+	  if (n_threads < 1)
+	      n_threads = 1;
+      }
+    sqlite3_randomness (sizeof (sqlite3_uint64), &seed);
+    workers = malloc (sizeof (TspGaWorker) * n_threads);
+    for (i = 0; i < n_threads; i++)
+      {
+	  TspGaWorkerPtr worker = workers + i;
+	  worker->Ga = ga;
+	  worker->Index = i;
+	  worker->NumThreads = n_threads;
+	  /* each worker owns a distinct (and never zero) PRNG state */
+	  worker->Random = (seed + (i * 0x9E3779B97F4A7C15ULL)) | 1;
+	  worker->Used = malloc (ga->Cities);
       }
 
     while (max_iterations >= 0)
       {
 	  /* sexual reproduction and darwinian selection */
-	  for (i = 0; i < ga->Count; i++)
-	    {
-		/* Genetic loop - with mutations */
-		TspGaSolutionPtr hybrid;
-		int mutation1 = 0;
-		int mutation2 = 0;
-		count++;
-		if (count % 13 == 0)
-		  {
-		      /* introducing a random mutation on parent #1 */
-		      mutation1 = 1;
-		  }
-		if (count % 16 == 0)
-		  {
-		      /* introducing a random mutation on parent #2 */
-		      mutation2 = 1;
-		  }
-		hybrid = tsp_ga_crossover (handle, ga, mutation1, mutation2);
-		*(ga->Offsprings + i) = hybrid;
-	    }
+	  tsp_ga_breed (workers, n_threads);
 	  evalTspGaFitness (ga);
 	  free_tsp_ga_offsprings (ga);
+	  ga->Generation += 1;
 	  max_iterations--;
       }
+    for (i = 0; i < n_threads; i++)
+	free (workers[i].Used);
+    free (workers);
 
 /* building the TSP GA solution */
     min = DBL_MAX;
@@ -4750,8 +6378,8 @@ tsp_ga_solve (sqlite3 * handle, int options, RoutingPtr graph,
 	  targets =
 	      build_tsp_ga_solution_targets (multiSolution->MultiTo->Items,
 					     multiSolution->From);
-	  set_tsp_ga_targets (handle, options, graph, routing, bestSolution,
-			      targets);
+	  set_tsp_ga_targets (handle, options, graph, routing, ga,
+			      bestSolution, targets);
 	  build_tsp_solution (multiSolution, targets, graph->Srid);
 	  destroy_tsp_targets (targets);
       }
@@ -4763,72 +6391,631 @@ tsp_ga_solve (sqlite3 * handle, int options, RoutingPtr graph,
 }
 
 static void
-network_free (RoutingPtr p)
+ch_free (RouteCHPtr ch)
 {
-/* memory cleanup; freeing any allocation for the network struct */
-    RouteNodePtr pN;
-    int i;
-    if (!p)
+/* memory cleanup; freeing the Contraction Hierarchies data */
+    if (ch == NULL)
+	return;
+    if (ch->Arcs)
+	free (ch->Arcs);
+    if (ch->Rank)
+	free (ch->Rank);
+    if (ch->UpFirst)
+	free (ch->UpFirst);
+    if (ch->UpArcs)
+	free (ch->UpArcs);
+    if (ch->DownFirst)
+	free (ch->DownFirst);
+    if (ch->DownArcs)
+	free (ch->DownArcs);
+    free (ch);
+}
+
+static void
+snap_index_free (RouteSnapIndexPtr index)
+{
+/* memory cleanup; freeing the Point2Point snapping index */
+    if (index == NULL)
+	return;
+    if (index->Links)
+	free (index->Links);
+    if (index->Coords)
+	free (index->Coords);
+    if (index->Nodes)
+	free (index->Nodes);
+    free (index);
+}
+
+static void
+td_free (RouteTDPtr td)
+{
+/* memory cleanup; freeing the Time Profiles and Turn Restrictions */
+    if (td == NULL)
 	return;
-    for (i = 0; i < p->NumNodes; i++)
+    if (td->StepTime)
+	free (td->StepTime);
+    if (td->StepCost)
+	free (td->StepCost);
+    if (td->Profiles)
+	free (td->Profiles);
+    if (td->ProfileRowid)
+	free (td->ProfileRowid);
+    if (td->LinkProfile)
+	free (td->LinkProfile);
+    if (td->Turns)
+	free (td->Turns);
+    if (td->TurnFirst)
+	free (td->TurnFirst);
+    if (td->TurnLink)
+	free (td->TurnLink);
+    if (td->TurnCost)
+	free (td->TurnCost);
+    free (td);
+}
+
+static int
+ch_header (RoutingPtr graph, const unsigned char *blob, int size)
+{
+/* parsing the Contraction Hierarchies HEADER block */
+    RouteCHPtr ch;
+    int nodes;
+    int links;
+    int shortcuts;
+    int i;
+    if (size < 14 || graph->CH != NULL)
+	return 0;
+    if (*(blob + 0) != GAIA_NET_CH_HEADER)	/* signature */
+	return 0;
+    nodes = gaiaImport32 (blob + 1, 1, graph->EndianArch);	/* # Nodes */
+    links = gaiaImport32 (blob + 5, 1, graph->EndianArch);	/* # original Links */
+    shortcuts = gaiaImport32 (blob + 9, 1, graph->EndianArch);	/* # Shortcuts */
+    if (*(blob + 13) != GAIA_NET_END)	/* signature */
+	return 0;
+    if (nodes != graph->NumNodes || links < 0 || shortcuts < 0)
+	return 0;
+    ch = malloc (sizeof (RouteCH));
+    ch->NumNodes = nodes;
+    ch->NumLinks = links;
+    ch->NumArcs = links + shortcuts;
+    ch->NextShortcut = links;
+    ch->Arcs = malloc (sizeof (RouteCHArc) * (ch->NumArcs + 1));
+    ch->Rank = malloc (sizeof (int) * nodes);
+    for (i = 0; i < nodes; i++)
+	ch->Rank[i] = -1;
+    ch->UpFirst = NULL;
+    ch->UpArcs = NULL;
+    ch->DownFirst = NULL;
+    ch->DownArcs = NULL;
+    graph->CH = ch;
+    return 1;
+}
+
+static int
+ch_block (RoutingPtr graph, const unsigned char *blob, int size)
+{
+/* parsing a Contraction Hierarchies Block */
+    RouteCHPtr ch = graph->CH;
+    const unsigned char *in = blob;
+    int items;
+    int i;
+    if (ch == NULL || size < 3)
+	return 0;
+    if (*in++ != GAIA_NET_CH_BLOCK)	/* signature */
+	return 0;
+    items = gaiaImport16 (in, 1, graph->EndianArch);	/* # items */
+    in += 2;
+    for (i = 0; i < items; i++)
       {
-	  pN = p->Nodes + i;
-	  if (pN->Code)
-	      free (pN->Code);
-	  if (pN->Links)
-	      free (pN->Links);
+	  if ((size - (in - blob)) < 9)
+	      return 0;
+	  if (*in == GAIA_NET_CH_NODE)
+	    {
+		/* the rank of some Node */
+		int index;
+		in++;
+		index = gaiaImport32 (in, 1, graph->EndianArch);	/* Node internal index */
+		in += 4;
+		if (index < 0 || index >= ch->NumNodes)
+		    return 0;
+		ch->Rank[index] = gaiaImport32 (in, 1, graph->EndianArch);	/* Node rank */
+		in += 4;
+	    }
+	  else if (*in == GAIA_NET_CH_SHORTCUT)
+	    {
+		/* a Shortcut */
+		RouteCHArcPtr arc;
+		if ((size - (in - blob)) < 26)
+		    return 0;
+		if (ch->NextShortcut >= ch->NumArcs)
+		    return 0;
+		in++;
+		arc = ch->Arcs + ch->NextShortcut;
+		arc->NodeFrom = gaiaImport32 (in, 1, graph->EndianArch);	/* FromNode internal index */
+		in += 4;
+		arc->NodeTo = gaiaImport32 (in, 1, graph->EndianArch);	/* ToNode internal index */
+		in += 4;
+		arc->Cost = gaiaImport64 (in, 1, graph->EndianArch);	/* Cost */
+		in += 8;
+		arc->Child1 = gaiaImport32 (in, 1, graph->EndianArch);	/* first replaced arc */
+		in += 4;
+		arc->Child2 = gaiaImport32 (in, 1, graph->EndianArch);	/* second replaced arc */
+		in += 4;
+		arc->Link = NULL;
+		if (*in++ != GAIA_NET_END)	/* signature */
+		    return 0;
+		if (arc->NodeFrom < 0 || arc->NodeFrom >= ch->NumNodes
+		    || arc->NodeTo < 0 || arc->NodeTo >= ch->NumNodes)
+		    return 0;
+		/* a Shortcut can only replace arcs defined before itself */
+		if (arc->Child1 < 0 || arc->Child1 >= ch->NextShortcut
+		    || arc->Child2 < 0 || arc->Child2 >= ch->NextShortcut)
+		    return 0;
+		ch->NextShortcut += 1;
+	    }
+	  else
+	      return 0;
       }
-    if (p->Nodes)
-	free (p->Nodes);
-    if (p->TableName)
-	free (p->TableName);
-    if (p->FromColumn)
-	free (p->FromColumn);
-    if (p->ToColumn)
-	free (p->ToColumn);
-    if (p->GeometryColumn)
-	free (p->GeometryColumn);
-    if (p->NameColumn)
-	free (p->NameColumn);
-    free (p);
+    return 1;
 }
 
-static RoutingPtr
-network_init (const unsigned char *blob, int size)
+static void
+ch_finalize (RoutingPtr graph)
 {
-/* parsing the HEADER block */
-    RoutingPtr graph;
-    int net64;
-    int aStar = 0;
-    int nodes;
-    int node_code;
-    int max_code_length;
-    int endian_arch = gaiaEndianArch ();
-    const char *table;
-    const char *from;
-    const char *to;
-    const char *geom;
-    const char *name = NULL;
-    double a_star_coeff = 1.0;
-    int len;
+/* 
+/ completing the Contraction Hierarchies data once the whole
+/ graph has been loaded; any inconsistency simply causes the
+/ CH data to be discarded
+*/
+    RouteCHPtr ch = graph->CH;
     int i;
-    const unsigned char *ptr;
-    if (size < 9)
-	return NULL;
-    if (*(blob + 0) == GAIA_NET_START)	/* signature - legacy format using 32bit ints */
-	net64 = 0;
-    else if (*(blob + 0) == GAIA_NET64_START)	/* signature - format using 64bit ints */
-	net64 = 1;
-    else if (*(blob + 0) == GAIA_NET64_A_STAR_START)	/* signature - format using 64bit ints AND supporting A* */
+    int j;
+    int k;
+    int ind;
+    int nodes;
+    int *filled;
+    if (ch == NULL)
+	return;
+    nodes = ch->NumNodes;
+    if (ch->NextShortcut != ch->NumArcs)
+	goto invalid;
+    for (i = 0; i < nodes; i++)
       {
-	  net64 = 1;
-	  aStar = 1;
+	  if (ch->Rank[i] < 0)
+	      goto invalid;
       }
-    else
-	return NULL;
-    if (*(blob + 1) != GAIA_NET_HEADER)	/* signature */
-	return NULL;
-    nodes = gaiaImport32 (blob + 2, 1, endian_arch);	/* # nodes */
+/* original Links follow the same order they have into the Nodes */
+    k = 0;
+    for (i = 0; i < nodes; i++)
+      {
+	  RouteNodePtr pN = graph->Nodes + i;
+	  for (j = 0; j < pN->NumLinks; j++)
+	    {
+		RouteCHArcPtr arc;
+		RouteLinkPtr pA = pN->Links + j;
+		if (k >= ch->NumLinks)
+		    goto invalid;
+		arc = ch->Arcs + k++;
+		arc->NodeFrom = pA->NodeFrom->InternalIndex;
+		arc->NodeTo = pA->NodeTo->InternalIndex;
+		arc->Cost = pA->Cost;
+		arc->Child1 = -1;
+		arc->Child2 = -1;
+		arc->Link = pA;
+	    }
+      }
+    if (k != ch->NumLinks)
+	goto invalid;
+
+/* building the upward (forward) and downward (backward) adjacencies */
+    ch->UpFirst = calloc (nodes + 1, sizeof (int));
+    ch->DownFirst = calloc (nodes + 1, sizeof (int));
+    for (i = 0; i < ch->NumArcs; i++)
+      {
+	  RouteCHArcPtr arc = ch->Arcs + i;
+	  if (arc->NodeFrom == arc->NodeTo)
+	      continue;
+	  if (ch->Rank[arc->NodeFrom] < ch->Rank[arc->NodeTo])
+	      ch->UpFirst[arc->NodeFrom + 1] += 1;
+	  else
+	      ch->DownFirst[arc->NodeTo + 1] += 1;
+      }
+    for (i = 0; i < nodes; i++)
+      {
+	  ch->UpFirst[i + 1] += ch->UpFirst[i];
+	  ch->DownFirst[i + 1] += ch->DownFirst[i];
+      }
+    ch->UpArcs = malloc (sizeof (int) * (ch->UpFirst[nodes] + 1));
+    ch->DownArcs = malloc (sizeof (int) * (ch->DownFirst[nodes] + 1));
+    filled = malloc (sizeof (int) * nodes);
+    for (i = 0; i < nodes; i++)
+	filled[i] = 0;
+    for (i = 0; i < ch->NumArcs; i++)
+      {
+	  RouteCHArcPtr arc = ch->Arcs + i;
+	  if (arc->NodeFrom == arc->NodeTo)
+	      continue;
+	  if (ch->Rank[arc->NodeFrom] < ch->Rank[arc->NodeTo])
+	    {
+		ind = ch->UpFirst[arc->NodeFrom] + filled[arc->NodeFrom];
+		ch->UpArcs[ind] = i;
+		filled[arc->NodeFrom] += 1;
+	    }
+      }
+    for (i = 0; i < nodes; i++)
+	filled[i] = 0;
+    for (i = 0; i < ch->NumArcs; i++)
+      {
+	  RouteCHArcPtr arc = ch->Arcs + i;
+	  if (arc->NodeFrom == arc->NodeTo)
+	      continue;
+	  if (ch->Rank[arc->NodeFrom] > ch->Rank[arc->NodeTo])
+	    {
+		ind = ch->DownFirst[arc->NodeTo] + filled[arc->NodeTo];
+		ch->DownArcs[ind] = i;
+		filled[arc->NodeTo] += 1;
+	    }
+      }
+    free (filled);
+    return;
+
+  invalid:
+    ch_free (ch);
+    graph->CH = NULL;
+}
+
+static int
+td_header (RoutingPtr graph, const unsigned char *blob, int size)
+{
+/* parsing the Time Profiles and Turn Restrictions HEADER block */
+    RouteTDPtr td;
+    int steps;
+    int turns;
+    if (size < 10 || graph->TD != NULL)
+	return 0;
+    if (*(blob + 0) != GAIA_NET_TD_HEADER)	/* signature */
+	return 0;
+    steps = gaiaImport32 (blob + 1, 1, graph->EndianArch);	/* # Profile steps */
+    turns = gaiaImport32 (blob + 5, 1, graph->EndianArch);	/* # Turn Restrictions */
+    if (*(blob + 9) != GAIA_NET_END)	/* signature */
+	return 0;
+    if (steps < 0 || turns < 0)
+	return 0;
+    td = malloc (sizeof (RouteTD));
+    td->NumSteps = steps;
+    td->NextStep = 0;
+    td->StepTime = malloc (sizeof (int) * (steps + 1));
+    td->StepCost = malloc (sizeof (double) * (steps + 1));
+    td->NumProfiles = 0;
+    td->MaxProfiles = 0;
+    td->Profiles = NULL;
+    td->ProfileRowid = NULL;
+    td->LinkProfile = NULL;
+    td->NumTurns = turns;
+    td->NextTurn = 0;
+    td->Turns = malloc (sizeof (RouteTDTurn) * (turns + 1));
+    td->TurnFirst = NULL;
+    td->TurnLink = NULL;
+    td->TurnCost = NULL;
+    td->AStarHeuristicCoeff = graph->AStarHeuristicCoeff;
+    graph->TD = td;
+    return 1;
+}
+
+static int
+td_block (RoutingPtr graph, const unsigned char *blob, int size)
+{
+/* parsing a Time Profiles and Turn Restrictions Block */
+    RouteTDPtr td = graph->TD;
+    const unsigned char *in = blob;
+    int items;
+    int i;
+    int j;
+    if (td == NULL || size < 3)
+	return 0;
+    if (*in++ != GAIA_NET_TD_BLOCK)	/* signature */
+	return 0;
+    items = gaiaImport16 (in, 1, graph->EndianArch);	/* # items */
+    in += 2;
+    for (i = 0; i < items; i++)
+      {
+	  if ((size - (in - blob)) < 12)
+	      return 0;
+	  if (*in == GAIA_NET_TD_PROFILE)
+	    {
+		/* the time-dependent Cost of some Link */
+		RouteTDProfilePtr profile;
+		int steps;
+		in++;
+		if (td->NumProfiles == td->MaxProfiles)
+		  {
+		      td->MaxProfiles =
+			  (td->MaxProfiles == 0) ? 1024 : td->MaxProfiles * 2;
+		      td->Profiles =
+			  realloc (td->Profiles,
+				   sizeof (RouteTDProfile) * td->MaxProfiles);
+		      td->ProfileRowid =
+			  realloc (td->ProfileRowid,
+				   sizeof (sqlite3_int64) * td->MaxProfiles);
+		  }
+		td->ProfileRowid[td->NumProfiles] = gaiaImportI64 (in, 1, graph->EndianArch);	/* Link ROWID */
+		in += 8;
+		steps = gaiaImport16 (in, 1, graph->EndianArch);	/* # steps */
+		in += 2;
+		if (steps <= 0 || td->NextStep + steps > td->NumSteps)
+		    return 0;
+		if ((size - (in - blob)) < (12 * steps) + 1)
+		    return 0;
+		profile = td->Profiles + td->NumProfiles;
+		profile->First = td->NextStep;
+		profile->Count = steps;
+		for (j = 0; j < steps; j++)
+		  {
+		      td->StepTime[td->NextStep] = gaiaImport32 (in, 1, graph->EndianArch);	/* step start time */
+		      in += 4;
+		      td->StepCost[td->NextStep] = gaiaImport64 (in, 1, graph->EndianArch);	/* step Cost */
+		      in += 8;
+		      td->NextStep += 1;
+		  }
+		if (*in++ != GAIA_NET_END)	/* signature */
+		    return 0;
+		td->NumProfiles += 1;
+	    }
+	  else if (*in == GAIA_NET_TD_TURN)
+	    {
+		/* a Turn Restriction */
+		RouteTDTurnPtr turn;
+		int banned;
+		if ((size - (in - blob)) < 27)
+		    return 0;
+		if (td->NextTurn >= td->NumTurns)
+		    return 0;
+		in++;
+		turn = td->Turns + td->NextTurn;
+		turn->FromRowid = gaiaImportI64 (in, 1, graph->EndianArch);	/* incoming Link ROWID */
+		in += 8;
+		turn->ToRowid = gaiaImportI64 (in, 1, graph->EndianArch);	/* outgoing Link ROWID */
+		in += 8;
+		banned = *in++;	/* banned turn */
+		turn->Cost = gaiaImport64 (in, 1, graph->EndianArch);	/* turn penalty */
+		in += 8;
+		if (banned)
+		    turn->Cost = DBL_MAX;
+		if (*in++ != GAIA_NET_END)	/* signature */
+		    return 0;
+		td->NextTurn += 1;
+	    }
+	  else
+	      return 0;
+      }
+    return 1;
+}
+
+static int
+cmp_td_link_rowid (const void *p1, const void *p2)
+{
+/* compares two Link references by ROWID [for QSORT and BSEARCH] */
+    const sqlite3_int64 *ref1 = (const sqlite3_int64 *) p1;
+    const sqlite3_int64 *ref2 = (const sqlite3_int64 *) p2;
+    if (*ref1 == *ref2)
+	return 0;
+    return (*ref1 > *ref2) ? 1 : -1;
+}
+
+static int
+td_find_links (sqlite3_int64 * refs, int count, sqlite3_int64 rowid)
+{
+/* 
+/ searching the Links corresponding to some ROWID (both directions);
+/ refs contains sorted pairs (ROWID, Link index)
+*/
+    sqlite3_int64 *ref =
+	bsearch (&rowid, refs, count, sizeof (sqlite3_int64) * 2,
+		 cmp_td_link_rowid);
+    if (ref == NULL)
+	return -1;
+    while (ref > refs && *(ref - 2) == rowid)
+	ref -= 2;		/* the first matching pair */
+    return (ref - refs) / 2;
+}
+
+static void
+td_finalize (RoutingPtr graph)
+{
+/* 
+/ completing the Time Profiles and Turn Restrictions once the whole
+/ graph has been loaded: Links are resolved from their ROWIDs into
+/ their internal indices; any inconsistency simply causes the
+/ time-dependent data to be discarded
+*/
+    RouteTDPtr td = graph->TD;
+    sqlite3_int64 *refs;
+    int i;
+    int k;
+    int pass;
+    if (td == NULL)
+	return;
+    if (td->NextStep != td->NumSteps || td->NextTurn != td->NumTurns)
+	goto invalid;
+
+/* sorting all Links by ROWID */
+    refs = malloc (sizeof (sqlite3_int64) * 2 * (graph->NumLinks + 1));
+    for (i = 0; i < graph->NumLinks; i++)
+      {
+	  refs[i * 2] = graph->Links[i].LinkRowid;
+	  refs[(i * 2) + 1] = i;
+      }
+    qsort (refs, graph->NumLinks, sizeof (sqlite3_int64) * 2,
+	   cmp_td_link_rowid);
+
+/* assigning the profiles to both directions of each Link */
+    td->LinkProfile = malloc (sizeof (int) * (graph->NumLinks + 1));
+    for (i = 0; i < graph->NumLinks; i++)
+	td->LinkProfile[i] = -1;
+    for (i = 0; i < td->NumProfiles; i++)
+      {
+	  RouteTDProfilePtr profile = td->Profiles + i;
+	  double min_cost = DBL_MAX;
+	  k = td_find_links (refs, graph->NumLinks, td->ProfileRowid[i]);
+	  if (k < 0)
+	      continue;
+	  for (pass = profile->First; pass < profile->First + profile->Count;
+	       pass++)
+	    {
+		if (td->StepCost[pass] < min_cost)
+		    min_cost = td->StepCost[pass];
+	    }
+	  for (; k < graph->NumLinks && refs[k * 2] == td->ProfileRowid[i];
+	       k++)
+	    {
+		int link = (int) refs[(k * 2) + 1];
+		RouteLinkPtr pA = graph->Links + link;
+		double dist;
+		td->LinkProfile[link] = i;
+		/* the A* heuristic must never overestimate any profile Cost */
+		dist =
+		    astar_heuristic_distance ((RouteNodePtr) (pA->NodeFrom),
+					      (RouteNodePtr) (pA->NodeTo), 1.0);
+		if (dist > 0.0 && min_cost / dist < td->AStarHeuristicCoeff)
+		    td->AStarHeuristicCoeff = min_cost / dist;
+	    }
+      }
+
+/* building the Turn Restrictions adjacency (by incoming Link) */
+    td->TurnFirst = calloc (graph->NumLinks + 1, sizeof (int));
+    for (pass = 0; pass < 2; pass++)
+      {
+	  if (pass == 1)
+	    {
+		/* second pass: all turns are now counted */
+		int total;
+		for (i = 0; i < graph->NumLinks; i++)
+		    td->TurnFirst[i + 1] += td->TurnFirst[i];
+		total = td->TurnFirst[graph->NumLinks];
+		td->TurnLink = malloc (sizeof (int) * (total + 1));
+		td->TurnCost = malloc (sizeof (double) * (total + 1));
+		for (i = graph->NumLinks; i > 0; i--)
+		    td->TurnFirst[i] = td->TurnFirst[i - 1];
+		td->TurnFirst[0] = 0;
+	    }
+	  for (i = 0; i < td->NumTurns; i++)
+	    {
+		RouteTDTurnPtr turn = td->Turns + i;
+		int kf = td_find_links (refs, graph->NumLinks, turn->FromRowid);
+		int kt = td_find_links (refs, graph->NumLinks, turn->ToRowid);
+		int f;
+		int t;
+		if (kf < 0 || kt < 0)
+		    continue;
+		for (f = kf;
+		     f < graph->NumLinks && refs[f * 2] == turn->FromRowid; f++)
+		  {
+		      int from = (int) refs[(f * 2) + 1];
+		      for (t = kt;
+			   t < graph->NumLinks
+			   && refs[t * 2] == turn->ToRowid; t++)
+			{
+			    int to = (int) refs[(t * 2) + 1];
+			    if (graph->Links[from].NodeTo !=
+				graph->Links[to].NodeFrom)
+				continue;	/* not a transition between these Links */
+			    if (pass == 0)
+				td->TurnFirst[from + 1] += 1;
+			    else
+			      {
+				  int ind = td->TurnFirst[from + 1]++;
+				  td->TurnLink[ind] = to;
+				  td->TurnCost[ind] = turn->Cost;
+			      }
+			}
+		  }
+	    }
+      }
+    free (refs);
+    free (td->ProfileRowid);
+    td->ProfileRowid = NULL;
+    free (td->Turns);
+    td->Turns = NULL;
+    return;
+
+  invalid:
+    td_free (td);
+    graph->TD = NULL;
+}
+
+static void
+network_free (RoutingPtr p)
+{
+/* memory cleanup; freeing any allocation for the network struct */
+    if (!p)
+	return;
+    if (p->Nodes)
+	free (p->Nodes);
+    if (p->CodesPool)
+	free (p->CodesPool);
+    if (p->Links)
+	free (p->Links);
+    if (p->LinkFirst)
+	free (p->LinkFirst);
+    if (p->LinkTarget)
+	free (p->LinkTarget);
+    if (p->LinkCost)
+	free (p->LinkCost);
+    if (p->RevFirst)
+	free (p->RevFirst);
+    if (p->RevLinks)
+	free (p->RevLinks);
+    if (p->TableName)
+	free (p->TableName);
+    if (p->FromColumn)
+	free (p->FromColumn);
+    if (p->ToColumn)
+	free (p->ToColumn);
+    if (p->GeometryColumn)
+	free (p->GeometryColumn);
+    if (p->NameColumn)
+	free (p->NameColumn);
+    ch_free (p->CH);
+    td_free (p->TD);
+    snap_index_free (p->SnapIndex);
+    free (p);
+}
+
+static RoutingPtr
+network_init (const unsigned char *blob, int size)
+{
+/* parsing the HEADER block */
+    RoutingPtr graph;
+    int net64;
+    int aStar = 0;
+    int nodes;
+    int node_code;
+    int max_code_length;
+    int endian_arch = gaiaEndianArch ();
+    const char *table;
+    const char *from;
+    const char *to;
+    const char *geom;
+    const char *name = NULL;
+    double a_star_coeff = 1.0;
+    int len;
+    int i;
+    const unsigned char *ptr;
+    if (size < 9)
+	return NULL;
+    if (*(blob + 0) == GAIA_NET_START)	/* signature - legacy format using 32bit ints */
+	net64 = 0;
+    else if (*(blob + 0) == GAIA_NET64_START)	/* signature - format using 64bit ints */
+	net64 = 1;
+    else if (*(blob + 0) == GAIA_NET64_A_STAR_START)	/* signature - format using 64bit ints AND supporting A* */
+      {
+	  net64 = 1;
+	  aStar = 1;
+      }
+    else
+	return NULL;
+    if (*(blob + 1) != GAIA_NET_HEADER)	/* signature */
+	return NULL;
+    nodes = gaiaImport32 (blob + 2, 1, endian_arch);	/* # nodes */
     if (nodes <= 0)
 	return NULL;
     if (*(blob + 6) == GAIA_NET_CODE)	/* Nodes identified by a TEXT code */
@@ -4897,10 +7084,25 @@ network_init (const unsigned char *blob, int size)
     graph->Nodes = malloc (sizeof (RouteNode) * nodes);
     for (i = 0; i < nodes; i++)
       {
+	  graph->Nodes[i].InternalIndex = -1;
 	  graph->Nodes[i].Code = NULL;
 	  graph->Nodes[i].NumLinks = 0;
 	  graph->Nodes[i].Links = NULL;
       }
+/* all Node Codes will be stored into a single pool */
+    if (node_code)
+	graph->CodesPool = malloc ((size_t) nodes * (max_code_length + 1));
+    else
+	graph->CodesPool = NULL;
+/* all Links will be stored into a single array */
+    graph->NumLinks = 0;
+    graph->MaxLinks = 0;
+    graph->Links = NULL;
+    graph->LinkFirst = malloc (sizeof (int) * (nodes + 1));
+    graph->LinkTarget = NULL;
+    graph->LinkCost = NULL;
+    graph->RevFirst = NULL;
+    graph->RevLinks = NULL;
     len = strlen (table);
     graph->TableName = malloc (len + 1);
     strcpy (graph->TableName, table);
@@ -4935,6 +7137,9 @@ network_init (const unsigned char *blob, int size)
 	    }
       }
     graph->AStarHeuristicCoeff = a_star_coeff;
+    graph->CH = NULL;
+    graph->TD = NULL;
+    graph->SnapIndex = NULL;
     return graph;
 }
 
@@ -4947,6 +7152,7 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
     int i;
     int ia;
     int index;
+    int first;
     char *code = NULL;
     double x;
     double y;
@@ -4954,7 +7160,6 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
     int links;
     RouteNodePtr pN;
     RouteLinkPtr pA;
-    int len;
     sqlite3_int64 linkId;
     int nodeToIdx;
     double cost;
@@ -4976,6 +7181,8 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
 	  in += 4;
 	  if (index < 0 || index >= graph->NumNodes)
 	      goto error;
+	  if (graph->Nodes[index].InternalIndex >= 0)
+	      goto error;	/* duplicate Node */
 	  if (graph->NodeCode)
 	    {
 		/* Nodes are identified by a TEXT Code */
@@ -5033,8 +7240,9 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
 	    {
 		/* Nodes are identified by a TEXT Code */
 		pN->Id = -1;
-		len = strlen (code);
-		pN->Code = malloc (len + 1);
+		pN->Code =
+		    graph->CodesPool +
+		    ((size_t) index * (graph->MaxCodeLength + 1));
 		strcpy (pN->Code, code);
 	    }
 	  else
@@ -5046,10 +7254,27 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
 	  pN->CoordX = x;
 	  pN->CoordY = y;
 	  pN->NumLinks = links;
+	  pN->Links = NULL;
+	  first = graph->NumLinks;
+	  graph->LinkFirst[index] = first;
 	  if (links)
 	    {
-		/* parsing the Links */
-		pN->Links = malloc (sizeof (RouteLink) * links);
+		/* parsing the Links; they'll be appended to the Links array */
+		if (graph->NumLinks + links > graph->MaxLinks)
+		  {
+		      int max = graph->MaxLinks * 2;
+		      RouteLinkPtr new_links;
+		      if (max < graph->NumLinks + links)
+			  max = graph->NumLinks + links;
+		      if (max < 4096)
+			  max = 4096;
+		      new_links =
+			  realloc (graph->Links, sizeof (RouteLink) * max);
+		      if (new_links == NULL)
+			  goto error;
+		      graph->Links = new_links;
+		      graph->MaxLinks = max;
+		  }
 		for (ia = 0; ia < links; ia++)
 		  {
 		      /* parsing each Link */
@@ -5081,7 +7306,7 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
 		      in += 8;
 		      if (*in++ != GAIA_NET_END)	/* signature */
 			  goto error;
-		      pA = pN->Links + ia;
+		      pA = graph->Links + first + ia;
 		      /* initializing the Link */
 		      if (nodeToIdx < 0 || nodeToIdx >= graph->NumNodes)
 			  goto error;
@@ -5090,9 +7315,8 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
 		      pA->LinkRowid = linkId;
 		      pA->Cost = cost;
 		  }
+		graph->NumLinks += links;
 	    }
-	  else
-	      pN->Links = NULL;
 	  if ((size - (in - blob)) < 1)
 	      goto error;
 	  if (*in++ != GAIA_NET_END)	/* signature */
@@ -5106,6 +7330,84 @@ network_block (RoutingPtr graph, const unsigned char *blob, int size)
     return 0;
 }
 
+static int
+network_finalize (RoutingPtr graph)
+{
+/* 
+/ completing the NETWORK once all Blocks have been parsed:
+/ building the CSR arrays (Links sorted by NodeFrom)
+*/
+    int i;
+    int j;
+    int k;
+    int sorted = 1;
+    RouteLinkPtr links;
+    for (i = 0, k = 0; i < graph->NumNodes; i++)
+      {
+	  RouteNodePtr pN = graph->Nodes + i;
+	  if (pN->InternalIndex != i)
+	      return 0;		/* missing Node */
+	  if (graph->LinkFirst[i] != k)
+	      sorted = 0;
+	  k += pN->NumLinks;
+      }
+    if (!sorted)
+      {
+	  /* Blocks out of order: rearranging the Links */
+	  links = malloc (sizeof (RouteLink) * (graph->NumLinks + 1));
+	  if (links == NULL)
+	      return 0;
+	  for (i = 0, k = 0; i < graph->NumNodes; i++)
+	    {
+		RouteNodePtr pN = graph->Nodes + i;
+		for (j = 0; j < pN->NumLinks; j++)
+		    links[k++] = graph->Links[graph->LinkFirst[i] + j];
+	    }
+	  free (graph->Links);
+	  graph->Links = links;
+	  graph->MaxLinks = graph->NumLinks + 1;
+      }
+    graph->LinkTarget = malloc (sizeof (int) * (graph->NumLinks + 1));
+    graph->LinkCost = malloc (sizeof (double) * (graph->NumLinks + 1));
+    if (graph->LinkTarget == NULL || graph->LinkCost == NULL)
+	return 0;
+    for (i = 0, k = 0; i < graph->NumNodes; i++)
+      {
+	  RouteNodePtr pN = graph->Nodes + i;
+	  graph->LinkFirst[i] = k;
+	  pN->Links = (pN->NumLinks > 0) ? graph->Links + k : NULL;
+	  for (j = 0; j < pN->NumLinks; j++, k++)
+	    {
+		RouteLinkPtr pA = graph->Links + k;
+		graph->LinkTarget[k] = pA->NodeTo->InternalIndex;
+		graph->LinkCost[k] = pA->Cost;
+	    }
+      }
+    graph->LinkFirst[graph->NumNodes] = k;
+
+/* the reverse CSR arrays (Links grouped by NodeTo) */
+    graph->RevFirst = calloc (graph->NumNodes + 1, sizeof (int));
+    graph->RevLinks = malloc (sizeof (int) * (graph->NumLinks + 1));
+    if (graph->RevFirst == NULL || graph->RevLinks == NULL)
+	return 0;
+    for (k = 0; k < graph->NumLinks; k++)
+	graph->RevFirst[graph->LinkTarget[k] + 1] += 1;
+    for (i = 0; i < graph->NumNodes; i++)
+	graph->RevFirst[i + 1] += graph->RevFirst[i];
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  for (k = graph->LinkFirst[i]; k < graph->LinkFirst[i + 1]; k++)
+	    {
+		int target = graph->LinkTarget[k];
+		graph->RevLinks[graph->RevFirst[target]++] = k;
+	    }
+      }
+    for (i = graph->NumNodes; i > 0; i--)
+	graph->RevFirst[i] = graph->RevFirst[i - 1];
+    graph->RevFirst[0] = 0;
+    return 1;
+}
+
 static RoutingPtr
 load_network (sqlite3 * handle, const char *table)
 {
@@ -5152,7 +7454,45 @@ load_network (sqlite3 * handle, const char *table)
 				  sqlite3_finalize (stmt);
 				  goto abort;
 			      }
-			    if (!network_block (graph, blob, size))
+			    if (size > 0 && *blob == GAIA_NET_CH_HEADER)
+			      {
+				  /* Contraction Hierarchies header */
+				  if (!ch_header (graph, blob, size))
+				    {
+					sqlite3_finalize (stmt);
+					goto abort;
+				    }
+			      }
+			    else if (size > 0 && *blob == GAIA_NET_CH_BLOCK)
+			      {
+				  /* Contraction Hierarchies data */
+				  if (!ch_block (graph, blob, size))
+				    {
+					sqlite3_finalize (stmt);
+					goto abort;
+				    }
+			      }
+			    else if (size > 0 && *blob == GAIA_NET_TD_HEADER)
+			      {
+				  /* Time Profiles and Turn Restrictions header */
+				  if (!td_header (graph, blob, size))
+				    {
+					sqlite3_finalize (stmt);
+					goto abort;
+				    }
+			      }
+			    else if (size > 0 && *blob == GAIA_NET_TD_BLOCK)
+			      {
+				  /* Time Profiles and Turn Restrictions data */
+				  if (!td_block (graph, blob, size))
+				    {
+					sqlite3_finalize (stmt);
+					goto abort;
+				    }
+			      }
+			    else if (size > 0 && *blob == GAIA_NET_REVISION)
+				;	/* UpdateRouting() revision: ignored */
+			    else if (!network_block (graph, blob, size))
 			      {
 				  sqlite3_finalize (stmt);
 				  goto abort;
@@ -5172,6 +7512,12 @@ load_network (sqlite3 * handle, const char *table)
 	    }
       }
     sqlite3_finalize (stmt);
+    if (!graph)
+	goto abort;
+    if (!network_finalize (graph))
+	goto abort;
+    ch_finalize (graph);
+    td_finalize (graph);
     srid = find_srid (handle, graph);
     graph->Srid = srid;
     return graph;
@@ -5180,52 +7526,1165 @@ load_network (sqlite3 * handle, const char *table)
     return NULL;
 }
 
-static void
-set_multi_by_id (RoutingMultiDestPtr multiple, RoutingPtr graph)
+static int
+routing_cache_signature (sqlite3 * handle, const char *table,
+			 int *schema_version, sqlite3_int64 * blocks,
+			 sqlite3_int64 * bytes, sqlite3_int64 * max_id)
 {
-// setting Node pointers to multiple destinations */
-    int i;
-    for (i = 0; i < multiple->Items; i++)
+/* 
+/ retrieving the current signature of some NETWORK table
+/
+/ PRAGMA data_version only makes sense within a single connection,
+/ so the schema_version (changed by any DROP/CREATE, thus by any
+/ CreateRouting) and the overall NetworkData size are checked;
+/ UpdateRouting() always moves the REVISION block at the end of
+/ the table, thus changing the max Id
+*/
+    sqlite3_stmt *stmt;
+    char *sql;
+    char *xname;
+    int ret;
+    int ok = 0;
+    ret =
+	sqlite3_prepare_v2 (handle, "PRAGMA schema_version", -1, &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
       {
-	  sqlite3_int64 id = *(multiple->Ids + i);
-	  if (id >= 1)
-	      *(multiple->To + i) = find_node_by_id (graph, id);
+	  *schema_version = sqlite3_column_int (stmt, 0);
+	  ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    if (!ok)
+	return 0;
+    ok = 0;
+    xname = gaiaDoubleQuotedSql (table);
+    sql =
+	sqlite3_mprintf
+	("SELECT Count(*), Sum(Length(NetworkData)), Max(Id) FROM main.\"%s\"",
+	 xname);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      {
+	  *blocks = sqlite3_column_int64 (stmt, 0);
+	  *bytes = sqlite3_column_int64 (stmt, 1);
+	  *max_id = sqlite3_column_int64 (stmt, 2);
+	  ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
+static void
+routing_cache_free_item (RoutingCacheItemPtr item)
+{
+/* memory cleanup; freeing a NETWORK cache item */
+    if (item->DbPath != NULL)
+	free (item->DbPath);
+    free (item->TableName);
+    network_free (item->Graph);
+    free (item);
+}
+
+static RoutingCacheItemPtr
+routing_cache_trim (const char *db_path, const char *table)
+{
+/* 
+/ detaching from the cache all idle items no longer needed: any
+/ private or outdated NETWORK, any previous version of the given 
+/ NETWORK, and then the least recently used ones exceeding the 
+/ max number of idle items
+/
+/ must be called while holding the cache semaphore; the detached
+/ items are returned so to be freed after releasing the semaphore
+*/
+    RoutingCacheItemPtr evicted = NULL;
+    RoutingCacheItemPtr item = routing_cache_first;
+    RoutingCacheItemPtr prev = NULL;
+    int idle = 0;
+    int current_seen = 0;
+    while (item != NULL)
+      {
+	  RoutingCacheItemPtr next = item->Next;
+	  int drop = 0;
+	  int matching = 0;
+	  if (db_path != NULL && item->DbPath != NULL
+	      && strcmp (item->DbPath, db_path) == 0
+	      && strcasecmp (item->TableName, table) == 0)
+	      matching = 1;
+	  if (item->RefCount == 0)
+	    {
+		if (item->DbPath == NULL || item->Outdated)
+		    drop = 1;
+		else if (matching && current_seen)
+		    drop = 1;	/* the first matching item is the most recent one */
+		if (!drop)
+		  {
+		      idle++;
+		      if (idle > VROUTE_CACHE_MAX_IDLE)
+			  drop = 1;
+		  }
+	    }
+	  if (matching)
+	      current_seen = 1;
+	  if (drop)
+	    {
+		if (prev == NULL)
+		    routing_cache_first = next;
+		else
+		    prev->Next = next;
+		item->Next = evicted;
+		evicted = item;
+	    }
+	  else
+	      prev = item;
+	  item = next;
+      }
+    return evicted;
+}
+
+static void
+routing_cache_free_list (RoutingCacheItemPtr item)
+{
+/* memory cleanup; freeing a list of detached cache items */
+    while (item != NULL)
+      {
+	  RoutingCacheItemPtr next = item->Next;
+	  routing_cache_free_item (item);
+	  item = next;
+      }
+}
+
+static RoutingCacheItemPtr
+routing_cache_find (const char *db_path, const char *table,
+		    int schema_version, sqlite3_int64 blocks,
+		    sqlite3_int64 bytes, sqlite3_int64 max_id)
+{
+/* 
+/ searching a matching NETWORK into the cache; when found it's
+/ moved in front of the list (most recently used)
+/
+/ must be called while holding the cache semaphore
+*/
+    RoutingCacheItemPtr item = routing_cache_first;
+    RoutingCacheItemPtr prev = NULL;
+    while (item != NULL)
+      {
+	  if (item->DbPath != NULL && !(item->Outdated)
+	      && strcmp (item->DbPath, db_path) == 0
+	      && strcasecmp (item->TableName, table) == 0
+	      && item->SchemaVersion == schema_version
+	      && item->Blocks == blocks && item->Bytes == bytes
+	      && item->MaxId == max_id)
+	    {
+		if (prev != NULL)
+		  {
+		      prev->Next = item->Next;
+		      item->Next = routing_cache_first;
+		      routing_cache_first = item;
+		  }
+		return item;
+	    }
+	  prev = item;
+	  item = item->Next;
+      }
+    return NULL;
+}
+
+static RoutingCacheItemPtr
+routing_cache_add (sqlite3 * handle, const char *db_path, const char *table,
+		   RoutingPtr graph)
+{
+/* 
+/ adding a NETWORK to the cache; a NULL db_path means a NETWORK
+/ private to a single connection (never shared)
+/
+/ must be called while holding the cache semaphore
+*/
+    RoutingCacheItemPtr item;
+    int len;
+    item = malloc (sizeof (RoutingCacheItem));
+    if (db_path == NULL)
+	item->DbPath = NULL;
+    else
+      {
+	  len = strlen (db_path);
+	  item->DbPath = malloc (len + 1);
+	  strcpy (item->DbPath, db_path);
+      }
+    item->Handle = handle;
+    len = strlen (table);
+    item->TableName = malloc (len + 1);
+    strcpy (item->TableName, table);
+    item->SchemaVersion = 0;
+    item->Blocks = 0;
+    item->Bytes = 0;
+    item->MaxId = 0;
+    item->Graph = graph;
+    item->RefCount = 1;
+    item->Outdated = 0;
+    item->Next = routing_cache_first;
+    routing_cache_first = item;
+    return item;
+}
+
+static RoutingPtr
+routing_cache_attach (sqlite3 * handle, const char *table)
+{
+/* 
+/ attaching a NETWORK: a previously loaded NETWORK will be
+/ directly shared (read-only) if still valid, otherwise
+/ the NETWORK will be loaded and then added to the cache
+/
+/ a NETWORK loaded from a MEMORY or TEMPORARY database, or while
+/ a transaction is pending (possibly containing uncommitted 
+/ changes), is never shared
+*/
+    const char *db_path;
+    int schema_version;
+    sqlite3_int64 blocks;
+    sqlite3_int64 bytes;
+    sqlite3_int64 max_id;
+    RoutingPtr graph;
+    RoutingCacheItemPtr item;
+    RoutingCacheItemPtr evicted;
+
+    db_path = sqlite3_db_filename (handle, "main");
+    if (db_path == NULL || *db_path == '\0' || !sqlite3_get_autocommit (handle)
+	|| !routing_cache_signature (handle, table, &schema_version, &blocks,
+				     &bytes, &max_id))
+      {
+	  /* a private NETWORK */
+	  graph = load_network (handle, table);
+	  if (graph == NULL)
+	      return NULL;
+	  splite_cache_semaphore_lock ();
+	  routing_cache_add (handle, NULL, table, graph);
+	  splite_cache_semaphore_unlock ();
+	  return graph;
+      }
+
+    splite_cache_semaphore_lock ();
+    item =
+	routing_cache_find (db_path, table, schema_version, blocks, bytes,
+			    max_id);
+    if (item != NULL)
+      {
+	  item->RefCount += 1;
+	  splite_cache_semaphore_unlock ();
+	  return item->Graph;
+      }
+    splite_cache_semaphore_unlock ();
+
+/* not yet cached: loading the NETWORK */
+    graph = load_network (handle, table);
+    if (graph == NULL)
+	return NULL;
+
+    splite_cache_semaphore_lock ();
+    item =
+	routing_cache_find (db_path, table, schema_version, blocks, bytes,
+			    max_id);
+    if (item != NULL)
+      {
+	  /* some other connection already cached the same NETWORK */
+	  item->RefCount += 1;
+	  splite_cache_semaphore_unlock ();
+	  network_free (graph);
+	  return item->Graph;
+      }
+    item = routing_cache_add (handle, db_path, table, graph);
+    item->SchemaVersion = schema_version;
+    item->Blocks = blocks;
+    item->Bytes = bytes;
+    item->MaxId = max_id;
+    evicted = routing_cache_trim (db_path, table);
+    splite_cache_semaphore_unlock ();
+    routing_cache_free_list (evicted);
+    return graph;
+}
+
+static int
+routing_cache_outdated (RoutingPtr graph)
+{
+/* checking if some NETWORK has been changed by UpdateRouting() */
+    RoutingCacheItemPtr item;
+    int outdated = 0;
+    splite_cache_semaphore_lock ();
+    item = routing_cache_first;
+    while (item != NULL)
+      {
+	  if (item->Graph == graph)
+	    {
+		outdated = item->Outdated;
+		break;
+	    }
+	  item = item->Next;
+      }
+    splite_cache_semaphore_unlock ();
+    return outdated;
+}
+
+static void
+routing_cache_release (RoutingPtr graph)
+{
+/* releasing a NETWORK; cached NETWORKs are kept alive while idle */
+    RoutingCacheItemPtr item;
+    RoutingCacheItemPtr evicted = NULL;
+    if (graph == NULL)
+	return;
+    splite_cache_semaphore_lock ();
+    item = routing_cache_first;
+    while (item != NULL)
+      {
+	  if (item->Graph == graph)
+	      break;
+	  item = item->Next;
+      }
+    if (item != NULL)
+      {
+	  item->RefCount -= 1;
+	  if (item->RefCount == 0)
+	      evicted = routing_cache_trim (NULL, NULL);
+      }
+    splite_cache_semaphore_unlock ();
+    if (item == NULL)
+      {
+	  /* not cached */
+	  network_free (graph);
+	  return;
+      }
+    routing_cache_free_list (evicted);
+}
+
+SPATIALITE_PRIVATE void
+splite_routing_cache_cleanup (void)
+{
+/* freeing all idle NETWORKs still cached */
+    RoutingCacheItemPtr evicted = NULL;
+    RoutingCacheItemPtr item;
+    RoutingCacheItemPtr prev = NULL;
+    splite_cache_semaphore_lock ();
+    item = routing_cache_first;
+    while (item != NULL)
+      {
+	  RoutingCacheItemPtr next = item->Next;
+	  if (item->RefCount == 0)
+	    {
+		if (prev == NULL)
+		    routing_cache_first = next;
+		else
+		    prev->Next = next;
+		item->Next = evicted;
+		evicted = item;
+	    }
+	  else
+	      prev = item;
+	  item = next;
+      }
+    splite_cache_semaphore_unlock ();
+    routing_cache_free_list (evicted);
+}
+
+SPATIALITE_PRIVATE void
+splite_routing_cache_outdate (const void *sqlite, const char *table)
+{
+/* 
+/ marking as outdated all NETWORKs loaded from some table just
+/ changed by UpdateRouting(): any VirtualRouting table still using 
+/ them will reload the NETWORK before its next query
+*/
+    sqlite3 *handle = (sqlite3 *) sqlite;
+    const char *db_path = sqlite3_db_filename (handle, "main");
+    RoutingCacheItemPtr item;
+    RoutingCacheItemPtr evicted;
+    splite_cache_semaphore_lock ();
+    item = routing_cache_first;
+    while (item != NULL)
+      {
+	  int matching = 0;
+	  if (item->DbPath == NULL)
+	    {
+		if (item->Handle == handle)
+		    matching = 1;
+	    }
+	  else if (db_path != NULL && strcmp (item->DbPath, db_path) == 0)
+	      matching = 1;
+	  if (matching && strcasecmp (item->TableName, table) == 0)
+	      item->Outdated = 1;
+	  item = item->Next;
+      }
+    evicted = routing_cache_trim (NULL, NULL);
+    splite_cache_semaphore_unlock ();
+    routing_cache_free_list (evicted);
+}
+
+static void
+set_multi_by_id (RoutingMultiDestPtr multiple, RoutingPtr graph)
+{
+// setting Node pointers to multiple destinations */
+    int i;
+    for (i = 0; i < multiple->Items; i++)
+      {
+	  sqlite3_int64 id = *(multiple->Ids + i);
+	  if (id >= 1)
+	      *(multiple->To + i) = find_node_by_id (graph, id);
+      }
+}
+
+static void
+set_multi_by_code (RoutingMultiDestPtr multiple, RoutingPtr graph)
+{
+// setting Node pointers to multiple destinations */
+    int i;
+    for (i = 0; i < multiple->Items; i++)
+      {
+	  const char *code = *(multiple->Codes + i);
+	  if (code != NULL)
+	      *(multiple->To + i) = find_node_by_code (graph, code);
+      }
+}
+
+static int
+do_check_valid_point (gaiaGeomCollPtr geom, int srid)
+{
+/* checking for a valid Point geometry */
+    if (geom == NULL)
+	return 0;
+    if (geom->FirstLinestring != NULL)
+	return 0;
+    if (geom->FirstPolygon != NULL)
+	return 0;
+    if (geom->FirstPoint == NULL)
+	return 0;
+    if (geom->FirstPoint != geom->LastPoint)
+	return 0;
+    if (geom->Srid != srid)
+	return 0;
+    return 1;
+}
+
+static int
+cmp_snap_rowid (const void *p1, const void *p2)
+{
+/* compares two Links by Rowid [sort] */
+    RouteLinkPtr pl1 = *((RouteLinkPtr *) p1);
+    RouteLinkPtr pl2 = *((RouteLinkPtr *) p2);
+    if (pl1->LinkRowid == pl2->LinkRowid)
+	return 0;
+    if (pl1->LinkRowid > pl2->LinkRowid)
+	return 1;
+    return -1;
+}
+
+static int
+cmp_snap_center_x (const void *p1, const void *p2)
+{
+/* compares two Link Geometries by MBR center X [sort] */
+    const RouteSnapLink *pl1 = (const RouteSnapLink *) p1;
+    const RouteSnapLink *pl2 = (const RouteSnapLink *) p2;
+    double c1 = pl1->MinX + pl1->MaxX;
+    double c2 = pl2->MinX + pl2->MaxX;
+    if (c1 == c2)
+	return 0;
+    if (c1 > c2)
+	return 1;
+    return -1;
+}
+
+static int
+cmp_snap_center_y (const void *p1, const void *p2)
+{
+/* compares two Link Geometries by MBR center Y [sort] */
+    const RouteSnapLink *pl1 = (const RouteSnapLink *) p1;
+    const RouteSnapLink *pl2 = (const RouteSnapLink *) p2;
+    double c1 = pl1->MinY + pl1->MaxY;
+    double c2 = pl2->MinY + pl2->MaxY;
+    if (c1 == c2)
+	return 0;
+    if (c1 > c2)
+	return 1;
+    return -1;
+}
+
+static int
+snap_dims (int dimension_model)
+{
+/* how many doubles for each vertex */
+    switch (dimension_model)
+      {
+      case GAIA_XY_Z:
+      case GAIA_XY_M:
+	  return 3;
+      case GAIA_XY_Z_M:
+	  return 4;
+      };
+    return 2;
+}
+
+static void
+snap_node_extend (RouteSnapNodePtr node, double minx, double miny,
+		  double maxx, double maxy)
+{
+/* extending the MBR of some R-Tree node */
+    if (minx < node->MinX)
+	node->MinX = minx;
+    if (miny < node->MinY)
+	node->MinY = miny;
+    if (maxx > node->MaxX)
+	node->MaxX = maxx;
+    if (maxy > node->MaxY)
+	node->MaxY = maxy;
+}
+
+static int
+snap_link_matches (RoutingPtr graph, RouteLinkPtr link, sqlite3_stmt * stmt,
+		   int from_col, int to_col)
+{
+/* checking if a Link joins the two Nodes of the current input row */
+    if (graph->NodeCode)
+      {
+	  if (sqlite3_column_type (stmt, from_col) != SQLITE_TEXT
+	      || sqlite3_column_type (stmt, to_col) != SQLITE_TEXT)
+	      return 0;
+	  if (strcmp
+	      (link->NodeFrom->Code,
+	       (const char *) sqlite3_column_text (stmt, from_col)) == 0
+	      && strcmp (link->NodeTo->Code,
+			 (const char *) sqlite3_column_text (stmt,
+							     to_col)) == 0)
+	      return 1;
+	  return 0;
+      }
+    if (sqlite3_column_type (stmt, from_col) != SQLITE_INTEGER
+	|| sqlite3_column_type (stmt, to_col) != SQLITE_INTEGER)
+	return 0;
+    if (link->NodeFrom->Id == sqlite3_column_int64 (stmt, from_col)
+	&& link->NodeTo->Id == sqlite3_column_int64 (stmt, to_col))
+	return 1;
+    return 0;
+}
+
+static int
+snap_index_pack (RouteSnapIndexPtr index)
+{
+/* building the packed R-Tree (Sort-Tile-Recursive) */
+    int leaves;
+    int slices;
+    int slice_size;
+    int level_first;
+    int level_count;
+    int num_nodes;
+    int i;
+    int j;
+    RouteSnapNodePtr node;
+
+    if (index->NumLinks == 0)
+	return 1;
+
+/* sorting the Links by vertical slices, then each slice by Y */
+    leaves =
+	(index->NumLinks + VROUTE_SNAP_FANOUT - 1) / VROUTE_SNAP_FANOUT;
+    slices = (int) ceil (sqrt ((double) leaves));
+    slice_size = slices * VROUTE_SNAP_FANOUT;
+    qsort (index->Links, index->NumLinks, sizeof (RouteSnapLink),
+	   cmp_snap_center_x);
+    for (i = 0; i < index->NumLinks; i += slice_size)
+      {
+	  int count = index->NumLinks - i;
+	  if (count > slice_size)
+	      count = slice_size;
+	  qsort (index->Links + i, count, sizeof (RouteSnapLink),
+		 cmp_snap_center_y);
+      }
+
+/* counting the nodes of all levels */
+    num_nodes = 0;
+    level_count = leaves;
+    while (1)
+      {
+	  num_nodes += level_count;
+	  if (level_count == 1)
+	      break;
+	  level_count =
+	      (level_count + VROUTE_SNAP_FANOUT - 1) / VROUTE_SNAP_FANOUT;
+      }
+    index->Nodes = malloc (sizeof (RouteSnapNode) * num_nodes);
+    if (index->Nodes == NULL)
+	return 0;
+    index->NumNodes = num_nodes;
+    index->NumLeaves = leaves;
+
+/* leaf nodes: consecutive Links */
+    for (i = 0; i < leaves; i++)
+      {
+	  node = index->Nodes + i;
+	  node->First = i * VROUTE_SNAP_FANOUT;
+	  node->Count = index->NumLinks - node->First;
+	  if (node->Count > VROUTE_SNAP_FANOUT)
+	      node->Count = VROUTE_SNAP_FANOUT;
+	  node->MinX = DBL_MAX;
+	  node->MinY = DBL_MAX;
+	  node->MaxX = -DBL_MAX;
+	  node->MaxY = -DBL_MAX;
+	  for (j = node->First; j < node->First + node->Count; j++)
+	    {
+		RouteSnapLinkPtr link = index->Links + j;
+		snap_node_extend (node, link->MinX, link->MinY, link->MaxX,
+				  link->MaxY);
+	    }
+      }
+
+/* upper levels: consecutive nodes of the level below */
+    level_first = 0;
+    level_count = leaves;
+    num_nodes = leaves;
+    while (level_count > 1)
+      {
+	  int parents =
+	      (level_count + VROUTE_SNAP_FANOUT - 1) / VROUTE_SNAP_FANOUT;
+	  for (i = 0; i < parents; i++)
+	    {
+		node = index->Nodes + num_nodes + i;
+		node->First = level_first + (i * VROUTE_SNAP_FANOUT);
+		node->Count = level_first + level_count - node->First;
+		if (node->Count > VROUTE_SNAP_FANOUT)
+		    node->Count = VROUTE_SNAP_FANOUT;
+		node->MinX = DBL_MAX;
+		node->MinY = DBL_MAX;
+		node->MaxX = -DBL_MAX;
+		node->MaxY = -DBL_MAX;
+		for (j = node->First; j < node->First + node->Count; j++)
+		  {
+		      RouteSnapNodePtr child = index->Nodes + j;
+		      snap_node_extend (node, child->MinX, child->MinY,
+					child->MaxX, child->MaxY);
+		  }
+	    }
+	  level_first = num_nodes;
+	  level_count = parents;
+	  num_nodes += parents;
+      }
+    return 1;
+}
+
+static RouteSnapIndexPtr
+snap_index_build (sqlite3 * handle, RoutingPtr graph)
+{
+/* loading all Link Geometries into a new snapping index */
+    RouteSnapIndexPtr index;
+    RouteLinkPtr *by_rowid = NULL;
+    char *sql;
+    char *xfrom;
+    char *xto;
+    char *xgeom;
+    char *xtable;
+    sqlite3_stmt *stmt = NULL;
+    int ret;
+    int i;
+    int max_links = 0;
+    int max_coords = 0;
+    int num_coords = 0;
+    int is_geographic = 0;
+
+    if (graph->GeometryColumn == NULL || graph->NumLinks <= 0)
+	return NULL;
+    if (!srid_is_geographic (handle, graph->Srid, &is_geographic))
+	return NULL;
+
+    index = malloc (sizeof (RouteSnapIndex));
+    if (index == NULL)
+	return NULL;
+    index->Srid = graph->Srid;
+    index->Geographic = is_geographic;
+    index->NumLinks = 0;
+    index->Links = NULL;
+    index->Coords = NULL;
+    index->NumLeaves = 0;
+    index->NumNodes = 0;
+    index->Nodes = NULL;
+
+/* sorting all Links by Rowid */
+    by_rowid = malloc (sizeof (RouteLinkPtr) * graph->NumLinks);
+    if (by_rowid == NULL)
+	goto error;
+    for (i = 0; i < graph->NumLinks; i++)
+	by_rowid[i] = graph->Links + i;
+    qsort (by_rowid, graph->NumLinks, sizeof (RouteLinkPtr), cmp_snap_rowid);
+
+    xfrom = gaiaDoubleQuotedSql (graph->FromColumn);
+    xto = gaiaDoubleQuotedSql (graph->ToColumn);
+    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
+    xtable = gaiaDoubleQuotedSql (graph->TableName);
+    sql =
+	sqlite3_mprintf ("SELECT rowid, \"%s\", \"%s\", \"%s\" FROM \"%s\"",
+			 xfrom, xto, xgeom, xtable);
+    free (xfrom);
+    free (xto);
+    free (xgeom);
+    free (xtable);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  sqlite3_int64 rowid;
+	  int direct = -1;
+	  int reverse = -1;
+	  int lo;
+	  int hi;
+	  int dims;
+	  int iv;
+	  const unsigned char *blob;
+	  int size;
+	  gaiaGeomCollPtr geom;
+	  gaiaLinestringPtr ln;
+	  RouteSnapLinkPtr link;
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret != SQLITE_ROW)
+	      goto error;
+	  if (sqlite3_column_type (stmt, 3) != SQLITE_BLOB)
+	      continue;
+	  rowid = sqlite3_column_int64 (stmt, 0);
+
+	  /* identifying the Links corresponding to this row */
+	  lo = 0;
+	  hi = graph->NumLinks;
+	  while (lo < hi)
+	    {
+		int mid = lo + ((hi - lo) / 2);
+		if (by_rowid[mid]->LinkRowid < rowid)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	  for (; lo < graph->NumLinks && by_rowid[lo]->LinkRowid == rowid; lo++)
+	    {
+		if (direct < 0
+		    && snap_link_matches (graph, by_rowid[lo], stmt, 1, 2))
+		    direct = by_rowid[lo] - graph->Links;
+		else if (reverse < 0
+			 && snap_link_matches (graph, by_rowid[lo], stmt, 2,
+					       1))
+		    reverse = by_rowid[lo] - graph->Links;
+	    }
+	  if (direct < 0 && reverse < 0)
+	      continue;
+
+	  blob = sqlite3_column_blob (stmt, 3);
+	  size = sqlite3_column_bytes (stmt, 3);
+	  geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+	  if (geom == NULL)
+	      continue;
+	  ln = geom->FirstLinestring;
+	  if (ln == NULL || ln->Points < 2)
+	    {
+		gaiaFreeGeomColl (geom);
+		continue;
+	    }
+	  dims = snap_dims (ln->DimensionModel);
+
+	  /* copying the Link Geometry */
+	  if (index->NumLinks == max_links)
+	    {
+		RouteSnapLinkPtr links;
+		max_links = (max_links == 0) ? 1024 : max_links * 2;
+		links =
+		    realloc (index->Links, sizeof (RouteSnapLink) * max_links);
+		if (links == NULL)
+		  {
+		      gaiaFreeGeomColl (geom);
+		      goto error;
+		  }
+		index->Links = links;
+	    }
+	  if (num_coords + (ln->Points * dims) > max_coords)
+	    {
+		double *coords;
+		if (max_coords == 0)
+		    max_coords = 16384;
+		while (num_coords + (ln->Points * dims) > max_coords)
+		    max_coords *= 2;
+		coords = realloc (index->Coords, sizeof (double) * max_coords);
+		if (coords == NULL)
+		  {
+		      gaiaFreeGeomColl (geom);
+		      goto error;
+		  }
+		index->Coords = coords;
+	    }
+	  link = index->Links + index->NumLinks;
+	  link->LinkRowid = rowid;
+	  link->Direct = direct;
+	  link->Reverse = reverse;
+	  link->DimensionModel = ln->DimensionModel;
+	  link->Points = ln->Points;
+	  link->Offset = num_coords;
+	  link->MinX = DBL_MAX;
+	  link->MinY = DBL_MAX;
+	  link->MaxX = -DBL_MAX;
+	  link->MaxY = -DBL_MAX;
+	  memcpy (index->Coords + num_coords, ln->Coords,
+		  sizeof (double) * ln->Points * dims);
+	  for (iv = 0; iv < ln->Points; iv++)
+	    {
+		double x = index->Coords[num_coords + (iv * dims)];
+		double y = index->Coords[num_coords + (iv * dims) + 1];
+		if (x < link->MinX)
+		    link->MinX = x;
+		if (y < link->MinY)
+		    link->MinY = y;
+		if (x > link->MaxX)
+		    link->MaxX = x;
+		if (y > link->MaxY)
+		    link->MaxY = y;
+	    }
+	  num_coords += ln->Points * dims;
+	  index->NumLinks += 1;
+	  gaiaFreeGeomColl (geom);
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    free (by_rowid);
+    by_rowid = NULL;
+
+    if (!snap_index_pack (index))
+	goto error;
+    return index;
+
+  error:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (by_rowid != NULL)
+	free (by_rowid);
+    snap_index_free (index);
+    return NULL;
+}
+
+static RouteSnapIndexPtr
+snap_index_attach (sqlite3 * handle, RoutingPtr graph)
+{
+/* 
+/ returning the snapping index of a NETWORK, building it on first use
+/ (the NETWORK could be shared, so the index is published under the
+/ cache lock and then never modified)
+*/
+    RouteSnapIndexPtr index;
+    RouteSnapIndexPtr other;
+
+    splite_cache_semaphore_lock ();
+    index = graph->SnapIndex;
+    splite_cache_semaphore_unlock ();
+    if (index != NULL)
+	return index;
+
+    index = snap_index_build (handle, graph);
+    if (index == NULL)
+	return NULL;
+    splite_cache_semaphore_lock ();
+    other = graph->SnapIndex;
+    if (other == NULL)
+	graph->SnapIndex = index;
+    splite_cache_semaphore_unlock ();
+    if (other != NULL)
+      {
+	  /* some other connection already built the same index */
+	  snap_index_free (index);
+	  return other;
+      }
+    return index;
+}
+
+static double
+snap_mbr_distance (double minx, double miny, double maxx, double maxy,
+		   double x, double y)
+{
+/* minimum distance between a Point and some MBR */
+    double dx = 0.0;
+    double dy = 0.0;
+    if (x < minx)
+	dx = minx - x;
+    else if (x > maxx)
+	dx = x - maxx;
+    if (y < miny)
+	dy = miny - y;
+    else if (y > maxy)
+	dy = y - maxy;
+    return sqrt ((dx * dx) + (dy * dy));
+}
+
+static double
+snap_link_locate (RouteSnapIndexPtr index, RouteSnapLinkPtr link, double x,
+		  double y, double *fraction)
+{
+/* 
+/ projecting a Point on some Link Geometry: returns the distance, 
+/ the projection being a fraction of the total 2D length
+*/
+    const double *coords = index->Coords + link->Offset;
+    int dims = snap_dims (link->DimensionModel);
+    double min_dist = DBL_MAX;
+    double position = 0.0;
+    double length = 0.0;
+    int iv;
+    for (iv = 1; iv < link->Points; iv++)
+      {
+	  double x0 = coords[(iv - 1) * dims];
+	  double y0 = coords[((iv - 1) * dims) + 1];
+	  double dx = coords[iv * dims] - x0;
+	  double dy = coords[(iv * dims) + 1] - y0;
+	  double seg = (dx * dx) + (dy * dy);
+	  double t = 0.0;
+	  double px;
+	  double py;
+	  double dist;
+	  if (seg > 0.0)
+	    {
+		t = (((x - x0) * dx) + ((y - y0) * dy)) / seg;
+		if (t < 0.0)
+		    t = 0.0;
+		if (t > 1.0)
+		    t = 1.0;
+	    }
+	  px = x0 + (t * dx) - x;
+	  py = y0 + (t * dy) - y;
+	  dist = (px * px) + (py * py);
+	  seg = sqrt (seg);
+	  if (dist < min_dist)
+	    {
+		min_dist = dist;
+		position = length + (t * seg);
+	    }
+	  length += seg;
+      }
+    if (length > 0.0)
+	*fraction = position / length;
+    else
+	*fraction = 0.0;
+    return sqrt (min_dist);
+}
+
+static void
+snap_add_candidate (RouteSnapCandidatePtr candidates, int *count,
+		    RouteSnapLinkPtr link, double distance, double fraction)
+{
+/* inserting a Link into the (ascending distance) candidates list */
+    int pos = *count;
+    if (pos == VROUTE_SNAP_CANDIDATES)
+      {
+	  RouteSnapCandidatePtr last = candidates + (pos - 1);
+	  if (distance > last->Distance)
+	      return;
+	  if (distance == last->Distance
+	      && link->LinkRowid > last->Link->LinkRowid)
+	      return;
+	  pos--;
+      }
+    else
+	*count += 1;
+    while (pos > 0)
+      {
+	  RouteSnapCandidatePtr prev = candidates + (pos - 1);
+	  if (prev->Distance < distance)
+	      break;
+	  if (prev->Distance == distance
+	      && prev->Link->LinkRowid < link->LinkRowid)
+	      break;
+	  candidates[pos] = *prev;
+	  pos--;
+      }
+    candidates[pos].Link = link;
+    candidates[pos].Distance = distance;
+    candidates[pos].Fraction = fraction;
+}
+
+static int
+snap_index_query (RouteSnapIndexPtr index, double x, double y,
+		  double tolerance, RouteSnapCandidatePtr candidates)
+{
+/* searching the nearest Links within Tolerance */
+    int stack[VROUTE_SNAP_FANOUT * 16];
+    int depth = 0;
+    int count = 0;
+    double limit = tolerance;
+
+    if (index->NumNodes == 0)
+	return 0;
+    stack[depth++] = index->NumNodes - 1;
+    while (depth > 0)
+      {
+	  int i;
+	  int node_index = stack[--depth];
+	  RouteSnapNodePtr node = index->Nodes + node_index;
+	  if (snap_mbr_distance
+	      (node->MinX, node->MinY, node->MaxX, node->MaxY, x, y) > limit)
+	      continue;
+	  for (i = node->First; i < node->First + node->Count; i++)
+	    {
+		if (node_index < index->NumLeaves)
+		  {
+		      /* leaf node: testing the Link Geometry */
+		      double dist;
+		      double fraction;
+		      RouteSnapLinkPtr link = index->Links + i;
+		      if (snap_mbr_distance
+			  (link->MinX, link->MinY, link->MaxX, link->MaxY, x,
+			   y) > limit)
+			  continue;
+		      dist = snap_link_locate (index, link, x, y, &fraction);
+		      if (dist > limit)
+			  continue;
+		      snap_add_candidate (candidates, &count, link, dist,
+					  fraction);
+		      if (count == VROUTE_SNAP_CANDIDATES)
+			  limit = candidates[count - 1].Distance;
+		  }
+		else
+		    stack[depth++] = i;
+	    }
+      }
+    return count;
+}
+
+static void
+snap_interpolate (const double *coords, int dims, int points,
+		  double position, double *vertex)
+{
+/* interpolating a vertex at some 2D distance along a Link Geometry */
+    double progr = 0.0;
+    int iv;
+    int k;
+    for (iv = 1; iv < points; iv++)
+      {
+	  const double *p0 = coords + ((iv - 1) * dims);
+	  const double *p1 = coords + (iv * dims);
+	  double dx = p1[0] - p0[0];
+	  double dy = p1[1] - p0[1];
+	  double seg = sqrt ((dx * dx) + (dy * dy));
+	  if (seg > 0.0 && progr + seg >= position)
+	    {
+		double t = (position - progr) / seg;
+		if (t < 0.0)
+		    t = 0.0;
+		if (t > 1.0)
+		    t = 1.0;
+		for (k = 0; k < dims; k++)
+		    vertex[k] = p0[k] + ((p1[k] - p0[k]) * t);
+		return;
+	    }
+	  progr += seg;
       }
+/* beyond the last vertex */
+    for (k = 0; k < dims; k++)
+	vertex[k] = coords[((points - 1) * dims) + k];
 }
 
 static void
-set_multi_by_code (RoutingMultiDestPtr multiple, RoutingPtr graph)
-{
-// setting Node pointers to multiple destinations */
-    int i;
-    for (i = 0; i < multiple->Items; i++)
-      {
-	  const char *code = *(multiple->Codes + i);
-	  if (code != NULL)
-	      *(multiple->To + i) = find_node_by_code (graph, code);
-      }
+snap_set_vertex (gaiaLinestringPtr ln, int iv, const double *vertex)
+{
+/* setting a vertex into the output Linestring */
+    switch (ln->DimensionModel)
+      {
+      case GAIA_XY_Z:
+	  gaiaSetPointXYZ (ln->Coords, iv, vertex[0], vertex[1], vertex[2]);
+	  break;
+      case GAIA_XY_M:
+	  gaiaSetPointXYM (ln->Coords, iv, vertex[0], vertex[1], vertex[2]);
+	  break;
+      case GAIA_XY_Z_M:
+	  gaiaSetPointXYZM (ln->Coords, iv, vertex[0], vertex[1], vertex[2],
+			    vertex[3]);
+	  break;
+      default:
+	  gaiaSetPoint (ln->Coords, iv, vertex[0], vertex[1]);
+	  break;
+      };
 }
 
-static int
-do_check_valid_point (gaiaGeomCollPtr geom, int srid)
+static gaiaGeomCollPtr
+snap_link_substring (RouteSnapIndexPtr index, RouteSnapLinkPtr link,
+		     double start, double end)
 {
-/* checking for a valid Point geometry */
-    if (geom == NULL)
-	return 0;
-    if (geom->FirstLinestring != NULL)
-	return 0;
-    if (geom->FirstPolygon != NULL)
-	return 0;
-    if (geom->FirstPoint == NULL)
-	return 0;
-    if (geom->FirstPoint != geom->LastPoint)
-	return 0;
-    if (geom->Srid != srid)
-	return 0;
-    return 1;
+/* 
+/ building the Linestring between two fractions (of the total
+/ 2D length) of some Link Geometry; always preserving its direction
+*/
+    const double *coords = index->Coords + link->Offset;
+    int dims = snap_dims (link->DimensionModel);
+    double length = 0.0;
+    double progr;
+    double vertex[4];
+    int count = 2;
+    int iv;
+    int out;
+    gaiaGeomCollPtr geom;
+    gaiaLinestringPtr ln;
+
+    for (iv = 1; iv < link->Points; iv++)
+      {
+	  double dx = coords[iv * dims] - coords[(iv - 1) * dims];
+	  double dy = coords[(iv * dims) + 1] - coords[((iv - 1) * dims) + 1];
+	  length += sqrt ((dx * dx) + (dy * dy));
+      }
+    start *= length;
+    end *= length;
+
+/* counting the intermediate vertices */
+    progr = 0.0;
+    for (iv = 1; iv < link->Points - 1; iv++)
+      {
+	  double dx = coords[iv * dims] - coords[(iv - 1) * dims];
+	  double dy = coords[(iv * dims) + 1] - coords[((iv - 1) * dims) + 1];
+	  progr += sqrt ((dx * dx) + (dy * dy));
+	  if (progr > start && progr < end)
+	      count++;
+      }
+
+    switch (link->DimensionModel)
+      {
+      case GAIA_XY_Z:
+	  geom = gaiaAllocGeomCollXYZ ();
+	  break;
+      case GAIA_XY_M:
+	  geom = gaiaAllocGeomCollXYM ();
+	  break;
+      case GAIA_XY_Z_M:
+	  geom = gaiaAllocGeomCollXYZM ();
+	  break;
+      default:
+	  geom = gaiaAllocGeomColl ();
+	  break;
+      };
+    geom->Srid = index->Srid;
+    ln = gaiaAddLinestringToGeomColl (geom, count);
+
+    snap_interpolate (coords, dims, link->Points, start, vertex);
+    snap_set_vertex (ln, 0, vertex);
+    out = 1;
+    progr = 0.0;
+    for (iv = 1; iv < link->Points - 1; iv++)
+      {
+	  double dx = coords[iv * dims] - coords[(iv - 1) * dims];
+	  double dy = coords[(iv * dims) + 1] - coords[((iv - 1) * dims) + 1];
+	  progr += sqrt ((dx * dx) + (dy * dy));
+	  if (progr > start && progr < end)
+	      snap_set_vertex (ln, out++, coords + (iv * dims));
+      }
+    snap_interpolate (coords, dims, link->Points, end, vertex);
+    snap_set_vertex (ln, out, vertex);
+    return geom;
 }
 
-static void
+static Point2PointCandidatePtr
 add_by_code_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
 			    const char *node_from, const char *node_to,
 			    int reverse, int mode)
@@ -5247,6 +8706,8 @@ add_by_code_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
     p->pathLen = 0.0;
     p->extraLen = 0.0;
     p->percent = 0.0;
+    p->linkCost = 0.0;
+    p->snap = NULL;
     p->next = NULL;
 /* adding to the list */
     if (mode == VROUTE_POINT2POINT_FROM)
@@ -5265,49 +8726,10 @@ add_by_code_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
 	      p2p->lastToCandidate->next = p;
 	  p2p->lastToCandidate = p;
       }
+    return p;
 }
 
-static int
-do_check_by_code_point2point_oneway (RoutingPtr graph, sqlite3_int64 rowid,
-				     const char *node_from, const char *node_to)
-{
-/* checking if the Link do really joins the two nodes */
-    int j;
-    RouteNodePtr node = find_node_by_code (graph, node_from);
-    if (node == NULL)
-	return 0;
-    for (j = 0; j < node->NumLinks; j++)
-      {
-	  RouteLinkPtr link = &(node->Links[j]);
-	  if (strcmp (link->NodeFrom->Code, node_from) == 0
-	      && strcmp (link->NodeTo->Code, node_to) == 0
-	      && link->LinkRowid == rowid)
-	      return 1;
-      }
-    return 0;
-}
-
-static int
-do_check_by_id_point2point_oneway (RoutingPtr graph, sqlite3_int64 rowid,
-				   sqlite3_int64 node_from,
-				   sqlite3_int64 node_to)
-{
-/* checking if the Link do really joins the two nodes */
-    int j;
-    RouteNodePtr node = find_node_by_id (graph, node_from);
-    if (node == NULL)
-	return 0;
-    for (j = 0; j < node->NumLinks; j++)
-      {
-	  RouteLinkPtr link = &(node->Links[j]);
-	  if (link->NodeFrom->Id == node_from && link->NodeTo->Id == node_to
-	      && link->LinkRowid == rowid)
-	      return 1;
-      }
-    return 0;
-}
-
-static void
+static Point2PointCandidatePtr
 add_by_id_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
 			  sqlite_int64 node_from, sqlite3_int64 node_to,
 			  int reverse, int mode)
@@ -5326,6 +8748,8 @@ add_by_id_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
     p->pathLen = 0.0;
     p->extraLen = 0.0;
     p->percent = 0.0;
+    p->linkCost = 0.0;
+    p->snap = NULL;
     p->next = NULL;
 /* adding to the list */
     if (mode == VROUTE_POINT2POINT_FROM)
@@ -5344,502 +8768,140 @@ add_by_id_to_point2point (virtualroutingPtr net, sqlite3_int64 rowid,
 	      p2p->lastToCandidate->next = p;
 	  p2p->lastToCandidate = p;
       }
+    return p;
 }
 
-static int
-do_prepare_point (virtualroutingPtr net, int mode)
+static void
+add_snapped_to_point2point (virtualroutingPtr net,
+			    RouteSnapCandidatePtr candidate, int reverse,
+			    int mode)
 {
-/* preparing a Point for Point2Point */
+/* adding to the Point2Point list a Link found by the snapping index */
     RoutingPtr graph = net->graph;
-    Point2PointSolutionPtr p2p = net->point2PointSolution;
-    char *xfrom;
-    char *xto;
-    char *xtable;
-    char *xgeom;
-    char *sql;
-    int ret;
-    int ok = 0;
-    sqlite3 *sqlite = net->db;
-    sqlite3_stmt *stmt = NULL;
-
-    xfrom = gaiaDoubleQuotedSql (graph->FromColumn);
-    xto = gaiaDoubleQuotedSql (graph->ToColumn);
-    xtable = gaiaDoubleQuotedSql (graph->TableName);
-    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-    sql = sqlite3_mprintf ("SELECT r.rowid, r.\"%s\", r.\"%s\", "
-			   "ST_Distance(p.geom, r.\"%s\") AS dist "
-			   "FROM \"%s\" AS r, (SELECT MakePoint(?, ?) AS geom) AS p "
-			   "WHERE dist <= ? AND r.rowid IN "
-			   "(SELECT rowid FROM SpatialIndex WHERE f_table_name = %Q  AND "
-			   "f_geometry_column = %Q AND search_frame = BuildCircleMBR(?, ?, ?)) "
-			   "ORDER BY dist LIMIT 4", xfrom, xto, xgeom, xtable,
-			   graph->TableName, graph->GeometryColumn);
-    free (xfrom);
-    free (xto);
-    free (xtable);
-    free (xgeom);
-    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-      {
-	  return 0;
-      }
-
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    if (mode == VROUTE_POINT2POINT_FROM)
-      {
-	  sqlite3_bind_double (stmt, 1, p2p->xFrom);
-	  sqlite3_bind_double (stmt, 2, p2p->yFrom);
-	  sqlite3_bind_double (stmt, 3, net->Tolerance);
-	  sqlite3_bind_double (stmt, 4, p2p->xFrom);
-	  sqlite3_bind_double (stmt, 5, p2p->yFrom);
-	  sqlite3_bind_double (stmt, 6, net->Tolerance);
-      }
+    RouteSnapLinkPtr snap = candidate->Link;
+    RouteLinkPtr link;
+    Point2PointCandidatePtr p;
+    if (reverse)
+	link = graph->Links + snap->Reverse;
     else
-      {
-	  sqlite3_bind_double (stmt, 1, p2p->xTo);
-	  sqlite3_bind_double (stmt, 2, p2p->yTo);
-	  sqlite3_bind_double (stmt, 3, net->Tolerance);
-	  sqlite3_bind_double (stmt, 4, p2p->xTo);
-	  sqlite3_bind_double (stmt, 5, p2p->yTo);
-	  sqlite3_bind_double (stmt, 6, net->Tolerance);
-      }
-    while (1)
-      {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		int ok_node_from = 0;
-		int ok_node_to = 0;
-		const char *cod_node_from;
-		const char *cod_node_to;
-		sqlite3_int64 id_node_from;
-		sqlite3_int64 id_node_to;
-
-		sqlite3_int64 rowid = sqlite3_column_int64 (stmt, 0);
-		if (graph->NodeCode)
-		  {
-		      if (sqlite3_column_type (stmt, 1) == SQLITE_TEXT)
-			{
-			    ok_node_from = 1;
-			    cod_node_from =
-				(const char *) sqlite3_column_text (stmt, 1);
-			}
-		      if (sqlite3_column_type (stmt, 2) == SQLITE_TEXT)
-			{
-			    ok_node_to = 1;
-			    cod_node_to =
-				(const char *) sqlite3_column_text (stmt, 2);
-			}
-		  }
-		else
-		  {
-		      if (sqlite3_column_type (stmt, 1) == SQLITE_INTEGER)
-			{
-			    ok_node_from = 1;
-			    id_node_from = sqlite3_column_int64 (stmt, 1);
-			}
-		      if (sqlite3_column_type (stmt, 2) == SQLITE_INTEGER)
-			{
-			    ok_node_to = 1;
-			    id_node_to = sqlite3_column_int64 (stmt, 2);
-			}
-		  }
-		if (ok_node_from && ok_node_to)
-		  {
-		      if (graph->NodeCode)
-			{
-			    /* direct connection */
-			    if (do_check_by_code_point2point_oneway
-				(graph, rowid, cod_node_from, cod_node_to))
-			      {
-				  add_by_code_to_point2point (net, rowid,
-							      cod_node_from,
-							      cod_node_to, 0,
-							      mode);
-				  ok = 1;
-			      }
-			    /* reverse connection */
-			    if (do_check_by_code_point2point_oneway
-				(graph, rowid, cod_node_to, cod_node_from))
-			      {
-				  add_by_code_to_point2point (net, rowid,
-							      cod_node_to,
-							      cod_node_from, 1,
-							      mode);
-				  ok = 1;
-			      }
-			}
-		      else
-			{
-			    /* direct connection */
-			    if (do_check_by_id_point2point_oneway
-				(graph, rowid, id_node_from, id_node_to))
-			      {
-				  add_by_id_to_point2point (net, rowid,
-							    id_node_from,
-							    id_node_to, 0,
-							    mode);
-				  ok = 1;
-			      }
-			    /* reverse connection */
-			    if (do_check_by_id_point2point_oneway
-				(graph, rowid, id_node_to, id_node_from))
-			      {
-				  add_by_id_to_point2point (net, rowid,
-							    id_node_to,
-							    id_node_from, 1,
-							    mode);
-				  ok = 1;
-			      }
-			}
-		  }
-	    }
-      }
-    sqlite3_finalize (stmt);
-    return ok;
-}
-
-static int
-build_ingress_path (virtualroutingPtr net, double xFrom, double yFrom,
-		    Point2PointCandidatePtr ptr, int srid)
-{
-/* Point2Point - attempting to build an Ingress Path */
-    RoutingPtr graph = net->graph;
-    char *sql;
-    char *xtable;
-    char *xgeom;
-    sqlite3 *sqlite = net->db;
-    sqlite3_stmt *stmt = NULL;
-    int ret;
-    int ok = 0;
-    double percent;
-    double length;
-    gaiaGeomCollPtr geom = NULL;
-    int is_geographic = 0;
-
-    if (!srid_is_geographic (sqlite, srid, &is_geographic))
-	return 0;
-
-/* locating the insertion point */
-    xtable = gaiaDoubleQuotedSql (graph->TableName);
-    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-    if (ptr->reverse)
-	sql =
-	    sqlite3_mprintf ("SELECT ST_Line_Locate_Point(ST_Reverse(\"%s\"), "
-			     "MakePoint(?, ?)) FROM \"%s\" WHERE rowid = ?",
-			     xgeom, xtable);
+	link = graph->Links + snap->Direct;
+    if (graph->NodeCode)
+	p = add_by_code_to_point2point (net, snap->LinkRowid,
+					link->NodeFrom->Code,
+					link->NodeTo->Code, reverse, mode);
     else
-	sql = sqlite3_mprintf ("SELECT ST_Line_Locate_Point(\"%s\", "
-			       "MakePoint(?, ?)) FROM \"%s\" WHERE rowid = ?",
-			       xgeom, xtable);
-    free (xgeom);
-    free (xtable);
-    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-      {
-	  return 0;
-      }
-
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, xFrom);
-    sqlite3_bind_double (stmt, 2, yFrom);
-    sqlite3_bind_int64 (stmt, 3, ptr->linkRowid);
-    while (1)
-      {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		percent = sqlite3_column_double (stmt, 0);
-		ok = 1;
-	    }
-      }
-    sqlite3_finalize (stmt);
-    if (!ok)
-	return 0;
-    if (percent >= 1.0)
-      {
-	  /* special case: the insertion point is the End Node */
-	  ptr->valid = 1;
-	  return 1;
-      }
-
-/* determining the ingress path */
-    xtable = gaiaDoubleQuotedSql (graph->TableName);
-    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-    if (is_geographic)
-      {
-	  if (ptr->reverse)
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom, 1) FROM "
-				     "(SELECT ST_Line_Substring(ST_Reverse(\"%s\"), ?, 100.0) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-	  else
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom, 1) FROM "
-				     "(SELECT ST_Line_Substring(\"%s\", ?, 100.0) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-      }
+	p = add_by_id_to_point2point (net, snap->LinkRowid,
+				      link->NodeFrom->Id, link->NodeTo->Id,
+				      reverse, mode);
+    p->snap = snap;
+    p->linkCost = link->Cost;
+    p->extraLen = candidate->Distance;
+    if (reverse)
+	p->percent = 1.0 - candidate->Fraction;
     else
-      {
-	  if (ptr->reverse)
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom) FROM "
-				     "(SELECT ST_Line_Substring(ST_Reverse(\"%s\"), ?, 100.0) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-	  else
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom) FROM "
-				     "(SELECT ST_Line_Substring(\"%s\", ?, 100.0) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-      }
-    free (xgeom);
-    free (xtable);
-    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-      {
-	  return 0;
-      }
-
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, percent);
-    sqlite3_bind_int64 (stmt, 2, ptr->linkRowid);
-    while (1)
-      {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
-		  {
-		      const unsigned char *blob = sqlite3_column_blob (stmt, 0);
-		      int size = sqlite3_column_bytes (stmt, 0);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom != NULL)
-			{
-			    gaiaLinestringPtr ln = geom->FirstLinestring;
-			    double x;
-			    double y;
-			    double z;
-			    double m;
-			    if (ln->DimensionModel == GAIA_XY_Z)
-			      {
-				  gaiaGetPointXYZ (ln->Coords, 0, &x, &y, &z);
-			      }
-			    else if (ln->DimensionModel == GAIA_XY_M)
-			      {
-				  gaiaGetPointXYM (ln->Coords, 0, &x, &y, &m);
-			      }
-			    else if (ln->DimensionModel == GAIA_XY_Z_M)
-			      {
-				  gaiaGetPointXYZM (ln->Coords, 0, &x, &y,
-						    &z, &m);
-			      }
-			    else
-			      {
-				  gaiaGetPoint (ln->Coords, 0, &x, &y);
-			      }
-			    length = sqlite3_column_double (stmt, 1);
-			    ptr->path = geom;
-			    ptr->pathLen = length;
-			    if (x == xFrom && y == yFrom)
-				;
-			    else
-			      {
-				  length =
-				      sqrt (((x - xFrom) * (x - xFrom)) +
-					    ((y - yFrom) * (y - yFrom)));
-				  ptr->extraLen = length;
-			      }
-			    ptr->valid = 1;
-			}
-		  }
-	    }
-      }
-    sqlite3_finalize (stmt);
-
-    return 1;
+	p->percent = candidate->Fraction;
 }
 
 static int
-build_egress_path (virtualroutingPtr net, double xTo, double yTo,
-		   Point2PointCandidatePtr ptr, int srid)
+do_prepare_point (virtualroutingPtr net, int mode)
 {
-/* Point2Point - attempting to build an Egress Path */
-    RoutingPtr graph = net->graph;
-    char *sql;
-    char *xtable;
-    char *xgeom;
-    sqlite3 *sqlite = net->db;
-    sqlite3_stmt *stmt = NULL;
-    int ret;
+/* preparing a Point for Point2Point */
+    Point2PointSolutionPtr p2p = net->point2PointSolution;
+    RouteSnapIndexPtr index;
+    RouteSnapCandidate candidates[VROUTE_SNAP_CANDIDATES];
+    int count;
+    int i;
     int ok = 0;
-    double percent;
-    double length;
-    gaiaGeomCollPtr geom = NULL;
-    int is_geographic = 0;
 
-    if (!srid_is_geographic (sqlite, srid, &is_geographic))
+    index = snap_index_attach (net->db, net->graph);
+    if (index == NULL)
 	return 0;
-
-/* locating the insertion point */
-    xtable = gaiaDoubleQuotedSql (graph->TableName);
-    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-    if (ptr->reverse)
-	sql =
-	    sqlite3_mprintf ("SELECT ST_Line_Locate_Point(ST_Reverse(\"%s\"), "
-			     "MakePoint(?, ?)) FROM \"%s\" WHERE rowid = ?",
-			     xgeom, xtable);
+    if (mode == VROUTE_POINT2POINT_FROM)
+	count =
+	    snap_index_query (index, p2p->xFrom, p2p->yFrom, net->Tolerance,
+			      candidates);
     else
-	sql = sqlite3_mprintf ("SELECT ST_Line_Locate_Point(\"%s\", "
-			       "MakePoint(?, ?)) FROM \"%s\" WHERE rowid = ?",
-			       xgeom, xtable);
-    free (xgeom);
-    free (xtable);
-    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-	return 0;
-
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, xTo);
-    sqlite3_bind_double (stmt, 2, yTo);
-    sqlite3_bind_int64 (stmt, 3, ptr->linkRowid);
-    while (1)
+	count =
+	    snap_index_query (index, p2p->xTo, p2p->yTo, net->Tolerance,
+			      candidates);
+    for (i = 0; i < count; i++)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
+	  RouteSnapLinkPtr snap = candidates[i].Link;
+	  if (snap->Direct >= 0)
+	    {
+		/* direct connection */
+		add_snapped_to_point2point (net, candidates + i, 0, mode);
+		ok = 1;
+	    }
+	  if (snap->Reverse >= 0)
 	    {
-		percent = sqlite3_column_double (stmt, 0);
+		/* reverse connection */
+		add_snapped_to_point2point (net, candidates + i, 1, mode);
 		ok = 1;
 	    }
       }
-    sqlite3_finalize (stmt);
-    if (!ok)
+    return ok;
+}
+
+static int
+build_ingress_path (virtualroutingPtr net, Point2PointCandidatePtr ptr)
+{
+/* Point2Point - attempting to build an Ingress Path */
+    RouteSnapIndexPtr index = net->graph->SnapIndex;
+    gaiaGeomCollPtr geom;
+    double fraction;
+
+    if (index == NULL || ptr->snap == NULL)
 	return 0;
-    if (percent >= 1.0)
+    if (ptr->percent >= 1.0)
       {
 	  /* special case: the insertion point is the End Node */
 	  ptr->valid = 1;
 	  return 1;
       }
 
-/* determining the egress path */
-    xtable = gaiaDoubleQuotedSql (graph->TableName);
-    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-    if (is_geographic)
+/* determining the ingress path (always following the Link Geometry) */
+    if (ptr->reverse)
       {
-	  if (ptr->reverse)
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom, 1) FROM "
-				     "(SELECT ST_Line_Substring(ST_Reverse(\"%s\"), 0.0, ?) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-	  else
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom, 1) FROM "
-				     "(SELECT ST_Line_Substring(\"%s\", 0.0, ?) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
+	  fraction = 1.0 - ptr->percent;
+	  geom = snap_link_substring (index, ptr->snap, 0.0, fraction);
       }
     else
+	geom = snap_link_substring (index, ptr->snap, ptr->percent, 1.0);
+    ptr->path = geom;
+    ptr->pathLen = ptr->linkCost * (1.0 - ptr->percent);
+    ptr->valid = 1;
+    return 1;
+}
+
+static int
+build_egress_path (virtualroutingPtr net, Point2PointCandidatePtr ptr)
+{
+/* Point2Point - attempting to build an Egress Path */
+    RouteSnapIndexPtr index = net->graph->SnapIndex;
+    gaiaGeomCollPtr geom;
+    double fraction;
+
+    if (index == NULL || ptr->snap == NULL)
+	return 0;
+    if (ptr->percent <= 0.0)
       {
-	  if (ptr->reverse)
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom) FROM "
-				     "(SELECT ST_Line_Substring(ST_Reverse(\"%s\"), 0.0, ?) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
-	  else
-	      sql = sqlite3_mprintf ("SELECT g.geom, ST_Length(g.geom) FROM "
-				     "(SELECT ST_Line_Substring(\"%s\", 0.0, ?) AS geom "
-				     "FROM \"%s\" WHERE rowid = ?) AS g", xgeom,
-				     xtable);
+	  /* special case: the insertion point is the Start Node */
+	  ptr->valid = 1;
+	  return 1;
       }
-    free (xgeom);
-    free (xtable);
-    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
-    sqlite3_free (sql);
-    if (ret != SQLITE_OK)
-	return 0;
 
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
-    sqlite3_bind_double (stmt, 1, percent);
-    sqlite3_bind_int64 (stmt, 2, ptr->linkRowid);
-    while (1)
+/* determining the egress path (always following the Link Geometry) */
+    if (ptr->reverse)
       {
-	  /* scrolling the result set rows */
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE)
-	      break;		/* end of result set */
-	  if (ret == SQLITE_ROW)
-	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
-		  {
-		      const unsigned char *blob = sqlite3_column_blob (stmt, 0);
-		      int size = sqlite3_column_bytes (stmt, 0);
-		      geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
-		      if (geom != NULL)
-			{
-			    gaiaLinestringPtr ln = geom->FirstLinestring;
-			    double x;
-			    double y;
-			    double z;
-			    double m;
-			    int last_pt = ln->Points - 1;
-			    if (ln->DimensionModel == GAIA_XY_Z)
-			      {
-				  gaiaGetPointXYZ (ln->Coords, last_pt, &x, &y,
-						   &z);
-			      }
-			    else if (ln->DimensionModel == GAIA_XY_M)
-			      {
-				  gaiaGetPointXYM (ln->Coords, last_pt, &x, &y,
-						   &m);
-			      }
-			    else if (ln->DimensionModel == GAIA_XY_Z_M)
-			      {
-				  gaiaGetPointXYZM (ln->Coords, last_pt, &x, &y,
-						    &z, &m);
-			      }
-			    else
-			      {
-				  gaiaGetPoint (ln->Coords, last_pt, &x, &y);
-			      }
-			    length = sqlite3_column_double (stmt, 1);
-			    ptr->path = geom;
-			    ptr->pathLen = length;
-			    if (x == xTo && y == yTo)
-				;
-			    else
-			      {
-				  length =
-				      sqrt (((x - xTo) * (x - xTo)) +
-					    ((y - yTo) * (y - yTo)));
-				  ptr->extraLen = length;
-			      }
-			    ptr->valid = 1;
-			}
-		  }
-	    }
+	  fraction = 1.0 - ptr->percent;
+	  geom = snap_link_substring (index, ptr->snap, fraction, 1.0);
       }
-    sqlite3_finalize (stmt);
-
+    else
+	geom = snap_link_substring (index, ptr->snap, 0.0, ptr->percent);
+    ptr->path = geom;
+    ptr->pathLen = ptr->linkCost * ptr->percent;
+    ptr->valid = 1;
     return 1;
 }
 
@@ -5853,7 +8915,7 @@ do_define_ingress_paths (virtualroutingPtr net)
     ptr = p2p->firstFromCandidate;
     while (ptr != NULL)
       {
-	  if (!build_ingress_path (net, p2p->xFrom, p2p->yFrom, ptr, p2p->srid))
+	  if (!build_ingress_path (net, ptr))
 	      return 0;
 	  ptr = ptr->next;
       }
@@ -5870,7 +8932,7 @@ do_define_egress_paths (virtualroutingPtr net)
     ptr = p2p->firstToCandidate;
     while (ptr != NULL)
       {
-	  if (!build_egress_path (net, p2p->xTo, p2p->yTo, ptr, p2p->srid))
+	  if (!build_egress_path (net, ptr))
 	      return 0;
 	  ptr = ptr->next;
       }
@@ -5997,12 +9059,31 @@ add_point2point_node_to_by_id (Point2PointSolutionPtr p2p, sqlite3_int64 id,
     p2p->lastToNode = p;
 }
 
+static int
+point2point_reached (RoutingMultiDestPtr multiple,
+		     ShortestPathSolutionPtr solution)
+{
+/* testing if the destination of some solution has been actually reached */
+    int i;
+    if (solution->To == NULL)
+	return 0;		/* undefined destination */
+    for (i = 0; i < multiple->Items; i++)
+      {
+	  if (*(multiple->To + i) == solution->To)
+	      return (*(multiple->Found + i) == 'Y');
+      }
+    return 0;
+}
+
 static void
 point2point_eval_solution (Point2PointSolutionPtr p2p,
+			   RoutingMultiDestPtr multiple,
 			   ShortestPathSolutionPtr solution, int nodeCode)
 {
 /* attempting to identify the optimal Point2Point solution */
     Point2PointCandidatePtr p_from = p2p->firstFromCandidate;
+    if (!point2point_reached (multiple, solution))
+	return;			/* unreachable destination */
     while (p_from != NULL)
       {
 	  /* searching FROM candidates */
@@ -6047,7 +9128,7 @@ point2point_eval_solution (Point2PointSolutionPtr p2p,
 				  p2p->totalCost = tot;
 				  p2p->fromCandidate = p_from;
 				  p2p->toCandidate = p_to;
-				  return;
+				  p2p->sameLink = 0;
 			      }
 			}
 		      p_to = p_to->next;
@@ -6057,6 +9138,64 @@ point2point_eval_solution (Point2PointSolutionPtr p2p,
       }
 }
 
+static void
+point2point_eval_same_link (virtualroutingPtr net)
+{
+/*
+/ both Points could lay on the same Link: in this case they can be
+/ directly connected by following the Link itself, without traversing
+/ any Node (only when FROM comes before TO along the Link direction)
+*/
+    Point2PointSolutionPtr p2p = net->point2PointSolution;
+    RouteSnapIndexPtr index = net->graph->SnapIndex;
+    Point2PointCandidatePtr p_from = p2p->firstFromCandidate;
+    if (index == NULL)
+	return;
+    while (p_from != NULL)
+      {
+	  Point2PointCandidatePtr p_to = p2p->firstToCandidate;
+	  while (p_to != NULL)
+	    {
+		if (p_from->snap != NULL && p_from->snap == p_to->snap
+		    && p_from->reverse == p_to->reverse
+		    && p_from->percent <= p_to->percent)
+		  {
+		      gaiaGeomCollPtr geom;
+		      double len;
+		      double tot;
+		      if (p_from->reverse)
+			  geom =
+			      snap_link_substring (index, p_from->snap,
+						   1.0 - p_to->percent,
+						   1.0 - p_from->percent);
+		      else
+			  geom =
+			      snap_link_substring (index, p_from->snap,
+						   p_from->percent,
+						   p_to->percent);
+		      len = p_from->linkCost * (p_to->percent - p_from->percent);
+		      tot = p_from->extraLen + len + p_to->extraLen;
+		      if (tot < p2p->totalCost)
+			{
+			    /* saving a better solution */
+			    if (p2p->sameLinkPath != NULL)
+				gaiaFreeGeomColl (p2p->sameLinkPath);
+			    p2p->totalCost = tot;
+			    p2p->fromCandidate = p_from;
+			    p2p->toCandidate = p_to;
+			    p2p->sameLink = 1;
+			    p2p->sameLinkPath = geom;
+			    p2p->sameLinkLen = len;
+			}
+		      else
+			  gaiaFreeGeomColl (geom);
+		  }
+		p_to = p_to->next;
+	    }
+	  p_from = p_from->next;
+      }
+}
+
 static RouteLinkPtr
 find_link (sqlite3 * sqlite, RoutingPtr graph, sqlite3_int64 linkRowid)
 {
@@ -6156,6 +9295,9 @@ add2DynLine (gaiaDynamicLinePtr dyn, gaiaGeomCollPtr geom, int reverse,
     double endCost;
     gaiaGeomCollPtr geo2;
 
+    if (geom == NULL)
+	return 0;		/* the insertion point is a Node: no partial Link */
+
     /* interpolating M-Values */
     if (dyn->Last == NULL)
 	startCost = 0.0;
@@ -6248,7 +9390,16 @@ build_point2point_solution (sqlite3 * sqlite, int options, RoutingPtr graph,
 		    gaiaAppendPointZMToDynamicLine (p2p->dynLine, p2p->xFrom,
 						    p2p->yFrom, p2p->zFrom,
 						    0.0);
-		if (row->Point2PointRole == VROUTE_POINT2POINT_START)
+		if (row->Point2PointRole == VROUTE_POINT2POINT_START
+		    && p2p->sameLink)
+		  {
+		      if (add2DynLine
+			  (p2p->dynLine, p2p->sameLinkPath,
+			   p2p->fromCandidate->reverse,
+			   p2p->fromCandidate->extraLen, p2p->sameLinkLen))
+			  p2p->hasZ = 1;
+		  }
+		else if (row->Point2PointRole == VROUTE_POINT2POINT_START)
 		    if (add2DynLine
 			(p2p->dynLine, p2p->fromCandidate->path,
 			 p2p->fromCandidate->reverse,
@@ -6485,8 +9636,7 @@ build_point2point_solution (sqlite3 * sqlite, int options, RoutingPtr graph,
 						}
 					      if (add2DynLine
 						  (p2p->dynLine, geom, reverse,
-						   0.0,
-						   row->linkRef->Link->Cost))
+						   0.0, row->linkRef->Cost))
 						  p2p->hasZ = 1;
 					  }
 					else
@@ -6603,6 +9753,57 @@ build_point2point_solution (sqlite3 * sqlite, int options, RoutingPtr graph,
       }
 }
 
+static void
+add_point2point_row (Point2PointSolutionPtr p2p, int route_row, int role,
+		     RowSolutionPtr linkRef, double cost)
+{
+/* appending a row to the Point2Point resultset */
+    ResultsetRowPtr row = malloc (sizeof (ResultsetRow));
+    row->RouteNum = 0;
+    row->RouteRow = route_row;
+    row->Point2PointRole = role;
+    row->From = NULL;
+    row->To = NULL;
+    row->Undefined = NULL;
+    row->UndefinedId = 0;
+    row->linkRef = linkRef;
+    row->TotalCost = cost;
+    row->Geometry = NULL;
+    row->Next = NULL;
+    if (p2p->FirstRow == NULL)
+	p2p->FirstRow = row;
+    if (p2p->LastRow != NULL)
+	p2p->LastRow->Next = row;
+    p2p->LastRow = row;
+}
+
+static void
+point2point_same_link_rows (virtualroutingCursorPtr cursor)
+{
+/* building the Point2Point solution rows: both Points on the same Link */
+    Point2PointSolutionPtr p2p = cursor->pVtab->point2PointSolution;
+    RowSolutionPtr linkRef;
+    add_point2point_row (p2p, 0, VROUTE_POINT2POINT_NONE, NULL,
+			 p2p->totalCost);
+    add_point2point_row (p2p, 1, VROUTE_POINT2POINT_INGRESS, NULL,
+			 p2p->fromCandidate->extraLen);
+    linkRef = malloc (sizeof (RowSolution));
+    linkRef->Link =
+	find_link (cursor->pVtab->db, cursor->pVtab->graph,
+		   p2p->fromCandidate->linkRowid);
+    linkRef->Cost = 0.0;
+    linkRef->Name = NULL;
+    linkRef->Next = NULL;
+    add_point2point_row (p2p, 2, VROUTE_POINT2POINT_START, linkRef,
+			 p2p->sameLinkLen);
+    add_point2point_row (p2p, 3, VROUTE_POINT2POINT_EGRESS, NULL,
+			 p2p->toCandidate->extraLen);
+    build_point2point_solution (cursor->pVtab->db,
+				cursor->pVtab->currentOptions,
+				cursor->pVtab->graph, p2p);
+    cursor->pVtab->multiSolution->Mode = VROUTE_POINT2POINT_SOLUTION;
+}
+
 static void
 point2point_resolve (virtualroutingCursorPtr cursor)
 {
@@ -6620,6 +9821,7 @@ point2point_resolve (virtualroutingCursorPtr cursor)
     RowSolutionPtr pA;
     ResultsetRowPtr row;
     RouteLinkPtr link;
+    point2point_eval_same_link (net);
     while (p_from != NULL)
       {
 	  /* extracting all FROM candidates */
@@ -6703,11 +9905,22 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 	      set_multi_by_code (multiple, graph);
 	  else
 	      set_multi_by_id (multiple, graph);
-	  if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
+	  if (graph->TD != NULL)
+	      td_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_SIMPLE,
+			net->currentAlgorithm, net->DepartureTime, graph,
+			cursor->pVtab->routing, cursor->pVtab->multiSolution);
+	  else if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 	      astar_solve (cursor->pVtab->db,
 			   VROUTE_SHORTEST_PATH_SIMPLE, graph,
 			   cursor->pVtab->routing,
 			   cursor->pVtab->multiSolution);
+	  else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM
+		   || net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM
+		   || net->currentAlgorithm == VROUTE_BIDI_A_STAR_ALGORITHM)
+	      pairwise_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_SIMPLE,
+			      net->currentAlgorithm, graph,
+			      cursor->pVtab->routing,
+			      cursor->pVtab->multiSolution);
 	  else
 	      dijkstra_multi_solve (cursor->pVtab->db,
 				    VROUTE_SHORTEST_PATH_SIMPLE, graph,
@@ -6716,7 +9929,8 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 	  solution = cursor->pVtab->multiSolution->First;
 	  while (solution != NULL)
 	    {
-		point2point_eval_solution (p2p, solution, graph->NodeCode);
+		point2point_eval_solution (p2p, multiple, solution,
+					   graph->NodeCode);
 		solution = solution->Next;
 	    }
 	  p_node_from = p_node_from->next;
@@ -6724,6 +9938,11 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 
     if (p2p->fromCandidate == NULL || p2p->toCandidate == NULL)
 	return;			/* invalid solution */
+    if (p2p->sameLink)
+      {
+	  point2point_same_link_rows (cursor);
+	  return;
+      }
 
 /* fully building the optimal Point2Point solution */
     reset_multiSolution (cursor->pVtab->multiSolution);
@@ -6761,9 +9980,19 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 	  vroute_add_multiple_id (multiple, p2p->toCandidate->idNodeFrom);
 	  set_multi_by_id (multiple, graph);
       }
-    if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
+    if (graph->TD != NULL)
+	td_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_QUICK,
+		  net->currentAlgorithm, net->DepartureTime, graph,
+		  cursor->pVtab->routing, cursor->pVtab->multiSolution);
+    else if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 	astar_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_QUICK, graph,
 		     cursor->pVtab->routing, cursor->pVtab->multiSolution);
+    else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM
+	     || net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM
+	     || net->currentAlgorithm == VROUTE_BIDI_A_STAR_ALGORITHM)
+	pairwise_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_QUICK,
+			net->currentAlgorithm, graph, cursor->pVtab->routing,
+			cursor->pVtab->multiSolution);
     else
 	dijkstra_multi_solve (cursor->pVtab->db, VROUTE_SHORTEST_PATH_QUICK,
 			      graph, cursor->pVtab->routing,
@@ -6830,6 +10059,7 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 		   p2p->fromCandidate->linkRowid);
     row->linkRef = malloc (sizeof (RowSolution));
     row->linkRef->Link = link;
+    row->linkRef->Cost = 0.0;
     row->linkRef->Name = NULL;
     row->linkRef->Next = NULL;
     row->TotalCost = p2p->fromCandidate->pathLen;
@@ -6879,6 +10109,7 @@ point2point_resolve (virtualroutingCursorPtr cursor)
 		   p2p->toCandidate->linkRowid);
     row->linkRef = malloc (sizeof (RowSolution));
     row->linkRef->Link = link;
+    row->linkRef->Cost = 0.0;
     row->linkRef->Name = NULL;
     row->linkRef->Next = NULL;
     row->TotalCost = p2p->toCandidate->pathLen;
@@ -6935,9 +10166,8 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     int ok_id;
     int ok_data;
     char *xname;
+    const char *td_column = "";
     RoutingPtr graph = NULL;
-    if (pAux)
-	pAux = pAux;		/* unused arg warning suppression */
 /* checking for table_name and geo_column_name */
     if (argc == 4)
       {
@@ -6995,7 +10225,7 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt = (virtualroutingPtr) sqlite3_malloc (sizeof (virtualrouting));
     if (!p_vt)
 	return SQLITE_NOMEM;
-    graph = load_network (db, table);
+    graph = routing_cache_attach (db, table);
     if (!graph)
       {
 	  /* something is going the wrong way */
@@ -7005,17 +10235,22 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  goto error;
       }
     p_vt->db = db;
+    p_vt->p_cache = pAux;
+    p_vt->table = NULL;
     p_vt->graph = graph;
     p_vt->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
     p_vt->currentRequest = VROUTE_SHORTEST_PATH;
     p_vt->currentOptions = VROUTE_SHORTEST_PATH_FULL;
     p_vt->currentDelimiter = ',';
     p_vt->Tolerance = 20.0;
+    p_vt->DepartureTime = 0.0;
     p_vt->routing = NULL;
     p_vt->pModule = &my_route_module;
     p_vt->nRef = 0;
     p_vt->zErrMsg = NULL;
 /* preparing the COLUMNs for this VIRTUAL TABLE */
+    if (p_vt->graph->TD != NULL)
+	td_column = ", DepartureTime DOUBLE";
     xname = gaiaDoubleQuotedSql (vtable);
     if (p_vt->graph->NodeCode)
       {
@@ -7026,8 +10261,8 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 				       "RouteId INTEGER, RouteRow INTEGER, Role TEXT, "
 				       "LinkRowid INTEGER, NodeFrom TEXT, NodeTo TEXT,"
 				       "PointFrom BLOB, PointTo BLOB, Tolerance DOUBLE, "
-				       "Cost DOUBLE, Geometry BLOB, Name TEXT)",
-				       xname);
+				       "Cost DOUBLE, Geometry BLOB, Name TEXT%s)",
+				       xname, td_column);
 	    }
 	  else
 	    {
@@ -7036,7 +10271,8 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 				       "RouteId INTEGER, RouteRow INTEGER, Role TEXT, "
 				       "LinkRowid INTEGER, NodeFrom TEXT, NodeTo TEXT,"
 				       "PointFrom BLOB, PointTo BLOB, Tolerance DOUBLE, "
-				       "Cost DOUBLE, Geometry BLOB)", xname);
+				       "Cost DOUBLE, Geometry BLOB%s)", xname,
+				       td_column);
 	    }
       }
     else
@@ -7048,8 +10284,8 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 				       "RouteId INTEGER, RouteRow INTEGER, Role TEXT, "
 				       "LinkRowid INTEGER, NodeFrom INTEGER, NodeTo INTEGER, "
 				       "PointFrom BLOB, PointTo BLOB, Tolerance Double, "
-				       "Cost DOUBLE, Geometry BLOB, Name TEXT)",
-				       xname);
+				       "Cost DOUBLE, Geometry BLOB, Name TEXT%s)",
+				       xname, td_column);
 	    }
 	  else
 	    {
@@ -7058,7 +10294,8 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 				       "RouteId INTEGER, RouteRow INTEGER, Role TEXT, "
 				       "LinkRowid INTEGER, NodeFrom INTEGER, NodeTo INTEGER, "
 				       "PointFrom BLOB, PointTo BLOB, Tolerance DOUBLE, "
-				       "Cost DOUBLE, Geometry BLOB)", xname);
+				       "Cost DOUBLE, Geometry BLOB%s)", xname,
+				       td_column);
 	    }
       }
     free (xname);
@@ -7074,7 +10311,7 @@ vroute_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     sqlite3_free (sql);
     *ppVTab = (sqlite3_vtab *) p_vt;
     p_vt->routing = routing_init (p_vt->graph);
-    free (table);
+    p_vt->table = table;
     free (vtable);
     return SQLITE_OK;
   error:
@@ -7093,6 +10330,41 @@ vroute_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     return vroute_create (db, pAux, argc, argv, ppVTab, pzErr);
 }
 
+static int
+vroute_is_limit_constraint (struct sqlite3_index_constraint *p)
+{
+/* 
+/ recent SQLite versions also pass any LIMIT or OFFSET clause
+/ as a constraint: it is never used by VirtualRouting
+*/
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+    if (p->op == SQLITE_INDEX_CONSTRAINT_LIMIT
+	|| p->op == SQLITE_INDEX_CONSTRAINT_OFFSET)
+	return 1;
+#else
+    if (p)
+	p = p;			/* unused arg warning suppression */
+#endif
+    return 0;
+}
+
+static void
+vroute_use_constraints (sqlite3_index_info * pIdxInfo)
+{
+/* passing all usable constraints to xFilter, in the same order */
+    int i;
+    int n = 0;
+    for (i = 0; i < pIdxInfo->nConstraint; i++)
+      {
+	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
+	  if (p->usable && !vroute_is_limit_constraint (p))
+	    {
+		pIdxInfo->aConstraintUsage[i].argvIndex = ++n;
+		pIdxInfo->aConstraintUsage[i].omit = 1;
+	    }
+      }
+}
+
 static int
 vroute_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 {
@@ -7116,7 +10388,7 @@ vroute_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
       {
 	  /* verifying the constraints */
 	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
-	  if (p->usable)
+	  if (p->usable && !vroute_is_limit_constraint (p))
 	    {
 		if (p->iColumn == 8 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
 		  {
@@ -7158,14 +10430,7 @@ vroute_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 	  else
 	      pIdxInfo->idxNum = 2;	/* first arg is TO */
 	  pIdxInfo->estimatedCost = 1.0;
-	  for (i = 0; i < pIdxInfo->nConstraint; i++)
-	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
-	    }
+	  vroute_use_constraints (pIdxInfo);
 	  err = 0;
       }
     if (fromPoint == 1 && toPoint == 1 && errors == 0)
@@ -7176,14 +10441,7 @@ vroute_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 	  else
 	      pIdxInfo->idxNum = 6;	/* first arg is TO */
 	  pIdxInfo->estimatedCost = 1.0;
-	  for (i = 0; i < pIdxInfo->nConstraint; i++)
-	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
-	    }
+	  vroute_use_constraints (pIdxInfo);
 	  err = 0;
       }
     if (from == 1 && cost == 1 && errors == 0)
@@ -7194,14 +10452,7 @@ vroute_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 	  else
 	      pIdxInfo->idxNum = 4;	/* first arg is COST */
 	  pIdxInfo->estimatedCost = 1.0;
-	  for (i = 0; i < pIdxInfo->nConstraint; i++)
-	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
-	    }
+	  vroute_use_constraints (pIdxInfo);
 	  err = 0;
       }
     if (err)
@@ -7220,7 +10471,9 @@ vroute_disconnect (sqlite3_vtab * pVTab)
     if (p_vt->routing)
 	routing_free (p_vt->routing);
     if (p_vt->graph)
-	network_free (p_vt->graph);
+	routing_cache_release (p_vt->graph);
+    if (p_vt->table)
+	free (p_vt->table);
     sqlite3_free (p_vt);
     return SQLITE_OK;
 }
@@ -7236,7 +10489,25 @@ static void
 vroute_read_row (virtualroutingCursorPtr cursor)
 {
 /* trying to read a "row" from Shortest Path solution */
-    if (cursor->pVtab->multiSolution->Mode == VROUTE_RANGE_SOLUTION)
+    if (cursor->pVtab->multiSolution->Mode == VROUTE_MATRIX_SOLUTION)
+      {
+	  MultiSolutionPtr multiSolution = cursor->pVtab->multiSolution;
+	  sqlite3_int64 cells = (sqlite3_int64) multiSolution->MultiFrom->Items
+	      * multiSolution->MultiTo->Items;
+	  if (multiSolution->CurrentRowId >= cells)
+	      cursor->pVtab->eof = 1;
+	  else
+	      cursor->pVtab->eof = 0;
+      }
+    else if (cursor->pVtab->multiSolution->Mode == VROUTE_ISOCHRONE_SOLUTION)
+      {
+	  MultiSolutionPtr multiSolution = cursor->pVtab->multiSolution;
+	  if (multiSolution->CurrentRowId >= multiSolution->NumBands)
+	      cursor->pVtab->eof = 1;
+	  else
+	      cursor->pVtab->eof = 0;
+      }
+    else if (cursor->pVtab->multiSolution->Mode == VROUTE_RANGE_SOLUTION)
       {
 	  if (cursor->pVtab->multiSolution->CurrentNodeRow == NULL)
 	      cursor->pVtab->eof = 1;
@@ -7281,15 +10552,175 @@ vroute_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
     return SQLITE_OK;
 }
 
-static int
-vroute_close (sqlite3_vtab_cursor * pCursor)
+static int
+vroute_close (sqlite3_vtab_cursor * pCursor)
+{
+/* closing the cursor */
+    virtualroutingCursorPtr cursor = (virtualroutingCursorPtr) pCursor;
+    delete_multiSolution (cursor->pVtab->multiSolution);
+    delete_point2PointSolution (cursor->pVtab->point2PointSolution);
+    sqlite3_free (pCursor);
+    return SQLITE_OK;
+}
+
+static RoutingMultiDestPtr
+vroute_get_multiple_origins (virtualroutingPtr net, sqlite3_value * value)
+{
+/* parsing the list of origins of a Cost Matrix request */
+    RoutingMultiDestPtr multiple = NULL;
+    if (net->graph->NodeCode)
+      {
+	  /* Nodes are identified by TEXT Codes */
+	  if (sqlite3_value_type (value) == SQLITE_TEXT)
+	    {
+		multiple =
+		    vroute_get_multiple_destinations (1, net->currentDelimiter,
+						      (const char *)
+						      sqlite3_value_text
+						      (value));
+		if (multiple != NULL)
+		    set_multi_by_code (multiple, net->graph);
+	    }
+      }
+    else
+      {
+	  /* Nodes are identified by INT Ids */
+	  if (sqlite3_value_type (value) == SQLITE_TEXT)
+	      multiple =
+		  vroute_get_multiple_destinations (0, net->currentDelimiter,
+						    (const char *)
+						    sqlite3_value_text (value));
+	  else if (sqlite3_value_type (value) == SQLITE_INTEGER)
+	      multiple =
+		  vroute_as_multiple_destinations (sqlite3_value_int64
+						   (value));
+	  if (multiple != NULL)
+	      set_multi_by_id (multiple, net->graph);
+      }
+    return multiple;
+}
+
+static int
+cmp_cost_bands (const void *p1, const void *p2)
+{
+/* compares two Cost bands [for QSORT] */
+    double c1 = *((const double *) p1);
+    double c2 = *((const double *) p2);
+    if (c1 == c2)
+	return 0;
+    if (c1 > c2)
+	return 1;
+    return -1;
+}
+
+static void
+vroute_get_cost_bands (MultiSolutionPtr multiSolution, char delimiter,
+		       sqlite3_value * value)
+{
+/* parsing the Cost bands of an Isochrones request */
+    int count = 0;
+    int i;
+    double *bands;
+    if (sqlite3_value_type (value) == SQLITE_TEXT)
+      {
+	  /* a list of Cost limits, e.g. '300,600,900' */
+	  const char *str = (const char *) sqlite3_value_text (value);
+	  const char *p = str;
+	  bands = malloc (sizeof (double) * (strlen (str) + 1));
+	  while (*p != '\0')
+	    {
+		char *end;
+		double cost;
+		if (*p == delimiter || *p == ' ' || *p == '\t' || *p == '\n'
+		    || *p == '\r')
+		  {
+		      p++;
+		      continue;
+		  }
+		cost = strtod (p, &end);
+		if (end == p)
+		  {
+		      /* invalid list */
+		      free (bands);
+		      return;
+		  }
+		if (cost > 0.0)
+		    bands[count++] = cost;
+		p = end;
+	    }
+      }
+    else
+      {
+	  /* a single Cost limit */
+	  bands = malloc (sizeof (double));
+	  if (multiSolution->MaxCost > 0.0)
+	      bands[count++] = multiSolution->MaxCost;
+      }
+    if (count == 0)
+      {
+	  free (bands);
+	  return;
+      }
+/* sorting the bands and removing duplicates */
+    qsort (bands, count, sizeof (double), cmp_cost_bands);
+    multiSolution->NumBands = 1;
+    for (i = 1; i < count; i++)
+      {
+	  if (bands[i] != bands[multiSolution->NumBands - 1])
+	      bands[multiSolution->NumBands++] = bands[i];
+      }
+    multiSolution->Bands = bands;
+    multiSolution->MaxCost = bands[multiSolution->NumBands - 1];
+}
+
+static void
+vroute_refresh_network (virtualroutingPtr p_vt)
+{
+/* 
+/ replacing a NETWORK changed by UpdateRouting(); the current
+/ one will be kept if the new one can't be loaded, or if it no
+/ longer matches the columns of this VirtualRouting table
+*/
+    RoutingPtr graph;
+    if (!routing_cache_outdated (p_vt->graph))
+	return;
+    graph = routing_cache_attach (p_vt->db, p_vt->table);
+    if (graph == NULL)
+	return;
+    if (graph->NodeCode != p_vt->graph->NodeCode
+	|| (graph->NameColumn == NULL) != (p_vt->graph->NameColumn == NULL)
+	|| (graph->TD == NULL) != (p_vt->graph->TD == NULL))
+      {
+	  routing_cache_release (graph);
+	  return;
+      }
+    routing_free (p_vt->routing);
+    routing_cache_release (p_vt->graph);
+    p_vt->graph = graph;
+    p_vt->routing = routing_init (graph);
+    if (graph->AStar == 0 && p_vt->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
+	p_vt->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
+    if (graph->AStar == 0
+	&& p_vt->currentAlgorithm == VROUTE_BIDI_A_STAR_ALGORITHM)
+	p_vt->currentAlgorithm = VROUTE_BIDIJKSTRA_ALGORITHM;
+    if (graph->CH == NULL && p_vt->currentAlgorithm == VROUTE_CH_ALGORITHM)
+	p_vt->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
+}
+
+static void
+vroute_set_heap_kind (virtualroutingPtr p_vt)
 {
-/* closing the cursor */
-    virtualroutingCursorPtr cursor = (virtualroutingCursorPtr) pCursor;
-    delete_multiSolution (cursor->pVtab->multiSolution);
-    delete_point2PointSolution (cursor->pVtab->point2PointSolution);
-    sqlite3_free (pCursor);
-    return SQLITE_OK;
+/* selecting the priority queue currently set on this connection */
+    struct splite_internal_cache *cache =
+	(struct splite_internal_cache *) (p_vt->p_cache);
+    p_vt->routing->HeapKind = ROUTING_HEAP_DARY;
+    if (cache == NULL)
+	return;
+    if (cache->magic1 != SPATIALITE_CACHE_MAGIC1
+	|| cache->magic2 != SPATIALITE_CACHE_MAGIC2)
+	return;
+    if (cache->routingHeap == ROUTING_HEAP_RADIX)
+	p_vt->routing->HeapKind = ROUTING_HEAP_RADIX;
 }
 
 static int
@@ -7309,9 +10740,11 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     Point2PointSolutionPtr p2p = cursor->pVtab->point2PointSolution;
     if (idxStr)
 	idxStr = idxStr;	/* unused arg warning suppression */
-    node_code = net->graph->NodeCode;
     reset_multiSolution (multiSolution);
     reset_point2PointSolution (p2p);
+    vroute_refresh_network (net);
+    vroute_set_heap_kind (net);
+    node_code = net->graph->NodeCode;
     cursor->pVtab->eof = 0;
     if (idxNum == 1 && argc == 2)
       {
@@ -7439,6 +10872,13 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 							   (argv[1]));
 	    }
       }
+    if (net->currentRequest == VROUTE_MATRIX && (idxNum == 1 || idxNum == 2)
+	&& argc == 2)
+      {
+	  /* Cost Matrix: NodeFrom is a list of origins */
+	  multiSolution->MultiFrom =
+	      vroute_get_multiple_origins (net, argv[(idxNum == 1) ? 0 : 1]);
+      }
     if (idxNum == 3 && argc == 2)
       {
 	  /* retrieving the From and Cost param */
@@ -7466,6 +10906,9 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	    }
 	  else if (sqlite3_value_type (argv[1]) == SQLITE_FLOAT)
 	      multiSolution->MaxCost = sqlite3_value_double (argv[1]);
+	  if (net->currentRequest == VROUTE_ISOCHRONE)
+	      vroute_get_cost_bands (multiSolution, net->currentDelimiter,
+				     argv[1]);
       }
     if (idxNum == 4 && argc == 2)
       {
@@ -7494,6 +10937,9 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	    }
 	  else if (sqlite3_value_type (argv[0]) == SQLITE_FLOAT)
 	      multiSolution->MaxCost = sqlite3_value_double (argv[0]);
+	  if (net->currentRequest == VROUTE_ISOCHRONE)
+	      vroute_get_cost_bands (multiSolution, net->currentDelimiter,
+				     argv[0]);
       }
     if (idxNum == 5 && argc == 2)
       {
@@ -7574,9 +11020,9 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 				  p2p->yTo = pt->Y;
 				  if (point->DimensionModel == GAIA_XY_Z
 				      || point->DimensionModel == GAIA_XY_Z_M)
-				      p2p->zFrom = pt->Z;
+				      p2p->zTo = pt->Z;
 				  else
-				      p2p->zFrom = 0.0;
+				      p2p->zTo = 0.0;
 			      }
 			    gaiaFreeGeomColl (point);
 			}
@@ -7597,9 +11043,9 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 				  p2p->yFrom = pt->Y;
 				  if (point->DimensionModel == GAIA_XY_Z
 				      || point->DimensionModel == GAIA_XY_Z_M)
-				      p2p->zTo = pt->Z;
+				      p2p->zFrom = pt->Z;
 				  else
-				      p2p->zTo = 0.0;
+				      p2p->zFrom = 0.0;
 			      }
 			    gaiaFreeGeomColl (point);
 			}
@@ -7613,6 +11059,7 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  p2p->CurrentRow = NULL;
 	  p2p->CurrentRowId = 0;
 	  p2p->Mode = VROUTE_POINT2POINT_SOLUTION;
+	  multiSolution->Mode = VROUTE_POINT2POINT_SOLUTION;
 	  /* searching candidates links (From) */
 	  if (!do_prepare_point (cursor->pVtab, VROUTE_POINT2POINT_FROM))
 	      p2p->Mode = VROUTE_POINT2POINT_ERROR;
@@ -7647,13 +11094,24 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  cursor->pVtab->eof = 0;
 	  return SQLITE_OK;
       }
+    if (multiSolution->MultiFrom && multiSolution->MultiTo)
+      {
+	  /* Cost Matrix request */
+	  cursor->pVtab->eof = 0;
+	  multiSolution->Mode = VROUTE_MATRIX_SOLUTION;
+	  matrix_solve (net->graph, net->currentAlgorithm, multiSolution);
+	  multiSolution->CurrentRowId = 0;
+	  return SQLITE_OK;
+      }
     if (multiSolution->From && multiSolution->MultiTo)
       {
 	  cursor->pVtab->eof = 0;
 	  if (net->currentRequest == VROUTE_TSP_NN)
 	    {
 		multiSolution->Mode = VROUTE_TSP_SOLUTION;
-		if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM)
+		if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM
+		    || net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM
+		    || net->currentAlgorithm == VROUTE_CH_ALGORITHM)
 		  {
 		      tsp_nn_solve (net->db, net->currentOptions, net->graph,
 				    net->routing, multiSolution);
@@ -7664,9 +11122,12 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  else if (net->currentRequest == VROUTE_TSP_GA)
 	    {
 		multiSolution->Mode = VROUTE_TSP_SOLUTION;
-		if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM)
+		if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM
+		    || net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM
+		    || net->currentAlgorithm == VROUTE_CH_ALGORITHM)
 		  {
-		      tsp_ga_solve (net->db, net->currentOptions, net->graph,
+		      tsp_ga_solve (net->db, net->currentOptions,
+				    net->currentAlgorithm, net->graph,
 				    net->routing, multiSolution);
 		      multiSolution->CurrentRowId = 0;
 		      multiSolution->CurrentRow = multiSolution->FirstRow;
@@ -7675,9 +11136,21 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  else
 	    {
 		multiSolution->Mode = VROUTE_ROUTING_SOLUTION;
-		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
+		if (net->graph->TD != NULL)
+		    td_solve (net->db, net->currentOptions,
+			      net->currentAlgorithm, net->DepartureTime,
+			      net->graph, net->routing, multiSolution);
+		else if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    astar_solve (net->db, net->currentOptions, net->graph,
 				 net->routing, multiSolution);
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM
+			 || net->currentAlgorithm ==
+			 VROUTE_BIDIJKSTRA_ALGORITHM
+			 || net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    pairwise_solve (net->db, net->currentOptions,
+				    net->currentAlgorithm, net->graph,
+				    net->routing, multiSolution);
 		else
 		    dijkstra_multi_solve (net->db, net->currentOptions,
 					  net->graph, net->routing,
@@ -7687,12 +11160,27 @@ vroute_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	    }
 	  return SQLITE_OK;
       }
+    if (multiSolution->From && multiSolution->Bands != NULL)
+      {
+	  /* Isochrones request */
+	  int srid = find_srid (net->db, net->graph);
+	  if (!net->graph->AStar)
+	      srid = VROUTE_INVALID_SRID;	/* the Nodes have no coordinates */
+	  cursor->pVtab->eof = 0;
+	  multiSolution->Mode = VROUTE_ISOCHRONE_SOLUTION;
+	  dijkstra_isochrones (net->p_cache, net->routing, multiSolution,
+			       srid);
+	  multiSolution->CurrentRowId = 0;
+	  return SQLITE_OK;
+      }
     if (multiSolution->From && multiSolution->MaxCost > 0.0)
       {
 	  int srid = find_srid (net->db, net->graph);
 	  cursor->pVtab->eof = 0;
 	  multiSolution->Mode = VROUTE_RANGE_SOLUTION;
-	  if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM)
+	  if (net->currentAlgorithm == VROUTE_DIJKSTRA_ALGORITHM
+	      || net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM
+	      || net->currentAlgorithm == VROUTE_CH_ALGORITHM)
 	    {
 		dijkstra_within_cost_range (net->routing, multiSolution, srid);
 		multiSolution->CurrentRowId = 0;
@@ -7734,7 +11222,13 @@ vroute_next (sqlite3_vtab_cursor * pCursor)
 		return SQLITE_OK;
 	    }
       }
-    if (multiSolution->Mode == VROUTE_RANGE_SOLUTION)
+    if (multiSolution->Mode == VROUTE_MATRIX_SOLUTION
+	|| multiSolution->Mode == VROUTE_ISOCHRONE_SOLUTION)
+      {
+	  /* rows directly addressed by their position */
+	  ;
+      }
+    else if (multiSolution->Mode == VROUTE_RANGE_SOLUTION)
       {
 	  if (multiSolution->CurrentNodeRow == NULL)
 	    {
@@ -7935,6 +11429,254 @@ do_cost_range_column (virtualroutingCursorPtr cursor,
       }
 }
 
+static void
+do_isochrone_column (virtualroutingCursorPtr cursor,
+		     sqlite3_context * pContext, int node_code, int column)
+{
+/* processing an Isochrones solution row */
+    const char *algorithm;
+    char delimiter[128];
+    const char *role;
+    MultiSolutionPtr multiSolution = cursor->pVtab->multiSolution;
+    int band = (int) (multiSolution->CurrentRowId);
+
+    if (column == 0)
+      {
+	  /* the currently used Algorithm */
+	  algorithm = "Dijkstra";
+	  if (band != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 1)
+      {
+	  /* the current Request type */
+	  algorithm = "Isochrone";
+	  if (band != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 2)
+      {
+	  /* the currently set Options: not applicable */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 3)
+      {
+	  /* the currently set delimiter char */
+	  if (isprint (cursor->pVtab->currentDelimiter))
+	      sprintf (delimiter, "%c [dec=%d, hex=%02x]",
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter);
+	  else
+	      sprintf (delimiter, "[dec=%d, hex=%02x]",
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter);
+	  if (band != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, delimiter, strlen (delimiter),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 4)
+      {
+	  /* the RouteNum column */
+	  sqlite3_result_int (pContext, band);
+      }
+    if (column == 5)
+      {
+	  /* the RouteRow column */
+	  sqlite3_result_int (pContext, 0);
+      }
+    if (column == 6)
+      {
+	  /* role of this row */
+	  role = "Isochrone";
+	  sqlite3_result_text (pContext, role, strlen (role), SQLITE_TRANSIENT);
+      }
+    if (column == 7)
+      {
+	  /* the LinkRowId column */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 8)
+      {
+	  /* the NodeFrom column */
+	  if (node_code)
+	      sqlite3_result_text (pContext, multiSolution->From->Code,
+				   strlen (multiSolution->From->Code),
+				   SQLITE_STATIC);
+	  else
+	      sqlite3_result_int64 (pContext, multiSolution->From->Id);
+      }
+    if (column >= 9 && column <= 12)
+      {
+	  /* the NodeTo, PointFrom, PointTo and Tolerance columns */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 13)
+      {
+	  /* the Cost column: the band limit */
+	  sqlite3_result_double (pContext, multiSolution->Bands[band]);
+      }
+    if (column == 14)
+      {
+	  /* the Geometry column */
+	  gaiaGeomCollPtr geom = multiSolution->Isochrones[band];
+	  if (geom == NULL)
+	      sqlite3_result_null (pContext);
+	  else
+	    {
+		int len;
+		unsigned char *p_result = NULL;
+		gaiaToSpatiaLiteBlobWkb (geom, &p_result, &len);
+		sqlite3_result_blob (pContext, p_result, len, free);
+	    }
+      }
+    if (column == 15)
+      {
+	  /* the [optional] Name column */
+	  sqlite3_result_null (pContext);
+      }
+}
+
+static void
+do_matrix_node_column (sqlite3_context * pContext, int node_code,
+		       RoutingMultiDestPtr multiple, int index)
+{
+/* returning an origin or destination of a Cost Matrix, as requested */
+    if (node_code)
+      {
+	  const char *code = *(multiple->Codes + index);
+	  if (code == NULL)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, code, strlen (code),
+				   SQLITE_STATIC);
+      }
+    else
+	sqlite3_result_int64 (pContext, *(multiple->Ids + index));
+}
+
+static void
+do_matrix_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
+		  sqlite3_context * pContext, int node_code, int column)
+{
+/* processing a Cost Matrix solution row */
+    const char *algorithm;
+    char delimiter[128];
+    const char *role;
+    MultiSolutionPtr multiSolution = cursor->pVtab->multiSolution;
+    sqlite3_int64 row = multiSolution->CurrentRowId;
+    int from = (int) (row / multiSolution->MultiTo->Items);
+    int to = (int) (row % multiSolution->MultiTo->Items);
+    double cost = multiSolution->Matrix[row];
+
+    if (column == 0)
+      {
+	  /* the currently used Algorithm */
+	  if (net->currentAlgorithm == VROUTE_CH_ALGORITHM
+	      && net->graph->CH != NULL)
+	      algorithm = "CH";
+	  else
+	      algorithm = "Dijkstra";
+	  if (row != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 1)
+      {
+	  /* the current Request type */
+	  algorithm = "Matrix";
+	  if (row != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 2)
+      {
+	  /* the currently set Options: not applicable */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 3)
+      {
+	  /* the currently set delimiter char */
+	  if (isprint (cursor->pVtab->currentDelimiter))
+	      sprintf (delimiter, "%c [dec=%d, hex=%02x]",
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter);
+	  else
+	      sprintf (delimiter, "[dec=%d, hex=%02x]",
+		       cursor->pVtab->currentDelimiter,
+		       cursor->pVtab->currentDelimiter);
+	  if (row != 0)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_text (pContext, delimiter, strlen (delimiter),
+				   SQLITE_TRANSIENT);
+      }
+    if (column == 4)
+      {
+	  /* the RouteNum column */
+	  sqlite3_result_int64 (pContext, row);
+      }
+    if (column == 5)
+      {
+	  /* the RouteRow column */
+	  sqlite3_result_int (pContext, 0);
+      }
+    if (column == 6)
+      {
+	  /* role of this row */
+	  role = "Cost";
+	  sqlite3_result_text (pContext, role, strlen (role), SQLITE_TRANSIENT);
+      }
+    if (column == 7)
+      {
+	  /* the LinkRowId column */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 8)
+      {
+	  /* the NodeFrom column */
+	  do_matrix_node_column (pContext, node_code,
+				 multiSolution->MultiFrom, from);
+      }
+    if (column == 9)
+      {
+	  /* the NodeTo column */
+	  do_matrix_node_column (pContext, node_code, multiSolution->MultiTo,
+				 to);
+      }
+    if (column >= 10 && column <= 12)
+      {
+	  /* the PointFrom, PointTo and Tolerance columns */
+	  sqlite3_result_null (pContext);
+      }
+    if (column == 13)
+      {
+	  /* the Cost column: NULL if unreachable */
+	  if (cost == DBL_MAX)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_double (pContext, cost);
+      }
+    if (column == 14 || column == 15)
+      {
+	  /* the Geometry and [optional] Name columns */
+	  sqlite3_result_null (pContext);
+      }
+}
+
 static void
 do_common_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		  sqlite3_context * pContext, int node_code,
@@ -7954,6 +11696,13 @@ do_common_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		/* the currently used Algorithm */
 		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    algorithm = "A*";
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM)
+		    algorithm = "CH";
+		else if (net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM)
+		    algorithm = "Bidirectional Dijkstra";
+		else if (net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    algorithm = "Bidirectional A*";
 		else
 		    algorithm = "Dijkstra";
 		if (row != first)
@@ -8024,6 +11773,13 @@ do_common_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		/* the currently used Algorithm */
 		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    algorithm = "A*";
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM)
+		    algorithm = "CH";
+		else if (net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM)
+		    algorithm = "Bidirectional Dijkstra";
+		else if (net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    algorithm = "Bidirectional A*";
 		else
 		    algorithm = "Dijkstra";
 		if (row != first)
@@ -8182,6 +11938,13 @@ do_common_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		/* the currently used Algorithm */
 		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    algorithm = "A*";
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM)
+		    algorithm = "CH";
+		else if (net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM)
+		    algorithm = "Bidirectional Dijkstra";
+		else if (net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    algorithm = "Bidirectional A*";
 		else
 		    algorithm = "Dijkstra";
 		if (row != first)
@@ -8430,7 +12193,7 @@ do_common_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 	  if (column == 13)
 	    {
 		/* the Cost column */
-		sqlite3_result_double (pContext, row->linkRef->Link->Cost);
+		sqlite3_result_double (pContext, row->linkRef->Cost);
 	    }
 	  if (column == 14)
 	    {
@@ -8469,6 +12232,13 @@ do_point2point_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		/* the currently used Algorithm */
 		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    algorithm = "A*";
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM)
+		    algorithm = "CH";
+		else if (net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM)
+		    algorithm = "Bidirectional Dijkstra";
+		else if (net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    algorithm = "Bidirectional A*";
 		else
 		    algorithm = "Dijkstra";
 		sqlite3_result_text (pContext, algorithm,
@@ -8669,6 +12439,13 @@ do_point2point_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 		/* the currently used Algorithm */
 		if (net->currentAlgorithm == VROUTE_A_STAR_ALGORITHM)
 		    algorithm = "A*";
+		else if (net->currentAlgorithm == VROUTE_CH_ALGORITHM)
+		    algorithm = "CH";
+		else if (net->currentAlgorithm == VROUTE_BIDIJKSTRA_ALGORITHM)
+		    algorithm = "Bidirectional Dijkstra";
+		else if (net->currentAlgorithm ==
+			 VROUTE_BIDI_A_STAR_ALGORITHM)
+		    algorithm = "Bidirectional A*";
 		else
 		    algorithm = "Dijkstra";
 		sqlite3_result_text (pContext, algorithm,
@@ -8765,7 +12542,7 @@ do_point2point_column (virtualroutingCursorPtr cursor, virtualroutingPtr net,
 	  if (column == 13)
 	    {
 		/* the Cost column */
-		sqlite3_result_double (pContext, row->linkRef->Link->Cost);
+		sqlite3_result_double (pContext, row->linkRef->Cost);
 	    }
 	  if (column == 14)
 	    {
@@ -8796,6 +12573,25 @@ vroute_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
     virtualroutingCursorPtr cursor = (virtualroutingCursorPtr) pCursor;
     virtualroutingPtr net = (virtualroutingPtr) cursor->pVtab;
     node_code = net->graph->NodeCode;
+    if (net->graph->TD != NULL
+	&& column == ((net->graph->NameColumn != NULL) ? 16 : 15))
+      {
+	  /* the currently set Departure Time */
+	  sqlite3_result_double (pContext, net->DepartureTime);
+	  return SQLITE_OK;
+      }
+    if (cursor->pVtab->multiSolution->Mode == VROUTE_MATRIX_SOLUTION)
+      {
+	  /* processing a Cost Matrix solution */
+	  do_matrix_column (cursor, net, pContext, node_code, column);
+	  return SQLITE_OK;
+      }
+    if (cursor->pVtab->multiSolution->Mode == VROUTE_ISOCHRONE_SOLUTION)
+      {
+	  /* processing an Isochrones solution */
+	  do_isochrone_column (cursor, pContext, node_code, column);
+	  return SQLITE_OK;
+      }
     if (cursor->pVtab->multiSolution->Mode == VROUTE_RANGE_SOLUTION)
       {
 	  /* processing "within Cost range" solution */
@@ -8836,6 +12632,33 @@ vroute_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
     return SQLITE_OK;
 }
 
+static void
+vroute_parse_departure (sqlite3_value * value, double *departure)
+{
+/* 
+/ parsing the Departure Time: seconds since midnight, 
+/ or a 'HH:MM' or 'HH:MM:SS' TEXT string
+*/
+    int hh;
+    int mm;
+    int ss = 0;
+    if (sqlite3_value_type (value) == SQLITE_INTEGER
+	|| sqlite3_value_type (value) == SQLITE_FLOAT)
+      {
+	  *departure = sqlite3_value_double (value);
+	  return;
+      }
+    if (sqlite3_value_type (value) != SQLITE_TEXT)
+	return;
+    if (sscanf
+	((const char *) sqlite3_value_text (value), "%d:%d:%d", &hh, &mm,
+	 &ss) < 2)
+	return;
+    if (hh < 0 || hh > 24 || mm < 0 || mm > 59 || ss < 0 || ss > 59)
+	return;
+    *departure = (hh * 3600.0) + (mm * 60.0) + ss;
+}
+
 static int
 vroute_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 	       sqlite_int64 * pRowid)
@@ -8859,7 +12682,13 @@ vroute_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 	  else
 	    {
 		/* performing an UPDATE */
-		if (argc == 18)
+		int n_columns = 15;
+		int td_index = -1;
+		if (p_vtab->graph->NameColumn)
+		    n_columns++;
+		if (p_vtab->graph->TD != NULL)
+		    td_index = n_columns++;	/* the DepartureTime column */
+		if (argc == n_columns + 2)
 		  {
 		      p_vtab->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
 		      p_vtab->currentDelimiter = ',';
@@ -8870,8 +12699,44 @@ vroute_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 			    if (strcasecmp ((char *) algorithm, "A*") == 0)
 				p_vtab->currentAlgorithm =
 				    VROUTE_A_STAR_ALGORITHM;
+			    else if (strcasecmp ((char *) algorithm, "CH") == 0
+				     || strcasecmp ((char *) algorithm,
+						    "CONTRACTION HIERARCHIES")
+				     == 0)
+				p_vtab->currentAlgorithm = VROUTE_CH_ALGORITHM;
+			    else if (strcasecmp ((char *) algorithm,
+						 "BIDIJKSTRA") == 0
+				     || strcasecmp ((char *) algorithm,
+						    "BIDIRECTIONAL DIJKSTRA")
+				     == 0)
+				p_vtab->currentAlgorithm =
+				    VROUTE_BIDIJKSTRA_ALGORITHM;
+			    else if (strcasecmp ((char *) algorithm,
+						 "BIA*") == 0
+				     || strcasecmp ((char *) algorithm,
+						    "BIDIRECTIONAL A*") == 0)
+				p_vtab->currentAlgorithm =
+				    VROUTE_BIDI_A_STAR_ALGORITHM;
 			}
-		      if (p_vtab->graph->AStar == 0)
+		      if (p_vtab->graph->AStar == 0
+			  && p_vtab->currentAlgorithm ==
+			  VROUTE_A_STAR_ALGORITHM)
+			  p_vtab->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
+		      if (p_vtab->graph->AStar == 0
+			  && p_vtab->currentAlgorithm ==
+			  VROUTE_BIDI_A_STAR_ALGORITHM)
+			  p_vtab->currentAlgorithm =
+			      VROUTE_BIDIJKSTRA_ALGORITHM;
+		      if (p_vtab->graph->TD != NULL
+			  && p_vtab->currentAlgorithm ==
+			  VROUTE_BIDIJKSTRA_ALGORITHM)
+			  p_vtab->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
+		      if (p_vtab->graph->TD != NULL
+			  && p_vtab->currentAlgorithm ==
+			  VROUTE_BIDI_A_STAR_ALGORITHM)
+			  p_vtab->currentAlgorithm = VROUTE_A_STAR_ALGORITHM;
+		      if (p_vtab->graph->CH == NULL
+			  && p_vtab->currentAlgorithm == VROUTE_CH_ALGORITHM)
 			  p_vtab->currentAlgorithm = VROUTE_DIJKSTRA_ALGORITHM;
 		      if (sqlite3_value_type (argv[3]) == SQLITE_TEXT)
 			{
@@ -8888,6 +12753,16 @@ vroute_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 			    else if (strcasecmp
 				     ((char *) request, "SHORTEST PATH") == 0)
 				p_vtab->currentRequest = VROUTE_SHORTEST_PATH;
+			    else if (strcasecmp ((char *) request, "MATRIX")
+				     == 0
+				     || strcasecmp ((char *) request,
+						    "COST MATRIX") == 0)
+				p_vtab->currentRequest = VROUTE_MATRIX;
+			    else if (strcasecmp ((char *) request, "ISOCHRONE")
+				     == 0
+				     || strcasecmp ((char *) request,
+						    "ISOCHRONES") == 0)
+				p_vtab->currentRequest = VROUTE_ISOCHRONE;
 			}
 		      if (sqlite3_value_type (argv[4]) == SQLITE_TEXT)
 			{
@@ -8914,8 +12789,12 @@ vroute_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 				sqlite3_value_text (argv[5]);
 			    p_vtab->currentDelimiter = *delimiter;
 			}
-		      if (sqlite3_value_type (argv[14]) == SQLITE_FLOAT)
+		      if (sqlite3_value_type (argv[14]) == SQLITE_FLOAT
+			  || sqlite3_value_type (argv[14]) == SQLITE_INTEGER)
 			  p_vtab->Tolerance = sqlite3_value_double (argv[14]);
+		      if (td_index >= 0)
+			  vroute_parse_departure (argv[td_index + 2],
+						  &(p_vtab->DepartureTime));
 		  }
 		return SQLITE_OK;
 	    }
@@ -8970,7 +12849,7 @@ vroute_rename (sqlite3_vtab * pVTab, const char *zNew)
 }
 
 static int
-splitevirtualroutingInit (sqlite3 * db)
+splitevirtualroutingInit (sqlite3 * db, void *p_cache)
 {
     int rc = SQLITE_OK;
     my_route_module.iVersion = 1;
@@ -8993,13 +12872,14 @@ splitevirtualroutingInit (sqlite3 * db)
     my_route_module.xRollback = &vroute_rollback;
     my_route_module.xFindFunction = NULL;
     my_route_module.xRename = &vroute_rename;
-    sqlite3_create_module_v2 (db, "virtualrouting", &my_route_module, NULL, 0);
+    sqlite3_create_module_v2 (db, "virtualrouting", &my_route_module, p_cache,
+			      0);
     return rc;
 }
 
 SPATIALITE_PRIVATE int
-virtualrouting_extension_init (void *xdb)
+virtualrouting_extension_init (void *xdb, const void *p_cache)
 {
     sqlite3 *db = (sqlite3 *) xdb;
-    return splitevirtualroutingInit (db);
+    return splitevirtualroutingInit (db, (void *) p_cache);
 }
@@ -60,6 +60,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiaaux.h>
 #include <spatialite/gaiageo.h>
+#include <spatialite_private.h>
 
 #ifdef _WIN32
 #define strcasecmp	_stricmp
@@ -608,6 +609,78 @@ vspidx_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     return vspidx_create (db, pAux, argc, argv, ppVTab, pzErr);
 }
 
+static int
+vspidx_estimate (VirtualSpatialIndexPtr p_vt, sqlite3_index_info * pIdxInfo,
+		 double *estimated_rows, double *estimated_cost)
+{
+/*
+/ estimating the selectivity of the search frame from the
+/ R*Tree statistics computed by UpdateLayerStatistics()
+/ (the constraint values are only available since SQLite 3.38)
+*/
+#if SQLITE_VERSION_NUMBER >= 3038000
+    int i;
+    int ret = 0;
+    const char *tn = NULL;
+    const char *geom_column = NULL;
+    char *db_prefix = NULL;
+    char *table_name = NULL;
+    gaiaGeomCollPtr geom = NULL;
+    for (i = 0; i < pIdxInfo->nConstraint; i++)
+      {
+	  sqlite3_value *value = NULL;
+	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
+	  if (!p->usable)
+	      continue;
+	  if (sqlite3_vtab_rhs_value (pIdxInfo, i, &value) != SQLITE_OK
+	      || value == NULL)
+	      continue;
+	  if (p->iColumn == 0 && sqlite3_value_type (value) == SQLITE_TEXT)
+	      tn = (const char *) sqlite3_value_text (value);
+	  if (p->iColumn == 1 && sqlite3_value_type (value) == SQLITE_TEXT)
+	      geom_column = (const char *) sqlite3_value_text (value);
+	  if (p->iColumn == 2 && sqlite3_value_type (value) == SQLITE_BLOB
+	      && geom == NULL)
+	      geom =
+		  gaiaFromSpatiaLiteBlobWkb (sqlite3_value_blob (value),
+					     sqlite3_value_bytes (value));
+      }
+    if (tn != NULL)
+      {
+	  vspidx_parse_table_name (tn, &db_prefix, &table_name);
+	  if (geom != NULL)
+	    {
+		gaiaMbrGeometry (geom);
+		ret =
+		    splite_spatial_index_estimate (p_vt->db, db_prefix,
+						   table_name, geom_column, 1,
+						   geom->MinX, geom->MinY,
+						   geom->MaxX, geom->MaxY,
+						   estimated_rows,
+						   estimated_cost);
+	    }
+	  else
+	      ret =
+		  splite_spatial_index_estimate (p_vt->db, db_prefix,
+						 table_name, geom_column, 0,
+						 0.0, 0.0, 0.0, 0.0,
+						 estimated_rows,
+						 estimated_cost);
+      }
+    if (geom)
+	gaiaFreeGeomColl (geom);
+    if (db_prefix)
+	free (db_prefix);
+    if (table_name)
+	free (table_name);
+    return ret;
+#else
+    if (p_vt || pIdxInfo || estimated_rows || estimated_cost)
+	p_vt = p_vt;		/* unused arg warning suppression */
+    return 0;
+#endif
+}
+
 static int
 vspidx_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 {
@@ -618,15 +691,18 @@ vspidx_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
     int table = 0;
     int geom = 0;
     int mbr = 0;
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+    double rows;
+    double cost;
+    VirtualSpatialIndexPtr p_vt = (VirtualSpatialIndexPtr) pVTab;
     for (i = 0; i < pIdxInfo->nConstraint; i++)
       {
 	  /* verifying the constraints */
 	  struct sqlite3_index_constraint *p = &(pIdxInfo->aConstraint[i]);
 	  if (p->usable)
 	    {
-		if (p->iColumn == 0 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
+		if (p->iColumn < 0)
+		    ;		/* ROWID: left to SQLite (e.g. JOIN terms) */
+		else if (p->iColumn == 0 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
 		    table++;
 		else if (p->iColumn == 1 && p->op == SQLITE_INDEX_CONSTRAINT_EQ)
 		    geom++;
@@ -644,13 +720,26 @@ vspidx_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 	  else
 	      pIdxInfo->idxNum = 2;
 	  pIdxInfo->estimatedCost = 1.0;
+	  if (vspidx_estimate (p_vt, pIdxInfo, &rows, &cost))
+	    {
+		/* R*Tree statistics are available */
+		pIdxInfo->estimatedCost = cost;
+		pIdxInfo->estimatedRows = (sqlite3_int64) rows;
+	    }
 	  for (i = 0; i < pIdxInfo->nConstraint; i++)
 	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
+		/* args are always passed as Table [, Column], MBR */
+		struct sqlite3_index_constraint *p =
+		    &(pIdxInfo->aConstraint[i]);
+		if (!p->usable || p->iColumn < 0)
+		    continue;
+		if (p->iColumn == 0)
+		    pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+		else if (p->iColumn == 1)
+		    pIdxInfo->aConstraintUsage[i].argvIndex = 2;
+		else
+		    pIdxInfo->aConstraintUsage[i].argvIndex = geom + 2;
+		pIdxInfo->aConstraintUsage[i].omit = 1;
 	    }
 	  err = 0;
       }
@@ -50,6 +50,41 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "sqlite3.h"
 #include "spatialite.h"
 
+#ifndef OMIT_ICONV		/* only if ICONV is supported */
+static int
+check_pt_cache (sqlite3 * handle, const char *step)
+{
+/* checking the pt cache against the main table */
+    int ret;
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    int ok = 1;
+    const char *sql =
+	"SELECT (SELECT Count(*) FROM pt), "
+	"(SELECT Count(*) FROM cache_pt_g), "
+	"(SELECT Count(*) FROM pt WHERE MbrIntersects(g, BuildMbr(11.2, 42.4, 12.75, 43.7))), "
+	"(SELECT Count(*) FROM cache_pt_g WHERE mbr = FilterMbrIntersects(11.2, 42.4, 12.75, 43.7))";
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Error in pt cache [%s]: %s\n", step, err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    if (rows != 1 || strcmp (results[4], results[5]) != 0
+	|| strcmp (results[6], results[7]) != 0)
+      {
+	  fprintf (stderr, "Unexpected pt cache result [%s]: %s / %s - %s / %s\n",
+		   step, results[4], results[5], results[6], results[7]);
+	  ok = 0;
+      }
+    sqlite3_free_table (results);
+    return ok;
+}
+#endif /* end ICONV conditional */
+
 int
 main (int argc, char *argv[])
 {
@@ -557,6 +592,130 @@ main (int argc, char *argv[])
 	    }
       }
 
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE cache2_pt_g USING MbrCache(pt, g);",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE cache2_pt_g error: %s\n",
+		   err_msg);
+	  sqlite3_free (err_msg);
+	  return -63;
+      }
+    for (pt = 0; pt < 3; pt++)
+      {
+	  /* comparing both the incrementally updated and the freshly loaded caches */
+	  const char *filter[] = { "Within", "Contains", "Intersects" };
+	  char sql[1024];
+	  sprintf (sql,
+		   "SELECT (SELECT Count(*) FROM pt WHERE Mbr%s(g, BuildMbr(11.2, 42.4, 12.75, 43.7))), "
+		   "(SELECT Count(*) FROM cache_pt_g WHERE mbr = FilterMbr%s(11.2, 42.4, 12.75, 43.7)), "
+		   "(SELECT Count(*) FROM cache2_pt_g WHERE mbr = FilterMbr%s(11.2, 42.4, 12.75, 43.7))",
+		   filter[pt], filter[pt], filter[pt]);
+	  if (pt == 1)
+	      sprintf (sql,
+		       "SELECT (SELECT Count(*) FROM pt WHERE MbrContains(g, BuildMbr(11.5, 43.5, 11.5, 43.5))), "
+		       "(SELECT Count(*) FROM cache_pt_g WHERE mbr = FilterMbrContains(11.5, 43.5, 11.5, 43.5)), "
+		       "(SELECT Count(*) FROM cache2_pt_g WHERE mbr = FilterMbrContains(11.5, 43.5, 11.5, 43.5))");
+	  ret =
+	      sqlite3_get_table (handle, sql, &results, &rows, &columns,
+				 &err_msg);
+	  if (ret != SQLITE_OK)
+	    {
+		fprintf (stderr, "Error in Mbr%s pt: %s\n", filter[pt],
+			 err_msg);
+		sqlite3_free (err_msg);
+		return -64;
+	    }
+	  if (rows != 1 || atoi (results[3]) == 0
+	      || strcmp (results[3], results[4]) != 0
+	      || strcmp (results[3], results[5]) != 0)
+	    {
+		fprintf (stderr,
+			 "Unexpected Mbr%s pt result: %s / %s / %s\n",
+			 filter[pt], results[3], results[4], results[5]);
+		sqlite3_free_table (results);
+		return -65;
+	    }
+	  sqlite3_free_table (results);
+      }
+
+    ret = sqlite3_exec (handle, "BEGIN", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "BEGIN error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -66;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "INSERT INTO pt (id, g) VALUES (20000, GeomFromText('POINT(11.5 43.5)', 4326));"
+		      "DELETE FROM pt WHERE id BETWEEN 100 AND 199;"
+		      "UPDATE pt SET g = GeomFromText('POINT(12.5 42.5)', 4326) WHERE id BETWEEN 200 AND 299;",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "pt transaction error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -67;
+      }
+    if (!check_pt_cache (handle, "transaction"))
+	return -68;
+    ret = sqlite3_exec (handle, "ROLLBACK", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "ROLLBACK error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -69;
+      }
+    if (!check_pt_cache (handle, "rollback"))
+	return -70;
+
+    ret =
+	sqlite3_exec (handle,
+		      "BEGIN;"
+		      "INSERT INTO pt (id, g) VALUES (20001, GeomFromText('POINT(11.6 43.6)', 4326));"
+		      "SAVEPOINT sp1;"
+		      "DELETE FROM pt WHERE id BETWEEN 300 AND 399;"
+		      "UPDATE pt SET g = GeomFromText('POINT(12.5 42.5)', 4326) WHERE id BETWEEN 400 AND 499;",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "pt savepoint error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -71;
+      }
+    ret =
+	sqlite3_exec (handle, "ROLLBACK TO sp1; RELEASE sp1; COMMIT;", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "ROLLBACK TO error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -72;
+      }
+    if (!check_pt_cache (handle, "savepoint"))
+	return -73;
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT Count(*), Max(generation) FROM cache_pt_g_snapshot",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Error in MbrCache snapshot: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -74;
+      }
+    if (rows != 1 || atoi (results[2]) < 2 || atoi (results[3]) < 2)
+      {
+	  fprintf (stderr, "Unexpected MbrCache snapshot: %s / %s\n",
+		   results[2], results[3]);
+	  sqlite3_free_table (results);
+	  return -75;
+      }
+    sqlite3_free_table (results);
+
     ret = sqlite3_exec (handle, "SELECT CreateMbrCache(1, 'geom');",
 			NULL, NULL, &err_msg);
     if (ret != SQLITE_OK)
@@ -47,6 +47,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #include "config.h"
 
@@ -2165,6 +2166,300 @@ test_legacy_mode ()
     return 0;
 }
 
+int
+test_geos_cache ()
+{
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    unsigned long hits;
+    unsigned long misses;
+    int returnValue = 0;
+    void *cache = spatialite_alloc_connection ();
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory db: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -401;
+      }
+
+    spatialite_init_ex (handle, cache, 0);
+
+    /* checking the GEOS cache size */
+    if (get_geos_cache_size (cache) != 16)
+      {
+	  fprintf (stderr, "unexpected default GEOS cache size: %d\n",
+		   get_geos_cache_size (cache));
+	  returnValue = -402;
+	  goto exit;
+      }
+    set_geos_cache_size (cache, 1);
+    if (get_geos_cache_size (cache) != 2)
+      {
+	  fprintf (stderr, "unexpected min GEOS cache size: %d\n",
+		   get_geos_cache_size (cache));
+	  returnValue = -403;
+	  goto exit;
+      }
+    set_geos_cache_size (cache, 100000);
+    if (get_geos_cache_size (cache) != 1024)
+      {
+	  fprintf (stderr, "unexpected max GEOS cache size: %d\n",
+		   get_geos_cache_size (cache));
+	  returnValue = -404;
+	  goto exit;
+      }
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT SetGeosCacheSize(8), GetGeosCacheSize()",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SetGeosCacheSize error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -405;
+	  goto exit;
+      }
+    if (rows != 1 || results[3] == NULL || atoi (results[3]) != 8)
+      {
+	  fprintf (stderr, "unexpected GetGeosCacheSize() result\n");
+	  sqlite3_free_table (results);
+	  returnValue = -406;
+	  goto exit;
+      }
+    sqlite3_free_table (results);
+
+#ifndef OMIT_GEOS		/* only if GEOS is supported */
+    /* two outer geometries interleaved on each row */
+    ret =
+	sqlite3_get_table (handle,
+			   "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10) "
+			   "SELECT Sum(ST_Intersects(CASE i % 2 WHEN 1 THEN BuildMbr(0, 0, 10, 10) "
+			   "ELSE BuildMbr(20, 20, 30, 30) END, MakePoint((1 - i % 2) * 20 + i * 0.5, "
+			   "(1 - i % 2) * 20 + i * 0.5))) FROM n",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "ST_Intersects error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -407;
+	  goto exit;
+      }
+    if (rows != 1 || results[1] == NULL || atoi (results[1]) != 10)
+      {
+	  fprintf (stderr, "unexpected ST_Intersects result\n");
+	  sqlite3_free_table (results);
+	  returnValue = -408;
+	  goto exit;
+      }
+    sqlite3_free_table (results);
+    get_geos_cache_stats (cache, &hits, &misses);
+    if (hits != 8 || misses != 2)
+      {
+	  fprintf (stderr, "unexpected GEOS cache stats: hits=%lu misses=%lu\n",
+		   hits, misses);
+	  returnValue = -409;
+	  goto exit;
+      }
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT GetGeosCacheHits(), GetGeosCacheMisses()",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "GetGeosCacheHits error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -410;
+	  goto exit;
+      }
+    if (rows != 1 || results[2] == NULL || results[3] == NULL
+	|| atoi (results[2]) != 8 || atoi (results[3]) != 2)
+      {
+	  fprintf (stderr, "unexpected GetGeosCacheHits() result\n");
+	  sqlite3_free_table (results);
+	  returnValue = -411;
+	  goto exit;
+      }
+    sqlite3_free_table (results);
+#endif /* end GEOS conditional */
+
+    ret =
+	sqlite3_exec (handle, "SELECT ResetGeosCacheStats()", NULL, NULL,
+		      &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "ResetGeosCacheStats error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -412;
+	  goto exit;
+      }
+    get_geos_cache_stats (cache, &hits, &misses);
+    if (hits != 0 || misses != 0)
+      {
+	  fprintf (stderr, "unexpected GEOS cache stats after reset\n");
+	  returnValue = -413;
+	  goto exit;
+      }
+
+    /* Cleanup and exit */
+  exit:
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -414;
+      }
+
+    spatialite_cleanup_ex (cache);
+    return returnValue;
+}
+
+#ifndef OMIT_GEOS		/* only if GEOS is supported */
+static int
+check_union_area (sqlite3 * handle, int threads)
+{
+/* aggregating 1000 overlapping squares into a single rectangle */
+    int ret;
+    char *sql;
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    double area;
+
+    sql =
+	sqlite3_mprintf ("SELECT SetUnionThreads(%d), ST_Area(ST_Union(g)) "
+			 "FROM (WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL "
+			 "SELECT i + 1 FROM n WHERE i < 999) "
+			 "SELECT BuildMbr(i % 40, i / 40, (i % 40) + 1.5, "
+			 "(i / 40) + 1.5) AS g FROM n)", threads);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "ST_Union error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    if (rows != 1 || results[3] == NULL)
+      {
+	  fprintf (stderr, "unexpected ST_Union result (threads=%d)\n",
+		   threads);
+	  sqlite3_free_table (results);
+	  return 0;
+      }
+    area = atof (results[3]);
+    sqlite3_free_table (results);
+    if (fabs (area - (40.5 * 25.5)) > 0.0000001)
+      {
+	  fprintf (stderr, "unexpected ST_Union area (threads=%d): %1.6f\n",
+		   threads, area);
+	  return 0;
+      }
+    return 1;
+}
+#endif /* end GEOS conditional */
+
+int
+test_union_threads ()
+{
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    int returnValue = 0;
+    void *cache = spatialite_alloc_connection ();
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory db: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -501;
+      }
+
+    spatialite_init_ex (handle, cache, 0);
+
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT SetUnionThreads(3), GetUnionThreads()",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SetUnionThreads error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -502;
+	  goto exit;
+      }
+    if (rows != 1 || results[3] == NULL || atoi (results[3]) != 3)
+      {
+	  fprintf (stderr, "unexpected GetUnionThreads() result\n");
+	  sqlite3_free_table (results);
+	  returnValue = -503;
+	  goto exit;
+      }
+    sqlite3_free_table (results);
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT SetUnionThreads(0), GetUnionThreads()",
+			   &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SetUnionThreads error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  returnValue = -504;
+	  goto exit;
+      }
+    if (rows != 1 || results[3] == NULL || atoi (results[3]) < 1)
+      {
+	  fprintf (stderr, "unexpected automatic GetUnionThreads() result\n");
+	  sqlite3_free_table (results);
+	  returnValue = -505;
+	  goto exit;
+      }
+    sqlite3_free_table (results);
+
+#ifndef OMIT_GEOS		/* only if GEOS is supported */
+    if (!check_union_area (handle, 1))
+      {
+	  returnValue = -506;
+	  goto exit;
+      }
+    if (!check_union_area (handle, 4))
+      {
+	  returnValue = -507;
+	  goto exit;
+      }
+#endif /* end GEOS conditional */
+
+    /* Cleanup and exit */
+  exit:
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -508;
+      }
+
+    spatialite_cleanup_ex (cache);
+    return returnValue;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -2178,6 +2473,12 @@ main (int argc, char *argv[])
     if (ret != 0)
 	return ret;
     ret = test_legacy_mode ();
+    if (ret != 0)
+	return ret;
+    ret = test_geos_cache ();
+    if (ret != 0)
+	return ret;
+    ret = test_union_threads ();
     if (ret != 0)
 	return ret;
     return 0;
@@ -0,0 +1,477 @@
+/*
+
+ check_routing_heap.c -- SpatiaLite Test Case
+
+ Author: Sandro Furieri <a.furieri@lqt.it>
+
+ ------------------------------------------------------------------------------
+ 
+ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ 
+ The contents of this file are subject to the Mozilla Public License Version
+ 1.1 (the "License"); you may not use this file except in compliance with
+ the License. You may obtain a copy of the License at
+ http://www.mozilla.org/MPL/
+ 
+Software distributed under the License is distributed on an "AS IS" basis,
+WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+for the specific language governing rights and limitations under the
+License.
+
+The Original Code is the SpatiaLite library
+
+The Initial Developer of the Original Code is Alessandro Furieri
+ 
+Portions created by the Initial Developer are Copyright (C) 2011
+the Initial Developer. All Rights Reserved.
+
+Contributor(s):
+
+Alternatively, the contents of this file may be used under the terms of
+either the GNU General Public License Version 2 or later (the "GPL"), or
+the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+in which case the provisions of the GPL or the LGPL are applicable instead
+of those above. If you wish to allow use of your version of this file only
+under the terms of either the GPL or the LGPL, and not to allow others to
+use your version of this file under the terms of the MPL, indicate your
+decision by deleting the provisions above and replace them with the notice
+and other provisions required by the GPL or the LGPL. If you do not delete
+the provisions above, a recipient may use your version of this file under
+the terms of any one of the MPL, the GPL or the LGPL.
+ 
+*/
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "config.h"
+
+#include "sqlite3.h"
+#include "spatialite.h"
+
+/*
+/ comparing the VirtualRouting priority queues (D-ary and Radix heap)
+/ on the test networks: both must return the same costs, and
+/ the time spent by each one is reported on stderr
+*/
+
+#define HEAP_PAIRS	200
+#define HEAP_RANGES	20
+#define HEAP_GRID	60
+
+static const char *heap_kinds[] = { "D-ary", "Radix" };
+
+static int
+do_create_grid (sqlite3 * handle)
+{
+/* creating a regular grid network with integer-like costs */
+    int ret;
+    int i;
+    int j;
+    int dir;
+    unsigned int seed = 12345;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt;
+    const char *sql;
+
+    ret = sqlite3_exec (handle,
+			"CREATE TABLE grid_roads (id INTEGER PRIMARY KEY, "
+			"node_from INTEGER, node_to INTEGER, cost DOUBLE)",
+			NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE TABLE grid_roads: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    sql = "INSERT INTO grid_roads (node_from, node_to, cost) VALUES (?, ?, ?)";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "INSERT INTO grid_roads: %s\n",
+		   sqlite3_errmsg (handle));
+	  return 0;
+      }
+    sqlite3_exec (handle, "BEGIN", NULL, NULL, NULL);
+    for (i = 0; i < HEAP_GRID; i++)
+      {
+	  for (j = 0; j < HEAP_GRID; j++)
+	    {
+		for (dir = 0; dir < 2; dir++)
+		  {
+		      int ii = (dir == 0) ? i + 1 : i;
+		      int jj = (dir == 1) ? j + 1 : j;
+		      if (ii >= HEAP_GRID || jj >= HEAP_GRID)
+			  continue;
+		      seed = (seed * 1103515245) + 12345;
+		      sqlite3_reset (stmt);
+		      sqlite3_clear_bindings (stmt);
+		      sqlite3_bind_int (stmt, 1, (i * HEAP_GRID) + j + 1);
+		      sqlite3_bind_int (stmt, 2, (ii * HEAP_GRID) + jj + 1);
+		      sqlite3_bind_double (stmt, 3,
+					   (double) (1 + ((seed >> 16) % 9)));
+		      ret = sqlite3_step (stmt);
+		      if (ret != SQLITE_DONE)
+			{
+			    fprintf (stderr, "INSERT INTO grid_roads: %s\n",
+				     sqlite3_errmsg (handle));
+			    sqlite3_finalize (stmt);
+			    return 0;
+			}
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+    sqlite3_exec (handle, "COMMIT", NULL, NULL, NULL);
+    return 1;
+}
+
+static int
+do_set_heap (sqlite3 * handle, const char *kind)
+{
+/* selecting the VirtualRouting priority queue */
+    int ret;
+    int result = 0;
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT SetRoutingHeap(?)";
+
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SetRoutingHeap: %s\n", sqlite3_errmsg (handle));
+	  return 0;
+      }
+    sqlite3_bind_text (stmt, 1, kind, -1, SQLITE_STATIC);
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+	result = sqlite3_column_int (stmt, 0);
+    sqlite3_finalize (stmt);
+    return result;
+}
+
+struct heap_nodes
+{
+/* the Nodes of a network: either TEXT codes or INTEGER ids */
+    int count;
+    int node_code;
+    char **codes;
+    int *ids;
+};
+
+static int
+do_load_nodes (sqlite3 * handle, const char *input_table,
+	       struct heap_nodes *nodes)
+{
+/* loading all Nodes of a network */
+    int ret;
+    int i = 0;
+    char *sql;
+    sqlite3_stmt *stmt;
+
+    nodes->count = 0;
+    nodes->node_code = 0;
+    nodes->codes = NULL;
+    nodes->ids = NULL;
+    sql = sqlite3_mprintf ("SELECT Count(*) FROM (SELECT node_from FROM "
+			   "\"%s\" UNION SELECT node_to FROM \"%s\")",
+			   input_table, input_table);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+	nodes->count = sqlite3_column_int (stmt, 0);
+    sqlite3_finalize (stmt);
+    if (nodes->count <= 0)
+	return 0;
+    nodes->codes = malloc (sizeof (char *) * nodes->count);
+    nodes->ids = malloc (sizeof (int) * nodes->count);
+
+    sql = sqlite3_mprintf ("SELECT node_from FROM \"%s\" UNION "
+			   "SELECT node_to FROM \"%s\" ORDER BY 1",
+			   input_table, input_table);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  nodes->count = 0;
+	  return 0;
+      }
+    while (sqlite3_step (stmt) == SQLITE_ROW && i < nodes->count)
+      {
+	  nodes->codes[i] = NULL;
+	  nodes->ids[i] = 0;
+	  if (sqlite3_column_type (stmt, 0) == SQLITE_TEXT)
+	    {
+		const char *code =
+		    (const char *) sqlite3_column_text (stmt, 0);
+		nodes->codes[i] = malloc (strlen (code) + 1);
+		strcpy (nodes->codes[i], code);
+		nodes->node_code = 1;
+	    }
+	  else
+	      nodes->ids[i] = sqlite3_column_int (stmt, 0);
+	  i++;
+      }
+    sqlite3_finalize (stmt);
+    nodes->count = i;
+    return 1;
+}
+
+static void
+do_free_nodes (struct heap_nodes *nodes)
+{
+/* memory cleanup: freeing the Nodes of a network */
+    int i;
+    if (nodes->codes != NULL)
+      {
+	  for (i = 0; i < nodes->count; i++)
+	    {
+		if (nodes->codes[i] != NULL)
+		    free (nodes->codes[i]);
+	    }
+	  free (nodes->codes);
+      }
+    if (nodes->ids != NULL)
+	free (nodes->ids);
+}
+
+static void
+do_bind_node (sqlite3_stmt * stmt, int pos, struct heap_nodes *nodes,
+	      int index)
+{
+/* binding a Node (either TEXT code or INTEGER id) */
+    if (nodes->node_code)
+	sqlite3_bind_text (stmt, pos, nodes->codes[index], -1,
+			   SQLITE_STATIC);
+    else
+	sqlite3_bind_int (stmt, pos, nodes->ids[index]);
+}
+
+static int
+do_bench (sqlite3 * handle, const char *network, const char *input_table)
+{
+/* running the same queries by using each priority queue */
+    int ret;
+    int k;
+    int i;
+    int result = 0;
+    char *sql;
+    clock_t t0;
+    double costs[2][HEAP_PAIRS + HEAP_RANGES];
+    struct heap_nodes nodes;
+    sqlite3_stmt *stmt_path = NULL;
+    sqlite3_stmt *stmt_range = NULL;
+
+    if (!do_load_nodes (handle, input_table, &nodes))
+	goto error;
+    sql = sqlite3_mprintf ("SELECT Cost FROM \"%s\" WHERE NodeFrom = ? "
+			   "AND NodeTo = ? LIMIT 1", network);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt_path, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    sql = sqlite3_mprintf ("SELECT Count(*), Sum(Cost) FROM \"%s\" "
+			   "WHERE NodeFrom = ? AND Cost <= ?", network);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt_range, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+
+    for (k = 0; k < 2; k++)
+      {
+	  if (!do_set_heap (handle, heap_kinds[k]))
+	    {
+		fprintf (stderr, "SetRoutingHeap('%s'): unexpected failure\n",
+			 heap_kinds[k]);
+		result = -2;
+		goto end;
+	    }
+	  t0 = clock ();
+	  for (i = 0; i < HEAP_PAIRS; i++)
+	    {
+		/* Shortest Path */
+		sqlite3_reset (stmt_path);
+		sqlite3_clear_bindings (stmt_path);
+		do_bind_node (stmt_path, 1, &nodes, (i * 37) % nodes.count);
+		do_bind_node (stmt_path, 2, &nodes,
+			      ((i * 101) + 17) % nodes.count);
+		costs[k][i] = -1.0;
+		ret = sqlite3_step (stmt_path);
+		if (ret == SQLITE_ROW
+		    && sqlite3_column_type (stmt_path, 0) != SQLITE_NULL)
+		    costs[k][i] = sqlite3_column_double (stmt_path, 0);
+		else if (ret != SQLITE_ROW && ret != SQLITE_DONE)
+		    goto error;
+		/* a single VirtualRouting cursor can be open at once */
+		sqlite3_reset (stmt_path);
+	    }
+	  for (i = 0; i < HEAP_RANGES; i++)
+	    {
+		/* Range analysis */
+		sqlite3_reset (stmt_range);
+		sqlite3_clear_bindings (stmt_range);
+		do_bind_node (stmt_range, 1, &nodes, (i * 53) % nodes.count);
+		sqlite3_bind_double (stmt_range, 2, 10.0 * (i + 1));
+		ret = sqlite3_step (stmt_range);
+		if (ret != SQLITE_ROW)
+		    goto error;
+		costs[k][HEAP_PAIRS + i] =
+		    sqlite3_column_int (stmt_range, 0) +
+		    sqlite3_column_double (stmt_range, 1);
+		sqlite3_reset (stmt_range);
+	    }
+	  fprintf (stderr, "%s %s heap: %d queries %1.3f ms\n", network,
+		   heap_kinds[k], HEAP_PAIRS + HEAP_RANGES,
+		   ((double) (clock () - t0) * 1000.0) / CLOCKS_PER_SEC);
+      }
+
+    for (i = 0; i < HEAP_PAIRS + HEAP_RANGES; i++)
+      {
+	  /* both heaps are expected to return the same costs */
+	  if (fabs (costs[0][i] - costs[1][i]) >
+	      0.000001 * (1.0 + fabs (costs[0][i])))
+	    {
+		fprintf (stderr,
+			 "%s: query #%d unexpected cost %1.6f (expected %1.6f)\n",
+			 network, i, costs[1][i], costs[0][i]);
+		result = -3;
+		goto end;
+	    }
+      }
+    goto end;
+
+  error:
+    fprintf (stderr, "%s: %s\n", network, sqlite3_errmsg (handle));
+    result = -1;
+  end:
+    do_free_nodes (&nodes);
+    if (stmt_path != NULL)
+	sqlite3_finalize (stmt_path);
+    if (stmt_range != NULL)
+	sqlite3_finalize (stmt_range);
+    do_set_heap (handle, "D-ary");
+    return result;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt;
+    const char *sql;
+    void *cache = spatialite_alloc_connection ();
+
+    if (argc > 1 || argv[0] == NULL)
+	argc = 1;		/* silencing stupid compiler warnings */
+
+    ret = system ("cp orbetello.sqlite copy-routing-heap.sqlite");
+    if (ret != 0)
+      {
+	  fprintf (stderr, "cannot copy orbetello.sqlite database\n");
+	  return -1;
+      }
+
+    ret =
+	sqlite3_open_v2 ("copy-routing-heap.sqlite", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr,
+		   "cannot open copy-routing-heap.sqlite database: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -1;
+      }
+
+    spatialite_init_ex (handle, cache, 0);
+
+/* testing the priority queue settings */
+    if (do_set_heap (handle, "unknown") != 0)
+      {
+	  fprintf (stderr, "SetRoutingHeap('unknown'): unexpected success\n");
+	  return -2;
+      }
+    if (!do_set_heap (handle, "RADIX"))
+      {
+	  fprintf (stderr, "SetRoutingHeap('RADIX'): unexpected failure\n");
+	  return -3;
+      }
+    sql = "SELECT GetRoutingHeap()";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "GetRoutingHeap: %s\n", sqlite3_errmsg (handle));
+	  return -4;
+      }
+    ret = sqlite3_step (stmt);
+    if (ret != SQLITE_ROW
+	|| strcmp ((const char *) sqlite3_column_text (stmt, 0), "RADIX") != 0)
+      {
+	  fprintf (stderr, "GetRoutingHeap: unexpected result\n");
+	  sqlite3_finalize (stmt);
+	  return -5;
+      }
+    sqlite3_finalize (stmt);
+
+/* the Orbetello road network (TEXT node codes, real costs) */
+    sql =
+	"SELECT CreateRouting('heap_roads_data', 'heap_roads', 'roads', "
+	"'node_from', 'node_to', NULL, 'cost', NULL, 0, 1, 'oneway_from_to', "
+	"'oneway_to_from', 0)";
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CreateRouting #1: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -6;
+      }
+    ret = do_bench (handle, "heap_roads", "roads");
+    if (ret != 0)
+      {
+	  fprintf (stderr, "Orbetello network error\n");
+	  return -7;
+      }
+
+/* a grid network (INTEGER node ids, integer-like costs) */
+    if (!do_create_grid (handle))
+	return -8;
+    sql =
+	"SELECT CreateRouting('heap_grid_data', 'heap_grid', 'grid_roads', "
+	"'node_from', 'node_to', NULL, 'cost', NULL, 0, 1, NULL, NULL, 0)";
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CreateRouting #2: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -9;
+      }
+    ret = do_bench (handle, "heap_grid", "grid_roads");
+    if (ret != 0)
+      {
+	  fprintf (stderr, "Grid network error\n");
+	  return -10;
+      }
+
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -11;
+      }
+
+    spatialite_cleanup_ex (cache);
+    spatialite_shutdown ();
+    ret = unlink ("copy-routing-heap.sqlite");
+    if (ret != 0)
+      {
+	  fprintf (stderr, "cannot remove copy-routing-heap database\n");
+	  return -12;
+      }
+    return 0;
+}
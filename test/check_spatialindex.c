@@ -1634,6 +1634,662 @@ do_test_rowid (sqlite3 * handle)
     return 0;
 }
 
+static int
+do_test_bulk_query (sqlite3 * handle, const char *sql, int expected)
+{
+/* checking a single query against the expected count */
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    int ret = sqlite3_get_table (handle, sql, &results, &rows, &columns,
+				 &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Error: %s\n%s\n", sql, err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    if (rows != 1 || results[1] == NULL || atoi (results[1]) != expected)
+      {
+	  fprintf (stderr, "Unexpected result: %s (expected %d)\n", sql,
+		   expected);
+	  sqlite3_free_table (results);
+	  return 0;
+      }
+    sqlite3_free_table (results);
+    return 1;
+}
+
+static int
+do_test_bulk_load (void)
+{
+/* testing R*Tree bulk loading (STR packing) */
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    int retcode = 0;
+    void *cache = spatialite_alloc_connection ();
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory database: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  spatialite_cleanup_ex (cache);
+	  return -401;
+      }
+    spatialite_init_ex (handle, cache, 0);
+
+    ret =
+	sqlite3_exec (handle, "SELECT InitSpatialMetadata(1, 'NONE')", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "InitSpatialMetadata() error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -402;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE bulk (id INTEGER PRIMARY KEY AUTOINCREMENT);"
+		      "SELECT AddGeometryColumn('bulk', 'geom', 4326, 'POLYGON', 'XY');"
+		      "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 6000) "
+		      "INSERT INTO bulk (id, geom) SELECT i, "
+		      "BuildMbr((i % 97) * 1.5, (i % 89) * 0.75, (i % 97) * 1.5 + (i % 7) * 0.1, "
+		      "(i % 89) * 0.75 + (i % 5) * 0.1, 4326) FROM n;"
+		      "INSERT INTO bulk (id, geom) VALUES (6001, NULL)", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "populating table bulk error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -403;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle, "SELECT CreateSpatialIndex('bulk', 'geom')", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CreateSpatialIndex(bulk) error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -404;
+	  goto end;
+      }
+
+/* checking the bulk loaded R*Tree */
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_bulk_geom", 6000))
+      {
+	  retcode = -405;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('bulk', 'geom')", 1))
+      {
+	  retcode = -406;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) = (SELECT Count(*) FROM bulk WHERE MbrIntersects(geom, "
+	 "BuildMbr(10, 10, 40, 30))) FROM idx_bulk_geom WHERE xmin <= 40 AND "
+	 "xmax >= 10 AND ymin <= 30 AND ymax >= 10", 1))
+      {
+	  retcode = -407;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM idx_bulk_geom_node WHERE nodeno = 1 AND "
+	 "substr(data, 1, 2) <> X'0000'", 1))
+      {
+	  retcode = -408;
+	  goto end;
+      }
+
+/* the R*Tree must still support ordinary updates */
+    ret =
+	sqlite3_exec (handle,
+		      "INSERT INTO bulk (id, geom) VALUES (6002, BuildMbr(12, 12, 13, 13, 4326));"
+		      "DELETE FROM bulk WHERE id BETWEEN 100 AND 199;"
+		      "UPDATE bulk SET geom = BuildMbr(1000, 1000, 1001, 1001, 4326) WHERE id = 500",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table bulk error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -409;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('bulk', 'geom')", 1))
+      {
+	  retcode = -410;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM idx_bulk_geom WHERE xmin <= 1001 AND xmax >= 1000 "
+	 "AND ymin <= 1001 AND ymax >= 1000", 1))
+      {
+	  retcode = -411;
+	  goto end;
+      }
+
+/* rebuilding the R*Tree from scratch */
+    ret =
+	sqlite3_exec (handle,
+		      "DELETE FROM idx_bulk_geom WHERE pkid > 3000", NULL, NULL,
+		      &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "DELETE FROM idx_bulk_geom error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -412;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('bulk', 'geom')", 0))
+      {
+	  retcode = -413;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT RecoverSpatialIndex('bulk', 'geom')", 1))
+      {
+	  retcode = -414;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_bulk_geom", 5901))
+      {
+	  retcode = -415;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('bulk', 'geom')", 1))
+      {
+	  retcode = -416;
+	  goto end;
+      }
+
+/* an empty table */
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE bulk_empty (id INTEGER PRIMARY KEY);"
+		      "SELECT AddGeometryColumn('bulk_empty', 'geom', 4326, 'POINT', 'XY');"
+		      "SELECT CreateSpatialIndex('bulk_empty', 'geom');"
+		      "INSERT INTO bulk_empty (id, geom) VALUES (1, MakePoint(1, 2, 4326))",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "table bulk_empty error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -417;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('bulk_empty', 'geom')", 1))
+      {
+	  retcode = -418;
+	  goto end;
+      }
+
+  end:
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  if (retcode == 0)
+	      retcode = -419;
+      }
+    spatialite_cleanup_ex (cache);
+    return retcode;
+}
+
+static int
+do_test_deferred_index (void)
+{
+/* testing the deferred SpatialIndex mode */
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    int retcode = 0;
+    void *cache = spatialite_alloc_connection ();
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory database: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  spatialite_cleanup_ex (cache);
+	  return -501;
+      }
+    spatialite_init_ex (handle, cache, 0);
+
+    ret =
+	sqlite3_exec (handle, "SELECT InitSpatialMetadata(1, 'NONE')", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "InitSpatialMetadata() error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -502;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE deferred (id INTEGER PRIMARY KEY);"
+		      "SELECT AddGeometryColumn('deferred', 'geom', 4326, 'POINT', 'XY');",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "creating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -503;
+	  goto end;
+      }
+
+/* no R*Tree yet: deferred mode can't be enabled */
+    if (!do_test_bulk_query
+	(handle, "SELECT EnableDeferredSpatialIndex('deferred', 'geom')", 0))
+      {
+	  retcode = -504;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CreateSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -505;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT EnableDeferredSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -506;
+	  goto end;
+      }
+
+/* bulk loading: the R*Tree is left untouched until flushed */
+    ret =
+	sqlite3_exec (handle,
+		      "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 3000) "
+		      "INSERT INTO deferred (id, geom) SELECT i, "
+		      "MakePoint((i % 97) * 1.5, (i % 89) * 0.75, 4326) FROM n",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "populating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -507;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom", 0))
+      {
+	  retcode = -508;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom_pending", 3000))
+      {
+	  retcode = -509;
+	  goto end;
+      }
+    if (!do_test_bulk_query (handle, "SELECT FlushDeferredSpatialIndex()", 1))
+      {
+	  retcode = -510;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom_pending", 0))
+      {
+	  retcode = -511;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -512;
+	  goto end;
+      }
+
+/* a few changes: applied as a single batch */
+    ret =
+	sqlite3_exec (handle,
+		      "DELETE FROM deferred WHERE id BETWEEN 100 AND 199;"
+		      "UPDATE deferred SET geom = MakePoint(1000, 1000, 4326) WHERE id = 500;"
+		      "UPDATE deferred SET geom = NULL WHERE id = 501;"
+		      "INSERT INTO deferred (id, geom) VALUES (3001, MakePoint(1, 1, 4326))",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -513;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom_pending", 103))
+      {
+	  retcode = -514;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT FlushDeferredSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -515;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom", 2900))
+      {
+	  retcode = -516;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM idx_deferred_geom WHERE xmin <= 1001 AND xmax >= 1000 "
+	 "AND ymin <= 1001 AND ymax >= 1000", 1))
+      {
+	  retcode = -517;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -518;
+	  goto end;
+      }
+
+/* back to the immediate mode: pending changes are applied */
+    ret =
+	sqlite3_exec (handle,
+		      "INSERT INTO deferred (id, geom) VALUES (3002, MakePoint(2, 2, 4326))",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -519;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT DisableDeferredSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -520;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM sqlite_master WHERE name = 'idx_deferred_geom_pending'",
+	 0))
+      {
+	  retcode = -521;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT FlushDeferredSpatialIndex('deferred', 'geom')", 0))
+      {
+	  retcode = -522;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "INSERT INTO deferred (id, geom) VALUES (3003, MakePoint(3, 3, 4326))",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -523;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom", 2902))
+      {
+	  retcode = -524;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -525;
+	  goto end;
+      }
+
+/* disabling a deferred index and then creating it again */
+    if (!do_test_bulk_query
+	(handle, "SELECT EnableDeferredSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -526;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT DisableSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -527;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM sqlite_master WHERE name = 'idx_deferred_geom_pending'",
+	 0))
+      {
+	  retcode = -528;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "DELETE FROM deferred WHERE id <= 100;"
+		      "UPDATE deferred SET geom = MakePoint(500, 500, 4326) WHERE id = 200",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -529;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CreateSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -530;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM sqlite_master WHERE name = 'idx_deferred_geom_pending'",
+	 0))
+      {
+	  retcode = -531;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT (SELECT Count(*) FROM idx_deferred_geom) = "
+	 "(SELECT Count(*) FROM deferred WHERE geom IS NOT NULL)", 1))
+      {
+	  retcode = -532;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM idx_deferred_geom WHERE pkid = 200 AND xmin = 500",
+	 1))
+      {
+	  retcode = -533;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT CheckSpatialIndex('deferred', 'geom')", 1))
+      {
+	  retcode = -534;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "INSERT INTO deferred (id, geom) VALUES (4000, MakePoint(4, 4, 4326))",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "updating table deferred error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -535;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM idx_deferred_geom WHERE pkid = 4000",
+	 1))
+      {
+	  retcode = -536;
+	  goto end;
+      }
+
+  end:
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  if (retcode == 0)
+	      retcode = -537;
+      }
+    spatialite_cleanup_ex (cache);
+    return retcode;
+}
+
+static int
+do_test_index_statistics (void)
+{
+/* testing the R*Tree statistics */
+    int ret;
+    sqlite3 *handle;
+    char *err_msg = NULL;
+    int retcode = 0;
+    void *cache = spatialite_alloc_connection ();
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory database: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  spatialite_cleanup_ex (cache);
+	  return -601;
+      }
+    spatialite_init_ex (handle, cache, 0);
+
+    ret =
+	sqlite3_exec (handle, "SELECT InitSpatialMetadata(1, 'NONE')", NULL,
+		      NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "InitSpatialMetadata() error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -602;
+	  goto end;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE stats (id INTEGER PRIMARY KEY, code INTEGER);"
+		      "SELECT AddGeometryColumn('stats', 'geom', 4326, 'POINT', 'XY');"
+		      "SELECT CreateSpatialIndex('stats', 'geom');"
+		      "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+		      "INSERT INTO stats (id, code, geom) SELECT i, i % 5, "
+		      "MakePoint((i % 100) * 2.0, (i / 100) * 2.0, 4326) FROM n",
+		      NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "creating table stats error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  retcode = -603;
+	  goto end;
+      }
+
+/* the statistics are collected by UpdateLayerStatistics() */
+    if (!do_test_bulk_query
+	(handle, "SELECT UpdateLayerStatistics('stats', 'geom')", 1))
+      {
+	  retcode = -604;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT row_count FROM spatial_index_statistics "
+	 "WHERE f_table_name = 'stats' AND f_geometry_column = 'geom'", 5000))
+      {
+	  retcode = -605;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT tree_depth >= 1 AND node_count >= 1 AND length(histogram) = 1024 "
+	 "FROM spatial_index_statistics WHERE f_table_name = 'stats'", 1))
+      {
+	  retcode = -606;
+	  goto end;
+      }
+
+/* SpatialIndex queries (sub-query and JOIN) */
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM stats WHERE code = 1 AND ROWID IN "
+	 "(SELECT ROWID FROM SpatialIndex WHERE f_table_name = 'stats' "
+	 "AND search_frame = BuildMbr(9, 9, 21, 21))", 6))
+      {
+	  retcode = -607;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle,
+	 "SELECT Count(*) FROM stats AS s, SpatialIndex AS i "
+	 "WHERE i.f_table_name = 'stats' AND i.f_geometry_column = 'geom' "
+	 "AND i.search_frame = BuildMbr(9, 9, 21, 21) "
+	 "AND s.ROWID = i.ROWID AND s.code = 1", 6))
+      {
+	  retcode = -608;
+	  goto end;
+      }
+
+/* dropping the table removes its statistics */
+    if (!do_test_bulk_query (handle, "SELECT DropGeoTable('stats')", 1))
+      {
+	  retcode = -609;
+	  goto end;
+      }
+    if (!do_test_bulk_query
+	(handle, "SELECT Count(*) FROM spatial_index_statistics", 0))
+      {
+	  retcode = -610;
+	  goto end;
+      }
+
+  end:
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  if (retcode == 0)
+	      retcode = -611;
+      }
+    spatialite_cleanup_ex (cache);
+    return retcode;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1885,6 +2541,27 @@ main (int argc, char *argv[])
 
 #endif /* end ICONV conditional */
 
+/* testing R*Tree bulk loading */
+    if (do_test_bulk_load () != 0)
+      {
+	  fprintf (stderr, "error while testing R*Tree bulk loading\n");
+	  return -400;
+      }
+
+/* testing the deferred SpatialIndex mode */
+    if (do_test_deferred_index () != 0)
+      {
+	  fprintf (stderr, "error while testing deferred SpatialIndex\n");
+	  return -500;
+      }
+
+/* testing the R*Tree statistics */
+    if (do_test_index_statistics () != 0)
+      {
+	  fprintf (stderr, "error while testing R*Tree statistics\n");
+	  return -600;
+      }
+
     if (argc > 1 || argv[0] == NULL)
 	argc = 1;		/* silencing stupid compiler warnings */
 
@@ -44,6 +44,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #include "config.h"
 
@@ -428,6 +429,297 @@ test_knn (sqlite3 * sqlite, int mode)
     return 0;
 }
 
+static int
+create_knn_batch (sqlite3 * sqlite)
+{
+/* creating the KNN Batch table and the Query Points */
+    int ret;
+    char *err_msg = NULL;
+    const char *sql;
+    sqlite3_stmt *stmt;
+    double x;
+    double y;
+
+    sql = "CREATE VIRTUAL TABLE knn_batch USING VirtualKNNBatch ()";
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE \"knn_batch\" error: %s\n",
+		   err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+
+    sql = "CREATE TABLE ref_points (id INTEGER PRIMARY KEY AUTOINCREMENT)";
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE TABLE \"ref_points\" error: %s\n",
+		   err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+
+    sql =
+	"SELECT AddGeometryColumn('ref_points', 'geom', 32632, 'POINT', 'XY')";
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "AddGeometryColumn \"ref_points.geom\" error: %s\n",
+		   err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+
+    sql = "INSERT INTO ref_points VALUES (NULL, MakePoint(?, ?, 32632))";
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (y = 3800000.25; y < 4002000.0; y += 12345.12345)
+      {
+	  for (x = 80000.25; x < 102000.0; x += 12345.12345)
+	    {
+		sqlite3_reset (stmt);
+		sqlite3_clear_bindings (stmt);
+		sqlite3_bind_double (stmt, 1, x);
+		sqlite3_bind_double (stmt, 2, y);
+		ret = sqlite3_step (stmt);
+		if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+		    ;
+		else
+		  {
+		      fprintf (stderr, "INSERT error: %s\n",
+			       sqlite3_errmsg (sqlite));
+		      sqlite3_finalize (stmt);
+		      return 0;
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+
+    return 1;
+}
+
+static int
+check_knn_batch_item (sqlite3_stmt * stmt_brute, sqlite3_stmt * stmt_dist,
+		      sqlite3_int64 q_rowid, int pos, sqlite3_int64 fid,
+		      double distance)
+{
+/* comparing a KNN Batch item against a brute force search */
+    int ret;
+    sqlite3_int64 brute_fid;
+    double brute_dist;
+
+    sqlite3_reset (stmt_brute);
+    sqlite3_clear_bindings (stmt_brute);
+    sqlite3_bind_int64 (stmt_brute, 1, q_rowid);
+    sqlite3_bind_int (stmt_brute, 2, pos - 1);
+    ret = sqlite3_step (stmt_brute);
+    if (ret != SQLITE_ROW)
+	return 0;
+    brute_fid = sqlite3_column_int64 (stmt_brute, 0);
+    brute_dist = sqlite3_column_double (stmt_brute, 1);
+    if (fabs (brute_dist - distance) > 0.000001)
+      {
+	  fprintf (stderr,
+		   "KNN Batch q_rowid=%lld pos=%d: distance %1.6f (expected %1.6f)\n",
+		   q_rowid, pos, distance, brute_dist);
+	  return 0;
+      }
+    if (brute_fid == fid)
+	return 1;
+
+/* a different fid is only acceptable for equidistant items */
+    sqlite3_reset (stmt_dist);
+    sqlite3_clear_bindings (stmt_dist);
+    sqlite3_bind_int64 (stmt_dist, 1, fid);
+    sqlite3_bind_int64 (stmt_dist, 2, q_rowid);
+    ret = sqlite3_step (stmt_dist);
+    if (ret == SQLITE_ROW
+	&& fabs (sqlite3_column_double (stmt_dist, 0) - distance) <= 0.000001)
+	return 1;
+    fprintf (stderr,
+	     "KNN Batch q_rowid=%lld pos=%d: fid %lld (expected %lld)\n",
+	     q_rowid, pos, fid, brute_fid);
+    return 0;
+}
+
+static int
+test_knn_batch (sqlite3 * sqlite, int mode)
+{
+/* testing a KNN Batch resultset */
+    int ret;
+    const char *sql;
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_stmt *stmt_brute = NULL;
+    sqlite3_stmt *stmt_dist = NULL;
+    sqlite3_int64 q_rowid = -1;
+    int pos = 0;
+    double dist = 0.0;
+    int rows = 0;
+    int queries = 0;
+
+    switch (mode)
+      {
+      case 0:
+	  sql =
+	      "SELECT * FROM knn_batch WHERE f_table_name = 'DB=main.points' "
+	      "AND f_geometry_column = 'geom' AND q_table_name = 'ref_points' "
+	      "AND max_items = 5";
+	  break;
+      case 1:
+	  sql =
+	      "SELECT * FROM knn_batch WHERE f_table_name = 'points' "
+	      "AND q_table_name = 'ref_points'";
+	  break;
+      case 2:
+	  sql =
+	      "SELECT * FROM knn_batch WHERE f_table_name = 'points' "
+	      "AND f_geometry_column = 'geom' AND q_table_name = 'ref_pointsx'";
+	  break;
+      };
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SELECT FROM \"knn_batch\": \"%s\"\n",
+		   sqlite3_errmsg (sqlite));
+	  return 0;
+      }
+
+/* brute force searches used for cross-checking the first Query Points */
+    sql = "SELECT p.ROWID, ST_Distance(p.geom, q.geom) "
+	"FROM points AS p, ref_points AS q "
+	"WHERE q.ROWID = ? AND p.geom IS NOT NULL "
+	"ORDER BY 2, 1 LIMIT 1 OFFSET ?";
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_brute, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "KNN Batch brute force: \"%s\"\n",
+		   sqlite3_errmsg (sqlite));
+	  goto error;
+      }
+    sql = "SELECT ST_Distance(p.geom, q.geom) "
+	"FROM points AS p, ref_points AS q WHERE p.ROWID = ? AND q.ROWID = ?";
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt_dist, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "KNN Batch brute force: \"%s\"\n",
+		   sqlite3_errmsg (sqlite));
+	  goto error;
+      }
+
+    while (1)
+      {
+	  /* scrolling the result set rows */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_TEXT
+		    && sqlite3_column_type (stmt, 1) == SQLITE_TEXT
+		    && sqlite3_column_type (stmt, 2) == SQLITE_TEXT
+		    && sqlite3_column_type (stmt, 3) == SQLITE_TEXT
+		    && sqlite3_column_type (stmt, 4) == SQLITE_INTEGER
+		    && sqlite3_column_type (stmt, 5) == SQLITE_INTEGER
+		    && sqlite3_column_type (stmt, 6) == SQLITE_INTEGER
+		    && sqlite3_column_type (stmt, 7) == SQLITE_INTEGER
+		    && sqlite3_column_type (stmt, 8) == SQLITE_FLOAT)
+		    ;
+		else
+		    goto error;
+		if (sqlite3_column_int64 (stmt, 5) != q_rowid)
+		  {
+		      /* a new Query Point */
+		      q_rowid = sqlite3_column_int64 (stmt, 5);
+		      pos = 0;
+		      dist = 0.0;
+		      queries++;
+		  }
+		/* nearest items are expected to come first */
+		if (sqlite3_column_int (stmt, 6) != pos + 1)
+		    goto error;
+		if (sqlite3_column_double (stmt, 8) < dist)
+		    goto error;
+		if (queries <= 3)
+		  {
+		      /* and they must be the true nearest items */
+		      if (!check_knn_batch_item
+			  (stmt_brute, stmt_dist, q_rowid,
+			   sqlite3_column_int (stmt, 6),
+			   sqlite3_column_int64 (stmt, 7),
+			   sqlite3_column_double (stmt, 8)))
+			  goto error;
+		  }
+		pos = sqlite3_column_int (stmt, 6);
+		dist = sqlite3_column_double (stmt, 8);
+		rows++;
+	    }
+	  else
+	      goto error;
+      }
+    if (!rows)
+	goto error;
+    sqlite3_finalize (stmt);
+    sqlite3_finalize (stmt_brute);
+    sqlite3_finalize (stmt_dist);
+    return 1;
+
+  error:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (stmt_brute != NULL)
+	sqlite3_finalize (stmt_brute);
+    if (stmt_dist != NULL)
+	sqlite3_finalize (stmt_dist);
+    return 0;
+}
+
+static int
+test_knn_mirror (sqlite3 * sqlite)
+{
+/* testing the KNN Mirror being invalidated by table changes */
+    int ret;
+    const char *sql;
+    sqlite3_stmt *stmt = NULL;
+    char *err_msg = NULL;
+    sqlite3_int64 new_rowid;
+    int ok = 0;
+
+    sql = "INSERT INTO points (id, geom) VALUES "
+	"(NULL, MakePoint(90000.5, 3900000.5, 32632))";
+    ret = sqlite3_exec (sqlite, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "INSERT INTO \"points\" error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    new_rowid = sqlite3_last_insert_rowid (sqlite);
+
+    sql =
+	"SELECT fid, distance FROM knn WHERE f_table_name = 'points' "
+	"AND f_geometry_column = 'geom' "
+	"AND ref_geometry = MakePoint(90000.5, 3900000.5) AND max_items = 1";
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "SELECT FROM \"knn\": \"%s\"\n",
+		   sqlite3_errmsg (sqlite));
+	  return 0;
+      }
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW)
+      {
+	  /* the newly inserted Point is expected to be the nearest one */
+	  if (sqlite3_column_int64 (stmt, 0) == new_rowid
+	      && sqlite3_column_double (stmt, 1) == 0.0)
+	      ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
 #endif
 
 int
@@ -618,6 +910,92 @@ main (int argc, char *argv[])
 	  return -19;
       }
 
+/* Creating the VirtualKNNBatch table */
+    ret = create_knn_batch (db_handle);
+    if (!ret)
+      {
+	  sqlite3_close (db_handle);
+	  return -20;
+      }
+
+/* Testing KNN Batch - #1 */
+    ret = test_knn_batch (db_handle, 0);
+    if (!ret)
+      {
+	  fprintf (stderr, "Check KNN Batch #1: unexpected failure\n");
+	  sqlite3_close (db_handle);
+	  return -21;
+      }
+
+/* Testing KNN Batch - #2 */
+    ret = test_knn_batch (db_handle, 1);
+    if (ret)
+      {
+	  fprintf (stderr, "Check KNN Batch #2: unexpected success\n");
+	  sqlite3_close (db_handle);
+	  return -22;
+      }
+
+/* Testing KNN Batch - #3 */
+    ret = test_knn_batch (db_handle, 2);
+    if (ret)
+      {
+	  fprintf (stderr, "Check KNN Batch #3: unexpected success\n");
+	  sqlite3_close (db_handle);
+	  return -23;
+      }
+
+/* enabling the KNN Mirror mode */
+    ret =
+	sqlite3_exec (db_handle, "SELECT EnableKnnMirrorMode()", NULL, NULL,
+		      &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "EnableKnnMirrorMode() error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  sqlite3_close (db_handle);
+	  return -24;
+      }
+
+/* Testing KNN Mirror - #1 */
+    ret = test_knn (db_handle, 1);
+    if (!ret)
+      {
+	  fprintf (stderr, "Check KNN Mirror #1: unexpected failure\n");
+	  sqlite3_close (db_handle);
+	  return -25;
+      }
+
+/* Testing KNN Mirror - #2 */
+    ret = test_knn_batch (db_handle, 0);
+    if (!ret)
+      {
+	  fprintf (stderr, "Check KNN Mirror #2: unexpected failure\n");
+	  sqlite3_close (db_handle);
+	  return -26;
+      }
+
+/* Testing KNN Mirror - #3 */
+    ret = test_knn_mirror (db_handle);
+    if (!ret)
+      {
+	  fprintf (stderr, "Check KNN Mirror #3: unexpected failure\n");
+	  sqlite3_close (db_handle);
+	  return -27;
+      }
+
+/* disabling the KNN Mirror mode */
+    ret =
+	sqlite3_exec (db_handle, "SELECT DisableKnnMirrorMode()", NULL, NULL,
+		      &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "DisableKnnMirrorMode() error: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  sqlite3_close (db_handle);
+	  return -28;
+      }
+
 #endif /* end KNN conditional */
 
     sqlite3_close (db_handle);
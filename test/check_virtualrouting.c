@@ -0,0 +1,499 @@
+/*
+
+ check_virtualrouting.c -- SpatiaLite Test Case
+
+ Author: Sandro Furieri <a.furieri@lqt.it>
+
+ ------------------------------------------------------------------------------
+ 
+ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ 
+ The contents of this file are subject to the Mozilla Public License Version
+ 1.1 (the "License"); you may not use this file except in compliance with
+ the License. You may obtain a copy of the License at
+ http://www.mozilla.org/MPL/
+ 
+Software distributed under the License is distributed on an "AS IS" basis,
+WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+for the specific language governing rights and limitations under the
+License.
+
+The Original Code is the SpatiaLite library
+
+The Initial Developer of the Original Code is Alessandro Furieri
+ 
+Portions created by the Initial Developer are Copyright (C) 2011
+the Initial Developer. All Rights Reserved.
+
+Contributor(s):
+
+Alternatively, the contents of this file may be used under the terms of
+either the GNU General Public License Version 2 or later (the "GPL"), or
+the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+in which case the provisions of the GPL or the LGPL are applicable instead
+of those above. If you wish to allow use of your version of this file only
+under the terms of either the GPL or the LGPL, and not to allow others to
+use your version of this file under the terms of the MPL, indicate your
+decision by deleting the provisions above and replace them with the notice
+and other provisions required by the GPL or the LGPL. If you do not delete
+the provisions above, a recipient may use your version of this file under
+the terms of any one of the MPL, the GPL or the LGPL.
+ 
+*/
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+
+#include "sqlite3.h"
+#include "spatialite.h"
+
+/*
+/ VirtualRouting functional tests on a file database:
+/ - the same query workspace (CSR graph, heap, node arrays) is reused
+/   by many consecutive queries of different kinds on the same table;
+/   every answer must match the one of a freshly created table
+/ - a second connection sharing the cached graph must notice both
+/   UpdateRouting (Max(Id) changes) and CreateRouting (schema_version
+/   changes), and must reload the graph before its next query
+*/
+
+#define VR_DB		"copy-virtualrouting.sqlite"
+#define VR_GRID		25
+#define VR_PAIRS	60
+
+static const char *vr_algorithms[] = { "Dijkstra", "BiDijkstra", "CH" };
+
+static int
+do_exec (sqlite3 * handle, const char *sql, const char *title)
+{
+/* executing an SQL statement */
+    char *err_msg = NULL;
+    int ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "%s: %s\n", title, err_msg);
+	  sqlite3_free (err_msg);
+	  return 0;
+      }
+    return 1;
+}
+
+static double
+do_get_cost (sqlite3 * handle, const char *table, int from, int to)
+{
+/* returning the Cost of a Shortest Path; -1.0 if unreachable */
+    int ret;
+    double cost = -1.0;
+    sqlite3_stmt *stmt;
+    char *sql = sqlite3_mprintf ("SELECT Cost FROM \"%s\" WHERE NodeFrom = %d "
+				 "AND NodeTo = %d LIMIT 1", table, from, to);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "%s: %s\n", table, sqlite3_errmsg (handle));
+	  return -2.0;
+      }
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW && sqlite3_column_type (stmt, 0) != SQLITE_NULL)
+	cost = sqlite3_column_double (stmt, 0);
+    else if (ret != SQLITE_ROW && ret != SQLITE_DONE)
+      {
+	  fprintf (stderr, "%s: %s\n", table, sqlite3_errmsg (handle));
+	  cost = -2.0;
+      }
+    sqlite3_finalize (stmt);
+    return cost;
+}
+
+static sqlite3_int64
+do_get_int (sqlite3 * handle, const char *sql)
+{
+/* returning the single INTEGER value of some query */
+    int ret;
+    sqlite3_int64 value = -1;
+    sqlite3_stmt *stmt;
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "%s: %s\n", sql, sqlite3_errmsg (handle));
+	  return -1;
+      }
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+	value = sqlite3_column_int64 (stmt, 0);
+    sqlite3_finalize (stmt);
+    return value;
+}
+
+static int
+do_get_matrix (sqlite3 * handle, const char *sql, sqlite3_int64 * count,
+	       double *sum)
+{
+/* returning the number of cells and the overall Cost of a Matrix */
+    int ret;
+    int ok = 0;
+    sqlite3_stmt *stmt;
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "%s: %s\n", sql, sqlite3_errmsg (handle));
+	  return 0;
+      }
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      {
+	  *count = sqlite3_column_int64 (stmt, 0);
+	  *sum = sqlite3_column_double (stmt, 1);
+	  ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
+static int
+do_create_grid (sqlite3 * handle)
+{
+/* creating a regular grid network with integer-like costs */
+    int ret;
+    int i;
+    int j;
+    int dir;
+    unsigned int seed = 4321;
+    sqlite3_stmt *stmt;
+    const char *sql;
+
+    if (!do_exec (handle, "CREATE TABLE grid_roads (id INTEGER PRIMARY KEY, "
+		  "node_from INTEGER, node_to INTEGER, cost DOUBLE)",
+		  "CREATE TABLE grid_roads"))
+	return 0;
+    sql = "INSERT INTO grid_roads (node_from, node_to, cost) VALUES (?, ?, ?)";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "INSERT INTO grid_roads: %s\n",
+		   sqlite3_errmsg (handle));
+	  return 0;
+      }
+    sqlite3_exec (handle, "BEGIN", NULL, NULL, NULL);
+    for (i = 0; i < VR_GRID; i++)
+      {
+	  for (j = 0; j < VR_GRID; j++)
+	    {
+		for (dir = 0; dir < 2; dir++)
+		  {
+		      int ii = (dir == 0) ? i + 1 : i;
+		      int jj = (dir == 1) ? j + 1 : j;
+		      if (ii >= VR_GRID || jj >= VR_GRID)
+			  continue;
+		      seed = (seed * 1103515245) + 12345;
+		      sqlite3_reset (stmt);
+		      sqlite3_clear_bindings (stmt);
+		      sqlite3_bind_int (stmt, 1, (i * VR_GRID) + j + 1);
+		      sqlite3_bind_int (stmt, 2, (ii * VR_GRID) + jj + 1);
+		      sqlite3_bind_double (stmt, 3,
+					   (double) (1 + ((seed >> 16) % 9)));
+		      ret = sqlite3_step (stmt);
+		      if (ret != SQLITE_DONE)
+			{
+			    fprintf (stderr, "INSERT INTO grid_roads: %s\n",
+				     sqlite3_errmsg (handle));
+			    sqlite3_finalize (stmt);
+			    return 0;
+			}
+		  }
+	    }
+      }
+    sqlite3_finalize (stmt);
+    sqlite3_exec (handle, "COMMIT", NULL, NULL, NULL);
+    return do_exec (handle,
+		    "SELECT CreateRouting('grid_data', 'grid_net', 'grid_roads', "
+		    "'node_from', 'node_to', NULL, 'cost', NULL, 0, 1, NULL, "
+		    "NULL, 0, 1)", "CreateRouting grid");
+}
+
+static int
+do_test_workspace (sqlite3 * handle)
+{
+/* reusing the same VirtualRouting workspace for many queries */
+    int ret;
+    int i;
+    int k;
+    int n_nodes = VR_GRID * VR_GRID;
+    double costs[3][VR_PAIRS];
+    char *sql;
+    sqlite3_int64 count;
+    double sum;
+
+    for (i = 0; i < VR_PAIRS; i++)
+      {
+	  int from = ((i * 37) % n_nodes) + 1;
+	  int to = (((i * 101) + 17) % n_nodes) + 1;
+	  for (k = 0; k < 3; k++)
+	    {
+		sql = sqlite3_mprintf ("UPDATE grid_net SET Algorithm = %Q",
+				       vr_algorithms[k]);
+		if (!do_exec (handle, sql, "UPDATE grid_net"))
+		  {
+		      sqlite3_free (sql);
+		      return -1;
+		  }
+		sqlite3_free (sql);
+		costs[k][i] = do_get_cost (handle, "grid_net", from, to);
+		if (costs[k][i] < 0.0)
+		    return -2;
+	    }
+	  /* a Range query and a Matrix request between the Shortest Paths */
+	  sql = sqlite3_mprintf ("SELECT Count(*) FROM grid_net "
+				 "WHERE NodeFrom = %d AND Cost <= 12.0", to);
+	  count = do_get_int (handle, sql);
+	  sqlite3_free (sql);
+	  if (count <= 0)
+	    {
+		fprintf (stderr, "grid_net: unexpected Range count %d\n",
+			 (int) count);
+		return -3;
+	    }
+	  if (!do_exec (handle, "UPDATE grid_net SET Request = 'Matrix'",
+			"UPDATE grid_net"))
+	      return -4;
+	  sql = sqlite3_mprintf ("SELECT Count(*), Sum(Cost) FROM grid_net "
+				 "WHERE NodeFrom = '%d,%d' AND NodeTo = '%d,%d'",
+				 from, to, to, from);
+	  ret = do_get_matrix (handle, sql, &count, &sum);
+	  sqlite3_free (sql);
+	  if (!ret || count != 4 || fabs (sum - (2.0 * costs[0][i])) > 0.000001)
+	    {
+		fprintf (stderr, "grid_net: unexpected Matrix %d cells %1.6f\n",
+			 (int) count, sum);
+		return -5;
+	    }
+	  if (!do_exec (handle,
+			"UPDATE grid_net SET Request = 'Shortest Path'",
+			"UPDATE grid_net"))
+	      return -6;
+      }
+
+    for (i = 0; i < VR_PAIRS; i++)
+      {
+	  /* a fresh VirtualRouting table has a brand new workspace */
+	  int from = ((i * 37) % n_nodes) + 1;
+	  int to = (((i * 101) + 17) % n_nodes) + 1;
+	  double cost;
+	  if (!do_exec (handle,
+			"CREATE VIRTUAL TABLE grid_fresh USING VirtualRouting('grid_data')",
+			"CREATE VIRTUAL TABLE grid_fresh"))
+	      return -7;
+	  cost = do_get_cost (handle, "grid_fresh", from, to);
+	  if (!do_exec (handle, "DROP TABLE grid_fresh", "DROP TABLE grid_fresh"))
+	      return -8;
+	  for (k = 0; k < 3; k++)
+	    {
+		if (fabs (costs[k][i] - cost) > 0.000001)
+		  {
+		      fprintf (stderr,
+			       "grid_net: %s %d -> %d unexpected cost %1.6f (expected %1.6f)\n",
+			       vr_algorithms[k], from, to, costs[k][i], cost);
+		      return -9;
+		  }
+	    }
+      }
+    return 0;
+}
+
+static int
+do_create_small (sqlite3 * handle)
+{
+/* creating a small directed network */
+    if (!do_exec (handle, "CREATE TABLE small_roads (id INTEGER PRIMARY KEY, "
+		  "node_from INTEGER, node_to INTEGER, cost DOUBLE)",
+		  "CREATE TABLE small_roads"))
+	return 0;
+    if (!do_exec (handle, "INSERT INTO small_roads VALUES "
+		  "(1, 1, 2, 10), (2, 2, 3, 10), (3, 1, 4, 4), (4, 4, 5, 4), "
+		  "(5, 5, 6, 4), (6, 6, 3, 4), (7, 2, 5, 3)",
+		  "INSERT INTO small_roads"))
+	return 0;
+    return do_exec (handle,
+		    "SELECT CreateRouting('small_data', 'small_net', 'small_roads', "
+		    "'node_from', 'node_to', NULL, 'cost', NULL, 0, 0, NULL, NULL, 1)",
+		    "CreateRouting small");
+}
+
+static int
+do_check_both (sqlite3 * handle, sqlite3 * handle2, double expected)
+{
+/* both connections must return the same (expected) Cost */
+    double cost = do_get_cost (handle, "small_net", 1, 3);
+    double cost2 = do_get_cost (handle2, "small_net2", 1, 3);
+    if (cost != expected || cost2 != expected)
+      {
+	  fprintf (stderr,
+		   "small_net: unexpected cost %1.6f / %1.6f (expected %1.6f)\n",
+		   cost, cost2, expected);
+	  return 0;
+      }
+    return 1;
+}
+
+static int
+do_test_reload (sqlite3 * handle, void *cache2)
+{
+/* a second connection must notice any change of the routing data */
+    int ret;
+    int result = 0;
+    sqlite3 *handle2;
+    sqlite3_int64 max_id;
+    sqlite3_int64 schema;
+
+    if (!do_create_small (handle))
+	return -1;
+    ret = sqlite3_open_v2 (VR_DB, &handle2, SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open %s database: %s\n", VR_DB,
+		   sqlite3_errmsg (handle2));
+	  sqlite3_close (handle2);
+	  return -2;
+      }
+    spatialite_init_ex (handle2, cache2, 0);
+    if (!do_exec (handle2,
+		  "CREATE VIRTUAL TABLE small_net2 USING VirtualRouting('small_data')",
+		  "CREATE VIRTUAL TABLE small_net2"))
+      {
+	  result = -3;
+	  goto end;
+      }
+    if (!do_check_both (handle, handle2, 16.0))
+      {
+	  result = -4;
+	  goto end;
+      }
+
+/* UpdateRouting: the Max(Id) of the routing data changes */
+    max_id = do_get_int (handle, "SELECT Max(Id) FROM small_data");
+    if (!do_exec (handle, "CREATE TABLE small_changes AS "
+		  "SELECT 3 AS link_id, 1 AS node_from, 4 AS node_to, "
+		  "20.0 AS cost", "CREATE TABLE small_changes"))
+      {
+	  result = -5;
+	  goto end;
+      }
+    if (!do_exec (handle, "SELECT UpdateRouting('small_data', 'small_changes')",
+		  "UpdateRouting"))
+      {
+	  result = -6;
+	  goto end;
+      }
+    if (do_get_int (handle, "SELECT Max(Id) FROM small_data") <= max_id)
+      {
+	  fprintf (stderr, "UpdateRouting: unchanged Max(Id)\n");
+	  result = -7;
+	  goto end;
+      }
+    if (!do_check_both (handle, handle2, 20.0))
+      {
+	  result = -8;
+	  goto end;
+      }
+
+/* CreateRouting: the schema_version changes */
+    schema = do_get_int (handle2, "PRAGMA schema_version");
+    if (!do_exec (handle, "UPDATE small_roads SET cost = 1 WHERE id = 6",
+		  "UPDATE small_roads"))
+      {
+	  result = -9;
+	  goto end;
+      }
+    if (!do_exec (handle,
+		  "SELECT CreateRouting('small_data', 'small_net', 'small_roads', "
+		  "'node_from', 'node_to', NULL, 'cost', NULL, 0, 0, NULL, NULL, 1)",
+		  "CreateRouting small #2"))
+      {
+	  result = -10;
+	  goto end;
+      }
+    if (do_get_int (handle2, "PRAGMA schema_version") == schema)
+      {
+	  fprintf (stderr, "CreateRouting: unchanged schema_version\n");
+	  result = -11;
+	  goto end;
+      }
+    if (!do_check_both (handle, handle2, 13.0))
+      {
+	  result = -12;
+	  goto end;
+      }
+
+  end:
+    ret = sqlite3_close (handle2);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle2));
+	  return -13;
+      }
+    return result;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int ret;
+    sqlite3 *handle;
+    void *cache = spatialite_alloc_connection ();
+    void *cache2 = spatialite_alloc_connection ();
+
+    if (argc > 1 || argv[0] == NULL)
+	argc = 1;		/* silencing stupid compiler warnings */
+
+    unlink (VR_DB);
+    ret =
+	sqlite3_open_v2 (VR_DB, &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open %s database: %s\n", VR_DB,
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -1;
+      }
+    spatialite_init_ex (handle, cache, 0);
+
+    if (!do_create_grid (handle))
+	return -2;
+    ret = do_test_workspace (handle);
+    if (ret != 0)
+      {
+	  fprintf (stderr, "Workspace reuse error: %d\n", ret);
+	  return -3;
+      }
+
+    ret = do_test_reload (handle, cache2);
+    if (ret != 0)
+      {
+	  fprintf (stderr, "Cross-connection reload error: %d\n", ret);
+	  return -4;
+      }
+
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -5;
+      }
+
+    spatialite_cleanup_ex (cache);
+    spatialite_cleanup_ex (cache2);
+    spatialite_shutdown ();
+    ret = unlink (VR_DB);
+    if (ret != 0)
+      {
+	  fprintf (stderr, "cannot remove %s database\n", VR_DB);
+	  return -6;
+      }
+    return 0;
+}
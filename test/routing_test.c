@@ -838,6 +838,144 @@ do_point2point (sqlite3 * handle, sqlite3_stmt * stmt)
     return count;
 }
 
+static double
+do_ch_cost (sqlite3 * handle, sqlite3_stmt * stmt_alg, sqlite3_stmt * stmt,
+	    const char *algorithm)
+{
+/* fetching the total cost of a Shortest Path solution */
+    int ret;
+    double cost = -1.0;
+
+    sqlite3_reset (stmt_alg);
+    sqlite3_clear_bindings (stmt_alg);
+    sqlite3_bind_text (stmt_alg, 1, algorithm, -1, SQLITE_STATIC);
+    sqlite3_step (stmt_alg);
+
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_text (stmt, 1, "RT05301806875GZ", -1, SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 2, "RT05301806761GZ", -1, SQLITE_STATIC);
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_int (stmt, 1) != 0)
+		    continue;	/* not the route header */
+		if (strcmp
+		    ((const char *) sqlite3_column_text (stmt, 0),
+		     algorithm) != 0)
+		    return -1.0;
+		cost = sqlite3_column_double (stmt, 2);
+	    }
+	  else
+	    {
+		fprintf (stderr, "Contraction Hierarchies #3: %s\n",
+			 sqlite3_errmsg (handle));
+		return -1.0;
+	    }
+      }
+    return cost;
+}
+
+static int
+do_test_ch (sqlite3 * handle)
+{
+/* testing Contraction Hierarchies */
+    const char *sql;
+    char *err_msg = NULL;
+    sqlite3_stmt *stmt_alg = NULL;
+    sqlite3_stmt *stmt = NULL;
+    double cost_dijkstra;
+    double cost_ch;
+    double cost_bidi;
+    int ret;
+    int result = 0;
+
+    sql =
+	"SELECT CreateRouting('test_ch_data', 'test_ch', 'roads', 'node_from', "
+	"'node_to', NULL, 'cost', 'road_name', 0, 1, 'oneway_from_to', "
+	"'oneway_to_from', 0, 1)";
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Contraction Hierarchies #1: %s\n", err_msg);
+	  sqlite3_free (err_msg);
+	  return -1;
+      }
+
+    sql = "UPDATE test_ch SET Algorithm = ?";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt_alg, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Contraction Hierarchies #2: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -2;
+      }
+    sql = "SELECT Algorithm, RouteRow, Cost FROM test_ch "
+	"WHERE NodeFrom = ? AND NodeTo = ?";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Contraction Hierarchies #2: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_finalize (stmt_alg);
+	  return -3;
+      }
+
+/* CH and Dijkstra are expected to find the same Shortest Path cost */
+    cost_dijkstra = do_ch_cost (handle, stmt_alg, stmt, "Dijkstra");
+    cost_ch = do_ch_cost (handle, stmt_alg, stmt, "CH");
+    if (cost_dijkstra <= 0.0 || cost_ch <= 0.0)
+      {
+	  fprintf (stderr, "Contraction Hierarchies: unexpected cost\n");
+	  result = -4;
+	  goto end;
+      }
+    if (cost_ch > cost_dijkstra + 0.000001)
+      {
+	  fprintf (stderr,
+		   "Contraction Hierarchies: unexpected cost %1.6f (expected %1.6f)\n",
+		   cost_ch, cost_dijkstra);
+	  result = -5;
+	  goto end;
+      }
+
+/* so is the bidirectional Dijkstra */
+    cost_bidi = do_ch_cost (handle, stmt_alg, stmt, "Bidirectional Dijkstra");
+    if (cost_bidi <= 0.0 || cost_bidi > cost_dijkstra + 0.000001)
+      {
+	  fprintf (stderr,
+		   "Bidirectional Dijkstra: unexpected cost %1.6f (expected %1.6f)\n",
+		   cost_bidi, cost_dijkstra);
+	  result = -8;
+	  goto end;
+      }
+
+/* multiple destinations */
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    sql = "SELECT * FROM test_ch WHERE NodeFrom = ? AND NodeTo = ?";
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "Contraction Hierarchies #4: %s\n",
+		   sqlite3_errmsg (handle));
+	  result = -6;
+	  goto end;
+      }
+    if (do_routing (handle, stmt, "test_ch", 0, 1) <= 0)
+	result = -7;
+
+  end:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    sqlite3_finalize (stmt_alg);
+    return result;
+}
+
 static int
 do_create_routing_nodes (sqlite3 * handle)
 {
@@ -1499,6 +1637,14 @@ main (int argc, char *argv[])
 	  return -45;
       }
 
+/* testing Contraction Hierarchies */
+    ret = do_test_ch (handle);
+    if (ret != 0)
+      {
+	  fprintf (stderr, "Test Contraction Hierarchies error\n");
+	  return -48;
+      }
+
 /* testing invalid cases */
     ret = do_test_invalid (handle);
     if (ret != 0)